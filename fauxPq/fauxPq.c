@@ -561,6 +561,24 @@ pq_suspend(unsigned int maxsleep)
 }
 
 
+/*
+ * Suspends the current thread like pq_suspend().  The faux product-queue has
+ * no insertion-counter, so this is the same as pq_suspend().
+ *
+ * pq                The product-queue.  Ignored.
+ * maxsleep          The amount of time to sleep in seconds.  If zero, then
+ *                   the sleep is indefinite.
+ *
+ * Returns:
+ *   0               Success.
+ */
+unsigned
+pq_wait(pqueue* const pq, unsigned int maxsleep)
+{
+        return pq_suspend(maxsleep);
+}
+
+
 /*
  * Get some detailed product queue statistics.  These may be useful for
  * monitoring the internal state of the product queue:
@@ -1005,11 +1005,21 @@ int main(
             log_debug("tcp sock: %d", sock);
         }
 
+        /*
+         * Set how child processes map the product-queue. Only this process
+         * pre-faults it -- to load it into the page-cache -- because children
+         * come and go.
+         */
+        if (pq_setMapDefaults(getQueueMapFlags() & ~PQ_POPULATE,
+                getQueueNumaNode()))
+            log_flush_warning();
+
         /*
          * Verify that the product-queue can be open for writing.
          */
         log_debug("main(): Opening product-queue");
-        if ((status = pq_open(pqfname, PQ_DEFAULT, &pq))) {
+        if ((status = pq_open(pqfname, getQueueMapFlags() & PQ_POPULATE,
+                &pq))) {
             if (PQ_CORRUPT == status) {
                 log_error_q("The product-queue \"%s\" is inconsistent", pqfname);
             }
@@ -4,6 +4,8 @@
 
 #include "RegularExpressions.h"
 
+#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 
 
@@ -55,3 +57,259 @@ re_vetSpec(
 
     return wasConverted;
 }
+
+
+/*
+ * The strings of literal characters found so far by re_requiredLiterals():
+ * each is 0-terminated and the last is the run being accumulated. Because
+ * each literal character comes from at least one character of the
+ * specification and each terminating 0 replaces another (or the end), they
+ * fit in the buffer.
+ */
+typedef struct {
+    char*       buf;            /* literals */
+    size_t      len;            /* bytes used in `buf` */
+    size_t      runLen;         /* length of current run */
+    size_t      count;          /* number of literals before current run */
+    int         anchored;       /* first literal begins matching strings? */
+    int         runAnchored;    /* current run begins matching strings? */
+} Literals;
+
+
+static void
+lit_append(
+    Literals* const     lit,
+    const int           c)
+{
+    lit->buf[lit->len++] = (char)c;
+    lit->runLen++;
+}
+
+
+static void
+lit_endRun(
+    Literals* const     lit)
+{
+    if (lit->runLen > 0) {
+        if (lit->count++ == 0)
+            lit->anchored = lit->runAnchored;
+        lit->buf[lit->len++] = 0;
+        lit->runLen = 0;
+    }
+    lit->runAnchored = 0;
+}
+
+
+/*
+ * Returns a pointer to the character after a bracket expression.
+ *
+ * Arguments:
+ *      cp      Pointer to the '[' that begins the bracket expression.
+ *
+ * Returns:
+ *      NULL    The bracket expression isn't terminated.
+ *      else    Pointer to the character after the closing ']'.
+ */
+static const char*
+skipBracket(
+    const char*         cp)
+{
+    if (*++cp == '^')
+        cp++;
+    if (*cp == ']')
+        cp++;                           /* literal ']' */
+
+    for (; *cp != 0; cp++) {
+        if (*cp == ']')
+            return cp + 1;
+
+        if (*cp == '[' && (cp[1] == ':' || cp[1] == '.' || cp[1] == '=')) {
+            const char  delim = cp[1];
+
+            for (cp += 2; *cp != 0 && !(*cp == delim && cp[1] == ']'); cp++)
+                ;
+            if (*cp++ == 0)
+                return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Returns a pointer to the character after a parenthesized subexpression.
+ *
+ * Arguments:
+ *      cp      Pointer to the '(' that begins the subexpression.
+ *
+ * Returns:
+ *      NULL    The subexpression isn't terminated.
+ *      else    Pointer to the character after the matching ')'.
+ */
+static const char*
+skipGroup(
+    const char*         cp)
+{
+    int depth = 0;
+
+    while (*cp != 0) {
+        if (*cp == '\\') {
+            if (cp[1] == 0)
+                return NULL;
+            cp += 2;
+        }
+        else if (*cp == '[') {
+            if ((cp = skipBracket(cp)) == NULL)
+                return NULL;
+        }
+        else {
+            if (*cp == '(')
+                depth++;
+            else if (*cp == ')' && --depth == 0)
+                return cp + 1;
+            cp++;
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Returns the strings of literal characters that every string matched by an
+ * extended regular-expression must contain. The strings are determined
+ * conservatively: if the specification has an alternation at its top level or
+ * a construct that isn't understood, then none are returned. Used to avoid
+ * executing a regular-expression on a string that can't match it.
+ *
+ * Arguments:
+ *      spec            Pointer to 0-terminated extended regular expression
+ *                      specification. Must not be NULL.
+ *      literals        Pointer to a buffer of at least `strlen(spec)+2` bytes
+ *                      for the literals, in order of appearance. Each is
+ *                      0-terminated and the last is followed by an empty
+ *                      string.
+ *      anchored        Pointer to an indicator that's set to 1 if and only if
+ *                      the first literal must begin a matching string.
+ *
+ * Returns:
+ *      The number of literals. 0 means none was found.
+ */
+size_t
+re_requiredLiterals(
+    const char* const   spec,
+    char* const         literals,
+    int* const          anchored)
+{
+    Literals            lit = {literals, 0, 0, 0, 0, 0};
+    const char*         cp = spec;
+    int                 haveAtom = 0;   /* an atom precedes `cp` */
+    int                 lastLit = 0;    /* ... and it's the run's last char */
+    int                 lastQuant = 0;  /* a quantifier precedes `cp` */
+
+    if (*cp == '^') {
+        cp++;
+        lit.runAnchored = 1;
+    }
+
+    while (*cp != 0) {
+        int     c = (unsigned char)*cp;
+
+        if (c == '*' || c == '+' || c == '?' || c == '{') {
+            int optional;
+
+            if (!haveAtom || lastQuant)
+                goto none;
+
+            if (c == '{') {
+                const char* end;
+
+                if (!isdigit((unsigned char)cp[1]) ||
+                        (end = strchr(cp, '}')) == NULL)
+                    goto none;
+                optional = strtol(cp+1, NULL, 10) == 0;
+                cp = end + 1;
+            }
+            else {
+                optional = c != '+';
+                cp++;
+            }
+
+            if (lastLit) {
+                /*
+                 * The quantified character might be absent or repeated, so
+                 * the run can't continue past it.
+                 */
+                if (optional) {
+                    lit.len--;
+                    lit.runLen--;
+                }
+                lit_endRun(&lit);
+            }
+            lastLit = 0;
+            lastQuant = 1;
+            continue;
+        }
+
+        lastQuant = 0;
+        lastLit = 0;
+        haveAtom = 1;
+
+        if (c == '|' || c == ')') {
+            goto none;
+        }
+        else if (c == '\\') {
+            c = (unsigned char)cp[1];
+            if (c == 0)
+                goto none;
+            cp += 2;
+            if (isalnum(c) || strchr("<>`'", c) != NULL) {
+                /* Back-reference or GNU operator */
+                lit_endRun(&lit);
+                continue;
+            }
+        }
+        else if (c == '[') {
+            if ((cp = skipBracket(cp)) == NULL)
+                goto none;
+            lit_endRun(&lit);
+            continue;
+        }
+        else if (c == '(') {
+            if ((cp = skipGroup(cp)) == NULL)
+                goto none;
+            lit_endRun(&lit);
+            continue;
+        }
+        else if (c == '.') {
+            cp++;
+            lit_endRun(&lit);
+            continue;
+        }
+        else if (c == '^' || c == '$') {
+            cp++;
+            haveAtom = 0;
+            lit_endRun(&lit);
+            continue;
+        }
+        else {
+            cp++;
+        }
+
+        lit_append(&lit, c);
+        lastLit = 1;
+    }
+
+    lit_endRun(&lit);
+    literals[lit.len] = 0;
+    *anchored = lit.anchored;
+
+    return lit.count;
+
+none:
+    *literals = 0;
+    *anchored = 0;
+
+    return 0;
+}
@@ -1,6 +1,8 @@
 #ifndef REGULAR_EXPRESSIONS_H
 #define REGULAR_EXPRESSIONS_H
 
+#include <stddef.h>
+
 
 /*
  * Indicates if a regular-expression specification is pathological or not.
@@ -35,4 +37,31 @@ int
 re_vetSpec(
     char* const spec);
 
+
+/*
+ * Returns the strings of literal characters that every string matched by an
+ * extended regular-expression must contain. The strings are determined
+ * conservatively: if the specification has an alternation at its top level or
+ * a construct that isn't understood, then none are returned. Used to avoid
+ * executing a regular-expression on a string that can't match it.
+ *
+ * Arguments:
+ *      spec            Pointer to 0-terminated extended regular expression
+ *                      specification. Must not be NULL.
+ *      literals        Pointer to a buffer of at least `strlen(spec)+2` bytes
+ *                      for the literals, in order of appearance. Each is
+ *                      0-terminated and the last is followed by an empty
+ *                      string.
+ *      anchored        Pointer to an indicator that's set to 1 if and only if
+ *                      the first literal must begin a matching string.
+ *
+ * Returns:
+ *      The number of literals. 0 means none was found.
+ */
+size_t
+re_requiredLiterals(
+    const char* const   spec,
+    char* const         literals,
+    int* const          anchored);
+
 #endif
@@ -0,0 +1,552 @@
+/*
+ *   Copyright 2026 University Corporation for Atmospheric Research
+ *
+ *   See file COPYRIGHT in the top-level source-directory for copying and
+ *   redistribution conditions.
+ */
+/**
+ * Single-producer/single-consumer ring of records in POSIX shared-memory. See
+ * "shmring.h" for the protocol between pqact(1) and a decoder.
+ *
+ * The segment starts with a header page followed by the data area. The
+ * producer only writes `head` and the consumer only writes `tail`; both are
+ * byte-offsets that only increase and that are reduced modulo the capacity
+ * when the data area is indexed. Each record is 8-byte aligned and starts with
+ * a `rec_hdr`. A record that wouldn't fit before the end of the data area is
+ * preceded by a padding record that fills the remainder.
+ */
+#include "config.h"
+
+#include "log.h"
+#include "shmring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHMRING_MAGIC   0x524d444cu     // "LDMR" in little-endian
+#define SHMRING_VERSION 1u
+#define SHMRING_HELLO   "LDM-SHMRING"   // First token of the line on the pipe
+#define SHMRING_ALIGN   8u
+#define SHMRING_DATA    4096u           // Offset of the data area
+#define SHMRING_LINE    128             // Maximum length of the line on the pipe
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;          ///< Size of the data area in bytes
+    char     pad0[48];
+    uint64_t head;              ///< Written by the producer
+    char     pad1[56];
+    uint64_t tail;              ///< Written by the consumer
+    char     pad2[56];
+} shm_hdr;
+
+typedef struct {
+    uint32_t size;              ///< Size of the record's payload in bytes
+    uint32_t type;              ///< REC_DATA or REC_PAD
+} rec_hdr;
+
+enum {
+    REC_DATA = 1,
+    REC_PAD
+};
+
+struct shmring {
+    shm_hdr* hdr;               ///< Start of the mapping
+    char*    data;              ///< Start of the data area
+    size_t   mapSize;           ///< Size of the mapping in bytes
+    uint64_t capacity;          ///< Size of the data area in bytes
+    uint64_t pos;               ///< Local copy of `head` or `tail`
+    uint64_t pending;           ///< Bytes of record returned by `shmring_next()`
+    int      fd;                ///< Pipe to/from the other process
+    char     name[64];          ///< Name of the shared-memory segment
+};
+
+static unsigned long ringCount; ///< Number of rings created by this process
+
+static inline uint64_t
+roundUp(const uint64_t n)
+{
+    return (n + SHMRING_ALIGN - 1) & ~(uint64_t)(SHMRING_ALIGN - 1);
+}
+
+static inline uint64_t
+loadAcquire(const uint64_t* const ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+storeRelease(uint64_t* const ptr, const uint64_t value)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+static void
+sleepBriefly(void)
+{
+    const struct timespec duration = {0, 200000}; // 200 µs
+    (void)nanosleep(&duration, NULL);
+}
+
+/**
+ * Maps a shared-memory segment.
+ *
+ * @param[in]  shmFd    File descriptor of the segment
+ * @param[in]  mapSize  Size of the segment in bytes
+ * @param[in]  prot     Memory protection of the mapping
+ * @param[out] ring     Ring whose `hdr`, `data`, and `mapSize` are set
+ * @retval     0        Success
+ * @return              `errno` error-code
+ */
+static int
+mapSegment(
+        const int      shmFd,
+        const size_t   mapSize,
+        const int      prot,
+        shmring* const ring)
+{
+    void* const addr = mmap(NULL, mapSize, prot, MAP_SHARED, shmFd, 0);
+
+    if (addr == MAP_FAILED)
+        return errno;
+
+    ring->hdr = addr;
+    ring->data = (char*)addr + SHMRING_DATA;
+    ring->mapSize = mapSize;
+
+    return 0;
+}
+
+/**
+ * Creates a ring and announces it to the decoder by writing the name of its
+ * shared-memory segment to the pipe to the decoder.
+ *
+ * @param[in]  fd        Write-end of the (empty) pipe to the decoder
+ * @param[in]  capacity  Capacity of the data area in bytes. Rounded up to a
+ *                       multiple of 8. `SHMRING_CAPACITY` is a sensible value.
+ * @param[out] ring      The ring
+ * @retval     0         Success. `*ring` is set.
+ * @return               `errno` error-code. `log_add()` called.
+ */
+int
+shmring_create(
+        const int       fd,
+        size_t          capacity,
+        shmring** const ring)
+{
+    int      status;
+    shmring* rng = calloc(1, sizeof(*rng));
+
+    if (rng == NULL) {
+        status = errno;
+        log_add_syserr("Couldn't allocate shared-memory ring");
+        return status;
+    }
+
+    capacity = roundUp(capacity);
+    rng->capacity = capacity;
+    rng->fd = fd;
+    (void)snprintf(rng->name, sizeof(rng->name), "/ldm-shmring.%ld.%lu",
+            (long)getpid(), __atomic_fetch_add(&ringCount, 1, __ATOMIC_RELAXED));
+
+    int shmFd = shm_open(rng->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (shmFd == -1 && errno == EEXIST) {
+        // Left behind by a terminated process with the same PID
+        (void)shm_unlink(rng->name);
+        shmFd = shm_open(rng->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    if (shmFd == -1) {
+        status = errno;
+        log_add_syserr("Couldn't create shared-memory segment \"%s\"",
+                rng->name);
+        free(rng);
+        return status;
+    }
+
+    const size_t mapSize = SHMRING_DATA + capacity;
+
+    if (ftruncate(shmFd, mapSize)) {
+        status = errno;
+        log_add_syserr("Couldn't set size of shared-memory segment \"%s\" to "
+                "%zu bytes", rng->name, mapSize);
+    }
+    else {
+        status = mapSegment(shmFd, mapSize, PROT_READ | PROT_WRITE, rng);
+        if (status)
+            log_add_errno(status, "Couldn't map shared-memory segment \"%s\"",
+                    rng->name);
+    }
+    (void)close(shmFd);
+
+    if (status == 0) {
+        rng->hdr->magic = SHMRING_MAGIC;
+        rng->hdr->version = SHMRING_VERSION;
+        rng->hdr->capacity = capacity;
+        rng->hdr->head = 0;
+        rng->hdr->tail = 0;
+
+        char       line[SHMRING_LINE];
+        const int  len = snprintf(line, sizeof(line), "%s %u %s\n",
+                SHMRING_HELLO, SHMRING_VERSION, rng->name);
+        ssize_t    nbytes;
+
+        // The pipe is empty and the line is shorter than PIPE_BUF
+        while ((nbytes = write(fd, line, len)) == -1 && errno == EINTR)
+            ;
+        if (nbytes != len) {
+            status = nbytes == -1 ? errno : EIO;
+            log_add_errno(status, "Couldn't announce shared-memory segment "
+                    "\"%s\" to decoder", rng->name);
+            (void)munmap(rng->hdr, rng->mapSize);
+        }
+    }
+
+    if (status) {
+        (void)shm_unlink(rng->name);
+        free(rng);
+    }
+    else {
+        *ring = rng;
+    }
+
+    return status;
+}
+
+/**
+ * Waits until the data area has enough free space.
+ *
+ * @param[in] ring       The ring
+ * @param[in] nbytes     Amount of free space needed in bytes
+ * @param[in] start      Time at which the write started
+ * @param[in] timeout    Timeout in seconds. 0 means indefinite timeout.
+ * @retval    0          Success
+ * @retval    EPIPE      The decoder closed its end of the pipe
+ * @retval    ETIMEDOUT  Timeout occurred
+ */
+static int
+waitForSpace(
+        shmring* const ring,
+        const uint64_t nbytes,
+        const time_t   start,
+        const unsigned timeout)
+{
+    for (;;) {
+        const uint64_t used = ring->pos - loadAcquire(&ring->hdr->tail);
+
+        if (ring->capacity - used >= nbytes)
+            return 0;
+
+        struct pollfd pfd = {.fd = ring->fd, .events = 0};
+        if (poll(&pfd, 1, 0) == 1 && (pfd.revents & (POLLERR | POLLHUP)))
+            return EPIPE;
+
+        if (timeout && time(NULL) - start >= timeout)
+            return ETIMEDOUT;
+
+        sleepBriefly();
+    }
+}
+
+/**
+ * Notifies the decoder of a new record. A full pipe means that the decoder has
+ * notifications that it hasn't read yet and that it will see the record.
+ *
+ * @param[in] ring  The ring
+ * @retval    0     Success
+ * @return          `errno` error-code
+ */
+static int
+ringDoorbell(
+        shmring* const ring)
+{
+    static const char doorbell = 0;
+    ssize_t           nbytes;
+
+    while ((nbytes = write(ring->fd, &doorbell, 1)) == -1 && errno == EINTR)
+        ;
+
+    return (nbytes == -1 && errno != EAGAIN) ? errno : 0;
+}
+
+/**
+ * Appends a record to the ring. Blocks until there's room for the record.
+ *
+ * @param[in] ring       The ring
+ * @param[in] iov        Pieces of the record
+ * @param[in] iovcnt     Number of pieces
+ * @param[in] timeout    Timeout in seconds. 0 means indefinite timeout.
+ * @retval    0          Success
+ * @retval    EMSGSIZE   The record is larger than the ring. `log_add()`
+ *                       called.
+ * @retval    EPIPE      The decoder closed its end of the pipe. `log_add()`
+ *                       called.
+ * @retval    ETIMEDOUT  The decoder didn't consume enough of the ring in time.
+ *                       `log_add()` called.
+ */
+int
+shmring_write(
+        shmring* const restrict            ring,
+        const struct iovec* const restrict iov,
+        const int                          iovcnt,
+        const unsigned                     timeout)
+{
+    uint64_t size = 0;
+
+    for (int i = 0; i < iovcnt; ++i)
+        size += iov[i].iov_len;
+
+    const uint64_t recSize = sizeof(rec_hdr) + roundUp(size);
+
+    if (size > UINT32_MAX || recSize > ring->capacity) {
+        log_add("%lu-byte record is too large for %lu-byte shared-memory ring",
+                (unsigned long)size, (unsigned long)ring->capacity);
+        return EMSGSIZE;
+    }
+
+    const time_t start = time(NULL);
+    int          status;
+    uint64_t     offset = ring->pos % ring->capacity;
+    uint64_t     extent = ring->capacity - offset;
+
+    if (extent < recSize) {
+        // Pad to the end of the data area
+        status = waitForSpace(ring, extent, start, timeout);
+        if (status)
+            goto failure;
+
+        rec_hdr* const pad = (rec_hdr*)(ring->data + offset);
+        pad->size = (uint32_t)(extent - sizeof(rec_hdr));
+        pad->type = REC_PAD;
+        ring->pos += extent;
+        storeRelease(&ring->hdr->head, ring->pos);
+        offset = 0;
+
+        // The decoder must consume the padding if the ring is nearly full
+        status = ringDoorbell(ring);
+        if (status)
+            goto failure;
+    }
+
+    status = waitForSpace(ring, recSize, start, timeout);
+    if (status)
+        goto failure;
+
+    rec_hdr* const hdr = (rec_hdr*)(ring->data + offset);
+    char*          dest = (char*)(hdr + 1);
+
+    for (int i = 0; i < iovcnt; ++i) {
+        (void)memcpy(dest, iov[i].iov_base, iov[i].iov_len);
+        dest += iov[i].iov_len;
+    }
+    hdr->size = (uint32_t)size;
+    hdr->type = REC_DATA;
+    ring->pos += recSize;
+    storeRelease(&ring->hdr->head, ring->pos);
+
+    status = ringDoorbell(ring);
+    if (status == 0)
+        return 0;
+
+failure:
+    if (status == ETIMEDOUT) {
+        log_add("Decoder didn't consume shared-memory ring \"%s\" within %u s",
+                ring->name, timeout);
+    }
+    else {
+        log_add_errno(status, "Couldn't write %lu-byte record to "
+                "shared-memory ring \"%s\"", (unsigned long)size, ring->name);
+    }
+    return status;
+}
+
+/**
+ * Destroys a ring created by `shmring_create()`. Records not yet consumed
+ * remain available to an attached decoder. Doesn't close the pipe.
+ *
+ * @param[in] ring  The ring or NULL
+ */
+void
+shmring_destroy(
+        shmring* const ring)
+{
+    if (ring) {
+        (void)munmap(ring->hdr, ring->mapSize);
+        (void)shm_unlink(ring->name); // Already unlinked if decoder attached
+        free(ring);
+    }
+}
+
+/**
+ * Attaches a decoder to the ring announced by pqact(1) on a pipe. Unlinks the
+ * ring's shared-memory segment so that it's freed when both processes are
+ * done with it.
+ *
+ * @param[in]  fd      Read-end of the pipe from pqact(1) (usually
+ *                     `STDIN_FILENO`)
+ * @param[out] ring    The ring
+ * @retval     0       Success. `*ring` is set.
+ * @retval     EPROTO  The pipe didn't start with the announcement of a ring
+ *                     (e.g., the PIPE action doesn't have the "-shm" option)
+ * @return             `errno` error-code
+ */
+int
+shmring_attach(
+        const int       fd,
+        shmring** const ring)
+{
+    char    line[SHMRING_LINE];
+    size_t  len = 0;
+    ssize_t nbytes;
+
+    // One byte at a time so that nothing after the line is consumed
+    while (len < sizeof(line) - 1) {
+        nbytes = read(fd, line + len, 1);
+        if (nbytes == -1 && errno == EINTR)
+            continue;
+        if (nbytes != 1)
+            return nbytes == 0 ? EPROTO : errno;
+        if (line[len++] == '\n')
+            break;
+    }
+    line[len] = 0;
+
+    char     hello[sizeof(SHMRING_HELLO)];
+    unsigned version;
+    shmring* rng = calloc(1, sizeof(*rng));
+
+    if (rng == NULL)
+        return errno;
+
+    if (sscanf(line, "%11s %u %63s", hello, &version, rng->name) != 3 ||
+            strcmp(hello, SHMRING_HELLO) || version != SHMRING_VERSION) {
+        free(rng);
+        return EPROTO;
+    }
+
+    int status;
+    int shmFd = shm_open(rng->name, O_RDWR, 0);
+
+    if (shmFd == -1) {
+        status = errno;
+    }
+    else {
+        struct stat st;
+
+        if (fstat(shmFd, &st)) {
+            status = errno;
+        }
+        else if (st.st_size <= SHMRING_DATA) {
+            status = EPROTO;
+        }
+        else {
+            status = mapSegment(shmFd, st.st_size, PROT_READ | PROT_WRITE,
+                    rng);
+        }
+        (void)close(shmFd);
+        (void)shm_unlink(rng->name);
+    }
+
+    if (status == 0) {
+        if (rng->hdr->magic != SHMRING_MAGIC ||
+                rng->hdr->version != SHMRING_VERSION ||
+                SHMRING_DATA + rng->hdr->capacity > rng->mapSize) {
+            (void)munmap(rng->hdr, rng->mapSize);
+            status = EPROTO;
+        }
+        else {
+            rng->capacity = rng->hdr->capacity;
+            rng->pos = loadAcquire(&rng->hdr->tail);
+            rng->fd = fd;
+            *ring = rng;
+        }
+    }
+
+    if (status)
+        free(rng);
+
+    return status;
+}
+
+/**
+ * Returns the next record of a ring. The record remains valid until the next
+ * call to this function or to `shmring_detach()`, at which point its space is
+ * returned to pqact(1). Blocks until a record is available.
+ *
+ * @param[in]  ring     The ring
+ * @param[out] data     The record's data in the ring
+ * @param[out] size     Size of the record in bytes
+ * @retval     0        Success. `*data` and `*size` are set.
+ * @retval     ENODATA  pqact(1) closed the pipe and there are no more records
+ * @return              `errno` error-code of reading the pipe
+ */
+int
+shmring_next(
+        shmring* const restrict     ring,
+        const void** const restrict data,
+        size_t* const restrict      size)
+{
+    if (ring->pending) {
+        ring->pos += ring->pending;
+        ring->pending = 0;
+        storeRelease(&ring->hdr->tail, ring->pos);
+    }
+
+    for (;;) {
+        if (loadAcquire(&ring->hdr->head) == ring->pos) {
+            char    doorbells[512];
+            ssize_t nbytes = read(ring->fd, doorbells, sizeof(doorbells));
+
+            if (nbytes == -1) {
+                if (errno == EINTR)
+                    continue;
+                return errno;
+            }
+            if (nbytes == 0 && loadAcquire(&ring->hdr->head) == ring->pos)
+                return ENODATA;
+            continue;
+        }
+
+        const rec_hdr* const hdr = (const rec_hdr*)
+                (ring->data + ring->pos % ring->capacity);
+        const uint64_t       recSize = sizeof(rec_hdr) + roundUp(hdr->size);
+
+        if (hdr->type == REC_PAD) {
+            ring->pos += recSize;
+            storeRelease(&ring->hdr->tail, ring->pos);
+            continue;
+        }
+
+        *data = hdr + 1;
+        *size = hdr->size;
+        ring->pending = recSize;
+
+        return 0;
+    }
+}
+
+/**
+ * Detaches a decoder from a ring. Doesn't close the pipe.
+ *
+ * @param[in] ring  The ring or NULL
+ */
+void
+shmring_detach(
+        shmring* const ring)
+{
+    if (ring) {
+        if (ring->pending)
+            storeRelease(&ring->hdr->tail, ring->pos + ring->pending);
+        (void)munmap(ring->hdr, ring->mapSize);
+        free(ring);
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ *   Copyright 2026 University Corporation for Atmospheric Research
+ *
+ *   See file COPYRIGHT in the top-level source-directory for copying and
+ *   redistribution conditions.
+ */
+/**
+ * Single-producer/single-consumer ring of records in POSIX shared-memory.
+ *
+ * pqact(1) uses a ring for a PIPE action that has the "-shm" option: it
+ * copies each data-product (preceded by its metadata if "-metadata" is also
+ * specified) into the ring once and the decoder reads the product in place
+ * instead of read()ing it from its standard input. The decoder's standard
+ * input is still the pipe from pqact(1): it carries the name of the
+ * shared-memory segment and one-byte notifications of new records. EOF on the
+ * pipe after the last record means that pqact(1) closed the action.
+ *
+ * A decoder uses the ring like this:
+ *
+ *     shmring*    ring;
+ *     const void* data;
+ *     size_t      size;
+ *     int         status = shmring_attach(STDIN_FILENO, &ring);
+ *
+ *     if (status == 0) {
+ *         while ((status = shmring_next(ring, &data, &size)) == 0)
+ *             decode(data, size); // `data` is valid until the next call
+ *         if (status == ENODATA)
+ *             status = 0; // pqact(1) closed the pipe
+ *         shmring_detach(ring);
+ *     }
+ */
+#ifndef _SHMRING_H_
+#define _SHMRING_H_
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+/**
+ * Default capacity, in bytes, of the data area of a ring.
+ */
+#define SHMRING_CAPACITY (64*1024*1024)
+
+typedef struct shmring shmring;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Producer (pqact(1)) side:
+ */
+int  shmring_create(int fd, size_t capacity, shmring** ring);
+int  shmring_write(shmring* ring, const struct iovec* iov, int iovcnt,
+        unsigned timeout);
+void shmring_destroy(shmring* ring);
+
+/*
+ * Consumer (decoder) side:
+ */
+int  shmring_attach(int fd, shmring** ring);
+int  shmring_next(shmring* ring, const void** data, size_t* size);
+void shmring_detach(shmring* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !_SHMRING_H_ */
@@ -907,8 +907,8 @@ mls_setProdClass(
 
 /**
  * Tries to multicast the next data-product from a multicast LDM sender's
- * product-queue. Will block for 30 seconds or until a SIGCONT is received if
- * the next data-product doesn't exist.
+ * product-queue. Will block for 30 seconds or until a data-product is inserted
+ * if the next data-product doesn't exist.
  *
  * @param[in] prodClass    Class of data-products to multicast.
  * @retval    0            Success.
@@ -937,12 +937,13 @@ mls_tryMulticast(
 
         if (!done) {
             /*
-             * Block until a signal handler is called or the timeout occurs. NB:
-             * `pq_suspend()` unblocks SIGCONT and SIGALRM.
+             * Block until a data-product is inserted, a signal handler is
+             * called, or the timeout occurs. NB: In compatibility mode,
+             * `pq_waitAndUnblock()` unblocks SIGCONT and SIGALRM.
              *
              * Keep timeout duration consistent with function description.
              */
-            (void)pq_suspendAndUnblock(30, termSigs, NELT(termSigs));
+            (void)pq_waitAndUnblock(pq, 30, termSigs, NELT(termSigs));
         }
 
         status = 0;           // no problems here
@@ -159,37 +159,51 @@ int lpqGet(
 }
 
 /**
- * Inserts a data-product into an LDM product-queue.
+ * Inserts data-products into an LDM product-queue under one lock of the
+ * queue. Each data-product gets its own status, so a duplicate doesn't hide
+ * the outcome of the others.
  *
  * This function is thread-safe.
  *
- * @retval 0    Success. Product inserted into queue.
- * @retval 1    Precondition failure. \link log_add() \endlink called.
- * @retval 2    O/S error. \link log_add() \endlink called.
- * @retval 3    Product already in queue.
- * @retval 4    Product-queue error. \link log_add() \endlink called.
+ * @retval 0    Success. `statuses` is set. Each status is 0 if the product
+ *              was inserted, 3 if the product was already in the queue, or 4
+ *              if the product couldn't be inserted (\link log_add()
+ *              \endlink called).
+ * @retval 2    O/S error. \link log_add() \endlink called. Nothing was
+ *              inserted.
+ * @retval 4    Product-queue error. \link log_add() \endlink called. Nothing
+ *              was inserted.
  */
-int lpqInsert(
-    LdmProductQueue* const  lpq,    /**< LDM product-queue to insert data-
-                                     *   product into. */
-    const product* const    prod)   /**< LDM data-product to be inserted */
+int lpqInsertv(
+    LdmProductQueue* const  lpq,        /**< LDM product-queue to insert data-
+                                         *   products into. */
+    const product* const    prods,      /**< LDM data-products to be
+                                         *   inserted */
+    const size_t            nprods,     /**< Number of data-products */
+    int* const              statuses)   /**< Status of each insertion */
 {
+    int status = pthread_mutex_lock(&lpq->mutex);
 
-    int status = 0;                 /* default success */
-
-    if ((status = pthread_mutex_lock(&lpq->mutex)) != 0) {
+    if (status != 0) {
         log_errno_q(status, "Couldn't lock mutex");
         status = 2;
     }
     else {
-        if ((status = pq_insert(lpq->pq, prod)) != 0) {
-            if (PQUEUE_DUP == status) {
-                status = 3;
-            }
-            else {
-                log_add("Couldn't insert product into queue: status=%d",
-                        status);
-                status = 4;
+        if ((status = pq_insertv(lpq->pq, prods, nprods, statuses)) != 0) {
+            log_add("Couldn't insert products into queue: status=%d",
+                    status);
+            status = 4;
+        }
+        else {
+            for (size_t i = 0; i < nprods; i++) {
+                if (PQUEUE_DUP == statuses[i]) {
+                    statuses[i] = 3;
+                }
+                else if (statuses[i] != 0) {
+                    log_add("Couldn't insert product into queue: status=%d",
+                            statuses[i]);
+                    statuses[i] = 4;
+                }
             }
         }
 
@@ -199,6 +213,28 @@ int lpqInsert(
     return status;
 }
 
+/**
+ * Inserts a data-product into an LDM product-queue.
+ *
+ * This function is thread-safe.
+ *
+ * @retval 0    Success. Product inserted into queue.
+ * @retval 1    Precondition failure. \link log_add() \endlink called.
+ * @retval 2    O/S error. \link log_add() \endlink called.
+ * @retval 3    Product already in queue.
+ * @retval 4    Product-queue error. \link log_add() \endlink called.
+ */
+int lpqInsert(
+    LdmProductQueue* const  lpq,    /**< LDM product-queue to insert data-
+                                     *   product into. */
+    const product* const    prod)   /**< LDM data-product to be inserted */
+{
+    int insertStatus;
+    int status = lpqInsertv(lpq, prod, 1, &insertStatus);
+
+    return status ? status : insertStatus;
+}
+
 /**
  * Closes an LDM product-queue.
  *
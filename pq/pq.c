@@ -6,6 +6,9 @@
  * copying and redistribution conditions.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE /* ppoll(), syscall() */
+#endif
 #include "config.h"
 
 #include <inttypes.h> /* sysconf */
@@ -21,6 +24,7 @@
 #include <limits.h>
 #include <log.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>  /* DEBUG */
 #include <errno.h>
 #include <signal.h>
@@ -29,7 +33,21 @@
 #include <time.h>
 #include <search.h>
 #include <stdint.h>
+#include <arpa/inet.h> /* ntohl() */
 #include <xdr.h>
+#include <zlib.h>
+#ifdef HAVE_LINUX_FUTEX_H
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+#endif
+#ifdef HAVE_SYS_EVENTFD_H
+    #include <poll.h>
+    #include <sys/eventfd.h>
+#endif
+#ifdef HAVE_LINUX_MEMPOLICY_H
+    #include <linux/mempolicy.h>
+    #include <sys/syscall.h>
+#endif
 
 #include "ldm.h"
 #include "pq.h"
@@ -46,6 +64,23 @@
 
 /* #define TRACE_LOCK 1 */
 
+/*
+ * Whether or not insertion-notification can use a futex on the shared
+ * insertion-counter instead of SIGCONT to the process group.
+ */
+#if defined(HAVE_MMAP) && defined(HAVE_LINUX_FUTEX_H) && \
+        defined(HAVE_SYS_EVENTFD_H)
+    #define PQ_HAVE_NOTIFY 1
+#endif
+
+/*
+ * Whether or not the control-region can be locked by a robust, process-shared
+ * lock in the file instead of by fcntl(2).
+ */
+#if defined(HAVE_MMAP) && defined(HAVE_PTHREAD_MUTEX_CONSISTENT)
+    #define PQ_HAVE_RWL 1
+#endif
+
 /*
  * The time interval, in seconds, to be subtracted from the creation-time
  * of a "signature" data-product in order to determine the initial
@@ -59,6 +94,12 @@ extern unsigned int     interval;
  */
 #define OFF_NONE  ((off_t)(-1))
 
+/*
+ * Loads a scalar in the product-queue that a writer might be concurrently
+ * modifying. Used by the optimistic read-path of `pq_sequenceHelper()`.
+ */
+#define PQ_PEEK(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+
 
 /*
  * flags used by the region layer.
@@ -72,6 +113,15 @@ extern unsigned int     interval;
 
 #define RGN_MODIFIED    RGN_WRITE       /* we did modify, else, discard */
 
+#define RGN_INFO        0x8     /* only the metadata of the data-product is
+                                 * needed (see `zp_attach()`) */
+
+#define RGN_UNLOCKED    0x10    /* the control-region isn't locked, so the
+                                 * region-list mustn't be consulted. The
+                                 * caller has seen that the region holds
+                                 * neither a chunk map nor a compressed
+                                 * data-product. */
+
 
 /* useful for aligning memory */
 #define _RNDUP(x, unit) ((((x) + (unit) - 1) / (unit)) * (unit))
@@ -530,30 +580,73 @@ struct tqueue
 };
 typedef struct tqueue tqueue;
 
+/*
+ * A tqueue can also record the feedtype of the product of each tqelem in an
+ * array that follows, and parallels, the tqelems (index format IX_TQFEED).
+ * A reader can then step over the products that aren't in its class without
+ * touching their data-regions. Unlike the skip-list blocks, the array is
+ * located from the tqueue alone, so the tq functions that move tqelems can
+ * move their feedtypes too. Functions are passed the array, or NULL if the
+ * tqueue doesn't have one.
+ */
+#define TQ_FEEDS(tq)    ((feedtypet *)&(tq)->tqep[(tq)->nalloc + \
+                            TQ_OVERHEAD_ELEMS])
+/* Feedtype of the product of tqelem 'tqep' or ANY if unknown */
+#define TQ_FEED(tq, feeds, tqep) \
+        ((feeds) == NULL ? ANY : (feeds)[(tqep) - (tq)->tqep])
+
 /* 
  * For a tq with the capacity to index nelems, return how much space
- * it will consume
+ * it will consume. If `feeds` is true, then the tq records the feedtype of
+ * each element.
  */
 static size_t
-tq_sz(const size_t nelems)
+tq_sz(const size_t nelems, const bool feeds)
 {
     log_assert(nelems);
     static size_t prev_nelems = 0;
+    static bool   prev_feeds;
     static size_t size;
-    if (nelems != prev_nelems) {
+    if (nelems != prev_nelems || feeds != prev_feeds) {
         prev_nelems = nelems;
+        prev_feeds = feeds;
         size = sizeof(tqueue) - sizeof(tqelem) * TQ_NALLOC_INITIAL;
         /* TQ_OVERHEAD_ELEMS extra slots for TQ_NIL, TQ_HEADER  */
         size += (nelems + TQ_OVERHEAD_ELEMS) * sizeof(tqelem);
+        if (feeds)
+            size += (nelems + TQ_OVERHEAD_ELEMS) * sizeof(feedtypet);
     }
     return size;
 }
 
 /*
- * Initialize tqueue structures
+ * A tqueue can instead be laid out as a ring: a circular array of the
+ * `nalloc` tqelems after TQ_NIL and TQ_HEAD, ordered by insertion time.
+ * Appending an element and deleting the oldest are O(1) and lookups are a
+ * binary search; the skip list and its fblks aren't used. An element that's
+ * deleted from the middle of the ring is left in place as a hole (offset
+ * OFF_NONE, time retained) until it reaches an end of the ring or the ring is
+ * compacted. The state of the ring is kept in the otherwise unused TQ_HEAD
+ * element.
+ */
+#define TQ_RING         (-1)    /* tq->level of a ring */
+#define TQ_IS_RING(tq)  (PQ_PEEK((tq)->level) == TQ_RING)
+/* Index of the oldest slot of the ring */
+#define TQR_START(tq)   ((tq)->tqep[TQ_HEAD].offset)
+/* Number of slots in use, including holes */
+#define TQR_LEN(tq)     ((tq)->tqep[TQ_HEAD].fblk)
+/* Pointer to the j-th oldest slot of the ring */
+#define TQR_SLOT(tq, j) (&(tq)->tqep[TQ_OVERHEAD_ELEMS + \
+                            ((size_t)TQR_START(tq) + (j)) % (tq)->nalloc])
+
+/*
+ * Initialize tqueue structures. If `ring` is true, then the tqueue will be a
+ * ring rather than a skip list. If `feeds` is true, then the tqueue records
+ * the feedtype of each element.
  */
 static void
-tq_init(tqueue *const tq, size_t const nalloc0, fb *fbp)
+tq_init(tqueue *const tq, size_t const nalloc0, fb *fbp, const bool ring,
+        const bool feeds)
 {
     tqelem *tqelemp;
     tqelem *const end = &tq->tqep[nalloc0 + TQ_OVERHEAD_ELEMS];
@@ -568,14 +661,34 @@ tq_init(tqueue *const tq, size_t const nalloc0, fb *fbp)
     tq->nalloc = nalloc0;
     /* cache offset to skip list blocks, so we can find them from only tq */
     tq->fbp_off = (char *)fbp - (char *)tq;
+    if(feeds) {
+        feedtypet *const ftp = TQ_FEEDS(tq);
+        for(i = 0; i < (int)nalloc; i++)
+            ftp[i] = ANY;
+    }
     /* build two distinguished tqelems, TQ_NIL and TQ_HEAD */
 #define TQ_NIL ((tqep_t)0)
     tqelemp = &tq->tqep[TQ_NIL];
     tqelemp->tv = TS_ENDT; /* the end of time, as we know it */
     tqelemp->offset = OFF_NONE;
-    tqelemp->fblk = fb_get(fbp, 0); /* not used */
+    tqelemp->fblk = ring ? (fblk_t)OFF_NONE : fb_get(fbp, 0); /* not used */
 #define TQ_HEAD ((tqep_t)1)
     tqelemp = &tq->tqep[TQ_HEAD];
+    if(ring) {
+        tqelemp->tv = TS_NONE;
+        TQR_START(tq) = 0;
+        TQR_LEN(tq) = 0;
+        tq->level = TQ_RING;
+        tq->nelems = TQ_OVERHEAD_ELEMS;
+        tq->nfree = nalloc0;
+        tq->free = TQ_NONE;
+        for(tqelemp = &tq->tqep[TQ_OVERHEAD_ELEMS]; tqelemp < end; tqelemp++) {
+            tqelemp->tv = TS_NONE;
+            tqelemp->offset = OFF_NONE;
+            tqelemp->fblk = (fblk_t)OFF_NONE;
+        }
+        return;
+    }
     tqelemp->tv = TS_NONE;              /* not used */
     tqelemp->offset = OFF_NONE; /* not used */
     maxlevel = fbp->maxsize - 1;
@@ -669,20 +782,234 @@ tq_rel_tqelem(tqueue *const tq, int level, tqep_t p)
 #define TV_CMP_EQ(tv, uv) \
         ((tv).tv_sec == (uv).tv_sec && (tv).tv_usec == (uv).tv_usec)
 
+/*
+ * Returns the ring-index of the tqelem 'tqep' of the ring 'tq'.
+ */
+static inline size_t
+tqr_index(const tqueue *const tq, const tqelem *const tqep)
+{
+    const size_t slot = tqep - &tq->tqep[TQ_OVERHEAD_ELEMS];
+    return (slot + tq->nalloc - (size_t)TQR_START(tq)) % tq->nalloc;
+}
+
+/*
+ * Returns the ring-index of the oldest slot of the ring 'tq' whose time
+ * isn't less than 'key' or TQR_LEN(tq) if there's no such slot.
+ */
+static size_t
+tqr_lowerBound(const tqueue *const tq, const timestampt *const key)
+{
+    size_t lo = 0;
+    size_t hi = TQR_LEN(tq);
+
+    while(lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if(TV_CMP_LT(TQR_SLOT(tq, mid)->tv, *key)) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Moves the ring-element 'src' of the ring 'tq' to 'dst' together with its
+ * feedtype in 'feeds' (if not NULL).
+ */
+static inline void
+tqr_move(tqueue *const tq, feedtypet *const feeds, tqelem *const dst,
+        const tqelem *const src)
+{
+    *dst = *src;
+    if(feeds != NULL)
+        feeds[dst - tq->tqep] = feeds[src - tq->tqep];
+}
+
+/*
+ * Removes the holes from the ring 'tq'.
+ */
+static void
+tqr_compact(tqueue *const tq, feedtypet *const feeds)
+{
+    const size_t len = TQR_LEN(tq);
+    size_t       n = 0;
+
+    for(size_t j = 0; j < len; j++) {
+        const tqelem *const tp = TQR_SLOT(tq, j);
+        if(tp->offset != OFF_NONE) {
+            if(n != j)
+                tqr_move(tq, feeds, TQR_SLOT(tq, n), tp);
+            n++;
+        }
+    }
+    log_debug("%lu holes removed", (unsigned long)(len - n));
+    TQR_LEN(tq) = n;
+}
+
+/*
+ * Adds an element to the ring 'tq'. The new element is normally appended.
+ * If the clock went backward or didn't advance, however, then the element is
+ * inserted in time-order and its time is incremented until it's unique, like
+ * tq_add(). The time is returned in '*tvp' if 'tvp' isn't NULL. 'feeds' is
+ * the feedtype array of the ring or NULL.
+ */
+static int
+tqr_add(tqueue *const tq, feedtypet *const feeds, const off_t offset,
+        const feedtypet feedtype, timestampt *const tvp)
+{
+    timestampt tv;
+    int        status = set_timestamp(&tv);
+
+    if(status == ENOERR) {
+        size_t len = TQR_LEN(tq);
+        size_t j;
+
+        if(len == tq->nalloc) {
+            tqr_compact(tq, feeds);
+            len = TQR_LEN(tq);
+            log_assert(len < tq->nalloc);
+        }
+        j = len;
+        if(len > 0 && !TV_CMP_LT(TQR_SLOT(tq, len - 1)->tv, tv)) {
+            j = tqr_lowerBound(tq, &tv);
+            while(j < len && TV_CMP_EQ(TQR_SLOT(tq, j)->tv, tv)) {
+                timestamp_incr(&tv);
+                j++;
+            }
+            for(size_t i = len; i > j; i--)
+                tqr_move(tq, feeds, TQR_SLOT(tq, i), TQR_SLOT(tq, i - 1));
+        }
+
+        tqelem *const tp = TQR_SLOT(tq, j);
+        tp->tv = tv;
+        tp->offset = offset;
+        tp->fblk = (fblk_t)OFF_NONE;
+        if(feeds != NULL)
+            feeds[tp - tq->tqep] = feedtype;
+        TQR_LEN(tq) = len + 1;
+        tq->nelems++;
+        tq->nfree--;
+        if(tvp != NULL)
+            *tvp = tv;
+    }
+    return status;
+}
+
+/*
+ * Ring version of tqe_find().
+ */
+static tqelem *
+tqr_find(const tqueue *const tq, const timestampt *const key,
+        const pq_match mt)
+{
+    const size_t len = TQR_LEN(tq);
+    size_t       j = tqr_lowerBound(tq, key);
+    const tqelem *tp;
+
+    switch (mt) {
+    case TV_LT:
+        while(j-- > 0) {
+            tp = TQR_SLOT(tq, j);
+            if(tp->offset != OFF_NONE)
+                return (tqelem *) tp;
+        }
+        return NULL;
+    case TV_EQ:
+        if(j < len) {
+            tp = TQR_SLOT(tq, j);
+            if(TV_CMP_EQ(tp->tv, *key) && tp->offset != OFF_NONE)
+                return (tqelem *) tp;
+        }
+        return NULL;
+    case TV_GT:
+        if(j < len && TV_CMP_EQ(TQR_SLOT(tq, j)->tv, *key))
+            j++;
+        for(; j < len; j++) {
+            tp = TQR_SLOT(tq, j);
+            if(tp->offset != OFF_NONE)
+                return (tqelem *) tp;
+        }
+        return NULL;
+    }
+    log_error_q("bad value for mt: %d", mt);
+    return NULL;
+}
+
+/*
+ * Ring version of tq_delete(). Deleting the oldest element just advances the
+ * start of the ring.
+ */
+static void
+tqr_delete(tqueue *const tq, const tqelem *const tqep)
+{
+    size_t  len = TQR_LEN(tq);
+    size_t  j = tqr_lowerBound(tq, &tqep->tv);
+    tqelem *tp;
+
+    if(j >= len)
+        return;
+    tp = TQR_SLOT(tq, j);
+    if(!TV_CMP_EQ(tp->tv, tqep->tv) || tp->offset != tqep->offset ||
+            tp->offset == OFF_NONE)
+        return;
+    tp->offset = OFF_NONE;
+    tq->nelems--;
+    tq->nfree++;
+
+    /* Keep both ends of the ring live */
+    while(len > 0 && TQR_SLOT(tq, 0)->offset == OFF_NONE) {
+        TQR_START(tq) = (TQR_START(tq) + 1) % (off_t)tq->nalloc;
+        len--;
+    }
+    while(len > 0 && TQR_SLOT(tq, len - 1)->offset == OFF_NONE)
+        len--;
+    TQR_LEN(tq) = len;
+}
+
+/*
+ * Ring version of tq_next().
+ */
+static tqelem *
+tqr_next(const tqueue *const tq, const tqelem *const tqep)
+{
+    const size_t len = TQR_LEN(tq);
+
+    if(tqep >= &tq->tqep[TQ_OVERHEAD_ELEMS]) {
+        for(size_t j = tqr_index(tq, tqep) + 1; j < len; j++) {
+            const tqelem *const tp = TQR_SLOT(tq, j);
+            if(tp->offset != OFF_NONE)
+                return (tqelem *) tp;
+        }
+    }
+    return (tqelem *) &tq->tqep[TQ_NIL];
+}
+
 /**
  * Adds an element to the time-queue.
  *
- * @param[in] tq      Pointer to time-queue.
- * @param[in] offset  Offset to data-portion of element to be added to
- *                    time-queue.
- * @retval    0       Success
- * @retval    ENOSPC  No more fblk-s: too many products in queue.
+ * @param[in] tq       Pointer to time-queue.
+ * @param[in] feeds    Feedtype array of the time-queue or NULL.
+ * @param[in] offset   Offset to data-portion of element to be added to
+ *                     time-queue.
+ * @param[in] feedtype Feedtype of the product. Ignored if `feeds` is NULL.
+ * @param[out] tvp     Insertion-time of the new element (it's unique in the
+ *                     time-queue) or NULL.
+ * @retval    0        Success
+ * @retval    ENOSPC   No more fblk-s: too many products in queue.
  */
 static int
 tq_add(
     tqueue* const       tq,
-    const off_t         offset)
+    feedtypet* const    feeds,
+    const off_t         offset,
+    const feedtypet     feedtype,
+    timestampt* const   tvp)
 {
+    if (TQ_IS_RING(tq))
+        return tqr_add(tq, feeds, offset, feedtype, tvp);
+
     fb*         fbp = (fb*)((char*)tq + tq->fbp_off);
 
     log_assert(fbp->magic == FB_MAGIC); // check for sanity
@@ -695,6 +1022,8 @@ tq_add(
      */
     tqep_t      tpix = tq_get_tqelem(tq);
     log_assert(tpix != TQ_NONE);
+    if (feeds != NULL)
+        feeds[tpix] = feedtype;
 
     // Pointer to the i-th element in the time-queue
     #define TQE_PTR(i)              (tq->tqep + i)
@@ -798,6 +1127,9 @@ tq_add(
                 TQE_INDEX_NEXT(tp, k) = TQE_INDEX_NEXT(tpp, k);
                 TQE_INDEX_NEXT(tpp, k) = tpix;
             } while(--k >= 0);
+
+            if (tvp != NULL)
+                *tvp = tp->tv;
         }
     }                                   /* insertion-time set */
 
@@ -826,6 +1158,8 @@ tqe_find(const tqueue *const tq, const timestampt *const key, const pq_match mt)
     if(tq->nelems - TQ_OVERHEAD_ELEMS == 0) {
         return NULL;
     }
+    if(TQ_IS_RING(tq))
+        return tqr_find(tq, key, mt);
     log_assert(fbp->magic == FB_MAGIC);
     p = TQ_HEAD;                /* header of skip list */
     tpp = &tq->tqep[p];
@@ -876,6 +1210,190 @@ tqe_find(const tqueue *const tq, const timestampt *const key, const pq_match mt)
 }
 
 
+/*
+ * Sets `*next` to the index of the element that follows element `p` in the
+ * level-`k` list of the tqueue 'tq' without trusting the tqueue to be
+ * consistent.
+ *
+ * Returns false if an index is out of range.
+ */
+static inline bool
+tq_peekNext(const tqueue *const tq, const fb *const fbp, const tqep_t p,
+        const int k, tqep_t *const next)
+{
+    const fblk_t fblk = PQ_PEEK(tq->tqep[p].fblk);
+    tqep_t q;
+
+    if(fblk >= fbp->arena_sz || fblk + k >= fbp->arena_sz)
+        return false;
+    q = (tqep_t)PQ_PEEK(fbp->fblks[fblk + k]);
+    if(q < 0 || q >= (tqep_t)(tq->nalloc + TQ_OVERHEAD_ELEMS))
+        return false;
+    *next = q;
+    return true;
+}
+
+static inline void
+tq_peekTime(const tqelem *const tqep, timestampt *const tvp)
+{
+    tvp->tv_sec = PQ_PEEK(tqep->tv.tv_sec);
+    tvp->tv_usec = PQ_PEEK(tqep->tv.tv_usec);
+}
+
+
+/*
+ * Ring version of tqe_findOptimistic().
+ */
+static int
+tqr_findOptimistic(const tqueue *const tq, const feedtypet *const feeds,
+        const timestampt *const key, const pq_match mt, timestampt *const tvp,
+        off_t *const offp, feedtypet *const feedp)
+{
+    const size_t        nalloc = tq->nalloc;
+    const off_t         start = PQ_PEEK(TQR_START(tq));
+    const size_t        len = PQ_PEEK(TQR_LEN(tq));
+    const tqelem *const slots = &tq->tqep[TQ_OVERHEAD_ELEMS];
+    size_t              lo = 0;
+    size_t              hi = len;
+    size_t              j;
+    timestampt          tv;
+    off_t               offset;
+
+#define TQR_PEEK_SLOT(j) (slots + ((size_t)start + (j)) % nalloc)
+    if(start < 0 || (size_t)start >= nalloc || len > nalloc)
+        return EAGAIN;
+    while(lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        tq_peekTime(TQR_PEEK_SLOT(mid), &tv);
+        if(TV_CMP_LT(tv, *key)) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    j = lo;
+
+    switch (mt) {
+    case TV_LT:
+        while(j-- > 0) {
+            offset = PQ_PEEK(TQR_PEEK_SLOT(j)->offset);
+            if(offset != OFF_NONE)
+                goto found;
+        }
+        return PQUEUE_END;
+    case TV_EQ:
+        if(j >= len)
+            return PQUEUE_END;
+        tq_peekTime(TQR_PEEK_SLOT(j), &tv);
+        offset = PQ_PEEK(TQR_PEEK_SLOT(j)->offset);
+        if(!TV_CMP_EQ(tv, *key) || offset == OFF_NONE)
+            return PQUEUE_END;
+        goto found;
+    case TV_GT:
+        if(j < len) {
+            tq_peekTime(TQR_PEEK_SLOT(j), &tv);
+            if(TV_CMP_EQ(tv, *key))
+                j++;
+        }
+        for(; j < len; j++) {
+            offset = PQ_PEEK(TQR_PEEK_SLOT(j)->offset);
+            if(offset != OFF_NONE)
+                goto found;
+        }
+        return PQUEUE_END;
+    default:
+        log_error_q("bad value for mt: %d", mt);
+        return EINVAL;
+    }
+
+found:
+    tq_peekTime(TQR_PEEK_SLOT(j), tvp);
+    *offp = offset;
+    *feedp = feeds == NULL
+            ? ANY
+            : PQ_PEEK(feeds[TQR_PEEK_SLOT(j) - tq->tqep]);
+    return 0;
+#undef TQR_PEEK_SLOT
+}
+
+
+/*
+ * Like tqe_find() but for use without a lock on the control-region: indexes
+ * are range-checked and the search is bounded, so a concurrent modification
+ * by a writer can only cause failure or a wrong answer -- which the caller
+ * must detect (see pq_sequenceHelper()). Sets *tvp, *offp, and *feedp from
+ * the matching element; *feedp is ANY if 'feeds', the feedtype array of the
+ * tqueue, is NULL.
+ *
+ * Returns 0 if found, PQUEUE_END if no match, or EAGAIN if the tqueue was
+ * seen to be inconsistent.
+ */
+static int
+tqe_findOptimistic(const tqueue *const tq, const feedtypet *const feeds,
+        const timestampt *const key, const pq_match mt, timestampt *const tvp,
+        off_t *const offp, feedtypet *const feedp)
+{
+    const fb *fbp = (const fb *)((const char *)tq + tq->fbp_off);
+    const size_t maxsteps = (tq->nalloc + TQ_OVERHEAD_ELEMS) * MAXLEVELS;
+    size_t nsteps = 0;
+    int k = PQ_PEEK(tq->level);
+    tqep_t p = TQ_HEAD;
+    tqep_t q;
+    timestampt qtv;
+
+    if(PQ_PEEK(tq->nelems) == TQ_OVERHEAD_ELEMS)
+        return PQUEUE_END;
+    if(k == TQ_RING)
+        return tqr_findOptimistic(tq, feeds, key, mt, tvp, offp, feedp);
+    if(k < 0 || k >= fbp->maxsize)
+        return EAGAIN;
+    do {
+        if(!tq_peekNext(tq, fbp, p, k, &q))
+            return EAGAIN;
+        tq_peekTime(&tq->tqep[q], &qtv);
+        while(TV_CMP_LT(qtv, *key)) {
+            if(++nsteps > maxsteps)
+                return EAGAIN; /* cycle */
+            p = q;
+            if(!tq_peekNext(tq, fbp, p, k, &q))
+                return EAGAIN;
+            tq_peekTime(&tq->tqep[q], &qtv);
+        }
+    } while(--k >= 0);
+
+    switch (mt) {
+    case TV_LT:
+        if(p == TQ_HEAD)
+            return PQUEUE_END;
+        q = p;
+        break;
+    case TV_EQ:
+        if(!TV_CMP_EQ(qtv, *key))
+            return PQUEUE_END;
+        break;
+    case TV_GT:
+        if(q != TQ_NIL && TV_CMP_EQ(qtv, *key)) {
+            if(!tq_peekNext(tq, fbp, q, 0, &q))
+                return EAGAIN;
+        }
+        if(q == TQ_NIL)
+            return PQUEUE_END;
+        break;
+    default:
+        log_error_q("bad value for mt: %d", mt);
+        return EINVAL;
+    }
+    if(q == TQ_NIL || q == TQ_HEAD)
+        return EAGAIN;
+
+    tq_peekTime(&tq->tqep[q], tvp);
+    *offp = PQ_PEEK(tq->tqep[q].offset);
+    *feedp = feeds == NULL ? ANY : PQ_PEEK(feeds[q]);
+    return 0;
+}
+
+
 /*
  * Return the oldest (first) element in the tqueue 'tq'
  *
@@ -890,6 +1408,8 @@ tqe_first(const tqueue *const tq)
     const tqelem *tqp;
     fb *fbp = (fb *)((char *)tq + tq->fbp_off);
 
+    if(TQ_IS_RING(tq))
+        return TQR_LEN(tq) ? (tqelem *) TQR_SLOT(tq, 0) : NULL;
     log_assert(fbp->magic == FB_MAGIC);
     p = TQ_HEAD;                /* header of skip list */
     tpp = &tq->tqep[p];
@@ -918,6 +1438,10 @@ tq_delete(tqueue *const tq, tqelem *tqep)
     tqep_t update[MAXLEVELS];
     fb *fbp = (fb *)((char *)tq + tq->fbp_off);
 
+    if(TQ_IS_RING(tq)) {
+        tqr_delete(tq, tqep);
+        return;
+    }
     log_assert(fbp->magic == FB_MAGIC); /* check for sanity */
     /* p = l->header; */
     p = TQ_HEAD;
@@ -986,6 +1510,9 @@ tq_delete(tqueue *const tq, tqelem *tqep)
 static inline tqelem *
 tq_next(const tqueue *const tq, const tqelem *const tqep) 
 {
+    if(TQ_IS_RING(tq))
+        return tqr_next(tq, tqep);
+
     /* get the skip list array of offsets */
     fb *fbp = (fb *)((char *)tq + tq->fbp_off);
     log_assert(fbp->magic == FB_MAGIC);
@@ -996,6 +1523,96 @@ tq_next(const tqueue *const tq, const tqelem *const tqep)
 
 
 
+/*
+ * Verifies the structure of the tqueue 'tq': that its indexes are in range,
+ * that its elements are strictly increasing in time, and that the number of
+ * its elements agrees with tq->nelems.
+ *
+ * Returns 0 if the tqueue is consistent or PQ_CORRUPT if it isn't, in which
+ * case log_add() is called.
+ */
+static int
+tq_check(const tqueue *const tq)
+{
+    const size_t nelems = tq->nelems - TQ_OVERHEAD_ELEMS;
+    size_t       count = 0;
+    timestampt   prev = TS_ZERO;
+
+    if(tq->nelems < TQ_OVERHEAD_ELEMS || nelems > tq->nalloc) {
+        log_add("Time-index has %lu elements but room for only %lu",
+                (unsigned long)nelems, (unsigned long)tq->nalloc);
+        return PQ_CORRUPT;
+    }
+
+    if(TQ_IS_RING(tq)) {
+        const size_t len = TQR_LEN(tq);
+
+        if(TQR_START(tq) < 0 || (size_t)TQR_START(tq) >= tq->nalloc ||
+                len > tq->nalloc) {
+            log_add("Time-index ring has start %ld and length %lu but only "
+                    "%lu slots", (long)TQR_START(tq), (unsigned long)len,
+                    (unsigned long)tq->nalloc);
+            return PQ_CORRUPT;
+        }
+        if(len > 0 && (TQR_SLOT(tq, 0)->offset == OFF_NONE ||
+                TQR_SLOT(tq, len - 1)->offset == OFF_NONE)) {
+            log_add("Time-index ring starts or ends with a hole");
+            return PQ_CORRUPT;
+        }
+        for(size_t j = 0; j < len; j++) {
+            const tqelem *const tp = TQR_SLOT(tq, j);
+            if(j > 0 && !TV_CMP_LT(prev, tp->tv)) {
+                log_add("Time-index ring is out of order at slot %lu",
+                        (unsigned long)j);
+                return PQ_CORRUPT;
+            }
+            prev = tp->tv;
+            if(tp->offset != OFF_NONE)
+                count++;
+        }
+    }
+    else {
+        const fb *const fbp = (const fb *)((const char *)tq + tq->fbp_off);
+        tqep_t          q;
+
+        if(fbp->magic != FB_MAGIC || tq->level < 0 ||
+                tq->level >= fbp->maxsize) {
+            log_add("Time-index skip list has level %d", tq->level);
+            return PQ_CORRUPT;
+        }
+        for(q = TQ_HEAD; ; ) {
+            const fblk_t fblk = tq->tqep[q].fblk;
+            if(fblk >= fbp->arena_sz) {
+                log_add("Time-index element %ld has fblk %lu",
+                        (long)q, (unsigned long)fblk);
+                return PQ_CORRUPT;
+            }
+            q = (tqep_t)fbp->fblks[fblk];
+            if(q == TQ_NIL)
+                break;
+            if(q <= TQ_HEAD || q >= (tqep_t)(tq->nalloc + TQ_OVERHEAD_ELEMS)
+                    || ++count > nelems) {
+                log_add("Time-index skip list is broken at element %ld",
+                        (long)q);
+                return PQ_CORRUPT;
+            }
+            if(count > 1 && !TV_CMP_LT(prev, tq->tqep[q].tv)) {
+                log_add("Time-index skip list is out of order at element %ld",
+                        (long)q);
+                return PQ_CORRUPT;
+            }
+            prev = tq->tqep[q].tv;
+        }
+    }
+
+    if(count != nelems) {
+        log_add("Time-index has %lu elements instead of %lu",
+                (unsigned long)count, (unsigned long)nelems);
+        return PQ_CORRUPT;
+    }
+    return 0;
+}
+
 /* End tqueue */
 /* Begin region */
 
@@ -1078,7 +1695,19 @@ typedef struct region region;
 #define clear_IsAlloc(rp)       (fClr((rp)->extent, ISALLOC))
 #define IsAlloc(rp)     (fIsSet((rp)->extent, ISALLOC))
 #define IsFree(rp)      (!IsAlloc(rp))
-#define Extent(rp)      (fMask((rp)->extent, ISALLOC))
+#define ISCHUNKED ((unsigned)0x2)       /* extent field of an allocated region
+                                         * is also or'd with ISCHUNKED when the
+                                         * region holds a chunk map */
+#define set_IsChunked(rp)       (fSet((rp)->extent, ISCHUNKED))
+#define IsChunked(rp)   (fIsSet((rp)->extent, ISCHUNKED))
+#define ISZIPPED ((unsigned)0x4)        /* extent field of an allocated region
+                                         * is also or'd with ISZIPPED when the
+                                         * data of its data-product is
+                                         * compressed */
+#define set_IsZipped(rp)        (fSet((rp)->extent, ISZIPPED))
+#define IsZipped(rp)    (fIsSet((rp)->extent, ISZIPPED))
+#define RL_FLAGS        (ISALLOC|ISCHUNKED|ISZIPPED)
+#define Extent(rp)      (fMask((rp)->extent, RL_FLAGS))
 
 /* End region */
 /* Begin regionl */
@@ -2165,6 +2794,18 @@ rl_find(const regionl *const rl, off_t const offset)
     return ret;
 }
 
+/*
+ * Returns the flags (ISALLOC, ISCHUNKED, ISZIPPED) of the in-use region whose
+ * offset is 'offset' or 0 if there's no such region.
+ */
+static unsigned
+rl_flags(const regionl *const rl, off_t const offset)
+{
+    const size_t rlix = rl_find(rl, offset);
+
+    return rlix == RL_NONE ? 0 : (unsigned)(rl->rp[rlix].extent & RL_FLAGS);
+}
+
 /*
  * Search the regionl 'rl' for an in-use region whose offset is
  * 'offset'.  Returns 1 and sets *rpp to match if found.  Otherwise,
@@ -2187,6 +2828,46 @@ rl_r_find(regionl *const rl, off_t const offset, region **rpp)
 }
 
 
+/*
+ * Like rl_find() but for use without a lock on the control-region: indexes
+ * are range-checked and the search is bounded. Sets *extentp to the extent of
+ * the in-use region whose offset is 'offset'.
+ *
+ * Returns 0 if found; otherwise, EAGAIN because the regionl was seen to be
+ * inconsistent or is being modified or because the region holds a chunk map
+ * or a compressed data-product, which are only attached with the
+ * control-region locked.
+ */
+static int
+rl_findOptimistic(const regionl *const rl, off_t const offset,
+        size_t *const extentp)
+{
+    const size_t nslots = rl->nalloc + RL_FREE_OVERHEAD;
+    const rlhash *rlhp = RLHASHP(rl);
+    size_t next = PQ_PEEK(rlhp->chains[rl_hash(rl->nchains, offset)]);
+    size_t n;
+
+    for(n = 0; next != RL_NONE && n < nslots; n++) {
+        const region *rep;
+
+        if(next >= nslots)
+            return EAGAIN;
+        rep = rl->rp + next;
+        if(PQ_PEEK(rep->offset) == offset) {
+            const size_t extent = PQ_PEEK(rep->extent);
+
+            if(!fIsSet(extent, ISALLOC) ||
+                    fIsSet(extent, ISCHUNKED|ISZIPPED))
+                return EAGAIN;
+            *extentp = fMask(extent, RL_FLAGS);
+            return 0;
+        }
+        next = PQ_PEEK(rep->next);
+    }
+    return EAGAIN;
+}
+
+
 /*
  * Add in-use region to region hashtable by offset. This function is the
  * complement of `rlhash_del()`.
@@ -2333,7 +3014,7 @@ rl_free(regionl *const rl, size_t rpix)
     region *rlrp = rl->rp;
     region *rep = rlrp + rpix;
 
-    clear_IsAlloc(rep);
+    fClr(rep->extent, RL_FLAGS);
     rl->nbytes -= rep->extent;
     rlhash_del(rl, rpix);
     rl->nelems--;
@@ -2345,6 +3026,36 @@ rl_free(regionl *const rl, size_t rpix)
         rl->maxfree = rl->nfree;
     log_assert(rl->nelems + rl->nfree + rl->nempty == rl->nalloc);
 }
+
+/*
+ * Shrinks the in-use region indexed by rlix to a smaller extent, returning the
+ * remainder to the free list. Does nothing if the remainder is too small to be
+ * a region or if there's no empty slot for it.
+ */
+static void
+rl_trim(regionl *const rl, size_t rlix, size_t const extent)
+{
+    region *rep = rl->rp + rlix;
+    size_t rem;
+
+    log_assert(IsAlloc(rep));
+    log_assert(extent <= Extent(rep));
+
+    rem = Extent(rep) - extent;
+    if(rem < MIN_RGN_SIZE || !rl_HasSpace(rl))
+        return;
+
+    region *new = rl_add(rl, rep->offset + (off_t)extent, rem);
+    if(new == NULL) {
+        log_clear();
+        return;
+    }
+    rep = rl->rp + rlix;
+    rep->extent = extent | (rep->extent & RL_FLAGS);
+    rl->nbytes -= rem;
+    rl_consolidate(rl, (size_t)(new - rl->rp)); /* updates maxfextent */
+    log_assert(rl->nelems + rl->nfree + rl->nempty == rl->nalloc);
+}
 /* End regionl */
 /* Begin sx */
 
@@ -2434,19 +3145,89 @@ sxwo_sz(size_t nelems)
         return sz;
 }
 
+/*
+ * The signature-index can instead be an open-addressed hash table (see
+ * PQ_SXOPEN) that uses Robin Hood linear probing with backward-shift deletion,
+ * so no tombstones accumulate even though every signature is eventually
+ * deleted. The sxelems are stored inline in the table. A parallel array of
+ * 16-bit metadata -- the probe distance of a slot's element plus one (zero
+ * means empty) and an 8-bit tag from the signature's hash -- lets most probes
+ * be rejected without touching the sxelems. The table has room for
+ * SXO_LOAD_DEN/SXO_LOAD_NUM times the number of products. Because signatures
+ * come from upstream LDMs, the hash is keyed by a random seed that's chosen
+ * when the index is initialized, and an addition that would take an element
+ * further than SXO_MAX_DIST from its home slot is refused rather than made.
+ *
+ * The first three members are those of an sx so that the functions of the
+ * signature-index can tell the formats apart by `nchains`.
+ */
+struct sxo {
+#define SX_OPEN         0       /* sx->nchains of an open-addressed index */
+#define SXO_LOAD_NUM    3       /* maximum load factor, numerator */
+#define SXO_LOAD_DEN    4       /* maximum load factor, denominator */
+#define SXO_MAX_DIST    254     /* maximum probe distance */
+  size_t nalloc;                /* number of products */
+  size_t nelems;                /* current number of signatures */
+  size_t nchains;               /* SX_OPEN */
+  size_t nslots;                /* number of slots in the table */
+  size_t slots_off;             /* offset of sxelem array from this struct */
+#define SXO_MAGIC       0x53584f42
+  size_t magic;                 /* "SXOB" to check alignment, endianness */
+  uint64_t seed;                /* random key of the hash */
+  uint16_t meta[1];             /* actually nslots long */
+};
+typedef struct sxo sxo;
+
+#define SXO_META(dist, tag)     ((uint16_t)((dist) << 8 | (tag)))
+#define SXO_DIST(meta)          ((meta) >> 8)
+#define SXO_TAG(meta)           ((meta) & 0xff)
+#define SXO_SLOTS(sxo)          ((sxelem *)((char *)(sxo) + (sxo)->slots_off))
+
+/*
+ * Returns the number of slots of an open-addressed signature-index for the
+ * specified number of elements.
+ */
+static inline size_t
+sxo_nslots(size_t const nelems)
+{
+        return nelems / SXO_LOAD_NUM * SXO_LOAD_DEN +
+                (nelems % SXO_LOAD_NUM * SXO_LOAD_DEN + SXO_LOAD_NUM - 1)
+                / SXO_LOAD_NUM + 1;
+}
+
+/*
+ * Returns the offset of the sxelems of an open-addressed signature-index with
+ * the specified number of slots.
+ */
+static inline size_t
+sxo_slots_off(size_t const nslots)
+{
+        return _RNDUP(offsetof(sxo, meta) + nslots * sizeof(uint16_t),
+                sizeof(sxelem));
+}
+
 /*
  * For a sx which is nelems long, return how much space it will
- * consume, including the auxilliary sxhash structure.
+ * consume, including the auxilliary sxhash structure or, if it's
+ * open-addressed, its table.
  */
 static size_t
-sx_sz(const size_t nelems)
+sx_sz(const size_t nelems, const bool open)
 {
     log_assert(nelems);
     static size_t prev_nelems = 0;
+    static bool   prev_open;
     static size_t size;
-    if (nelems != prev_nelems) {
+    if (nelems != prev_nelems || open != prev_open) {
         prev_nelems = nelems;
-        size = sxwo_sz(nelems) + sxhash_sz(nchains(nelems));
+        prev_open = open;
+        if (open) {
+            const size_t nslots = sxo_nslots(nelems);
+            size = sxo_slots_off(nslots) + nslots * sizeof(sxelem);
+        }
+        else {
+            size = sxwo_sz(nelems) + sxhash_sz(nchains(nelems));
+        }
     }
     return size;
 }
@@ -2484,14 +3265,71 @@ sxhash_init(sxhash *const sxhp, size_t const nchains)
 }
 
 
+/*
+ * Returns a random key for the hash of an open-addressed sx so that the home
+ * slots of signatures can't be predicted by an upstream LDM.
+ */
+static uint64_t
+sxo_seed(void)
+{
+        uint64_t seed = 0;
+        int      fd = open("/dev/urandom", O_RDONLY);
+
+        if(fd >= 0) {
+                if(read(fd, &seed, sizeof(seed)) != sizeof(seed))
+                        seed = 0;
+                (void)close(fd);
+        }
+        if(seed == 0) {
+                struct timespec now;
+
+                (void)clock_gettime(CLOCK_REALTIME, &now);
+                seed = ((uint64_t)now.tv_sec << 30 ^ (uint64_t)now.tv_nsec ^
+                        (uint64_t)getpid() << 20) * UINT64_C(0x9e3779b97f4a7c15);
+        }
+        return seed;
+}
+
+/*
+ * Initialize an open-addressed sx, with all slots empty.
+ */
+static void
+sxo_init(sxo *const sxo, size_t const nalloc)
+{
+        size_t  i;
+        sxelem *slots;
+
+        sxo->nalloc = nalloc;
+        sxo->nelems = 0;
+        sxo->nchains = SX_OPEN;
+        sxo->nslots = sxo_nslots(nalloc);
+        log_assert(sxo->nslots <= UINT32_MAX); /* for sxo_home() */
+        sxo->slots_off = sxo_slots_off(sxo->nslots);
+        sxo->magic = SXO_MAGIC;
+        sxo->seed = sxo_seed();
+        slots = SXO_SLOTS(sxo);
+        for(i = 0; i < sxo->nslots; i++) {
+                sxo->meta[i] = 0;
+                memset(slots[i].sxi, 0, sizeof(signaturet));
+                slots[i].offset = OFF_NONE;
+                slots[i].next = SX_NONE;
+        }
+}
+
 /*
  * Initialize an sx (and its associated sxhash).
  * We define number of chains so that expected length of each chain will be
- * SX_EXP_CHAIN_LEN.
+ * SX_EXP_CHAIN_LEN. If `open` is true, then the sx will be open-addressed
+ * instead.
  */
 static void
-sx_init(sx *const sx, size_t const nalloc)
+sx_init(sx *const sx, size_t const nalloc, const bool open)
 {
+        if(open) {
+                sxo_init((sxo *)sx, nalloc);
+                return;
+        }
+
         sxelem *sxep;
         sxelem *const end = &sx->sxep[nalloc];
         sxhash *sxhp;
@@ -2529,6 +3367,186 @@ sx_compare(const signaturet sig1, const signaturet sig2)
   return 0 == memcmp(sig1, sig2, sizeof(signaturet));
 }
 
+/*
+ * Returns the hash of a signature for an open-addressed sx. All of the
+ * signature is mixed in because signatures needn't be random (e.g., a
+ * sequence number in some bytes and zeros in the rest). The seed is mixed into
+ * both halves before they're combined so that colliding signatures can't be
+ * computed without it.
+ */
+static inline uint64_t
+sxo_hash(const uint64_t seed, const signaturet sig)
+{
+    uint64_t a;
+    uint64_t b;
+
+    (void)memcpy(&a, sig, sizeof(a));
+    (void)memcpy(&b, sig + sizeof(a), sizeof(b));
+    a ^= seed;
+    b ^= seed >> 29 | seed << 35;
+    a *= UINT64_C(0xbf58476d1ce4e5b9);
+    a ^= a >> 31;
+    a ^= b * UINT64_C(0x9e3779b97f4a7c15);
+    a ^= a >> 33;
+    a *= UINT64_C(0xff51afd7ed558ccd);
+    a ^= a >> 33;
+    a *= UINT64_C(0xc4ceb9fe1a85ec53);
+    a ^= a >> 33;
+    return a;
+}
+
+/*
+ * Returns the home slot of a hash in an open-addressed sx. Maps the upper 32
+ * bits of the hash onto [0, nslots) without a division.
+ */
+static inline size_t
+sxo_home(const sxo *const sxo, const uint64_t hash)
+{
+    return (size_t)(((hash >> 32) * (uint64_t)sxo->nslots) >> 32);
+}
+
+/*
+ * Returns the index of the slot of an open-addressed sx that contains a
+ * signature or SX_NONE if the signature isn't in the sx.
+ */
+static size_t
+sxo_find(const sxo *const sxo, const signaturet sig)
+{
+    const uint64_t      hash = sxo_hash(sxo->seed, sig);
+    const unsigned      tag = hash & 0xff;
+    const sxelem *const slots = SXO_SLOTS(sxo);
+    size_t              i = sxo_home(sxo, hash);
+
+    log_assert(sxo->magic == SXO_MAGIC);
+    for(unsigned dist = 1; ; dist++) {
+        const uint16_t meta = sxo->meta[i];
+        /* An empty slot or a richer element ends the search */
+        if(SXO_DIST(meta) < dist)
+            return SX_NONE;
+        if(SXO_TAG(meta) == tag && sx_compare(sig, slots[i].sxi))
+            return i;
+        if(++i == sxo->nslots)
+            i = 0;
+    }
+}
+
+/*
+ * Indicates if an element with a given hash can be added to an open-addressed
+ * sx without any element ending up more than SXO_MAX_DIST slots from its home.
+ * Follows sxo_add() but only reads the metadata, which sxo_add() only changes
+ * at the slot it has reached, so the answer is exact.
+ */
+static bool
+sxo_fits(const sxo *const sxo, const uint64_t hash)
+{
+    unsigned dist = 1;
+    size_t   i = sxo_home(sxo, hash);
+
+    for(;;) {
+        const uint16_t meta = sxo->meta[i];
+        if(meta == 0)
+            return true;
+        if(SXO_DIST(meta) < dist)
+            dist = SXO_DIST(meta);
+        if(++dist > SXO_MAX_DIST)
+            return false;
+        if(++i == sxo->nslots)
+            i = 0;
+    }
+}
+
+/*
+ * Adds a signature to an open-addressed sx, which mustn't contain it. An
+ * element that's further from its home slot takes the slot of one that's
+ * nearer to its own (Robin Hood).
+ *
+ * Returns the added element or NULL if no space is left, either because the
+ * sx is full or because the signature's neighborhood is (e.g., signatures
+ * crafted to collide).
+ */
+static sxelem *
+sxo_add(sxo *const sxo, const signaturet sig, off_t const offset)
+{
+    const uint64_t hash = sxo_hash(sxo->seed, sig);
+    sxelem *const  slots = SXO_SLOTS(sxo);
+    sxelem        *added = NULL;
+    sxelem         elem;
+    unsigned       tag = hash & 0xff;
+    unsigned       dist = 1;
+    size_t         i = sxo_home(sxo, hash);
+
+    log_assert(sxo->magic == SXO_MAGIC);
+    if(sxo->nelems >= sxo->nalloc) {
+        log_error_q("sx_add: no slots for signatures, too many products?");
+        return NULL;
+    }
+    if(!sxo_fits(sxo, hash)) {
+        log_error_q("sx_add: probe distance for signature %s would exceed %d",
+                s_signaturet(NULL, 0, sig), SXO_MAX_DIST);
+        return NULL;
+    }
+    memcpy(elem.sxi, sig, sizeof(signaturet));
+    elem.offset = offset;
+    elem.next = SX_NONE;
+
+    for(;;) {
+        const uint16_t meta = sxo->meta[i];
+        if(meta == 0) {
+            sxo->meta[i] = SXO_META(dist, tag);
+            slots[i] = elem;
+            break;
+        }
+        if(SXO_DIST(meta) < dist) {
+            /* Take the slot and carry its element onward */
+            const sxelem tmp = slots[i];
+            sxo->meta[i] = SXO_META(dist, tag);
+            slots[i] = elem;
+            if(added == NULL)
+                added = &slots[i];
+            elem = tmp;
+            dist = SXO_DIST(meta);
+            tag = SXO_TAG(meta);
+        }
+        ++dist;
+        log_assert(dist <= SXO_MAX_DIST); /* ensured by sxo_fits() */
+        if(++i == sxo->nslots)
+            i = 0;
+    }
+    if(added == NULL)
+        added = &slots[i];
+    sxo->nelems++;
+    return added;
+}
+
+/*
+ * Deletes a signature from an open-addressed sx by shifting back the
+ * following elements that aren't in their home slots.
+ *
+ * Returns 1 if found and deleted, returns 0 if not found.
+ */
+static int
+sxo_find_delete(sxo *const sxo, const signaturet sig)
+{
+    sxelem *const slots = SXO_SLOTS(sxo);
+    size_t        i = sxo_find(sxo, sig);
+
+    if(i == SX_NONE)
+        return 0;
+    for(;;) {
+        size_t   j = i + 1 == sxo->nslots ? 0 : i + 1;
+        uint16_t meta = sxo->meta[j];
+        if(SXO_DIST(meta) <= 1)
+            break;
+        sxo->meta[i] = SXO_META(SXO_DIST(meta) - 1, SXO_TAG(meta));
+        slots[i] = slots[j];
+        i = j;
+    }
+    sxo->meta[i] = 0;
+    slots[i].offset = OFF_NONE;
+    sxo->nelems--;
+    return 1;
+}
+
 /*
  * Get index of an available sxelem off the free list.
  * Returns SX_NONE if none available.
@@ -2562,6 +3580,50 @@ sxelem_free(sx *const sx, size_t sxix)
     sx->nfree++;
 }
 
+/*
+ * The `next` member of an open-addressed sxelem links nothing, so it holds
+ * instead the insertion-time, in microseconds, of the associated entry in the
+ * time-queue (or SX_NONE if that time is unknown). This lets a cursor be
+ * positioned at a data-product by signature with one lookup in each index
+ * rather than a scan of the time-queue. A size_t must be at least 64 bits.
+ */
+#define SXE_TIME_OK(sx) \
+        ((sx)->nchains == SX_OPEN && sizeof(size_t) >= sizeof(uint64_t))
+
+/*
+ * Records the insertion-time of the time-queue entry of a signature-index
+ * element. Does nothing if the signature-index can't hold it.
+ */
+static inline void
+sxe_setTime(
+        const sx *const         sx,
+        sxelem *const           sxep,
+        const timestampt *const tvp)
+{
+    if(SXE_TIME_OK(sx) && tvp->tv_sec >= 0)
+        sxep->next = (size_t)((uint64_t)tvp->tv_sec * 1000000 + tvp->tv_usec);
+}
+
+/*
+ * Returns the insertion-time of the time-queue entry of a signature-index
+ * element if it's known.
+ *
+ * @retval true   `*tvp` is set
+ * @retval false  The insertion-time is unknown
+ */
+static inline bool
+sxe_getTime(
+        const sx *const     sx,
+        const sxelem *const sxep,
+        timestampt *const   tvp)
+{
+    if(!SXE_TIME_OK(sx) || sxep->next == SX_NONE)
+        return false;
+    tvp->tv_sec = (time_t)(sxep->next / 1000000);
+    tvp->tv_usec = sxep->next % 1000000;
+    return true;
+}
+
 /**
  * Searches the signature-index for an entry.
  *
@@ -2579,6 +3641,13 @@ sx_find(sx *const sx, const signaturet sig, sxelem **sxepp)
     size_t next;
     sxhash *sxhp;
     int status = 0;
+
+    if (sx->nchains == SX_OPEN) {
+        sxo* const sxo = (struct sxo*)sx;
+        size_t     i = sxo_find(sxo, sig);
+        *sxepp = i == SX_NONE ? NULL : &SXO_SLOTS(sxo)[i];
+        return i != SX_NONE;
+    }
         /* sxhp = (sxhash *)((char *)(sx) + sxwo_sz(sx->nalloc)); */
     sxhp = (sxhash *)(&sx->sxep[sx->nalloc]);
     log_assert(sxhp->magic == SX_MAGIC);
@@ -2616,6 +3685,9 @@ sx_add(sx *const sx, const signaturet sig, off_t const offset)
     size_t try;
     size_t next;                /* head of a list of signatures */
     sxhash *sxhp;
+
+    if (sx->nchains == SX_OPEN)
+        return sxo_add((struct sxo*)sx, sig, offset);
     /* sxhp = (sxhash *)((char *)(sx) + sxwo_sz(sx->nalloc)); */
     sxhp = (sxhash *)(&sx->sxep[sx->nalloc]);
     log_assert(sxhp->magic == SX_MAGIC);
@@ -2662,6 +3734,9 @@ sx_find_delete(sx *const sx, const signaturet sig)
     size_t try;
     size_t next;
     sxhash *sxhp;
+
+    if (sx->nchains == SX_OPEN)
+        return sxo_find_delete((struct sxo*)sx, sig);
     /* sxhp = (sxhash *)((char *)(sx) + sxwo_sz(sx->nalloc)); */
     sxhp = (sxhash *)(&sx->sxep[sx->nalloc]);
     log_assert(sxhp->magic == SX_MAGIC);
@@ -2670,6 +3745,8 @@ sx_find_delete(sx *const sx, const signaturet sig)
     /* find chain */
     try = sx_hash(sx->nchains, sig);
     next = sxhp->chains[try];
+    if (next == SX_NONE)
+        return 0;       /* empty chain */
     sxep = &sx->sxep[next];
     if(sx_compare(sig, sxep->sxi)) { /* found */
         sxhp->chains[try] = sxep->next;
@@ -2692,4199 +3769,9943 @@ sx_find_delete(sx *const sx, const signaturet sig)
     return 0;              /* not found */
 }
 
+/*
+ * Adds the signatures of one signature-index to another, which may have a
+ * different capacity or format. The insertion-times of an open-addressed
+ * source are kept if the destination can hold them. Returns 0 or ENOSPC if the
+ * destination is too small.
+ */
+static int
+sx_copy(sx *const dst, const sx *const src)
+{
+    if (src->nchains == SX_OPEN) {
+        const sxo* const    sxop = (const sxo*)src;
+        const sxelem* const slots = SXO_SLOTS(sxop);
+
+        for (size_t i = 0; i < sxop->nslots; i++) {
+            if (sxop->meta[i]) {
+                sxelem* const sxep = sx_add(dst, slots[i].sxi,
+                        slots[i].offset);
+                timestampt    tv;
+
+                if (sxep == NULL)
+                    return ENOSPC;
+                if (sxe_getTime(src, slots + i, &tv))
+                    sxe_setTime(dst, sxep, &tv);
+            }
+        }
+    }
+    else {
+        const sxhash* const sxhp = (const sxhash*)&src->sxep[src->nalloc];
+
+        for (size_t c = 0; c < src->nchains; c++)
+            for (size_t ix = sxhp->chains[c]; ix != SX_NONE;
+                    ix = src->sxep[ix].next)
+                if (sx_add(dst, src->sxep[ix].sxi, src->sxep[ix].offset)
+                        == NULL)
+                    return ENOSPC;
+    }
+    return 0;
+}
+
 /* End sx */
-/* Begin ix */
+/* Begin es */
 
 /*
- * We use 'ix' to refer to the collection of shared
- * indexes at the end of the file.
- * (pq->rlp & pq->tqp)
+ * An index format (IX_EVSIGS) adds the signatures of recently evicted
+ * data-products, so that a data-product that arrives again after it was evicted
+ * -- for example, from a redundant upstream LDM that lags by more than the
+ * minimum virtual residence time -- is rejected as a duplicate rather than
+ * processed again. It's a ring of one signature per product slot, in order of
+ * eviction, that's indexed by an open-addressed hash table. A signature is
+ * remembered until its entry is overwritten or it's older than the horizon.
  */
 
+#define ES_MAGIC        0x45564953      /* "EVIS" */
+/* Default horizon in seconds */
+#define ES_HORIZON      3600
+
+typedef struct {
+    signaturet  sig;            /* signature of an evicted data-product */
+    int64_t     when;           /* time of eviction in seconds */
+} eselem;
+
+struct es {
+    uint32_t    magic;
+    uint32_t    horizon;        /* seconds to remember a signature. 0 => as
+                                 * long as there's room */
+    size_t      nalloc;         /* capacity of the ring */
+    size_t      nbuckets;       /* size of hash table. A power of two */
+    size_t      head;           /* index of next ring entry to be written */
+    size_t      nelems;         /* number of ring entries in use */
+    uint64_t    nadds;          /* number of signatures added */
+    uint64_t    nlate;          /* number of late duplicates rejected */
+    uint64_t    seed;           /* random key of the hash. See sxo_hash() */
+    eselem      ring[1];        /* actually `nalloc` long and followed by
+                                 * `nbuckets` uint32_t buckets of ring
+                                 * index + 1 (0 => empty) */
+};
+typedef struct es es;
+
+static inline size_t
+es_nbuckets(const size_t nelems)
+{
+    size_t n = 1;
+    while (n < 2*nelems)
+        n *= 2;
+    return n;
+}
+
 /*
- * Return the amount of space required to store a
- * collection of indices, each of 'nelems'.
+ * Returns the size, in bytes, of the evicted-signature index for a given
+ * number of product slots.
  */
 static size_t
-ix_sz(const size_t nelems, const size_t align)
+es_sz(const size_t nelems)
 {
-    log_assert(nelems);
-    static size_t prev_nelems;
-    static size_t size;
-    if (nelems != prev_nelems) {
-        prev_nelems = nelems;
-        size = _RNDUP(rl_sz(nelems), align) + _RNDUP(tq_sz(nelems), align)
-           + _RNDUP(fb_sz(nelems), align) + _RNDUP(sx_sz(nelems), align);
-    }
-    return size;
+    return offsetof(es, ring) + nelems*sizeof(eselem) +
+            es_nbuckets(nelems)*sizeof(uint32_t);
+}
+
+static inline uint32_t*
+es_buckets(es* const esp)
+{
+    return (uint32_t*)(esp->ring + esp->nalloc);
 }
 
+static inline size_t
+es_hash(const es* const esp, const signaturet sig)
+{
+    return (size_t)sxo_hash(esp->seed, sig) & (esp->nbuckets - 1);
+}
 
-/**
- * Computes and returns pointers to the indexes.
- *
- * @param[in]  ix      Start of index region
- * @param[in]  ixsz    Extent of the index region in bytes
- * @param[in]  nelems  Capacity of product-queue in number of products
- * @param[in]  align   Alignment parameter in bytes
- * @param[out] rlpp    Pointer to region index
- * @param[out] tqpp    Pointer to time index
- * @param[out] fbpp    Pointer to "fblk" index
- * @param[out] sxpp    Pointer to signature index
- * @retval     1       Success. `*rlpp`, `*tqpp`, `*fbpp`, and `*sxpp` are set
- * @retval     0       Failure. log_log() called.
+static void
+es_init(es* const esp, const size_t nelems)
+{
+    esp->magic = ES_MAGIC;
+    esp->horizon = ES_HORIZON;
+    esp->nalloc = nelems;
+    esp->nbuckets = es_nbuckets(nelems);
+    esp->head = 0;
+    esp->nelems = 0;
+    esp->nadds = 0;
+    esp->nlate = 0;
+    esp->seed = sxo_seed();
+    (void)memset(es_buckets(esp), 0, esp->nbuckets*sizeof(uint32_t));
+}
+
+/*
+ * Removes the hash-table entry of a ring entry. Uses backward-shift deletion
+ * so that later probes needn't skip tombstones.
  */
-static int
-ix_ptrs(
-        void* const restrict     ix,
-        const size_t             ixsz,
-        const size_t             nelems,
-        const size_t             align,
-        regionl** const restrict rlpp,
-        tqueue** const restrict  tqpp,
-        fb** const restrict      fbpp,
-        sx** const restrict      sxpp)
+static void
+es_unlink(es* const esp, const size_t ringix)
 {
-    log_assert(nelems);
-    /*
-     * Profiling revealed that the program pqact(1) spent about 1/3 of its time
-     * in the function isprime(), which is indirectly called by the functions
-     * rl_sz() and sx_sz(); thus, the following optimization. SRE 2016-06-21
-     */
-    static size_t prev_nelems = 0;
-    static size_t rl_size;
-    static size_t tq_size;
-    static size_t fb_size;
-    static size_t sx_size;
-    if (nelems != prev_nelems) {
-        prev_nelems = nelems;
-        rl_size = rl_sz(nelems);
-        tq_size = tq_sz(nelems);
-        fb_size = fb_sz(nelems);
-        sx_size = sx_sz(nelems);
+    uint32_t* const buckets = es_buckets(esp);
+    const size_t    mask = esp->nbuckets - 1;
+    size_t          i = es_hash(esp, esp->ring[ringix].sig);
+
+    while (buckets[i] != ringix + 1) {
+        if (buckets[i] == 0)
+            return; /* superseded by a newer entry. See es_add() */
+        i = (i + 1) & mask;
     }
-    *rlpp = (regionl*)ix;
-    *tqpp =  (tqueue*)_RNDUP((intptr_t)((char*)(*rlpp) + rl_size), align);
-    *fbpp =      (fb*)_RNDUP((intptr_t)((char*)(*tqpp) + tq_size), align);
-    *sxpp =      (sx*)_RNDUP((intptr_t)((char*)(*fbpp) + fb_size), align);
-    /*
-     * Can't set cached `tq->fbp` and `rl->fbp` here because they are in a
-     * memory-mapped file, which might be open read-only.
-     */
-    bool bounds_check = ((char*)(*sxpp) + sx_size) <= ((char*)ix + ixsz);
-#ifdef NDEBUG
-    if (!bounds_check) {
-        log_error_q("ix=%p, ixsz=%zu, nelems=%zu, align=%zu, rl_size=%zu, "
-                "tq_size=%zu, fb_size=%zu, sx_size=%zu, *sxpp=%p",
-                ix, ixsz, nelems, align, rl_size, tq_size, fb_size, sx_size,
-                *sxpp);
-        return 0;
+    for (size_t j = (i + 1) & mask; buckets[j]; j = (j + 1) & mask) {
+        const size_t k = es_hash(esp, esp->ring[buckets[j] - 1].sig);
+        /* Move the entry at `j` unless its home is cyclically in (i, j] */
+        if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+            buckets[i] = buckets[j];
+            i = j;
+        }
     }
-#else
-    log_assert(bounds_check);
-#endif
-    return 1;
+    buckets[i] = 0;
 }
 
-/* End ix */
-/* Begin bsrch */
 /*
- * Code is derived from berkeley bsearch(),
- * But we want to know where we were on failure, so
- * we can do sorted insertions.
+ * Remembers the signature of an evicted data-product, forgetting the oldest
+ * one if the ring is full. If the signature is already remembered, then its
+ * hash-table entry is moved to the new ring entry so that es_find() sees the
+ * latest eviction.
  */
+static void
+es_add(es* const esp, const signaturet sig, const time_t now)
+{
+    uint32_t* const buckets = es_buckets(esp);
+    const size_t    mask = esp->nbuckets - 1;
+    const size_t    ix = esp->head;
+
+    if (esp->nelems == esp->nalloc) {
+        es_unlink(esp, ix);
+    }
+    else {
+        esp->nelems++;
+    }
+    (void)memcpy(esp->ring[ix].sig, sig, sizeof(signaturet));
+    esp->ring[ix].when = now;
+
+    size_t i = es_hash(esp, sig);
+    while (buckets[i] && !sx_compare(sig, esp->ring[buckets[i] - 1].sig))
+        i = (i + 1) & mask;
+    buckets[i] = ix + 1;
+
+    esp->head = (ix + 1) % esp->nalloc;
+    esp->nadds++;
+}
+
 /*
- * Perform a binary search.
- *
- * The code below is a bit sneaky.  After a comparison fails, we
- * divide the work in half by moving either left or right. If lim
- * is odd, moving left simply involves halving lim: e.g., when lim
- * is 5 we look at item 2, so we change lim to 2 so that we will
- * look at items 0 & 1.  If lim is even, the same applies.  If lim
- * is odd, moving right again involves halving lim, this time moving
- * the base up one item past p: e.g., when lim is 5 we change base
- * to item 3 and make lim 2 so that we will look at items 3 and 4.
- * If lim is even, however, we have to shrink it by one before
- * halving: e.g., when lim is 4, we still looked at item 2, so we
- * have to make lim 3, then halve, obtaining 1, so that we will only
- * look at item 3.
+ * Indicates if a signature is that of a data-product that was evicted within
+ * the horizon.
  */
-static int
-bsrch(const void *key,
-        const void *base0,
-        size_t nmemb,
-        size_t size,
-        int (*compar)(const void *, const void *),
-        const void **resultp
-        )
+static bool
+es_find(const es* const esp, const signaturet sig, const time_t now)
 {
-        const char *base = base0;
-        size_t lim;
-        int cmp = 0;
-        const void *p = base0;
+    const uint32_t* const buckets = es_buckets((es*)esp);
+    const size_t          mask = esp->nbuckets - 1;
 
-        for (lim = nmemb; lim != 0; lim /= 2) {
-                p = base + (lim/2) * size;
-                cmp = (*compar)(key, p);
-                if (cmp == 0)
-                {
-                        /* found it */
-                        *resultp = p;
-                        return 1;
-                }
-                if (cmp > 0) {  /* key > p: move right */
-                        base = (const char *)p + size;
-                        lim--;
-                }               /* else move left */
-        }
-        /* didn't find it */
-        if(cmp > 0)
-                *resultp = (const char *)p + size;
-        else    
-                *resultp = p;
-        return 0;
+    for (size_t i = es_hash(esp, sig); buckets[i]; i = (i + 1) & mask) {
+        const eselem* const esep = esp->ring + buckets[i] - 1;
+
+        if (sx_compare(sig, esep->sig))
+            return esp->horizon == 0 || now - esep->when <= esp->horizon;
+    }
+    return false;
 }
-/* End bsrch */
-/* Begin riu */
 
 /*
- * This structure is used to keep track of
- * a region which this process has 'in use'.
- * It appears on the process private list (riul *) pq->riulp.
- * 'offset' is the seek offset of the region in the queue file,
- * 'extent' is it's size,
- * 'vp' is the memory handle being used to access the region,
- * and 'rflags' stashes the RGN_* flags with which the region was gotten.
+ * Returns the time of the oldest remembered eviction or `now` if there's
+ * none.
  */
-struct riu {
-        off_t offset;
-        size_t extent;
-        void *vp;
-        int rflags;
-};
-typedef struct riu riu;
-
-/* End riu */
-/* Begin riul */
+static time_t
+es_oldest(const es* const esp, const time_t now)
+{
+    if (esp->nelems == 0)
+        return now;
+    return esp->ring[esp->nelems < esp->nalloc ? 0 : esp->head].when;
+}
 
 /*
- * The process private list of regions in use.
- * Sorted by offset.
- *
- * TODO: This table typically contains 3 to 5 entries (verify).
- * Maintaining sort and using binary search is overkill.
+ * Adds the remembered signatures of one evicted-signature index to another,
+ * which may have a different capacity, from oldest to newest. The signatures
+ * are hashed with the seed of the destination. The horizon and counters are
+ * copied, too.
  */
-struct riul
+static void
+es_copy(es* const dst, const es* const src)
 {
-#define RIU_NALLOC_INITIAL      255
-        size_t sz;
-        size_t nalloc;
-        size_t nelems;
-        size_t maxelems;        /* max nelems so far */
-        riu rp[RIU_NALLOC_INITIAL]; /* actually nalloc long */
+    const size_t start = src->nelems < src->nalloc ? 0 : src->head;
+
+    for (size_t i = 0; i < src->nelems; i++) {
+        const eselem* const esep = src->ring + (start + i) % src->nalloc;
+        es_add(dst, esep->sig, (time_t)esep->when);
+    }
+    dst->horizon = src->horizon;
+    dst->nadds = src->nadds;
+    dst->nlate = src->nlate;
+}
+
+/* End es */
+/* Begin cl */
+
+/*
+ * An index format (IX_RLCLASS) segregates the small data-products of a
+ * product-queue that allocates by size-class (PQ_RLCLASS). The region of a
+ * data-product of at most CL_MAX bytes has the extent of the smallest
+ * size-class that holds it. Each size-class has a list of free regions of its
+ * extent, linked by their `next` members, and a slab: a free region that's a
+ * multiple of the class's extent, from whose front regions of the class are
+ * cut, and that's taken from the free region that best fits one region of the
+ * class. A freed small region goes onto the list of its class rather than being
+ * merged with its neighbors, so small data-products reuse each others' regions
+ * and don't fragment the free regions that large data-products need; only a
+ * larger data-product or a new slab is found by `rl_fext_find()`. The regions
+ * of the size-classes are counted as free by the region-list but aren't on
+ * its skip-lists; they're returned there by `cl_drain()` when a large
+ * data-product doesn't fit.
+ */
+
+#define CL_MAGIC        0x434c4153      /* "CLAS" */
+/* Extent of the smallest size-class in bytes */
+#define CL_MIN          256
+/* Number of size-classes per doubling of the extent */
+#define CL_STEPS        8
+/* Number of doublings of the extent from the smallest to the largest class */
+#define CL_DOUBLINGS    8
+#define CL_NCLASSES     (1 + CL_STEPS*CL_DOUBLINGS)
+/* Extent of the largest size-class in bytes */
+#define CL_MAX          (CL_MIN << CL_DOUBLINGS)
+/* Maximum extent of a slab in bytes. Larger slabs hold more free space
+ * idle */
+#define CL_SLAB         (16*1024)
+
+struct cl {
+    uint32_t    magic;
+    uint32_t    nclasses;       /* number of size-classes */
+    size_t      nregions;       /* number of free regions on the lists and in
+                                 * slabs */
+    size_t      nbytes;         /* number of bytes in those regions */
+    size_t      heads[CL_NCLASSES]; /* rp-index of the first free region of
+                                 * each class or RL_NONE */
+    size_t      slabs[CL_NCLASSES]; /* rp-index of the slab of each class or
+                                 * RL_NONE */
 };
-typedef struct riul riul;
-#define MIN_RIUL_SZ (3 * sizeof(size_t))
+typedef struct cl cl;
+
+/*
+ * Returns the size, in bytes, of the size-class index.
+ */
+static inline size_t
+cl_sz(void)
+{
+    return sizeof(cl);
+}
 
+static void
+cl_init(cl* const clp)
+{
+    clp->magic = CL_MAGIC;
+    clp->nclasses = CL_NCLASSES;
+    clp->nregions = 0;
+    clp->nbytes = 0;
+    for (size_t c = 0; c < CL_NCLASSES; c++) {
+        clp->heads[c] = RL_NONE;
+        clp->slabs[c] = RL_NONE;
+    }
+}
 
 /*
- * Return the nalloc (array size) 
- * of a riul which will fit into 'sz'.
+ * Returns the extent of a size-class. Classes grow by 1/CL_STEPS of the
+ * previous power of two, so a region wastes less than 1/CL_STEPS of its
+ * extent.
  */
 static size_t
-riul_nalloc(size_t sz)
+cl_extent(const size_t c, const size_t align)
 {
-        log_assert(sz >  MIN_RIUL_SZ);
-        sz -= sizeof(size_t); /* sz */
-        sz -= sizeof(size_t); /* nalloc */
-        sz -= sizeof(size_t); /* nelems */
-        sz -= sizeof(size_t); /* maxelems */
-        sz /= sizeof(riu);
-        return sz;
-}
+    size_t extent;
 
+    if (c == 0) {
+        extent = CL_MIN;
+    }
+    else {
+        const size_t base = (size_t)CL_MIN << ((c-1)/CL_STEPS);
+        extent = base + ((c-1)%CL_STEPS + 1)*(base/CL_STEPS);
+    }
+    return _RNDUP(extent, align);
+}
 
 /*
- * Initialize (re Initialize) a riul
+ * Returns the smallest size-class whose extent is at least a given one or
+ * CL_NCLASSES if the extent is larger than every class.
  */
-static void
-riul_init(riul *const rl, size_t const nelems, size_t sz)
+static size_t
+cl_ceil(const size_t extent, const size_t align)
 {
-        riu *rp;
-        size_t nalloc = riul_nalloc(sz);
-        riu *const end = &rl->rp[nalloc];
+    size_t lo = 0;
+    size_t hi = CL_NCLASSES;
 
-        log_assert(rl != NULL);
-        log_assert(sz != 0);
-        log_assert(nelems == 0 || rl->nelems == nelems);
-        log_assert(nelems == 0 || rl->nalloc < nalloc);
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
 
-        rl->sz = sz;
-        rl->nalloc = nalloc;
-        rl->nelems = nelems;
-        if(nelems == 0)
-            rl->maxelems = 0;
-        for(rp = &rl->rp[nelems];
-                        rp < end; rp++)
-        {
-                rp->offset = OFF_NONE;
-                rp->extent = 0;
-                rp->vp = NULL;
-                rp->rflags = 0;
+        if (cl_extent(mid, align) < extent) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
         }
+    }
+    return lo;
 }
 
-
 /*
- * Affirm that that another element can be added to rl
+ * Returns the largest size-class whose extent is at most a given one or
+ * CL_NCLASSES if the extent is smaller than every class or larger than
+ * CL_MAX.
  */
-static int
-riul_HasSpace(const riul *const rl)
+static size_t
+cl_floor(const size_t extent, const size_t align)
 {
-        log_assert(rl->nelems <= rl->nalloc);
-        return (rl->nelems < rl->nalloc);
-}
+    const size_t c = cl_ceil(extent, align);
 
+    if (c == CL_NCLASSES)
+        return c;
+    if (cl_extent(c, align) == extent)
+        return c;
+    return c ? c - 1 : CL_NCLASSES;
+}
 
-/**
- * Comparison function used by bsrch() in riul_r_find() below.
- * The riul is sorted by region offset.
+/*
+ * Puts a free region that's on neither skip-list onto the list of its class.
+ * The region must be counted as free by the region-list.
  */
-static int
-riul_r_compare(const void *vp1, const void *vp2)
+static void
+cl_push(cl* const clp, regionl* const rl, const size_t rlix, const size_t c)
 {
-    const riu*  riu1 = vp1;
-    const riu*  riu2 = vp2;
-    const off_t diff = riu1->offset - riu2->offset;
-    return (diff < 0)
-            ? -1
-            : (diff == 0)
-              ? 0
-              : 1;
-}
+    region* const rep = rl->rp + rlix;
 
+    rep->next = clp->heads[c];
+    rep->prev = RL_NONE;
+    clp->heads[c] = rlix;
+    clp->nregions++;
+    clp->nbytes += rep->extent;
+}
 
-/**
- * Searches a list of regions-in-use for one with a given or greater offset.
- *
- * @param[in]  rl      List of regions-in-use
- * @param[in]  offset  Offset to search for
- * @param[out] rpp     Pointer to region-in-use with given offset or to the next
- *                     region in the list with a greater offset
- * @retval     1       Region with given offset found
- * @retval     0       Region with given offset not found
+/*
+ * Cuts a region of a class's extent from the front of the class's slab. The
+ * region is counted as in use. Returns RL_NONE if the class has no slab or
+ * there's no empty slot for the region.
  */
-static int
-riul_r_find(
-        const riul* const restrict rl,
-        off_t const                offset,
-        riu* const* const restrict rpp)
+static size_t
+cl_cut(cl* const clp, regionl* const rl, const size_t c, const size_t extent)
 {
-        int status;
-        riu rgn;
-        rgn.offset = offset;
-        status = bsrch(&rgn,
-                rl->rp, rl->nelems, sizeof(riu), riul_r_compare,
-                        (const void **)rpp);
-        log_assert(status == 0 || (*rpp)->vp != NULL);
-        return status;
-}
+    const size_t slabix = clp->slabs[c];
+    size_t       rlix;
 
+    if (slabix == RL_NONE)
+        return RL_NONE;
 
-/**
- * Finds a region-in-use in a regions-in-use list.
- *
- * @param[in] rl          List of regions-in-use
- * @param[in] offset      Offset of region to be found
- * @retval    NULL        No such region found
- * @return                Pointer to region-in-use entry
- */
-static riu*
-riul_find(
-        const riul* const rl,
-        const off_t       offset)
-{
-        riu* rp;
-        return riul_r_find(rl, offset, &rp)
-                ? rp
-                : NULL;
+    region* slab = rl->rp + slabix;
+    log_assert(slab->extent >= extent && slab->extent % extent == 0);
+
+    if (slab->extent == extent) {
+        /* Last region of the slab */
+        clp->slabs[c] = RL_NONE;
+        clp->nregions--;
+        rl->nfree--;
+        rlix = slabix;
+    }
+    else {
+        rlix = rp_get(rl);
+        if (rlix == RL_NONE)
+            return RL_NONE;
+        slab = rl->rp + slabix;
+        region* const rep = rl->rp + rlix;
+        rep->offset = slab->offset;
+        rep->extent = extent;
+        slab->offset += (off_t)extent;
+        slab->extent -= extent;
+    }
+    clp->nbytes -= extent;
+    rl->nelems++;
+    if (rl->nelems > rl->maxelems)
+        rl->maxelems = rl->nelems;
+    return rlix;
 }
 
-/**
- * Add elem to list, maintain sort by offset
- *
- * @param[in,out] riulpp  List of regions-in-use. `*riulpp` may be modified on
- *                        return.
- * @param[in] growby      Amount, in bytes, to grow the list by if necessary
- * @param[in] offset      Offset to region in bytes
- * @param[in] extent      Extent of region in bytes
- * @param[in] vp          Pointer to region's data
- * @param[in] rflags      Region flags: bitwise OR of
- *                        - RGN_NOLOCK  Don't lock region; locking handled
- *                                      elsewhere
- *                        - RGN_WRITE   Region will be modified
- *                        - RGN_NOWAIT  Return immediately if can't lock, else
- *                                      wait
- * @retval 0              Success.
- * @retval ENOMEM         Insufficient memory is available.
+/*
+ * Gets a free region of a size-class: from the class's list, from its slab,
+ * or from a new slab or region taken from the free skip-lists. The region is
+ * counted as in use. Returns RL_NONE if none is available. This function is
+ * the complement of `cl_put()`.
  */
-static int
-riul_add(
-        riul** const restrict riulpp,
-        const size_t          growby,
-        const off_t           offset,
-        const size_t          extent,
-        void* const restrict  vp,
-        const int             rflags,
-        riu** const restrict  rpp)
+static size_t
+cl_get(cl* const clp, regionl* const rl, const size_t c, const size_t align)
 {
-        riu *rp;
-        riul *rl = *riulpp;
-        riu *end;
-
-        if(!riul_HasSpace(rl))
-        {
-                /* get space */
-                size_t newsz = rl->sz + growby;
-                riul *nriulp = (riul *)realloc(rl, newsz);
-                if(nriulp == NULL)
-                        return errno;
-                riul_init(nriulp, nriulp->nelems, newsz);
-                *riulpp = rl = nriulp;
-        }
+    const size_t extent = cl_extent(c, align);
+    size_t       rlix = clp->heads[c];
 
-        /*
-         * "end" should be set after any potential reallocation of the
-         * regions-in-use structure to ensure that "end" points into the
-         * (possibly new) "rl->rp" array.
-         */
-        end = &rl->rp[rl->nelems];
+    if (rlix != RL_NONE) {
+        region* const rep = rl->rp + rlix;
 
-        {
-            int found = riul_r_find(rl, offset, &rp);
+        clp->heads[c] = rep->next;
+        clp->nregions--;
+        clp->nbytes -= rep->extent;
+        rl->nfree--;
+        rl->nelems++;
+        if (rl->nelems > rl->maxelems)
+            rl->maxelems = rl->nelems;
+        return rlix;
+    }
 
-            log_assert(found == 0);
-        }
+    rlix = cl_cut(clp, rl, c, extent);
+    if (rlix != RL_NONE || clp->slabs[c] != RL_NONE)
+        return rlix;
 
-        if(rp < end)
-        {
-                /* shuffle right */
-                /* LOG_DEBUG("riul_add memmove: %ld", (char* )end - (char *)rp); */
-                memmove(rp +1, rp, (char *)end - (char *)rp);
-        }
-        
-        rp->offset = offset;
-        rp->extent = extent;
-        rp->vp = vp;
-        rp->rflags = rflags;
+    /* Cutting a new slab needs two empty slots: for a split-off remainder and
+     * for the region. */
+    if (rl->nempty < 2)
+        return RL_NONE;
 
-        *rpp = rp;
+    /* The slab is cut from the free region that best fits one region of the
+     * class, so that it doesn't split a free region that a larger
+     * data-product could use. */
+    rlix = rl_get(rl, extent);
+    if (rlix == RL_NONE)
+        return RL_NONE;
 
-        rl->nelems++;
-        if(rl->nelems > rl->maxelems) {
-            rl->maxelems = rl->nelems;
-        }
-        /* DEBUG */ /* log_assert(riul_r_find(rl, offset, &rp) != 0); */
+    size_t want = rl->rp[rlix].extent / extent;
+    if (want > CL_SLAB / extent)
+        want = CL_SLAB / extent;
+    if (want == 0)
+        want = 1;
+    want *= extent;
+    if (rl->rp[rlix].extent > want && rl_split(rl, rlix, want)) {
+        log_clear();
+        rl_put(rl, rlix);
+        return RL_NONE;
+    }
+    if (want == extent)
+        return rlix;
 
-        return ENOERR;
+    /* The new region is the class's slab, which is free */
+    rl->nelems--;
+    rl->nfree++;
+    if (rl->nfree > rl->maxfree)
+        rl->maxfree = rl->nfree;
+    clp->slabs[c] = rlix;
+    clp->nregions++;
+    clp->nbytes += want;
+    rlix = cl_cut(clp, rl, c, extent);
+    log_assert(rlix != RL_NONE);
+    log_assert(rl->nelems + rl->nfree + rl->nempty == rl->nalloc);
+    return rlix;
 }
 
-/**
- * Remove a region-in-use from the list of regions-in-use
- *
- * @param[in,out] rl  List of regions-in-use
- * @param[in]         In-use region to be removed from list
+/*
+ * Returns a region that was gotten by `cl_get()` but never allocated to the
+ * list of its class. This function is the complement of `cl_get()`.
  */
 static void
-riul_delete(
-        riul* const restrict rl,
-        riu* const restrict  rp)
+cl_put(cl* const clp, regionl* const rl, const size_t rlix, const size_t align)
 {
-        riu *end = &rl->rp[rl->nelems];
-        riu *rght = rp +1;
-
-        log_assert(&rl->rp[0] <= rp && rp < end);
-
-        if(rght < end)
-        {
-                /* shuffle left */
-                /* LOG_DEBUG("riul_delete memmove: %ld", (char* )end - (char *)rght); */
-                memmove(rp, rght, (char *)end - (char *)rght);
-        }
-        end--;
+    const size_t c = cl_floor(rl->rp[rlix].extent, align);
 
-        end->offset = OFF_NONE;
-        end->extent = 0;
-        end->vp = NULL;
-        end->rflags = 0;
-        rl->nelems--;
+    log_assert(c < CL_NCLASSES);
+    rl->nelems--;
+    rl->nfree++;
+    cl_push(clp, rl, rlix, c);
+    log_assert(rl->nelems + rl->nfree + rl->nempty == rl->nalloc);
 }
 
-/* End riul */
-/* Begin pqctl */
-
 /*
- * Shared, on disk, pq control structure.
- * Fixed size, never grows.
- * At beginning of file.
+ * Frees an in-use region onto the list of its size-class. Returns false, doing
+ * nothing, if its extent is outside the size-classes.
  */
-struct pqctl {
-#define PQ_MAGIC        0x50515545      /* PQUE */
-        size_t          magic;
-#define PQ_VERSION      7
-        size_t          version;
-        off_t           datao;          /* beginning of data segment */
-        off_t           ixo;            /* beginning of index segment */
-        size_t          ixsz;           /* size of index segement */
-        size_t          nalloc;         /* slots allocated for products */
-        size_t          align;
-        /* stats */
-        off_t           highwater;
-        size_t          maxproducts;
-#define WRITE_COUNT_MAGIC       PQ_MAGIC
-        unsigned        write_count_magic;
-#define MAX_WRITE_COUNT         ~0u
-        unsigned        write_count;
-#define METRICS_MAGIC           (PQ_MAGIC+1)
-        unsigned        metrics_magic;
-        timestampt      mostRecent;     /* time of most recent insertion */
-        timestampt      minVirtResTime; /* minimum virtual residence time */
-        int             isFull;         /* is the queue full? */
-#define METRICS_MAGIC_2         (PQ_MAGIC+2)
-        unsigned        metrics_magic_2;
-        off_t           mvrtSize;       /* data-usage in bytes when MVRT set */
-        size_t          mvrtSlots;      /* slot-usage when MVRT set */
-};
-typedef struct pqctl pqctl;
-
-/* End pqctl */
-/* Begin pq */
+static bool
+cl_free(cl* const clp, regionl* const rl, const size_t rlix,
+        const size_t align)
+{
+    region* const rep = rl->rp + rlix;
+    const size_t  c = cl_floor(Extent(rep), align);
 
-/* function for putting memory to disk and releasing the memory; does a
- * possible unmap() or write() followed by an unlock */
-typedef int mtofFunc(pqueue *const pq,
-        off_t const offset,
-        int const rflags);
+    if (c == CL_NCLASSES)
+        return false;
 
-/* function for getting stuff on disk into memory; does a lock possibly followed
- * by an mmap() or read() */
-typedef int ftomFunc(pqueue *const pq,
-        const off_t offset,
-        const size_t extent,
-        const int rflags,
-        void **const ptrp);
+    fClr(rep->extent, RL_FLAGS);
+    rl->nbytes -= rep->extent;
+    rlhash_del(rl, rlix);
+    rl->nelems--;
+    rl->nfree++;
+    if (rl->nfree > rl->maxfree)
+        rl->maxfree = rl->nfree;
+    cl_push(clp, rl, rlix, c);
+    log_assert(rl->nelems + rl->nfree + rl->nempty == rl->nalloc);
+    return true;
+}
 
 /*
- * The process private pq info. (Internal structure)
+ * Returns the free regions of the size-classes, including their slabs, to the
+ * free skip-lists, where they're merged with their free neighbors. Returns the
+ * number of regions returned.
  */
-struct pqueue {
-#define PQ_SIGSBLOCKED  0x1000  /* sav_set is valid */
-        /**
-         * Product-queue flags. Bitwise OR of
-         * - Persistent flags:
-         *   + PQ_MAPRGNS      Map region by region, default is whole file if
-         *                     possible; otherwise, by region
-         *   + PQ_NOCLOBBER    Don't replace an existing product-queue
-         *   + PQ_NOLOCK       Disable locking (DANGER!)
-         *   + PQ_NOMAP        Use `malloc/read/write/free` instead of `mmap()`
-         *   + PQ_PRIVATE      `mmap()` the file `MAP_PRIVATE`. Default is
-         *                     `MAP_SHARED`.
-         *   + PQ_READONLY     Product-queue is read-only. Default is
-         *                     read/write.
-         * - Transient flag:
-         *   + PQ_SIGSBLOCKED  Critical-section signals are blocked
-         */
-        int              pflags;
-        size_t           pagesz;
-        ftomFunc*        ftom;
-        mtofFunc*        mtof;
-        size_t           riusz;
-        riul*            riulp;
-
-        int              fd;
-
-        pqctl*           ctlp;
+static size_t
+cl_drain(cl* const clp, regionl* const rl)
+{
+    size_t n = 0;
 
-        off_t            datao;
-        /// start of memory-mapped file
-        void*            base;
+    for (size_t c = 0; c < CL_NCLASSES; c++) {
+        size_t rlix = clp->heads[c];
 
-        /// Where are the indexes
-        off_t            ixo;
-        size_t           ixsz;
-        void*            ixp;
-        /// Slots allocated for products
-        size_t           nalloc;
+        while (rlix != RL_NONE) {
+            const size_t next = rl->rp[rlix].next;
 
-        /// Region-list index
-        regionl*         rlp;
-        /// timestamp index
-        tqueue*          tqp;
-        /// Skip-list blocks, needed in both region list and timestamp layers
-        fb*              fbp;
-        /// Signature index
-        sx*              sxp;
-        /// Private, current position in queue
-        timestampt       cursor;
-        /// Private, current offset in queue
-        off_t            cursor_offset;
-        sigset_t         sav_set;
-        /// Pathname of the product-queue
-        char             pathname[PATH_MAX];
-        /// Number of reserved products
-        long             pqe_count;
+            rl->nfree--;
+            rl_rel(rl, rlix);
+            rl_consolidate(rl, rlix);
+            n++;
+            rlix = next;
+        }
+        clp->heads[c] = RL_NONE;
+        if (clp->slabs[c] != RL_NONE) {
+            rl->nfree--;
+            rl_rel(rl, clp->slabs[c]);
+            rl_consolidate(rl, clp->slabs[c]);
+            clp->slabs[c] = RL_NONE;
+            n++;
+        }
+    }
+    clp->nregions = 0;
+    clp->nbytes = 0;
+    log_assert(rl->nelems + rl->nfree + rl->nempty == rl->nalloc);
+    return n;
+}
 
-        /// Mutex for concurrent access by multiple threads
-        pthread_mutex_t  mutex;
-};
+/* End cl */
+/* Begin ix */
 
-/* The total size of a product-queue in bytes: */
-#define TOTAL_SIZE(pq) ((off_t)((pq)->ixo + (pq)->ixsz))
+/*
+ * We use 'ix' to refer to the collection of shared
+ * indexes at the end of the file.
+ * (pq->rlp & pq->tqp)
+ */
 
-/* Begin OS */
+/*
+ * Formats of the indexes that differ from those of earlier versions of the
+ * LDM. Bitwise OR of
+ */
+#define IX_TQRING       0x1     /* time-index is a ring */
+#define IX_SXOPEN       0x2     /* signature-index is open-addressed */
+#define IX_TQFEED       0x4     /* time-index records feedtypes */
+#define IX_CHUNKS       0x8     /* region-list has chunks of data-products */
+#define IX_ZIPPED       0x10    /* data-products might be compressed */
+#define IX_EVSIGS       0x20    /* signatures of evicted data-products */
+#define IX_RLCLASS      0x40    /* size-classes of small data-products */
 
 /*
- * What is the system pagesize?
+ * Return the amount of space required to store a
+ * collection of indices, each of 'nelems', in the given formats.
  */
-static inline long
-pagesize(void)
+static size_t
+ix_sz(const size_t nelems, const size_t align, const unsigned formats)
 {
-/* Hmm, aren't standards great? */
-#ifndef CRAY
-#if defined(_SC_PAGE_SIZE) && !defined(_SC_PAGESIZE)
-#define _SC_PAGESIZE _SC_PAGE_SIZE
-#endif
-#ifdef _SC_PAGESIZE
-        return sysconf(_SC_PAGESIZE);
-#else
-        return (long)getpagesize();
-#endif
-#else
-        return 4096L;
-#endif
+    log_assert(nelems);
+    static size_t   prev_nelems;
+    static unsigned prev_formats;
+    static size_t   size;
+    if (nelems != prev_nelems || formats != prev_formats) {
+        prev_nelems = nelems;
+        prev_formats = formats;
+        size = _RNDUP(rl_sz(nelems), align)
+           + _RNDUP(tq_sz(nelems, formats & IX_TQFEED), align)
+           + _RNDUP(fb_sz(nelems), align)
+           + _RNDUP(sx_sz(nelems, formats & IX_SXOPEN), align)
+           + ((formats & IX_EVSIGS) ? _RNDUP(es_sz(nelems), align) : 0)
+           + ((formats & IX_RLCLASS) ? _RNDUP(cl_sz(), align) : 0);
+    }
+    return size;
 }
 
-/*
- * Sortof like ftruncate, except won't make the
- * file shorter.
- * May have side effect of leaving the
- * current position hosed.
- * If sparse == 0, fill in all the zero blocks (slow); 
- * else extend sparsely, without allocating zero blocks.
+
+/**
+ * Computes and returns pointers to the indexes.
  *
- * Returns:
- *      EBADF   The "fd" argument is not a file descriptor open for writing.
- *      EIO     An I/O error occurred while reading from the file system.
- *      EOVERFLOW
- *              The file size in bytes or the number of blocks allocated to the
- *              file or the file serial number cannot be represented correctly.
- *      EINTR   A signal was caught during execution.
- *      EINVAL  The "len" argument was less than 0.
- *      EFBIG or EINVAL
- *              The "len" argument was greater than the maximum file size.
- *      EFBIG   The file is a regular file and length is greater than the offset
- *              maximum established in the open file description associated with
- *              "fd".
- *      EROFS   The named file resides on a read-only file system.
+ * @param[in]  ix      Start of index region
+ * @param[in]  ixsz    Extent of the index region in bytes
+ * @param[in]  nelems  Capacity of product-queue in number of products
+ * @param[in]  align   Alignment parameter in bytes
+ * @param[in]  formats Formats of the indexes. Bitwise OR of IX_* flags.
+ * @param[out] rlpp    Pointer to region index
+ * @param[out] tqpp    Pointer to time index
+ * @param[out] fbpp    Pointer to "fblk" index
+ * @param[out] sxpp    Pointer to signature index
+ * @param[out] espp    Pointer to evicted-signature index. NULL if `formats`
+ *                     doesn't contain IX_EVSIGS.
+ * @param[out] clpp    Pointer to size-class index. NULL if `formats` doesn't
+ *                     contain IX_RLCLASS.
+ * @retval     1       Success. `*rlpp`, `*tqpp`, `*fbpp`, `*sxpp`, `*espp`,
+ *                     and `*clpp` are set
+ * @retval     0       Failure. log_log() called.
  */
 static int
-fgrow(const int fd, const off_t len, int sparse)
+ix_ptrs(
+        void* const restrict     ix,
+        const size_t             ixsz,
+        const size_t             nelems,
+        const size_t             align,
+        const unsigned           formats,
+        regionl** const restrict rlpp,
+        tqueue** const restrict  tqpp,
+        fb** const restrict      fbpp,
+        sx** const restrict      sxpp,
+        es** const restrict      espp,
+        cl** const restrict      clpp)
 {
-        struct stat sb;
-        if (fstat(fd, &sb) < 0)
-                return errno;
-        if (len < sb.st_size)
-                return ENOERR;
-        if (sparse != 0) {
-#ifdef HAVE_FTRUNCATE
-            if (ftruncate(fd, len) < 0)
-                return errno;
+    log_assert(nelems);
+    /*
+     * Profiling revealed that the program pqact(1) spent about 1/3 of its time
+     * in the function isprime(), which is indirectly called by the functions
+     * rl_sz() and sx_sz(); thus, the following optimization. SRE 2016-06-21
+     */
+    static size_t   prev_nelems = 0;
+    static unsigned prev_formats;
+    static size_t   rl_size;
+    static size_t   tq_size;
+    static size_t   fb_size;
+    static size_t   sx_size;
+    static size_t   es_size;
+    static size_t   cl_size;
+    if (nelems != prev_nelems || formats != prev_formats) {
+        prev_nelems = nelems;
+        prev_formats = formats;
+        rl_size = rl_sz(nelems);
+        tq_size = tq_sz(nelems, formats & IX_TQFEED);
+        fb_size = fb_sz(nelems);
+        sx_size = sx_sz(nelems, formats & IX_SXOPEN);
+        es_size = (formats & IX_EVSIGS) ? es_sz(nelems) : 0;
+        cl_size = (formats & IX_RLCLASS) ? cl_sz() : 0;
+    }
+    *rlpp = (regionl*)ix;
+    *tqpp =  (tqueue*)_RNDUP((intptr_t)((char*)(*rlpp) + rl_size), align);
+    *fbpp =      (fb*)_RNDUP((intptr_t)((char*)(*tqpp) + tq_size), align);
+    *sxpp =      (sx*)_RNDUP((intptr_t)((char*)(*fbpp) + fb_size), align);
+    *espp = es_size
+            ? (es*)_RNDUP((intptr_t)((char*)(*sxpp) + sx_size), align)
+            : NULL;
+    char* const end = *espp ? (char*)(*espp) + es_size
+            : (char*)(*sxpp) + sx_size;
+    *clpp = cl_size
+            ? (cl*)_RNDUP((intptr_t)end, align)
+            : NULL;
+    /*
+     * Can't set cached `tq->fbp` and `rl->fbp` here because they are in a
+     * memory-mapped file, which might be open read-only.
+     */
+    bool bounds_check = (*clpp ? (char*)(*clpp) + cl_size : end) <=
+            ((char*)ix + ixsz);
+#ifdef NDEBUG
+    if (!bounds_check) {
+        log_error_q("ix=%p, ixsz=%zu, nelems=%zu, align=%zu, rl_size=%zu, "
+                "tq_size=%zu, fb_size=%zu, sx_size=%zu, *sxpp=%p",
+                ix, ixsz, nelems, align, rl_size, tq_size, fb_size, sx_size,
+                *sxpp);
+        return 0;
+    }
 #else
-            {
-                int dumb = 0;
-                /* beware position moved as side effect */
-                if (lseek(fd, len-sizeof(dumb), SEEK_SET) < 0)
-                        return errno;
-                if(write(fd, &dumb, sizeof(dumb)) < 0)
-                        return errno;
-            }
-#endif /* HAVE_FTRUNCATE */
-        } else {                /* else, fill in all the zeros */
-#define N_ZEROS_GROW 8192
-            static int zeros[N_ZEROS_GROW];
-            size_t zsize = N_ZEROS_GROW * sizeof(int);
-            size_t clen = sb.st_size;
-            off_t ii;
-            /* beware position moved as side effect */
-            if (lseek(fd, clen, SEEK_SET) < 0)
-                return errno;
-            if(write(fd, zeros, (len-clen) % zsize) < 0)
-                return errno;
-            for(ii = clen + (len-clen) % zsize; ii < len; ii += zsize) {
-                if(write(fd, zeros, zsize) < 0)
-                    return errno;
-            }
-        }
-        return ENOERR;
+    log_assert(bounds_check);
+#endif
+    return 1;
 }
 
-/******************************************************************************
- * File Locking Functions:
- ******************************************************************************/
-
-/* 
- * Decode flock l_type member to string.
- * DEBUG
+/* End ix */
+/* Begin bsrch */
+/*
+ * Code is derived from berkeley bsearch(),
+ * But we want to know where we were on failure, so
+ * we can do sorted insertions.
  */
-static char *
-s_ltype(const short l_type)
+/*
+ * Perform a binary search.
+ *
+ * The code below is a bit sneaky.  After a comparison fails, we
+ * divide the work in half by moving either left or right. If lim
+ * is odd, moving left simply involves halving lim: e.g., when lim
+ * is 5 we look at item 2, so we change lim to 2 so that we will
+ * look at items 0 & 1.  If lim is even, the same applies.  If lim
+ * is odd, moving right again involves halving lim, this time moving
+ * the base up one item past p: e.g., when lim is 5 we change base
+ * to item 3 and make lim 2 so that we will look at items 3 and 4.
+ * If lim is even, however, we have to shrink it by one before
+ * halving: e.g., when lim is 4, we still looked at item 2, so we
+ * have to make lim 3, then halve, obtaining 1, so that we will only
+ * look at item 3.
+ */
+static int
+bsrch(const void *key,
+        const void *base0,
+        size_t nmemb,
+        size_t size,
+        int (*compar)(const void *, const void *),
+        const void **resultp
+        )
 {
-        switch (l_type) {
-        case F_WRLCK: return "F_WRLCK";
-        case F_RDLCK: return "F_RDLCK";
-        case F_UNLCK: return "F_UNLCK";
+        const char *base = base0;
+        size_t lim;
+        int cmp = 0;
+        const void *p = base0;
+
+        for (lim = nmemb; lim != 0; lim /= 2) {
+                p = base + (lim/2) * size;
+                cmp = (*compar)(key, p);
+                if (cmp == 0)
+                {
+                        /* found it */
+                        *resultp = p;
+                        return 1;
+                }
+                if (cmp > 0) {  /* key > p: move right */
+                        base = (const char *)p + size;
+                        lim--;
+                }               /* else move left */
         }
-        return "Unknown type";
+        /* didn't find it */
+        if(cmp > 0)
+                *resultp = (const char *)p + size;
+        else    
+                *resultp = p;
+        return 0;
 }
+/* End bsrch */
+/* Begin riu */
 
-/* 
- * Decode flock whence member to string.
- * DEBUG
+/*
+ * This structure is used to keep track of
+ * a region which this process has 'in use'.
+ * It appears on the process private list (riul *) pq->riulp.
+ * 'offset' is the seek offset of the region in the queue file,
+ * 'extent' is it's size,
+ * 'vp' is the memory handle being used to access the region,
+ * and 'rflags' stashes the RGN_* flags with which the region was gotten.
+ * If the region holds the chunk map of a chunked data-product, then 'vp' and
+ * 'extent' are those of the contiguous view of the data-product while it's
+ * attached and 'ckhead' and 'ckextent' are those of the region (see
+ * `ck_attach()`); otherwise, 'ckhead' is NULL.
+ * If the data-product is compressed, then 'vp' and 'extent' are those of its
+ * decompressed copy while it's attached and 'zphead' and 'zpextent' are those
+ * of the (possibly chunked) data-product (see `zp_attach()`); otherwise,
+ * 'zphead' is NULL.
  */
-static char *
-s_whence(const short whence)
+struct riu {
+        off_t offset;
+        size_t extent;
+        void *vp;
+        int rflags;
+        void *ckhead;
+        size_t ckextent;
+        void *zphead;
+        size_t zpextent;
+        uint64_t locked; /* when locked in nanoseconds or 0 */
+};
+typedef struct riu riu;
+
+/* End riu */
+/* Begin riul */
+
+/*
+ * The process private list of regions in use.
+ * Sorted by offset.
+ *
+ * TODO: This table typically contains 3 to 5 entries (verify).
+ * Maintaining sort and using binary search is overkill.
+ */
+struct riul
 {
-        switch (whence) {
-        case SEEK_SET: return "SEEK_SET";
-        case SEEK_CUR: return "SEEK_CUR";
-        case SEEK_END: return "SEEK_END";
-        }
-        return "Unknown whence";
+#define RIU_NALLOC_INITIAL      255
+        size_t sz;
+        size_t nalloc;
+        size_t nelems;
+        size_t maxelems;        /* max nelems so far */
+        riu rp[RIU_NALLOC_INITIAL]; /* actually nalloc long */
+};
+typedef struct riul riul;
+#define MIN_RIUL_SZ (3 * sizeof(size_t))
+
+
+/*
+ * Return the nalloc (array size) 
+ * of a riul which will fit into 'sz'.
+ */
+static size_t
+riul_nalloc(size_t sz)
+{
+        log_assert(sz >  MIN_RIUL_SZ);
+        sz -= sizeof(size_t); /* sz */
+        sz -= sizeof(size_t); /* nalloc */
+        sz -= sizeof(size_t); /* nelems */
+        sz -= sizeof(size_t); /* maxelems */
+        sz /= sizeof(riu);
+        return sz;
 }
 
 
 /*
- * If this process would be unable to obtain a lock,
- * return the pid of the process holding the conflicting lock.
- * Else return zero or -1 on error.
+ * Initialize (re Initialize) a riul
  */
-static pid_t
-fd_isLocked(const int fd, const short l_type,
-        const off_t offset, const short l_whence, const size_t extent)
+static void
+riul_init(riul *const rl, size_t const nelems, size_t sz)
 {
-        int cmd = F_GETLK;
-        struct flock lock;
-        lock.l_type = l_type;
-        lock.l_start = offset;
-        lock.l_whence = l_whence;
-        lock.l_len = (off_t)extent;
-        if(fcntl(fd, cmd, &lock) < 0)
-                return ((pid_t)-1);
-        return (lock.l_type == F_UNLCK ? 0 : lock.l_pid);
+        riu *rp;
+        size_t nalloc = riul_nalloc(sz);
+        riu *const end = &rl->rp[nalloc];
+
+        log_assert(rl != NULL);
+        log_assert(sz != 0);
+        log_assert(nelems == 0 || rl->nelems == nelems);
+        log_assert(nelems == 0 || rl->nalloc < nalloc);
+
+        rl->sz = sz;
+        rl->nalloc = nalloc;
+        rl->nelems = nelems;
+        if(nelems == 0)
+            rl->maxelems = 0;
+        for(rp = &rl->rp[nelems];
+                        rp < end; rp++)
+        {
+                rp->offset = OFF_NONE;
+                rp->extent = 0;
+                rp->vp = NULL;
+                rp->rflags = 0;
+                rp->ckhead = NULL;
+                rp->ckextent = 0;
+                rp->zphead = NULL;
+                rp->zpextent = 0;
+                rp->locked = 0;
+        }
 }
 
 
 /*
- * convenience wrapper around fcntl locking
- *
- * Returns:
- *      0       Success
- *      EACCESS or EAGAIN
- *              The "cmd" argument is F_SETLK: the type of lock (l_type) is a
- *              shared (F_RDLCK) or exclusive (F_WRLCK) lock and the segment
- *              of a file to be locked is already exclusive-locked by another
- *              process, or the type is an exclusive lock and some portion of
- *              the segment of a file to be locked is already shared-locked or
- *              exclusive-locked by another process.
- *      EBADF   The "fd" argument is not a valid open file descriptor, or the
- *              argument "cmd" is F_SETLK or F_SETLKW, the type of lock, l_type,
- *              is a shared lock (F_RDLCK), and "fd" is not a valid file
- *              descriptor open for reading, or the type of lock l_type, is an
- *              exclusive lock (F_WRLCK), and "fd" is not a valid file
- *              descriptor open for writing.
- *      EINVAL  The "cmd" argument is invalid, or the "cmd" argument is F_GETLK,
- *              F_SETLK or F_SETLKW and "l_type", "offset", "l_whence", or
- *              "extent" is not valid, or "fd" refers to a file that does not 
- *              support locking.
- *      ENOLCK  The argument "cmd" is F_SETLK or F_SETLKW and satisfying the
- *              lock or unlock request would result in the number of locked
- *              regions in the system exceeding a system-imposed limit.
- *      EOVERFLOW
- *              The "cmd" argument is F_GETLK, F_SETLK or F_SETLKW and the
- *              smallest or, if "extent" is non-zero, the largest offset of any
- *              byte in the requested segment cannot be represented correctly
- *              in an object of type off_t.
- *      EDEADLK The "cmd" argument is F_SETLKW, the lock is blocked by some lock
- *              from another process and putting the calling process to sleep,
- *              waiting for that lock to become free would cause a deadlock.
+ * Affirm that that another element can be added to rl
  */
 static int
-fd_lock(const int fd, const int cmd, const short l_type,
-        const off_t offset, const short l_whence, const size_t extent)
+riul_HasSpace(const riul *const rl)
 {
-        struct flock lock;
+        log_assert(rl->nelems <= rl->nalloc);
+        return (rl->nelems < rl->nalloc);
+}
 
-        lock.l_type = l_type;
-        lock.l_start = offset;
-        lock.l_whence = l_whence;
-        lock.l_len = (off_t)extent;
-        /* return (fcntl(fd, cmd, &lock) < 0 ? errno : 0); */
-        if (fcntl(fd, cmd, &lock) < 0)
-        {
-                int errnum = errno;
 
-                if(errnum == EDEADLK || errnum == EAGAIN || errnum == EACCES)
-                {
-                        if(errnum == EDEADLK || cmd != F_SETLK)
-                        {
-                        pid_t conflict = fd_isLocked(fd, l_type, offset,
-                                        l_whence, extent);
-                        log_errno_q(errnum,
-                                "fcntl %s failed for rgn (%ld %s, %lu): %s",
-                                s_ltype(l_type), 
-                                (long)offset, s_whence(l_whence), (long)extent, 
-                                strerror(errnum));
-                        log_error_q("conflicting pid %d", (int)conflict);
-                        }
-                }
-                else
-                {
-                        log_syserr_q("fcntl %s failed for rgn (%ld %s, %lu) %d",
-                                s_ltype(l_type), 
-                                (long)offset, s_whence(l_whence), (long)extent, 
-                                errnum);
-                }
-                
-                return errnum;
-        }
-        /* else */
-        return 0;
+/**
+ * Comparison function used by bsrch() in riul_r_find() below.
+ * The riul is sorted by region offset.
+ */
+static int
+riul_r_compare(const void *vp1, const void *vp2)
+{
+    const riu*  riu1 = vp1;
+    const riu*  riu2 = vp2;
+    const off_t diff = riu1->offset - riu2->offset;
+    return (diff < 0)
+            ? -1
+            : (diff == 0)
+              ? 0
+              : 1;
 }
 
-/******************************************************************************
- * Memory-Mapping Functions:
- ******************************************************************************/
 
-#ifdef HAVE_MMAP
-/*
- * Wrapper around mmap()
+/**
+ * Searches a list of regions-in-use for one with a given or greater offset.
  *
- * Returns:
- *      EACCES  The "fd" argument is not open for read, regardless of the
- *              protection specified, or "fd" is not open for write and
- *              PROT_WRITE was specified for a MAP_SHARED type mapping.
- *      EAGAIN  The mapping could not be locked in memory, if required by
- *              mlockall(), due to a lack of resources.
- *      EBADF   The "fd" argument is not a valid open file descriptor.
- *      EINVAL  The "*ptrp" argument (if MAP_FIXED was specified) or "offset" is
- *              not a multiple of the page size as returned by sysconf(), or
- *              are considered invalid by the implementation.
- *      EINVAL  The value of "mflags" is invalid (neither MAP_PRIVATE nor 
- *              MAP_SHARED is set).
- *      EMFILE  The number of mapped regions would exceed an
- *              implementation-dependent limit (per process or per system).
- *      ENODEV  The "fd" argument refers to a file whose type is not supported
- *              by mmap().
- *      ENOMEM  MAP_FIXED was specified, and the range [*ptrp, *ptrp + extent)
- *              exceeds that allowed for the address space of a process; or if
- *              MAP_FIXED was not specified and there is insufficient room in
- *              the address space to effect the mapping.
- *      ENOMEM  The mapping could not be locked in memory, if required by
- *              mlockall(), because it would require more space than the system
- *              is able to supply.
- *      ENOTSUP The implementation does not support the combination of accesses
- *              requested in the "prot" argument.
- *      ENXIO   Addresses in the range [offset, offset + extent) are invalid for
- *              the object specified by "fd".
- *      ENXIO   MAP_FIXED was specified in "mflags" and the combination of
- *              "*ptrp", "extent" and "offset" is invalid for the object
- *              specified by "fd".
- *      EOVERFLOW
- *              The file is a regular file and the value of "offset" plus 
- *              "extent" exceeds the offset maximum established in the open file
- *              description associated with "fd". 
+ * @param[in]  rl      List of regions-in-use
+ * @param[in]  offset  Offset to search for
+ * @param[out] rpp     Pointer to region-in-use with given offset or to the next
+ *                     region in the list with a greater offset
+ * @retval     1       Region with given offset found
+ * @retval     0       Region with given offset not found
  */
 static int
-mapwrap(const int fd,
-        const off_t offset,
-        const size_t extent,
-        const int prot,
-        int mflags,
-        void **ptrp)
+riul_r_find(
+        const riul* const restrict rl,
+        off_t const                offset,
+        riu* const* const restrict rpp)
 {
-        int status = ENOERR;
-        void *mm;
-
-#ifdef MAP_FILE /* HP-UX */
-        fSet(mflags, MAP_FILE);
-#endif
-#ifdef MAP_VARIABLE /* HP-UX */
-        if(!fIsSet(mflags, MAP_FIXED))
-                fSet(mflags, MAP_VARIABLE);
-#endif
-        
-        mm = (void *) mmap(*ptrp, extent, prot, mflags, fd, offset);
-        if(mm == MAP_FAILED)
-        {
-                status = errno;
-                log_add_syserr("mmap() failure: *ptrp=%p, offset=%ld, extent=%lu",
-                    *ptrp, (long)offset, (unsigned long)extent);
-                log_error_q("Product-queue size too big?");
-                return status;
-        }
-#if TRACE_MMAP
-        log_debug("%p = mmap: %p %ld %lu", mm, *ptrp,
-                (long)offset, (unsigned long)extent );
-#endif
-
-        *ptrp = mm;
+        int status;
+        riu rgn;
+        rgn.offset = offset;
+        status = bsrch(&rgn,
+                rl->rp, rl->nelems, sizeof(riu), riul_r_compare,
+                        (const void **)rpp);
+        log_assert(status == 0 || (*rpp)->vp != NULL);
         return status;
 }
 
 
-/*
- * Wrapper around munmap
+/**
+ * Finds a region-in-use in a regions-in-use list.
+ *
+ * @param[in] rl          List of regions-in-use
+ * @param[in] offset      Offset of region to be found
+ * @retval    NULL        No such region found
+ * @return                Pointer to region-in-use entry
+ */
+static riu*
+riul_find(
+        const riul* const rl,
+        const off_t       offset)
+{
+        riu* rp;
+        return riul_r_find(rl, offset, &rp)
+                ? rp
+                : NULL;
+}
+
+/**
+ * Add elem to list, maintain sort by offset
+ *
+ * @param[in,out] riulpp  List of regions-in-use. `*riulpp` may be modified on
+ *                        return.
+ * @param[in] growby      Amount, in bytes, to grow the list by if necessary
+ * @param[in] offset      Offset to region in bytes
+ * @param[in] extent      Extent of region in bytes
+ * @param[in] vp          Pointer to region's data
+ * @param[in] rflags      Region flags: bitwise OR of
+ *                        - RGN_NOLOCK  Don't lock region; locking handled
+ *                                      elsewhere
+ *                        - RGN_WRITE   Region will be modified
+ *                        - RGN_NOWAIT  Return immediately if can't lock, else
+ *                                      wait
+ * @retval 0              Success.
+ * @retval ENOMEM         Insufficient memory is available.
  */
-/*ARGSUSED*/
 static int
-unmapwrap(void *const ptr,
-        const off_t offset,
-        const size_t extent,
-        const int mflags)
+riul_add(
+        riul** const restrict riulpp,
+        const size_t          growby,
+        const off_t           offset,
+        const size_t          extent,
+        void* const restrict  vp,
+        const int             rflags,
+        riu** const restrict  rpp)
 {
-        int status = ENOERR;
+        riu *rp;
+        riul *rl = *riulpp;
+        riu *end;
 
-#ifdef USE_MSYNC
-        /* if(!fIsSet(mflags, M_DISCARD)) */
-        if(1)
+        if(!riul_HasSpace(rl))
         {
-#ifdef MS_ASYNC
-                if(msync(ptr, extent, MS_ASYNC) == -1)
-                        log_syserr_q("msync: %ld %lu MS_ASYNC",
-                                (long)offset, (unsigned long)extent);
-#else
-                if(msync(ptr, extent) == -1)
-                        log_syserr_q("msync: %ld %lu",
-                                (long)offset, (unsigned long)extent);
-#endif
+                /* get space */
+                size_t newsz = rl->sz + growby;
+                riul *nriulp = (riul *)realloc(rl, newsz);
+                if(nriulp == NULL)
+                        return errno;
+                riul_init(nriulp, nriulp->nelems, newsz);
+                *riulpp = rl = nriulp;
         }
-#endif /* USE_MSYNC */
 
-#if TRACE_MMAP
-        log_debug("unmap: %p %ld %lu", ptr, (long)offset, (unsigned long)extent);
-#endif
-        if(munmap(ptr, extent) == -1)
+        /*
+         * "end" should be set after any potential reallocation of the
+         * regions-in-use structure to ensure that "end" points into the
+         * (possibly new) "rl->rp" array.
+         */
+        end = &rl->rp[rl->nelems];
+
         {
-                status = errno;
-                log_syserr_q("munmap: %ld %lu", (long)offset, (unsigned long)extent);
-                return status;
+            int found = riul_r_find(rl, offset, &rp);
+
+            log_assert(found == 0);
         }
 
-        return status;
-}
-#endif /*HAVE_MMAP*/
+        if(rp < end)
+        {
+                /* shuffle right */
+                /* LOG_DEBUG("riul_add memmove: %ld", (char* )end - (char *)rp); */
+                memmove(rp +1, rp, (char *)end - (char *)rp);
+        }
+        
+        rp->offset = offset;
+        rp->extent = extent;
+        rp->vp = vp;
+        rp->rflags = rflags;
+        rp->ckhead = NULL;
+        rp->ckextent = 0;
+        rp->zphead = NULL;
+        rp->zpextent = 0;
+        rp->locked = 0;
 
-/******************************************************************************
- * Lower-Level Data-Product Data-Region Functions:
- ******************************************************************************/
+        *rpp = rp;
+
+        rl->nelems++;
+        if(rl->nelems > rl->maxelems) {
+            rl->maxelems = rl->nelems;
+        }
+        /* DEBUG */ /* log_assert(riul_r_find(rl, offset, &rp) != 0); */
+
+        return ENOERR;
+}
 
 /**
- * Get a lock on (offset, extent).
+ * Remove a region-in-use from the list of regions-in-use
  *
- * @param[in] rflags  Region flags: bitwise OR of
- *                    - RGN_NOLOCK  Don't lock region; locking handled elsewhere
- *                    - RGN_WRITE   Region will be modified
- *                    - RGN_NOWAIT  Return immediately if can't lock, else wait
- * @retval 0          Success
- * @retval EACCES or EAGAIN
- *                    The "cmd" argument is F_SETLK: the type of lock (l_type)
- *                    is a shared (F_RDLCK) or exclusive (F_WRLCK) lock and the
- *                    segment of a file to be locked is already exclusive-locked
- *                    by another process, or the type is an exclusive lock and
- *                    some portion of the segment of a file to be locked is
- *                    already shared-locked or exclusive-locked by another
- *                    process.
- * @retval EBADF      The "fd" argument is not a valid open file descriptor, or
- *                    the argument "cmd" is F_SETLK or F_SETLKW, the type of
- *                    lock, l_type, is a shared lock (F_RDLCK), and "fd" is not
- *                    a valid file descriptor open for reading, or the type of
- *                    lock l_type, is an exclusive lock (F_WRLCK), and "fd" is
- *                    not a valid file descriptor open for writing.
- * @retval EINVAL     The "cmd" argument is invalid, or the "cmd" argument is
- *                    F_GETLK, F_SETLK or F_SETLKW and "l_type", "offset",
- *                    "l_whence", or "extent" is not valid, or "fd" refers to a
- *                    file that does not support locking.
- * @retval ENOLCK     The argument "cmd" is F_SETLK or F_SETLKW and satisfying
- *                    the lock or unlock request would result in the number of
- *                    locked regions in the system exceeding a system-imposed
- *                    limit.
- * @retval EOVERFLOW  The "cmd" argument is F_GETLK, F_SETLK or F_SETLKW and the
- *                    smallest or, if "extent" is non-zero, the largest offset
- *                    of any byte in the requested segment cannot be represented
- *                    correctly in an object of type off_t.
- * @retval EDEADLK    The "cmd" argument is F_SETLKW, the lock is blocked by
- *                    some lock from another process and putting the calling
- *                    process to sleep, waiting for that lock to become free
- *                    would cause a deadlock.
+ * @param[in,out] rl  List of regions-in-use
+ * @param[in]         In-use region to be removed from list
  */
-static int
-rgn2_lock(pqueue *const pq,
-        const off_t offset,
-        const size_t extent,
-        const int rflags)
+static void
+riul_delete(
+        riul* const restrict rl,
+        riu* const restrict  rp)
 {
-#ifndef NDEBUG
-        if(offset == pq->ixo && extent == pq->ixsz)
-                log_assert(fIsSet(rflags, RGN_NOLOCK));
-        else
-                log_assert(!fIsSet(rflags, RGN_NOLOCK));
-#endif
+        riu *end = &rl->rp[rl->nelems];
+        riu *rght = rp +1;
 
-        if(fIsSet(rflags, RGN_NOLOCK) || fIsSet(pq->pflags, PQ_NOLOCK))
-                return ENOERR;
-        
-        /* else */
-        {
-                int cmd = fIsSet(rflags, RGN_NOWAIT) ?  F_SETLK : F_SETLKW;
-                short l_type = fIsSet(rflags, RGN_WRITE) ? F_WRLCK : F_RDLCK;
+        log_assert(&rl->rp[0] <= rp && rp < end);
 
-                int status =  fd_lock(pq->fd, cmd, l_type,
-                                offset, SEEK_SET, extent);
-#if TRACE_LOCK
-        log_debug("%s (%ld, %lu)",
-                s_ltype(l_type),
-                (long)offset, (unsigned long)extent);
-#endif
-                return status;
+        if(rght < end)
+        {
+                /* shuffle left */
+                /* LOG_DEBUG("riul_delete memmove: %ld", (char* )end - (char *)rght); */
+                memmove(rp, rght, (char *)end - (char *)rght);
         }
+        end--;
+
+        end->offset = OFF_NONE;
+        end->extent = 0;
+        end->vp = NULL;
+        end->rflags = 0;
+        end->ckhead = NULL;
+        end->ckextent = 0;
+        end->zphead = NULL;
+        end->zpextent = 0;
+        end->locked = 0;
+        rl->nelems--;
 }
 
+/* End riul */
+/* Begin pqctl */
 
-/**
- * Release lock on (offset, extent) according to the RGN_* flags rflags.
- *
- * @param[in] rflags  Region flags: bitwise OR of
- *                    - RGN_NOLOCK  Region wasn't locked
- *                    - RGN_WRITE   Region was modified
- *                    - RGN_NOWAIT  Ignored
- * @retval 0          Success.
- * @retval EBADF      The product-queue's file descriptor is invalid.
- * @retval EINVAL     The region is not valid.
- * @retval EOVERFLOW  The region is too large.
+/*
+ * Robust reader/writer lock for the control-region of a product-queue created
+ * with PQ_ROBUST. It resides in the control-region itself. Its state is
+ * guarded by a robust, process-shared mutex and its holders are recorded by
+ * process-ID so that it can be reclaimed from a process that terminated while
+ * holding it.
  */
-static int
-rgn2_unlock(
-        pqueue *const pq,
-        const off_t offset,
-        const size_t extent,
-        const int rflags)
-{
-#ifndef NDEBUG
-        if(offset == pq->ixo && extent == pq->ixsz)
-                log_assert(fIsSet(rflags, RGN_NOLOCK));
-#endif
-
-        if(fIsSet(rflags, RGN_NOLOCK) || fIsSet(pq->pflags, PQ_NOLOCK))
-                return ENOERR;
-        /* else */
-#if TRACE_LOCK
-        log_debug("F_UNLCK (%ld, %lu)",
-                (long)offset, (unsigned long)extent);
-#endif
-        return fd_lock(pq->fd, F_SETLK, F_UNLCK,
-                        offset, SEEK_SET, extent);
-}
+#define RWL_MAXREADERS  256
+typedef struct {
+        pthread_mutex_t mutex;          /* robust & process-shared. Guards rest */
+        uint32_t        seq;            /* state-change counter. Futex word. */
+        unsigned        nwaiters;       /* processes that might wait on `seq` */
+        pid_t           writer;         /* holder of the write-lock or 0 */
+        unsigned        nreaders;       /* number of read-locks held */
+        pid_t           readers[RWL_MAXREADERS]; /* holders of read-locks */
+        char            boot[40];       /* system boot-identifier at init */
+} rwl;
 
-/**
- * Reserves a region in a product-queue for reading or writing.
- * - Locks the region in the product-queue file
- * - Adds the region to the list of regions-in-use
- *
- * @param[in,out] pq       Product queue
- * @param[in]     offset   Offset to region in bytes
- * @param[in]     extent   Extent of region in bytes
- * @param[in]     rflags   Region flags. Bitwise OR of
- *                         - RGN_NOLOCK  Don't lock region; locking handled
- *                                       elsewhere
- *                         - RGN_WRITE   Region will be modified
- *                         - RGN_NOWAIT  Return immediately if can't lock, else
- *                                       wait
- * @param[in]     vp       Data area of region
- * @param[out]    rpp      Region in use entry
- * @retval        0        Success
- * @retval        EACCES   Region already reserved. `log_add()` *not* called.
- * @retval        EDEADLK  Deadlock condition detected. `log_add()` called.
- * @retval        ENOLCK   Number of file-locks would exceed system limit.
- *                         `log_add()` called.
- * @retval        ENOMEM   Insufficient memory available. `log_add()` called.
- * @see `rgn2_release()`
+/*
+ * Entry of the registry of consumers in the control-region. A consumer
+ * registers itself the first time that it positions its cursor and thereafter
+ * publishes its cursor without locking the control-region, so `seq` is odd
+ * while `cursor` is being changed. A writer that deletes a data-product that
+ * the consumer hasn't read counts it in `overruns`.
  */
-static int
-rgn2_reserve(
-        pqueue* const restrict pq,
-        const off_t            offset,
-        const size_t           extent,
-        const int              rflags,
-        void* const restrict   vp,
-        riu** const restrict   rpp)
-{
-    int status;
-
-    if (riul_find(pq->riulp, offset)) {
-        status = EACCES;
-    }
-    else {
-        status = rgn2_lock(pq, offset, extent, rflags);
+typedef struct {
+        pid_t           pid;            /* process-ID of consumer or 0 */
+        uint32_t        seq;            /* odd while `cursor` is changed */
+        timestampt      cursor;         /* insertion-time of last product */
+        uint64_t        overruns;       /* its products deleted unread */
+        int64_t         warned;         /* time of last overrun-warning */
+} conselem;
 
-        if (status != EACCES) {
-            if (status == EAGAIN) {
-                status = EACCES;
-            }
-            else if (status) {
-                log_add_errno(status, "rgn_lock() failure");
-            }
-            else {
-                status = riul_add(&pq->riulp, pq->pagesz, offset, extent, vp,
-                        rflags, rpp);
+/*
+ * Statistics of one kind of lock (PQ_LOCK_*) in the control-region. Every
+ * process that has the product-queue open adds to them without locking (see
+ * `ls_map()`). Times are in nanoseconds.
+ */
+typedef struct {
+        uint64_t        count;          /* locks acquired */
+        uint64_t        writes;         /* ... of which for writing */
+        uint64_t        retries;        /* attempts that found it locked */
+        uint64_t        wait_ns;        /* total time waited */
+        uint64_t        hold_ns;        /* total time held */
+        uint64_t        wait_max;       /* longest wait */
+        uint64_t        hold_max;       /* longest hold */
+        uint64_t        wait[PQ_LOCK_BINS]; /* histogram of waits */
+        uint64_t        hold[PQ_LOCK_BINS]; /* histogram of holds */
+} lselem;
 
-                if (status) {
-                    log_add_errno(status, "riul_add() failure");
-                    (void)rgn2_unlock(pq, offset, extent,
-                            fMask(rflags, RGN_MODIFIED|RGN_NOWAIT));
-                }
-            } // Region in file locked
-        } // Locking region didn't return `EACCES`
-    } // Region not in list of regions-in-use
+/*
+ * Shared, on disk, pq control structure.
+ * Fixed size, never grows.
+ * At beginning of file.
+ */
+struct pqctl {
+#define PQ_MAGIC        0x50515545      /* PQUE */
+        size_t          magic;
+#define PQ_VERSION      7
+/*
+ * Version of a product-queue that has an index in a format that earlier
+ * versions of the LDM don't understand (see `ix_formats`)
+ */
+#define PQ_VERSION_IX   8
+        size_t          version;
+        off_t           datao;          /* beginning of data segment */
+        off_t           ixo;            /* beginning of index segment */
+        size_t          ixsz;           /* size of index segement */
+        size_t          nalloc;         /* slots allocated for products */
+        size_t          align;
+        /* stats */
+        off_t           highwater;
+        size_t          maxproducts;
+#define WRITE_COUNT_MAGIC       PQ_MAGIC
+        unsigned        write_count_magic;
+#define MAX_WRITE_COUNT         ~0u
+        unsigned        write_count;
+#define METRICS_MAGIC           (PQ_MAGIC+1)
+        unsigned        metrics_magic;
+        timestampt      mostRecent;     /* time of most recent insertion */
+        timestampt      minVirtResTime; /* minimum virtual residence time */
+        int             isFull;         /* is the queue full? */
+#define METRICS_MAGIC_2         (PQ_MAGIC+2)
+        unsigned        metrics_magic_2;
+        off_t           mvrtSize;       /* data-usage in bytes when MVRT set */
+        size_t          mvrtSlots;      /* slot-usage when MVRT set */
+#define NOTIFY_MAGIC            (PQ_MAGIC+3)
+        unsigned        notify_magic;
+        unsigned        notify_sigcont; /* notify by SIGCONT? */
+        uint32_t        insert_seq;     /* insertion counter. Futex word. */
+#define LOCK_MAGIC              (PQ_MAGIC+4)
+        unsigned        lock_magic;
+        unsigned        lock_robust;    /* locked by `lock`, not fcntl(2)? */
+        rwl             lock;           /* robust control-region lock */
+#define WRITE_GEN_MAGIC         (PQ_MAGIC+5)
+        unsigned        write_gen_magic;
+        uint32_t        write_gen;      /* odd while index is being modified */
+#define IX_MAGIC                (PQ_MAGIC+6)
+        unsigned        ix_magic;
+        unsigned        ix_formats;     /* bitwise OR of IX_* flags */
+#define ALLOC_MAGIC             (PQ_MAGIC+7)
+        unsigned        alloc_magic;
+        uint64_t        alloc_inserts;  /* regions allocated for products */
+        uint64_t        alloc_evictions;/* products deleted to allocate them */
+#define CONS_MAGIC              (PQ_MAGIC+8)
+        unsigned        cons_magic;
+        uint64_t        cons_overruns;  /* products deleted before a
+                                         * registered consumer read them */
+        conselem        cons[PQ_MAXCONSUMERS]; /* registry of consumers */
+#define ZIP_MAGIC               (PQ_MAGIC+9)
+        unsigned        zip_magic;
+        feedtypet       zip_feeds;      /* feedtypes whose data is compressed */
+        uint64_t        zip_in;         /* bytes of data compressed */
+        uint64_t        zip_out;        /* bytes of data after compression */
+#define LSTAT_MAGIC             (PQ_MAGIC+10)
+        unsigned        lstat_magic;
+        lselem          lstat[PQ_LOCK_KINDS]; /* lock statistics. Must be
+                                         * within the first page */
+};
+typedef struct pqctl pqctl;
 
-    return status;
+/*
+ * Returns the formats of the indexes of a product-queue as a bitwise OR of
+ * IX_* flags.
+ */
+static inline unsigned
+ctl_ixFormats(const pqctl* const ctlp)
+{
+        return ctlp->ix_magic == IX_MAGIC ? ctlp->ix_formats : 0;
 }
 
-/**
- * Releases a region in a product-queue that was previously reserved by
- *   - Deleting the relevant entry in the list of regions-in-use
- *   - Unlocking the relevant section of the product-queue file
- *
- * @param[in,out] pq      Product queue
- * @param[in]     offset  Offset to region in bytes
- * @param[in]     rflags  Region flags. Bitwise OR of
- *                         - RGN_NOLOCK     Don't lock region; locking handled
- *                                          elsewhere
- *                         - RGN_MODIFIED   Region was modified
- * @retval        0       Success
- * @retval        EINVAL  Region with given offset isn't in use
- * @see `region_reserve()`
+/*
+ * Returns the formats of the indexes of a product-queue that's created with
+ * the given product-queue flags as a bitwise OR of IX_* flags.
  */
-static int
-rgn2_release(
-        pqueue* const pq,
-        const off_t   offset,
-        int const     rflags)
+static inline unsigned
+pq_ixFormats(const int pflags)
 {
-    int  status;
-    riu* rp;
-
-    if (riul_r_find(pq->riulp, offset, &rp) == 0) {
-        log_error_q("Region with offset %ld is not in use", (long)offset);
-        status = EINVAL;
-    }
-    else {
-        log_assert(rp->offset == offset);
-        log_assert(0 < rp->extent && rp->extent < TOTAL_SIZE(pq));
-
-        size_t extent = rp->extent;
-
-        log_assert(pq->base == NULL || (rp->vp != NULL
-                 && pq->base <= rp->vp
-                && (char *)rp->vp <= (char *)pq->base + pq->ixo));
-        log_assert(pIf(fIsSet(rflags, RGN_MODIFIED),
-                        fIsSet(rp->rflags, RGN_WRITE)));
-        log_assert(fIsSet(rflags, RGN_NOLOCK) ==
-                        fIsSet(rp->rflags, RGN_NOLOCK));
-
-        riul_delete(pq->riulp, rp);
-        status = rgn2_unlock(pq, offset, extent, rflags);
-    }
+        return (fIsSet(pflags, PQ_TQRING) ? IX_TQRING : 0) |
+               (fIsSet(pflags, PQ_SXOPEN) ? IX_SXOPEN : 0) |
+               (fIsSet(pflags, PQ_TQFEED) ? IX_TQFEED : 0) |
+               (fIsSet(pflags, PQ_CHUNKED) ? IX_CHUNKS : 0) |
+               (fIsSet(pflags, PQ_COMPRESS) ? IX_ZIPPED : 0) |
+               (fIsSet(pflags, PQ_EVSIGS) ? IX_EVSIGS : 0) |
+               (fIsSet(pflags, PQ_RLCLASS) ? IX_RLCLASS : 0);
+}
 
-    return status;
+/*
+ * Returns the feedtype array of the time-index of a product-queue whose
+ * indexes have the given formats or NULL if it doesn't have one.
+ */
+static inline feedtypet*
+ix_tqFeeds(tqueue* const tqp, const unsigned formats)
+{
+        return (formats & IX_TQFEED) ? TQ_FEEDS(tqp) : NULL;
 }
 
-/******************************************************************************
- * Memory <-> File Synchronization Functions:
- ******************************************************************************/
+/* End pqctl */
+/* Begin pq */
 
-/**
- * Synchronizes a region in the product-queue file to memory using `lseek(2)`,
- * `malloc(3)`, and `read(2)`. Locks the file-region.
- *
- * @param[in,out] pqueue  Product queue
- * @param[in]     offset  Offset to file region in bytes
- * @param[in]     extent  Extent of region in bytes
- * @param[in]     rflags  Region flags. Bitwise OR of
- *                        - RGN_NOLOCK  Don't lock region; locking handled
- *                                      elsewhere
- *                        - RGN_WRITE   Region will be modified
- *                        - RGN_NOWAIT  Return immediately if can't lock, else
- *                                      wait
- * @param[out]    ptrp    Location of region in memory
- * @retval        0       Success
- * @retval        EACCES  Region already reserved. `log_add()` *not* called.
- * @retval        EDEADLK Deadlock condition detected. `log_add()` called.
- * @retval        ENOLCK  Number of file-locks would exceed system limit.
- *                        `log_add()` called.
- * @retval        ENOMEM  Insufficient memory available. `log_add()` called.
- * @retval        EIO     An I/O error occurred while accessing the file system.
- *                        `log_add()` called.
- * @retval        EINTR   A signal was caught during execution. `log_add()`
- *                        called.
- * @see `f_mtof()`
+/* function for putting memory to disk and releasing the memory; does a
+ * possible unmap() or write() followed by an unlock */
+typedef int mtofFunc(pqueue *const pq,
+        off_t const offset,
+        int const rflags);
+
+/* function for getting stuff on disk into memory; does a lock possibly followed
+ * by an mmap() or read() */
+typedef int ftomFunc(pqueue *const pq,
+        const off_t offset,
+        const size_t extent,
+        const int rflags,
+        void **const ptrp);
+
+/*
+ * The process private pq info. (Internal structure)
  */
-static int
-f_ftom(
-        pqueue *const pq,
-        const off_t   offset,
-        const size_t  extent,
-        const int     rflags,
-        void **const  ptrp)
-{
-    log_assert(pq != NULL);
-    log_assert(pq->datao > 0);
-    log_assert(pq->datao % pq->pagesz == 0);
-    log_assert(pq->ixo >= pq->datao);
-    log_assert(pq->ixo % pq->pagesz == 0);
-    log_assert(pq->ixsz >= pq->pagesz);
-    log_assert(pq->ixsz % pq->pagesz == 0);
+struct pqueue {
+#define PQ_SIGSBLOCKED  0x10000 /* sav_set is valid */
+#define PQ_CTLWRITE     0x20000 /* control-region is held for writing */
+        /**
+         * Product-queue flags. Bitwise OR of
+         * - Persistent flags:
+         *   + PQ_MAPRGNS      Map region by region, default is whole file if
+         *                     possible; otherwise, by region
+         *   + PQ_NOCLOBBER    Don't replace an existing product-queue
+         *   + PQ_NOLOCK       Disable locking (DANGER!)
+         *   + PQ_NOMAP        Use `malloc/read/write/free` instead of `mmap()`
+         *   + PQ_PRIVATE      `mmap()` the file `MAP_PRIVATE`. Default is
+         *                     `MAP_SHARED`.
+         *   + PQ_READONLY     Product-queue is read-only. Default is
+         *                     read/write.
+         *   + PQ_SIGCONT      Notify insertions by SIGCONT to the process
+         *                     group rather than by the insertion-counter
+         *   + PQ_ROBUST       Lock the control-region by the robust lock in
+         *                     the file rather than by fcntl(2)
+         *   + PQ_TQRING       The time-index is a ring rather than a skip
+         *                     list
+         *   + PQ_SXOPEN       The signature-index is open-addressed rather
+         *                     than chained
+         * - Transient flag:
+         *   + PQ_SIGSBLOCKED  Critical-section signals are blocked
+         *   + PQ_CTLWRITE     Control-region is held for writing
+         */
+        int              pflags;
+        size_t           pagesz;
+        ftomFunc*        ftom;
+        mtofFunc*        mtof;
+        size_t           riusz;
+        riul*            riulp;
 
-    log_assert(0 <= offset && offset <= pq->ixo);
-    log_assert(0 != extent && extent < TOTAL_SIZE(pq));
+        int              fd;
 
-    log_assert(pIf(fIsSet(rflags, RGN_WRITE),
-                !fIsSet(pq->pflags, PQ_READONLY)));
+        pqctl*           ctlp;
 
-    void* vp = NULL;
-    riu*  rp;
-    int   status = rgn2_reserve(pq, offset, extent, rflags, vp, &rp);
+        off_t            datao;
+        /// start of memory-mapped file
+        void*            base;
+        /// Extent of the file that's mapped at `base` in bytes
+        size_t           mapped;
+        /// Extent of the address-space that's reserved at `base` in bytes, so
+        /// that the mapping can be extended in place if the product-queue is
+        /// grown (see `pq_grow()`)
+        size_t           mapsz;
 
-    if (status != EACCES) {
-        if (status) {
-            log_add("Couldn't reserve %lu bytes starting at offset %ld",
-                    (unsigned long)extent, (long)offset);
-        }
-        else {
-            vp = malloc(extent);
+        /// Where are the indexes
+        off_t            ixo;
+        size_t           ixsz;
+        void*            ixp;
+        /// Slots allocated for products
+        size_t           nalloc;
 
-            if (vp == NULL) {
-                log_add_syserr("Couldn't malloc() %lu bytes",
-                        (unsigned long)extent);
-                status = errno;
-            }
-            else {
-                rp->vp = vp; // Set region-in-use pointer; was `NULL`
+        /// Region-list index
+        regionl*         rlp;
+        /// timestamp index
+        tqueue*          tqp;
+        /// Feedtypes of the timestamp index or NULL
+        feedtypet*       tqfp;
+        /// Skip-list blocks, needed in both region list and timestamp layers
+        fb*              fbp;
+        /// Signature index
+        sx*              sxp;
+        /// Index of signatures of evicted data-products or NULL
+        es*              esp;
+        /// Index of the size-classes of small data-products or NULL
+        cl*              clp;
+        /// Private, current position in queue
+        timestampt       cursor;
+        /// Private, current offset in queue
+        off_t            cursor_offset;
+        sigset_t         sav_set;
+        /// Pathname of the product-queue
+        char             pathname[PATH_MAX];
+        /// Number of reserved products
+        long             pqe_count;
+        /// Control-page mapped for insertion-notification or NULL
+        pqctl*           notifyp;
+        /// Insertion-counter when the time-queue was last searched
+        uint32_t         seen_seq;
+        /// Pollable insertion-notification file-descriptor or -1
+        int              notify_fd;
+        /// Thread that posts insertion-notifications to `notify_fd`
+        pthread_t        notify_thread;
+        /// Control-page mapped for the robust control-region lock or NULL
+        pqctl*           lockctlp;
+        /// File-descriptor opened for writing by a read-only opener for
+        /// `lockctlp` or -1
+        int              lock_fd;
+        /// Control-region mapped for the registry of consumers or NULL
+        pqctl*           consctlp;
+        /// File-descriptor opened for writing by a read-only opener for
+        /// `consctlp` or -1
+        int              cons_fd;
+        /// Index of this process' entry in the registry of consumers, -1 if
+        /// unregistered, or -2 if registration failed
+        int              consix;
+        /// Feedtypes whose data is compressed on insertion (see PQ_COMPRESS)
+        feedtypet        zipfeeds;
+        /// Number of data-products after the cursor whose regions are
+        /// prefetched by pq_sequence() or 0 (see PQ_PREFETCH)
+#define PF_DEFAULT      32
+        unsigned         pf_count;
+        /// Prefetching resumes when the cursor reaches this insertion-time
+        timestampt       pf_mid;
+        /// Insertion-time of the last prefetched data-product
+        timestampt       pf_last;
+        /// Whether the last prefetch reached the end of the product-queue
+        bool             pf_tail;
+        /// Insertion-counter at the last prefetch
+        uint32_t         pf_seq;
+        /// Number of data-products whose regions were prefetched
+        unsigned long long pf_prods;
+        /// Number of bytes prefetched
+        unsigned long long pf_bytes;
+        /// Number of sequenced data-products whose pages were marked cold
+        unsigned long long pf_colds;
+        /// Control-page mapped for the lock statistics or NULL
+        pqctl*           lsctlp;
+        /// File-descriptor opened for writing by a read-only opener for
+        /// `lsctlp` or -1
+        int              ls_fd;
+        /// When `mutex` was acquired in nanoseconds or 0
+        uint64_t         ls_mutexLocked;
+        /// Depth of recursive acquisitions of `mutex`
+        unsigned         ls_mutexDepth;
 
-                (void)memset(vp, 0, extent);
+        /// Mutex for concurrent access by multiple threads
+        pthread_mutex_t  mutex;
+};
 
-                ssize_t nread = pread(pq->fd, vp, extent, offset);
+/* The total size of a product-queue in bytes: */
+#define TOTAL_SIZE(pq) ((off_t)((pq)->ixo + (pq)->ixsz))
 
-                if (nread == -1) {
-                    log_add_syserr("Couldn't read %lu bytes from "
-                            "product-queue starting at offset %ld",
-                            (unsigned long)extent, (long)offset);
-                    status = errno;
-                }
-                else if (nread && nread != extent) {
-                    log_add("Read %ld bytes from product-queue at offset %ld; "
-                            "expected to read %lu", (long)nread, (long)offset,
-                            (unsigned long)extent);
-                    status = EIO;
-                }
-                else {
-                    // Requested number of bytes read or none at all.
-                    // It's okay to read zero bytes because of pq_create(3)
-                    *ptrp = vp;
-                }
+/*
+ * Frees an in-use region: onto the list of its size-class if the product-queue
+ * allocates by size-class and the region is small enough; otherwise, onto the
+ * free skip-lists.
+ */
+static void
+pq_freeRegion(pqueue* const pq, const size_t rlix)
+{
+    if (pq->clp == NULL || !cl_free(pq->clp, pq->rlp, rlix, pq->ctlp->align))
+        rl_free(pq->rlp, rlix);
+}
 
-                if (status)
-                    free(vp);
-            } // Memory successfully `malloc()`ed
+/* Begin ls */
 
-            if (status)
-                (void)rgn2_release(pq, offset, rflags);
-        } // Region successfully reserved
-    } // Region not found in list of regions-in-use
+/*
+ * Statistics of the locks of a product-queue: how long processes wait for and
+ * hold the lock on the control-region (i.e., from `ctl_get()` to `ctl_rel()`),
+ * the locks on the regions of data-products, and the mutex of a thread-safe
+ * product-queue, and how often a lock was found to be locked. They're kept in
+ * the control-region so that they accumulate over all the processes that have
+ * the product-queue open. Because they must be updated outside the
+ * control-region lock (e.g., while waiting for it), each process maps the
+ * control-page for writing separately and updates them atomically. They're
+ * advisory: a process that can't map them doesn't contribute.
+ */
 
-    return status;
+/**
+ * Returns the current time in nanoseconds for timing locks.
+ */
+static inline uint64_t
+ls_now(void)
+{
+        struct timespec ts;
+
+        (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
 }
 
 /**
- * Synchronizes memory to a region of a product-queue file using `write(2)`, and
- * `free(3)` for a region in use. Unlocks the file-region in question.
+ * Returns the index of the histogram-bin for a lock time.
  *
- * @param[in,out] pq      Product queue
- * @param[in]     offset  Offset to region in file in bytes
- * @param[in]     rflags  Region flags. Bitwise inclusive OR of
- *                        - RGN_NOLOCK     Don't lock region; locking handled
- *                                         elsewhere
- *                        - RGN_MODIFIED   Region was modified
- * @retval        0       Success
- * @retval        EBADF   Product-queue isn't open for writing. `log_add()`
- *                        called.
- * @retval        EINVAL  Region with given offset isn't in use. `log_add()`
- *                        called.
- * @retval        EIO     I/O error. `log_add()` called.
- * @see `mm_ftom()`
+ * @param[in] ns  The time in nanoseconds.
+ * @return        The index of the bin (see PQ_LOCK_BINS).
  */
-static int
-f_mtof( pqueue *const pq,
-        off_t const offset,
-        int const rflags)
+static inline unsigned
+ls_bin(const uint64_t ns)
 {
-    log_assert(pq != NULL); /* would have core dumped already initializing */
-    log_assert(pq->datao > 0);
-    log_assert(pq->datao % pq->pagesz == 0);
-    log_assert(pq->ixo >= pq->datao);
-    log_assert(pq->ixo % pq->pagesz == 0);
-    log_assert(pq->ixsz >= pq->pagesz);
-    log_assert(pq->ixsz % pq->pagesz == 0);
-
-    log_assert(pIf(fIsSet(rflags, RGN_MODIFIED),
-                    !fIsSet(pq->pflags, PQ_READONLY)));
+        const uint64_t units = ns >> 10;
+        unsigned       bin = units ? 64 - __builtin_clzll(units) : 0;
 
-    int  status;
-    riu* rp;
+        return bin < PQ_LOCK_BINS ? bin : PQ_LOCK_BINS - 1;
+}
 
-    if (riul_r_find(pq->riulp, offset, &rp) == 0) {
-        log_add("Region with offset %ld isn't in use", (long)offset);
-        status = EINVAL;
-    }
-    else {
-        log_assert(rp->vp != NULL);
+/**
+ * Adds a lock time to the statistics of a lock.
+ *
+ * @param[in,out] hist   The histogram.
+ * @param[in,out] total  The total time.
+ * @param[in,out] max    The longest time.
+ * @param[in]     ns     The time in nanoseconds.
+ */
+static void
+ls_add(
+        uint64_t* const hist,
+        uint64_t* const total,
+        uint64_t* const max,
+        const uint64_t  ns)
+{
+        uint64_t old = __atomic_load_n(max, __ATOMIC_RELAXED);
 
-        size_t extent = rp->extent;
-        void*  vp = rp->vp;
+        (void)__atomic_fetch_add(hist + ls_bin(ns), 1, __ATOMIC_RELAXED);
+        (void)__atomic_fetch_add(total, ns, __ATOMIC_RELAXED);
+        while(ns > old && !__atomic_compare_exchange_n(max, &old, ns, true,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+}
 
-        if (!fIsSet(rflags, RGN_MODIFIED)) {
-            status = 0;
-        }
-        else {
-            log_assert(!fIsSet(pq->pflags, PQ_READONLY));
+/**
+ * Returns the time to be passed to `ls_acquired()` when starting to acquire a
+ * lock.
+ *
+ * @param[in] pq  The product-queue.
+ * @return        The current time in nanoseconds or 0 if the lock statistics
+ *                aren't kept by this process.
+ */
+static inline uint64_t
+ls_start(const pqueue* const pq)
+{
+        return pq->lsctlp != NULL ? ls_now() : 0;
+}
 
-            ssize_t nwrote = pwrite(pq->fd, vp, extent, offset);
+/**
+ * Records that a lock was acquired.
+ *
+ * @param[in,out] pq     The product-queue.
+ * @param[in]     kind   The kind of lock.
+ * @param[in]     write  Whether the lock is for writing.
+ * @param[in]     start  When acquisition started according to `ls_start()`.
+ * @return               When the lock was acquired in nanoseconds, to be
+ *                       passed to `ls_released()`, or 0 if the lock statistics
+ *                       aren't kept by this process.
+ */
+static uint64_t
+ls_acquired(
+        pqueue* const      pq,
+        const pq_lock_kind kind,
+        const bool         write,
+        const uint64_t     start)
+{
+        uint64_t now;
+        lselem*  lep;
 
-            if (nwrote == -1) {
-                log_add_syserr("Couldn't write %lu bytes to product-queue "
-                        "starting at offset %ld", (unsigned long)extent,
-                        (long)offset);
-                status = errno;
-            }
-            else if (nwrote != extent) {
-                log_add("Wrote %ld bytes to product-queue at offset %ld; "
-                        "expected to write %lu", nwrote, (long)offset,
-                        (unsigned long)extent);
-                status = EIO;
-            }
-            else {
-                status = 0;
-            }
-        }
+        if(start == 0 || pq->lsctlp == NULL)
+                return 0;
 
-        (void)rgn2_release(pq, offset, rflags);
-        free(vp);
-    } // Region found in list of regions-in-use
+        now = ls_now();
+        lep = pq->lsctlp->lstat + kind;
+        (void)__atomic_fetch_add(&lep->count, 1, __ATOMIC_RELAXED);
+        if(write)
+                (void)__atomic_fetch_add(&lep->writes, 1, __ATOMIC_RELAXED);
+        ls_add(lep->wait, &lep->wait_ns, &lep->wait_max, now - start);
 
-    return status;
+        return now;
 }
 
-
-#ifdef HAVE_MMAP
 /**
- * Synchronizes a region of the product-queue file to memory using `mmap(2)`.
- * Locks the file-region in question.
+ * Records that a lock was found to be locked (EAGAIN or EACCES).
  *
- * @param[in,out] pqueue  Product queue
- * @param[in]     offset  Offset to region in bytes
- * @param[in]     extent  Extent of region in bytes
- * @param[in]     rflags  Region flags. Bitwise OR of
- *                        - RGN_NOLOCK  Don't lock region; locking handled
- *                                      elsewhere
- *                        - RGN_WRITE   Region will be modified
- *                        - RGN_NOWAIT  Return immediately if can't lock, else
- *                                      wait
- * @param[out]    ptrp    Location of mapped region in memory
- * @retval        0       Success
- * @retval        EACCES  Region already reserved. `log_add()` *not* called.
- * @retval        EDEADLK Deadlock condition detected. `log_add()` called.
- * @retval        ENOLCK  Number of file-locks would exceed system limit.
- *                        `log_add()`
- *                        called.
- * @retval        ENOMEM  Insufficient memory available. `log_add()` called.
- * @retval        EIO     An I/O error occurred while accessing the file system.
- *                        `log_add()` called.
- * @retval        EINTR   A signal was caught during execution. `log_add()`
- *                        called.
- * @retval        EMFILE  The number of mapped regions would exceed an
- *                        implementation-dependent limit (per process or per
- *                        system). `log_add()` called.
- * @see `mm_mtof()`
+ * @param[in,out] pq     The product-queue.
+ * @param[in]     kind   The kind of lock.
  */
-static int
-mm_ftom(pqueue* const pq,
-        const off_t   offset,
-        const size_t  extent,
-        const int     rflags,
-        void** const  ptrp)
+static void
+ls_retried(
+        pqueue* const      pq,
+        const pq_lock_kind kind)
 {
-    int    mflags = fIsSet(pq->pflags, PQ_PRIVATE) ? MAP_PRIVATE : MAP_SHARED;
-    int    prot = (fIsSet(pq->pflags, PQ_READONLY) && !fIsSet(rflags, RGN_WRITE))
-            ? PROT_READ
-            : (PROT_READ|PROT_WRITE);
-    size_t rem = offset % pq->pagesz;
-    size_t pagext = _RNDUP(rem + extent, pq->pagesz);
-
-    log_assert(pq != NULL); /* would have core dumped already initializing */
-    log_assert(pq->datao > 0);
-    log_assert(pq->datao % pq->pagesz == 0);
-    log_assert(pq->ixo >= pq->datao);
-    log_assert(pq->ixo % pq->pagesz == 0);
-    log_assert(pq->ixsz >= pq->pagesz);
-    log_assert(pq->ixsz % pq->pagesz == 0);
-
-    log_assert(0 <= offset && offset <= pq->ixo);
-    log_assert(0 != extent && extent < TOTAL_SIZE(pq));
-
-    log_assert(pIf(fIsSet(rflags, RGN_WRITE),
-                    !fIsSet(pq->pflags, PQ_READONLY)));
-
-    void* vp = NULL;
-    riu*  rp;
-    int   status = rgn2_reserve(pq, offset, extent, rflags, vp, &rp);
-
-    if (status != EACCES) {
-        if (status) {
-            log_add("rgn2_reserve() failure");
-        }
-        else {
-            if (fIsSet(prot, PROT_WRITE)) {
-                status = fgrow(pq->fd, offset+extent,
-                        fIsSet(pq->pflags, PQ_SPARSE));
-                if (status)
-                    log_add_errno(status, "fgrow() failure");
-            }
-
-            if (status == 0) {
-                off_t  pageo = offset - rem;
-
-                log_assert(pageo % pq->pagesz == 0);
-                log_assert(pagext % pq->pagesz == 0);
-
-                status = mapwrap(pq->fd, pageo, pagext, prot, mflags, &vp);
-
-                if (status == 0) {
-                    vp = (char*)vp + rem;
-                    rp->vp = vp; // Set region-in-use pointer. Was `NULL`.
-                    *ptrp = vp;
-                } // Region was successfully memory-mapped
-            } // Region in file was successfully extended if necessary
-
-            if (status)
-                (void)rgn2_release(pq, offset, rflags);
-        } // Region was successfully reserved
-    } // Locking file didn't return `EACCES`
-
-    return status;
+        if(pq->lsctlp != NULL)
+                (void)__atomic_fetch_add(&pq->lsctlp->lstat[kind].retries, 1,
+                                __ATOMIC_RELAXED);
 }
 
 /**
- * Synchronizes memory to a region of the file using `mmap(2)` for a region in
- * use. Unlocks the file-region in question.
+ * Records that a lock was released.
  *
- * @param[in,out] pq      Product queue
- * @param[in]     offset  Offset to region in file in bytes
- * @param[in]     rflags  Region flags. Bitwise inclusive OR of
- *                        - RGN_NOLOCK     Don't lock region; locking handled
- *                                         elsewhere
- *                        - RGN_MODIFIED   Region was modified
- * @retval        0       Success
- * @retval        EINVAL  Region with given offset isn't in use
- * @see `mm_ftom()`
+ * @param[in,out] pq      The product-queue.
+ * @param[in]     kind    The kind of lock.
+ * @param[in]     locked  When the lock was acquired according to
+ *                        `ls_acquired()`.
  */
-static int
-mm_mtof(pqueue *const pq,
-        off_t const   offset,
-        int const     rflags)
+static void
+ls_released(
+        pqueue* const      pq,
+        const pq_lock_kind kind,
+        const uint64_t     locked)
 {
-    int status;
+        if(locked != 0 && pq->lsctlp != NULL)
+        {
+                lselem* const lep = pq->lsctlp->lstat + kind;
 
-    log_assert(pq != NULL); /* would have core dumped already initializing */
-    log_assert(pq->datao > 0);
-    log_assert(pq->datao % pq->pagesz == 0);
-    log_assert(pq->ixo >= pq->datao);
-    log_assert(pq->ixo % pq->pagesz == 0);
-    log_assert(pq->ixsz >= pq->pagesz);
-    log_assert(pq->ixsz % pq->pagesz == 0);
+                ls_add(lep->hold, &lep->hold_ns, &lep->hold_max,
+                                ls_now() - locked);
+        }
+}
 
-    log_assert(pIf(fIsSet(rflags, RGN_MODIFIED),
-                    !fIsSet(pq->pflags, PQ_READONLY)));
+static ftomFunc f_ftom;
 
-    riu *rp = NULL;
-    if (riul_r_find(pq->riulp, offset, &rp) == 0) {
-        log_add("Region with offset %ld is not in use", (long)offset);
-        status = EINVAL;
-    }
-    else {
-        log_assert(rp->vp != NULL);
+/**
+ * Maps the control-page of a product-queue for writing the lock statistics.
+ * Failure isn't fatal: this process then doesn't contribute to them.
+ *
+ * @param[in,out] pq  The product-queue.
+ */
+static void
+ls_map(pqueue* const pq)
+{
+#ifdef HAVE_MMAP
+        int   fd = pq->fd;
+        void* vp;
 
-        int    mflags = 0; /* TODO: translate rflags to mflags */
-        off_t  rem = offset % (off_t)pq->pagesz;
-        size_t extent = rp->extent;
-        void*  vp = rp->vp;
+        /*
+         * A process that reads and writes the control-region would write back
+         * stale statistics, so they're only kept if it's memory-mapped.
+         */
+        if(fIsSet(pq->pflags, PQ_NOLOCK) || fIsSet(pq->pflags, PQ_PRIVATE) ||
+                        pq->ftom == f_ftom)
+                return;
 
-        if (rem == 0) {
-            status =  unmapwrap(vp, offset, extent, mflags);
-        }
-        else {
-            off_t pageno = offset / (off_t)pq->pagesz;
-            size_t pagext = _RNDUP(rem + extent, (off_t)pq->pagesz);
-            vp = (char *)vp - rem;
-            status = unmapwrap(vp, pageno*(off_t)pq->pagesz, pagext, mflags);
+        if(fIsSet(pq->pflags, PQ_READONLY))
+        {
+                fd = open(pq->pathname, O_RDWR);
+                if(fd < 0)
+                {
+                        log_debug("Couldn't open product-queue \"%s\" for "
+                                "writing lock statistics: %s", pq->pathname,
+                                strerror(errno));
+                        return;
+                }
+                (void)ensure_close_on_exec(fd);
         }
 
-        if (status) {
-            log_add_errno(status, "unmapwrap() failure");
+        vp = mmap(NULL, pq->pagesz, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if(vp == MAP_FAILED)
+        {
+                log_debug("Couldn't map control-page for lock statistics: %s",
+                        strerror(errno));
         }
-        else {
-            status = rgn2_release(pq, offset, rflags);
-            if (status)
-                log_add_errno(status, "rgn2_release() failure");
+        else if(((pqctl*)vp)->lstat_magic != LSTAT_MAGIC)
+        {
+                /* Opened read-only and not yet opened for writing */
+                (void)munmap(vp, pq->pagesz);
+        }
+        else
+        {
+                pq->lsctlp = (pqctl*)vp;
         }
-    } // Region found in regions-in-use list
 
-    return status;
+        if(fd != pq->fd)
+                pq->ls_fd = fd; /* closing it would release fcntl(2) locks */
+#endif
 }
 
 /**
- * Memory-maps the entire product-queue.
+ * Unmaps the lock statistics of a product-queue.
  *
- * @param[in] pq  Pointer to the product-queue object.
- * @retval EBADF      The file descriptor of the product-queue is invalid.
- * @retval EIO        An I/O error occurred while reading from the file system.
- * @retval EOVERFLOW  The file size in bytes or the number of blocks allocated
- *                    to the file or the file serial number cannot be
- *                    represented correctly.
- * @retval EINTR      A signal was caught during execution.
- * @retval EFBIG or EINVAL
- *                    The size of the product-queue is greater than the maximum
- *                    file size.
- * @retval EROFS      The named file resides on a read-only file system.
- * @retval EAGAIN     The mapping could not be locked in memory, if required by
- *                    mlockall(), due to a lack of resources.
- * @retval EINVAL     The product-queue object wants to map the product-queue to
- *                    a fixed memory location that is not a multiple of the page
- *                    size as returned by sysconf(), or is considered invalid
- *                    by the O/S.
- * @retval EMFILE     The number of mapped regions would exceed an O/S-dependent
- *                    limit (per process or per system).
- * @retval ENODEV     The file descriptor of the product-queue object refers to
- *                    a file whose type is not supported by mmap().
- * @retval ENOMEM     The size of the product-queue exceeds that allowed for the
- *                    address space of a process.
- * @retval ENOMEM     The mapping could not be locked in memory, if required by
- *                    mlockall(), because it would require more space than the
- *                    system is able to supply.
- * @retval ENOTSUP    The O/S does not support the combination of accesses
- *                    requested.
- * @retval ENXIO      The size of the product-queue is invalid for the object
- *                    specified by its file descriptor.
+ * @param[in,out] pq  The product-queue.
  */
-static int
-mm0_map(pqueue *const pq)
+static void
+ls_unmap(pqueue* const pq)
 {
-        int status = ENOERR;
-        void *vp = pq->base;
-        struct stat sb;
-        off_t st_size = TOTAL_SIZE(pq);
-        log_assert(st_size >= 0);
-        int mflags = fIsSet(pq->pflags, PQ_PRIVATE) ?
-                        MAP_PRIVATE : MAP_SHARED;
-        int prot = fIsSet(pq->pflags, PQ_READONLY) ?
-                        PROT_READ : (PROT_READ|PROT_WRITE);
-
-        if(fstat(pq->fd, &sb) < 0)
-                return errno;
-        if(st_size < sb.st_size)
-        {
-                st_size = sb.st_size;
-        }
-        else if(!fIsSet(pq->pflags, PQ_READONLY))
+#ifdef HAVE_MMAP
+        if(pq->lsctlp != NULL)
         {
-                status = fgrow(pq->fd, st_size,
-                               fIsSet(pq->pflags, PQ_SPARSE));
-                if(status != ENOERR)
-                        return status;
-        }
-        if(vp != NULL)
-                fSet(mflags, MAP_FIXED);
-        log_debug("Mapping %ld", (long)st_size);
-        if (~(size_t)0 < st_size) {
-            log_error_q("File is too big to memory-map");
-            pq->base = NULL;
-            status = EFBIG;
-            return status;
+                (void)munmap(pq->lsctlp, pq->pagesz);
+                pq->lsctlp = NULL;
         }
-        status = mapwrap(pq->fd, 0, st_size, prot, mflags, &vp);
-        log_assert(status != EACCES);
-        if(status != ENOERR)
+        if(pq->ls_fd >= 0)
         {
-                pq->base = NULL;
-                return status;
+                (void)close(pq->ls_fd);
+                pq->ls_fd = -1;
         }
-        log_assert(vp != NULL);
-        log_assert(pIf(pq->base != NULL, pq->base == vp));
-        pq->base = vp;
-        return status;
+#endif
 }
 
 /**
- * Synchronizes a region in the product-queue file to memory using `mmap()` to
- * map the whole file. Locks the region in question.
- *
- * @param[in] rflags  Region flags: bitwise OR of
- *                    - RGN_NOLOCK  Don't lock region; locking handled elsewhere
- *                    - RGN_WRITE   Region will be modified
- *                    - RGN_NOWAIT  Return immediately if can't lock, else wait
+ * Returns the statistics of the locks of a product-queue.
  *
- * `log_add()` is called for all of the following:
- * @retval EACCES     The region is already locked by another process.
- * @retval EINVAL     The product-queue file doesn't support locking.
- * @retval ENOLCK     The number of locked regions would exceed a system-imposed
- *                    limit.
- * @retval EDEADLK    A deadlock in region locking has been detected.
- * @retval EBADF      The file descriptor of the product-queue is invalid.
- * @retval EIO        An I/O error occurred while reading from the file system.
- * @retval EOVERFLOW  The file size in bytes or the number of blocks allocated
- *                    to the file or the file serial number cannot be
- *                    represented correctly.
- * @retval EINTR      A signal was caught during execution.
- * @retval EFBIG or EINVAL
- *                    The size of the product-queue is greater than the maximum
- *                    file size.
- * @retval EROFS      The named file resides on a read-only file system.
- * @retval EINVAL     The product-queue object wants to map the product-queue to
- *                    a fixed memory location that is not a multiple of the page
- *                    size as returned by sysconf(), or is considered invalid
- *                    by the O/S.
- * @retval EMFILE     The number of mapped regions would exceed an O/S-dependent
- *                    limit (per process or per system).
- * @retval ENODEV     The file descriptor of the product-queue object refers to
- *                    a file whose type is not supported by mmap().
- * @retval ENOMEM     The size of the product-queue exceeds that allowed for the
- *                    address space of a process.
- * @retval ENOMEM     The mapping could not be locked in memory, if required by
- *                    mlockall(), because it would require more space than the
- *                    system is able to supply.
- * @retval ENOTSUP    The O/S does not support the combination of accesses
- *                    requested.
- * @retval ENXIO      The size of the product-queue is invalid for the object
- *                    specified by its file descriptor.
+ * @param[out] stats  The statistics of each kind of lock.
+ * @param[in]  lstat  The statistics in the control-region.
  */
-/*ARGSUSED*/
-static int
-mm0_ftom(pqueue *const pq,
-        const off_t offset,
-        const size_t extent,
-        const int rflags,
-        void **const ptrp)
+static void
+ls_copy(
+        pq_lockstats* const restrict stats,
+        const lselem* const restrict lstat)
 {
-    int status = 0;
-
-    log_assert(pq != NULL);
-    log_assert(pq->datao > 0);
-    log_assert(pq->datao % pq->pagesz == 0);
-    log_assert(pq->ixo >= pq->datao);
-    log_assert(pq->ixo % pq->pagesz == 0);
-    log_assert(pq->ixsz >= pq->pagesz);
-    log_assert(pq->ixsz % pq->pagesz == 0);
-
-    log_assert(0 <= offset && offset <= pq->ixo);
-    log_assert(0 != extent && extent < TOTAL_SIZE(pq));
-
-    if (!pIf(fIsSet(rflags, RGN_WRITE),
-                    !fIsSet(pq->pflags, PQ_READONLY))) {
-        log_error_q("Write access requested to readonly product-queue");
-        abort();
-    }
-
-    if (pq->base == NULL) {
-        status = mm0_map(pq); // First time
-        if (status)
-            log_add_errno(status, "mm0_map() failure");
-    }
-
-    if (status == 0) {
-        void* const vp = (char*)pq->base + offset;
-        riu*        rp; // Not used
-
-        status = rgn2_reserve(pq, offset, extent, rflags, vp, &rp);
+        for(int kind = 0; kind < PQ_LOCK_KINDS; kind++)
+        {
+                pq_lockstats* const  dst = stats + kind;
+                const lselem* const  src = lstat + kind;
+
+                dst->count = __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+                dst->writes = __atomic_load_n(&src->writes, __ATOMIC_RELAXED);
+                dst->retries = __atomic_load_n(&src->retries,
+                                __ATOMIC_RELAXED);
+                dst->waitNs = __atomic_load_n(&src->wait_ns, __ATOMIC_RELAXED);
+                dst->holdNs = __atomic_load_n(&src->hold_ns, __ATOMIC_RELAXED);
+                dst->waitMax = __atomic_load_n(&src->wait_max,
+                                __ATOMIC_RELAXED);
+                dst->holdMax = __atomic_load_n(&src->hold_max,
+                                __ATOMIC_RELAXED);
+                for(int i = 0; i < PQ_LOCK_BINS; i++)
+                {
+                        dst->wait[i] = __atomic_load_n(&src->wait[i],
+                                        __ATOMIC_RELAXED);
+                        dst->hold[i] = __atomic_load_n(&src->hold[i],
+                                        __ATOMIC_RELAXED);
+                }
+        }
+}
 
-        if (status != EACCES) {
-            if (status) {
-                log_add("rgn2_reserve() failure");
-            }
-            else {
-                *ptrp = vp;
-            }
-        } // File locking didn't return `EACCES`
-    } // Product-queue file was successfully memory-mapped if necessary
+/* End ls */
 
-    return status;
-}
+/* Begin OS */
 
-/**
- * Transfers a product-queue region from memory to file given that the entire
- * product-queue is memory-mapped.
- *
- * @param[in,out] pq      Product-queue
- * @param[in]     offset  Offset to region in bytes
- * @param[in]     rflags  Region flags. Bitwise OR of
- *                         - RGN_NOLOCK     Don't lock region; locking handled
- *                                          elsewhere
- *                         - RGN_MODIFIED   Region was modified
- * @retval EINVAL     The region could not be found in the list of in-use
- *                    regions.
- * @retval EBADF      The product-queue's file descriptor is invalid.
- * @retval EOVERFLOW  The (offset + extent) specification of the region is
- *                    invalid.
+/*
+ * What is the system pagesize?
  */
-static int
-mm0_mtof(
-        pqueue *const pq,
-        off_t const   offset,
-        int const     rflags)
+static inline long
+pagesize(void)
 {
-    log_assert(pq != NULL); /* would have core dumped already initializing */
-    log_assert(pq->datao > 0);
-    log_assert(pq->datao % pq->pagesz == 0);
-    log_assert(pq->ixo >= pq->datao);
-    log_assert(pq->ixo % pq->pagesz == 0);
-    log_assert(pq->ixsz >= pq->pagesz);
-    log_assert(pq->ixsz % pq->pagesz == 0);
-
-    log_assert(pIf(fIsSet(rflags, RGN_MODIFIED),
-                    !fIsSet(pq->pflags, PQ_READONLY)));
-
-    return rgn2_release(pq, offset, rflags);
+/* Hmm, aren't standards great? */
+#ifndef CRAY
+#if defined(_SC_PAGE_SIZE) && !defined(_SC_PAGESIZE)
+#define _SC_PAGESIZE _SC_PAGE_SIZE
+#endif
+#ifdef _SC_PAGESIZE
+        return sysconf(_SC_PAGESIZE);
+#else
+        return (long)getpagesize();
+#endif
+#else
+        return 4096L;
+#endif
 }
-/* End OS */
-#endif /*HAVE_MMAP*/
-
-
-/* The maximum value of a "size_t": */
-static const size_t MAX_SIZE_T = ~(size_t)0;
 
+#ifdef HAVE_LINUX_FUTEX_H
+static inline long
+futex(
+        uint32_t* const              uaddr,
+        const int                    op,
+        const uint32_t               val,
+        const struct timespec* const timeout)
+{
+    return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+#endif
 
-/**
- * Indicates if memory-mapping by individual data-products is necessary.
+/*
+ * Sortof like ftruncate, except won't make the
+ * file shorter.
+ * May have side effect of leaving the
+ * current position hosed.
+ * If sparse == 0, fill in all the zero blocks (slow); 
+ * else extend sparsely, without allocating zero blocks.
  *
- * Arguments:
- *      pq      Pointer to the product-queue structure.
  * Returns:
- *      0       If and only if it is not necessary to memory-map the
- *              product-queue by individual data-products.
+ *      EBADF   The "fd" argument is not a file descriptor open for writing.
+ *      EIO     An I/O error occurred while reading from the file system.
+ *      EOVERFLOW
+ *              The file size in bytes or the number of blocks allocated to the
+ *              file or the file serial number cannot be represented correctly.
+ *      EINTR   A signal was caught during execution.
+ *      EINVAL  The "len" argument was less than 0.
+ *      EFBIG or EINVAL
+ *              The "len" argument was greater than the maximum file size.
+ *      EFBIG   The file is a regular file and length is greater than the offset
+ *              maximum established in the open file description associated with
+ *              "fd".
+ *      EROFS   The named file resides on a read-only file system.
  */
-static inline int
-isProductMappingNecessary(
-    const pqueue* const pq)
+static int
+fgrow(const int fd, const off_t len, int sparse)
 {
-    return (TOTAL_SIZE(pq) > MAX_SIZE_T)
-#if __FreeBSD__ == 4
-        /*
-         * The operating-system is 32-bit Free BSD 4, which has a limit of
-         * 2 gigabytes on the extent argument of an mmap(2) call.
-         */
-        || (sizeof(size_t) == 4 && TOTAL_SIZE(pq) > 2000000000)
-#endif
-        ;
+        struct stat sb;
+        if (fstat(fd, &sb) < 0)
+                return errno;
+        if (len < sb.st_size)
+                return ENOERR;
+        if (sparse != 0) {
+#ifdef HAVE_FTRUNCATE
+            if (ftruncate(fd, len) < 0)
+                return errno;
+#else
+            {
+                int dumb = 0;
+                /* beware position moved as side effect */
+                if (lseek(fd, len-sizeof(dumb), SEEK_SET) < 0)
+                        return errno;
+                if(write(fd, &dumb, sizeof(dumb)) < 0)
+                        return errno;
+            }
+#endif /* HAVE_FTRUNCATE */
+        } else {                /* else, fill in all the zeros */
+#define N_ZEROS_GROW 8192
+            static int zeros[N_ZEROS_GROW];
+            size_t zsize = N_ZEROS_GROW * sizeof(int);
+            size_t clen = sb.st_size;
+            off_t ii;
+            /* beware position moved as side effect */
+            if (lseek(fd, clen, SEEK_SET) < 0)
+                return errno;
+            if(write(fd, zeros, (len-clen) % zsize) < 0)
+                return errno;
+            for(ii = clen + (len-clen) % zsize; ii < len; ii += zsize) {
+                if(write(fd, zeros, zsize) < 0)
+                    return errno;
+            }
+        }
+        return ENOERR;
 }
 
 /******************************************************************************
- * Higher-Level Data-Product Data-Region Functions:
+ * File Locking Functions:
  ******************************************************************************/
 
-/*
- * Release/unlock a data region. This function is the complement of `rgn_get()`.
+/* 
+ * Decode flock l_type member to string.
+ * DEBUG
  */
-static inline int
-rgn_rel(pqueue *const pq, off_t const offset, int const rflags)
+static char *
+s_ltype(const short l_type)
 {
-        log_assert(offset >= pq->datao && offset < pq->ixo);
-        return (pq->mtof)(pq, offset, rflags);
+        switch (l_type) {
+        case F_WRLCK: return "F_WRLCK";
+        case F_RDLCK: return "F_RDLCK";
+        case F_UNLCK: return "F_UNLCK";
+        }
+        return "Unknown type";
+}
+
+/* 
+ * Decode flock whence member to string.
+ * DEBUG
+ */
+static char *
+s_whence(const short whence)
+{
+        switch (whence) {
+        case SEEK_SET: return "SEEK_SET";
+        case SEEK_CUR: return "SEEK_CUR";
+        case SEEK_END: return "SEEK_END";
+        }
+        return "Unknown whence";
 }
 
+
 /*
- * Get/lock a data region. This function is the complement of `rgn_rel()`.
- *
- * Returns:
- *      0       Success
- *      `log_add()` is called for all of the following:
+ * If this process would be unable to obtain a lock,
+ * return the pid of the process holding the conflicting lock.
+ * Else return zero or -1 on error.
+ */
+static pid_t
+fd_isLocked(const int fd, const short l_type,
+        const off_t offset, const short l_whence, const size_t extent)
+{
+        int cmd = F_GETLK;
+        struct flock lock;
+        lock.l_type = l_type;
+        lock.l_start = offset;
+        lock.l_whence = l_whence;
+        lock.l_len = (off_t)extent;
+        if(fcntl(fd, cmd, &lock) < 0)
+                return ((pid_t)-1);
+        return (lock.l_type == F_UNLCK ? 0 : lock.l_pid);
+}
+
+
+/*
+ * convenience wrapper around fcntl locking
+ *
+ * Returns:
+ *      0       Success
  *      EACCESS or EAGAIN
- *              "rflags" contains RGN_NOWAIT and the segment of a file to
- *              be locked is already exclusive-locked by another process,
- *              or "rflags" contains RGN_WRITE and some portion of the
- *              segment of the file to be locked is already shared-locked or
+ *              The "cmd" argument is F_SETLK: the type of lock (l_type) is a
+ *              shared (F_RDLCK) or exclusive (F_WRLCK) lock and the segment
+ *              of a file to be locked is already exclusive-locked by another
+ *              process, or the type is an exclusive lock and some portion of
+ *              the segment of a file to be locked is already shared-locked or
  *              exclusive-locked by another process.
- *      EACCES  "pq->fd" is not open for read, regardless of the protection
- *              specified, or "pq->fd" is not open for write and PROT_WRITE was
- *              specified for a MAP_SHARED type mapping.
+ *      EBADF   The "fd" argument is not a valid open file descriptor, or the
+ *              argument "cmd" is F_SETLK or F_SETLKW, the type of lock, l_type,
+ *              is a shared lock (F_RDLCK), and "fd" is not a valid file
+ *              descriptor open for reading, or the type of lock l_type, is an
+ *              exclusive lock (F_WRLCK), and "fd" is not a valid file
+ *              descriptor open for writing.
+ *      EINVAL  The "cmd" argument is invalid, or the "cmd" argument is F_GETLK,
+ *              F_SETLK or F_SETLKW and "l_type", "offset", "l_whence", or
+ *              "extent" is not valid, or "fd" refers to a file that does not 
+ *              support locking.
+ *      ENOLCK  The argument "cmd" is F_SETLK or F_SETLKW and satisfying the
+ *              lock or unlock request would result in the number of locked
+ *              regions in the system exceeding a system-imposed limit.
+ *      EOVERFLOW
+ *              The "cmd" argument is F_GETLK, F_SETLK or F_SETLKW and the
+ *              smallest or, if "extent" is non-zero, the largest offset of any
+ *              byte in the requested segment cannot be represented correctly
+ *              in an object of type off_t.
+ *      EDEADLK The "cmd" argument is F_SETLKW, the lock is blocked by some lock
+ *              from another process and putting the calling process to sleep,
+ *              waiting for that lock to become free would cause a deadlock.
+ */
+static int
+fd_lock(const int fd, const int cmd, const short l_type,
+        const off_t offset, const short l_whence, const size_t extent)
+{
+        struct flock lock;
+
+        lock.l_type = l_type;
+        lock.l_start = offset;
+        lock.l_whence = l_whence;
+        lock.l_len = (off_t)extent;
+        /* return (fcntl(fd, cmd, &lock) < 0 ? errno : 0); */
+        if (fcntl(fd, cmd, &lock) < 0)
+        {
+                int errnum = errno;
+
+                if(errnum == EDEADLK || errnum == EAGAIN || errnum == EACCES)
+                {
+                        if(errnum == EDEADLK || cmd != F_SETLK)
+                        {
+                        pid_t conflict = fd_isLocked(fd, l_type, offset,
+                                        l_whence, extent);
+                        log_errno_q(errnum,
+                                "fcntl %s failed for rgn (%ld %s, %lu): %s",
+                                s_ltype(l_type), 
+                                (long)offset, s_whence(l_whence), (long)extent, 
+                                strerror(errnum));
+                        log_error_q("conflicting pid %d", (int)conflict);
+                        }
+                }
+                else
+                {
+                        log_syserr_q("fcntl %s failed for rgn (%ld %s, %lu) %d",
+                                s_ltype(l_type), 
+                                (long)offset, s_whence(l_whence), (long)extent, 
+                                errnum);
+                }
+                
+                return errnum;
+        }
+        /* else */
+        return 0;
+}
+
+/******************************************************************************
+ * Memory-Mapping Functions:
+ ******************************************************************************/
+
+#ifdef HAVE_MMAP
+/*
+ * Wrapper around mmap()
+ *
+ * Returns:
+ *      EACCES  The "fd" argument is not open for read, regardless of the
+ *              protection specified, or "fd" is not open for write and
+ *              PROT_WRITE was specified for a MAP_SHARED type mapping.
  *      EAGAIN  The mapping could not be locked in memory, if required by
  *              mlockall(), due to a lack of resources.
- *      EBADF   "pq->fd" is not a valid open file descriptor, or "rflags"
- *              doesn't contain RGN_WRITE and "pq->fd" is not a valid file
- *              descriptor open for reading, or "rflags" contains RGN_WRITE
- *              and "pq->fd" is not a valid file descriptor open for writing.
- *      EDEADLK "rflags" doesn't contain RGN_NOWAIT, the lock is blocked by some
- *              lock from another process and putting the calling process to
- *              sleep, waiting for that lock to become free would cause a
- *              deadlock.
- *      EFBIG or EINVAL
- *              The "extent" argument was greater than the maximum file size.
- *      EFBIG   The file is a regular file and length is greater than the offset
- *              maximum established in the open file description associated with
- *              "pq->fd".
- *      EINTR   A signal was caught during execution.
- *      EINVAL  "offset", or "extent" is not valid, or "pq->fd" refers to a file
- *              that does not support locking.
- *      EINVAL  "offset" is not a multiple of the page size as returned by
- *              sysconf(), or is considered invalid by the implementation.
- *      EIO     An I/O error occurred while reading from the file system.
+ *      EBADF   The "fd" argument is not a valid open file descriptor.
+ *      EINVAL  The "*ptrp" argument (if MAP_FIXED was specified) or "offset" is
+ *              not a multiple of the page size as returned by sysconf(), or
+ *              are considered invalid by the implementation.
+ *      EINVAL  The value of "mflags" is invalid (neither MAP_PRIVATE nor 
+ *              MAP_SHARED is set).
  *      EMFILE  The number of mapped regions would exceed an
  *              implementation-dependent limit (per process or per system).
- *      ENODEV  "pq->fd" refers to a file whose type is not supported by mmap().
- *      ENOLCK  Satisfying the request would result in the number of locked
- *              regions in the system exceeding a system-imposed limit.
- *      ENOMEM  There is insufficient room in the address space to effect the
- *              necessary mapping.
+ *      ENODEV  The "fd" argument refers to a file whose type is not supported
+ *              by mmap().
+ *      ENOMEM  MAP_FIXED was specified, and the range [*ptrp, *ptrp + extent)
+ *              exceeds that allowed for the address space of a process; or if
+ *              MAP_FIXED was not specified and there is insufficient room in
+ *              the address space to effect the mapping.
  *      ENOMEM  The mapping could not be locked in memory, if required by
  *              mlockall(), because it would require more space than the system
  *              is able to supply.
- *      ENOMEM  Insufficient memory is available.
  *      ENOTSUP The implementation does not support the combination of accesses
- *              requested in "pq->pflags" and "rflags".
+ *              requested in the "prot" argument.
  *      ENXIO   Addresses in the range [offset, offset + extent) are invalid for
- *              the object specified by "pq->fd".
- *      EOVERFLOW
- *              The smallest or, if "extent" is non-zero, the largest offset of
- *              any byte in the requested segment cannot be represented
- *              correctly in an object of type off_t.
- *      EOVERFLOW
- *              The file size in bytes or the number of blocks allocated to the
- *              file or the file serial number cannot be represented correctly.
+ *              the object specified by "fd".
+ *      ENXIO   MAP_FIXED was specified in "mflags" and the combination of
+ *              "*ptrp", "extent" and "offset" is invalid for the object
+ *              specified by "fd".
  *      EOVERFLOW
- *              The file is a regular file and the value of "offset" plus
+ *              The file is a regular file and the value of "offset" plus 
  *              "extent" exceeds the offset maximum established in the open file
- *              description associated with "pq->fd".
- *      EROFS   The file resides on a read-only file system.
+ *              description associated with "fd". 
  */
-static inline int
-rgn_get(pqueue *const pq, off_t const offset, size_t const extent,
-         int const rflags, void **const vpp)
-{
-        log_assert(offset >= pq->datao && offset < pq->ixo);
-        log_assert(extent >= MIN_RGN_SIZE  && extent <= pq->ixo - pq->datao);
-
-        log_assert(pq->riulp->nelems <= pq->rlp->nelems +1);
-
-        return (pq->ftom)(pq, offset, extent, rflags, vpp);
-}
-
-/******************************************************************************
- * XDR Functions:
- ******************************************************************************/
-
-static void *
-xinfo_i(void *buf, size_t size, enum xdr_op op,
-        prod_info *infop)
+static int
+mapwrap(const int fd,
+        const off_t offset,
+        const size_t extent,
+        const int prot,
+        int mflags,
+        void **ptrp)
 {
-        XDR xdrs[1] ;
-
-        xdrmem_create(xdrs, buf, (u_int)size, op) ;
+        int status = ENOERR;
+        void *mm;
 
-        if(!xdr_prod_info(xdrs, infop))
+#ifdef MAP_FILE /* HP-UX */
+        fSet(mflags, MAP_FILE);
+#endif
+#ifdef MAP_VARIABLE /* HP-UX */
+        if(!fIsSet(mflags, MAP_FIXED))
+                fSet(mflags, MAP_VARIABLE);
+#endif
+        
+        mm = (void *) mmap(*ptrp, extent, prot, mflags, fd, offset);
+        if(mm == MAP_FAILED)
         {
-                log_error_q("xinfo:%s xdr_prod_info() failed",
-                        infop->ident) ;
-                return NULL;
+                status = errno;
+                log_add_syserr("mmap() failure: *ptrp=%p, offset=%ld, extent=%lu",
+                    *ptrp, (long)offset, (unsigned long)extent);
+                log_error_q("Product-queue size too big?");
+                return status;
         }
-        /* return data ptr. Unwarranted intimacy with xdr_mem implementation */
-        return xdrs->x_private;
+#if TRACE_MMAP
+        log_debug("%p = mmap: %p %ld %lu", mm, *ptrp,
+                (long)offset, (unsigned long)extent );
+#endif
+
+        *ptrp = mm;
+        return status;
 }
 
 
 /*
- * XDR Encode or Decode "prod" to or from "buf" of size "size".
+ * Wrapper around munmap
  */
-static ptrdiff_t
-xproduct(void *buf, size_t size, enum xdr_op op, product *prod)
+/*ARGSUSED*/
+static int
+unmapwrap(void *const ptr,
+        const off_t offset,
+        const size_t extent,
+        const int mflags)
 {
-        XDR xdrs[1] ;
-        xdrmem_create(xdrs, buf, (u_int)size, op);
+        int status = ENOERR;
 
-        if (!xdr_product(xdrs, prod))
+#ifdef USE_MSYNC
+        /* if(!fIsSet(mflags, M_DISCARD)) */
+        if(1)
         {
-                log_error_q("%s xdr_product() failed",
-                        prod->info.ident);
-                return 0;
+#ifdef MS_ASYNC
+                if(msync(ptr, extent, MS_ASYNC) == -1)
+                        log_syserr_q("msync: %ld %lu MS_ASYNC",
+                                (long)offset, (unsigned long)extent);
+#else
+                if(msync(ptr, extent) == -1)
+                        log_syserr_q("msync: %ld %lu",
+                                (long)offset, (unsigned long)extent);
+#endif
         }
+#endif /* USE_MSYNC */
 
-        /*      return xlen_product(prod) ; */
-        return (xdrs->x_private - xdrs->x_base);
+#if TRACE_MMAP
+        log_debug("unmap: %p %ld %lu", ptr, (long)offset, (unsigned long)extent);
+#endif
+        if(munmap(ptr, extent) == -1)
+        {
+                status = errno;
+                log_syserr_q("munmap: %ld %lu", (long)offset, (unsigned long)extent);
+                return status;
+        }
+
+        return status;
 }
+#endif /*HAVE_MMAP*/
 
 /******************************************************************************
- * Lower-Level Product-Queue Functions:
+ * Robust Control-Region Lock:
+ *
+ * When a product-queue is created with PQ_ROBUST, its control-region is locked
+ * by the reader/writer lock in the control-region itself rather than by
+ * fcntl(2). Locking and unlocking an uncontended lock is then a
+ * compare-and-swap in shared memory instead of a system call. A process that
+ * must wait does so on a futex (or polls where futexes are unavailable) and
+ * periodically reclaims the lock from holders that no longer exist. Because
+ * the lock is in the file, it is reinitialized after a system restart.
  ******************************************************************************/
 
+#ifdef PQ_HAVE_RWL
+
+/*
+ * Interval, in seconds, between checks for terminated holders of the lock by a
+ * waiting process:
+ */
+#define RWL_REAP_INTERVAL 1
+
+/*
+ * Process-ID of this process. Cached because the lock is otherwise taken and
+ * released without a system call.
+ */
+static pid_t          rwl_pid;
+static pthread_once_t rwl_pidOnce = PTHREAD_ONCE_INIT;
+
+static void
+rwl_setPid(void)
+{
+    rwl_pid = getpid();
+}
+
+static void
+rwl_initPid(void)
+{
+    rwl_setPid();
+    (void)pthread_atfork(NULL, NULL, rwl_setPid);
+}
+
 /**
- * Deletes a data-product if the product is not locked.
+ * Returns the process-ID of this process.
  *
- * @param[in]  pq          The product-queue.
- * @param[in]  tqep        The entry in the time-map.
- * @param[in]  rlix        The index of the entry in the region-map.
- * @param[out] info        The data-product metadata. On success, caller should
- *                         unconditionally call `xdr_free(xdr_prod_info,
- *                         (char*)info)` when it's no longer needed.
- * @retval     0           Success. `*info` is set. Caller should
- *                         unconditionally call `xdr_free(xdr_prod_info,
- *                         (char*)info)` when it's no longer needed.
- * @retval     EACCES      Product is locked.
- * @retval     PQ_CORRUPT  The product-queue is corrupt. Error-messaged logged.
- * @retval     PQ_SYSTEM   System error. Error-message logged.
+ * @return  The process-ID of this process.
+ */
+static inline pid_t
+rwl_getPid(void)
+{
+    (void)pthread_once(&rwl_pidOnce, rwl_initPid);
+    return rwl_pid;
+}
+
+/**
+ * Returns the identifier of the current boot of the system. No process can
+ * hold a lock whose boot-identifier differs.
+ *
+ * @param[out] buf   Boot-identifier. Empty if unknown.
+ * @param[in]  size  Size of `buf` in bytes.
+ */
+static void
+rwl_bootId(
+        char* const  buf,
+        const size_t size)
+{
+    FILE* const file = fopen("/proc/sys/kernel/random/boot_id", "r");
+
+    buf[0] = 0;
+    if (file) {
+        if (fgets(buf, size, file) == NULL)
+            buf[0] = 0;
+        (void)fclose(file);
+    }
+}
+
+/**
+ * Initializes a robust control-region lock.
+ *
+ * @param[out] lp  The lock.
+ * @retval     0   Success.
+ * @return         <errno.h> error-code. `log_add()` called.
  */
 static int
-pq2_try_del_prod(
-    pqueue* const restrict    pq,
-    tqelem* const restrict    tqep,
-    size_t                    rlix,
-    prod_info* const restrict info)
+rwl_init(rwl* const lp)
 {
-    region* const rep = pq->rlp->rp + rlix;
-    const off_t   offset = rep->offset;
-    int           status;
+    pthread_mutexattr_t attr;
+    char                boot[sizeof(lp->boot)];
+    int                 status = pthread_mutexattr_init(&attr);
 
-    if (offset != tqep->offset) {
-        log_error_q("Offset-to-region mismatch: time-entry=%ld, "
-                "region-entry=%ld", (long)tqep->offset, (long)offset);
-        status = PQ_CORRUPT;
+    if (status) {
+        log_add_errno(status, "Couldn't initialize mutex attributes");
     }
     else {
-        void* vp;
-
-        status = rgn_get(pq, offset, Extent(rep), RGN_WRITE|RGN_NOWAIT, &vp);
+        (void)memset(lp, 0, sizeof(*lp));
+        (void)pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        (void)pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        status = pthread_mutex_init(&lp->mutex, &attr);
         if (status) {
-            if (status == EACCES || status == EAGAIN) {
-                log_clear();
-                status = EACCES;
-            }
-            else {
-                log_syserr_q("Couldn't get region (offset=%ld,extent=%lu)");
-                status = PQ_SYSTEM;
-            }
+            log_add_errno(status, "Couldn't initialize control-region mutex");
         }
         else {
-            /* Get the metadata of the data-product. */
-            XDR xdrs;
+            /* The boot-identifier validates the rest, so it's set last */
+            rwl_bootId(boot, sizeof(boot));
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            (void)memcpy(lp->boot, boot, sizeof(boot));
+        }
+        (void)pthread_mutexattr_destroy(&attr);
+    }
 
-            xdrmem_create(&xdrs, vp, Extent(rep), XDR_DECODE);
-            // Necessary for `xdr_prod_info()`
-            (void)memset(info, 0, sizeof(prod_info));
+    return status;
+}
 
-            if (!xdr_prod_info(&xdrs, info)) {
-                log_error_q("Couldn't XDR_DECODE data-product metadata");
-                status = PQ_CORRUPT;
-            }
-            else {
-                /*
-                 * Remove the corresponding entry from the signature-map.
-                 */
-                if (sx_find_delete(pq->sxp, info->signature) == 0) {
-                    log_error_q("pq_try_del_prod(): signature %s: Not Found",
-                            s_signaturet(NULL, 0, info->signature));
-                    status = PQ_CORRUPT;
-                }
-                else {
-                    /*
-                     * Remove the corresponding entry from the time-map.
-                     */
-                    tq_delete(pq->tqp, tqep);
+/**
+ * Indicates if a process exists.
+ *
+ * @param[in] pid    The process-ID.
+ * @retval    true   The process exists (or might).
+ * @retval    false  The process doesn't exist.
+ */
+static inline bool
+rwl_isAlive(const pid_t pid)
+{
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
 
-                    /*
-                     * Remove the corresponding entry from the region-map.
-                     */
-                    rl_free(pq->rlp, rlix);
-                }
+/**
+ * Removes terminated processes from the holders of a robust control-region
+ * lock. The lock's mutex must be locked.
+ *
+ * @param[in,out] lp  The lock.
+ */
+static void
+rwl_reap(rwl* const lp)
+{
+    if (lp->writer && !rwl_isAlive(lp->writer)) {
+        log_warning_q("Reclaiming control-region write-lock from terminated "
+                "process %ld. Product-queue might be corrupt.",
+                (long)lp->writer);
+        lp->writer = 0;
+        lp->seq++;
+    }
 
-                if (status)
-                    xdr_free(xdr_prod_info, (char*)info);
-            } // `xdr_prod_info()` successful
+    for (unsigned i = 0; i < lp->nreaders && i < RWL_MAXREADERS; ) {
+        if (rwl_isAlive(lp->readers[i])) {
+            i++;
+        }
+        else {
+            log_warning_q("Reclaiming control-region read-lock from "
+                    "terminated process %ld", (long)lp->readers[i]);
+            lp->readers[i] = lp->readers[--lp->nreaders];
+            lp->seq++;
+        }
+    }
+    if (lp->nreaders > RWL_MAXREADERS)
+        lp->nreaders = RWL_MAXREADERS;
+}
 
-            xdr_destroy(&xdrs);
+/**
+ * Locks the mutex of a robust control-region lock. If the previous owner of
+ * the mutex terminated while owning it, then the state of the lock is
+ * recovered.
+ *
+ * @param[in,out] lp  The lock.
+ * @retval        0   Success.
+ * @return            <errno.h> error-code. `log_add()` called.
+ */
+static int
+rwl_enter(rwl* const lp)
+{
+    int status = pthread_mutex_lock(&lp->mutex);
 
-            /* Release the data-region. */
-            (void)rgn_rel(pq, offset, 0);
-        } // `rgn_get()` successful
-    } // region-offsets match
+    if (status == EOWNERDEAD) {
+        log_warning_q("Process terminated while changing control-region lock. "
+                "Recovering.");
+        rwl_reap(lp);
+        status = pthread_mutex_consistent(&lp->mutex);
+    }
+    if (status)
+        log_add_errno(status, "Couldn't lock control-region mutex");
 
     return status;
 }
 
-
 /**
- * Set the minimum virtual residence time metrics if appropriate.
+ * Waits for the state of a robust control-region lock to change. The lock's
+ * mutex must be locked; it's unlocked while waiting.
  *
- * @param[in] pq             The product-queue.
- * @param[in] receptionTime  The time the data-product was inserted into the
- *                           product-queue.
- * @param[in] info           The data-product metadata.
+ * @param[in,out] lp  The lock.
+ * @retval        0   Success. The lock's mutex is locked.
+ * @return            <errno.h> error-code. `log_add()` called. The lock's mutex
+ *                    is unlocked.
  */
-static void
-pq2_set_mvrt(
-    pqueue* const restrict     pq,
-    timestampt* const restrict receptionTime,
-    prod_info* const restrict  info)
+static int
+rwl_wait(rwl* const lp)
 {
-    const timestampt*           creationTime = &info->arrival;
-    timestampt                  now;
-
-    /*
-     * If the product was received before it was created, then use the product's
-     * reception-time as its creation-time in the computation of the product's
-     * virtual residence-time.
-     */
-    if (TV_CMP_LT(*receptionTime, *creationTime))
-        creationTime = receptionTime;
+    const uint32_t seq = lp->seq;
+    int            status;
 
-    (void)set_timestamp(&now);
+    lp->nwaiters++;
+    (void)pthread_mutex_unlock(&lp->mutex);
+#ifdef HAVE_LINUX_FUTEX_H
+    {
+        const struct timespec timeout = {RWL_REAP_INTERVAL, 0};
+        (void)futex(&lp->seq, FUTEX_WAIT, seq, &timeout);
+    }
+#else
+    {
+        const struct timespec pause = {0, 1000000}; // 1 ms
+        (void)nanosleep(&pause, NULL);
+    }
+#endif
+    status = rwl_enter(lp);
+    if (status == 0 && lp->nwaiters > 0)
+        lp->nwaiters--;
 
-    /*
-     * Compute the product's residence time only if the product was
-     * created before now.
-     */
-    if (TV_CMP_LT(*creationTime, now)) {
-        timestampt      virtResTime = diff_timestamp(&now, creationTime);
+    return status;
+}
 
-        if (tvIsNone(pq->ctlp->minVirtResTime) ||
-                TV_CMP_LT(virtResTime, pq->ctlp->minVirtResTime)) {
-            log_info_q("pq_set_mvrt(): MVRT product: %s",
-                    s_prod_info(NULL, 0, info,
-                            log_is_enabled_debug));
-            pq->ctlp->minVirtResTime = virtResTime;
-            pq->ctlp->mvrtSize = pq->rlp->nbytes;
-            pq->ctlp->mvrtSlots = pq->rlp->nelems;
+/**
+ * Locks a robust control-region lock.
+ *
+ * @param[in,out] lp      The lock.
+ * @param[in]     write   Whether to lock for writing rather than reading.
+ * @param[in]     nowait  Whether to return rather than wait if the lock is
+ *                        unavailable.
+ * @retval        0       Success.
+ * @retval        EAGAIN  `nowait` is true and the lock is unavailable.
+ * @return                <errno.h> error-code. `log_add()` called.
+ */
+static int
+rwl_lock(
+        rwl* const lp,
+        const bool write,
+        const bool nowait)
+{
+    time_t reapTime = 0;
+    int    status = rwl_enter(lp);
+
+    while (status == 0) {
+        if (lp->writer == 0 && (write
+                ? lp->nreaders == 0
+                : lp->nreaders < RWL_MAXREADERS)) {
+            if (write) {
+                lp->writer = rwl_getPid();
+            }
+            else {
+                lp->readers[lp->nreaders++] = rwl_getPid();
+            }
+            (void)pthread_mutex_unlock(&lp->mutex);
+            break;
+        }
+        if (nowait) {
+            (void)pthread_mutex_unlock(&lp->mutex);
+            status = EAGAIN;
+            break;
+        }
+        if (reapTime == 0)
+            reapTime = time(NULL) + RWL_REAP_INTERVAL;
+        status = rwl_wait(lp);
+        if (status == 0 && time(NULL) >= reapTime) {
+            rwl_reap(lp);
+            reapTime = time(NULL) + RWL_REAP_INTERVAL;
         }
     }
+
+    return status;
 }
 
 /**
- * Deletes the oldest product in a product queue that is not locked.  In the
- * unlikely event that all the products in the queue are locked or a deadlock
- * is detected, returns an error status other than ENOERR.  Sets the "isFull",
- * "minVirtResTime", "mvrtSize", and "mvrtSlots" members of the product-queue
- * control block on success.
+ * Unlocks a robust control-region lock that's held by this process.
  *
- * @param[in] pq          Pointer to the product-queue object.  Shall not be
- *                        NULL.
- * @retval    0           Success.  "pq->ctlp->isFull" set to true.
- * @retval    EACESS      No unlocked products left to delete. Error-message
- *                        logged.
- * @retval    PQ_CORRUPT  The product-queue is corrupt. Error message logged.
- * @retval    PQ_SYSTEM   System error. Error-message logged.
+ * @param[in,out] lp  The lock.
+ * @retval        0   Success.
+ * @return            <errno.h> error-code. `log_add()` called.
  */
 static int
-pq2_del_oldest(
-    pqueue* const pq)
+rwl_unlock(rwl* const lp)
 {
-    int status = EACCES;
+    const pid_t pid = rwl_getPid();
+    int         status = rwl_enter(lp);
 
-    log_assert(pq != NULL);
-    log_assert(pq->ctlp != NULL && pq->tqp != NULL);
+    if (status == 0) {
+        if (lp->writer == pid) {
+            lp->writer = 0;
+        }
+        else {
+            unsigned i = 0;
 
-    /* Delete the oldest unlocked data-product. */
-    size_t  rlix;
-    for (tqelem* tqep = tqe_first(pq->tqp);
-            tqep && (rlix = rl_find(pq->rlp, tqep->offset)) != RL_NONE;
-            tqep = tq_next(pq->tqp, tqep)) {
-        prod_info  info;
-        timestampt insertionTime = tqep->tv;
-        status = pq2_try_del_prod(pq, tqep, rlix, &info);
-        if (status == 0) {
-            pq->ctlp->isFull = 1; // Mark the queue as full.
-            /* Adjust the minimum virtual residence time. */
-            pq2_set_mvrt(pq, &insertionTime, &info);
-            xdr_free(xdr_prod_info, (char*)&info);
-            return 0;
+            while (i < lp->nreaders && lp->readers[i] != pid)
+                i++;
+            if (i < lp->nreaders) {
+                lp->readers[i] = lp->readers[--lp->nreaders];
+            }
+            else {
+                log_warning_q("Control-region isn't locked by this process");
+            }
         }
-        if (status != EACCES)
-            return status;
+        lp->seq++;
+#ifdef HAVE_LINUX_FUTEX_H
+        /*
+         * A waiter that terminated can't decrement `nwaiters`; if no process
+         * was woken, then no process was waiting.
+         */
+        if (lp->nwaiters > 0 &&
+                futex(&lp->seq, FUTEX_WAKE, INT_MAX, NULL) == 0)
+            lp->nwaiters = 0;
+#endif
+        (void)pthread_mutex_unlock(&lp->mutex);
     }
 
-    log_error_q("no unlocked products left to delete!");
-
     return status;
+}
 
-#if 0
-    tqelem*             tqep = tqe_first(pq->tqp);
-    int                 status = ENOERR;
-    void*               vp = NULL;
-    region*             rep = NULL;
-    size_t              rlix;
-
-    rlix = rl_find(pq->rlp, tqep->offset);
-    log_assert(rlix != RL_NONE);
-    rep = pq->rlp->rp + rlix;
-    status = rgn_get(pq, rep->offset, Extent(rep), RGN_WRITE|RGN_NOWAIT, &vp);
-
-    while (status != ENOERR) {
-        /*
-         * The current data-product is locked.  Try the next one.
-         */
-        tqep = tq_next(pq->tqp, tqep);
-        rlix = rl_find(pq->rlp, tqep->offset);
-
-        if (rlix == RL_NONE) {
-            log_error_q("no unlocked products left to delete!");
-            break;
-        }
-
-        rep = pq->rlp->rp + rlix;
-        status =
-            rgn_get(pq, rep->offset, Extent(rep), RGN_WRITE|RGN_NOWAIT, &vp);
-    }
-
-    if (status == ENOERR) {
-        /*
-         * Got the data region.  Start releasing associated entries.
-         */
-        off_t           offset = rep->offset;
-        unsigned char*  signature;
-        InfoBuf         infoBuf;
-
-        /*
-         * Get the metadata of the data-product.
-         */
-        (void)xinfo_i(vp, Extent(rep), XDR_DECODE, ib_init(&infoBuf));
-
-        /*
-         * Set the minimum virtual residence time metrics if appropriate.
-         */
-        {
-            const timestampt*           creationTime = &infoBuf.info.arrival;
-            const timestampt* const     receptionTime = &tqep->tv;
-            timestampt                  now;
-
-            /*
-             * If the product was received before it was created, then use the
-             * product's reception-time as its creation-time in the computation
-             * of the product's virtual residence-time.
-             */
-            if ((TV_CMP_LT(*receptionTime, *creationTime))) {
-                creationTime = receptionTime;
-            }
-
-            (void)set_timestamp(&now);
-
-            /*
-             * Compute the product's residence time only if the product was
-             * created before now.
-             */
-            if (TV_CMP_LT(*creationTime, now)) {
-                timestampt      virtResTime =
-                    diff_timestamp(&now, creationTime);
-
-                if (tvIsNone(pq->ctlp->minVirtResTime) ||
-                        (TV_CMP_LT(virtResTime, pq->ctlp->minVirtResTime)))  {
-                    log_info_q("pq_del_oldest(): MVRT product: %s",
-                            s_prod_info(NULL, 0, &infoBuf.info, ulogIsDebug()));
-                    pq->ctlp->minVirtResTime = virtResTime;
-                    pq->ctlp->mvrtSize = pq->rlp->nbytes;
-                    pq->ctlp->mvrtSlots = pq->rlp->nelems;
-                }
-            }
-        }
-
-        /*
-         * Remove the corresponding entry from the time-list.
-         */
-        tq_delete(pq->tqp, tqep);
-
-        /*
-         * Remove the corresponding entry from the signature-list.
-         */
-        signature = infoBuf.info.signature;
-
-        if (sx_find_delete(pq->sxp, signature) == 0) {
-            log_error_q("signature %s: Not Found",
-                    s_signaturet(NULL, 0, signature));
-            status = EINVAL;
-        }
-
-        /*
-         * Remove the corresponding entry from the region-list.
-         */
-        rl_free(pq->rlp, rlix);
-
-        /*
-         * Release the data region.
-         */
-        (void) rgn_rel(pq, offset, 0);
-
-        /*
-         * Mark the queue as full.
-         */
-        pq->ctlp->isFull = 1;
-    }                                   /* got data region */
-
-    return status;
-#endif
-}
-
+#endif /* PQ_HAVE_RWL */
 
 /******************************************************************************
- * Lower-Level Reserved Product-Region Functions:
+ * Lower-Level Data-Product Data-Region Functions:
  ******************************************************************************/
 
-
-/*
- * Free a region, by offset
+/**
+ * Get a lock on (offset, extent). Adds to the lock statistics.
+ *
+ * @param[in] rflags  Region flags: bitwise OR of
+ *                    - RGN_NOLOCK  Don't lock region; locking handled elsewhere
+ *                    - RGN_WRITE   Region will be modified
+ *                    - RGN_NOWAIT  Return immediately if can't lock, else wait
+ * @param[out] locked When the lock was acquired according to `ls_acquired()`.
+ *                    Set only on success.
+ * @retval 0          Success
+ * @retval EACCES or EAGAIN
+ *                    The "cmd" argument is F_SETLK: the type of lock (l_type)
+ *                    is a shared (F_RDLCK) or exclusive (F_WRLCK) lock and the
+ *                    segment of a file to be locked is already exclusive-locked
+ *                    by another process, or the type is an exclusive lock and
+ *                    some portion of the segment of a file to be locked is
+ *                    already shared-locked or exclusive-locked by another
+ *                    process.
+ * @retval EBADF      The "fd" argument is not a valid open file descriptor, or
+ *                    the argument "cmd" is F_SETLK or F_SETLKW, the type of
+ *                    lock, l_type, is a shared lock (F_RDLCK), and "fd" is not
+ *                    a valid file descriptor open for reading, or the type of
+ *                    lock l_type, is an exclusive lock (F_WRLCK), and "fd" is
+ *                    not a valid file descriptor open for writing.
+ * @retval EINVAL     The "cmd" argument is invalid, or the "cmd" argument is
+ *                    F_GETLK, F_SETLK or F_SETLKW and "l_type", "offset",
+ *                    "l_whence", or "extent" is not valid, or "fd" refers to a
+ *                    file that does not support locking.
+ * @retval ENOLCK     The argument "cmd" is F_SETLK or F_SETLKW and satisfying
+ *                    the lock or unlock request would result in the number of
+ *                    locked regions in the system exceeding a system-imposed
+ *                    limit.
+ * @retval EOVERFLOW  The "cmd" argument is F_GETLK, F_SETLK or F_SETLKW and the
+ *                    smallest or, if "extent" is non-zero, the largest offset
+ *                    of any byte in the requested segment cannot be represented
+ *                    correctly in an object of type off_t.
+ * @retval EDEADLK    The "cmd" argument is F_SETLKW, the lock is blocked by
+ *                    some lock from another process and putting the calling
+ *                    process to sleep, waiting for that lock to become free
+ *                    would cause a deadlock.
  */
 static int
-rpqe_free(pqueue *pq, off_t offset, signaturet signature)
+rgn2_lock(pqueue *const pq,
+        const off_t offset,
+        const size_t extent,
+        const int rflags,
+        uint64_t *const locked)
 {
-        region *rp = NULL;
-        size_t rlix;
+        const pq_lock_kind kind = offset == 0 ? PQ_LOCK_CTL : PQ_LOCK_REGION;
+        uint64_t start;
+        int status;
 
-        rlix = rl_find(pq->rlp, offset);
-        if(rlix == RL_NONE)
+#ifndef NDEBUG
+        if(offset == pq->ixo && extent == pq->ixsz)
+                log_assert(fIsSet(rflags, RGN_NOLOCK));
+        else
+                log_assert(!fIsSet(rflags, RGN_NOLOCK));
+#endif
+
+        if(fIsSet(rflags, RGN_NOLOCK) || fIsSet(pq->pflags, PQ_NOLOCK))
         {
-                log_error_q("offset 0x%08lx: Not Found", (long)offset);
-                return EINVAL;
+                *locked = 0;
+                return ENOERR;
         }
-        rp = pq->rlp->rp + rlix;
-        if(IsFree(rp))
+
+        start = ls_start(pq);
+#ifdef PQ_HAVE_RWL
+        if(offset == 0 && pq->lockctlp != NULL)
         {
-                log_error_q("0x%08lx: Already free", (long)offset);
-                return EINVAL;
+                status = rwl_lock(&pq->lockctlp->lock,
+                                fIsSet(rflags, RGN_WRITE),
+                                fIsSet(rflags, RGN_NOWAIT));
         }
-
-        if(sx_find_delete(pq->sxp, signature) == 0)
+        else
+#endif
         {
-                log_error_q("signature %s: Not Found",
-                        s_signaturet(NULL, 0, signature));
-                return EINVAL;
+                int cmd = fIsSet(rflags, RGN_NOWAIT) ?  F_SETLK : F_SETLKW;
+                short l_type = fIsSet(rflags, RGN_WRITE) ? F_WRLCK : F_RDLCK;
+
+                status =  fd_lock(pq->fd, cmd, l_type,
+                                offset, SEEK_SET, extent);
+#if TRACE_LOCK
+        log_debug("%s (%ld, %lu)",
+                s_ltype(l_type),
+                (long)offset, (unsigned long)extent);
+#endif
         }
-        rl_free(pq->rlp, rlix);
 
-        return ENOERR;
+        if(status == ENOERR)
+                *locked = ls_acquired(pq, kind, fIsSet(rflags, RGN_WRITE),
+                                start);
+        else if(status == EAGAIN || status == EACCES)
+                ls_retried(pq, kind);
+
+        return status;
 }
 
 
 /**
- * Delete oldest elements until you have space for 'extent' Returns in *rixp the
- * region list index for a suitable region. Increments the number of regions in
- * use if successful.
+ * Release lock on (offset, extent) according to the RGN_* flags rflags. Adds
+ * to the lock statistics.
  *
- * @retval    0           Success.
- * @retval    ENOMEM      No data-products to delete.
- * @retval    EACESS      No unlocked products left to delete. Error-message
- *                        logged.
- * @retval    PQ_CORRUPT  The product-queue is corrupt. Error message logged.
- * @retval    PQ_SYSTEM   System error. Error-message logged.
+ * @param[in] rflags  Region flags: bitwise OR of
+ *                    - RGN_NOLOCK  Region wasn't locked
+ *                    - RGN_WRITE   Region was modified
+ *                    - RGN_NOWAIT  Ignored
+ * @param[in] locked  When the lock was acquired according to `rgn2_lock()`.
+ * @retval 0          Success.
+ * @retval EBADF      The product-queue's file descriptor is invalid.
+ * @retval EINVAL     The region is not valid.
+ * @retval EOVERFLOW  The region is too large.
  */
 static int
-rpqe_mkspace(pqueue *const pq, size_t const extent, size_t *rixp)
+rgn2_unlock(
+        pqueue *const pq,
+        const off_t offset,
+        const size_t extent,
+        const int rflags,
+        const uint64_t locked)
 {
-        size_t rlix;
-
-        log_debug("%s:rpqe_mkspace(): Deleting oldest to make space for %ld bytes",
-                __FILE__, (long)extent);
-
-        do {
-                if(pq->rlp->nelems == 0)
-                        return ENOMEM;
-
-                int status = pq2_del_oldest(pq);
-
-                if(status != ENOERR)
-                        return status;
-
-                rlix = rl_get(pq->rlp, extent);
-        } while (rlix == RL_NONE) ;
-
-        *rixp = rlix;
+#ifndef NDEBUG
+        if(offset == pq->ixo && extent == pq->ixsz)
+                log_assert(fIsSet(rflags, RGN_NOLOCK));
+#endif
 
-        return ENOERR;
+        if(fIsSet(rflags, RGN_NOLOCK) || fIsSet(pq->pflags, PQ_NOLOCK))
+                return ENOERR;
+        ls_released(pq, offset == 0 ? PQ_LOCK_CTL : PQ_LOCK_REGION, locked);
+#ifdef PQ_HAVE_RWL
+        if(offset == 0 && pq->lockctlp != NULL)
+                return rwl_unlock(&pq->lockctlp->lock);
+#endif
+        /* else */
+#if TRACE_LOCK
+        log_debug("F_UNLCK (%ld, %lu)",
+                (long)offset, (unsigned long)extent);
+#endif
+        return fd_lock(pq->fd, F_SETLK, F_UNLCK,
+                        offset, SEEK_SET, extent);
 }
 
 /**
- * Delete oldest elements until a consolidation has occurred, making
- * an rl element available.  If this gets called much, you didn't
- * allocate enough product slots or a big enough queue.
+ * Reserves a region in a product-queue for reading or writing.
+ * - Locks the region in the product-queue file
+ * - Adds the region to the list of regions-in-use
  *
- * @retval    0           Success.
- * @retval    ENOMEM      No data-products to delete.
- * @retval    EACESS      No unlocked products left to delete. Error-message
- *                        logged.
- * @retval    PQ_CORRUPT  The product-queue is corrupt. Error message logged.
- * @retval    PQ_SYSTEM   System error. Error-message logged.
+ * @param[in,out] pq       Product queue
+ * @param[in]     offset   Offset to region in bytes
+ * @param[in]     extent   Extent of region in bytes
+ * @param[in]     rflags   Region flags. Bitwise OR of
+ *                         - RGN_NOLOCK  Don't lock region; locking handled
+ *                                       elsewhere
+ *                         - RGN_WRITE   Region will be modified
+ *                         - RGN_NOWAIT  Return immediately if can't lock, else
+ *                                       wait
+ * @param[in]     vp       Data area of region
+ * @param[out]    rpp      Region in use entry
+ * @retval        0        Success
+ * @retval        EACCES   Region already reserved. `log_add()` *not* called.
+ * @retval        EDEADLK  Deadlock condition detected. `log_add()` called.
+ * @retval        ENOLCK   Number of file-locks would exceed system limit.
+ *                         `log_add()` called.
+ * @retval        ENOMEM   Insufficient memory available. `log_add()` called.
+ * @see `rgn2_release()`
  */
 static int
-rpqe_mkslot(pqueue *const pq)
+rgn2_reserve(
+        pqueue* const restrict pq,
+        const off_t            offset,
+        const size_t           extent,
+        const int              rflags,
+        void* const restrict   vp,
+        riu** const restrict   rpp)
 {
-        /* LOG_NOTICE("Deleting oldest to get a queue slot"); */
+    int status;
 
-        do {
-                if(pq->rlp->nelems == 0)
-                        return ENOMEM;
+    if (riul_find(pq->riulp, offset)) {
+        status = EACCES;
+    }
+    else {
+        uint64_t locked;
 
-                int status = pq2_del_oldest(pq);
+        status = rgn2_lock(pq, offset, extent, rflags, &locked);
 
-                if(status != ENOERR)
-                        return status;
+        if (status != EACCES) {
+            if (status == EAGAIN) {
+                status = EACCES;
+            }
+            else if (status) {
+                log_add_errno(status, "rgn_lock() failure");
+            }
+            else {
+                status = riul_add(&pq->riulp, pq->pagesz, offset, extent, vp,
+                        rflags, rpp);
 
-        } while (!rl_HasSpace(pq->rlp)) ;
+                if (status) {
+                    log_add_errno(status, "riul_add() failure");
+                    (void)rgn2_unlock(pq, offset, extent,
+                            fMask(rflags, RGN_MODIFIED|RGN_NOWAIT), locked);
+                }
+                else {
+                    (*rpp)->locked = locked;
+                }
+            } // Region in file locked
+        } // Locking region didn't return `EACCES`
+    } // Region not in list of regions-in-use
 
-        return ENOERR;
+    return status;
 }
 
-
 /**
- * Allocate a new region for a data-product from the data section (which may
- * eventually get handed to the user). Delete products in the queue, as
- * necessary, in order to make room. If successful, then
- * - A new region is added to the regions-in-use list;
- * - The number of regions in use is incremented;
- * - The number of bytes in use is incremented;
- * - The maximum number of regions in use is updated;
- * - The maximum number of bytes in use is updated;
- * - The data portion of the region is locked.
+ * Releases a region in a product-queue that was previously reserved by
+ *   - Deleting the relevant entry in the list of regions-in-use
+ *   - Unlocking the relevant section of the product-queue file
  *
- * @param[in]  pq      The product-queue.
- * @param[in]  extent  The size of the product in bytes.
- * @param[in]  sxi     The signature of the product.
- * @param[out] vpp     Pointer to the start of the data region.
- * @param[out] sxepp   Pointer to the existing signature entry if the product
- *                     already exists in the product-queue.
- * @retval PQ_DUP      A product with the same signature already exists in the
- *                     product-queue.
- * @retval PQ_CORRUPT  The product-queue is corrupt. Error message logged.
- * @retval PQ_SYSTEM   System error. Error-message logged.
- * @retval ENOMEM      Insufficient memory is available.
- * @retval ENOMEM      There is insufficient room in the address space to effect
- *                     the necessary mapping.
- * @retval EACESS      No unlocked products left to delete.
- * @retval EAGAIN      A mapping could not be locked in memory, if required by
- *                     mlockall(), due to a lack of resources.
- * @retval EDEADLK     The region's lock is blocked by some lock from another
- *                     process and putting the calling process to sleep, waiting
- *                     for that lock to become free would cause a deadlock.
- * @retval EFBIG or EINVAL
- *                     The `extent` argument was greater than the maximum file
- *                     size.
- * @retval EINTR       A signal was caught during execution.
- * @retval EINVAL      `extent` is not valid, or "pq->fd" refers to a file
- *                     that does not support locking.
- * @retval EIO         An I/O error occurred while reading from the file system.
- * @retval EMFILE      The number of mapped regions would exceed an
- *                     implementation-dependent limit (per process or per
- *                     system).
- * @retval ENODEV      `pq->fd` refers to a file whose type is not supported by
- *                     `mmap()`.
- * @retval ENOLCK      Satisfying the request would result in the number of
- *                     locked regions in the system exceeding a system-imposed
- *                     limit.
+ * @param[in,out] pq      Product queue
+ * @param[in]     offset  Offset to region in bytes
+ * @param[in]     rflags  Region flags. Bitwise OR of
+ *                         - RGN_NOLOCK     Don't lock region; locking handled
+ *                                          elsewhere
+ *                         - RGN_MODIFIED   Region was modified
+ * @retval        0       Success
+ * @retval        EINVAL  Region with given offset isn't in use
+ * @see `region_reserve()`
  */
 static int
-rpqe_new(pqueue *pq, size_t extent, const signaturet sxi,
-        void **vpp, sxelem **sxepp)
+rgn2_release(
+        pqueue* const pq,
+        const off_t   offset,
+        int const     rflags)
 {
-    int           status = ENOERR;
-    size_t        rlix;            /* region list index */
-    region*       hit = NULL;
-    static size_t smallest_extent_seen = UINT_MAX;
-
-    /*
-     * Check for duplicate
-     */
-    // log_debug_1("Checking for duplicate");
-    if (sxi && sx_find(pq->sxp, sxi, sxepp) != 0) {
-        log_debug("PQ_DUP");
-        return PQ_DUP;
-    }
-
-    /* We may need to split what we find */
-    if (!rl_HasSpace(pq->rlp)) {
-        /* get one slot */
-        // log_debug_1("Making a slot");
-        status = rpqe_mkslot(pq);
-        if (status != ENOERR)
-            return status;
-    }
-
-    extent = _RNDUP(extent, pq->ctlp->align);
-    if (extent < smallest_extent_seen)
-        smallest_extent_seen = extent;
+    int  status;
+    riu* rp;
 
-    // log_debug_1("Getting a region");
-    rlix = rl_get(pq->rlp, extent);
-    if (rlix == RL_NONE) {
-        status = rpqe_mkspace(pq, extent, &rlix);
-        if (status != ENOERR)
-            return status;
-    }
-    hit = pq->rlp->rp + rlix;
-    log_assert(IsFree(hit));
-    #define PQ_FRAGMENT_HEURISTIC 64
-    /* Don't bother to split off tiny fragments too small for any
-       product we've seen */
-    if (extent + smallest_extent_seen + PQ_FRAGMENT_HEURISTIC < hit->extent) {
-        // log_debug_1("Splitting region");
-        status = rl_split(pq->rlp, rlix, extent);
-        if (status != ENOERR)
-            goto rl_split_failure;
+    if (riul_r_find(pq->riulp, offset, &rp) == 0) {
+        log_error_q("Region with offset %ld is not in use", (long)offset);
+        status = EINVAL;
     }
+    else {
+        log_assert(rp->offset == offset);
+        log_assert(0 < rp->extent && rp->extent < TOTAL_SIZE(pq));
 
-    log_assert((hit->offset % pq->ctlp->align) == 0);
-    set_IsAlloc(hit);
-    // log_debug_1("Adding region hash");
-    rlhash_add(pq->rlp, rlix);
+        size_t   extent = rp->extent;
+        uint64_t locked = rp->locked;
 
-    // log_debug_1("Getting region");
-    status = rgn_get(pq, hit->offset, Extent(hit), RGN_WRITE, vpp);
-    if (status != ENOERR)
-        goto rgn_get_failure;
+        log_assert(pq->base == NULL || (rp->vp != NULL
+                 && pq->base <= rp->vp
+                && (char *)rp->vp <= (char *)pq->base + pq->ixo));
+        log_assert(pIf(fIsSet(rflags, RGN_MODIFIED),
+                        fIsSet(rp->rflags, RGN_WRITE)));
+        log_assert(fIsSet(rflags, RGN_NOLOCK) ==
+                        fIsSet(rp->rflags, RGN_NOLOCK));
 
-    if (sxi) {
-        // log_debug_1("Adding signature");
-        sxelem* const sxelem = sx_add(pq->sxp, sxi, hit->offset);
-        if (sxelem == NULL) {
-            log_error_q("sx_add() failure");
-            status = ENOMEM;
-            goto sx_add_failure;
-        }
-        *sxepp = sxelem;
+        riul_delete(pq->riulp, rp);
+        status = rgn2_unlock(pq, offset, extent, rflags, locked);
     }
 
-    /* Update stats */
-    off_t         highwater = hit->offset + (off_t)Extent(hit) -
-            pq->ctlp->datao;
-    if (highwater > pq->ctlp->highwater)
-        pq->ctlp->highwater = highwater;
-    if (pq->rlp->nelems >  pq->ctlp->maxproducts)
-        pq->ctlp->maxproducts = pq->rlp->nelems;
-    pq->rlp->nbytes += (off_t)Extent(hit);
-    if (pq->rlp->nbytes > pq->rlp->maxbytes)
-        pq->rlp->maxbytes = pq->rlp->nbytes;
-
     return status;
-
-    sx_add_failure:
-        // log_debug_1("Releasing region");
-        (void)rgn_rel(pq, hit->offset, 0); // region's data portion unmodified
-    rgn_get_failure:
-        // log_debug_1("Deleting region hash");
-        rlhash_del(pq->rlp, rlix);
-        clear_IsAlloc(hit);
-    rl_split_failure:
-        // log_debug_1("Unsplitting region");
-        rl_put(pq->rlp, rlix); // undoes `rl_get()` and `rpqe_mkspace()`
-        return status;
 }
 
-
 /******************************************************************************
- * Control-Header Functions:
+ * Memory <-> File Synchronization Functions:
  ******************************************************************************/
 
-/*
- * The 'ctl_xxx' functions deal with pqctl pq->ctlp AND
- * the indexes pq->rlp, pq->tqp, pq->sxp, pq->fbp via ixXXX.
- * Accesses to these areas operate on a single lock, the lock
- * on (0, pgsz), ctlp.
- */
-
 /**
- * Release the ctl lock and write back any changes.
+ * Synchronizes a region in the product-queue file to memory using `lseek(2)`,
+ * `malloc(3)`, and `read(2)`. Locks the file-region.
  *
- * @retval EINVAL     The region could not be found in the list of in-use
- *                    regions.
- * @retval EBADF      The product-queue's file descriptor is invalid.
- * @retval EOVERFLOW  The (offset + extent) specification of the region is
- *                    invalid.
- */
-static int
-ctl_rel(pqueue *const pq, const int rflags)
-{
-        int status = ENOERR;
-
-        log_assert(pq->ctlp != NULL);
-        log_assert(pq->ixp != NULL);
-
-        if(pq->ixp != NULL)
-        {
-                status = (pq->mtof)(pq, pq->ixo, rflags|RGN_NOLOCK);
-                if(status != ENOERR)
-                        log_error_q("mtof ix: %s", strerror(status));
-                pq->ixp = NULL;
-                pq->rlp = NULL;
-                pq->tqp = NULL;
-                pq->sxp = NULL;
-                pq->fbp = NULL;
-        }
-        
-        if(pq->ctlp != NULL)
-        {
-                status = (pq->mtof)(pq, 0, rflags);
-                if(status != ENOERR)
-                        log_error_q("mtof ctl: %s", strerror(status));
-                pq->ctlp = NULL;
-        }
-
-        if(fIsSet(pq->pflags, PQ_SIGSBLOCKED))
-        {
-                /* something was set, end critical section */
-                sigset_t sav_set = pq->sav_set;
-
-                (void)sigemptyset(&pq->sav_set);
-                fClr(pq->pflags, PQ_SIGSBLOCKED);
-
-                (void) pthread_sigmask(SIG_SETMASK, &sav_set, NULL);
-        }
-
-        return status;
-}
-
-
-/*
- * Initialize the on disk state (ctl and indexes) of a
- * new queue file. Called by pq_create().
+ * @param[in,out] pqueue  Product queue
+ * @param[in]     offset  Offset to file region in bytes
+ * @param[in]     extent  Extent of region in bytes
+ * @param[in]     rflags  Region flags. Bitwise OR of
+ *                        - RGN_NOLOCK  Don't lock region; locking handled
+ *                                      elsewhere
+ *                        - RGN_WRITE   Region will be modified
+ *                        - RGN_NOWAIT  Return immediately if can't lock, else
+ *                                      wait
+ * @param[out]    ptrp    Location of region in memory
+ * @retval        0       Success
+ * @retval        EACCES  Region already reserved. `log_add()` *not* called.
+ * @retval        EDEADLK Deadlock condition detected. `log_add()` called.
+ * @retval        ENOLCK  Number of file-locks would exceed system limit.
+ *                        `log_add()` called.
+ * @retval        ENOMEM  Insufficient memory available. `log_add()` called.
+ * @retval        EIO     An I/O error occurred while accessing the file system.
+ *                        `log_add()` called.
+ * @retval        EINTR   A signal was caught during execution. `log_add()`
+ *                        called.
+ * @see `f_mtof()`
  */
 static int
-ctl_init(pqueue *const pq, size_t const align)
+f_ftom(
+        pqueue *const pq,
+        const off_t   offset,
+        const size_t  extent,
+        const int     rflags,
+        void **const  ptrp)
 {
-        int status = ENOERR;
-        void *vp = NULL;
-        size_t nalloc;
-
-        log_assert(pq != NULL);
-        log_assert(pq->pagesz != 0);
-        log_assert(pq->datao > 0);
-        log_assert(pq->datao % pq->pagesz == 0);
-        log_assert(pq->ixo > pq->datao);
-        log_assert(pq->ixo % pq->pagesz == 0);
-        log_assert(pq->ixsz >= pq->pagesz);
-        log_assert(pq->ixsz % pq->pagesz == 0);
-        log_assert(align != 0);
+    log_assert(pq != NULL);
+    log_assert(pq->datao > 0);
+    log_assert(pq->datao % pq->pagesz == 0);
+    log_assert(pq->ixo >= pq->datao);
+    log_assert(pq->ixo % pq->pagesz == 0);
+    log_assert(pq->ixsz >= pq->pagesz);
+    log_assert(pq->ixsz % pq->pagesz == 0);
 
-        /*
-         * The following isn't a critical section that's protected by
-         * `pthread_sigmask(SIG_BLOCK,...)` because any error (including EINTR)
-         * unlinks the created file.
-         */
+    log_assert(0 <= offset && offset <= pq->ixo);
+    log_assert(0 != extent && extent < TOTAL_SIZE(pq));
 
-        /*
-         * bring in the pqctl
-         * N.B. No wait. Another lock implies create collision, error
-         */
-        status = (pq->ftom)(pq,
-                         0, (size_t)pq->datao, RGN_WRITE|RGN_NOWAIT, &vp);
-#ifdef HAVE_MMAP
-        if(status == EIO && (pq->ftom == mm_ftom || pq->ftom == mm0_ftom))
-        {
-                log_notice_q("EIO => remote file system");
-                /* try again */
-                pq->ftom = f_ftom;
-                pq->mtof = f_mtof;
-                status = (pq->ftom)(pq,
-                        0, (size_t)pq->datao, RGN_WRITE|RGN_NOWAIT, &vp);
-        }
-#endif
-        if(status != ENOERR)
-                return status;
+    log_assert(pIf(fIsSet(rflags, RGN_WRITE),
+                !fIsSet(pq->pflags, PQ_READONLY)));
 
-        pq->ctlp = (pqctl *)vp;
-        pq->ctlp->magic = PQ_MAGIC;
-        pq->ctlp->version = PQ_VERSION;
-        pq->ctlp->write_count_magic = WRITE_COUNT_MAGIC;
-        pq->ctlp->write_count = 1;              /* this process is writer */
-        pq->ctlp->datao = pq->datao;
-        pq->ctlp->ixo = pq->ixo;
-        pq->ctlp->ixsz = pq->ixsz;
-        pq->ctlp->nalloc = pq->nalloc;
-        pq->ctlp->highwater = 0;
-        pq->ctlp->maxproducts = 0;
-        pq->ctlp->align = align;
-        pq->ctlp->metrics_magic = METRICS_MAGIC;
-        pq->ctlp->mostRecent = TS_NONE;
-        pq->ctlp->minVirtResTime = TS_NONE;
-        pq->ctlp->isFull = 0;
-        pq->ctlp->metrics_magic_2 = METRICS_MAGIC_2;
-        pq->ctlp->mvrtSize = -1;
-        pq->ctlp->mvrtSlots = 0;
+    void* vp = NULL;
+    riu*  rp;
+    int   status = rgn2_reserve(pq, offset, extent, rflags, vp, &rp);
 
-        /* bring in the indexes */
-        status = (pq->ftom)(pq,
-                         pq->ixo, pq->ixsz, RGN_WRITE|RGN_NOLOCK, &pq->ixp);
-        if(status != ENOERR)
-        {
-                (void)(pq->mtof)(pq, 0, 0);
-                return status;
+    if (status != EACCES) {
+        if (status) {
+            log_add("Couldn't reserve %lu bytes starting at offset %ld",
+                    (unsigned long)extent, (long)offset);
         }
+        else {
+            vp = malloc(extent);
 
-        (void)ix_ptrs(pq->ixp, pq->ixsz, pq->nalloc, align, &pq->rlp, &pq->tqp, &pq->fbp, &pq->sxp);
-        nalloc = pq->nalloc;    /* ix_ptrs computed this in version 3 */
-
-        /* initialize fb for skip list blocks */
-        fb_init(pq->fbp, nalloc);
+            if (vp == NULL) {
+                log_add_syserr("Couldn't malloc() %lu bytes",
+                        (unsigned long)extent);
+                status = errno;
+            }
+            else {
+                rp->vp = vp; // Set region-in-use pointer; was `NULL`
 
-        /* initialize tqueue */
-        tq_init(pq->tqp, nalloc, pq->fbp);
+                (void)memset(vp, 0, extent);
 
-        /* initialize regionl, adding one huge region for data */
-        rl_init(pq->rlp, nalloc, pq->fbp);
-        {
-                off_t  datasz = pq->ixo - pq->datao;
+                ssize_t nread = pread(pq->fd, vp, extent, offset);
 
-                if (~(size_t)0 < datasz) {
-                    log_error_q("Data portion of file is too big for one region");
-                    return EFBIG;
+                if (nread == -1) {
+                    log_add_syserr("Couldn't read %lu bytes from "
+                            "product-queue starting at offset %ld",
+                            (unsigned long)extent, (long)offset);
+                    status = errno;
                 }
-                {
-                    size_t extent0 = (size_t)datasz;
-                    region *rp = rl_add(pq->rlp, pq->datao, extent0);
-
-                    pq->rlp->maxfextent = extent0;
-                    log_assert(rp != NULL
-                            && rp->offset == pq->datao
-                            && rp->extent == extent0);
+                else if (nread && nread != extent) {
+                    log_add("Read %ld bytes from product-queue at offset %ld; "
+                            "expected to read %lu", (long)nread, (long)offset,
+                            (unsigned long)extent);
+                    status = EIO;
+                }
+                else {
+                    // Requested number of bytes read or none at all.
+                    // It's okay to read zero bytes because of pq_create(3)
+                    *ptrp = vp;
                 }
-        }
 
-        sx_init(pq->sxp, nalloc);
-        
-        return status;
+                if (status)
+                    free(vp);
+            } // Memory successfully `malloc()`ed
+
+            if (status)
+                (void)rgn2_release(pq, offset, rflags);
+        } // Region successfully reserved
+    } // Region not found in list of regions-in-use
+
+    return status;
 }
 
-/*
- * Sets the functions to be used to access the product-queue.
+/**
+ * Synchronizes memory to a region of a product-queue file using `write(2)`, and
+ * `free(3)` for a region in use. Unlocks the file-region in question.
  *
- * Arguments:
- *      pq      Pointer to product-queue structure.  The following members
- *              must be set to their final values: pflags, ixo, ixsz.
+ * @param[in,out] pq      Product queue
+ * @param[in]     offset  Offset to region in file in bytes
+ * @param[in]     rflags  Region flags. Bitwise inclusive OR of
+ *                        - RGN_NOLOCK     Don't lock region; locking handled
+ *                                         elsewhere
+ *                        - RGN_MODIFIED   Region was modified
+ * @retval        0       Success
+ * @retval        EBADF   Product-queue isn't open for writing. `log_add()`
+ *                        called.
+ * @retval        EINVAL  Region with given offset isn't in use. `log_add()`
+ *                        called.
+ * @retval        EIO     I/O error. `log_add()` called.
+ * @see `mm_ftom()`
  */
-static void
-ctl_setAccessFunctions(
-    pqueue* const       pq)
+static int
+f_mtof( pqueue *const pq,
+        off_t const offset,
+        int const rflags)
 {
-    const int           pflags = pq->pflags;
+    log_assert(pq != NULL); /* would have core dumped already initializing */
+    log_assert(pq->datao > 0);
+    log_assert(pq->datao % pq->pagesz == 0);
+    log_assert(pq->ixo >= pq->datao);
+    log_assert(pq->ixo % pq->pagesz == 0);
+    log_assert(pq->ixsz >= pq->pagesz);
+    log_assert(pq->ixsz % pq->pagesz == 0);
 
-    log_assert(NULL != pq);
+    log_assert(pIf(fIsSet(rflags, RGN_MODIFIED),
+                    !fIsSet(pq->pflags, PQ_READONLY)));
 
-#ifdef HAVE_MMAP
-    if (fIsSet(pflags, PQ_NOMAP)) {
-#endif
-        /*
-         * The product-queue will be accessed via read() and write().
-         */
-        pq->ftom = f_ftom;
-        pq->mtof = f_mtof;
-#ifdef HAVE_MMAP
+    int  status;
+    riu* rp;
+
+    if (riul_r_find(pq->riulp, offset, &rp) == 0) {
+        log_add("Region with offset %ld isn't in use", (long)offset);
+        status = EINVAL;
     }
     else {
-        if (fIsSet(pflags, PQ_MAPRGNS) || isProductMappingNecessary(pq)) {
-            /*
-             * The product-queue will be accessed by being memory-mapped
-             * on a region-by-region basis.
-             */
-            pq->ftom = mm_ftom;
-            pq->mtof = mm_mtof;
+        log_assert(rp->vp != NULL);
+
+        size_t extent = rp->extent;
+        void*  vp = rp->vp;
+
+        if (!fIsSet(rflags, RGN_MODIFIED)) {
+            status = 0;
+        }
+        else {
+            log_assert(!fIsSet(pq->pflags, PQ_READONLY));
+
+            ssize_t nwrote = pwrite(pq->fd, vp, extent, offset);
+
+            if (nwrote == -1) {
+                log_add_syserr("Couldn't write %lu bytes to product-queue "
+                        "starting at offset %ld", (unsigned long)extent,
+                        (long)offset);
+                status = errno;
+            }
+            else if (nwrote != extent) {
+                log_add("Wrote %ld bytes to product-queue at offset %ld; "
+                        "expected to write %lu", nwrote, (long)offset,
+                        (unsigned long)extent);
+                status = EIO;
+            }
+            else {
+                status = 0;
+            }
+        }
+
+        (void)rgn2_release(pq, offset, rflags);
+        free(vp);
+    } // Region found in list of regions-in-use
+
+    return status;
+}
+
+
+#ifdef HAVE_MMAP
+/**
+ * Synchronizes a region of the product-queue file to memory using `mmap(2)`.
+ * Locks the file-region in question.
+ *
+ * @param[in,out] pqueue  Product queue
+ * @param[in]     offset  Offset to region in bytes
+ * @param[in]     extent  Extent of region in bytes
+ * @param[in]     rflags  Region flags. Bitwise OR of
+ *                        - RGN_NOLOCK  Don't lock region; locking handled
+ *                                      elsewhere
+ *                        - RGN_WRITE   Region will be modified
+ *                        - RGN_NOWAIT  Return immediately if can't lock, else
+ *                                      wait
+ * @param[out]    ptrp    Location of mapped region in memory
+ * @retval        0       Success
+ * @retval        EACCES  Region already reserved. `log_add()` *not* called.
+ * @retval        EDEADLK Deadlock condition detected. `log_add()` called.
+ * @retval        ENOLCK  Number of file-locks would exceed system limit.
+ *                        `log_add()`
+ *                        called.
+ * @retval        ENOMEM  Insufficient memory available. `log_add()` called.
+ * @retval        EIO     An I/O error occurred while accessing the file system.
+ *                        `log_add()` called.
+ * @retval        EINTR   A signal was caught during execution. `log_add()`
+ *                        called.
+ * @retval        EMFILE  The number of mapped regions would exceed an
+ *                        implementation-dependent limit (per process or per
+ *                        system). `log_add()` called.
+ * @see `mm_mtof()`
+ */
+static int
+mm_ftom(pqueue* const pq,
+        const off_t   offset,
+        const size_t  extent,
+        const int     rflags,
+        void** const  ptrp)
+{
+    int    mflags = fIsSet(pq->pflags, PQ_PRIVATE) ? MAP_PRIVATE : MAP_SHARED;
+    int    prot = (fIsSet(pq->pflags, PQ_READONLY) && !fIsSet(rflags, RGN_WRITE))
+            ? PROT_READ
+            : (PROT_READ|PROT_WRITE);
+    size_t rem = offset % pq->pagesz;
+    size_t pagext = _RNDUP(rem + extent, pq->pagesz);
+
+    log_assert(pq != NULL); /* would have core dumped already initializing */
+    log_assert(pq->datao > 0);
+    log_assert(pq->datao % pq->pagesz == 0);
+    log_assert(pq->ixo >= pq->datao);
+    log_assert(pq->ixo % pq->pagesz == 0);
+    log_assert(pq->ixsz >= pq->pagesz);
+    log_assert(pq->ixsz % pq->pagesz == 0);
+
+    log_assert(0 <= offset && offset <= pq->ixo);
+    log_assert(0 != extent && extent < TOTAL_SIZE(pq));
+
+    log_assert(pIf(fIsSet(rflags, RGN_WRITE),
+                    !fIsSet(pq->pflags, PQ_READONLY)));
+
+    void* vp = NULL;
+    riu*  rp;
+    int   status = rgn2_reserve(pq, offset, extent, rflags, vp, &rp);
+
+    if (status != EACCES) {
+        if (status) {
+            log_add("rgn2_reserve() failure");
+        }
+        else {
+            if (fIsSet(prot, PROT_WRITE)) {
+                status = fgrow(pq->fd, offset+extent,
+                        fIsSet(pq->pflags, PQ_SPARSE));
+                if (status)
+                    log_add_errno(status, "fgrow() failure");
+            }
+
+            if (status == 0) {
+                off_t  pageo = offset - rem;
+
+                log_assert(pageo % pq->pagesz == 0);
+                log_assert(pagext % pq->pagesz == 0);
+
+                status = mapwrap(pq->fd, pageo, pagext, prot, mflags, &vp);
+
+                if (status == 0) {
+                    vp = (char*)vp + rem;
+                    rp->vp = vp; // Set region-in-use pointer. Was `NULL`.
+                    *ptrp = vp;
+                } // Region was successfully memory-mapped
+            } // Region in file was successfully extended if necessary
+
+            if (status)
+                (void)rgn2_release(pq, offset, rflags);
+        } // Region was successfully reserved
+    } // Locking file didn't return `EACCES`
+
+    return status;
+}
+
+/**
+ * Synchronizes memory to a region of the file using `mmap(2)` for a region in
+ * use. Unlocks the file-region in question.
+ *
+ * @param[in,out] pq      Product queue
+ * @param[in]     offset  Offset to region in file in bytes
+ * @param[in]     rflags  Region flags. Bitwise inclusive OR of
+ *                        - RGN_NOLOCK     Don't lock region; locking handled
+ *                                         elsewhere
+ *                        - RGN_MODIFIED   Region was modified
+ * @retval        0       Success
+ * @retval        EINVAL  Region with given offset isn't in use
+ * @see `mm_ftom()`
+ */
+static int
+mm_mtof(pqueue *const pq,
+        off_t const   offset,
+        int const     rflags)
+{
+    int status;
+
+    log_assert(pq != NULL); /* would have core dumped already initializing */
+    log_assert(pq->datao > 0);
+    log_assert(pq->datao % pq->pagesz == 0);
+    log_assert(pq->ixo >= pq->datao);
+    log_assert(pq->ixo % pq->pagesz == 0);
+    log_assert(pq->ixsz >= pq->pagesz);
+    log_assert(pq->ixsz % pq->pagesz == 0);
+
+    log_assert(pIf(fIsSet(rflags, RGN_MODIFIED),
+                    !fIsSet(pq->pflags, PQ_READONLY)));
+
+    riu *rp = NULL;
+    if (riul_r_find(pq->riulp, offset, &rp) == 0) {
+        log_add("Region with offset %ld is not in use", (long)offset);
+        status = EINVAL;
+    }
+    else {
+        log_assert(rp->vp != NULL);
+
+        int    mflags = 0; /* TODO: translate rflags to mflags */
+        off_t  rem = offset % (off_t)pq->pagesz;
+        size_t extent = rp->extent;
+        void*  vp = rp->vp;
+
+        if (rem == 0) {
+            status =  unmapwrap(vp, offset, extent, mflags);
+        }
+        else {
+            off_t pageno = offset / (off_t)pq->pagesz;
+            size_t pagext = _RNDUP(rem + extent, (off_t)pq->pagesz);
+            vp = (char *)vp - rem;
+            status = unmapwrap(vp, pageno*(off_t)pq->pagesz, pagext, mflags);
+        }
+
+        if (status) {
+            log_add_errno(status, "unmapwrap() failure");
+        }
+        else {
+            status = rgn2_release(pq, offset, rflags);
+            if (status)
+                log_add_errno(status, "rgn2_release() failure");
+        }
+    } // Region found in regions-in-use list
+
+    return status;
+}
+
+/*
+ * Process-wide defaults for memory-mapping entire product-queues (see
+ * pq_setMapDefaults()).
+ */
+#define MAP_MAXNODES    1024
+static int     mapFlags = 0;
+static int     mapNode = -1;
+
+/**
+ * Tunes the memory-mapping of an entire product-queue according to its flags
+ * and the process-wide defaults: advises the use of transparent huge pages,
+ * binds the mapping to a NUMA node, and pre-faults its pages, in that order so
+ * that the pre-faulted pages are huge and on the node. Failures are logged as
+ * warnings because the mapping is usable regardless.
+ *
+ * @param[in] pq    The product-queue.
+ * @param[in] base  Start of the mapping.
+ * @param[in] len   Length of the mapping in bytes.
+ */
+static void
+mm0_tune(
+        const pqueue* const pq,
+        void* const         base,
+        const size_t        len)
+{
+    const int flags = pq->pflags | mapFlags;
+
+    if (fIsSet(flags, PQ_HUGEPAGES)) {
+#ifdef MADV_HUGEPAGE
+        if (madvise(base, len, MADV_HUGEPAGE)) {
+            log_add_syserr("Couldn't use huge pages for product-queue \"%s\"",
+                    pq->pathname);
+            log_flush_warning();
+        }
+#else
+        log_warning_q("Huge pages aren't supported");
+#endif
+    }
+
+    if (mapNode >= 0) {
+#if defined(HAVE_LINUX_MEMPOLICY_H) && defined(SYS_mbind)
+        const size_t  nbits = CHAR_BIT*sizeof(unsigned long);
+        unsigned long mask[MAP_MAXNODES/(CHAR_BIT*sizeof(unsigned long))];
+
+        (void)memset(mask, 0, sizeof(mask));
+        mask[mapNode/nbits] = 1UL << (mapNode % nbits);
+        if (syscall(SYS_mbind, base, len, MPOL_BIND, mask, MAP_MAXNODES + 1,
+                MPOL_MF_MOVE)) {
+            log_add_syserr("Couldn't bind product-queue \"%s\" to NUMA node "
+                    "%d", pq->pathname, mapNode);
+            log_flush_warning();
+        }
+#else
+        log_warning_q("NUMA binding isn't supported");
+#endif
+    }
+
+    if (fIsSet(flags, PQ_POPULATE)) {
+        struct timeval start, stop;
+        int            status = EINVAL;
+
+        (void)gettimeofday(&start, NULL);
+#if defined(MADV_POPULATE_READ) && defined(MADV_POPULATE_WRITE)
+        /* Pre-faulting writable pages also allocates a sparse file's blocks */
+        status = madvise(base, len, fIsSet(pq->pflags, PQ_READONLY)
+                    ? MADV_POPULATE_READ
+                    : MADV_POPULATE_WRITE)
+                ? errno
+                : 0;
+#endif
+        if (status == EINVAL) {
+            /* The O/S predates MADV_POPULATE_*: touch every page instead */
+            const volatile char* const bytes = base;
+
+            for (size_t off = 0; off < len; off += pq->pagesz)
+                (void)bytes[off];
+            status = 0;
+        }
+        (void)gettimeofday(&stop, NULL);
+
+        if (status) {
+            log_add_errno(status, "Couldn't pre-fault product-queue \"%s\"",
+                    pq->pathname);
+            log_flush_warning();
+        }
+        else {
+            log_info_q("Pre-faulted %lu bytes of product-queue \"%s\" in "
+                    "%.3f s", (unsigned long)len, pq->pathname,
+                    d_diff_timestamp(&stop, &start));
+        }
+    }
+}
+
+/*
+ * Minimum extent of the address-space that's reserved for a product-queue that's
+ * mapped as a whole
+ */
+#define MM0_RESERVE_MIN ((size_t)64 << 30)
+
+/*
+ * Reserves address-space for mapping a product-queue of a given size as a whole
+ * that has room for the product-queue to be grown several times over (see
+ * `pq_grow()`). The reservation is neither accessible nor backed by memory.
+ * Returns the start of the reservation and sets `pq->mapsz` or returns NULL if
+ * nothing was reserved, in which case the product-queue can still be mapped
+ * but not extended.
+ */
+static void*
+mm0_reserve(pqueue *const pq, const size_t size)
+{
+#if defined(MAP_ANONYMOUS) && defined(MAP_NORESERVE)
+        if(sizeof(void*) >= 8 && size <= ~(size_t)0/4) {
+                const size_t extent = 4*size < MM0_RESERVE_MIN
+                        ? MM0_RESERVE_MIN : 4*size;
+                void* const  vp = mmap(NULL, extent, PROT_NONE,
+                        MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+
+                if(vp != MAP_FAILED) {
+                        pq->mapsz = extent;
+                        return vp;
+                }
+        }
+#endif
+        pq->mapsz = 0;
+        return NULL;
+}
+
+/**
+ * Memory-maps the entire product-queue.
+ *
+ * @param[in] pq  Pointer to the product-queue object.
+ * @retval EBADF      The file descriptor of the product-queue is invalid.
+ * @retval EIO        An I/O error occurred while reading from the file system.
+ * @retval EOVERFLOW  The file size in bytes or the number of blocks allocated
+ *                    to the file or the file serial number cannot be
+ *                    represented correctly.
+ * @retval EINTR      A signal was caught during execution.
+ * @retval EFBIG or EINVAL
+ *                    The size of the product-queue is greater than the maximum
+ *                    file size.
+ * @retval EROFS      The named file resides on a read-only file system.
+ * @retval EAGAIN     The mapping could not be locked in memory, if required by
+ *                    mlockall(), due to a lack of resources.
+ * @retval EINVAL     The product-queue object wants to map the product-queue to
+ *                    a fixed memory location that is not a multiple of the page
+ *                    size as returned by sysconf(), or is considered invalid
+ *                    by the O/S.
+ * @retval EMFILE     The number of mapped regions would exceed an O/S-dependent
+ *                    limit (per process or per system).
+ * @retval ENODEV     The file descriptor of the product-queue object refers to
+ *                    a file whose type is not supported by mmap().
+ * @retval ENOMEM     The size of the product-queue exceeds that allowed for the
+ *                    address space of a process.
+ * @retval ENOMEM     The mapping could not be locked in memory, if required by
+ *                    mlockall(), because it would require more space than the
+ *                    system is able to supply.
+ * @retval ENOTSUP    The O/S does not support the combination of accesses
+ *                    requested.
+ * @retval ENXIO      The size of the product-queue is invalid for the object
+ *                    specified by its file descriptor.
+ */
+static int
+mm0_map(pqueue *const pq)
+{
+        int status = ENOERR;
+        void *vp = pq->base;
+        struct stat sb;
+        off_t st_size = TOTAL_SIZE(pq);
+        log_assert(st_size >= 0);
+        int mflags = fIsSet(pq->pflags, PQ_PRIVATE) ?
+                        MAP_PRIVATE : MAP_SHARED;
+        int prot = fIsSet(pq->pflags, PQ_READONLY) ?
+                        PROT_READ : (PROT_READ|PROT_WRITE);
+
+        if(fstat(pq->fd, &sb) < 0)
+                return errno;
+        if(st_size < sb.st_size)
+        {
+                st_size = sb.st_size;
+        }
+        else if(!fIsSet(pq->pflags, PQ_READONLY))
+        {
+                status = fgrow(pq->fd, st_size,
+                               fIsSet(pq->pflags, PQ_SPARSE));
+                if(status != ENOERR)
+                        return status;
+        }
+        log_debug("Mapping %ld", (long)st_size);
+        if (~(size_t)0 < st_size) {
+            log_error_q("File is too big to memory-map");
+            pq->base = NULL;
+            status = EFBIG;
+            return status;
+        }
+        if(vp == NULL)
+                vp = mm0_reserve(pq, (size_t)st_size);
+        if(vp != NULL)
+                fSet(mflags, MAP_FIXED);
+        status = mapwrap(pq->fd, 0, st_size, prot, mflags, &vp);
+        log_assert(status != EACCES);
+        if(status != ENOERR)
+        {
+                if(pq->base == NULL && pq->mapsz > 0)
+                        (void)munmap(vp, pq->mapsz);
+                pq->base = NULL;
+                pq->mapsz = 0;
+                return status;
+        }
+        log_assert(vp != NULL);
+        log_assert(pIf(pq->base != NULL, pq->base == vp));
+        pq->base = vp;
+        pq->mapped = (size_t)st_size;
+        if(pq->mapsz < pq->mapped)
+                pq->mapsz = pq->mapped;
+        mm0_tune(pq, vp, st_size);
+        return status;
+}
+
+/**
+ * Extends the memory-mapping of a product-queue that's mapped as a whole to
+ * cover the file after the product-queue was grown by another process (see
+ * `pq_grow()`). The extension is mapped into the address-space that was
+ * reserved after the mapping, so the mapping doesn't move.
+ *
+ * @param[in,out] pq      The product-queue.
+ * @param[in]     size    New size of the product-queue in bytes.
+ * @retval        0       Success.
+ * @retval        ENOMEM  The reserved address-space is too small. The
+ *                        product-queue must be reopened. `log_add()` called.
+ * @return                <errno.h> error-code of `mmap()`. `log_add()` called.
+ */
+static int
+mm0_extend(pqueue *const pq, const off_t size)
+{
+        int   mflags = MAP_FIXED | (fIsSet(pq->pflags, PQ_PRIVATE) ?
+                        MAP_PRIVATE : MAP_SHARED);
+        int   prot = fIsSet(pq->pflags, PQ_READONLY) ?
+                        PROT_READ : (PROT_READ|PROT_WRITE);
+        void *vp = (char*)pq->base + pq->mapped;
+        int   status;
+
+        if(size <= (off_t)pq->mapped)
+                return ENOERR;
+        if(size > (off_t)pq->mapsz) {
+                log_add("Product-queue \"%s\" grew to %ld bytes, beyond the "
+                        "%lu bytes of address-space reserved for it. It must "
+                        "be reopened.", pq->pathname, (long)size,
+                        (unsigned long)pq->mapsz);
+                return ENOMEM;
+        }
+        status = mapwrap(pq->fd, (off_t)pq->mapped, (size_t)size - pq->mapped,
+                        prot, mflags, &vp);
+        if(status != ENOERR)
+                return status;
+        mm0_tune(pq, vp, (size_t)size - pq->mapped);
+        pq->mapped = (size_t)size;
+        return ENOERR;
+}
+
+/**
+ * Synchronizes a region in the product-queue file to memory using `mmap()` to
+ * map the whole file. Locks the region in question.
+ *
+ * @param[in] rflags  Region flags: bitwise OR of
+ *                    - RGN_NOLOCK  Don't lock region; locking handled elsewhere
+ *                    - RGN_WRITE   Region will be modified
+ *                    - RGN_NOWAIT  Return immediately if can't lock, else wait
+ *
+ * `log_add()` is called for all of the following:
+ * @retval EACCES     The region is already locked by another process.
+ * @retval EINVAL     The product-queue file doesn't support locking.
+ * @retval ENOLCK     The number of locked regions would exceed a system-imposed
+ *                    limit.
+ * @retval EDEADLK    A deadlock in region locking has been detected.
+ * @retval EBADF      The file descriptor of the product-queue is invalid.
+ * @retval EIO        An I/O error occurred while reading from the file system.
+ * @retval EOVERFLOW  The file size in bytes or the number of blocks allocated
+ *                    to the file or the file serial number cannot be
+ *                    represented correctly.
+ * @retval EINTR      A signal was caught during execution.
+ * @retval EFBIG or EINVAL
+ *                    The size of the product-queue is greater than the maximum
+ *                    file size.
+ * @retval EROFS      The named file resides on a read-only file system.
+ * @retval EINVAL     The product-queue object wants to map the product-queue to
+ *                    a fixed memory location that is not a multiple of the page
+ *                    size as returned by sysconf(), or is considered invalid
+ *                    by the O/S.
+ * @retval EMFILE     The number of mapped regions would exceed an O/S-dependent
+ *                    limit (per process or per system).
+ * @retval ENODEV     The file descriptor of the product-queue object refers to
+ *                    a file whose type is not supported by mmap().
+ * @retval ENOMEM     The size of the product-queue exceeds that allowed for the
+ *                    address space of a process.
+ * @retval ENOMEM     The mapping could not be locked in memory, if required by
+ *                    mlockall(), because it would require more space than the
+ *                    system is able to supply.
+ * @retval ENOTSUP    The O/S does not support the combination of accesses
+ *                    requested.
+ * @retval ENXIO      The size of the product-queue is invalid for the object
+ *                    specified by its file descriptor.
+ */
+/*ARGSUSED*/
+static int
+mm0_ftom(pqueue *const pq,
+        const off_t offset,
+        const size_t extent,
+        const int rflags,
+        void **const ptrp)
+{
+    int status = 0;
+
+    log_assert(pq != NULL);
+    log_assert(pq->datao > 0);
+    log_assert(pq->datao % pq->pagesz == 0);
+    log_assert(pq->ixo >= pq->datao);
+    log_assert(pq->ixo % pq->pagesz == 0);
+    log_assert(pq->ixsz >= pq->pagesz);
+    log_assert(pq->ixsz % pq->pagesz == 0);
+
+    log_assert(0 <= offset && offset <= pq->ixo);
+    log_assert(0 != extent && extent < TOTAL_SIZE(pq));
+
+    if (!pIf(fIsSet(rflags, RGN_WRITE),
+                    !fIsSet(pq->pflags, PQ_READONLY))) {
+        log_error_q("Write access requested to readonly product-queue");
+        abort();
+    }
+
+    if (pq->base == NULL) {
+        status = mm0_map(pq); // First time
+        if (status)
+            log_add_errno(status, "mm0_map() failure");
+    }
+
+    if (status == 0) {
+        void* const vp = (char*)pq->base + offset;
+        riu*        rp; // Not used
+
+        status = rgn2_reserve(pq, offset, extent, rflags, vp, &rp);
+
+        if (status != EACCES) {
+            if (status) {
+                log_add("rgn2_reserve() failure");
+            }
+            else {
+                *ptrp = vp;
+            }
+        } // File locking didn't return `EACCES`
+    } // Product-queue file was successfully memory-mapped if necessary
+
+    return status;
+}
+
+/**
+ * Transfers a product-queue region from memory to file given that the entire
+ * product-queue is memory-mapped.
+ *
+ * @param[in,out] pq      Product-queue
+ * @param[in]     offset  Offset to region in bytes
+ * @param[in]     rflags  Region flags. Bitwise OR of
+ *                         - RGN_NOLOCK     Don't lock region; locking handled
+ *                                          elsewhere
+ *                         - RGN_MODIFIED   Region was modified
+ * @retval EINVAL     The region could not be found in the list of in-use
+ *                    regions.
+ * @retval EBADF      The product-queue's file descriptor is invalid.
+ * @retval EOVERFLOW  The (offset + extent) specification of the region is
+ *                    invalid.
+ */
+static int
+mm0_mtof(
+        pqueue *const pq,
+        off_t const   offset,
+        int const     rflags)
+{
+    log_assert(pq != NULL); /* would have core dumped already initializing */
+    log_assert(pq->datao > 0);
+    log_assert(pq->datao % pq->pagesz == 0);
+    log_assert(pq->ixo >= pq->datao);
+    log_assert(pq->ixo % pq->pagesz == 0);
+    log_assert(pq->ixsz >= pq->pagesz);
+    log_assert(pq->ixsz % pq->pagesz == 0);
+
+    log_assert(pIf(fIsSet(rflags, RGN_MODIFIED),
+                    !fIsSet(pq->pflags, PQ_READONLY)));
+
+    return rgn2_release(pq, offset, rflags);
+}
+/**
+ * Unmaps the robust control-region lock of a product-queue.
+ *
+ * @param[in,out] pq  The product-queue.
+ */
+static void
+lock_unmap(pqueue* const pq)
+{
+#ifdef PQ_HAVE_RWL
+    if (pq->lockctlp != NULL) {
+        (void)munmap(pq->lockctlp, (size_t)pq->datao);
+        pq->lockctlp = NULL;
+    }
+#endif
+    if (pq->lock_fd >= 0) {
+        (void)close(pq->lock_fd);
+        pq->lock_fd = -1;
+    }
+}
+
+/**
+ * Maps the control-region of a product-queue for its robust control-region
+ * lock. The control-region must not be locked by this process. Subsequent
+ * locking of the control-region uses the robust lock rather than fcntl(2). The
+ * lock is reinitialized if it was initialized before the last system restart.
+ * A read-only opener must be able to open the file for writing.
+ *
+ * @param[in,out] pq       The product-queue.
+ * @param[in]     path     Pathname of the product-queue.
+ * @retval        0        Success.
+ * @retval        ENOTSUP  Robust locking isn't supported by this system or by
+ *                         how the product-queue is accessed. `log_add()`
+ *                         called.
+ * @return                 <errno.h> error-code. `log_add()` called.
+ */
+static int
+lock_map(
+        pqueue* const     pq,
+        const char* const path)
+{
+#ifndef PQ_HAVE_RWL
+    log_add("Robust locking of product-queue \"%s\" isn't supported on this "
+            "system", path);
+    return ENOTSUP;
+#else
+    int    status = ENOERR;
+    int    fd = pq->fd;
+    char   boot[sizeof(((rwl*)0)->boot)];
+    void*  vp;
+
+    if (fIsSet(pq->pflags, PQ_NOLOCK))
+        return ENOERR;
+
+    if (pq->ftom == f_ftom) {
+        log_add("Robust locking of product-queue \"%s\" requires that it be "
+                "memory-mapped", path);
+        return ENOTSUP;
+    }
+
+    if (fIsSet(pq->pflags, PQ_READONLY)) {
+        fd = open(path, O_RDWR);
+        if (fd < 0) {
+            status = errno;
+            log_add_syserr("Couldn't open robustly-locked product-queue \"%s\" "
+                    "for writing", path);
+            return status;
+        }
+        (void)ensure_close_on_exec(fd);
+    }
+
+    vp = mmap(NULL, (size_t)pq->datao, PROT_READ|PROT_WRITE, MAP_SHARED, fd,
+            0);
+    if (vp == MAP_FAILED) {
+        status = errno;
+        log_add_syserr("Couldn't map control-region of product-queue \"%s\"",
+                path);
+    }
+    else {
+        pqctl* const ctlp = (pqctl*)vp;
+
+        rwl_bootId(boot, sizeof(boot));
+        if (boot[0] && strncmp(boot, ctlp->lock.boot, sizeof(boot))) {
+            /*
+             * Initialized before the last restart. The fcntl(2) lock serializes
+             * reinitialization by processes that open the product-queue
+             * concurrently.
+             */
+            status = fd_lock(fd, F_SETLKW, F_WRLCK, 0, SEEK_SET,
+                    (size_t)pq->datao);
+            if (status == 0) {
+                if (strncmp(boot, ctlp->lock.boot, sizeof(boot))) {
+                    log_notice_q("Initializing control-region lock of "
+                            "product-queue \"%s\"", path);
+                    status = rwl_init(&ctlp->lock);
+                }
+                (void)fd_lock(fd, F_SETLK, F_UNLCK, 0, SEEK_SET,
+                        (size_t)pq->datao);
+            }
+        }
+
+        if (status) {
+            (void)munmap(vp, (size_t)pq->datao);
+        }
+        else {
+            pq->lockctlp = ctlp;
+        }
+    }
+
+    if (fd != pq->fd) {
+        if (status) {
+            (void)close(fd);
+        }
+        else {
+            /* Closing it would release this process' fcntl(2) locks */
+            pq->lock_fd = fd;
+        }
+    }
+
+    return status;
+#endif
+}
+
+/* End OS */
+#endif /*HAVE_MMAP*/
+
+
+/* The maximum value of a "size_t": */
+static const size_t MAX_SIZE_T = ~(size_t)0;
+
+
+/**
+ * Indicates if memory-mapping by individual data-products is necessary.
+ *
+ * Arguments:
+ *      pq      Pointer to the product-queue structure.
+ * Returns:
+ *      0       If and only if it is not necessary to memory-map the
+ *              product-queue by individual data-products.
+ */
+static inline int
+isProductMappingNecessary(
+    const pqueue* const pq)
+{
+    return (TOTAL_SIZE(pq) > MAX_SIZE_T)
+#if __FreeBSD__ == 4
+        /*
+         * The operating-system is 32-bit Free BSD 4, which has a limit of
+         * 2 gigabytes on the extent argument of an mmap(2) call.
+         */
+        || (sizeof(size_t) == 4 && TOTAL_SIZE(pq) > 2000000000)
+#endif
+        ;
+}
+
+/******************************************************************************
+ * Chunked Data-Products:
+ *
+ * A product-queue created with PQ_CHUNKED stores a large data-product for which
+ * there's no contiguous free region as a chain of chunks. The region of such a
+ * data-product -- the one that's indexed by time and signature and that's
+ * locked -- holds only a chunk map. Each chunk is a separate in-use region
+ * whose page-aligned interior holds the next CK_SIZE bytes of the XDR-encoded
+ * data-product (the last chunk holds the rest). Getting the region of a
+ * chunked data-product maps its chunks adjacently into a reserved range of the
+ * address space, so the data-product is contiguous to the functions that
+ * decode it and to the writer of `pqe_new()` alike.
+ ******************************************************************************/
+
+/*
+ * Magic number of a chunk map. Whether a region holds a chunk map is recorded
+ * by the ISCHUNKED flag of its entry in the region-list because a data-product
+ * can start with any bytes; the magic number only guards against a corrupt
+ * region-list.
+ */
+#define CK_MAGIC        0xC84B4D41u
+/* Number of bytes of a data-product in each chunk. A multiple of page-sizes */
+#define CK_SIZE         ((size_t)4*1024*1024)
+
+/*
+ * The chunk map in the region of a chunked data-product.
+ */
+typedef struct {
+        uint32_t magic;         /* CK_MAGIC in network byte-order */
+        uint32_t nchunks;       /* number of chunks */
+        uint64_t size;          /* size of the XDR-encoded data-product */
+        off_t    offsets[1];    /* offsets of the chunks' regions. Actually
+                                 * `nchunks` long */
+} ckmap;
+
+/*
+ * Returns the size, in bytes, of the chunk map of a given number of chunks.
+ */
+static inline size_t
+ck_mapSize(const size_t nchunks)
+{
+        return offsetof(ckmap, offsets) + nchunks*sizeof(off_t);
+}
+
+/*
+ * Returns the number of chunks of a data-product of a given size.
+ */
+static inline size_t
+ck_count(const size_t size)
+{
+        return (size + CK_SIZE - 1) / CK_SIZE;
+}
+
+/*
+ * Returns the offset of the page-aligned interior of a chunk's region.
+ */
+static inline off_t
+ck_dataOffset(const pqueue* const pq, const off_t offset)
+{
+        return _RNDUP(offset, (off_t)pq->pagesz);
+}
+
+#ifdef HAVE_MMAP
+/*
+ * Indicates if a region that's flagged as holding a chunk map holds a valid
+ * one.
+ *
+ * @param[in] pq      Product-queue
+ * @param[in] map     Start of the region
+ * @param[in] extent  Extent of the region in bytes
+ */
+static bool
+ck_isMap(
+        const pqueue* const restrict pq,
+        const ckmap* const restrict  map,
+        const size_t                 extent)
+{
+        if (extent < ck_mapSize(1) || map->magic != htonl(CK_MAGIC) ||
+                map->nchunks == 0 || extent < ck_mapSize(map->nchunks) ||
+                map->nchunks != ck_count(map->size))
+            return false;
+
+        for (uint32_t i = 0; i < map->nchunks; i++) {
+            if (map->offsets[i] < pq->datao ||
+                    ck_dataOffset(pq, map->offsets[i]) >= pq->ixo)
+                return false;
+        }
+
+        return true;
+}
+
+/*
+ * Indicates if the region-list flags a region as holding a chunk map.
+ *
+ * @pre                The control-region is locked.
+ * @param[in] pq       Product-queue
+ * @param[in] offset   Offset of the region
+ */
+static bool
+ck_isChunked(
+        const pqueue* const pq,
+        const off_t         offset)
+{
+        return fIsSet(rl_flags(pq->rlp, offset), ISCHUNKED);
+}
+
+/**
+ * Maps the chunks of a data-product adjacently in memory if the data-product
+ * is chunked. The region of the data-product must be in use by this process.
+ * The region-in-use entry then references the contiguous data-product until
+ * `ck_detach()`.
+ *
+ * @pre                    The control-region is locked unless `rflags`
+ *                         contains RGN_UNLOCKED.
+ * @param[in]     pq       Product-queue
+ * @param[in]     offset   Offset of the region of the data-product
+ * @param[in]     rflags   Region flags with which the region was gotten
+ * @param[in,out] vpp      The region on input; the data-product on output
+ * @param[in,out] extentp  The extent of the region on input; the size of the
+ *                         data-product on output
+ * @retval        0        Success. `*vpp` and `*extentp` are unchanged if the
+ *                         data-product isn't chunked.
+ * @retval        EINVAL   The region isn't in use. `log_add()` called.
+ * @retval        PQ_CORRUPT  The region is flagged as holding a chunk map
+ *                            but doesn't. `log_add()` called.
+ * @return                 `mmap()` error code. `log_add()` called.
+ */
+static int
+ck_attach(
+        pqueue* const restrict pq,
+        const off_t            offset,
+        const int              rflags,
+        void** const restrict  vpp,
+        size_t* const restrict extentp)
+{
+        const ckmap* const map = *vpp;
+        riu*               rp;
+
+        if (!fIsSet(pq->pflags, PQ_CHUNKED) || fIsSet(rflags, RGN_UNLOCKED) ||
+                !ck_isChunked(pq, offset))
+            return 0;
+
+        if (!ck_isMap(pq, map, *extentp)) {
+            log_add("Region with offset %ld doesn't hold a valid chunk map",
+                    (long)offset);
+            return PQ_CORRUPT;
+        }
+
+        if (riul_r_find(pq->riulp, offset, &rp) == 0) {
+            log_add("Region with offset %ld is not in use", (long)offset);
+            return EINVAL;
+        }
+
+        const int    prot = (fIsSet(pq->pflags, PQ_READONLY) &&
+                    !fIsSet(rflags, RGN_WRITE))
+                ? PROT_READ
+                : (PROT_READ|PROT_WRITE);
+        const int    mflags = fIsSet(pq->pflags, PQ_PRIVATE)
+                ? MAP_PRIVATE
+                : MAP_SHARED;
+        const size_t viewsz = _RNDUP(map->size, pq->pagesz);
+        char* const  view = mmap(NULL, viewsz, PROT_NONE,
+                MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+
+        if (view == MAP_FAILED) {
+            log_add_syserr("Couldn't reserve %lu bytes for chunked "
+                    "data-product", (unsigned long)viewsz);
+            return errno;
+        }
+
+        for (uint32_t i = 0; i < map->nchunks; i++) {
+            const size_t len = (i + 1 < map->nchunks)
+                    ? CK_SIZE
+                    : viewsz - i*CK_SIZE;
+
+            if (mmap(view + i*CK_SIZE, len, prot, mflags|MAP_FIXED, pq->fd,
+                    ck_dataOffset(pq, map->offsets[i])) == MAP_FAILED) {
+                const int status = errno;
+
+                log_add_syserr("Couldn't map chunk %u of data-product at "
+                        "offset %ld", i, (long)offset);
+                (void)munmap(view, viewsz);
+                return status;
+            }
+        }
+
+        rp->ckhead = rp->vp;
+        rp->ckextent = rp->extent;
+        rp->vp = view;
+        rp->extent = map->size;
+        *vpp = view;
+        *extentp = map->size;
+
+        return 0;
+}
+
+/**
+ * Unmaps the chunks of a data-product mapped by `ck_attach()`. Does nothing if
+ * the data-product isn't chunked.
+ *
+ * @param[in] pq      Product-queue
+ * @param[in] offset  Offset of the region of the data-product
+ */
+static void
+ck_detach(
+        pqueue* const pq,
+        const off_t   offset)
+{
+        riu* rp;
+
+        if (fIsSet(pq->pflags, PQ_CHUNKED) &&
+                riul_r_find(pq->riulp, offset, &rp) && rp->ckhead) {
+            (void)munmap(rp->vp, _RNDUP(rp->extent, pq->pagesz));
+            rp->vp = rp->ckhead;
+            rp->extent = rp->ckextent;
+            rp->ckhead = NULL;
+            rp->ckextent = 0;
+        }
+}
+
+/**
+ * Frees the regions of the chunks of a data-product that's attached by
+ * `ck_attach()`. Does nothing if the data-product isn't chunked.
+ *
+ * @pre                The control-region is write-locked.
+ * @param[in] pq       Product-queue
+ * @param[in] offset   Offset of the region of the data-product
+ */
+static void
+ck_free(
+        pqueue* const pq,
+        const off_t   offset)
+{
+        riu* rp;
+
+        if (fIsSet(pq->pflags, PQ_CHUNKED) && ck_isChunked(pq, offset) &&
+                riul_r_find(pq->riulp, offset, &rp) && rp->ckhead) {
+            const ckmap* const map = rp->ckhead;
+
+            for (uint32_t i = 0; i < map->nchunks; i++) {
+                const size_t rlix = rl_find(pq->rlp, map->offsets[i]);
+
+                if (rlix == RL_NONE) {
+                    log_error_q("Chunk %u of data-product at offset %ld not "
+                            "found", i, (long)offset);
+                }
+                else {
+                    pq_freeRegion(pq, rlix);
+                }
+            }
+        }
+}
+#else
+static inline int
+ck_attach(
+        pqueue* const restrict pq,
+        const off_t            offset,
+        const int              rflags,
+        void** const restrict  vpp,
+        size_t* const restrict extentp)
+{
+        return 0;
+}
+
+static inline void
+ck_detach(
+        pqueue* const pq,
+        const off_t   offset)
+{
+}
+
+static inline void
+ck_free(
+        pqueue* const pq,
+        const off_t   offset)
+{
+}
+#endif /* HAVE_MMAP */
+
+/******************************************************************************
+ * Compressed Data-Products:
+ *
+ * A product-queue created with PQ_COMPRESS stores the data of a data-product
+ * whose feedtype is in `pqctl.zip_feeds` compressed by zlib if that saves at
+ * least 1/ZP_MINSAVE of it. The region of such a data-product holds a ZP_HDRLEN
+ * byte header, the XDR-encoded metadata -- unchanged, so the size is that of the
+ * uncompressed data and the signature is the MD5 checksum of it -- and then the
+ * compressed data. Getting the region of a compressed data-product returns the
+ * XDR-encoded data-product as it would have been stored uncompressed, so
+ * readers are unaffected.
+ ******************************************************************************/
+
+/*
+ * Magic number of a compressed data-product. Whether a data-product is
+ * compressed is recorded by the ISZIPPED flag of its entry in the region-list
+ * because a data-product can start with any bytes; the magic number only
+ * guards against a corrupt region-list.
+ */
+#define ZP_MAGIC        0xC85A4C42u
+/* Size of the header of a compressed data-product */
+#define ZP_HDRLEN       8
+/* Minimum size, in bytes, of data that's worth compressing */
+#define ZP_MINSIZE      512
+/* Compressed data must be smaller by at least 1/ZP_MINSAVE to be stored */
+#define ZP_MINSAVE      8
+
+/*
+ * Returns the length of the XDR-encoded metadata at the start of 'xp' of
+ * 'extent' bytes without decoding it and sets '*szp' to the size of the data.
+ * Returns 0 if the encoding is truncated or invalid.
+ */
+static size_t
+zp_infoLen(const void *const xp, const size_t extent, uint32_t *const szp)
+{
+        const char *const start = xp;
+        const char *cp = start + 8 + sizeof(signaturet);
+        const char *const end = start + extent;
+        uint32_t xval;
+
+        if(cp + 4 > end)
+                return 0;
+        (void)memcpy(&xval, cp, 4); /* length of origin */
+        if(ntohl(xval) > HOSTNAMESIZE)
+                return 0;
+        cp += 4 + _RNDUP(ntohl(xval), 4) + 4 + 4; /* feedtype and seqno */
+        if(cp + 4 > end)
+                return 0;
+        (void)memcpy(&xval, cp, 4); /* length of ident */
+        if(ntohl(xval) > KEYSIZE)
+                return 0;
+        cp += 4 + _RNDUP(ntohl(xval), 4);
+        if(cp + 4 > end)
+                return 0;
+        (void)memcpy(&xval, cp, 4);
+        *szp = ntohl(xval);
+
+        return cp + 4 - start;
+}
+
+/**
+ * Compresses data if its feedtype is compressed by the product-queue and if
+ * that saves enough space.
+ *
+ * @param[in]  pq        Product-queue
+ * @param[in]  feedtype  Feedtype of the data-product
+ * @param[in]  data      Data to be compressed
+ * @param[in]  sz        Size of the data in bytes
+ * @param[out] zlenp     Size of the compressed data in bytes
+ * @retval     NULL      The data shouldn't be compressed
+ * @return               The compressed data. The caller should `free()` it.
+ */
+static void*
+zp_compress(
+        pqueue* const restrict     pq,
+        const feedtypet            feedtype,
+        const void* const restrict data,
+        const size_t               sz,
+        size_t* const restrict     zlenp)
+{
+        if (!fIsSet(pq->pflags, PQ_COMPRESS) ||
+                (feedtype & pq->zipfeeds) == 0 || sz < ZP_MINSIZE)
+            return NULL;
+
+        uLongf      zlen = compressBound(sz);
+        Bytef*const zbuf = malloc(zlen);
+
+        if (zbuf == NULL)
+            return NULL; // The data-product is stored uncompressed
+
+        if (compress2(zbuf, &zlen, data, sz, Z_BEST_SPEED) != Z_OK ||
+                _RNDUP(zlen, 4) + ZP_HDRLEN > sz - sz/ZP_MINSAVE) {
+            free(zbuf);
+            return NULL;
+        }
+
+        *zlenp = zlen;
+        return zbuf;
+}
+
+/**
+ * Writes a compressed data-product. This is the complement of
+ * `zp_attach()`.
+ *
+ * @param[out] vp      Start of the region of the data-product. Must have room
+ *                     for `ZP_HDRLEN + infolen + _RNDUP(zlen, 4)` bytes.
+ * @param[in]  info    XDR-encoded metadata of the data-product. May overlap
+ *                     `vp`.
+ * @param[in]  infolen Length of the XDR-encoded metadata in bytes
+ * @param[in]  zbuf    Compressed data. Mustn't overlap `vp`.
+ * @param[in]  zlen    Length of the compressed data in bytes
+ */
+static void
+zp_write(
+        void* const       vp,
+        const void* const info,
+        const size_t      infolen,
+        const void* const zbuf,
+        const size_t      zlen)
+{
+        char* const    cp = vp;
+        const uint32_t hdr[2] = {htonl(ZP_MAGIC), htonl((uint32_t)zlen)};
+
+        (void)memmove(cp + ZP_HDRLEN, info, infolen);
+        (void)memcpy(cp, hdr, sizeof(hdr));
+        (void)memcpy(cp + ZP_HDRLEN + infolen, zbuf, zlen);
+        (void)memset(cp + ZP_HDRLEN + infolen + zlen, 0,
+                _RNDUP(zlen, 4) - zlen);
+}
+
+/**
+ * Accounts for the compression of data.
+ *
+ * @pre           The control-region is write-locked.
+ * @param[in] pq  Product-queue
+ * @param[in] sz  Size of the data in bytes
+ * @param[in] zlen Size of the compressed data in bytes
+ */
+static inline void
+zp_count(
+        pqueue* const pq,
+        const size_t  sz,
+        const size_t  zlen)
+{
+        pq->ctlp->zip_in += sz;
+        pq->ctlp->zip_out += zlen;
+}
+
+/**
+ * Decompresses a data-product if it's compressed. The region of the
+ * data-product must be in use by this process. The region-in-use entry then
+ * references the uncompressed data-product until `zp_detach()`.
+ *
+ * @pre                    The control-region is locked unless `rflags`
+ *                         contains RGN_UNLOCKED.
+ * @param[in]     pq       Product-queue
+ * @param[in]     offset   Offset of the region of the data-product
+ * @param[in]     rflags   Region flags with which the region was gotten. If
+ *                         RGN_INFO is set, then only the header is skipped:
+ *                         the metadata is correct but the data isn't there.
+ * @param[in,out] vpp      The region on input; the data-product on output
+ * @param[in,out] extentp  The extent of the region on input; the size of the
+ *                         data-product on output
+ * @retval        0        Success. `*vpp` and `*extentp` are unchanged if the
+ *                         data-product isn't compressed.
+ * @retval        EINVAL   The region isn't in use. `log_add()` called.
+ * @retval        EIO      The data-product is corrupt. `log_add()` called.
+ * @retval        ENOMEM   Out of memory. `log_add()` called.
+ */
+static int
+zp_attach(
+        pqueue* const restrict pq,
+        const off_t            offset,
+        const int              rflags,
+        void** const restrict  vpp,
+        size_t* const restrict extentp)
+{
+        uint32_t hdr[2];
+        riu*     rp;
+
+        if (!fIsSet(pq->pflags, PQ_COMPRESS) || fIsSet(rflags, RGN_UNLOCKED) ||
+                !fIsSet(rl_flags(pq->rlp, offset), ISZIPPED))
+            return 0;
+        if (*extentp >= ZP_HDRLEN)
+            (void)memcpy(hdr, *vpp, sizeof(hdr));
+        if (*extentp < ZP_HDRLEN || hdr[0] != htonl(ZP_MAGIC)) {
+            log_add("Compressed data-product at offset %ld has no header",
+                    (long)offset);
+            return EIO;
+        }
+
+        if (riul_r_find(pq->riulp, offset, &rp) == 0) {
+            log_add("Region with offset %ld is not in use", (long)offset);
+            return EINVAL;
+        }
+
+        char*  xp = (char*)*vpp + ZP_HDRLEN;
+        size_t extent = *extentp - ZP_HDRLEN;
+
+        if (!fIsSet(rflags, RGN_INFO)) {
+            uint32_t     sz;
+            const size_t infolen = zp_infoLen(xp, extent, &sz);
+            const size_t zlen = ntohl(hdr[1]);
+
+            if (infolen == 0 || infolen + zlen > extent) {
+                log_add("Compressed data-product at offset %ld is corrupt",
+                        (long)offset);
+                return EIO;
+            }
+
+            char* const buf = malloc(infolen + _RNDUP(sz, 4));
+            if (buf == NULL) {
+                log_add_syserr("Couldn't allocate %lu bytes for compressed "
+                        "data-product", (unsigned long)(infolen + sz));
+                return ENOMEM;
+            }
+
+            uLongf len = sz;
+            if (uncompress((Bytef*)buf + infolen, &len, (Bytef*)xp + infolen,
+                    zlen) != Z_OK || len != sz) {
+                log_add("Couldn't decompress data-product at offset %ld",
+                        (long)offset);
+                free(buf);
+                return EIO;
+            }
+            (void)memcpy(buf, xp, infolen);
+            (void)memset(buf + infolen + sz, 0, _RNDUP(sz, 4) - sz);
+
+            xp = buf;
+            extent = infolen + _RNDUP(sz, 4);
+        }
+
+        rp->zphead = rp->vp;
+        rp->zpextent = rp->extent;
+        rp->vp = xp;
+        rp->extent = extent;
+        *vpp = xp;
+        *extentp = extent;
+
+        return 0;
+}
+
+/**
+ * Frees a data-product decompressed by `zp_attach()`. Does nothing if the
+ * data-product isn't compressed.
+ *
+ * @param[in] pq      Product-queue
+ * @param[in] offset  Offset of the region of the data-product
+ */
+static void
+zp_detach(
+        pqueue* const pq,
+        const off_t   offset)
+{
+        riu* rp;
+
+        if (fIsSet(pq->pflags, PQ_COMPRESS) &&
+                riul_r_find(pq->riulp, offset, &rp) && rp->zphead) {
+            if (rp->vp != (char*)rp->zphead + ZP_HDRLEN)
+                free(rp->vp);
+            rp->vp = rp->zphead;
+            rp->extent = rp->zpextent;
+            rp->zphead = NULL;
+            rp->zpextent = 0;
+        }
+}
+
+/******************************************************************************
+ * Higher-Level Data-Product Data-Region Functions:
+ ******************************************************************************/
+
+/*
+ * Release/unlock a data region. This function is the complement of `rgn_get()`.
+ */
+static inline int
+rgn_rel(pqueue *const pq, off_t const offset, int const rflags)
+{
+        log_assert(offset >= pq->datao && offset < pq->ixo);
+        zp_detach(pq, offset);
+        ck_detach(pq, offset);
+        return (pq->mtof)(pq, offset, rflags);
+}
+
+/*
+ * Get/lock a data region. This function is the complement of `rgn_rel()`.
+ * If the region is that of a chunked data-product, then the data-product is
+ * returned as if it were contiguous (see `ck_attach()`); if it's that of a
+ * compressed data-product, then the data-product is returned uncompressed
+ * (see `zp_attach()`).
+ *
+ * On input, "*extentp" is the extent of the region; on success, it's the
+ * extent of the returned memory.
+ *
+ * Returns:
+ *      0       Success
+ *      `log_add()` is called for all of the following:
+ *      EACCESS or EAGAIN
+ *              "rflags" contains RGN_NOWAIT and the segment of a file to
+ *              be locked is already exclusive-locked by another process,
+ *              or "rflags" contains RGN_WRITE and some portion of the
+ *              segment of the file to be locked is already shared-locked or
+ *              exclusive-locked by another process.
+ *      EACCES  "pq->fd" is not open for read, regardless of the protection
+ *              specified, or "pq->fd" is not open for write and PROT_WRITE was
+ *              specified for a MAP_SHARED type mapping.
+ *      EAGAIN  The mapping could not be locked in memory, if required by
+ *              mlockall(), due to a lack of resources.
+ *      EBADF   "pq->fd" is not a valid open file descriptor, or "rflags"
+ *              doesn't contain RGN_WRITE and "pq->fd" is not a valid file
+ *              descriptor open for reading, or "rflags" contains RGN_WRITE
+ *              and "pq->fd" is not a valid file descriptor open for writing.
+ *      EDEADLK "rflags" doesn't contain RGN_NOWAIT, the lock is blocked by some
+ *              lock from another process and putting the calling process to
+ *              sleep, waiting for that lock to become free would cause a
+ *              deadlock.
+ *      EFBIG or EINVAL
+ *              The "extent" argument was greater than the maximum file size.
+ *      EFBIG   The file is a regular file and length is greater than the offset
+ *              maximum established in the open file description associated with
+ *              "pq->fd".
+ *      EINTR   A signal was caught during execution.
+ *      EINVAL  "offset", or "extent" is not valid, or "pq->fd" refers to a file
+ *              that does not support locking.
+ *      EINVAL  "offset" is not a multiple of the page size as returned by
+ *              sysconf(), or is considered invalid by the implementation.
+ *      EIO     An I/O error occurred while reading from the file system.
+ *      EMFILE  The number of mapped regions would exceed an
+ *              implementation-dependent limit (per process or per system).
+ *      ENODEV  "pq->fd" refers to a file whose type is not supported by mmap().
+ *      ENOLCK  Satisfying the request would result in the number of locked
+ *              regions in the system exceeding a system-imposed limit.
+ *      ENOMEM  There is insufficient room in the address space to effect the
+ *              necessary mapping.
+ *      ENOMEM  The mapping could not be locked in memory, if required by
+ *              mlockall(), because it would require more space than the system
+ *              is able to supply.
+ *      ENOMEM  Insufficient memory is available.
+ *      ENOTSUP The implementation does not support the combination of accesses
+ *              requested in "pq->pflags" and "rflags".
+ *      ENXIO   Addresses in the range [offset, offset + extent) are invalid for
+ *              the object specified by "pq->fd".
+ *      EOVERFLOW
+ *              The smallest or, if "extent" is non-zero, the largest offset of
+ *              any byte in the requested segment cannot be represented
+ *              correctly in an object of type off_t.
+ *      EOVERFLOW
+ *              The file size in bytes or the number of blocks allocated to the
+ *              file or the file serial number cannot be represented correctly.
+ *      EOVERFLOW
+ *              The file is a regular file and the value of "offset" plus
+ *              "extent" exceeds the offset maximum established in the open file
+ *              description associated with "pq->fd".
+ *      EROFS   The file resides on a read-only file system.
+ */
+static inline int
+rgn_get(pqueue *const pq, off_t const offset, size_t *const extentp,
+         int const rflags, void **const vpp)
+{
+        log_assert(offset >= pq->datao && offset < pq->ixo);
+        log_assert(*extentp >= MIN_RGN_SIZE &&
+                *extentp <= pq->ixo - pq->datao);
+
+        log_assert(pq->riulp->nelems <= pq->rlp->nelems +1);
+
+        int status = (pq->ftom)(pq, offset, *extentp, rflags, vpp);
+
+        if (status == 0) {
+            status = ck_attach(pq, offset, rflags, vpp, extentp);
+            if (status == 0) {
+                status = zp_attach(pq, offset, rflags, vpp, extentp);
+                if (status)
+                    ck_detach(pq, offset);
+            }
+            if (status)
+                (void)(pq->mtof)(pq, offset, 0);
+        }
+
+        return status;
+}
+
+/******************************************************************************
+ * XDR Functions:
+ ******************************************************************************/
+
+static void *
+xinfo_i(void *buf, size_t size, enum xdr_op op,
+        prod_info *infop)
+{
+        XDR xdrs[1] ;
+
+        xdrmem_create(xdrs, buf, (u_int)size, op) ;
+
+        if(!xdr_prod_info(xdrs, infop))
+        {
+                log_error_q("xinfo:%s xdr_prod_info() failed",
+                        infop->ident) ;
+                return NULL;
+        }
+        /* return data ptr. Unwarranted intimacy with xdr_mem implementation */
+        return xdrs->x_private;
+}
+
+
+/*
+ * XDR Encode or Decode "prod" to or from "buf" of size "size".
+ */
+static ptrdiff_t
+xproduct(void *buf, size_t size, enum xdr_op op, product *prod)
+{
+        XDR xdrs[1] ;
+        xdrmem_create(xdrs, buf, (u_int)size, op);
+
+        if (!xdr_product(xdrs, prod))
+        {
+                log_error_q("%s xdr_product() failed",
+                        prod->info.ident);
+                return 0;
+        }
+
+        /*      return xlen_product(prod) ; */
+        return (xdrs->x_private - xdrs->x_base);
+}
+
+/******************************************************************************
+ * Lower-Level Product-Queue Functions:
+ ******************************************************************************/
+
+/**
+ * Deletes a data-product if the product is not locked.
+ *
+ * @param[in]  pq          The product-queue.
+ * @param[in]  tqep        The entry in the time-map.
+ * @param[in]  rlix        The index of the entry in the region-map.
+ * @param[out] info        The data-product metadata. On success, caller should
+ *                         unconditionally call `xdr_free(xdr_prod_info,
+ *                         (char*)info)` when it's no longer needed.
+ * @retval     0           Success. `*info` is set. Caller should
+ *                         unconditionally call `xdr_free(xdr_prod_info,
+ *                         (char*)info)` when it's no longer needed.
+ * @retval     EACCES      Product is locked.
+ * @retval     PQ_CORRUPT  The product-queue is corrupt. Error-messaged logged.
+ * @retval     PQ_SYSTEM   System error. Error-message logged.
+ */
+static int
+pq2_try_del_prod(
+    pqueue* const restrict    pq,
+    tqelem* const restrict    tqep,
+    size_t                    rlix,
+    prod_info* const restrict info)
+{
+    region* const rep = pq->rlp->rp + rlix;
+    const off_t   offset = rep->offset;
+    int           status;
+
+    if (offset != tqep->offset) {
+        log_error_q("Offset-to-region mismatch: time-entry=%ld, "
+                "region-entry=%ld", (long)tqep->offset, (long)offset);
+        status = PQ_CORRUPT;
+    }
+    else {
+        void*  vp;
+        size_t extent = Extent(rep);
+
+        status = rgn_get(pq, offset, &extent, RGN_WRITE|RGN_NOWAIT|RGN_INFO,
+                &vp);
+        if (status) {
+            if (status == EACCES || status == EAGAIN) {
+                log_clear();
+                status = EACCES;
+            }
+            else {
+                log_syserr_q("Couldn't get region (offset=%ld,extent=%lu)");
+                status = PQ_SYSTEM;
+            }
+        }
+        else {
+            /* Get the metadata of the data-product. */
+            XDR xdrs;
+
+            xdrmem_create(&xdrs, vp, extent, XDR_DECODE);
+            // Necessary for `xdr_prod_info()`
+            (void)memset(info, 0, sizeof(prod_info));
+
+            if (!xdr_prod_info(&xdrs, info)) {
+                log_error_q("Couldn't XDR_DECODE data-product metadata");
+                status = PQ_CORRUPT;
+            }
+            else {
+                /*
+                 * Remove the corresponding entry from the signature-map.
+                 */
+                if (sx_find_delete(pq->sxp, info->signature) == 0) {
+                    log_error_q("pq_try_del_prod(): signature %s: Not Found",
+                            s_signaturet(NULL, 0, info->signature));
+                    status = PQ_CORRUPT;
+                }
+                else {
+                    /*
+                     * Remove the corresponding entry from the time-map.
+                     */
+                    tq_delete(pq->tqp, tqep);
+
+                    /*
+                     * Remove the corresponding entries from the region-map.
+                     */
+                    ck_free(pq, offset);
+                    pq_freeRegion(pq, rlix);
+                }
+
+                if (status)
+                    xdr_free(xdr_prod_info, (char*)info);
+            } // `xdr_prod_info()` successful
+
+            xdr_destroy(&xdrs);
+
+            /* Release the data-region. */
+            (void)rgn_rel(pq, offset, 0);
+        } // `rgn_get()` successful
+    } // region-offsets match
+
+    return status;
+}
+
+
+/**
+ * Set the minimum virtual residence time metrics if appropriate.
+ *
+ * @param[in] pq             The product-queue.
+ * @param[in] receptionTime  The time the data-product was inserted into the
+ *                           product-queue.
+ * @param[in] info           The data-product metadata.
+ */
+static void
+pq2_set_mvrt(
+    pqueue* const restrict     pq,
+    timestampt* const restrict receptionTime,
+    prod_info* const restrict  info)
+{
+    const timestampt*           creationTime = &info->arrival;
+    timestampt                  now;
+
+    /*
+     * If the product was received before it was created, then use the product's
+     * reception-time as its creation-time in the computation of the product's
+     * virtual residence-time.
+     */
+    if (TV_CMP_LT(*receptionTime, *creationTime))
+        creationTime = receptionTime;
+
+    (void)set_timestamp(&now);
+
+    /*
+     * Compute the product's residence time only if the product was
+     * created before now.
+     */
+    if (TV_CMP_LT(*creationTime, now)) {
+        timestampt      virtResTime = diff_timestamp(&now, creationTime);
+
+        if (tvIsNone(pq->ctlp->minVirtResTime) ||
+                TV_CMP_LT(virtResTime, pq->ctlp->minVirtResTime)) {
+            log_info_q("pq_set_mvrt(): MVRT product: %s",
+                    s_prod_info(NULL, 0, info,
+                            log_is_enabled_debug));
+            pq->ctlp->minVirtResTime = virtResTime;
+            pq->ctlp->mvrtSize = pq->rlp->nbytes;
+            pq->ctlp->mvrtSlots = pq->rlp->nelems;
+        }
+    }
+}
+
+/**
+ * Returns the cursor of a registered consumer. Doesn't lock the control-region.
+ *
+ * @param[in] cep  The consumer's entry in the registry.
+ * @return         The consumer's cursor.
+ */
+static timestampt
+cons_cursor(const conselem* const cep)
+{
+    timestampt cursor;
+
+    /* Bounded, in case the consumer terminated while changing its cursor */
+    for (int i = 0; i < 1000; i++) {
+        const uint32_t seq = __atomic_load_n(&cep->seq, __ATOMIC_ACQUIRE);
+
+        cursor = cep->cursor;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (!(seq & 1) && __atomic_load_n(&cep->seq, __ATOMIC_RELAXED) == seq)
+            break;
+    }
+
+    return cursor;
+}
+
+/* Minimum interval between overrun-warnings about a consumer in seconds */
+#define CONS_WARN_INTERVAL      60
+
+/**
+ * Accounts for the deletion of a data-product that registered consumers haven't
+ * read. Logs a warning about such a consumer at most once per
+ * CONS_WARN_INTERVAL seconds. Frees the entry of a consumer whose process has
+ * terminated. The control-region must be locked for writing.
+ *
+ * @param[in,out] pq          The product-queue.
+ * @param[in]     insertTime  Insertion-time of the deleted data-product.
+ */
+static void
+cons_overrun(
+        pqueue* const           pq,
+        const timestampt* const insertTime)
+{
+    pqctl* const ctlp = pq->ctlp;
+
+    if (ctlp->cons_magic != CONS_MAGIC)
+        return;
+
+    for (int i = 0; i < PQ_MAXCONSUMERS; i++) {
+        conselem* const  cep = ctlp->cons + i;
+        pid_t            pid = __atomic_load_n(&cep->pid, __ATOMIC_ACQUIRE);
+
+        if (pid == 0)
+            continue;
+
+        const timestampt cursor = cons_cursor(cep);
+
+        if (tvIsNone(cursor) || !tvCmp(*insertTime, cursor, >))
+            continue;
+
+        const time_t now = time(NULL);
+        if (now - cep->warned >= CONS_WARN_INTERVAL) {
+            if (kill(pid, 0) && errno == ESRCH) {
+                (void)__atomic_compare_exchange_n(&cep->pid, &pid, 0, false,
+                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+                continue;
+            }
+            cep->warned = now;
+            log_warning_q("Deleted data-product not yet read by consumer %ld: "
+                    "%.0f s behind, %llu such products so far", (long)pid,
+                    d_diff_timestamp(insertTime, &cursor),
+                    (unsigned long long)cep->overruns + 1);
+        }
+        cep->overruns++;
+        ctlp->cons_overruns++;
+    }
+}
+
+/**
+ * Deletes the oldest product in a product queue that is not locked.  In the
+ * unlikely event that all the products in the queue are locked or a deadlock
+ * is detected, returns an error status other than ENOERR.  Sets the "isFull",
+ * "minVirtResTime", "mvrtSize", and "mvrtSlots" members of the product-queue
+ * control block on success.
+ *
+ * @param[in] pq          Pointer to the product-queue object.  Shall not be
+ *                        NULL.
+ * @retval    0           Success.  "pq->ctlp->isFull" set to true.
+ * @retval    EACESS      No unlocked products left to delete. Error-message
+ *                        logged.
+ * @retval    PQ_CORRUPT  The product-queue is corrupt. Error message logged.
+ * @retval    PQ_SYSTEM   System error. Error-message logged.
+ */
+static int
+pq2_del_oldest(
+    pqueue* const pq)
+{
+    int status = EACCES;
+
+    log_assert(pq != NULL);
+    log_assert(pq->ctlp != NULL && pq->tqp != NULL);
+
+    /* Delete the oldest unlocked data-product. */
+    size_t  rlix;
+    for (tqelem* tqep = tqe_first(pq->tqp);
+            tqep && (rlix = rl_find(pq->rlp, tqep->offset)) != RL_NONE;
+            tqep = tq_next(pq->tqp, tqep)) {
+        prod_info  info;
+        timestampt insertionTime = tqep->tv;
+        status = pq2_try_del_prod(pq, tqep, rlix, &info);
+        if (status == 0) {
+            if (pq->esp)
+                es_add(pq->esp, info.signature, time(NULL));
+            cons_overrun(pq, &insertionTime);
+            pq->ctlp->isFull = 1; // Mark the queue as full.
+            /* Adjust the minimum virtual residence time. */
+            pq2_set_mvrt(pq, &insertionTime, &info);
+            xdr_free(xdr_prod_info, (char*)&info);
+            return 0;
+        }
+        if (status != EACCES)
+            return status;
+    }
+
+    log_error_q("no unlocked products left to delete!");
+
+    return status;
+
+#if 0
+    tqelem*             tqep = tqe_first(pq->tqp);
+    int                 status = ENOERR;
+    void*               vp = NULL;
+    region*             rep = NULL;
+    size_t              rlix;
+
+    rlix = rl_find(pq->rlp, tqep->offset);
+    log_assert(rlix != RL_NONE);
+    rep = pq->rlp->rp + rlix;
+    status = rgn_get(pq, rep->offset, Extent(rep), RGN_WRITE|RGN_NOWAIT, &vp);
+
+    while (status != ENOERR) {
+        /*
+         * The current data-product is locked.  Try the next one.
+         */
+        tqep = tq_next(pq->tqp, tqep);
+        rlix = rl_find(pq->rlp, tqep->offset);
+
+        if (rlix == RL_NONE) {
+            log_error_q("no unlocked products left to delete!");
+            break;
+        }
+
+        rep = pq->rlp->rp + rlix;
+        status =
+            rgn_get(pq, rep->offset, Extent(rep), RGN_WRITE|RGN_NOWAIT, &vp);
+    }
+
+    if (status == ENOERR) {
+        /*
+         * Got the data region.  Start releasing associated entries.
+         */
+        off_t           offset = rep->offset;
+        unsigned char*  signature;
+        InfoBuf         infoBuf;
+
+        /*
+         * Get the metadata of the data-product.
+         */
+        (void)xinfo_i(vp, Extent(rep), XDR_DECODE, ib_init(&infoBuf));
+
+        /*
+         * Set the minimum virtual residence time metrics if appropriate.
+         */
+        {
+            const timestampt*           creationTime = &infoBuf.info.arrival;
+            const timestampt* const     receptionTime = &tqep->tv;
+            timestampt                  now;
+
+            /*
+             * If the product was received before it was created, then use the
+             * product's reception-time as its creation-time in the computation
+             * of the product's virtual residence-time.
+             */
+            if ((TV_CMP_LT(*receptionTime, *creationTime))) {
+                creationTime = receptionTime;
+            }
+
+            (void)set_timestamp(&now);
+
+            /*
+             * Compute the product's residence time only if the product was
+             * created before now.
+             */
+            if (TV_CMP_LT(*creationTime, now)) {
+                timestampt      virtResTime =
+                    diff_timestamp(&now, creationTime);
+
+                if (tvIsNone(pq->ctlp->minVirtResTime) ||
+                        (TV_CMP_LT(virtResTime, pq->ctlp->minVirtResTime)))  {
+                    log_info_q("pq_del_oldest(): MVRT product: %s",
+                            s_prod_info(NULL, 0, &infoBuf.info, ulogIsDebug()));
+                    pq->ctlp->minVirtResTime = virtResTime;
+                    pq->ctlp->mvrtSize = pq->rlp->nbytes;
+                    pq->ctlp->mvrtSlots = pq->rlp->nelems;
+                }
+            }
+        }
+
+        /*
+         * Remove the corresponding entry from the time-list.
+         */
+        tq_delete(pq->tqp, tqep);
+
+        /*
+         * Remove the corresponding entry from the signature-list.
+         */
+        signature = infoBuf.info.signature;
+
+        if (sx_find_delete(pq->sxp, signature) == 0) {
+            log_error_q("signature %s: Not Found",
+                    s_signaturet(NULL, 0, signature));
+            status = EINVAL;
+        }
+
+        /*
+         * Remove the corresponding entry from the region-list.
+         */
+        pq_freeRegion(pq, rlix);
+
+        /*
+         * Release the data region.
+         */
+        (void) rgn_rel(pq, offset, 0);
+
+        /*
+         * Mark the queue as full.
+         */
+        pq->ctlp->isFull = 1;
+    }                                   /* got data region */
+
+    return status;
+#endif
+}
+
+
+/******************************************************************************
+ * Lower-Level Reserved Product-Region Functions:
+ ******************************************************************************/
+
+
+/*
+ * Free a region, by offset
+ */
+static int
+rpqe_free(pqueue *pq, off_t offset, signaturet signature)
+{
+        region *rp = NULL;
+        size_t rlix;
+
+        rlix = rl_find(pq->rlp, offset);
+        if(rlix == RL_NONE)
+        {
+                log_error_q("offset 0x%08lx: Not Found", (long)offset);
+                return EINVAL;
+        }
+        rp = pq->rlp->rp + rlix;
+        if(IsFree(rp))
+        {
+                log_error_q("0x%08lx: Already free", (long)offset);
+                return EINVAL;
+        }
+
+        if(sx_find_delete(pq->sxp, signature) == 0)
+        {
+                log_error_q("signature %s: Not Found",
+                        s_signaturet(NULL, 0, signature));
+                return EINVAL;
+        }
+        pq_freeRegion(pq, rlix);
+
+        return ENOERR;
+}
+
+
+/**
+ * Delete oldest elements until you have space for 'extent' Returns in *rixp the
+ * region list index for a suitable region. Increments the number of regions in
+ * use if successful.
+ *
+ * @retval    0           Success.
+ * @retval    ENOMEM      No data-products to delete.
+ * @retval    EACESS      No unlocked products left to delete. Error-message
+ *                        logged.
+ * @retval    PQ_CORRUPT  The product-queue is corrupt. Error message logged.
+ * @retval    PQ_SYSTEM   System error. Error-message logged.
+ */
+static int
+rpqe_mkspace(pqueue *const pq, size_t const extent, size_t *rixp)
+{
+        size_t rlix;
+
+        log_debug("%s:rpqe_mkspace(): Deleting oldest to make space for %ld bytes",
+                __FILE__, (long)extent);
+
+        for (;;) {
+                /* Regions of the size-classes might merge into enough space */
+                if(pq->clp && pq->clp->nregions) {
+                        (void)cl_drain(pq->clp, pq->rlp);
+                        rlix = rl_get(pq->rlp, extent);
+                        if(rlix != RL_NONE)
+                                break;
+                }
+                if(pq->rlp->nelems == 0)
+                        return ENOMEM;
+
+                int status = pq2_del_oldest(pq);
+
+                if(status != ENOERR)
+                        return status;
+                pq->ctlp->alloc_evictions++;
+
+                rlix = rl_get(pq->rlp, extent);
+                if(rlix != RL_NONE)
+                        break;
+        }
+
+        *rixp = rlix;
+
+        return ENOERR;
+}
+
+/**
+ * Delete oldest elements until a consolidation has occurred, making
+ * an rl element available.  If this gets called much, you didn't
+ * allocate enough product slots or a big enough queue.
+ *
+ * @retval    0           Success.
+ * @retval    ENOMEM      No data-products to delete.
+ * @retval    EACESS      No unlocked products left to delete. Error-message
+ *                        logged.
+ * @retval    PQ_CORRUPT  The product-queue is corrupt. Error message logged.
+ * @retval    PQ_SYSTEM   System error. Error-message logged.
+ */
+static int
+rpqe_mkslot(pqueue *const pq)
+{
+        /* LOG_NOTICE("Deleting oldest to get a queue slot"); */
+
+        do {
+                /* Regions of the size-classes might merge into free slots */
+                if(pq->clp && pq->clp->nregions) {
+                        (void)cl_drain(pq->clp, pq->rlp);
+                        if(rl_HasSpace(pq->rlp))
+                                break;
+                }
+                if(pq->rlp->nelems == 0)
+                        return ENOMEM;
+
+                int status = pq2_del_oldest(pq);
+
+                if(status != ENOERR)
+                        return status;
+                pq->ctlp->alloc_evictions++;
+
+        } while (!rl_HasSpace(pq->rlp)) ;
+
+        return ENOERR;
+}
+
+/**
+ * Gets a region of a size-class, deleting the oldest data-products if
+ * necessary. Returns in *rixp the region list index of the region. Increments
+ * the number of regions in use if successful.
+ *
+ * @retval    0           Success.
+ * @retval    ENOMEM      No data-products to delete.
+ * @retval    EACESS      No unlocked products left to delete. Error-message
+ *                        logged.
+ * @retval    PQ_CORRUPT  The product-queue is corrupt. Error message logged.
+ * @retval    PQ_SYSTEM   System error. Error-message logged.
+ */
+static int
+rpqe_mkclass(pqueue *const pq, size_t const c, size_t *rixp)
+{
+        size_t rlix;
+
+        while((rlix = cl_get(pq->clp, pq->rlp, c, pq->ctlp->align)) ==
+                        RL_NONE) {
+                /* The regions of the other classes might merge into a slab */
+                if(pq->clp->nregions) {
+                        (void)cl_drain(pq->clp, pq->rlp);
+                        continue;
+                }
+                if(pq->rlp->nelems == 0)
+                        return ENOMEM;
+
+                int status = pq2_del_oldest(pq);
+
+                if(status != ENOERR)
+                        return status;
+                pq->ctlp->alloc_evictions++;
+        }
+
+        *rixp = rlix;
+
+        return ENOERR;
+}
+
+
+#ifdef HAVE_MMAP
+/*
+ * Takes a free region for a chunked data-product: splits off any remainder,
+ * marks the region as in use, and updates the statistics.
+ *
+ * @retval 0       Success
+ * @retval ENOMEM  No empty slot for the remainder. `log_add()` called.
+ */
+static int
+ck_take(pqueue *const pq, const size_t rlix, const size_t extent)
+{
+        region* const hit = pq->rlp->rp + rlix;
+
+        log_assert(IsFree(hit));
+        if (hit->extent >= extent + MIN_RGN_SIZE) {
+            int status = rl_split(pq->rlp, rlix, extent);
+            if (status) {
+                rl_put(pq->rlp, rlix);
+                return status;
+            }
+        }
+
+        set_IsAlloc(hit);
+        rlhash_add(pq->rlp, rlix);
+
+        const off_t highwater = hit->offset + (off_t)Extent(hit) -
+                pq->ctlp->datao;
+        if (highwater > pq->ctlp->highwater)
+            pq->ctlp->highwater = highwater;
+        pq->rlp->nbytes += (off_t)Extent(hit);
+        if (pq->rlp->nbytes > pq->rlp->maxbytes)
+            pq->rlp->maxbytes = pq->rlp->nbytes;
+
+        return 0;
+}
+
+/**
+ * Allocates the regions of a chunked data-product: one for the chunk map and
+ * one for each chunk. Deletes the oldest data-products, as necessary. The
+ * region of the chunk map is indexed and locked like that of a contiguous
+ * data-product, and the returned memory is the data-product as if it were
+ * contiguous (see `ck_attach()`). Called by `rpqe_new()` when there's no free
+ * region large enough for the data-product.
+ *
+ * @param[in]  pq      The product-queue.
+ * @param[in]  extent  The size of the product in bytes.
+ * @param[in]  sxi     The signature of the product or NULL.
+ * @param[out] vpp     Pointer to the start of the data-product.
+ * @param[out] sxepp   Pointer to the new signature entry.
+ * @return             See `rpqe_new()`.
+ */
+static int
+rpqe_newChunked(pqueue *pq, const size_t extent, const signaturet sxi,
+        void **vpp, sxelem **sxepp)
+{
+    const size_t  align = pq->ctlp->align;
+    const size_t  nchunks = ck_count(extent);
+    /* So that a chunk's data can start on a page boundary */
+    const size_t  slop = pq->pagesz > align ? pq->pagesz - align : 0;
+    size_t* const rlixs = malloc((nchunks + 1) * sizeof(size_t));
+    size_t        ntaken = 0;
+    int           status = ENOERR;
+    ckmap*        map;
+
+    if (rlixs == NULL) {
+        log_error_q("Couldn't allocate %lu region indexes",
+                (unsigned long)nchunks + 1);
+        return ENOMEM;
+    }
+
+    /* Every region might need an empty slot for its remainder */
+    while (pq->rlp->nempty < 2*(nchunks + 1)) {
+        if (pq->rlp->nelems == 0) {
+            status = ENOMEM;
+            goto failure;
+        }
+        status = pq2_del_oldest(pq);
+        if (status)
+            goto failure;
+        pq->ctlp->alloc_evictions++;
+    }
+
+    /* The region of the chunk map is first */
+    for (size_t i = 0; i <= nchunks; i++) {
+        size_t rgnsz;
+
+        if (i == 0) {
+            rgnsz = _RNDUP(ck_mapSize(nchunks), align);
+        }
+        else {
+            const size_t rest = extent - (i - 1)*CK_SIZE;
+            rgnsz = _RNDUP(rest < CK_SIZE ? rest : CK_SIZE, align) + slop;
+        }
+        if (rgnsz < MIN_RGN_SIZE)
+            rgnsz = MIN_RGN_SIZE;
+
+        size_t rlix = rl_get(pq->rlp, rgnsz);
+        if (rlix == RL_NONE) {
+            status = rpqe_mkspace(pq, rgnsz, &rlix);
+            if (status)
+                goto failure;
+        }
+        status = ck_take(pq, rlix, rgnsz);
+        if (status)
+            goto failure;
+        rlixs[ntaken++] = rlix;
+    }
+
+    region* const head = pq->rlp->rp + rlixs[0];
+    size_t        size = Extent(head);
+    void*         vp;
+
+    /*
+     * The region is gotten directly because the chunk map must be written
+     * before the region is flagged as holding one and attached.
+     */
+    status = (pq->ftom)(pq, head->offset, size, RGN_WRITE, &vp);
+    if (status)
+        goto failure;
+
+    map = vp;
+    map->magic = htonl(CK_MAGIC);
+    map->nchunks = (uint32_t)nchunks;
+    map->size = extent;
+    for (size_t i = 0; i < nchunks; i++)
+        map->offsets[i] = pq->rlp->rp[rlixs[i+1]].offset;
+    set_IsChunked(head);
+
+    status = ck_attach(pq, head->offset, RGN_WRITE, &vp, &size);
+    if (status) {
+        log_flush_error();
+        (void)(pq->mtof)(pq, head->offset, 0);
+        goto failure;
+    }
+
+    if (sxi) {
+        sxelem* const sxelem = sx_add(pq->sxp, sxi, head->offset);
+        if (sxelem == NULL) {
+            log_error_q("sx_add() failure");
+            (void)rgn_rel(pq, head->offset, 0);
+            status = ENOMEM;
+            goto failure;
+        }
+        *sxepp = sxelem;
+    }
+
+    if (pq->rlp->nelems >  pq->ctlp->maxproducts)
+        pq->ctlp->maxproducts = pq->rlp->nelems;
+    pq->ctlp->alloc_inserts++;
+    free(rlixs);
+    *vpp = vp;
+
+    return 0;
+
+failure:
+    while (ntaken > 0)
+        pq_freeRegion(pq, rlixs[--ntaken]);
+    free(rlixs);
+    return status;
+}
+#endif /* HAVE_MMAP */
+
+
+/**
+ * Allocate a new region for a data-product from the data section (which may
+ * eventually get handed to the user). Delete products in the queue, as
+ * necessary, in order to make room. If successful, then
+ * - A new region is added to the regions-in-use list;
+ * - The number of regions in use is incremented;
+ * - The number of bytes in use is incremented;
+ * - The maximum number of regions in use is updated;
+ * - The maximum number of bytes in use is updated;
+ * - The data portion of the region is locked.
+ *
+ * @param[in]  pq      The product-queue.
+ * @param[in]  extent  The size of the product in bytes.
+ * @param[in]  sxi     The signature of the product.
+ * @param[out] vpp     Pointer to the start of the data region.
+ * @param[out] sxepp   Pointer to the existing signature entry if the product
+ *                     already exists in the product-queue.
+ * @retval PQ_DUP      A product with the same signature already exists in the
+ *                     product-queue.
+ * @retval PQ_CORRUPT  The product-queue is corrupt. Error message logged.
+ * @retval PQ_SYSTEM   System error. Error-message logged.
+ * @retval ENOMEM      Insufficient memory is available.
+ * @retval ENOMEM      There is insufficient room in the address space to effect
+ *                     the necessary mapping.
+ * @retval EACESS      No unlocked products left to delete.
+ * @retval EAGAIN      A mapping could not be locked in memory, if required by
+ *                     mlockall(), due to a lack of resources.
+ * @retval EDEADLK     The region's lock is blocked by some lock from another
+ *                     process and putting the calling process to sleep, waiting
+ *                     for that lock to become free would cause a deadlock.
+ * @retval EFBIG or EINVAL
+ *                     The `extent` argument was greater than the maximum file
+ *                     size.
+ * @retval EINTR       A signal was caught during execution.
+ * @retval EINVAL      `extent` is not valid, or "pq->fd" refers to a file
+ *                     that does not support locking.
+ * @retval EIO         An I/O error occurred while reading from the file system.
+ * @retval EMFILE      The number of mapped regions would exceed an
+ *                     implementation-dependent limit (per process or per
+ *                     system).
+ * @retval ENODEV      `pq->fd` refers to a file whose type is not supported by
+ *                     `mmap()`.
+ * @retval ENOLCK      Satisfying the request would result in the number of
+ *                     locked regions in the system exceeding a system-imposed
+ *                     limit.
+ */
+static int
+rpqe_new(pqueue *pq, size_t extent, const signaturet sxi,
+        void **vpp, sxelem **sxepp)
+{
+    int           status = ENOERR;
+    size_t        rlix;            /* region list index */
+    region*       hit = NULL;
+    static size_t smallest_extent_seen = UINT_MAX;
+
+    /*
+     * Check for duplicate
+     */
+    // log_debug_1("Checking for duplicate");
+    if (sxi && sx_find(pq->sxp, sxi, sxepp) != 0) {
+        log_debug("PQ_DUP");
+        return PQ_DUP;
+    }
+    if (sxi && pq->esp && es_find(pq->esp, sxi, time(NULL))) {
+        log_debug("PQ_DUP of evicted product");
+        pq->esp->nlate++;
+        return PQ_DUP;
+    }
+
+#ifdef HAVE_MMAP
+    if (fIsSet(pq->pflags, PQ_CHUNKED) && extent > CK_SIZE &&
+            pq->ftom != f_ftom &&
+            _RNDUP(extent, pq->ctlp->align) > pq->rlp->maxfextent)
+        return rpqe_newChunked(pq, extent, sxi, vpp, sxepp);
+#endif
+
+    /* We may need to split what we find */
+    if (!rl_HasSpace(pq->rlp)) {
+        /* get one slot */
+        // log_debug_1("Making a slot");
+        status = rpqe_mkslot(pq);
+        if (status != ENOERR)
+            return status;
+    }
+
+    extent = _RNDUP(extent, pq->ctlp->align);
+    if (extent < smallest_extent_seen)
+        smallest_extent_seen = extent;
+
+    const size_t  c = pq->clp ? cl_ceil(extent, pq->ctlp->align) : CL_NCLASSES;
+
+    // log_debug_1("Getting a region");
+    if (c < CL_NCLASSES) {
+        /* A region of a size-class has the class's extent */
+        status = rpqe_mkclass(pq, c, &rlix);
+        if (status != ENOERR)
+            return status;
+    }
+    else {
+        rlix = rl_get(pq->rlp, extent);
+        if (rlix == RL_NONE) {
+            status = rpqe_mkspace(pq, extent, &rlix);
+            if (status != ENOERR)
+                return status;
+        }
+    }
+    hit = pq->rlp->rp + rlix;
+    log_assert(IsFree(hit));
+    #define PQ_FRAGMENT_HEURISTIC 64
+    /* Don't bother to split off tiny fragments too small for any
+       product we've seen */
+    if (c == CL_NCLASSES &&
+            extent + smallest_extent_seen + PQ_FRAGMENT_HEURISTIC < hit->extent) {
+        // log_debug_1("Splitting region");
+        status = rl_split(pq->rlp, rlix, extent);
+        if (status != ENOERR)
+            goto rl_split_failure;
+    }
+
+    log_assert((hit->offset % pq->ctlp->align) == 0);
+    set_IsAlloc(hit);
+    // log_debug_1("Adding region hash");
+    rlhash_add(pq->rlp, rlix);
+
+    /*
+     * The region is gotten directly because its previous content mustn't be
+     * taken for a chunk map.
+     */
+    status = (pq->ftom)(pq, hit->offset, Extent(hit), RGN_WRITE, vpp);
+    if (status != ENOERR)
+        goto rgn_get_failure;
+
+    if (sxi) {
+        // log_debug_1("Adding signature");
+        sxelem* const sxelem = sx_add(pq->sxp, sxi, hit->offset);
+        if (sxelem == NULL) {
+            log_error_q("sx_add() failure");
+            status = ENOMEM;
+            goto sx_add_failure;
+        }
+        *sxepp = sxelem;
+    }
+
+    /* Update stats */
+    off_t         highwater = hit->offset + (off_t)Extent(hit) -
+            pq->ctlp->datao;
+    if (highwater > pq->ctlp->highwater)
+        pq->ctlp->highwater = highwater;
+    if (pq->rlp->nelems >  pq->ctlp->maxproducts)
+        pq->ctlp->maxproducts = pq->rlp->nelems;
+    pq->rlp->nbytes += (off_t)Extent(hit);
+    if (pq->rlp->nbytes > pq->rlp->maxbytes)
+        pq->rlp->maxbytes = pq->rlp->nbytes;
+    pq->ctlp->alloc_inserts++;
+
+    return status;
+
+    sx_add_failure:
+        // log_debug_1("Releasing region");
+        (void)rgn_rel(pq, hit->offset, 0); // region's data portion unmodified
+    rgn_get_failure:
+        // log_debug_1("Deleting region hash");
+        rlhash_del(pq->rlp, rlix);
+        clear_IsAlloc(hit);
+    rl_split_failure:
+        // log_debug_1("Unsplitting region");
+        if (c < CL_NCLASSES) {
+            cl_put(pq->clp, pq->rlp, rlix, pq->ctlp->align); // undoes `rpqe_mkclass()`
+        }
+        else {
+            rl_put(pq->rlp, rlix); // undoes `rl_get()` and `rpqe_mkspace()`
+        }
+        return status;
+}
+
+
+/******************************************************************************
+ * Control-Header Functions:
+ ******************************************************************************/
+
+/*
+ * The 'ctl_xxx' functions deal with pqctl pq->ctlp AND
+ * the indexes pq->rlp, pq->tqp, pq->sxp, pq->fbp via ixXXX.
+ * Accesses to these areas operate on a single lock, the lock
+ * on (0, pgsz), ctlp.
+ */
+
+/*
+ * The generation-counter `write_gen` in the pqctl is odd while a writer holds
+ * the control-region and is incremented when the writer releases it. This
+ * lets pq_sequenceHelper() read the indexes without locking the control-region
+ * and detect an intervening writer (a "seqlock").
+ */
+
+/*
+ * Writes the generation-counter to the file if the control-region is a
+ * private copy.
+ */
+static void
+ctl_writeGen(pqueue *const pq)
+{
+        if(pq->ftom == f_ftom)
+                (void)pwrite(pq->fd, &pq->ctlp->write_gen,
+                                sizeof(pq->ctlp->write_gen),
+                                offsetof(pqctl, write_gen));
+}
+
+/*
+ * Marks the indexes as being modified. The control-region must be held for
+ * writing.
+ */
+static void
+ctl_beginWrite(pqueue *const pq)
+{
+        uint32_t gen = pq->ctlp->write_gen;
+
+        if(!(gen & 1)) /* else a previous writer terminated */
+                __atomic_store_n(&pq->ctlp->write_gen, gen + 1,
+                                __ATOMIC_RELAXED);
+        /* the counter must be seen to change before the indexes do */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        ctl_writeGen(pq);
+        fSet(pq->pflags, PQ_CTLWRITE);
+}
+
+/*
+ * Marks the indexes as no longer being modified. The indexes must have been
+ * written.
+ */
+static void
+ctl_endWrite(pqueue *const pq)
+{
+        __atomic_store_n(&pq->ctlp->write_gen, (pq->ctlp->write_gen | 1) + 1,
+                        __ATOMIC_RELEASE);
+        ctl_writeGen(pq);
+        fClr(pq->pflags, PQ_CTLWRITE);
+}
+
+/**
+ * Release the ctl lock and write back any changes.
+ *
+ * @retval EINVAL     The region could not be found in the list of in-use
+ *                    regions.
+ * @retval EBADF      The product-queue's file descriptor is invalid.
+ * @retval EOVERFLOW  The (offset + extent) specification of the region is
+ *                    invalid.
+ */
+static int
+ctl_rel(pqueue *const pq, const int rflags)
+{
+        int status = ENOERR;
+
+        log_assert(pq->ctlp != NULL);
+        log_assert(pq->ixp != NULL);
+
+        if(pq->ixp != NULL)
+        {
+                status = (pq->mtof)(pq, pq->ixo, rflags|RGN_NOLOCK);
+                if(status != ENOERR)
+                        log_error_q("mtof ix: %s", strerror(status));
+                pq->ixp = NULL;
+                pq->rlp = NULL;
+                pq->tqp = NULL;
+                pq->sxp = NULL;
+                pq->esp = NULL;
+                pq->clp = NULL;
+                pq->fbp = NULL;
+        }
+
+        if(pq->ctlp != NULL && fIsSet(pq->pflags, PQ_CTLWRITE))
+                ctl_endWrite(pq); /* after the index is written */
+        
+        if(pq->ctlp != NULL)
+        {
+                status = (pq->mtof)(pq, 0, rflags);
+                if(status != ENOERR)
+                        log_error_q("mtof ctl: %s", strerror(status));
+                pq->ctlp = NULL;
+        }
+
+        if(fIsSet(pq->pflags, PQ_SIGSBLOCKED))
+        {
+                /* something was set, end critical section */
+                sigset_t sav_set = pq->sav_set;
+
+                (void)sigemptyset(&pq->sav_set);
+                fClr(pq->pflags, PQ_SIGSBLOCKED);
+
+                (void) pthread_sigmask(SIG_SETMASK, &sav_set, NULL);
+        }
+
+        return status;
+}
+
+
+/*
+ * Initialize the on disk state (ctl and indexes) of a
+ * new queue file. Called by pq_create().
+ */
+static int
+ctl_init(pqueue *const pq, size_t const align)
+{
+        int status = ENOERR;
+        void *vp = NULL;
+        size_t nalloc;
+
+        log_assert(pq != NULL);
+        log_assert(pq->pagesz != 0);
+        log_assert(pq->datao > 0);
+        log_assert(pq->datao % pq->pagesz == 0);
+        log_assert(pq->ixo > pq->datao);
+        log_assert(pq->ixo % pq->pagesz == 0);
+        log_assert(pq->ixsz >= pq->pagesz);
+        log_assert(pq->ixsz % pq->pagesz == 0);
+        log_assert(align != 0);
+
+        /*
+         * The following isn't a critical section that's protected by
+         * `pthread_sigmask(SIG_BLOCK,...)` because any error (including EINTR)
+         * unlinks the created file.
+         */
+
+        /*
+         * bring in the pqctl
+         * N.B. No wait. Another lock implies create collision, error
+         */
+        status = (pq->ftom)(pq,
+                         0, (size_t)pq->datao, RGN_WRITE|RGN_NOWAIT, &vp);
+#ifdef HAVE_MMAP
+        if(status == EIO && (pq->ftom == mm_ftom || pq->ftom == mm0_ftom))
+        {
+                log_notice_q("EIO => remote file system");
+                /* try again */
+                pq->ftom = f_ftom;
+                pq->mtof = f_mtof;
+                status = (pq->ftom)(pq,
+                        0, (size_t)pq->datao, RGN_WRITE|RGN_NOWAIT, &vp);
+        }
+#endif
+        if(status != ENOERR)
+                return status;
+
+        pq->ctlp = (pqctl *)vp;
+        pq->ctlp->magic = PQ_MAGIC;
+        pq->ctlp->ix_magic = IX_MAGIC;
+        pq->ctlp->ix_formats = pq_ixFormats(pq->pflags);
+        pq->ctlp->version = pq->ctlp->ix_formats ? PQ_VERSION_IX : PQ_VERSION;
+        pq->ctlp->write_count_magic = WRITE_COUNT_MAGIC;
+        pq->ctlp->write_count = 1;              /* this process is writer */
+        pq->ctlp->datao = pq->datao;
+        pq->ctlp->ixo = pq->ixo;
+        pq->ctlp->ixsz = pq->ixsz;
+        pq->ctlp->nalloc = pq->nalloc;
+        pq->ctlp->highwater = 0;
+        pq->ctlp->maxproducts = 0;
+        pq->ctlp->align = align;
+        pq->ctlp->metrics_magic = METRICS_MAGIC;
+        pq->ctlp->mostRecent = TS_NONE;
+        pq->ctlp->minVirtResTime = TS_NONE;
+        pq->ctlp->isFull = 0;
+        pq->ctlp->metrics_magic_2 = METRICS_MAGIC_2;
+        pq->ctlp->mvrtSize = -1;
+        pq->ctlp->mvrtSlots = 0;
+        pq->ctlp->notify_magic = NOTIFY_MAGIC;
+        pq->ctlp->notify_sigcont = fIsSet(pq->pflags, PQ_SIGCONT) ? 1 : 0;
+        pq->ctlp->insert_seq = 0;
+        pq->ctlp->lock_magic = LOCK_MAGIC;
+        pq->ctlp->lock_robust = fIsSet(pq->pflags, PQ_ROBUST) ? 1 : 0;
+        pq->ctlp->write_gen_magic = WRITE_GEN_MAGIC;
+        pq->ctlp->write_gen = 0;
+        pq->ctlp->alloc_magic = ALLOC_MAGIC;
+        pq->ctlp->alloc_inserts = 0;
+        pq->ctlp->alloc_evictions = 0;
+        pq->ctlp->cons_magic = CONS_MAGIC;
+        pq->ctlp->cons_overruns = 0;
+        (void)memset(pq->ctlp->cons, 0, sizeof(pq->ctlp->cons));
+        pq->ctlp->zip_magic = ZIP_MAGIC;
+        pq->ctlp->zip_feeds = pq->zipfeeds;
+        pq->ctlp->zip_in = 0;
+        pq->ctlp->zip_out = 0;
+        pq->ctlp->lstat_magic = LSTAT_MAGIC;
+        (void)memset(pq->ctlp->lstat, 0, sizeof(pq->ctlp->lstat));
+#ifdef PQ_HAVE_RWL
+        if(pq->ctlp->lock_robust)
+        {
+                status = rwl_init(&pq->ctlp->lock);
+                if(status != ENOERR)
+                {
+                        (void)(pq->mtof)(pq, 0, 0);
+                        return status;
+                }
+        }
+#endif
+
+        /* bring in the indexes */
+        status = (pq->ftom)(pq,
+                         pq->ixo, pq->ixsz, RGN_WRITE|RGN_NOLOCK, &pq->ixp);
+        if(status != ENOERR)
+        {
+                (void)(pq->mtof)(pq, 0, 0);
+                return status;
+        }
+
+        (void)ix_ptrs(pq->ixp, pq->ixsz, pq->nalloc, align,
+                pq->ctlp->ix_formats, &pq->rlp, &pq->tqp, &pq->fbp, &pq->sxp,
+                &pq->esp, &pq->clp);
+        nalloc = pq->nalloc;    /* ix_ptrs computed this in version 3 */
+
+        /* initialize fb for skip list blocks */
+        fb_init(pq->fbp, nalloc);
+
+        /* initialize tqueue */
+        tq_init(pq->tqp, nalloc, pq->fbp,
+                pq->ctlp->ix_formats & IX_TQRING,
+                pq->ctlp->ix_formats & IX_TQFEED);
+        pq->tqfp = ix_tqFeeds(pq->tqp, pq->ctlp->ix_formats);
+
+        /* initialize regionl, adding one huge region for data */
+        rl_init(pq->rlp, nalloc, pq->fbp);
+        if (pq->clp)
+                cl_init(pq->clp);
+        {
+                off_t  datasz = pq->ixo - pq->datao;
+
+                if (~(size_t)0 < datasz) {
+                    log_error_q("Data portion of file is too big for one region");
+                    return EFBIG;
+                }
+                {
+                    size_t extent0 = (size_t)datasz;
+                    region *rp = rl_add(pq->rlp, pq->datao, extent0);
+
+                    pq->rlp->maxfextent = extent0;
+                    log_assert(rp != NULL
+                            && rp->offset == pq->datao
+                            && rp->extent == extent0);
+                }
+        }
+
+        sx_init(pq->sxp, nalloc, pq->ctlp->ix_formats & IX_SXOPEN);
+        if (pq->esp)
+                es_init(pq->esp, nalloc);
+        
+        return status;
+}
+
+/*
+ * Sets the functions to be used to access the product-queue.
+ *
+ * Arguments:
+ *      pq      Pointer to product-queue structure.  The following members
+ *              must be set to their final values: pflags, ixo, ixsz.
+ */
+static void
+ctl_setAccessFunctions(
+    pqueue* const       pq)
+{
+    const int           pflags = pq->pflags;
+
+    log_assert(NULL != pq);
+
+#ifdef HAVE_MMAP
+    if (fIsSet(pflags, PQ_NOMAP)) {
+#endif
+        /*
+         * The product-queue will be accessed via read() and write().
+         */
+        pq->ftom = f_ftom;
+        pq->mtof = f_mtof;
+#ifdef HAVE_MMAP
+    }
+    else {
+        if (fIsSet(pflags, PQ_MAPRGNS) || isProductMappingNecessary(pq)) {
+            /*
+             * The product-queue will be accessed by being memory-mapped
+             * on a region-by-region basis.
+             */
+            pq->ftom = mm_ftom;
+            pq->mtof = mm_mtof;
+        }
+        else
+        {
+            /*
+             * The product-queue will be accessed by being memory-mapped
+             * once, in its entirety.
+             */
+            pq->ftom = mm0_ftom;
+            pq->mtof = mm0_mtof;
+        }
+    }
+#endif
+}
+
+
+/*
+ * Initialize the in-memory state of pq from an existing file. Called by
+ * pq_open().  On successful return, the control region (pq->ctlp) will be
+ * mapped and/or locked.
+ *
+ * Arguments:
+ *      pq      Pointer to product-queue structure to be set.
+ *      path    Pathname of product-queue.
+ *
+ * Returns:
+ *      0           Success
+ *      PQ_CORRUPT  The  product-queue is internally inconsistent.
+ *      else        <errno.h> error-code.
+ */
+static int
+ctl_gopen(pqueue *const pq, const char *path)
+{
+        int status = ENOERR;
+        pqctl *ctlp;
+        size_t ctlsz; 
+        void *vp = NULL;
+
+        log_assert(pq != NULL);
+        log_assert(pq->pagesz > 0);
+        log_assert(pq->ixp == NULL && pq->rlp == NULL && pq->tqp == NULL);
+
+        ctlsz = pq->pagesz;
+
+        /*FALLTHROUGH*/
+remap:
+        status = (pq->ftom)(pq, 0, ctlsz, 0, &vp);
+#ifdef HAVE_MMAP
+        if(status == EIO && (pq->ftom == mm_ftom || pq->ftom == mm0_ftom))
+        {
+                log_warning_q("Product-queue can't be memory-mapped!  "
+                    "Continuing with slower read/write I/O.");
+                /* try again */
+                pq->ftom = f_ftom;
+                pq->mtof = f_mtof;
+                status = (pq->ftom)(pq, 0, ctlsz, 0, &vp);
+        }
+#endif
+        if(status != ENOERR)
+                return status;
+
+        ctlp = (pqctl *)vp;
+        if(ctlp->magic != PQ_MAGIC)
+        {
+                /* Not a product queue */
+                log_error_q("%s: Not a product queue", path);
+                status = EINVAL;
+                goto unwind_map;
+        }
+        if (PQ_VERSION != ctlp->version && PQ_VERSION_IX != ctlp->version)
+        {
+                log_error_q("%s: Product queue is version %d instead of expected version %d",
+                       path, ctlp->version, PQ_VERSION);
+                status = EINVAL;
+                goto unwind_map;
+        }
+        if(ctlp->datao % pq->pagesz != 0)
+        {
+                /* Can't align */
+                /* TODO: If we use read()/write() not fatal ??? */
+                log_error_q("%s: Can't align", path);
+                status = EINVAL;
+                goto unwind_map;
+        }
+        if((size_t)ctlp->datao != ctlsz)
+        {
+                /* we guessed wrong, try again */
+                if(ctlsz != pq->pagesz)
+                {
+                        /* don't try more than once */
+                        status = EINVAL;
+                        goto unwind_map;
+                }
+                ctlsz = (size_t)ctlp->datao;
+                (void)(pq->mtof)(pq, 0, 0);
+                goto remap;
+        }
+
+        pq->datao = ctlp->datao;
+        pq->ixo = ctlp->ixo;
+        pq->ixsz = ctlp->ixsz;
+        pq->nalloc = ctlp->nalloc;
+        pq->ctlp = ctlp;
+
+        if (!(pq->datao > 0) ||
+            !(pq->datao % pq->pagesz == 0) ||
+            !(pq->ixo > pq->datao) ||
+            !(pq->ixo % pq->pagesz == 0) ||
+            !(pq->ixsz >= pq->pagesz) ||
+            !(pq->ixsz % pq->pagesz == 0)) {
+
+            log_error_q("pq->datao=%lu, pq->pagesz=%lu, pq->ixo=%lu, "
+                "pq->ixsz=%lu",
+                (unsigned long)pq->datao, (unsigned long)pq->pagesz, 
+                (unsigned long)pq->ixo, (unsigned long)pq->ixsz);
+            status = PQ_CORRUPT;
+            goto unwind_map;
+        }
+
+        /*
+         * Reset the product-queue access-functions based on the product-queue's
+         * actual size.
+         */
+        ctl_setAccessFunctions(pq);
+
+        /* bring in the indexes */
+        status = (pq->ftom)(pq, pq->ixo, pq->ixsz, RGN_NOLOCK, &pq->ixp);
+        if(status != ENOERR)
+                goto unwind_map;
+
+        if (!ix_ptrs(pq->ixp, pq->ixsz, pq->nalloc, pq->ctlp->align,
+                ctl_ixFormats(pq->ctlp), &pq->rlp, &pq->tqp, &pq->fbp,
+                &pq->sxp, &pq->esp, &pq->clp)) {
+            status = PQ_CORRUPT;
+            goto unwind_map;
+        }
+        pq->tqfp = ix_tqFeeds(pq->tqp, ctl_ixFormats(pq->ctlp));
+
+        if (!(pq->rlp->nalloc == pq->nalloc && pq->tqp->nalloc == pq->nalloc
+                        && pq->sxp->nalloc == pq->nalloc)) { 
+                log_error_q("pq->rlp->nalloc=%lu, pq->nalloc=%lu, "
+                    "pq->tqp->nalloc=%lu, pq->sxp->nalloc=%lu",
+                    (unsigned long)pq->rlp->nalloc,
+                    (unsigned long)pq->nalloc, 
+                    (unsigned long)pq->tqp->nalloc, 
+                    (unsigned long)pq->sxp->nalloc);
+                status = PQ_CORRUPT;
+                goto unwind_map;
+        }
+
+        return ENOERR;
+
+unwind_map:
+        (void)(pq->mtof)(pq, 0, 0);
+        return status;
+}
+
+
+/**
+ * Adopts the location and size of the index region and the capacity of the
+ * product-queue from its control-region after another process grew the
+ * product-queue (see `pq_grow()`). The data-products don't move, so the only
+ * other change is that a product-queue that's mapped as a whole has its
+ * mapping extended. The control-region must be held.
+ *
+ * @param[in,out] pq      The product-queue.
+ * @retval        0       Success.
+ * @retval        ENOMEM  The product-queue must be reopened. `log_add()`
+ *                        called.
+ * @return                <errno.h> error-code. `log_add()` called.
+ */
+static int
+ctl_regeometry(pqueue *const pq)
+{
+        const pqctl *const ctlp = pq->ctlp;
+
+        if(!(ctlp->ixo >= pq->ixo + (off_t)pq->ixsz) ||
+                        !(ctlp->ixo % pq->pagesz == 0) ||
+                        !(ctlp->ixsz >= pq->pagesz) ||
+                        !(ctlp->ixsz % pq->pagesz == 0) ||
+                        !(ctlp->nalloc >= pq->nalloc)) {
+                log_add("Product-queue \"%s\" has an invalid new index "
+                        "region: ixo=%ld, ixsz=%lu, nalloc=%lu", pq->pathname,
+                        (long)ctlp->ixo, (unsigned long)ctlp->ixsz,
+                        (unsigned long)ctlp->nalloc);
+                return PQ_CORRUPT;
+        }
+#ifdef HAVE_MMAP
+        if(pq->ftom == mm0_ftom && pq->base != NULL) {
+                const int status = mm0_extend(pq,
+                                ctlp->ixo + (off_t)ctlp->ixsz);
+
+                if(status != ENOERR)
+                        return status;
+        }
+#endif
+        log_info_q("Product-queue \"%s\" grew from %ld to %ld data bytes and "
+                "from %lu to %lu slots", pq->pathname,
+                (long)(pq->ixo - pq->datao), (long)(ctlp->ixo - pq->datao),
+                (unsigned long)pq->nalloc, (unsigned long)ctlp->nalloc);
+        pq->ixo = ctlp->ixo;
+        pq->ixsz = ctlp->ixsz;
+        pq->nalloc = ctlp->nalloc;
+        return ENOERR;
+}
+
+/**
+ * Get/lock the ctl for access by this process
+ *
+ * @param[in] rflags  Region flags: bitwise OR of
+ *                    - RGN_NOLOCK  Don't lock region; locking handled elsewhere
+ *                    - RGN_WRITE   Region will be modified
+ *                    - RGN_NOWAIT  Return immediately if can't lock, else wait
+ * @retval ENOERR     Success.
+ * @retval EACCESS or EAGAIN
+ *                    The region is already locked by another process.
+ * @retval EINVAL     The product-queue file doesn't support locking.
+ * @retval ENOLCK     The number of locked regions would exceed a system-imposed
+ *                    limit.
+ * @retval EDEADLK    A deadlock in region locking has been detected.
+ * @retval EBADF      The file descriptor of the product-queue is invalid.
+ * @retval EIO        An I/O error occurred while reading from the file system.
+ * @retval EOVERFLOW  The file size in bytes or the number of blocks allocated
+ *                    to the file or the file serial number cannot be
+ *                    represented correctly.
+ * @retval EINTR      A signal was caught during execution.
+ * @retval EFBIG or EINVAL
+ *                    The size of the product-queue is greater than the maximum
+ *                    file size.
+ * @retval EROFS      The named file resides on a read-only file system.
+ * @retval EAGAIN     The mapping could not be locked in memory, if required by
+ *                    mlockall(), due to a lack of resources.
+ * @retval EINVAL     The product-queue object wants to map the product-queue to
+ *                    a fixed memory location that is not a multiple of the page
+ *                    size as returned by sysconf(), or is considered invalid
+ *                    by the O/S.
+ * @retval EMFILE     The number of mapped regions would exceed an O/S-dependent
+ *                    limit (per process or per system).
+ * @retval ENODEV     The file descriptor of the product-queue object refers to
+ *                    a file whose type is not supported by mmap().
+ * @retval ENOMEM     The size of the product-queue exceeds that allowed for the
+ *                    address space of a process.
+ * @retval ENOMEM     The mapping could not be locked in memory, if required by
+ *                    mlockall(), because it would require more space than the
+ *                    system is able to supply.
+ * @retval ENOTSUP    The O/S does not support the combination of accesses
+ *                    requested.
+ * @retval ENXIO      The size of the product-queue is invalid for the object
+ *                    specified by its file descriptor.
+ */
+static int
+ctl_get(pqueue *const pq, int const rflags)
+{
+        int status = ENOERR;
+
+#if _NOMAP || !defined(HAVE_MMAP)
+        log_assert(pq->mtof == f_mtof);
+        log_assert(pq->ctlp == NULL);
+        log_assert(pq->ixp == NULL);
+#endif
+
+        if(fIsSet(rflags, RGN_WRITE) && !fIsSet(pq->pflags, PQ_SIGSBLOCKED))
+        {
+                /* We are beginning a critical section */
+                sigset_t set;
+
+                (void) sigfillset(&set);
+                (void) sigdelset(&set, SIGABRT);
+                (void) sigdelset(&set, SIGFPE);
+                (void) sigdelset(&set, SIGILL);
+                (void) sigdelset(&set, SIGSEGV);
+                (void) sigdelset(&set, SIGBUS);
+                status = pthread_sigmask(SIG_BLOCK, &set, &pq->sav_set);
+                log_assert(0 == status);
+                fSet(pq->pflags, PQ_SIGSBLOCKED);
+        }
+        if(pq->ctlp == NULL)
+        {
+                /* bring in the pqctl */
+                status = (pq->ftom)(pq,
+                                 0, (size_t)pq->datao, rflags,
+                                (void **)&pq->ctlp);
+                if(status != ENOERR)
+                        goto unwind_mask;
+                if(pq->ctlp->ixo != pq->ixo || pq->ctlp->ixsz != pq->ixsz ||
+                                pq->ctlp->nalloc != pq->nalloc)
+                {
+                        /* another process grew the product-queue */
+                        log_assert(pq->ixp == NULL);
+                        status = ctl_regeometry(pq);
+                        if(status != ENOERR)
+                                goto unwind_ctl;
+                }
+        }
+        log_assert(pq->ctlp->magic == PQ_MAGIC);
+        log_assert(PQ_VERSION == pq->ctlp->version ||
+                PQ_VERSION_IX == pq->ctlp->version);
+        log_assert(pq->ctlp->datao == pq->datao);
+        log_assert(pq->ctlp->ixo == pq->ixo);
+        log_assert(pq->ctlp->ixsz == pq->ixsz);
+
+        if(pq->ixp == NULL)
+        {
+                /* bring in the indexes */
+                status = (pq->ftom)(pq,
+                                 pq->ixo, pq->ctlp->ixsz, rflags|RGN_NOLOCK,
+                                &pq->ixp);
+                if(status != ENOERR)
+                        goto unwind_ctl;
+        }
+
+        ix_ptrs(pq->ixp, pq->ixsz, pq->nalloc, pq->ctlp->align,
+            ctl_ixFormats(pq->ctlp), &pq->rlp, &pq->tqp, &pq->fbp, &pq->sxp,
+            &pq->esp, &pq->clp);
+        pq->tqfp = ix_tqFeeds(pq->tqp, ctl_ixFormats(pq->ctlp));
+        log_assert(pq->rlp->nalloc == pq->nalloc && pq->tqp->nalloc == pq->nalloc
+                        && pq->sxp->nalloc == pq->nalloc);
+
+        if(fIsSet(rflags, RGN_WRITE) && !fIsSet(pq->pflags, PQ_CTLWRITE))
+                ctl_beginWrite(pq);
+
+        return ENOERR;
+unwind_ctl:
+        (void) (pq->mtof)(pq, 0, 0);
+        pq->ctlp = NULL;
+unwind_mask:
+        {
+            sigset_t set = pq->sav_set;
+
+            (void) sigemptyset(&pq->sav_set);
+            fClr(pq->pflags, PQ_SIGSBLOCKED);
+            (void) pthread_sigmask(SIG_SETMASK, &set, NULL);
+        }
+        return status;
+}
+
+/******************************************************************************
+ * Product-Queue Functions:
+ ******************************************************************************/
+
+/*
+ * Locks the mutex of a thread-safe product-queue. Adds to the lock statistics
+ * unless the calling thread already holds it.
+ */
+static void
+pq_lockIf(pqueue* const pq)
+{
+    if (fIsSet(pq->pflags, PQ_THREADSAFE)) {
+        const uint64_t start = ls_start(pq);
+        int            status = pthread_mutex_trylock(&pq->mutex);
+
+        if (status == EBUSY) {
+            ls_retried(pq, PQ_LOCK_MUTEX);
+            status = pthread_mutex_lock(&pq->mutex);
+        }
+        if (status) {
+            log_add_errno(status, "pthread_mutex_lock() failure");
+            log_flush_error();
+            abort();
+        }
+        if (pq->ls_mutexDepth++ == 0)
+            pq->ls_mutexLocked = ls_acquired(pq, PQ_LOCK_MUTEX, true, start);
+    }
+}
+
+/*
+ * Unlocks the mutex of a thread-safe product-queue. Adds to the lock
+ * statistics unless the calling thread still holds it.
+ */
+static void
+pq_unlockIf(pqueue* const pq)
+{
+    if (fIsSet(pq->pflags, PQ_THREADSAFE)) {
+        int status;
+
+        if (--pq->ls_mutexDepth == 0)
+            ls_released(pq, PQ_LOCK_MUTEX, pq->ls_mutexLocked);
+        status = pthread_mutex_unlock(&pq->mutex);
+
+        if (status) {
+            log_add_errno(status, "pthread_mutex_unlock() failure");
+            log_flush_error();
+            abort();
+        }
+    }
+}
+
+/*
+ * Sets the offset and size fields of a product-queue structure.
+ *
+ * Arguments:
+ *      pq              Pointer to the product-queue structure to have its
+ *                      "pagesz", "datao", "ixo", "ixsz", and "nalloc" fields
+ *                      set.
+ *      align           Alignment reguirement in bytes.
+ *      initsz          Initial size of the data segment in bytes.
+ *      nregions        The capacity of the product-queue in products.
+ */
+static void
+pq_setOffsetsAndSizes(
+    pqueue* const       pq,
+    const size_t        align,
+    const off_t         initsz,
+    const size_t        nregions)
+{
+    /* Size of an I/O page in bytes: */
+    pq->pagesz = (size_t)pagesize();
+    /* Offset to the data segment in bytes: */
+    pq->datao = lcm(pq->pagesz, align);
+    log_assert(pq->datao >= sizeof(pqctl));
+    /* Offset to the index segment in bytes: */
+    pq->ixo = pq->datao + _RNDUP(initsz, pq->pagesz);
+    /* The capacity of the product-queue in products: */
+    pq->nalloc = nregions;
+
+    /* Size of the index segement: */
+    if (nregions == 0) {
+        pq->ixsz = pq->pagesz;
+    }
+    else {
+        pq->ixsz = ix_sz(nregions, align, pq_ixFormats(pq->pflags));
+        pq->ixsz = _RNDUP(pq->ixsz, pq->pagesz);
+    }
+}
+
+
+/**
+ * Allocates and initializes a product-queue structure.
+ *
+ * @param[in] pflags     Product-queue flags. Bitwise OR of
+ *                       - PQ_MAPRGNS    Map region by region, default is whole
+ *                                       file if possible; otherwise, by region
+ *                       - PQ_NOCLOBBER  Don't replace an existing product-queue
+ *                       - PQ_NOLOCK     Disable locking (DANGER!)
+ *                       - PQ_NOMAP      Use `malloc/read/write/free` instead of
+ *                                       `mmap()`
+ *                       - PQ_PRIVATE    `mmap()` the file `MAP_PRIVATE`.
+ *                                       Default is `MAP_SHARED`.
+ *                       - PQ_READONLY   Product-queue is read-only. Default is
+ *                                       read/write.
+ * @param[in] align      Alignment reguirement in bytes.
+ * @param[in] initialsz  Capacity of the product-queue in bytes.
+ * @param[in] maxProds   Capacity of the product-queue in number of products.
+ * @retval    NULL       Failure. "errno" set.
+ * @return               Pointer to the product-queue structure. The client
+ *                       should call "pq_delete(pq)" when the structure is no
+ *                       longer needed.
+ */
+static pqueue*
+pq_new(
+    const int           pflags,
+    const size_t        align,
+    const off_t         initialsz,
+    const size_t        maxProds)
+{
+    pqueue* const       pq = (pqueue*)malloc(sizeof(pqueue));
+
+    if (pq == NULL)
+        return NULL;
+
+    (void)memset(pq, 0, sizeof(pqueue));
+    (void)sigemptyset(&pq->sav_set);
+
+    /*
+     * This is a convenient place to overide things at compile time.
+     */
+
+    pq->pflags = pflags;
+    pq->zipfeeds = fIsSet(pflags, PQ_COMPRESS) ? ANY : NONE;
+    pq->pf_count = fIsSet(pflags, PQ_PREFETCH) ? PF_DEFAULT : 0;
+
+    fSet(pq->pflags, PQ_NOGROW); /* always set for this version of pq! */
+    pq_setOffsetsAndSizes(pq, align, initialsz, maxProds);
+
+    if (pq->ixo < pq->datao) {
+        log_error_q("Queue-size not supported by environment: initialsz=%ld, "
+                "sizeof(off_t)=%lu, sizeof(size_t)=%lu", (long)initialsz,
+                (unsigned long)sizeof(off_t), (unsigned long)sizeof(size_t));
+        errno = EINVAL;
+        free(pq);
+        return NULL;
+    }
+
+    if (isProductMappingNecessary(pq)) {
+        /*
+         * The entire product-queue can't be memory-mapped in one mmap(2)
+         * call; consequently, each data-product will be individually
+         * memory-mapped.
+         */
+        fSet(pq->pflags, PQ_MAPRGNS);
+    }
+
+#if __hpux
+    if (fIsSet(pq->pflags, PQ_MAPRGNS)) {
+        /*
+         * HP-UX requires that memory-mapped segments be aligned on page
+         * boundaries.
+         */
+        if (align < pq->pagesz) {
+            /* LOG_NOTICE("forcing alignment %u", pq->pagesz); */
+            pq_setOffsetsAndSizes(pq, pq->pagesz, initialsz, maxProds);
+        }
+    }
+#endif
+
+    pq->riulp = (riul*)malloc(pq->pagesz);
+    if (pq->riulp == NULL) {
+        free(pq);
+        return NULL;
+    }
+    riul_init(pq->riulp, 0, pq->pagesz);
+
+    {
+        pthread_mutexattr_t attr;
+        int                 status = pthread_mutexattr_init(&attr);
+        if (status) {
+            log_add_errno(status, "Couldn't initialize mutex attributes");
+        }
+        else {
+            (void)pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+            (void)pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+            status = pthread_mutex_init(&pq->mutex, &attr);
+            if (status)
+                log_add_errno(status, "Couldn't initialize mutex");
+            (void)pthread_mutexattr_destroy(&attr);
+        }
+        if (status) {
+            free(pq->riulp);
+            free(pq);
+            return NULL;
+        }
+    }
+
+    /*
+     * Set the product-queue access-functions.
+     */
+    ctl_setAccessFunctions(pq);
+
+    pq->fd = -1;
+    pq->cursor = TS_NONE;
+    pq->cursor_offset = OFF_NONE;
+    pq->pqe_count = 0;
+    pq->notify_fd = -1;
+    pq->lock_fd = -1;
+    pq->cons_fd = -1;
+    pq->consix = -1;
+    pq->ls_fd = -1;
+
+    return pq;
+}
+
+/**
+ * Frees a product-queue.
+ *
+ * @param[in,out]  Product queue
+ */
+static void
+pq_free(pqueue *const pq)
+{
+        if(pq == NULL)
+                return;
+        (void)pthread_mutex_destroy(&pq->mutex);
+        if(pq->riulp != NULL)
+        {
+                free(pq->riulp);
+                pq->riulp = NULL;
+        }
+        free(pq);
+}
+
+
+/* Begin notify */
+
+/*
+ * Readers are told about new data-products by the insertion-counter in the
+ * control-region. A writer increments the counter while holding the
+ * control-region and then wakes any process waiting on it. Because the counter
+ * is in the shared file, only those processes waiting on this product-queue are
+ * woken -- unlike SIGCONT, which is sent to the entire process group. The
+ * control-page is mapped separately from the region layer so that the counter
+ * can be waited upon without locking the control-region.
+ */
+
+/**
+ * Maps the control-page of a product-queue for insertion-notification.
+ * Failure isn't fatal: notification then reverts to SIGCONT.
+ *
+ * @param[in,out] pq  The product-queue.
+ */
+static void
+notify_map(pqueue* const pq)
+{
+#ifdef PQ_HAVE_NOTIFY
+    void* const vp = mmap(NULL, pq->pagesz, PROT_READ, MAP_SHARED, pq->fd, 0);
+
+    if (vp == MAP_FAILED) {
+        log_debug("Couldn't map control-page for notification: %s",
+                strerror(errno));
+    }
+    else {
+        pq->notifyp = (pqctl*)vp;
+    }
+#endif
+}
+
+/**
+ * Stops the notification thread, closes the notification file-descriptor, and
+ * unmaps the notification control-page of a product-queue.
+ *
+ * @param[in,out] pq  The product-queue.
+ */
+static void
+notify_unmap(pqueue* const pq)
+{
+#ifdef PQ_HAVE_NOTIFY
+    if (pq->notify_fd >= 0) {
+        (void)pthread_cancel(pq->notify_thread);
+        (void)pthread_join(pq->notify_thread, NULL);
+        (void)close(pq->notify_fd);
+        pq->notify_fd = -1;
+    }
+    if (pq->notifyp != NULL) {
+        (void)munmap(pq->notifyp, pq->pagesz);
+        pq->notifyp = NULL;
+    }
+#endif
+}
+
+/**
+ * Indicates if insertion-notification uses the insertion-counter rather than
+ * SIGCONT.
+ *
+ * @param[in] pq     The product-queue.
+ * @retval    true   Notification is by the insertion-counter.
+ * @retval    false  Notification is by SIGCONT to the process group.
+ */
+static inline bool
+notify_isSeq(const pqueue* const pq)
+{
+    return pq->notifyp != NULL && !fIsSet(pq->pflags, PQ_SIGCONT);
+}
+
+/**
+ * Returns the insertion-counter of a product-queue without locking.
+ *
+ * @pre            `notify_isSeq(pq)`
+ * @param[in] pq   The product-queue.
+ * @return         The insertion-counter.
+ */
+static inline uint32_t
+notify_getSeq(const pqueue* const pq)
+{
+    return __atomic_load_n(&pq->notifyp->insert_seq, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Increments the insertion-counter of a product-queue.
+ *
+ * @pre            The control-region is write-locked.
+ * @param[in] pq   The product-queue.
+ */
+static inline void
+ctl_incSeq(pqueue* const pq)
+{
+    (void)__atomic_add_fetch(&pq->ctlp->insert_seq, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Notifies readers of a product-queue that a data-product was inserted.
+ *
+ * @pre                The control-region is unlocked.
+ * @param[in] pq       The product-queue.
+ * @param[in] sigcont  Whether or not to send SIGCONT to the process group if
+ *                     notification isn't by the insertion-counter.
+ */
+static void
+pq_notify(
+        pqueue* const pq,
+        const bool    sigcont)
+{
+#ifdef PQ_HAVE_NOTIFY
+    if (notify_isSeq(pq)) {
+        (void)futex(&pq->notifyp->insert_seq, FUTEX_WAKE, INT_MAX, NULL);
+        return;
+    }
+#endif
+    if (sigcont) {
+        /*
+         * Inform others in our process group that there is new data available
+         * (see pq_suspend()). SIGCONT is ignored by default.
+         */
+        (void)kill(0, SIGCONT);
+    }
+}
+
+#ifdef PQ_HAVE_NOTIFY
+/**
+ * Waits for the insertion-counter of a product-queue to differ from a given
+ * value. Returns early if a signal-catching function is executed.
+ *
+ * @pre                  `notify_isSeq(pq)`
+ * @param[in] pq         The product-queue.
+ * @param[in] seq        The value of the insertion-counter to wait past.
+ * @param[in] timeout    Relative timeout. Shall not be NULL.
+ * @retval    0          The counter differs from `seq` or a spurious wake-up
+ *                       occurred.
+ * @retval    ETIMEDOUT  The timeout occurred.
+ * @retval    EINTR      A signal-catching function was executed.
+ */
+static int
+notify_wait(
+        pqueue* const                pq,
+        const uint32_t               seq,
+        const struct timespec* const timeout)
+{
+    /*
+     * A timeout is always given because a futex wait with one is interrupted by
+     * a caught signal regardless of SA_RESTART.
+     */
+    if (notify_getSeq(pq) != seq ||
+            futex(&pq->notifyp->insert_seq, FUTEX_WAIT, seq, timeout) == 0)
+        return 0;
+
+    return (errno == EAGAIN) ? 0 : errno;
+}
+
+/**
+ * Posts to the notification file-descriptor of a product-queue every time the
+ * insertion-counter changes. Executed on a separate thread that's cancelled by
+ * `notify_unmap()`.
+ *
+ * @param[in] arg  The product-queue.
+ * @return         NULL.
+ */
+static void*
+notify_run(void* const arg)
+{
+    pqueue* const         pq = (pqueue*)arg;
+    uint32_t              seq = notify_getSeq(pq);
+    /* Bounds the latency of cancellation */
+    const struct timespec slice = {1, 0};
+
+    for (;;) {
+        pthread_testcancel();
+
+        const uint32_t now = notify_getSeq(pq);
+
+        if (now != seq) {
+            seq = now;
+            (void)eventfd_write(pq->notify_fd, 1);
+        }
+        else {
+            (void)notify_wait(pq, seq, &slice);
+        }
+    }
+
+    return NULL; // Eclipse wants to see a return
+}
+#endif
+
+/**
+ * Returns a file-descriptor that becomes readable when a data-product is
+ * inserted into a product-queue. The descriptor may be used with `poll()`,
+ * `select()`, etc. It should be read via `eventfd_read()` or an 8-byte `read()`
+ * before waiting on it again. It shall not be closed by the caller: it's closed
+ * by `pq_close()`.
+ *
+ * @param[in]  pq        The product-queue.
+ * @param[out] fd        The file-descriptor.
+ * @retval     0         Success. `*fd` is set.
+ * @retval     ENOSYS    Notification is by SIGCONT, either because the
+ *                       product-queue was created or opened with `PQ_SIGCONT`
+ *                       or because the platform doesn't support it.
+ * @return               <errno.h> error-code. `log_add()` called.
+ */
+int
+pq_getNotifyFd(
+        pqueue* const pq,
+        int* const    fd)
+{
+    int status;
+
+    pq_lockIf(pq);
+
+    if (!notify_isSeq(pq)) {
+        status = ENOSYS;
+    }
+    else if (pq->notify_fd >= 0) {
+        *fd = pq->notify_fd;
+        status = 0;
+    }
+    else {
+#ifdef PQ_HAVE_NOTIFY
+        pq->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (pq->notify_fd < 0) {
+            status = errno;
+            log_add_syserr("Couldn't create notification file-descriptor");
+        }
+        else {
+            status = pthread_create(&pq->notify_thread, NULL, notify_run, pq);
+
+            if (status) {
+                log_add_errno(status, "Couldn't create notification thread");
+                (void)close(pq->notify_fd);
+                pq->notify_fd = -1;
+            }
+            else {
+                *fd = pq->notify_fd;
+            }
+        }
+#else
+        status = ENOSYS;
+#endif
+    }
+
+    pq_unlockIf(pq);
+
+    return status;
+}
+
+/**
+ * Returns the insertion-counter of a product-queue. The counter is incremented
+ * every time a data-product is inserted. It may be passed to
+ * `pq_waitForInsert()`.
+ *
+ * @param[in]  pq      The product-queue.
+ * @param[out] seq     The insertion-counter.
+ * @retval     0       Success. `*seq` is set.
+ * @retval     ENOSYS  Notification is by SIGCONT.
+ */
+int
+pq_getInsertSeq(
+        pqueue* const   pq,
+        unsigned* const seq)
+{
+    int status;
+
+    pq_lockIf(pq);
+
+    if (!notify_isSeq(pq)) {
+        status = ENOSYS;
+    }
+    else {
+#ifdef PQ_HAVE_NOTIFY
+        *seq = notify_getSeq(pq);
+#endif
+        status = 0;
+    }
+
+    pq_unlockIf(pq);
+
+    return status;
+}
+
+/**
+ * Waits for a data-product to be inserted into a product-queue after its
+ * insertion-counter had a given value. Only processes waiting on the
+ * product-queue are woken. Returns early if a signal-catching function is
+ * executed.
+ *
+ * @param[in] pq         The product-queue.
+ * @param[in] seq        The insertion-counter from `pq_getInsertSeq()`.
+ * @param[in] timeout    Relative timeout or NULL for an indefinite wait.
+ * @retval    0          A data-product was inserted after `seq` (or a spurious
+ *                       wake-up occurred).
+ * @retval    ETIMEDOUT  The timeout occurred.
+ * @retval    EINTR      A signal-catching function was executed.
+ * @retval    ENOSYS     Notification is by SIGCONT. Use `pq_suspend()`.
+ */
+int
+pq_waitForInsert(
+        pqueue* const                pq,
+        const unsigned               seq,
+        const struct timespec* const timeout)
+{
+    if (!notify_isSeq(pq))
+        return ENOSYS;
+
+#ifdef PQ_HAVE_NOTIFY
+    const struct timespec forever = {INT_MAX, 0};
+
+    return notify_wait(pq, seq, timeout ? timeout : &forever);
+#else
+    return ENOSYS;
+#endif
+}
+
+/* End notify */
+
+
+/* Begin consumers */
+
+/*
+ * A process that reads a product-queue registers itself in the registry of
+ * consumers in the control-region the first time that it positions its cursor.
+ * It publishes its cursor thereafter, so that the lag of each consumer can be
+ * determined (see `pq_getConsumers()`) and so that a writer can tell when it
+ * deletes a data-product that a consumer hasn't read. The control-region is
+ * mapped separately from the region layer -- like the control-page for
+ * notification -- so that publishing the cursor is only a few stores to
+ * memory. Failure to register isn't fatal: the consumer is then unregistered.
+ */
+
+/**
+ * Registers this process in the registry of consumers of a product-queue.
+ * Reclaims the entry of a terminated consumer if necessary.
+ *
+ * @param[in,out] pq  The product-queue.
+ */
+static void
+cons_register(pqueue* const pq)
+{
+    pq->consix = -2; // Unless registration succeeds
+#ifdef HAVE_MMAP
+    void* vp = pq->consctlp; // Non-NULL if mapped by a parent process
+
+    if (vp == NULL) {
+        int fd = pq->fd;
+
+        if (fIsSet(pq->pflags, PQ_READONLY)) {
+            fd = open(pq->pathname, O_RDWR);
+            if (fd < 0) {
+                log_debug("Couldn't open product-queue \"%s\" for writing to "
+                        "register consumer: %s", pq->pathname,
+                        strerror(errno));
+                return;
+            }
+            (void)ensure_close_on_exec(fd);
+            /* Closing it would release this process' fcntl(2) locks */
+            pq->cons_fd = fd;
+        }
+
+        vp = mmap(NULL, (size_t)pq->datao, PROT_READ|PROT_WRITE, MAP_SHARED,
+                fd, 0);
+        if (vp == MAP_FAILED) {
+            log_debug("Couldn't map control-region to register consumer: %s",
+                    strerror(errno));
+            return;
+        }
+    }
+
+    pqctl* const ctlp = (pqctl*)vp;
+    const pid_t  pid = getpid();
+
+    if (ctlp->cons_magic == CONS_MAGIC) {
+        for (int pass = 0; pass < 2 && pq->consix < 0; pass++) {
+            for (int i = 0; i < PQ_MAXCONSUMERS; i++) {
+                conselem* const cep = ctlp->cons + i;
+                pid_t           old = __atomic_load_n(&cep->pid,
+                        __ATOMIC_RELAXED);
+
+                /* The second pass reclaims entries of terminated processes */
+                if (old == 0 || (pass && kill(old, 0) && errno == ESRCH)) {
+                    if (__atomic_compare_exchange_n(&cep->pid, &old, pid,
+                            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                        cep->seq = 0;
+                        cep->cursor = TS_NONE;
+                        cep->overruns = 0;
+                        cep->warned = 0;
+                        pq->consix = i;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    if (pq->consix < 0) {
+        log_debug("Couldn't register consumer of product-queue \"%s\"",
+                pq->pathname);
+        (void)munmap(vp, (size_t)pq->datao);
+        pq->consctlp = NULL;
+    }
+    else {
+        pq->consctlp = ctlp;
+    }
+#endif
+}
+
+/**
+ * Publishes the cursor of this process in the registry of consumers of a
+ * product-queue. Registers this process first if necessary -- including when
+ * it's the child of a registered process.
+ *
+ * @param[in,out] pq  The product-queue.
+ */
+static void
+cons_publish(pqueue* const pq)
+{
+    if (pq->consix == -1)
+        cons_register(pq);
+
+    if (pq->consix >= 0) {
+        conselem* cep = pq->consctlp->cons + pq->consix;
+
+        if (!tvEqual(cep->cursor, pq->cursor)) {
+            if (__atomic_load_n(&cep->pid, __ATOMIC_RELAXED) != getpid()) {
+                cons_register(pq);
+                if (pq->consix < 0)
+                    return;
+                cep = pq->consctlp->cons + pq->consix;
+            }
+            __atomic_store_n(&cep->seq, cep->seq + 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            cep->cursor = pq->cursor;
+            __atomic_store_n(&cep->seq, cep->seq + 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/**
+ * Removes this process from the registry of consumers of a product-queue and
+ * unmaps the registry.
+ *
+ * @param[in,out] pq  The product-queue.
+ */
+static void
+cons_unregister(pqueue* const pq)
+{
+#ifdef HAVE_MMAP
+    if (pq->consctlp != NULL) {
+        pid_t pid = getpid(); // Not a parent process' entry
+
+        (void)__atomic_compare_exchange_n(&pq->consctlp->cons[pq->consix].pid,
+                &pid, 0, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+        (void)munmap(pq->consctlp, (size_t)pq->datao);
+        pq->consctlp = NULL;
+    }
+    if (pq->cons_fd >= 0) {
+        (void)close(pq->cons_fd);
+        pq->cons_fd = -1;
+    }
+#endif
+    pq->consix = -1;
+}
+
+/**
+ * Returns the registered consumers of a product-queue and how far behind the
+ * most recently inserted data-product each one is. The lag of a consumer is
+ * measured from its cursor, which is the insertion-time of the last
+ * data-product that it read, so it's only meaningful for a consumer that reads
+ * forward in time. Consumers whose processes have terminated are omitted.
+ *
+ * @param[in]  pq         The product-queue.
+ * @param[out] consumers  The registered consumers. Shall have
+ *                        PQ_MAXCONSUMERS elements.
+ * @param[out] count      The number of registered consumers.
+ * @param[out] overruns   The number of data-products deleted before a
+ *                        registered consumer read them or NULL.
+ * @retval     0          Success. `*count` is 0 if the product-queue was last
+ *                        opened for writing by an earlier version of the LDM.
+ * @retval     EINVAL     `pq == NULL || consumers == NULL || count == NULL`.
+ * @return                Error from `ctl_get()`.
+ */
+int
+pq_getConsumers(
+        pqueue* const             pq,
+        pq_consumer* const        consumers,
+        size_t* const             count,
+        unsigned long long* const overruns)
+{
+    if (pq == NULL || consumers == NULL || count == NULL)
+        return EINVAL;
+
+    pq_lockIf(pq);
+        int status = ctl_get(pq, 0);
+
+        if (status == 0) {
+            const pqctl* const ctlp = pq->ctlp;
+            size_t             n = 0;
+
+            if (ctlp->cons_magic == CONS_MAGIC) {
+                const tqelem* tqep = tqe_first(pq->tqp);
+                /* Anything before the oldest product was deleted */
+                const timestampt oldest = tqep && tqep->offset != OFF_NONE
+                    ? tqep->tv
+                    : ctlp->mostRecent;
+
+                for (int i = 0; i < PQ_MAXCONSUMERS; i++) {
+                    const conselem* const cep = ctlp->cons + i;
+                    const pid_t           pid = __atomic_load_n(&cep->pid,
+                            __ATOMIC_ACQUIRE);
+
+                    if (pid == 0 || (kill(pid, 0) && errno == ESRCH))
+                        continue;
+
+                    pq_consumer* const cp = consumers + n++;
+                    cp->pid = pid;
+                    cp->cursor = cons_cursor(cep);
+                    cp->overruns = cep->overruns;
+                    cp->lagBytes = 0;
+                    cp->lagProds = 0;
+
+                    const timestampt from = tvIsNone(cp->cursor) ||
+                            tvCmp(cp->cursor, oldest, <)
+                        ? oldest
+                        : cp->cursor;
+                    cp->lag = tvCmp(ctlp->mostRecent, from, >)
+                        ? d_diff_timestamp(&ctlp->mostRecent, &from)
+                        : 0;
+                }
+
+                for (; n && tqep && tqep->offset != OFF_NONE;
+                        tqep = tq_next(pq->tqp, tqep)) {
+                    const size_t rlix = rl_find(pq->rlp, tqep->offset);
+                    const size_t extent = rlix == RL_NONE
+                        ? 0
+                        : Extent(pq->rlp->rp + rlix);
+
+                    for (size_t i = 0; i < n; i++) {
+                        if (tvIsNone(consumers[i].cursor) ||
+                                tvCmp(tqep->tv, consumers[i].cursor, >)) {
+                            consumers[i].lagBytes += extent;
+                            consumers[i].lagProds++;
+                        }
+                    }
+                }
+            }
+
+            *count = n;
+            if (overruns)
+                *overruns = ctlp->cons_magic == CONS_MAGIC
+                    ? ctlp->cons_overruns
+                    : 0;
+            (void)ctl_rel(pq, 0);
+        }
+    pq_unlockIf(pq);
+
+    return status;
+}
+
+/* End consumers */
+
+/**
+ * Sets the feedtypes whose data is compressed when inserted into a
+ * product-queue that was created with PQ_COMPRESS. Data already in the
+ * product-queue is unaffected. Other processes that have the product-queue open
+ * for writing are unaffected until they reopen it.
+ *
+ * @param[in] pq       The product-queue. Shall be open for writing.
+ * @param[in] feeds    The feedtypes whose data is compressed (e.g., ANY or
+ *                     NONE).
+ * @retval    0        Success.
+ * @retval    EINVAL   `pq == NULL`.
+ * @retval    EACCES   The product-queue is open for reading only.
+ * @retval    ENOTSUP  The product-queue wasn't created with PQ_COMPRESS.
+ * @return             Error from `ctl_get()`.
+ */
+int
+pq_setCompression(
+        pqueue* const   pq,
+        const feedtypet feeds)
+{
+    if (pq == NULL)
+        return EINVAL;
+
+    pq_lockIf(pq);
+        int status;
+
+        if (fIsSet(pq->pflags, PQ_READONLY)) {
+            status = EACCES;
+        }
+        else if (!fIsSet(pq->pflags, PQ_COMPRESS)) {
+            status = ENOTSUP;
+        }
+        else if ((status = ctl_get(pq, RGN_WRITE)) == 0) {
+            pq->ctlp->zip_feeds = feeds;
+            pq->zipfeeds = feeds;
+            (void)ctl_rel(pq, RGN_MODIFIED);
+        }
+    pq_unlockIf(pq);
+
+    return status;
+}
+
+/**
+ * Returns the compression-related attributes of a product-queue.
+ *
+ * @param[in]  pq       The product-queue.
+ * @param[out] feeds    The feedtypes whose data is compressed or NULL. NONE
+ *                      if the product-queue wasn't created with PQ_COMPRESS.
+ * @param[out] in       The number of bytes of data that have been compressed
+ *                      or NULL.
+ * @param[out] out      The number of bytes that data became by being
+ *                      compressed or NULL.
+ * @retval     0        Success.
+ * @retval     EINVAL   `pq == NULL`.
+ * @return              Error from `ctl_get()`.
+ */
+int
+pq_getCompression(
+        pqueue* const             pq,
+        feedtypet* const          feeds,
+        unsigned long long* const in,
+        unsigned long long* const out)
+{
+    if (pq == NULL)
+        return EINVAL;
+
+    pq_lockIf(pq);
+        int status = ctl_get(pq, 0);
+
+        if (status == 0) {
+            const pqctl* const ctlp = pq->ctlp;
+            const bool         valid = fIsSet(pq->pflags, PQ_COMPRESS) &&
+                    ctlp->zip_magic == ZIP_MAGIC;
+
+            if (feeds)
+                *feeds = valid ? ctlp->zip_feeds : NONE;
+            if (in)
+                *in = valid ? ctlp->zip_in : 0;
+            if (out)
+                *out = valid ? ctlp->zip_out : 0;
+            (void)ctl_rel(pq, 0);
+        }
+    pq_unlockIf(pq);
+
+    return status;
+}
+
+/**
+ * Sets how long the signatures of evicted data-products are remembered in a
+ * product-queue that was created with PQ_EVSIGS. A data-product whose
+ * signature is remembered is rejected as a duplicate. The signatures are also
+ * forgotten when the product-queue has evicted as many data-products since as
+ * it has product slots.
+ *
+ * @param[in] pq       The product-queue. Shall be open for writing.
+ * @param[in] horizon  How long, in seconds, to remember a signature. 0 means
+ *                     for as long as there's room.
+ * @retval    0        Success.
+ * @retval    EINVAL   `pq == NULL`.
+ * @retval    EACCES   The product-queue is open for reading only.
+ * @retval    ENOTSUP  The product-queue wasn't created with PQ_EVSIGS.
+ * @return             Error from `ctl_get()`.
+ */
+int
+pq_setEvictedHorizon(
+        pqueue* const  pq,
+        const unsigned horizon)
+{
+    if (pq == NULL)
+        return EINVAL;
+
+    pq_lockIf(pq);
+        int status;
+
+        if (fIsSet(pq->pflags, PQ_READONLY)) {
+            status = EACCES;
+        }
+        else if (!fIsSet(pq->pflags, PQ_EVSIGS)) {
+            status = ENOTSUP;
+        }
+        else if ((status = ctl_get(pq, RGN_WRITE)) == 0) {
+            pq->esp->horizon = horizon;
+            (void)ctl_rel(pq, RGN_MODIFIED);
+        }
+    pq_unlockIf(pq);
+
+    return status;
+}
+
+/**
+ * Returns the statistics of the signatures of evicted data-products that are
+ * remembered by a product-queue.
+ *
+ * @param[in]  pq       The product-queue.
+ * @param[out] horizon  How long, in seconds, a signature is remembered (0
+ *                      means for as long as there's room) or NULL.
+ * @param[out] history  How long ago, in seconds, the oldest remembered
+ *                      data-product was evicted or NULL. If this is less than
+ *                      `*horizon`, then the product-queue has too few product
+ *                      slots to remember signatures that long.
+ * @param[out] nlate    The number of data-products rejected because they were
+ *                      evicted earlier or NULL.
+ * @retval     0        Success.
+ * @retval     EINVAL   `pq == NULL`.
+ * @retval     ENOTSUP  The product-queue wasn't created with PQ_EVSIGS.
+ * @return              Error from `ctl_get()`.
+ */
+int
+pq_getEvictedStats(
+        pqueue* const             pq,
+        unsigned* const           horizon,
+        double* const             history,
+        unsigned long long* const nlate)
+{
+    if (pq == NULL)
+        return EINVAL;
+    if (!fIsSet(pq->pflags, PQ_EVSIGS))
+        return ENOTSUP;
+
+    pq_lockIf(pq);
+        int status = ctl_get(pq, 0);
+
+        if (status == 0) {
+            const es* const esp = pq->esp;
+            const time_t    now = time(NULL);
+
+            if (horizon)
+                *horizon = esp->horizon;
+            if (history)
+                *history = difftime(now, es_oldest(esp, now));
+            if (nlate)
+                *nlate = esp->nlate;
+            (void)ctl_rel(pq, 0);
+        }
+    pq_unlockIf(pq);
+
+    return status;
+}
+
+/**
+ * Returns the statistics of the locks of a product-queue: for each kind of
+ * lock, how many times it was acquired, how many times it was found to be
+ * locked, and histograms of how long it was waited for and held. They're
+ * accumulated by all the processes that have had the product-queue open
+ * since it was created or first opened for writing by this version of the LDM,
+ * so the difference between two calls is the activity in between.
+ *
+ * @param[in]  pq       The product-queue.
+ * @param[out] stats    The statistics of each kind of lock, indexed by
+ *                      PQ_LOCK_*.
+ * @retval     0        Success.
+ * @retval     EINVAL   `pq == NULL || stats == NULL`.
+ * @retval     ENOTSUP  The product-queue has no lock statistics because it
+ *                      hasn't been opened for writing by this version of the
+ *                      LDM.
+ * @return              Error from `ctl_get()`.
+ */
+int
+pq_getLockStats(
+        pqueue* const      pq,
+        pq_lockstats       stats[PQ_LOCK_KINDS])
+{
+    int status = 0;
+
+    if (pq == NULL || stats == NULL)
+        return EINVAL;
+
+    pq_lockIf(pq);
+        if (pq->lsctlp != NULL) {
+            ls_copy(stats, pq->lsctlp->lstat);
         }
+        else {
+            status = ctl_get(pq, 0);
+
+            if (status == 0) {
+                if (pq->ctlp->lstat_magic == LSTAT_MAGIC) {
+                    ls_copy(stats, pq->ctlp->lstat);
+                }
+                else {
+                    status = ENOTSUP;
+                }
+                (void)ctl_rel(pq, 0);
+            }
+        }
+    pq_unlockIf(pq);
+
+    return status;
+}
+
+/**
+ * Sets the number of data-products after the cursor whose regions are
+ * prefetched by `pq_sequence()` when it moves forward (TV_GT) through a
+ * product-queue. This is useful for a product-queue that's larger than
+ * physical memory and a process that's catching up. The pages of the regions
+ * of sequenced data-products are also marked as reclaimable. Only affects the
+ * product-queue as opened by the calling process.
+ *
+ * @param[in] pq       The product-queue.
+ * @param[in] count    The number of data-products to prefetch. 0 disables
+ *                     prefetching.
+ * @retval    0        Success.
+ * @retval    EINVAL   `pq == NULL`.
+ */
+int
+pq_setPrefetch(
+        pqueue* const  pq,
+        const unsigned count)
+{
+    if (pq == NULL)
+        return EINVAL;
+
+    pq_lockIf(pq);
+        pq->pf_count = count;
+        if (count)
+            fSet(pq->pflags, PQ_PREFETCH);
+        else
+            fClr(pq->pflags, PQ_PREFETCH);
+    pq_unlockIf(pq);
+
+    return 0;
+}
+
+/**
+ * Returns the statistics of the prefetching of data-products by
+ * `pq_sequence()` in the calling process.
+ *
+ * @param[in]  pq       The product-queue.
+ * @param[out] count    The number of data-products after the cursor that are
+ *                      prefetched (0 means prefetching is disabled) or NULL.
+ * @param[out] nprods   The number of data-products whose regions were
+ *                      prefetched or NULL.
+ * @param[out] nbytes   The number of bytes prefetched or NULL.
+ * @param[out] ncold    The number of sequenced data-products whose pages were
+ *                      marked as reclaimable or NULL.
+ * @retval     0        Success.
+ * @retval     EINVAL   `pq == NULL`.
+ */
+int
+pq_getPrefetchStats(
+        pqueue* const             pq,
+        unsigned* const           count,
+        unsigned long long* const nprods,
+        unsigned long long* const nbytes,
+        unsigned long long* const ncold)
+{
+    if (pq == NULL)
+        return EINVAL;
+
+    pq_lockIf(pq);
+        if (count)
+            *count = pq->pf_count;
+        if (nprods)
+            *nprods = pq->pf_prods;
+        if (nbytes)
+            *nbytes = pq->pf_bytes;
+        if (ncold)
+            *ncold = pq->pf_colds;
+    pq_unlockIf(pq);
+
+    return 0;
+}
+
+
+/**
+ * Sets the defaults for memory-mapping the entire product-queues that are
+ * subsequently created or opened by this process. Child processes inherit the
+ * defaults. The defaults don't apply to product-queues that are mapped region
+ * by region.
+ *
+ * @param[in] pflags  Flags that are added to those given to `pq_create()` and
+ *                    `pq_open()`. Bitwise OR of
+ *                      PQ_HUGEPAGES  Advise transparent huge pages
+ *                      PQ_POPULATE   Pre-fault the pages
+ * @param[in] node    NUMA node to which the memory of the mappings is bound or
+ *                    -1 for no binding.
+ * @retval    0       Success.
+ * @retval    EINVAL  `pflags` contains another flag or `node` is invalid.
+ *                    `log_add()` called.
+ */
+int
+pq_setMapDefaults(
+        const int pflags,
+        const int node)
+{
+    if (pflags & ~(PQ_HUGEPAGES|PQ_POPULATE)) {
+        log_add("Invalid memory-mapping flags: %#x", pflags);
+        return EINVAL;
+    }
+    if (node < -1 || node >= MAP_MAXNODES) {
+        log_add("Invalid NUMA node: %d", node);
+        return EINVAL;
+    }
+
+    mapFlags = pflags;
+    mapNode = node;
+
+    return 0;
+}
+
+/**
+ * Creates a product-queue. On success, the writer-counter of the created
+ * product-queue will be one.
+ *
+ * @param[in] path        Pathname of the product-queue.
+ * @param[in] mode        File mode. Bitwise OR of
+ *                        - S_IRWXU    Read, write, execute/search by owner.
+ *                            + S_IRUSR  Read permission, owner.
+ *                            + S_IWUSR  Write permission, owner.
+ *                        - S_IRWXG    Read, write, execute/search by group.
+ *                            + S_IRGRP  Read permission, group.
+ *                            + S_IWGRP  Write permission, group.
+ *                        - S_IRWXO    Read, write, execute/search by others.
+ *                            + S_IROTH  Read permission, others.
+ *                            + S_IWOTH  Write permission, others.
+ *                        This value is bitwise ANDed with the complement of the
+ *                        process' file mode creation mask.
+ * @param[in]  pflags     Product-queue flags. Bitwise OR of
+ *                          PQ_DEFAULT	  Default attributes (0).
+ *                          PQ_MAPRGNS    Map region by region. Default is whole
+ *                                        file.
+ *                          PQ_NOCLOBBER  Don't replace an existing
+ *                                        product-queue.
+ *                          PQ_NOLOCK     Disable locking (DANGER!)
+ *                          PQ_NOMAP      Use `malloc/read/write/free` instead
+ *                                        of `mmap()`
+ *                          PQ_PRIVATE    `mmap()` the file `MAP_PRIVATE`.
+ *                                        Default is `MAP_SHARED`.
+ *                          PQ_ROBUST     Lock the control-region with a
+ *                                        robust, process-shared lock in the
+ *                                        file rather than `fcntl()`.
+ *                          PQ_TQRING     Index the data-products by
+ *                                        insertion-time with a circular
+ *                                        array rather than a skip list. The
+ *                                        product-queue can't be opened by
+ *                                        older versions of the LDM.
+ *                          PQ_SXOPEN     Index the data-products by
+ *                                        signature with an open-addressed
+ *                                        hash table rather than a chained
+ *                                        one. The product-queue can't be
+ *                                        opened by older versions of the LDM.
+ *                          PQ_TQFEED     Record the feedtype of each
+ *                                        data-product in the time-index so
+ *                                        that readers can skip products not
+ *                                        in their class without reading them.
+ *                                        The product-queue can't be opened by
+ *                                        older versions of the LDM.
+ *                          PQ_RLCLASS    Allocate small data-products from
+ *                                        free lists and slabs of
+ *                                        size-classes. The product-queue
+ *                                        can't be opened by older versions
+ *                                        of the LDM.
+ *                          PQ_CHUNKED    Store a large data-product for
+ *                                        which there's no contiguous free
+ *                                        region as a chain of chunks. Needs
+ *                                        memory-mapping. The product-queue
+ *                                        can't be opened by older versions
+ *                                        of the LDM.
+ *                          PQ_COMPRESS   Compress the data of data-products
+ *                                        with zlib when that saves space.
+ *                                        All feedtypes are compressed until
+ *                                        `pq_setCompression()` says
+ *                                        otherwise. The product-queue can't
+ *                                        be opened by older versions of the
+ *                                        LDM.
+ *                          PQ_EVSIGS     Remember the signatures of evicted
+ *                                        data-products for an hour (see
+ *                                        `pq_setEvictedHorizon()`) so that
+ *                                        their late duplicates are rejected.
+ *                                        The product-queue can't be opened by
+ *                                        older versions of the LDM.
+ *                          PQ_HUGEPAGES  Advise transparent huge pages for the
+ *                                        memory-mapping of the whole file.
+ *                          PQ_POPULATE   Pre-fault the memory-mapping of the
+ *                                        whole file.
+ * @param[in]  align      Alignment parameter for file components or 0.
+ * @param[in]  initialsz  Size, in bytes, of the data portion of the product-
+ *                        queue.
+ * @param[in]  nproducts  Number of product slots to create.
+ * @param[out] pqp        Product-queue.
+ * @retval     0          Success. `*pqp` is set.
+ * @retval     ENOTSUP    `pflags` contains PQ_ROBUST and robust locking isn't
+ *                        supported by this system or by `pflags`. `log_add()`
+ *                        called.
+ */
+int
+pq_create(const char *path, mode_t mode,
+        int pflags,
+        size_t align,
+        off_t initialsz, /* initial allocation available */
+        size_t nproducts, /* initial rl->nalloc, ... */
+        pqueue **pqp)
+{
+        int oflags = (O_RDWR|O_CREAT|O_TRUNC);
+        int fd;
+        pqueue *pq = NULL;
+        int status = ENOERR;
+
+        /* enforce minimum alignment */
+        align = (align == 0 ? M_RND_UNIT : _RNDUP(align, M_RND_UNIT));
+        /* TODO: check for absurd align values ? */
+
+        if(initialsz != 0)
+                initialsz = (off_t) _RNDUP(initialsz, align);
         else
+                initialsz = (off_t) align;
+
+        pq = pq_new(pflags, align, initialsz, nproducts);
+        if(pq == NULL)
+                return errno;
+
+        if(fIsSet(pflags, PQ_NOCLOBBER))
+                fSet(oflags, O_EXCL);
+        fd = open(path, oflags, mode);
+        if(fd < 0)
+        {
+                status = errno;
+                goto unwind_new;
+        }
+        (void)ensure_close_on_exec(fd);
+
+        pq->fd = fd;
+        (void)strncpy(pq->pathname, path, sizeof(pq->pathname));
+        pq->pathname[sizeof(pq->pathname)-1] = 0;
+
+        status = ctl_init(pq, align);
+        if(status != ENOERR)
+                goto unwind_open;
+
+        (void) ctl_rel(pq, RGN_MODIFIED);
+
+        if(fIsSet(pflags, PQ_ROBUST))
         {
-            /*
-             * The product-queue will be accessed by being memory-mapped
-             * once, in its entirety.
-             */
-            pq->ftom = mm0_ftom;
-            pq->mtof = mm0_mtof;
+                /* N.B. The control-region was locked by fcntl(2) until now */
+                status = lock_map(pq, path);
+                if(status != ENOERR)
+                        goto unwind_open;
         }
+
+        notify_map(pq);
+        ls_map(pq);
+        *pqp = pq;
+
+        return ENOERR;
+
+unwind_open:
+        (void)close(fd);
+        (void)unlink(path);
+        /*FALLTHROUGH*/
+unwind_new:
+        pq_free(pq);
+        return status;
+}
+
+
+/**
+ * Opens an existing product-queue.
+ *
+ * @param[in] path         Pathname of product-queue.
+ * @param[in] pflags       File-open flags. Bitwise OR of
+ *                           PQ_MAPRGNS    Map region by region, default whole
+ *                                         file if possible; otherwise by region
+ *                           PQ_NOLOCK     Disable locking (DANGER!)
+ *                           PQ_NOMAP      Use `malloc/read/write/free` instead
+ *                                         of `mmap()`
+ *                           PQ_PRIVATE    `mmap()` the file `MAP_PRIVATE`.
+ *                                         Default is `MAP_SHARED`
+ *                           PQ_READONLY   Default is read-write.
+ *                           PQ_PREFETCH   Prefetch the data-products after the
+ *                                         cursor of `pq_sequence()`
+ *                           PQ_HUGEPAGES  Advise transparent huge pages for
+ *                                         the memory-mapping of the whole file
+ *                           PQ_POPULATE   Pre-fault the memory-mapping of the
+ *                                         whole file
+ * @param[out] pqp         Memory location to receive pointer to product-queue
+ *                         structure.
+ * @retval     0           Success. *pqp set.
+ * @retval     EACCES      Permission denied. pflags doesn't contain PQ_READONLY
+ *                         and the product-queue is already open by the maximum
+ *                         number of writers.
+ * @retval     ENOTSUP     The product-queue was created with PQ_ROBUST and
+ *                         robust locking isn't supported by this system or by
+ *                         `pflags`. `log_add()` called.
+ * @retval     PQ_CORRUPT  The  product-queue is internally inconsistent.
+ * @return                 Other <errno.h> error-code.
+ */
+int
+pq_open(
+    const char* const path,
+    int               pflags,
+    pqueue** const    pqp)
+{
+    int               status;
+    bool              lstat = false; /* has lock statistics? */
+    pqueue*           pq = pq_new(pflags, M_RND_UNIT, 0, 0);
+
+    if (NULL == pq) {
+        status = errno;
     }
-#endif
+    else {
+        pq->fd = open(path, fIsSet(pflags, PQ_READONLY) ? O_RDONLY : O_RDWR, 0);
+
+        if (0 > pq->fd) {
+            status = errno;
+        }
+        else {
+            (void)ensure_close_on_exec(pq->fd);
+            (void)strncpy(pq->pathname, path, sizeof(pq->pathname));
+            pq->pathname[sizeof(pq->pathname)-1] = 0;
+            status = ctl_gopen(pq, path);
+
+            if (!status) {
+                const bool robust = LOCK_MAGIC == pq->ctlp->lock_magic &&
+                        pq->ctlp->lock_robust;
+
+                if (NOTIFY_MAGIC == pq->ctlp->notify_magic &&
+                        pq->ctlp->notify_sigcont)
+                    fSet(pq->pflags, PQ_SIGCONT);
+                if (ctl_ixFormats(pq->ctlp) & IX_TQRING)
+                    fSet(pq->pflags, PQ_TQRING);
+                if (ctl_ixFormats(pq->ctlp) & IX_SXOPEN)
+                    fSet(pq->pflags, PQ_SXOPEN);
+                if (ctl_ixFormats(pq->ctlp) & IX_TQFEED)
+                    fSet(pq->pflags, PQ_TQFEED);
+                if (ctl_ixFormats(pq->ctlp) & IX_CHUNKS)
+                    fSet(pq->pflags, PQ_CHUNKED);
+                if (ctl_ixFormats(pq->ctlp) & IX_ZIPPED) {
+                    fSet(pq->pflags, PQ_COMPRESS);
+                    pq->zipfeeds = pq->ctlp->zip_feeds;
+                }
+                if (ctl_ixFormats(pq->ctlp) & IX_EVSIGS)
+                    fSet(pq->pflags, PQ_EVSIGS);
+                if (ctl_ixFormats(pq->ctlp) & IX_RLCLASS)
+                    fSet(pq->pflags, PQ_RLCLASS);
+                lstat = LSTAT_MAGIC == pq->ctlp->lstat_magic;
+
+                (void)ctl_rel(pq, 0);           /* release control-block */
+
+                if (robust) {
+                    /*
+                     * The control-region is henceforth locked by the robust
+                     * lock rather than by fcntl(2).
+                     */
+                    fSet(pq->pflags, PQ_ROBUST);
+                    status = lock_map(pq, path);
+                }
+
+                if (!status && !fIsSet(pflags, PQ_READONLY)) {
+                    status = ctl_get(pq, RGN_WRITE);
+
+                    if (!status) {
+                        int      rflags = 0;    /* control-block unmodified */
+                        pqctl*   ctlp = pq->ctlp;
+
+                        if (WRITE_COUNT_MAGIC != ctlp->write_count_magic) {
+                            /*
+                             * This process is the first one of this version of
+                             * the LDM to open the product-queue for writing.
+                             * Initialize the "write count" mechanism.
+                             */
+                            ctlp->write_count_magic = WRITE_COUNT_MAGIC;
+                            ctlp->write_count = 0;
+                            rflags = RGN_MODIFIED;
+                        }
+
+                        if (MAX_WRITE_COUNT > ctlp->write_count) {
+                            ctlp->write_count++;
+                            rflags = RGN_MODIFIED;
+                        }
+                        else {
+                            log_error_q("Too many writers (%u) to product-queue "
+                                "(%s)", ctlp->write_count, path);
+
+                            status = EACCES;    /* too many writers */
+                        }
+
+                        if (!status) {
+                            if (METRICS_MAGIC != ctlp->metrics_magic) {
+                                /*
+                                 * This process is the first one of this
+                                 * version of the LDM to open the product-queue
+                                 * for writing.  Initialize the additional
+                                 * metrics.
+                                 */
+                                ctlp->metrics_magic = METRICS_MAGIC;
+                                ctlp->mostRecent = TS_NONE;
+                                ctlp->minVirtResTime = TS_NONE;
+                                ctlp->isFull = 0;
+                                rflags = RGN_MODIFIED;
+                            }
+                            if (METRICS_MAGIC_2 != ctlp->metrics_magic_2) {
+                                /*
+                                 * This process is the first one of this
+                                 * version of the LDM to open the product-queue
+                                 * for writing.  Initialize the additional
+                                 * metrics.
+                                 */
+                                ctlp->metrics_magic_2 = METRICS_MAGIC_2;
+                                ctlp->mvrtSize = -1;
+                                ctlp->mvrtSlots = 0;
+                                rflags = RGN_MODIFIED;
+                            }
+                            if (NOTIFY_MAGIC != ctlp->notify_magic) {
+                                /*
+                                 * This process is the first one of this
+                                 * version of the LDM to open the product-queue
+                                 * for writing.  Initialize the insertion-
+                                 * notification.
+                                 */
+                                ctlp->notify_magic = NOTIFY_MAGIC;
+                                ctlp->notify_sigcont = 0;
+                                ctlp->insert_seq = 0;
+                                rflags = RGN_MODIFIED;
+                            }
+                            if (LOCK_MAGIC != ctlp->lock_magic) {
+                                /*
+                                 * This process is the first one of this
+                                 * version of the LDM to open the product-queue
+                                 * for writing. The control-region is locked by
+                                 * fcntl(2).
+                                 */
+                                ctlp->lock_magic = LOCK_MAGIC;
+                                ctlp->lock_robust = 0;
+                                rflags = RGN_MODIFIED;
+                            }
+                            if (WRITE_GEN_MAGIC != ctlp->write_gen_magic) {
+                                /*
+                                 * This process is the first one of this
+                                 * version of the LDM to open the product-queue
+                                 * for writing. Enable optimistic reading.
+                                 */
+                                ctlp->write_gen_magic = WRITE_GEN_MAGIC;
+                                rflags = RGN_MODIFIED;
+                            }
+                            if (IX_MAGIC != ctlp->ix_magic) {
+                                /*
+                                 * This process is the first one of this
+                                 * version of the LDM to open the product-queue
+                                 * for writing. The indexes are in the formats
+                                 * of earlier versions.
+                                 */
+                                ctlp->ix_magic = IX_MAGIC;
+                                ctlp->ix_formats = 0;
+                                rflags = RGN_MODIFIED;
+                            }
+                            if (ALLOC_MAGIC != ctlp->alloc_magic) {
+                                /*
+                                 * This process is the first one of this
+                                 * version of the LDM to open the product-queue
+                                 * for writing. Initialize the allocation
+                                 * metrics.
+                                 */
+                                ctlp->alloc_magic = ALLOC_MAGIC;
+                                ctlp->alloc_inserts = 0;
+                                ctlp->alloc_evictions = 0;
+                                rflags = RGN_MODIFIED;
+                            }
+                            if (CONS_MAGIC != ctlp->cons_magic) {
+                                /*
+                                 * This process is the first one of this
+                                 * version of the LDM to open the product-queue
+                                 * for writing. Clear the registry of
+                                 * consumers.
+                                 */
+                                ctlp->cons_magic = CONS_MAGIC;
+                                ctlp->cons_overruns = 0;
+                                (void)memset(ctlp->cons, 0,
+                                        sizeof(ctlp->cons));
+                                rflags = RGN_MODIFIED;
+                            }
+                            if (ZIP_MAGIC != ctlp->zip_magic) {
+                                /*
+                                 * This process is the first one of this
+                                 * version of the LDM to open the product-queue
+                                 * for writing. Nothing's compressed.
+                                 */
+                                ctlp->zip_magic = ZIP_MAGIC;
+                                ctlp->zip_feeds = NONE;
+                                ctlp->zip_in = 0;
+                                ctlp->zip_out = 0;
+                                rflags = RGN_MODIFIED;
+                            }
+                            if (LSTAT_MAGIC != ctlp->lstat_magic) {
+                                /*
+                                 * This process is the first one of this
+                                 * version of the LDM to open the product-queue
+                                 * for writing. Clear the lock statistics.
+                                 */
+                                ctlp->lstat_magic = LSTAT_MAGIC;
+                                (void)memset(ctlp->lstat, 0,
+                                        sizeof(ctlp->lstat));
+                                rflags = RGN_MODIFIED;
+                            }
+                        }
+
+                        (void)ctl_rel(pq, rflags);
+                    }                           /* ctl_get() success */
+                }                               /* open for writing */
+            }                                   /* ctl_gopen() success */
+
+            if (status) {
+                lock_unmap(pq);
+                (void)close(pq->fd);
+                pq->fd = -1;
+            }
+        }                                       /* pq->fd >= 0 */
+
+        if (status) {
+            pq_free(pq);
+        }
+        else {
+            notify_map(pq);
+            if (lstat || !fIsSet(pflags, PQ_READONLY))
+                ls_map(pq);
+            *pqp = pq;
+        }
+    }                                           /* pq != NULL */
+
+    return status;
 }
 
 
-/*
- * Initialize the in-memory state of pq from an existing file. Called by
- * pq_open().  On successful return, the control region (pq->ctlp) will be
- * mapped and/or locked.
+/**
+ * Returns the flags used to open or create a product-queue.
  *
- * Arguments:
- *      pq      Pointer to product-queue structure to be set.
- *      path    Pathname of product-queue.
+ * @param[in] pq  The product-queue.
+ * @return        The flags: a bitwise OR of
+ *                    PQ_MAPRGNS     Map region by region, default whole file.
+ *                    PQ_NOCLOBBER   Don't replace an existing product-queue.
+ *                    PQ_NOLOCK      Disable locking.
+ *                    PQ_NOMAP       Use `malloc/read/write/free` instead of
+ *                                   `mmap()`
+ *                    PQ_PRIVATE     `mmap()` the file `MAP_PRIVATE`. Default is
+ *                                   `MAP_SHARED`
+ *                    PQ_READONLY    Default is read/write.
+ *                    PQ_THREADSAFE  Product-queue access is thread-safe
+ */
+int
+pq_getFlags(
+        pqueue* const pq)
+{
+    pq_lockIf(pq);
+        int pflags = pq->pflags;
+    pq_unlockIf(pq);
+
+    return pflags;
+}
+
+/*
+ * On success, if the product-queue was open for writing, then its
+ * writer-counter will be decremented.
  *
  * Returns:
- *      0           Success
- *      PQ_CORRUPT  The  product-queue is internally inconsistent.
- *      else        <errno.h> error-code.
- */
-static int
-ctl_gopen(pqueue *const pq, const char *path)
+ *      0               Success.
+ *      EOVERFLOW       Write-count of product queue was prematurely zero.
+ *      !0              Other <errno.h> code.
+ */
+int
+pq_close(pqueue *pq)
 {
-        int status = ENOERR;
-        pqctl *ctlp;
-        size_t ctlsz; 
-        void *vp = NULL;
+    int status = ENOERR;                    /* success */
+    int fd = -1;
 
-        log_assert(pq != NULL);
-        log_assert(pq->pagesz > 0);
-        log_assert(pq->ixp == NULL && pq->rlp == NULL && pq->tqp == NULL);
+    if (pq == NULL)
+            return 0;
 
-        ctlsz = pq->pagesz;
+    pq_lockIf(pq);
+        fd = pq->fd;
 
-        /*FALLTHROUGH*/
-remap:
-        status = (pq->ftom)(pq, 0, ctlsz, 0, &vp);
-#ifdef HAVE_MMAP
-        if(status == EIO && (pq->ftom == mm_ftom || pq->ftom == mm0_ftom))
+        if(pq->riulp != NULL)
         {
-                log_warning_q("Product-queue can't be memory-mapped!  "
-                    "Continuing with slower read/write I/O.");
-                /* try again */
-                pq->ftom = f_ftom;
-                pq->mtof = f_mtof;
-                status = (pq->ftom)(pq, 0, ctlsz, 0, &vp);
+                while(pq->riulp->nelems > 2)
+                {
+                        off_t offset =
+                                pq->riulp->rp[pq->riulp->nelems -1].offset;
+                        if(offset == pq->ixo || offset == 0)
+                                continue;
+                        (void) rgn_rel(pq, offset, 0);
+                }
         }
-#endif
-        if(status != ENOERR)
-                return status;
 
-        ctlp = (pqctl *)vp;
-        if(ctlp->magic != PQ_MAGIC)
-        {
-                /* Not a product queue */
-                log_error_q("%s: Not a product queue", path);
-                status = EINVAL;
-                goto unwind_map;
-        }
-        if (PQ_VERSION != ctlp->version && 7 != ctlp->version)
-        {
-                log_error_q("%s: Product queue is version %d instead of expected version %d",
-                       path, ctlp->version, PQ_VERSION);
-                status = EINVAL;
-                goto unwind_map;
-        }
-        if(ctlp->datao % pq->pagesz != 0)
-        {
-                /* Can't align */
-                /* TODO: If we use read()/write() not fatal ??? */
-                log_error_q("%s: Can't align", path);
-                status = EINVAL;
-                goto unwind_map;
-        }
-        if((size_t)ctlp->datao != ctlsz)
+        if(pq->rlp != NULL)
         {
-                /* we guessed wrong, try again */
-                if(ctlsz != pq->pagesz)
-                {
-                        /* don't try more than once */
-                        status = EINVAL;
-                        goto unwind_map;
-                }
-                ctlsz = (size_t)ctlp->datao;
-                (void)(pq->mtof)(pq, 0, 0);
-                goto remap;
+                (void)(pq->mtof)(pq, pq->ixo, RGN_NOLOCK);
+                pq->rlp = NULL;
         }
 
-        pq->datao = ctlp->datao;
-        pq->ixo = ctlp->ixo;
-        pq->ixsz = ctlp->ixsz;
-        pq->nalloc = ctlp->nalloc;
-        pq->ctlp = ctlp;
+        if (fIsSet(pq->pflags, PQ_READONLY)) {
+            if (NULL != pq->ctlp)
+                (void)ctl_rel(pq, 0);
+        }
+        else {
+            status = ctl_get(pq, RGN_WRITE);
 
-        if (!(pq->datao > 0) ||
-            !(pq->datao % pq->pagesz == 0) ||
-            !(pq->ixo > pq->datao) ||
-            !(pq->ixo % pq->pagesz == 0) ||
-            !(pq->ixsz >= pq->pagesz) ||
-            !(pq->ixsz % pq->pagesz == 0)) {
+            if (!status) {
+                int rflags;
 
-            log_error_q("pq->datao=%lu, pq->pagesz=%lu, pq->ixo=%lu, "
-                "pq->ixsz=%lu",
-                (unsigned long)pq->datao, (unsigned long)pq->pagesz, 
-                (unsigned long)pq->ixo, (unsigned long)pq->ixsz);
-            status = PQ_CORRUPT;
-            goto unwind_map;
-        }
+                if (0 < pq->ctlp->write_count) {
+                    pq->ctlp->write_count--;
+                    rflags = RGN_MODIFIED;
+                }
+                else {
+                    log_error_q("Write-count of product-queue prematurely 0");
 
-        /*
-         * Reset the product-queue access-functions based on the product-queue's
-         * actual size.
-         */
-        ctl_setAccessFunctions(pq);
+                    rflags = 0;                 /* unmodified */
+                    status = EOVERFLOW;
+                }
 
-        /* bring in the indexes */
-        status = (pq->ftom)(pq, pq->ixo, pq->ixsz, RGN_NOLOCK, &pq->ixp);
-        if(status != ENOERR)
-                goto unwind_map;
+                (void)ctl_rel(pq, rflags);
+            }
+        }                                       /* was opened for writing */
 
-        if (!ix_ptrs(pq->ixp, pq->ixsz, pq->nalloc, pq->ctlp->align,
-                &pq->rlp, &pq->tqp, &pq->fbp, &pq->sxp)) {
-            status = PQ_CORRUPT;
-            goto unwind_map;
+#ifdef HAVE_MMAP
+        if(pq->base != NULL && pq->ftom == mm0_ftom)
+        {
+                /* special case, time to unmap the whole thing */
+                int mflags = 0; /* TODO: translate rflags to mflags */
+                (void) unmapwrap(pq->base, 0, pq->mapped, mflags);
+                if(pq->mapsz > pq->mapped)
+                        (void) munmap((char*)pq->base + pq->mapped,
+                                        pq->mapsz - pq->mapped);
+                pq->base = NULL;
         }
+#endif
 
-        if (!(pq->rlp->nalloc == pq->nalloc && pq->tqp->nalloc == pq->nalloc
-                        && pq->sxp->nalloc == pq->nalloc)) { 
-                log_error_q("pq->rlp->nalloc=%lu, pq->nalloc=%lu, "
-                    "pq->tqp->nalloc=%lu, pq->sxp->nalloc=%lu",
-                    (unsigned long)pq->rlp->nalloc,
-                    (unsigned long)pq->nalloc, 
-                    (unsigned long)pq->tqp->nalloc, 
-                    (unsigned long)pq->sxp->nalloc);
-                status = PQ_CORRUPT;
-                goto unwind_map;
-        }
+    pq_unlockIf(pq);
+    cons_unregister(pq);
+    notify_unmap(pq);
+    lock_unmap(pq);
+    ls_unmap(pq);
+    pq_free(pq);
 
-        return ENOERR;
+    if(fd > -1 && close(fd) < 0 && !status)
+            status = errno;
 
-unwind_map:
-        (void)(pq->mtof)(pq, 0, 0);
-        return status;
+    return status;
 }
 
 
 /**
- * Get/lock the ctl for access by this process
+ * Returns the pathname of a product-queue as given to `pq_create()` or
+ * `pq_open()`.
  *
- * @param[in] rflags  Region flags: bitwise OR of
- *                    - RGN_NOLOCK  Don't lock region; locking handled elsewhere
- *                    - RGN_WRITE   Region will be modified
- *                    - RGN_NOWAIT  Return immediately if can't lock, else wait
- * @retval ENOERR     Success.
- * @retval EACCESS or EAGAIN
- *                    The region is already locked by another process.
- * @retval EINVAL     The product-queue file doesn't support locking.
- * @retval ENOLCK     The number of locked regions would exceed a system-imposed
- *                    limit.
- * @retval EDEADLK    A deadlock in region locking has been detected.
- * @retval EBADF      The file descriptor of the product-queue is invalid.
- * @retval EIO        An I/O error occurred while reading from the file system.
- * @retval EOVERFLOW  The file size in bytes or the number of blocks allocated
- *                    to the file or the file serial number cannot be
- *                    represented correctly.
- * @retval EINTR      A signal was caught during execution.
- * @retval EFBIG or EINVAL
- *                    The size of the product-queue is greater than the maximum
- *                    file size.
- * @retval EROFS      The named file resides on a read-only file system.
- * @retval EAGAIN     The mapping could not be locked in memory, if required by
- *                    mlockall(), due to a lack of resources.
- * @retval EINVAL     The product-queue object wants to map the product-queue to
- *                    a fixed memory location that is not a multiple of the page
- *                    size as returned by sysconf(), or is considered invalid
- *                    by the O/S.
- * @retval EMFILE     The number of mapped regions would exceed an O/S-dependent
- *                    limit (per process or per system).
- * @retval ENODEV     The file descriptor of the product-queue object refers to
- *                    a file whose type is not supported by mmap().
- * @retval ENOMEM     The size of the product-queue exceeds that allowed for the
- *                    address space of a process.
- * @retval ENOMEM     The mapping could not be locked in memory, if required by
- *                    mlockall(), because it would require more space than the
- *                    system is able to supply.
- * @retval ENOTSUP    The O/S does not support the combination of accesses
- *                    requested.
- * @retval ENXIO      The size of the product-queue is invalid for the object
- *                    specified by its file descriptor.
+ * @param[in] pq  The product-queue.
+ * @return        The pathname of the product-queue as given to `pq_create()` or
+ *                `pq_open()`.
  */
-static int
-ctl_get(pqueue *const pq, int const rflags)
+const char* pq_getPathname(
+        pqueue* pq)
 {
-        int status = ENOERR;
+    pq_lockIf(pq);
+        const char* pathname = pq->pathname;
+    pq_unlockIf(pq);
 
-#if _NOMAP || !defined(HAVE_MMAP)
-        log_assert(pq->mtof == f_mtof);
-        log_assert(pq->ctlp == NULL);
-        log_assert(pq->ixp == NULL);
-#endif
+    return pathname;
+}
 
-        if(fIsSet(rflags, RGN_WRITE) && !fIsSet(pq->pflags, PQ_SIGSBLOCKED))
-        {
-                /* We are beginning a critical section */
-                sigset_t set;
 
-                (void) sigfillset(&set);
-                (void) sigdelset(&set, SIGABRT);
-                (void) sigdelset(&set, SIGFPE);
-                (void) sigdelset(&set, SIGILL);
-                (void) sigdelset(&set, SIGSEGV);
-                (void) sigdelset(&set, SIGBUS);
-                status = pthread_sigmask(SIG_BLOCK, &set, &pq->sav_set);
-                log_assert(0 == status);
-                fSet(pq->pflags, PQ_SIGSBLOCKED);
-        }
-        if(pq->ctlp == NULL)
-        {
-                /* bring in the pqctl */
-                status = (pq->ftom)(pq,
-                                 0, (size_t)pq->datao, rflags,
-                                (void **)&pq->ctlp);
-                if(status != ENOERR)
-                        goto unwind_mask;
-        }
-        log_assert(pq->ctlp->magic == PQ_MAGIC);
-        log_assert(PQ_VERSION == pq->ctlp->version || 7 == pq->ctlp->version);
-        log_assert(pq->ctlp->datao == pq->datao);
-        log_assert(pq->ctlp->ixo == pq->ixo);
-        log_assert(pq->ctlp->ixsz == pq->ixsz);
+/*
+ * Let the user find out the pagesize.
+ */
+int
+pq_pagesize(pqueue *pq)
+{
+    /*
+     * Allow the caller to figure out what the default would be prior to
+     * calling `pq_create()`.
+     */
+    if(pq == NULL)
+        return (int)pagesize();
+
+    // Else, tell the caller what it is
+    pq_lockIf(pq);
+        int pagesz = (int) pq->pagesz;
+    pq_unlockIf(pq);
 
-        if(pq->ixp == NULL)
-        {
-                /* bring in the indexes */
-                status = (pq->ftom)(pq,
-                                 pq->ixo, pq->ctlp->ixsz, rflags|RGN_NOLOCK,
-                                &pq->ixp);
-                if(status != ENOERR)
-                        goto unwind_ctl;
-        }
+    return pagesz;
+}
 
-        ix_ptrs(pq->ixp, pq->ixsz, pq->nalloc, pq->ctlp->align, &pq->rlp,
-            &pq->tqp, &pq->fbp, &pq->sxp);
-        log_assert(pq->rlp->nalloc == pq->nalloc && pq->tqp->nalloc == pq->nalloc
-                        && pq->sxp->nalloc == pq->nalloc);
 
-        return ENOERR;
-unwind_ctl:
-        (void) (pq->mtof)(pq, 0, 0);
-        pq->ctlp = NULL;
-unwind_mask:
-        {
-            sigset_t set = pq->sav_set;
+/**
+ * Returns the size of the data portion of a product-queue.
+ *
+ * @param[in] pq  Pointer to the product-queue object.
+ * @return        The size, in bytes, of the data portion of the product-queue.
+ */
+size_t
+pq_getDataSize(
+    pqueue* const       pq)
+{
+    pq_lockIf(pq);
+        size_t size = pq->ixo - pq->datao;
+    pq_unlockIf(pq);
 
-            (void) sigemptyset(&pq->sav_set);
-            fClr(pq->pflags, PQ_SIGSBLOCKED);
-            (void) pthread_sigmask(SIG_SETMASK, &set, NULL);
-        }
-        return status;
+    return size;
 }
 
-/******************************************************************************
- * Product-Queue Functions:
- ******************************************************************************/
 
-static void
-pq_lockIf(pqueue* const pq)
+typedef struct {
+    time_t      start;
+    /*
+     * Hostnames are limited to 255 bytes.  See
+     * <http://www.opengroup.org/onlinepubs/007908799/xns/gethostname.html>.
+     */
+    char        hostname[256];
+} FutureEntry;
+
+
+static inline int
+compareFutureEntries(
+    const void* const   entry1,
+    const void* const   entry2)
 {
-    if (fIsSet(pq->pflags, PQ_THREADSAFE)) {
-        int status = pthread_mutex_lock(&pq->mutex);
+    const char* name1 = ((FutureEntry*)entry1)->hostname;
+    const char* name2 = ((FutureEntry*)entry2)->hostname;
 
-        if (status) {
-            log_add_errno(status, "pthread_mutex_lock() failure");
-            log_flush_error();
-            abort();
-        }
-    }
+    return strcmp(name1, name2);
 }
 
+
 static void
-pq_unlockIf(pqueue* const pq)
+vetCreationTime(
+    const prod_info* const      info)
 {
-    if (fIsSet(pq->pflags, PQ_THREADSAFE)) {
-        int status = pthread_mutex_unlock(&pq->mutex);
+    /*
+     * Vet the creation-time of a data-product.
+     */
+    timestampt  initialSearchTime = info->arrival;
+    timestampt  now;
 
-        if (status) {
-            log_add_errno(status, "pthread_mutex_unlock() failure");
-            log_flush_error();
-            abort();
+    /*
+     * Keep the following consonant with the temporal backoff in
+     * pq_setCursorFromSignature().
+     */
+    initialSearchTime.tv_sec -= SEARCH_BACKOFF;
+
+    (void)set_timestamp(&now);
+
+    if (tvCmp(initialSearchTime, now, >)) {
+        const char* const       origin = info->origin;
+        char*                   cp = strstr(origin, "_v_");
+        size_t                  len =
+            cp == NULL ?  strlen(origin) : (size_t)(cp - origin);
+
+        if (log_is_enabled_info) {
+            log_add("Future product from \"%*s\". "
+                    "Fix local or ingest clock. %s",
+                    (int)len, origin, s_prod_info(NULL, 0, info, 0));
+            log_flush_warning();
         }
-    }
-}
+        else {
+            FutureEntry         targetEntry;
+            FutureEntry* const* treeEntry;
+            static void*        root = NULL;
+#           define              FUTURE_INTERVAL (60*60) /* 1 h */
 
-/*
- * Sets the offset and size fields of a product-queue structure.
- *
- * Arguments:
- *      pq              Pointer to the product-queue structure to have its
- *                      "pagesz", "datao", "ixo", "ixsz", and "nalloc" fields
- *                      set.
- *      align           Alignment reguirement in bytes.
- *      initsz          Initial size of the data segment in bytes.
- *      nregions        The capacity of the product-queue in products.
- */
-static void
-pq_setOffsetsAndSizes(
-    pqueue* const       pq,
-    const size_t        align,
-    const off_t         initsz,
-    const size_t        nregions)
-{
-    /* Size of an I/O page in bytes: */
-    pq->pagesz = (size_t)pagesize();
-    /* Offset to the data segment in bytes: */
-    pq->datao = lcm(pq->pagesz, align);
-    log_assert(pq->datao >= sizeof(pqctl));
-    /* Offset to the index segment in bytes: */
-    pq->ixo = pq->datao + _RNDUP(initsz, pq->pagesz);
-    /* The capacity of the product-queue in products: */
-    pq->nalloc = nregions;
+            if (len > (sizeof(targetEntry.hostname)-1))
+                len = sizeof(targetEntry.hostname) - 1;
+            (void)memcpy(targetEntry.hostname, origin, len);
+            targetEntry.hostname[len] = 0;
 
-    /* Size of the index segement: */
-    if (nregions == 0) {
-        pq->ixsz = pq->pagesz;
-    }
-    else {
-        pq->ixsz = ix_sz(nregions, align);
-        pq->ixsz = _RNDUP(pq->ixsz, pq->pagesz);
-    }
+            treeEntry = tfind(&targetEntry, &root, compareFutureEntries);
+
+            if (treeEntry != NULL) {
+                FutureEntry*    entry = *treeEntry;
+                time_t          now = time(NULL);
+
+                if (entry->start <= now) {
+                    log_warning_q("Future product from \"%s\". "
+                            "Fix local or ingest clock. %s", entry->hostname,
+                            s_prod_info(NULL, 0, info, 0));
+
+                    entry->start = now + FUTURE_INTERVAL;
+                }
+            }
+            else {
+                FutureEntry*    newEntry = malloc(sizeof(FutureEntry));
+
+                log_warning_q("Future product from \"%s\". "
+                        "Fix local or ingest clock. %s", targetEntry.hostname,
+                    s_prod_info(NULL, 0, info, 0));
+
+                if (newEntry != NULL) {
+                    newEntry->start = time(NULL) + FUTURE_INTERVAL;
+                    (void)strcpy(newEntry->hostname, targetEntry.hostname);
+
+                    (void)tsearch(newEntry, &root, compareFutureEntries);
+                }                       /* "newEntry" allocated */
+            }                           /* host not in database */
+        }                               /* non-verbose logging */
+    }                                   /* product created in future */
 }
 
 
 /**
- * Allocates and initializes a product-queue structure.
+ * Inserts a data-product at the tail-end of the product-queue.
  *
- * @param[in] pflags     Product-queue flags. Bitwise OR of
- *                       - PQ_MAPRGNS    Map region by region, default is whole
- *                                       file if possible; otherwise, by region
- *                       - PQ_NOCLOBBER  Don't replace an existing product-queue
- *                       - PQ_NOLOCK     Disable locking (DANGER!)
- *                       - PQ_NOMAP      Use `malloc/read/write/free` instead of
- *                                       `mmap()`
- *                       - PQ_PRIVATE    `mmap()` the file `MAP_PRIVATE`.
- *                                       Default is `MAP_SHARED`.
- *                       - PQ_READONLY   Product-queue is read-only. Default is
- *                                       read/write.
- * @param[in] align      Alignment reguirement in bytes.
- * @param[in] initialsz  Capacity of the product-queue in bytes.
- * @param[in] maxProds   Capacity of the product-queue in number of products.
- * @retval    NULL       Failure. "errno" set.
- * @return               Pointer to the product-queue structure. The client
- *                       should call "pq_delete(pq)" when the structure is no
- *                       longer needed.
+ * @pre                    The control-region is write-locked.
+ * @param[in] pq           The product-queue.
+ * @param[in] prod         The data-product.
+ * @param[in] zbuf         The data of the data-product compressed by
+ *                         `zp_compress()` or NULL to store it uncompressed.
+ * @param[in] zlen         The length of `zbuf` in bytes.
+ * @retval ENOERR          Success.
+ * @retval PQ_DUP          Product already exists in the queue.
+ * @retval PQ_BIG          Product is too large to insert in the queue.
+ * @return                 <errno.h> error code.
  */
-static pqueue*
-pq_new(
-    const int           pflags,
-    const size_t        align,
-    const off_t         initialsz,
-    const size_t        maxProds)
+static int
+rpq_insert(
+        pqueue *const        pq,
+        const product *const prod,
+        const void *const    zbuf,
+        const size_t         zlen)
 {
-    pqueue* const       pq = (pqueue*)malloc(sizeof(pqueue));
+        int status;
+        size_t extent;
+        size_t infolen = 0;
+        void *vp = NULL;
+        sxelem *sxep;
+        timestampt insertTime;
 
-    if (pq == NULL)
-        return NULL;
+        // log_debug_1("Getting product size");
+        if (zbuf) {
+                infolen = xlen_prod_info(&prod->info);
+                extent = ZP_HDRLEN + infolen + _RNDUP(zlen, 4);
+        }
+        else {
+                extent = xlen_product(prod);
+        }
+        if (extent > pq_getDataSize(pq)) {
+                log_debug("rpq_insert(): product is too big");
+                return PQ_BIG;
+        }
+
+        // log_debug_1("Getting space for product");
+        status = rpqe_new(pq, extent, prod->info.signature, &vp, &sxep);
+        if(status != ENOERR) {
+                log_debug("rpq_insert(): rpqe_new() failure");
+                return status;
+        }
+
+        // log_debug_1("XDR-ing product");
+        if (zbuf) {
+                char *const xp = (char *)vp + ZP_HDRLEN;
+                                                /* cast away const'ness */
+                if(xinfo_i(xp, infolen, XDR_ENCODE,
+                        (prod_info *)&prod->info) == NULL)
+                {
+                        log_debug("rpq_insert(): xinfo_i() failure");
+                        status = EIO;
+                        goto unwind_rgn;
+                }
+                zp_write(vp, xp, infolen, zbuf, zlen);
+                zp_count(pq, prod->info.sz, zlen);
+
+                const size_t rlix = rl_find(pq->rlp, sxep->offset);
+                if(rlix != RL_NONE)
+                        set_IsZipped(pq->rlp->rp + rlix);
+        }
+                                                /* cast away const'ness */
+        else if(xproduct(vp, extent, XDR_ENCODE, (product *)prod) == 0)
+        {
+                log_debug("rpq_insert(): xproduct() failure");
+                status = EIO;
+                goto unwind_rgn;
+        }
+
+        log_assert(pq->tqp != NULL && tq_HasSpace(pq->tqp));
+        status = tq_add(pq->tqp, pq->tqfp, sxep->offset, prod->info.feedtype,
+                &insertTime);
+        if(status != ENOERR) {
+                log_debug("rpq_insert(): tq_add() failure");
+                goto unwind_rgn;
+        }
+        sxe_setTime(pq->sxp, sxep, &insertTime);
+
+        // log_debug_1("Setting timestamp");
+        set_timestamp(&pq->ctlp->mostRecent);
+        ctl_incSeq(pq);
+        // log_debug_1("Vetting creation time");
+        vetCreationTime(&prod->info);
+        /*FALLTHROUGH*/
+
+unwind_rgn:
+        // log_debug_1("Releasing region");
+        (void) rgn_rel(pq, sxep->offset, status == ENOERR ? RGN_MODIFIED : 0);
+
+        return status;
+}
 
-    (void)memset(pq, 0, sizeof(pqueue));
-    (void)sigemptyset(&pq->sav_set);
 
-    /*
-     * This is a convenient place to overide things at compile time.
-     */
+/**
+ * Inserts a data-product at the tail-end of the product-queue without signaling
+ * the process group. Processes waiting on the insertion-counter of the
+ * product-queue are still notified.
+ *
+ * @param[in] pq           The product-queue.
+ * @param[in] prod         The data-product.
+ * @retval ENOERR          Success.
+ * @retval EINVAL          Invalid argument.
+ * @retval PQ_DUP          Product already exists in the queue.
+ * @retval PQ_BIG          Product is too large to insert in the queue.
+ */
+int
+pq_insertNoSig(pqueue *pq, const product *prod)
+{
+    int status = ENOERR;
 
-    pq->pflags = pflags;
+    pq_lockIf(pq);
+        log_assert(pq != NULL);
+        log_assert(prod != NULL);
 
-    fSet(pq->pflags, PQ_NOGROW); /* always set for this version of pq! */
-    pq_setOffsetsAndSizes(pq, align, initialsz, maxProds);
+        if(fIsSet(pq->pflags, PQ_READONLY)) {
+                log_debug("pq_insertNoSig(): queue is read-only");
+                status = EACCES;
+                goto unwind_lock;
+        }
 
-    if (pq->ixo < pq->datao) {
-        log_error_q("Queue-size not supported by environment: initialsz=%ld, "
-                "sizeof(off_t)=%lu, sizeof(size_t)=%lu", (long)initialsz,
-                (unsigned long)sizeof(off_t), (unsigned long)sizeof(size_t));
-        errno = EINVAL;
-        free(pq);
-        return NULL;
-    }
+        if (xlen_product(prod) > pq_getDataSize(pq)) {
+                log_debug("pq_insertNoSig(): product is too big");
+                status = PQ_BIG;
+                goto unwind_lock;
+        }
 
-    if (isProductMappingNecessary(pq)) {
         /*
-         * The entire product-queue can't be memory-mapped in one mmap(2)
-         * call; consequently, each data-product will be individually
-         * memory-mapped.
+         * Compress the data before the control-region is locked.
          */
-        fSet(pq->pflags, PQ_MAPRGNS);
-    }
+        size_t zlen = 0;
+        void  *zbuf = zp_compress(pq, prod->info.feedtype, prod->data,
+                prod->info.sz, &zlen);
 
-#if __hpux
-    if (fIsSet(pq->pflags, PQ_MAPRGNS)) {
         /*
-         * HP-UX requires that memory-mapped segments be aligned on page
-         * boundaries.
+         * Write lock pq->ctl.
          */
-        if (align < pq->pagesz) {
-            /* LOG_NOTICE("forcing alignment %u", pq->pagesz); */
-            pq_setOffsetsAndSizes(pq, pq->pagesz, initialsz, maxProds);
+        // log_debug_1("Getting control header");
+        status = ctl_get(pq, RGN_WRITE);
+        if(status != ENOERR) {
+                log_debug("pq_insertNoSig(): ctl_get() failure");
+                free(zbuf);
+                goto unwind_lock;
         }
-    }
-#endif
 
-    pq->riulp = (riul*)malloc(pq->pagesz);
-    if (pq->riulp == NULL) {
-        free(pq);
-        return NULL;
-    }
-    riul_init(pq->riulp, 0, pq->pagesz);
-
-    {
-        pthread_mutexattr_t attr;
-        int                 status = pthread_mutexattr_init(&attr);
-        if (status) {
-            log_add_errno(status, "Couldn't initialize mutex attributes");
-        }
-        else {
-            (void)pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-            (void)pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
-            status = pthread_mutex_init(&pq->mutex, &attr);
-            if (status)
-                log_add_errno(status, "Couldn't initialize mutex");
-            (void)pthread_mutexattr_destroy(&attr);
-        }
-        if (status) {
-            free(pq->riulp);
-            free(pq);
-            return NULL;
-        }
-    }
+        status = rpq_insert(pq, prod, zbuf, zlen);
 
-    /*
-     * Set the product-queue access-functions.
-     */
-    ctl_setAccessFunctions(pq);
+        // log_debug_1("Releasing control header");
+        (void) ctl_rel(pq, RGN_MODIFIED);
+        free(zbuf);
+        if (status == ENOERR)
+                pq_notify(pq, false);
+        /*FALLTHROUGH*/
 
-    pq->fd = -1;
-    pq->cursor = TS_NONE;
-    pq->cursor_offset = OFF_NONE;
-    pq->pqe_count = 0;
+unwind_lock:
+        // log_debug_1("Unlocking");
+        // log_debug_1("Returning %d", status);
+    pq_unlockIf(pq);
 
-    return pq;
+    return status;
 }
 
+
 /**
- * Frees a product-queue.
+ * Insert at rear of queue and notify readers. Readers are notified via the
+ * insertion-counter of the queue or, in compatibility mode, by sending SIGCONT
+ * to the process group.
  *
- * @param[in,out]  Product queue
+ * @param[in,out]  pq    Product queue
+ * @param[in]      prod  Data product
+ * @retval 0             Success.
+ * @retval EINVAL        Invalid argument.
+ * @retval PQ_DUP        Product already exists in the queue.
+ * @retval PQ_BIG        Product is too large to insert in the queue.
+ * @retval PQ_SYSTEM     System failure. log_add() called.
  */
-static void
-pq_free(pqueue *const pq)
+int
+pq_insert(pqueue *pq, const product *prod)
 {
-        if(pq == NULL)
-                return;
-        (void)pthread_mutex_destroy(&pq->mutex);
-        if(pq->riulp != NULL)
+        int status = pq_insertNoSig(pq, prod);
+        if(status == ENOERR && !notify_isSeq(pq))
         {
-                free(pq->riulp);
-                pq->riulp = NULL;
+                /*
+                 * Inform others in our process group
+                 * that there is new data available.
+                 * (see pq_suspend() below.)
+                 *  SIGCONT is ignored by default...
+                 */
+                (void)kill(0, SIGCONT);
         }
-        free(pq);
+        return status;
 }
 
 
 /**
- * Creates a product-queue. On success, the writer-counter of the created
- * product-queue will be one.
+ * Inserts data-products at the rear of the queue under one lock of the
+ * control-region and notifies readers once. This is cheaper than calling
+ * `pq_insert()` for each data-product when they arrive in bursts.
  *
- * @param[in] path        Pathname of the product-queue.
- * @param[in] mode        File mode. Bitwise OR of
- *                        - S_IRWXU    Read, write, execute/search by owner.
- *                            + S_IRUSR  Read permission, owner.
- *                            + S_IWUSR  Write permission, owner.
- *                        - S_IRWXG    Read, write, execute/search by group.
- *                            + S_IRGRP  Read permission, group.
- *                            + S_IWGRP  Write permission, group.
- *                        - S_IRWXO    Read, write, execute/search by others.
- *                            + S_IROTH  Read permission, others.
- *                            + S_IWOTH  Write permission, others.
- *                        This value is bitwise ANDed with the complement of the
- *                        process' file mode creation mask.
- * @param[in]  pflags     Product-queue flags. Bitwise OR of
- *                          PQ_DEFAULT	  Default attributes (0).
- *                          PQ_MAPRGNS    Map region by region. Default is whole
- *                                        file.
- *                          PQ_NOCLOBBER  Don't replace an existing
- *                                        product-queue.
- *                          PQ_NOLOCK     Disable locking (DANGER!)
- *                          PQ_NOMAP      Use `malloc/read/write/free` instead
- *                                        of `mmap()`
- *                          PQ_PRIVATE    `mmap()` the file `MAP_PRIVATE`.
- *                                        Default is `MAP_SHARED`.
- * @param[in]  align      Alignment parameter for file components or 0.
- * @param[in]  initialsz  Size, in bytes, of the data portion of the product-
- *                        queue.
- * @param[in]  nproducts  Number of product slots to create.
- * @param[out] pqp        Product-queue.
- * @retval     0          Success. `*pqp` is set.
+ * @param[in,out]  pq        Product queue
+ * @param[in]      prods     Data products
+ * @param[in]      nprods    Number of data products
+ * @param[out]     statuses  The status of each insertion -- as returned by
+ *                           `pq_insert()` (e.g., 0, PQ_DUP, or PQ_BIG)
+ * @retval 0                 Success. `statuses` is set.
+ * @retval EACCES            The product-queue is read-only. Nothing was
+ *                           inserted.
+ * @return                   <errno.h> error code. Nothing was inserted.
  */
 int
-pq_create(const char *path, mode_t mode,
-        int pflags,
-        size_t align,
-        off_t initialsz, /* initial allocation available */
-        size_t nproducts, /* initial rl->nalloc, ... */
-        pqueue **pqp)
+pq_insertv(
+        pqueue* const        pq,
+        const product* const prods,
+        const size_t         nprods,
+        int* const           statuses)
 {
-        int oflags = (O_RDWR|O_CREAT|O_TRUNC);
-        int fd;
-        pqueue *pq = NULL;
-        int status = ENOERR;
+    int    status;
+    size_t ninserted = 0;
+    struct {
+        void*  buf;
+        size_t len;
+    }*     zips = NULL;
 
-        /* enforce minimum alignment */
-        align = (align == 0 ? M_RND_UNIT : _RNDUP(align, M_RND_UNIT));
-        /* TODO: check for absurd align values ? */
+    log_assert(pq != NULL);
+    log_assert(nprods == 0 || (prods != NULL && statuses != NULL));
 
-        if(initialsz != 0)
-                initialsz = (off_t) _RNDUP(initialsz, align);
-        else
-                initialsz = (off_t) align;
+    pq_lockIf(pq);
+        if (fIsSet(pq->pflags, PQ_READONLY)) {
+            log_debug("pq_insertv(): queue is read-only");
+            status = EACCES;
+        }
+        else {
+            /*
+             * Compress the data before the control-region is locked. The data
+             * is stored uncompressed if there's no memory for this.
+             */
+            if (fIsSet(pq->pflags, PQ_COMPRESS) && nprods &&
+                    (zips = calloc(nprods, sizeof(*zips))) != NULL) {
+                for (size_t i = 0; i < nprods; i++)
+                    zips[i].buf = zp_compress(pq, prods[i].info.feedtype,
+                            prods[i].data, prods[i].info.sz, &zips[i].len);
+            }
 
-        pq = pq_new(pflags, align, initialsz, nproducts);
-        if(pq == NULL)
-                return errno;
+            if ((status = ctl_get(pq, RGN_WRITE)) != ENOERR) {
+                log_debug("pq_insertv(): ctl_get() failure");
+            }
+            else {
+                for (size_t i = 0; i < nprods; i++) {
+                    statuses[i] = zips
+                            ? rpq_insert(pq, prods + i, zips[i].buf,
+                                    zips[i].len)
+                            : rpq_insert(pq, prods + i, NULL, 0);
+                    if (statuses[i] == ENOERR)
+                        ninserted++;
+                }
+                (void)ctl_rel(pq, RGN_MODIFIED);
+                if (ninserted)
+                    pq_notify(pq, true);
+            }
 
-        if(fIsSet(pflags, PQ_NOCLOBBER))
-                fSet(oflags, O_EXCL);
-        fd = open(path, oflags, mode);
-        if(fd < 0)
-        {
-                status = errno;
-                goto unwind_new;
+            if (zips) {
+                for (size_t i = 0; i < nprods; i++)
+                    free(zips[i].buf);
+                free(zips);
+            }
         }
-        (void)ensure_close_on_exec(fd);
+    pq_unlockIf(pq);
 
-        pq->fd = fd;
+    return status;
+}
+
+
+/*
+ * Returns some useful, "highwater" statistics of a product-queue.  The
+ * statistics are since the queue was created.
+ *
+ * Arguments:
+ *      pq              Pointer to the product-queue.  Shall not be NULL.
+ *      highwaterp      Pointer to the maxium number of bytes used in the
+ *                      data portion of the product-queue.  Shall not be NULL.
+ *                      Set upon successful return.
+ *      maxproductsp    Pointer to the maximum number of data-products that the
+ *                      product-queue has held since it was created.  Shall not
+ *                      be NULL.  Set upon successful return.
+ * Returns:
+ *      0               Success.  "*highwaterp" and "*maxproductsp" are set.
+ *      else            <errno.h> error code.
+ */
+int
+pq_highwater(pqueue *pq, off_t *highwaterp, size_t *maxproductsp)
+{
+    pq_lockIf(pq);
+        /* Read lock pq->xctl. */
+        int status = ctl_get(pq, 0);
+
+        if(status == ENOERR) {
+            if(highwaterp)
+                    *highwaterp = pq->ctlp->highwater;
+            if(maxproductsp)
+                    *maxproductsp = pq->ctlp->maxproducts;
+            (void) ctl_rel(pq, 0);
+        }
+    pq_unlockIf(pq);
+
+    return status;
+}
 
-        status = ctl_init(pq, align);
-        if(status != ENOERR)
-                goto unwind_open;
 
-        (void)strncpy(pq->pathname, path, sizeof(pq->pathname));
-        pq->pathname[sizeof(pq->pathname)-1] = 0;
+/*
+ * Indicates if the product-queue is full (i.e., if a data-product has been
+ * deleted in order to make room for another data-product).
+ *
+ * Arguments:
+ *      pq              Pointer to the product-queue structure.  Shall not be
+ *                      NULL.
+ *      isFull          Pointer to the indicator of whether or not the queue
+ *                      is full.  Shall not be NULL.  Set upon successful
+ *                      return.  "*isfull" will be non-zero if and only if the
+ *                      product-queue is full.
+ * Returns:
+ *      0               Success.  "*isFull" is set.
+ *      else            <errno.h> error code.
+ */
+int pq_isFull(
+    pqueue* const       pq,
+    int* const          isFull)
+{
+    pq_lockIf(pq);
+    int status = ctl_get(pq, 0);
+    if (status == ENOERR) {
+        *isFull = pq->ctlp->isFull;
+        (void)ctl_rel(pq, 0);
+    }                                   /* "pq->ctlp" allocated */
 
-        *pqp = pq;
+    pq_unlockIf(pq);
+    return status;
+}
 
-        (void) ctl_rel(pq, RGN_MODIFIED);
 
-        return ENOERR;
+/*
+ * Returns the time of the most-recent insertion of a data-product.
+ *
+ * Arguments:
+ *      pq              Pointer to the product-queue structure.  Shall not be
+ *                      NULL.
+ *      mostRecent      Pointer to the time of the most-recent insertion of a
+ *                      data-product.  Upon successful return, "*mostRecent"
+ *                      shall be TS_NONE if such a time doesn't exist (because
+ *                      the queue is empty, for example).
+ * Returns:
+ *      0               Success.  "*mostRecent" is set.
+ *      else            <errno.h> error code.
+ */
+int pq_getMostRecent(
+    pqueue* const       pq,
+    timestampt* const   mostRecent)
+{
+    pq_lockIf(pq);
+    int status = ctl_get(pq, 0);
+    if (status == ENOERR) {
+        *mostRecent = pq->ctlp->mostRecent;
+        (void)ctl_rel(pq, 0);
+    }                                   /* "pq->ctlp" allocated */
 
-unwind_open:
-        (void)close(fd);
-        (void)unlink(path);
-        /*FALLTHROUGH*/
-unwind_new:
-        pq_free(pq);
-        return status;
+    pq_unlockIf(pq);
+    return status;
 }
 
 
-/**
- * Opens an existing product-queue.
+/*
+ * Returns metrics associated with the minimum virtual residence time of
+ * data-products in the queue since the queue was created or the metrics reset.
+ * The virtual residence time of a data-product is the time that the product
+ * was removed from the queue minus the time that the product was created.  The
+ * minimum virtual residence time is the minimum of the virtual residence times
+ * over all applicable products.
  *
- * @param[in] path         Pathname of product-queue.
- * @param[in] pflags       File-open flags. Bitwise OR of
- *                           PQ_MAPRGNS    Map region by region, default whole
- *                                         file if possible; otherwise by region
- *                           PQ_NOLOCK     Disable locking (DANGER!)
- *                           PQ_NOMAP      Use `malloc/read/write/free` instead
- *                                         of `mmap()`
- *                           PQ_PRIVATE    `mmap()` the file `MAP_PRIVATE`.
- *                                         Default is `MAP_SHARED`
- *                           PQ_READONLY   Default is read-write.
- * @param[out] pqp         Memory location to receive pointer to product-queue
- *                         structure.
- * @retval     0           Success. *pqp set.
- * @retval     EACCES      Permission denied. pflags doesn't contain PQ_READONLY
- *                         and the product-queue is already open by the maximum
- *                         number of writers.
- * @retval     PQ_CORRUPT  The  product-queue is internally inconsistent.
- * @return                 Other <errno.h> error-code.
+ * Arguments:
+ *      pq              Pointer to the product-queue structure.  Shall not be
+ *                      NULL.
+ *      minVirtResTime  Pointer to the minimum virtual residence time of the
+ *                      queue since the queue was created.  Shall not be NULL.
+ *                      "*minVirtResTime" is set upon successful return.  If
+ *                      such a time doesn't exist (because no products have
+ *                      been deleted from the queue, for example), then
+ *                      "*minVirtResTime" shall be TS_NONE upon successful
+ *                      return.
+ *      size            Pointer to the amount of data used, in bytes, when the
+ *                      minimum virtual residence time was set. Shall not be
+ *                      NULL. Set upon successful return. If this parameter
+ *                      doesn't exist, then "*size" shall be set to -1.
+ *      slots           Pointer to the number of slots used when the minimum
+ *                      virtual residence time was set. Shall not be NULL. Set
+ *                      upon successful return. If this parameter doesn't exist,
+ *                      the "*slots" shall be set to 0.
+ * Returns:
+ *      0               Success.  All the outout metrics are set.
+ *      else            <errno.h> error code.
  */
-int
-pq_open(
-    const char* const path,
-    int               pflags,
-    pqueue** const    pqp)
+int pq_getMinVirtResTimeMetrics(
+    pqueue* const       pq,
+    timestampt* const   minVirtResTime,
+    off_t* const        size,
+    size_t* const       slots)
 {
-    int               status;
-    pqueue*           pq = pq_new(pflags, M_RND_UNIT, 0, 0);
+    pq_lockIf(pq);
 
-    if (NULL == pq) {
-        status = errno;
-    }
-    else {
-        pq->fd = open(path, fIsSet(pflags, PQ_READONLY) ? O_RDONLY : O_RDWR, 0);
+    int status = ctl_get(pq, 0);
+    if (status == ENOERR) {
+        pqctl*   ctlp = pq->ctlp;
 
-        if (0 > pq->fd) {
-            status = errno;
+        if (METRICS_MAGIC == ctlp->metrics_magic) {
+            *minVirtResTime = ctlp->minVirtResTime;
         }
         else {
-            (void)ensure_close_on_exec(pq->fd);
-            status = ctl_gopen(pq, path);
+            *minVirtResTime = TS_NONE;
+        }
 
-            if (!status) {
-                (void)ctl_rel(pq, 0);           /* release control-block */
+        if (METRICS_MAGIC_2 == ctlp->metrics_magic_2) {
+            *size = ctlp->mvrtSize;
+            *slots = ctlp->mvrtSlots;
+        }
+        else {
+            *size = -1;
+            *slots = 0;
+        }
 
-                if (!fIsSet(pflags, PQ_READONLY)) {
-                    status = ctl_get(pq, RGN_WRITE);
+        (void)ctl_rel(pq, 0);
+    }                                   /* "pq->ctlp" allocated */
 
-                    if (!status) {
-                        int      rflags = 0;    /* control-block unmodified */
-                        pqctl*   ctlp = pq->ctlp;
+    pq_unlockIf(pq);
+    return status;
+}
 
-                        if (WRITE_COUNT_MAGIC != ctlp->write_count_magic) {
-                            /*
-                             * This process is the first one of this version of
-                             * the LDM to open the product-queue for writing.
-                             * Initialize the "write count" mechanism.
-                             */
-                            ctlp->write_count_magic = WRITE_COUNT_MAGIC;
-                            ctlp->write_count = 0;
-                            rflags = RGN_MODIFIED;
-                        }
+/*
+ * Clears the metrics associated with the minimum virtual residence time of
+ * data-products in the queue.  After this function, the minimum virtual
+ * residence time metrics will be recomputed as products are deleted from the
+ * queue.
+ *
+ * Arguments:
+ *      pq              Pointer to the product-queue structure.  Shall not be
+ *                      NULL.  Must be open for writing.
+ * Returns:
+ *      0               Success.  The minimum virtual residence time metrics are
+ *                      cleared.
+ *      else            <errno.h> error code.
+ */
+int pq_clearMinVirtResTimeMetrics(
+    pqueue* const       pq)
+{
+    pq_lockIf(pq);
 
-                        if (MAX_WRITE_COUNT > ctlp->write_count) {
-                            ctlp->write_count++;
-                            rflags = RGN_MODIFIED;
-                        }
-                        else {
-                            log_error_q("Too many writers (%u) to product-queue "
-                                "(%s)", ctlp->write_count, path);
+    int status = ctl_get(pq, RGN_WRITE);
+    if (status == ENOERR) {
+        pq->ctlp->minVirtResTime = TS_NONE;
+        pq->ctlp->mvrtSize = -1;
+        pq->ctlp->mvrtSlots = 0;
 
-                            status = EACCES;    /* too many writers */
-                        }
+        (void)ctl_rel(pq, RGN_MODIFIED);
+    }                                   /* "pq->ctlp" allocated */
 
-                        if (!status) {
-                            if (METRICS_MAGIC != ctlp->metrics_magic) {
-                                /*
-                                 * This process is the first one of this
-                                 * version of the LDM to open the product-queue
-                                 * for writing.  Initialize the additional
-                                 * metrics.
-                                 */
-                                ctlp->metrics_magic = METRICS_MAGIC;
-                                ctlp->mostRecent = TS_NONE;
-                                ctlp->minVirtResTime = TS_NONE;
-                                ctlp->isFull = 0;
-                                rflags = RGN_MODIFIED;
-                            }
-                            if (METRICS_MAGIC_2 != ctlp->metrics_magic_2) {
-                                /*
-                                 * This process is the first one of this
-                                 * version of the LDM to open the product-queue
-                                 * for writing.  Initialize the additional
-                                 * metrics.
-                                 */
-                                ctlp->metrics_magic_2 = METRICS_MAGIC_2;
-                                ctlp->mvrtSize = -1;
-                                ctlp->mvrtSlots = 0;
-                                rflags = RGN_MODIFIED;
-                            }
+    pq_unlockIf(pq);
+    return status;
+}
 
-                            (void)strncpy(pq->pathname, path,
-                                    sizeof(pq->pathname));
-                            pq->pathname[sizeof(pq->pathname)-1] = 0;
-                        }
 
-                        (void)ctl_rel(pq, rflags);
-                    }                           /* ctl_get() success */
-                }                               /* open for writing */
-            }                                   /* ctl_gopen() success */
+/**
+ * Get some detailed product queue statistics.  These may be useful for
+ * monitoring the internal state of the product queue:
+ *
+ * @param[out] nprodsp      The current number of products in the queue.  May be
+ *                          NULL.
+ * @param[out] nfreep       The current number of free regions.  This should be
+ *                          small and it's OK if it's zero, since new free
+ *                          regions are created as needed by deleting oldest
+ *                          products.  If this gets large, insertion and
+ *                          deletion take longer.  May be NULL.
+ * @param[out] nemptyp      The number of product slots left.  This may
+ *                          decrease, but should eventually stay above some
+ *                          positive value unless too few product slots were
+ *                          allocated when the queue was created.  New product
+ *                          slots get created when adjacent free regions are
+ *                          consolidated, and product slots get consumed when
+ *                          larger free regions are split into smaller free
+ *                          regions.  May be NULL.
+ * @param[out] nbytesp      The current number of bytes in the queue used for
+ *                          data products.  May be NULL.
+ * @param[out] maxprodsp    The maximum number of products in the queue, so far.
+ *                          May be NULL.
+ * @param[out] maxfreep     The maximum number of free regions, so far.  May be
+ *                          NULL.
+ * @param[out] minemptyp    The minimum number of empty product slots, so far.
+ *                          May be NULL.
+ * @param[out] maxbytesp    The maximum number of bytes used for data, so far.
+ *                          May be NULL.
+ * @param[out] age_oldestp  The age in seconds of the oldest product in the
+ *                          queue.  May be NULL.
+ * @param[out] maxextentp   Extent of largest free region  May be NULL.
+ * @retval 0          Success.
+ * @retval EACCESS or EAGAIN
+ *                    The region is already locked by another process.
+ * @retval EINVAL     The product-queue file doesn't support locking.
+ * @retval ENOLCK     The number of locked regions would exceed a system-imposed
+ *                    limit.
+ * @retval EDEADLK    A deadlock in region locking has been detected.
+ * @retval EBADF      The file descriptor of the product-queue is invalid.
+ * @retval EIO        An I/O error occurred while reading from the file system.
+ * @retval EOVERFLOW  The file size in bytes or the number of blocks allocated
+ *                    to the file or the file serial number cannot be
+ *                    represented correctly.
+ * @retval EINTR      A signal was caught during execution.
+ * @retval EFBIG or EINVAL
+ *                    The size of the product-queue is greater than the maximum
+ *                    file size.
+ * @retval EROFS      The named file resides on a read-only file system.
+ * @retval EAGAIN     The mapping could not be locked in memory, if required by
+ *                    mlockall(), due to a lack of resources.
+ * @retval EINVAL     The product-queue object wants to map the product-queue to
+ *                    a fixed memory location that is not a multiple of the page
+ *                    size as returned by sysconf(), or is considered invalid
+ *                    by the O/S.
+ * @retval EMFILE     The number of mapped regions would exceed an O/S-dependent
+ *                    limit (per process or per system).
+ * @retval ENODEV     The file descriptor of the product-queue object refers to
+ *                    a file whose type is not supported by mmap().
+ * @retval ENOMEM     The size of the product-queue exceeds that allowed for the
+ *                    address space of a process.
+ * @retval ENOMEM     The mapping could not be locked in memory, if required by
+ *                    mlockall(), because it would require more space than the
+ *                    system is able to supply.
+ * @retval ENOTSUP    The O/S does not support the combination of accesses
+ *                    requested.
+ * @retval ENXIO      The size of the product-queue is invalid for the object
+ *                    specified by its file descriptor.
+ *
+ * Note: the fixed number of slots allocated for products when the
+ * queue was created is nalloc = (nprods + nfree + nempty).
+ */
+int
+pq_stats(pqueue *pq,
+     size_t* const      nprodsp,
+     size_t* const      nfreep,
+     size_t* const      nemptyp,
+     size_t* const      nbytesp,
+     size_t* const      maxprodsp,
+     size_t* const      maxfreep,
+     size_t* const      minemptyp,
+     size_t* const      maxbytesp,
+     double* const      age_oldestp,
+     size_t* const      maxextentp)
+{
+    pq_lockIf(pq);
+        /* Read lock pq->ctl. */
+        int status = ctl_get(pq, 0);
+
+        if(status == ENOERR) {
+            if(nprodsp)
+                *nprodsp = pq->rlp->nelems;
+            if(nfreep)
+                *nfreep = pq->rlp->nfree;
+            if(maxextentp)
+                *maxextentp = pq->rlp->maxfextent;
+            if(nemptyp)
+                *nemptyp = pq->rlp->nempty;
+            if(nbytesp)
+                *nbytesp = pq->rlp->nbytes;
+            if(maxprodsp)
+                *maxprodsp = pq->rlp->maxelems;
+            if(maxfreep)
+                *maxfreep = pq->rlp->maxfree;
+            if(minemptyp)
+                *minemptyp = pq->rlp->minempty;
+            if(maxbytesp)
+                *maxbytesp = pq->rlp->maxbytes;
+            if(age_oldestp) {
+                timestampt ts0;
+                tqelem *tqep;
 
-            if (status) {
-                (void)close(pq->fd);
-                pq->fd = -1;
+                tqep = tqe_first(pq->tqp); /* get oldest */
+                if(tqep != NULL) {
+                  set_timestamp(&ts0);
+                  *age_oldestp = d_diff_timestamp(&ts0, &tqep->tv);
+                } else {
+                  *age_oldestp = 0;
+                }
             }
-        }                                       /* pq->fd >= 0 */
 
-        if (status) {
-            pq_free(pq);
-        }
-        else {
-            *pqp = pq;
+            (void) ctl_rel(pq, 0);
         }
-    }                                           /* pq != NULL */
+    pq_unlockIf(pq);
 
     return status;
 }
 
+/*
+ * Smallest extent, in bytes, of the second bin of the histogram of free extents
+ * returned by pq_fragStats(). Each subsequent bin is twice as wide.
+ */
+#define FRAG_BIN_MIN    1024
 
-/**
- * Returns the flags used to open or create a product-queue.
- *
- * @param[in] pq  The product-queue.
- * @return        The flags: a bitwise OR of
- *                    PQ_MAPRGNS     Map region by region, default whole file.
- *                    PQ_NOCLOBBER   Don't replace an existing product-queue.
- *                    PQ_NOLOCK      Disable locking.
- *                    PQ_NOMAP       Use `malloc/read/write/free` instead of
- *                                   `mmap()`
- *                    PQ_PRIVATE     `mmap()` the file `MAP_PRIVATE`. Default is
- *                                   `MAP_SHARED`
- *                    PQ_READONLY    Default is read/write.
- *                    PQ_THREADSAFE  Product-queue access is thread-safe
+/*
+ * Returns the bin of the histogram of free extents for a free region.
  */
-int
-pq_getFlags(
-        pqueue* const pq)
+static size_t
+frag_bin(const size_t extent)
 {
-    pq_lockIf(pq);
-        int pflags = pq->pflags;
-    pq_unlockIf(pq);
+    size_t bin = 0;
 
-    return pflags;
+    for (size_t min = FRAG_BIN_MIN; bin < PQ_FRAG_BINS-1 && extent >= min;
+            min *= 2)
+        bin++;
+    return bin;
 }
 
-/*
- * On success, if the product-queue was open for writing, then its
- * writer-counter will be decremented.
+/**
+ * Returns metrics on the fragmentation of the data section of a product-queue.
+ * Bin 0 of the histogram counts the free regions whose extent is less than 1
+ * KiB; bin `i` (0 < i < PQ_FRAG_BINS-1), those whose extent is at least 2^(i-1)
+ * KiB but less than 2^i KiB; and the last bin, those whose extent is at least
+ * 2^(PQ_FRAG_BINS-2) KiB. The ratio of evictions to insertions is the average
+ * number of data-products that an insertion deleted to make room for itself;
+ * data-products deleted by pq_evict() aren't counted.
  *
- * Returns:
- *      0               Success.
- *      EOVERFLOW       Write-count of product queue was prematurely zero.
- *      !0              Other <errno.h> code.
+ * @param[in]  pq          The product-queue.
+ * @param[out] classes     Whether the product-queue allocates small
+ *                         data-products by size-class (PQ_RLCLASS) or NULL.
+ * @param[out] classbytes  Number of bytes in the free lists and slabs of the
+ *                         size-classes or NULL.
+ * @param[out] maxextent   Extent of the largest free region in bytes or NULL.
+ *                         Excludes the regions of the size-classes.
+ * @param[out] hist        Histogram of the extents of the free regions,
+ *                         including those of the size-classes, or NULL. Must
+ *                         have PQ_FRAG_BINS elements.
+ * @param[out] ninserts    Number of data-products inserted into the
+ *                         product-queue by this version of the LDM or NULL.
+ * @param[out] nevictions  Number of data-products deleted by those insertions
+ *                         or NULL.
+ * @retval     0           Success.
+ * @return                 `<errno.h>` error code.
  */
 int
-pq_close(pqueue *pq)
+pq_fragStats(
+        pqueue* const restrict             pq,
+        bool* const restrict               classes,
+        size_t* const restrict             classbytes,
+        size_t* const restrict             maxextent,
+        size_t* const restrict             hist,
+        unsigned long long* const restrict ninserts,
+        unsigned long long* const restrict nevictions)
 {
-    int status = ENOERR;                    /* success */
-    int fd = -1;
-
-    if (pq == NULL)
-            return 0;
-
     pq_lockIf(pq);
-        fd = pq->fd;
-
-        if(pq->riulp != NULL)
-        {
-                while(pq->riulp->nelems > 2)
-                {
-                        off_t offset =
-                                pq->riulp->rp[pq->riulp->nelems -1].offset;
-                        if(offset == pq->ixo || offset == 0)
-                                continue;
-                        (void) (pq->mtof)(pq, offset, 0);
-                }
-        }
-
-        if(pq->rlp != NULL)
-        {
-                (void)(pq->mtof)(pq, pq->ixo, RGN_NOLOCK);
-                pq->rlp = NULL;
-        }
-
-        if (fIsSet(pq->pflags, PQ_READONLY)) {
-            if (NULL != pq->ctlp)
-                (void)ctl_rel(pq, 0);
-        }
-        else {
-            status = ctl_get(pq, RGN_WRITE);
-
-            if (!status) {
-                int rflags;
-
-                if (0 < pq->ctlp->write_count) {
-                    pq->ctlp->write_count--;
-                    rflags = RGN_MODIFIED;
-                }
-                else {
-                    log_error_q("Write-count of product-queue prematurely 0");
+        /* Read lock pq->ctl. */
+        int status = ctl_get(pq, 0);
 
-                    rflags = 0;                 /* unmodified */
-                    status = EOVERFLOW;
+        if (status == ENOERR) {
+            const regionl* const rl = pq->rlp;
+            const pqctl* const   ctlp = pq->ctlp;
+            const bool           valid = ctlp->alloc_magic == ALLOC_MAGIC;
+
+            const cl* const      clp = pq->clp;
+
+            if (classes)
+                *classes = clp != NULL;
+            if (classbytes)
+                *classbytes = clp ? clp->nbytes : 0;
+            if (maxextent)
+                *maxextent = rl->maxfextent;
+            if (ninserts)
+                *ninserts = valid ? ctlp->alloc_inserts : 0;
+            if (nevictions)
+                *nevictions = valid ? ctlp->alloc_evictions : 0;
+            if (hist) {
+                const region* const rlrp = rl->rp;
+                const fb* const     fbp = pq->fbp;
+
+                (void)memset(hist, 0, PQ_FRAG_BINS*sizeof(*hist));
+                for (size_t rlix = fbp->fblks[rlrp[rl->fext].prev];
+                        rlix != RL_FEXT_TL;
+                        rlix = fbp->fblks[rlrp[rlix].prev])
+                    hist[frag_bin(rlrp[rlix].extent)]++;
+                for (size_t c = 0; clp && c < CL_NCLASSES; c++) {
+                    for (size_t rlix = clp->heads[c]; rlix != RL_NONE;
+                            rlix = rlrp[rlix].next)
+                        hist[frag_bin(rlrp[rlix].extent)]++;
+                    if (clp->slabs[c] != RL_NONE)
+                        hist[frag_bin(rlrp[clp->slabs[c]].extent)]++;
                 }
-
-                (void)ctl_rel(pq, rflags);
             }
-        }                                       /* was opened for writing */
 
-#ifdef HAVE_MMAP
-        if(pq->base != NULL && pq->ftom == mm0_ftom)
-        {
-                /* special case, time to unmap the whole thing */
-                int mflags = 0; /* TODO: translate rflags to mflags */
-                (void) unmapwrap(pq->base, 0, TOTAL_SIZE(pq), mflags);
-                pq->base = NULL;
+            (void) ctl_rel(pq, 0);
         }
-#endif
-
     pq_unlockIf(pq);
-    pq_free(pq);
-
-    if(fd > -1 && close(fd) < 0 && !status)
-            status = errno;
 
     return status;
 }
 
-
-/**
- * Returns the pathname of a product-queue as given to `pq_create()` or
- * `pq_open()`.
+/*
+ * Returns the number of slots in a product-queue.
  *
- * @param[in] pq  The product-queue.
- * @return        The pathname of the product-queue as given to `pq_create()` or
- *                `pq_open()`.
+ * Arguments:
+ *      pq              Pointer to the product-queue object.
+ * Returns:
+ *      The number of slots in the product-queue.
  */
-const char* pq_getPathname(
-        pqueue* pq)
+size_t
+pq_getSlotCount(
+    pqueue* const       pq)
 {
     pq_lockIf(pq);
-        const char* pathname = pq->pathname;
+    size_t nalloc = pq->nalloc;
     pq_unlockIf(pq);
-
-    return pathname;
+    return nalloc;
 }
 
 
 /*
- * Let the user find out the pagesize.
+ * Returns the insertion-timestamp of the oldest data-product in the
+ * product-queue.
+ *
+ * Arguments:
+ *      oldestCursor    Pointer to structure to received the insertion-time
+ *                      of the oldest data-product.
+ * Returns:
+ *      ENOERR          Success.
+ *      else            Failure.
  */
 int
-pq_pagesize(pqueue *pq)
+pq_getOldestCursor(
+    pqueue*             pq,
+    timestampt* const   oldestCursor)
 {
-    /*
-     * Allow the caller to figure out what the default would be prior to
-     * calling `pq_create()`.
-     */
-    if(pq == NULL)
-        return (int)pagesize();
-
-    // Else, tell the caller what it is
     pq_lockIf(pq);
-        int pagesz = (int) pq->pagesz;
-    pq_unlockIf(pq);
 
-    return pagesz;
+    int status = ctl_get(pq, 0);
+    if (status == ENOERR) {
+        tqelem*         tqep = tqe_first(pq->tqp);
+
+        if (tqep == NULL) {
+            *oldestCursor = TS_NONE;
+        }
+        else {
+            *oldestCursor = tqep->tv;
+        }
+
+        (void)ctl_rel(pq, 0);
+    }                                   /* control region locked */
+
+    pq_unlockIf(pq);
+    return status;
 }
 
 
-/**
- * Returns the size of the data portion of a product-queue.
+/*
+ * Returns the number of pq_open()s for writing outstanding on an existing
+ * product queue.  If a writing process terminates without calling pq_close(),
+ * then the actual number will be less than this number.  This function opens
+ * the product-queue read-only, so if there are no outstanding product-queue
+ * writers, then the returned count will be zero.
  *
- * @param[in] pq  Pointer to the product-queue object.
- * @return        The size, in bytes, of the data portion of the product-queue.
+ * Arguments:
+ *      path    The pathname of the product-queue.
+ *      count   The memory to receive the number of writers.
+ * Returns:
+ *      0           Success.  *count will be the number of writers.
+ *      EINVAL      path is NULL or count is NULL.  *count untouched.
+ *      ENOSYS      Function not supported because product-queue doesn't support
+ *                  writer-counting.
+ *      PQ_CORRUPT  The  product-queue is internally inconsistent.
+ *      else        <errno.h> error-code.  *count untouched.
  */
-size_t
-pq_getDataSize(
-    pqueue* const       pq)
+int
+pq_get_write_count(
+    const char* const   path,
+    unsigned* const     count)
 {
-    pq_lockIf(pq);
-        size_t size = pq->ixo - pq->datao;
-    pq_unlockIf(pq);
+    int status;
 
-    return size;
-}
+    if (NULL == path || NULL == count) {
+        status = EINVAL;
+    }
+    else {
+        pqueue* pq;
 
+        status = pq_open(path, PQ_READONLY, &pq);
 
-typedef struct {
-    time_t      start;
-    /*
-     * Hostnames are limited to 255 bytes.  See
-     * <http://www.opengroup.org/onlinepubs/007908799/xns/gethostname.html>.
-     */
-    char        hostname[256];
-} FutureEntry;
+        if (!status) {
+            /*
+             * Get the control-block.
+             */
+            status = ctl_get(pq, 0);            /* readonly */
 
+            if (!status) {
+                pqctl*  ctlp = pq->ctlp;
 
-static inline int
-compareFutureEntries(
-    const void* const   entry1,
-    const void* const   entry2)
-{
-    const char* name1 = ((FutureEntry*)entry1)->hostname;
-    const char* name2 = ((FutureEntry*)entry2)->hostname;
+                if (WRITE_COUNT_MAGIC != ctlp->write_count_magic) {
+                    status = ENOSYS;
+                }
+                else {
+                    *count = pq->ctlp->write_count;
+                }
+                
+                (void)ctl_rel(pq, 0);
+            }
 
-    return strcmp(name1, name2);
+            (void)pq_close(pq);
+        }
+    }
+
+    return status;
 }
 
 
-static void
-vetCreationTime(
-    const prod_info* const      info)
+/*
+ * Sets to zero the number of pq_open()s for writing outstanding on the
+ * product-queue.  This is a dangerous function and should only be used when
+ * it is known that there are no outstanding pq_open()s for writing on the
+ * product-queue.
+ *
+ * Arguments:
+ *      path    The pathname of the product-queue.
+ * Returns:
+ *      0           Success.
+ *      EINVAL      path is NULL.
+ *      PQ_CORRUPT  The  product-queue is internally inconsistent.
+ *      else        <errno.h> error-code.
+ */
+int
+pq_clear_write_count(const char* const path)
 {
-    /*
-     * Vet the creation-time of a data-product.
-     */
-    timestampt  initialSearchTime = info->arrival;
-    timestampt  now;
-
-    /*
-     * Keep the following consonant with the temporal backoff in
-     * pq_setCursorFromSignature().
-     */
-    initialSearchTime.tv_sec -= SEARCH_BACKOFF;
-
-    (void)set_timestamp(&now);
-
-    if (tvCmp(initialSearchTime, now, >)) {
-        const char* const       origin = info->origin;
-        char*                   cp = strstr(origin, "_v_");
-        size_t                  len =
-            cp == NULL ?  strlen(origin) : (size_t)(cp - origin);
-
-        if (log_is_enabled_info) {
-            log_add("Future product from \"%*s\". "
-                    "Fix local or ingest clock. %s",
-                    (int)len, origin, s_prod_info(NULL, 0, info, 0));
-            log_flush_warning();
-        }
-        else {
-            FutureEntry         targetEntry;
-            FutureEntry* const* treeEntry;
-            static void*        root = NULL;
-#           define              FUTURE_INTERVAL (60*60) /* 1 h */
+    int status;
 
-            if (len > (sizeof(targetEntry.hostname)-1))
-                len = sizeof(targetEntry.hostname) - 1;
-            (void)memcpy(targetEntry.hostname, origin, len);
-            targetEntry.hostname[len] = 0;
+    if (NULL == path) {
+        status = EINVAL;
+    }
+    else {
+        pqueue* pq;
 
-            treeEntry = tfind(&targetEntry, &root, compareFutureEntries);
+        status = pq_open(path, 0, &pq);         /* open for writing */
 
-            if (treeEntry != NULL) {
-                FutureEntry*    entry = *treeEntry;
-                time_t          now = time(NULL);
+        if (!status) {
+            status = ctl_get(pq, RGN_WRITE);
 
-                if (entry->start <= now) {
-                    log_warning_q("Future product from \"%s\". "
-                            "Fix local or ingest clock. %s", entry->hostname,
-                            s_prod_info(NULL, 0, info, 0));
+            if (!status) {
+                int    rflags = 0;              /* control-block unmodified */
+                pqctl* ctlp = pq->ctlp;
 
-                    entry->start = now + FUTURE_INTERVAL;
+                if (ctlp->write_count != 1) {
+                    ctlp->write_count = 1;      /* pq_close() will decrement */
+                    rflags = RGN_MODIFIED;      /* control-block modified */
                 }
-            }
-            else {
-                FutureEntry*    newEntry = malloc(sizeof(FutureEntry));
 
-                log_warning_q("Future product from \"%s\". "
-                        "Fix local or ingest clock. %s", targetEntry.hostname,
-                    s_prod_info(NULL, 0, info, 0));
+                ctl_rel(pq, rflags);
+            }
 
-                if (newEntry != NULL) {
-                    newEntry->start = time(NULL) + FUTURE_INTERVAL;
-                    (void)strcpy(newEntry->hostname, targetEntry.hostname);
+            (void)pq_close(pq);
+        }
+    }
 
-                    (void)tsearch(newEntry, &root, compareFutureEntries);
-                }                       /* "newEntry" allocated */
-            }                           /* host not in database */
-        }                               /* non-verbose logging */
-    }                                   /* product created in future */
+    return status;
 }
 
 
 /**
- * Inserts a data-product at the tail-end of the product-queue without signaling
- * the process group.
+ * Checks the time-index of a product-queue: its structure, whether skip list
+ * or ring, and that every element refers to an allocated region. The
+ * product-queue is opened read-only.
  *
- * @param[in] pq           The product-queue.
- * @param[in] prod         The data-product.
- * @retval ENOERR          Success.
- * @retval EINVAL          Invalid argument.
- * @retval PQ_DUP          Product already exists in the queue.
- * @retval PQ_BIG          Product is too large to insert in the queue.
+ * @param[in] path        Pathname of the product-queue.
+ * @retval    0           The time-index is consistent.
+ * @retval    EINVAL      `path` is NULL.
+ * @retval    PQ_CORRUPT  The time-index is inconsistent. `log_add()` called.
+ * @return                Other <errno.h> error-code.
  */
 int
-pq_insertNoSig(pqueue *pq, const product *prod)
+pq_check_time_index(const char* const path)
 {
-    int status = ENOERR;
+    int status;
 
-    pq_lockIf(pq);
-        size_t extent;
-        void *vp = NULL;
-        sxelem *sxep;
-        
-        log_assert(pq != NULL);
-        log_assert(prod != NULL);
+    if (NULL == path) {
+        status = EINVAL;
+    }
+    else {
+        pqueue* pq;
 
-        if(fIsSet(pq->pflags, PQ_READONLY)) {
-                log_debug("pq_insertNoSig(): queue is read-only");
-                status = EACCES;
-                goto unwind_lock;
-        }
+        status = pq_open(path, PQ_READONLY, &pq);
 
-        // log_debug_1("Getting product size");
-        extent = xlen_product(prod);
-        if (extent > pq_getDataSize(pq)) {
-                log_debug("pq_insertNoSig(): product is too big");
-                status = PQ_BIG;
-                goto unwind_lock;
-        }
+        if (!status) {
+            status = ctl_get(pq, 0);            /* readonly */
 
-        /*
-         * Write lock pq->ctl.
-         */
-        // log_debug_1("Getting control header");
-        status = ctl_get(pq, RGN_WRITE);
-        if(status != ENOERR) {
-                log_debug("pq_insertNoSig(): ctl_get() failure");
-                goto unwind_lock;
+            if (!status) {
+                status = tq_check(pq->tqp);
+
+                for (const tqelem* tqep = status ? NULL : tqe_first(pq->tqp);
+                        tqep != NULL && tqep->offset != OFF_NONE;
+                        tqep = tq_next(pq->tqp, tqep)) {
+                    if (rl_find(pq->rlp, tqep->offset) == RL_NONE) {
+                        log_add("Time-index element refers to offset %ld, "
+                                "which isn't an allocated region",
+                                (long)tqep->offset);
+                        status = PQ_CORRUPT;
+                        break;
+                    }
+                }
+
+                (void)ctl_rel(pq, 0);
+            }
+
+            (void)pq_close(pq);
         }
+    }
+
+    return status;
+}
+
+
+/* Begin rc */
+
+/*
+ * Recovery of the indexes of a product-queue from its data-products (see
+ * `pq_recover()`). The candidates are the in-use regions of the table of
+ * regions -- the array, not the hash chains or free lists that index it. Each
+ * candidate is read from the file and decoded by one of several threads. The
+ * indexes are then checked against the data-products that were found, and
+ * only those that are inconsistent are rebuilt: the region-list together with
+ * a skip-list time-index because they share the fblks, and the
+ * signature-index and the index of evicted signatures by themselves.
+ */
 
-        // log_debug_1("Getting space for product");
-        status = rpqe_new(pq, extent, prod->info.signature, &vp, &sxep);
-        if(status != ENOERR) {
-                log_debug("pq_insertNoSig(): rpqe_new() failure");
-                goto unwind_ctl;
-        }
+/* Kinds of candidate regions */
+#define RC_BAD          0       /* not a data-product */
+#define RC_PRODUCT      1       /* a data-product */
+#define RC_MAP          2       /* the chunk map of a chunked data-product */
+#define RC_CHUNK        3       /* a chunk of a chunked data-product */
+/* Maximum length of the header and XDR-encoded metadata of a data-product */
+#define RC_HDRLEN       (ZP_HDRLEN + 8 + sizeof(signaturet) + \
+                         4 + _RNDUP(HOSTNAMESIZE, 4) + 4 + 4 + \
+                         4 + _RNDUP(KEYSIZE, 4) + 4)
+/* Minimum number of candidates per decoding thread */
+#define RC_MIN_PER_THREAD 1024
+/* Maximum number of decoding threads */
+#define RC_MAX_THREADS  32
 
-        // log_debug_1("XDR-ing product");
-                                                /* cast away const'ness */
-        if(xproduct(vp, extent, XDR_ENCODE, (product *)prod) == 0)
-        {
-                log_debug("pq_insertNoSig(): xproduct() failure");
-                status = EIO;
-                goto unwind_rgn;
-        }
+typedef struct {
+        off_t      offset;      /* offset of the region */
+        size_t     extent;      /* extent of the region */
+        timestampt tv;          /* insertion-time from the time-index */
+        timestampt arrival;     /* arrival-time of the data-product */
+        signaturet sig;         /* signature of the data-product */
+        feedtypet  feedtype;    /* feedtype of the data-product */
+        int        kind;        /* RC_* */
+        bool       intq;        /* referenced by the time-index? */
+        bool       keep;        /* retained by the recovered indexes? */
+        bool       chunked;     /* flagged as holding a chunk map? */
+        bool       zipped;      /* flagged as compressed? */
+        size_t     owner;       /* index of the chunk map of an RC_CHUNK */
+        void*      map;         /* copy of the chunk map of an RC_MAP */
+} rcelem;
 
-        log_assert(pq->tqp != NULL && tq_HasSpace(pq->tqp));
-        status = tq_add(pq->tqp, sxep->offset);
-        if(status != ENOERR) {
-                log_debug("pq_insertNoSig(): tq_add() failure");
-                goto unwind_rgn;
-        }
+typedef struct {
+        const pqueue* pq;
+        rcelem*       elems;
+        size_t        nelems;
+} rcscan;
 
-        // log_debug_1("Setting timestamp");
-        set_timestamp(&pq->ctlp->mostRecent);
-        // log_debug_1("Vetting creation time");
-        vetCreationTime(&prod->info);
-        /*FALLTHROUGH*/
+static int
+rc_cmpOffset(const void *const a, const void *const b)
+{
+        const off_t x = ((const rcelem *)a)->offset;
+        const off_t y = ((const rcelem *)b)->offset;
 
-unwind_rgn:
-        // log_debug_1("Releasing region");
-        (void) rgn_rel(pq, sxep->offset, status == ENOERR ? RGN_MODIFIED : 0);
-        /*FALLTHROUGH*/
+        return x < y ? -1 : x > y;
+}
 
-unwind_ctl:
-        // log_debug_1("Releasing control header");
-        (void) ctl_rel(pq, RGN_MODIFIED);
-        /*FALLTHROUGH*/
+static int
+rc_cmpSig(const void *const a, const void *const b)
+{
+        const rcelem *const x = *(const rcelem *const *)a;
+        const rcelem *const y = *(const rcelem *const *)b;
+        const int           cmp = memcmp(x->sig, y->sig, sizeof(signaturet));
 
-unwind_lock:
-        // log_debug_1("Unlocking");
-        // log_debug_1("Returning %d", status);
-    pq_unlockIf(pq);
+        return cmp ? cmp : rc_cmpOffset(x, y);
+}
 
-    return status;
+static int
+rc_cmpTime(const void *const a, const void *const b)
+{
+        const rcelem *const x = *(const rcelem *const *)a;
+        const rcelem *const y = *(const rcelem *const *)b;
+
+        return TV_CMP_LT(x->tv, y->tv) ? -1 :
+                TV_CMP_LT(y->tv, x->tv) ? 1 : rc_cmpOffset(x, y);
 }
 
+/*
+ * Returns the candidate whose region has the given offset or NULL.
+ */
+static rcelem *
+rc_find(rcelem *const elems, const size_t nelems, const off_t offset)
+{
+        rcelem key;
 
-/**
- * Insert at rear of queue, send SIGCONT to process group
- *
- * @param[in,out]  pq    Product queue
- * @param[in]      prod  Data product
- * @retval 0             Success.
- * @retval EINVAL        Invalid argument.
- * @retval PQ_DUP        Product already exists in the queue.
- * @retval PQ_BIG        Product is too large to insert in the queue.
- * @retval PQ_SYSTEM     System failure. log_add() called.
+        key.offset = offset;
+        return bsearch(&key, elems, nelems, sizeof(rcelem), rc_cmpOffset);
+}
+
+/*
+ * Returns the in-use regions of the region table as candidates that are
+ * sorted by offset. A region that's outside the data section or that overlaps
+ * another isn't a candidate and clears '*consistent'. Returns NULL if there
+ * are no candidates or if out of memory, in which case '*nelemsp' isn't zero.
  */
-int
-pq_insert(pqueue *pq, const product *prod)
+static rcelem *
+rc_candidates(const pqueue *const pq, size_t *const nelemsp,
+        bool *const consistent)
 {
-        int status = pq_insertNoSig(pq, prod);
-        if(status == ENOERR)
-        {
-                /*
-                 * Inform others in our process group
-                 * that there is new data available.
-                 * (see pq_suspend() below.)
-                 *  SIGCONT is ignored by default...
-                 */
-                (void)kill(0, SIGCONT);
+        const regionl *const rl = pq->rlp;
+        const size_t         nslots = rl->nalloc + RL_FREE_OVERHEAD;
+        rcelem              *elems;
+        size_t               n = 0;
+        size_t               i;
+
+        for(i = RL_FREE_OVERHEAD; i < nslots; i++)
+                if(IsAlloc(rl->rp + i))
+                        n++;
+        *nelemsp = n;
+        if(n == 0)
+                return NULL;
+        elems = malloc(n * sizeof(rcelem));
+        if(elems == NULL) {
+                log_add_syserr("Couldn't allocate %lu candidate regions",
+                        (unsigned long)n);
+                return NULL;
         }
-        return status;
+
+        n = 0;
+        for(i = RL_FREE_OVERHEAD; i < nslots; i++) {
+                const region *const rep = rl->rp + i;
+
+                if(!IsAlloc(rep))
+                        continue;
+                if(rep->offset < pq->datao || Extent(rep) == 0 ||
+                                Extent(rep) > (size_t)(pq->ixo - rep->offset)) {
+                        log_add("Region %lu (offset %ld, extent %lu) is "
+                                "outside the data section", (unsigned long)i,
+                                (long)rep->offset,
+                                (unsigned long)Extent(rep));
+                        *consistent = false;
+                        continue;
+                }
+                (void)memset(elems + n, 0, sizeof(rcelem));
+                elems[n].offset = rep->offset;
+                elems[n].extent = Extent(rep);
+                elems[n].tv = TS_NONE;
+                elems[n].kind = RC_BAD;
+                elems[n].chunked = IsChunked(rep);
+                elems[n].zipped = IsZipped(rep);
+                n++;
+        }
+        qsort(elems, n, sizeof(rcelem), rc_cmpOffset);
+
+        *nelemsp = 0;
+        for(i = 0; i < n; i++) {
+                const size_t j = *nelemsp;
+
+                if(j > 0 && elems[i].offset < elems[j-1].offset +
+                                (off_t)elems[j-1].extent) {
+                        log_add("Region at offset %ld overlaps the one at %ld",
+                                (long)elems[i].offset, (long)elems[j-1].offset);
+                        *consistent = false;
+                        continue;
+                }
+                elems[(*nelemsp)++] = elems[i];
+        }
+        return elems;
 }
 
+/*
+ * Decodes the start of a data-product: its arrival-time, signature, and
+ * feedtype. 'buf' holds the first 'len' bytes of the data-product, which
+ * mustn't extend past 'extent' bytes and which start with the header of a
+ * compressed data-product if the region is flagged as compressed. Returns true
+ * if the data-product is valid.
+ */
+static bool
+rc_parse(const char *const buf, const size_t len, const size_t extent,
+        rcelem *const rcp)
+{
+        const char *info = buf;
+        size_t      hdrlen = 0;
+        size_t      infolen;
+        size_t      datalen;
+        uint32_t    xval[2];
+        uint32_t    sz;
+
+        if(rcp->zipped) {
+                if(len < ZP_HDRLEN)
+                        return false;
+                (void)memcpy(xval, buf, sizeof(xval));
+                if(xval[0] != htonl(ZP_MAGIC))
+                        return false;
+                hdrlen = ZP_HDRLEN;
+                info += ZP_HDRLEN;
+        }
+        infolen = zp_infoLen(info, len - hdrlen, &sz);
+        if(infolen == 0)
+                return false;
+        datalen = _RNDUP(hdrlen ? ntohl(xval[1]) : sz, 4);
+        if(hdrlen + infolen + datalen > extent)
+                return false;
+
+        (void)memcpy(xval, info, sizeof(xval));
+        rcp->arrival.tv_sec = (int32_t)ntohl(xval[0]);
+        rcp->arrival.tv_usec = (int32_t)ntohl(xval[1]);
+        if(rcp->arrival.tv_sec < 0 || rcp->arrival.tv_usec < 0 ||
+                        rcp->arrival.tv_usec >= 1000000)
+                return false;
+        (void)memcpy(rcp->sig, info + 8, sizeof(signaturet));
+        (void)memcpy(xval, info + 8 + sizeof(signaturet), 4); /* origin */
+        (void)memcpy(xval, info + 8 + sizeof(signaturet) + 4 +
+                        _RNDUP(ntohl(xval[0]), 4), 4);
+        rcp->feedtype = ntohl(xval[0]);
+        return true;
+}
 
 /*
- * Returns some useful, "highwater" statistics of a product-queue.  The
- * statistics are since the queue was created.
- *
- * Arguments:
- *      pq              Pointer to the product-queue.  Shall not be NULL.
- *      highwaterp      Pointer to the maxium number of bytes used in the
- *                      data portion of the product-queue.  Shall not be NULL.
- *                      Set upon successful return.
- *      maxproductsp    Pointer to the maximum number of data-products that the
- *                      product-queue has held since it was created.  Shall not
- *                      be NULL.  Set upon successful return.
- * Returns:
- *      0               Success.  "*highwaterp" and "*maxproductsp" are set.
- *      else            <errno.h> error code.
+ * Reads and decodes a candidate region. Thread-safe because it only reads
+ * the product-queue.
  */
-int
-pq_highwater(pqueue *pq, off_t *highwaterp, size_t *maxproductsp)
+static void
+rc_decode(const pqueue *const pq, rcelem *const rcp)
 {
-    pq_lockIf(pq);
-        /* Read lock pq->xctl. */
-        int status = ctl_get(pq, 0);
+        char         buf[RC_HDRLEN];
+        const size_t len = rcp->extent < sizeof(buf)
+                ? rcp->extent
+                : sizeof(buf);
 
-        if(status == ENOERR) {
-            if(highwaterp)
-                    *highwaterp = pq->ctlp->highwater;
-            if(maxproductsp)
-                    *maxproductsp = pq->ctlp->maxproducts;
-            (void) ctl_rel(pq, 0);
+        if(pread(pq->fd, buf, len, rcp->offset) != (ssize_t)len)
+                return;
+#ifdef HAVE_MMAP
+        if(rcp->chunked) {
+                const size_t mapsz = len < offsetof(ckmap, offsets)
+                        ? 0
+                        : ck_mapSize(((ckmap *)buf)->nchunks);
+                ckmap       *map;
+                size_t       n;
+
+                if(mapsz == 0 || mapsz > rcp->extent ||
+                                (map = malloc(mapsz)) == NULL)
+                        return;
+                if(pread(pq->fd, map, mapsz, rcp->offset) != (ssize_t)mapsz ||
+                                !ck_isMap(pq, map, mapsz)) {
+                        free(map);
+                        return;
+                }
+                n = map->size < sizeof(buf) ? map->size : sizeof(buf);
+                if(pread(pq->fd, buf, n, ck_dataOffset(pq, map->offsets[0]))
+                                != (ssize_t)n ||
+                                !rc_parse(buf, n, map->size, rcp)) {
+                        free(map);
+                        return;
+                }
+                rcp->map = map;
+                rcp->kind = RC_MAP;
+                return;
         }
-    pq_unlockIf(pq);
-
-    return status;
+#endif
+        if(rc_parse(buf, len, rcp->extent, rcp))
+                rcp->kind = RC_PRODUCT;
 }
 
+static void *
+rc_scanRange(void *const arg)
+{
+        const rcscan *const scan = arg;
+
+        for(size_t i = 0; i < scan->nelems; i++)
+                rc_decode(scan->pq, scan->elems + i);
+        return NULL;
+}
 
 /*
- * Indicates if the product-queue is full (i.e., if a data-product has been
- * deleted in order to make room for another data-product).
- *
- * Arguments:
- *      pq              Pointer to the product-queue structure.  Shall not be
- *                      NULL.
- *      isFull          Pointer to the indicator of whether or not the queue
- *                      is full.  Shall not be NULL.  Set upon successful
- *                      return.  "*isfull" will be non-zero if and only if the
- *                      product-queue is full.
- * Returns:
- *      0               Success.  "*isFull" is set.
- *      else            <errno.h> error code.
+ * Decodes the candidate regions with up to 'nthreads' threads (0 means one
+ * per online processor). Returns the number of threads used.
  */
-int pq_isFull(
-    pqueue* const       pq,
-    int* const          isFull)
+static unsigned
+rc_scan(const pqueue *const pq, rcelem *const elems, const size_t nelems,
+        unsigned nthreads)
 {
-    pq_lockIf(pq);
-    int status = ctl_get(pq, 0);
-    if (status == ENOERR) {
-        *isFull = pq->ctlp->isFull;
-        (void)ctl_rel(pq, 0);
-    }                                   /* "pq->ctlp" allocated */
+        rcscan    scans[RC_MAX_THREADS];
+        pthread_t threads[RC_MAX_THREADS];
+        bool      started[RC_MAX_THREADS];
+        unsigned  i;
+
+        if(nthreads == 0) {
+                const long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+                nthreads = nprocs > 0 ? (unsigned)nprocs : 1;
+        }
+        if(nthreads > RC_MAX_THREADS)
+                nthreads = RC_MAX_THREADS;
+        if(nthreads > nelems / RC_MIN_PER_THREAD)
+                nthreads = nelems / RC_MIN_PER_THREAD;
+        if(nthreads == 0)
+                nthreads = 1;
+
+        for(i = 0; i < nthreads; i++) {
+                const size_t start = nelems * i / nthreads;
+
+                scans[i].pq = pq;
+                scans[i].elems = elems + start;
+                scans[i].nelems = nelems * (i + 1) / nthreads - start;
+        }
+        /* The calling thread decodes the first range and any that a thread
+         * couldn't be created for */
+        for(i = 1; i < nthreads; i++) {
+                started[i] = pthread_create(&threads[i], NULL, rc_scanRange,
+                                &scans[i]) == 0;
+                if(!started[i])
+                        (void)rc_scanRange(&scans[i]);
+        }
+        (void)rc_scanRange(&scans[0]);
+        for(i = 1; i < nthreads; i++)
+                if(started[i])
+                        (void)pthread_join(threads[i], NULL);
 
-    pq_unlockIf(pq);
-    return status;
+        return nthreads;
+}
+
+/*
+ * Assigns the chunks of each chunk map to it. A chunk map whose chunks aren't
+ * all undecodable candidates that contain their data is invalidated.
+ */
+static void
+rc_claimChunks(const pqueue *const pq, rcelem *const elems,
+        const size_t nelems)
+{
+        for(size_t i = 0; i < nelems; i++) {
+                const ckmap *const map = elems[i].map;
+                uint32_t           j;
+
+                if(elems[i].kind != RC_MAP)
+                        continue;
+                for(j = 0; j < map->nchunks; j++) {
+                        const rcelem *const rcp = rc_find(elems, nelems,
+                                        map->offsets[j]);
+                        const size_t        len = j + 1 < map->nchunks
+                                ? CK_SIZE
+                                : map->size - (size_t)j*CK_SIZE;
+
+                        if(rcp == NULL || rcp->kind != RC_BAD ||
+                                        ck_dataOffset(pq, rcp->offset) +
+                                        (off_t)len > rcp->offset +
+                                        (off_t)rcp->extent)
+                                break;
+                }
+                if(j < map->nchunks) {
+                        log_add("Chunk %lu of data-product at offset %ld is "
+                                "invalid", (unsigned long)j,
+                                (long)elems[i].offset);
+                        elems[i].kind = RC_BAD;
+                        continue;
+                }
+                for(j = 0; j < map->nchunks; j++) {
+                        rcelem *const rcp = rc_find(elems, nelems,
+                                        map->offsets[j]);
+                        rcp->kind = RC_CHUNK;
+                        rcp->owner = i;
+                }
+        }
 }
 
+/*
+ * Checks the time-index against the candidates and sets the insertion-time
+ * of the data-products that it references. Returns true if the time-index is
+ * consistent; otherwise, log_add() is called.
+ */
+static bool
+rc_checkTimes(const pqueue *const pq, rcelem *const elems,
+        const size_t nelems)
+{
+        bool consistent = true;
+
+        if(tq_check(pq->tqp))
+                return false;
+
+        for(const tqelem *tqep = tqe_first(pq->tqp);
+                        tqep != NULL && tqep->offset != OFF_NONE;
+                        tqep = tq_next(pq->tqp, tqep)) {
+                rcelem *const rcp = rc_find(elems, nelems, tqep->offset);
+
+                if(rcp == NULL || rcp->intq ||
+                                (rcp->kind != RC_PRODUCT &&
+                                 rcp->kind != RC_MAP)) {
+                        log_add("Time-index element refers to offset %ld, "
+                                "which isn't a data-product",
+                                (long)tqep->offset);
+                        consistent = false;
+                        continue;
+                }
+                rcp->intq = true;
+                rcp->tv = tqep->tv;
+        }
+        return consistent;
+}
 
 /*
- * Returns the time of the most-recent insertion of a data-product.
+ * Decides which candidates the recovered indexes retain: the data-products
+ * that the time-index references if it's consistent (any others were being
+ * inserted) or all of them if it isn't, but only one per signature, and the
+ * chunks of the retained chunked data-products. Clears '*timesOk' if a
+ * data-product of the time-index isn't retained.
  *
- * Arguments:
- *      pq              Pointer to the product-queue structure.  Shall not be
- *                      NULL.
- *      mostRecent      Pointer to the time of the most-recent insertion of a
- *                      data-product.  Upon successful return, "*mostRecent"
- *                      shall be TS_NONE if such a time doesn't exist (because
- *                      the queue is empty, for example).
- * Returns:
- *      0               Success.  "*mostRecent" is set.
- *      else            <errno.h> error code.
+ * Returns 0 or ENOMEM, in which case log_add() is called.
  */
-int pq_getMostRecent(
-    pqueue* const       pq,
-    timestampt* const   mostRecent)
+static int
+rc_select(rcelem *const elems, const size_t nelems, bool *const timesOk,
+        size_t *const nprodsp, size_t *const nfreedp)
 {
-    pq_lockIf(pq);
-    int status = ctl_get(pq, 0);
-    if (status == ENOERR) {
-        *mostRecent = pq->ctlp->mostRecent;
-        (void)ctl_rel(pq, 0);
-    }                                   /* "pq->ctlp" allocated */
+        rcelem **prods = malloc((nelems + 1) * sizeof(rcelem *));
+        size_t   nprods = 0;
+        size_t   i;
+
+        if(prods == NULL) {
+                log_add_syserr("Couldn't allocate %lu data-products",
+                        (unsigned long)nelems);
+                return ENOMEM;
+        }
+        for(i = 0; i < nelems; i++) {
+                if(elems[i].kind == RC_PRODUCT || elems[i].kind == RC_MAP) {
+                        elems[i].keep = !*timesOk || elems[i].intq;
+                        if(elems[i].keep)
+                                prods[nprods++] = elems + i;
+                }
+        }
 
-    pq_unlockIf(pq);
-    return status;
+        qsort(prods, nprods, sizeof(rcelem *), rc_cmpSig);
+        for(i = 1; i < nprods; i++) {
+                if(memcmp(prods[i-1]->sig, prods[i]->sig,
+                                sizeof(signaturet)) == 0) {
+                        log_add("Data-products at offsets %ld and %ld have "
+                                "the same signature", (long)prods[i-1]->offset,
+                                (long)prods[i]->offset);
+                        prods[i]->keep = false;
+                        if(prods[i]->intq)
+                                *timesOk = false;
+                }
+        }
+        free(prods);
+
+        *nprodsp = 0;
+        *nfreedp = 0;
+        for(i = 0; i < nelems; i++) {
+                if(elems[i].kind == RC_CHUNK)
+                        elems[i].keep = elems[elems[i].owner].keep;
+                if(!elems[i].keep)
+                        (*nfreedp)++;
+                else if(elems[i].kind != RC_CHUNK)
+                        (*nprodsp)++;
+        }
+        return 0;
+}
+
+/*
+ * Returns the next element after 'ix' of a skip list whose next "pointer" is
+ * in fblk 'fblk' or 'none' if the fblk is invalid.
+ */
+static inline size_t
+rc_next(const fb *const fbp, const size_t fblk, const size_t none)
+{
+        return fblk < fbp->arena_sz ? (size_t)fbp->fblks[fblk] : none;
 }
 
+static int
+rc_cmpRegion(const void *const a, const void *const b)
+{
+        const off_t x = ((const region *)a)->offset;
+        const off_t y = ((const region *)b)->offset;
+
+        return x < y ? -1 : x > y;
+}
 
 /*
- * Returns metrics associated with the minimum virtual residence time of
- * data-products in the queue since the queue was created or the metrics reset.
- * The virtual residence time of a data-product is the time that the product
- * was removed from the queue minus the time that the product was created.  The
- * minimum virtual residence time is the minimum of the virtual residence times
- * over all applicable products.
- *
- * Arguments:
- *      pq              Pointer to the product-queue structure.  Shall not be
- *                      NULL.
- *      minVirtResTime  Pointer to the minimum virtual residence time of the
- *                      queue since the queue was created.  Shall not be NULL.
- *                      "*minVirtResTime" is set upon successful return.  If
- *                      such a time doesn't exist (because no products have
- *                      been deleted from the queue, for example), then
- *                      "*minVirtResTime" shall be TS_NONE upon successful
- *                      return.
- *      size            Pointer to the amount of data used, in bytes, when the
- *                      minimum virtual residence time was set. Shall not be
- *                      NULL. Set upon successful return. If this parameter
- *                      doesn't exist, then "*size" shall be set to -1.
- *      slots           Pointer to the number of slots used when the minimum
- *                      virtual residence time was set. Shall not be NULL. Set
- *                      upon successful return. If this parameter doesn't exist,
- *                      the "*slots" shall be set to 0.
- * Returns:
- *      0               Success.  All the outout metrics are set.
- *      else            <errno.h> error code.
+ * Checks the lists and slabs of the size-class index and returns their free
+ * regions sorted by offset. Returns NULL if they're inconsistent or memory
+ * couldn't be allocated, in which case log_add() is called.
  */
-int pq_getMinVirtResTimeMetrics(
-    pqueue* const       pq,
-    timestampt* const   minVirtResTime,
-    off_t* const        size,
-    size_t* const       slots)
+static region *
+rc_classRegions(const pqueue *const pq, size_t *const nregionsp)
+{
+        const cl *const      clp = pq->clp;
+        const regionl *const rl = pq->rlp;
+        const region *const  rp = rl->rp;
+        const size_t         nslots = rl->nalloc + RL_FREE_OVERHEAD;
+        const size_t         align = pq->ctlp->align;
+        region              *regions;
+        size_t               n = 0;
+        size_t               nbytes = 0;
+        size_t               ix;
+
+        if(clp->magic != CL_MAGIC || clp->nclasses != CL_NCLASSES ||
+                        clp->nregions > rl->nfree) {
+                log_add("Size-class index has invalid parameters");
+                return NULL;
+        }
+        regions = malloc((clp->nregions + 1) * sizeof(region));
+        if(regions == NULL) {
+                log_add_syserr("Couldn't allocate %lu size-class regions",
+                        (unsigned long)clp->nregions);
+                return NULL;
+        }
+        for(size_t c = 0; c < CL_NCLASSES; c++) {
+                for(ix = clp->heads[c]; ix != RL_NONE; ix = rp[ix].next) {
+                        if(ix < RL_FREE_OVERHEAD || ix >= nslots ||
+                                        IsAlloc(rp + ix) ||
+                                        cl_floor(rp[ix].extent, align) != c ||
+                                        n >= clp->nregions) {
+                                log_add("Size-class %lu free list is broken",
+                                        (unsigned long)c);
+                                free(regions);
+                                return NULL;
+                        }
+                        nbytes += rp[ix].extent;
+                        regions[n++] = rp[ix];
+                }
+                ix = clp->slabs[c];
+                if(ix != RL_NONE) {
+                        if(ix < RL_FREE_OVERHEAD || ix >= nslots ||
+                                        IsAlloc(rp + ix) ||
+                                        rp[ix].extent == 0 || rp[ix].extent %
+                                        cl_extent(c, align) != 0 ||
+                                        n >= clp->nregions) {
+                                log_add("Size-class %lu slab is broken",
+                                        (unsigned long)c);
+                                free(regions);
+                                return NULL;
+                        }
+                        nbytes += rp[ix].extent;
+                        regions[n++] = rp[ix];
+                }
+        }
+        if(n != clp->nregions || nbytes != clp->nbytes) {
+                log_add("Size-classes have %lu regions of %lu bytes instead "
+                        "of %lu of %lu", (unsigned long)n,
+                        (unsigned long)nbytes, (unsigned long)clp->nregions,
+                        (unsigned long)clp->nbytes);
+                free(regions);
+                return NULL;
+        }
+        qsort(regions, n, sizeof(region), rc_cmpRegion);
+        *nregionsp = n;
+        return regions;
+}
+
+/*
+ * Advances a position in the data section over the candidates and the free
+ * regions of the size-classes that start at it.
+ */
+static off_t
+rc_skip(off_t pos, const rcelem *const elems, const size_t nelems,
+        size_t *const j, const region *const cls, const size_t ncl,
+        size_t *const k)
 {
-    pq_lockIf(pq);
+        for(;;) {
+                if(*j < nelems && elems[*j].offset == pos)
+                        pos += elems[(*j)++].extent;
+                else if(*k < ncl && cls[*k].offset == pos)
+                        pos += cls[(*k)++].extent;
+                else
+                        return pos;
+        }
+}
 
-    int status = ctl_get(pq, 0);
-    if (status == ENOERR) {
-        pqctl*   ctlp = pq->ctlp;
+/*
+ * Checks the region-list against the candidates, all of which must be
+ * retained, and the free regions of the size-classes, which are sorted by
+ * offset: its statistics, its hash chains, its free lists by offset and by
+ * extent, which together with the candidates and the size-classes must tile
+ * the data section, and its list of empty slots. Returns true if the
+ * region-list is consistent; otherwise, log_add() is called.
+ */
+static bool
+rc_checkRegionList(const pqueue *const pq, const rcelem *const elems,
+        const size_t nelems, const region *const cls, const size_t ncl)
+{
+        const regionl *const rl = pq->rlp;
+        const region *const  rp = rl->rp;
+        const rlhash *const  rlhp = RLHASHP(rl);
+        const fb *const      fbp = pq->fbp;
+        const size_t         nslots = rl->nalloc + RL_FREE_OVERHEAD;
+        size_t               n = 0;
+        size_t               ix;
+        size_t               j;
+        size_t               k = 0;
+        size_t               extent = 0;
+        off_t                pos = pq->datao;
+
+        if(rlhp->magic != RL_MAGIC || rl->nchains !=
+                        rlhash_nchains(rl->nalloc) ||
+                        rl->fbp_off != (char *)fbp - (char *)rl ||
+                        rl->nelems + rl->nfree + rl->nempty != rl->nalloc) {
+                log_add("Region-list has invalid parameters");
+                return false;
+        }
+        for(j = 0; j < nelems; j++) {
+                if(!elems[j].keep) {
+                        log_add("Region at offset %ld isn't that of an "
+                                "indexed data-product", (long)elems[j].offset);
+                        return false;
+                }
+        }
+        if(rl->nelems != nelems) {
+                log_add("Region-list has %lu in-use regions instead of %lu",
+                        (unsigned long)rl->nelems, (unsigned long)nelems);
+                return false;
+        }
 
-        if (METRICS_MAGIC == ctlp->metrics_magic) {
-            *minVirtResTime = ctlp->minVirtResTime;
+        for(size_t c = 0; c < rl->nchains; c++) {
+                for(ix = rlhp->chains[c]; ix != RL_NONE; ix = rp[ix].next) {
+                        if(ix < RL_FREE_OVERHEAD || ix >= nslots ||
+                                        !IsAlloc(rp + ix) ||
+                                        rl_hash(rl->nchains, rp[ix].offset)
+                                        != c || ++n > rl->nelems) {
+                                log_add("Region-list hash chain %lu is broken",
+                                        (unsigned long)c);
+                                return false;
+                        }
+                }
         }
-        else {
-            *minVirtResTime = TS_NONE;
+        if(n != rl->nelems) {
+                log_add("Region-list hash chains have %lu regions instead of "
+                        "%lu", (unsigned long)n, (unsigned long)rl->nelems);
+                return false;
         }
 
-        if (METRICS_MAGIC_2 == ctlp->metrics_magic_2) {
-            *size = ctlp->mvrtSize;
-            *slots = ctlp->mvrtSlots;
+        n = 0;
+        j = 0;
+        for(ix = rc_next(fbp, rp[RL_FOFF_HD].next, RL_NONE); ix != RL_FOFF_TL;
+                        ix = rc_next(fbp, rp[ix].next, RL_NONE)) {
+                if(ix < RL_FREE_OVERHEAD || ix >= nslots || IsAlloc(rp + ix) ||
+                                ++n > rl->nfree - ncl) {
+                        log_add("Region-list free list by offset is broken");
+                        return false;
+                }
+                pos = rc_skip(pos, elems, nelems, &j, cls, ncl, &k);
+                if(rp[ix].offset != pos) {
+                        log_add("Free region at offset %ld should be at %ld",
+                                (long)rp[ix].offset, (long)pos);
+                        return false;
+                }
+                pos += rp[ix].extent;
         }
-        else {
-            *size = -1;
-            *slots = 0;
+        pos = rc_skip(pos, elems, nelems, &j, cls, ncl, &k);
+        if(n != rl->nfree - ncl || j != nelems || k != ncl || pos != pq->ixo) {
+                log_add("Regions don't cover the data section");
+                return false;
         }
 
-        (void)ctl_rel(pq, 0);
-    }                                   /* "pq->ctlp" allocated */
+        n = 0;
+        for(ix = rc_next(fbp, rp[RL_FEXT_HD].prev, RL_NONE); ix != RL_FEXT_TL;
+                        ix = rc_next(fbp, rp[ix].prev, RL_NONE)) {
+                if(ix < RL_FREE_OVERHEAD || ix >= nslots || IsAlloc(rp + ix) ||
+                                rp[ix].extent < extent ||
+                                ++n > rl->nfree - ncl) {
+                        log_add("Region-list free list by extent is broken");
+                        return false;
+                }
+                extent = rp[ix].extent;
+        }
+        if(n != rl->nfree - ncl) {
+                log_add("Region-list free list by extent has %lu regions "
+                        "instead of %lu", (unsigned long)n,
+                        (unsigned long)(rl->nfree - ncl));
+                return false;
+        }
 
-    pq_unlockIf(pq);
-    return status;
+        n = 0;
+        for(ix = rl->empty; ix != RL_NONE; ix = rp[ix].next) {
+                if(ix < RL_FREE_OVERHEAD || ix >= nslots || ++n > rl->nempty) {
+                        log_add("Region-list empty list is broken");
+                        return false;
+                }
+        }
+        if(n != rl->nempty) {
+                log_add("Region-list empty list has %lu slots instead of %lu",
+                        (unsigned long)n, (unsigned long)rl->nempty);
+                return false;
+        }
+        return true;
 }
 
 /*
- * Clears the metrics associated with the minimum virtual residence time of
- * data-products in the queue.  After this function, the minimum virtual
- * residence time metrics will be recomputed as products are deleted from the
- * queue.
- *
- * Arguments:
- *      pq              Pointer to the product-queue structure.  Shall not be
- *                      NULL.  Must be open for writing.
- * Returns:
- *      0               Success.  The minimum virtual residence time metrics are
- *                      cleared.
- *      else            <errno.h> error code.
+ * Checks the region-list and, if the product-queue allocates by size-class, the
+ * size-class index against the candidates, all of which must be retained.
+ * Returns true if they're consistent; otherwise, log_add() is called.
  */
-int pq_clearMinVirtResTimeMetrics(
-    pqueue* const       pq)
+static bool
+rc_checkRegions(const pqueue *const pq, const rcelem *const elems,
+        const size_t nelems)
 {
-    pq_lockIf(pq);
+        region *cls = NULL;
+        size_t  ncl = 0;
 
-    int status = ctl_get(pq, RGN_WRITE);
-    if (status == ENOERR) {
-        pq->ctlp->minVirtResTime = TS_NONE;
-        pq->ctlp->mvrtSize = -1;
-        pq->ctlp->mvrtSlots = 0;
+        if(pq->clp && (cls = rc_classRegions(pq, &ncl)) == NULL)
+                return false;
 
-        (void)ctl_rel(pq, RGN_MODIFIED);
-    }                                   /* "pq->ctlp" allocated */
+        const bool consistent = rc_checkRegionList(pq, elems, nelems, cls,
+                ncl);
 
-    pq_unlockIf(pq);
-    return status;
+        free(cls);
+        return consistent;
 }
 
+/*
+ * Checks the fblks of the skip lists: their free lists and that no fblk of
+ * the free lists of the region-list or, if 'tq' is true, of the time-index is
+ * free. The region-list and the time-index must be consistent. Returns true
+ * if the fblks are consistent; otherwise, log_add() is called.
+ */
+static bool
+rc_checkFblks(const pqueue *const pq, const bool tq)
+{
+        const fb *const      fbp = pq->fbp;
+        const regionl *const rl = pq->rlp;
+        unsigned char       *isfree;
+        size_t               avail = 0;
+        size_t               ix;
+        bool                 consistent = true;
+
+        if(fbp->magic != FB_MAGIC || fbp->maxsize != log4(pq->nalloc) + 1 ||
+                        fbp->arena_sz > fb_arena_sz(pq->nalloc)) {
+                log_add("Skip-list blocks have invalid parameters");
+                return false;
+        }
+        isfree = calloc(fbp->arena_sz, 1);
+        if(isfree == NULL) {
+                log_add_syserr("Couldn't allocate %lu bytes",
+                        (unsigned long)fbp->arena_sz);
+                return false;
+        }
 
-/**
- * Get some detailed product queue statistics.  These may be useful for
- * monitoring the internal state of the product queue:
- *
- * @param[out] nprodsp      The current number of products in the queue.  May be
- *                          NULL.
- * @param[out] nfreep       The current number of free regions.  This should be
- *                          small and it's OK if it's zero, since new free
- *                          regions are created as needed by deleting oldest
- *                          products.  If this gets large, insertion and
- *                          deletion take longer.  May be NULL.
- * @param[out] nemptyp      The number of product slots left.  This may
- *                          decrease, but should eventually stay above some
- *                          positive value unless too few product slots were
- *                          allocated when the queue was created.  New product
- *                          slots get created when adjacent free regions are
- *                          consolidated, and product slots get consumed when
- *                          larger free regions are split into smaller free
- *                          regions.  May be NULL.
- * @param[out] nbytesp      The current number of bytes in the queue used for
- *                          data products.  May be NULL.
- * @param[out] maxprodsp    The maximum number of products in the queue, so far.
- *                          May be NULL.
- * @param[out] maxfreep     The maximum number of free regions, so far.  May be
- *                          NULL.
- * @param[out] minemptyp    The minimum number of empty product slots, so far.
- *                          May be NULL.
- * @param[out] maxbytesp    The maximum number of bytes used for data, so far.
- *                          May be NULL.
- * @param[out] age_oldestp  The age in seconds of the oldest product in the
- *                          queue.  May be NULL.
- * @param[out] maxextentp   Extent of largest free region  May be NULL.
- * @retval 0          Success.
- * @retval EACCESS or EAGAIN
- *                    The region is already locked by another process.
- * @retval EINVAL     The product-queue file doesn't support locking.
- * @retval ENOLCK     The number of locked regions would exceed a system-imposed
- *                    limit.
- * @retval EDEADLK    A deadlock in region locking has been detected.
- * @retval EBADF      The file descriptor of the product-queue is invalid.
- * @retval EIO        An I/O error occurred while reading from the file system.
- * @retval EOVERFLOW  The file size in bytes or the number of blocks allocated
- *                    to the file or the file serial number cannot be
- *                    represented correctly.
- * @retval EINTR      A signal was caught during execution.
- * @retval EFBIG or EINVAL
- *                    The size of the product-queue is greater than the maximum
- *                    file size.
- * @retval EROFS      The named file resides on a read-only file system.
- * @retval EAGAIN     The mapping could not be locked in memory, if required by
- *                    mlockall(), due to a lack of resources.
- * @retval EINVAL     The product-queue object wants to map the product-queue to
- *                    a fixed memory location that is not a multiple of the page
- *                    size as returned by sysconf(), or is considered invalid
- *                    by the O/S.
- * @retval EMFILE     The number of mapped regions would exceed an O/S-dependent
- *                    limit (per process or per system).
- * @retval ENODEV     The file descriptor of the product-queue object refers to
- *                    a file whose type is not supported by mmap().
- * @retval ENOMEM     The size of the product-queue exceeds that allowed for the
- *                    address space of a process.
- * @retval ENOMEM     The mapping could not be locked in memory, if required by
- *                    mlockall(), because it would require more space than the
- *                    system is able to supply.
- * @retval ENOTSUP    The O/S does not support the combination of accesses
- *                    requested.
- * @retval ENXIO      The size of the product-queue is invalid for the object
- *                    specified by its file descriptor.
- *
- * Note: the fixed number of slots allocated for products when the
- * queue was created is nalloc = (nprods + nfree + nempty).
+        for(int level = 0; consistent && level <= fbp->maxsize; level++) {
+                const size_t size = level < fbp->maxsize ? level + 1 :
+                        fbp->maxsize;
+                fblk_t       fblk = fbp->free[level];
+
+                for(size_t n = 0; consistent && n < fbp->nfree[level]; n++) {
+                        consistent = fblk + size <= fbp->arena_sz;
+                        for(size_t k = 0; consistent && k < size; k++)
+                                consistent = !isfree[fblk + k]++;
+                        if(consistent)
+                                fblk = fbp->fblks[fblk];
+                }
+                avail += fbp->nfree[level];
+        }
+        if(!consistent || avail != fbp->avail) {
+                log_add("Skip-list block free lists are broken");
+                free(isfree);
+                return false;
+        }
+
+#define RC_INUSE(fblk)  ((fblk) < fbp->arena_sz && !isfree[fblk])
+        consistent = RC_INUSE(rl->rp[RL_FOFF_HD].next) &&
+                RC_INUSE(rl->rp[RL_FOFF_TL].next) &&
+                RC_INUSE(rl->rp[RL_FEXT_HD].prev) &&
+                RC_INUSE(rl->rp[RL_FEXT_TL].prev);
+        for(ix = fbp->fblks[rl->rp[RL_FOFF_HD].next];
+                        consistent && ix != RL_FOFF_TL;
+                        ix = fbp->fblks[rl->rp[ix].next])
+                consistent = RC_INUSE(rl->rp[ix].next) &&
+                        RC_INUSE(rl->rp[ix].prev);
+        if(consistent && tq) {
+                const tqueue *const tqp = pq->tqp;
+
+                consistent = RC_INUSE(tqp->tqep[TQ_NIL].fblk);
+                for(ix = TQ_HEAD; consistent && ix != TQ_NIL;
+                                ix = fbp->fblks[tqp->tqep[ix].fblk])
+                        consistent = RC_INUSE(tqp->tqep[ix].fblk);
+        }
+#undef RC_INUSE
+        free(isfree);
+        if(!consistent)
+                log_add("A skip-list block is both in use and free");
+        return consistent;
+}
+
+/*
+ * Checks the signature-index against the retained data-products. An
+ * open-addressed signature-index must also know the insertion-time of each
+ * data-product, so it's inconsistent if the time-index is to be rebuilt.
+ * Returns true if it's consistent; otherwise, log_add() is called.
  */
-int
-pq_stats(pqueue *pq,
-     size_t* const      nprodsp,
-     size_t* const      nfreep,
-     size_t* const      nemptyp,
-     size_t* const      nbytesp,
-     size_t* const      maxprodsp,
-     size_t* const      maxfreep,
-     size_t* const      minemptyp,
-     size_t* const      maxbytesp,
-     double* const      age_oldestp,
-     size_t* const      maxextentp)
+static bool
+rc_checkSigs(const pqueue *const pq, const rcelem *const elems,
+        const size_t nelems, const bool timesOk)
 {
-    pq_lockIf(pq);
-        /* Read lock pq->ctl. */
-        int status = ctl_get(pq, 0);
+        sx *const sxp = pq->sxp;
+        size_t    n = 0;
 
-        if(status == ENOERR) {
-            if(nprodsp)
-                *nprodsp = pq->rlp->nelems;
-            if(nfreep)
-                *nfreep = pq->rlp->nfree;
-            if(maxextentp)
-                *maxextentp = pq->rlp->maxfextent;
-            if(nemptyp)
-                *nemptyp = pq->rlp->nempty;
-            if(nbytesp)
-                *nbytesp = pq->rlp->nbytes;
-            if(maxprodsp)
-                *maxprodsp = pq->rlp->maxelems;
-            if(maxfreep)
-                *maxfreep = pq->rlp->maxfree;
-            if(minemptyp)
-                *minemptyp = pq->rlp->minempty;
-            if(maxbytesp)
-                *maxbytesp = pq->rlp->maxbytes;
-            if(age_oldestp) {
-                timestampt ts0;
-                tqelem *tqep;
+        if(sxp->nchains == SX_OPEN) {
+                const sxo *const sxop = (const sxo *)sxp;
 
-                tqep = tqe_first(pq->tqp); /* get oldest */
-                if(tqep != NULL) {
-                  set_timestamp(&ts0);
-                  *age_oldestp = d_diff_timestamp(&ts0, &tqep->tv);
-                } else {
-                  *age_oldestp = 0;
+                if(sxop->magic != SXO_MAGIC ||
+                                sxop->nslots != sxo_nslots(pq->nalloc) ||
+                                sxop->slots_off != sxo_slots_off(sxop->nslots)) {
+                        log_add("Signature-index has invalid parameters");
+                        return false;
                 }
-            }
-
-            (void) ctl_rel(pq, 0);
+                for(size_t i = 0; i < sxop->nslots; i++)
+                        if(sxop->meta[i])
+                                n++;
+        }
+        else {
+                const sxhash *const sxhp = (const sxhash *)
+                        &sxp->sxep[sxp->nalloc];
+                size_t              ix;
+
+                if(sxhp->magic != SX_MAGIC ||
+                                sxp->nchains != nchains(pq->nalloc) ||
+                                sxp->nelems + sxp->nfree != sxp->nalloc) {
+                        log_add("Signature-index has invalid parameters");
+                        return false;
+                }
+                for(size_t c = 0; c < sxp->nchains; c++) {
+                        for(ix = sxhp->chains[c]; ix != SX_NONE;
+                                        ix = sxp->sxep[ix].next) {
+                                if(ix >= sxp->nalloc || sx_hash(sxp->nchains,
+                                                sxp->sxep[ix].sxi) != c ||
+                                                ++n > sxp->nelems) {
+                                        log_add("Signature-index hash chain "
+                                                "%lu is broken",
+                                                (unsigned long)c);
+                                        return false;
+                                }
+                        }
+                }
+                size_t nfree = 0;
+                for(ix = sxp->free; ix != SX_NONE; ix = sxp->sxep[ix].next) {
+                        if(ix >= sxp->nalloc || ++nfree > sxp->nfree) {
+                                log_add("Signature-index free list is broken");
+                                return false;
+                        }
+                }
+                if(nfree != sxp->nfree) {
+                        log_add("Signature-index free list has %lu elements "
+                                "instead of %lu", (unsigned long)nfree,
+                                (unsigned long)sxp->nfree);
+                        return false;
+                }
+        }
+        if(n != sxp->nelems) {
+                log_add("Signature-index has %lu signatures instead of %lu",
+                        (unsigned long)n, (unsigned long)sxp->nelems);
+                return false;
         }
-    pq_unlockIf(pq);
 
-    return status;
+        n = 0;
+        for(size_t i = 0; i < nelems; i++) {
+                sxelem *sxep;
+
+                if(!elems[i].keep || elems[i].kind == RC_CHUNK)
+                        continue;
+                if(!sx_find(sxp, elems[i].sig, &sxep) ||
+                                sxep->offset != elems[i].offset) {
+                        log_add("Signature of data-product at offset %ld "
+                                "isn't indexed", (long)elems[i].offset);
+                        return false;
+                }
+                if(SXE_TIME_OK(sxp)) {
+                        timestampt tv;
+
+                        if(!timesOk || !sxe_getTime(sxp, sxep, &tv) ||
+                                        !TV_CMP_EQ(tv, elems[i].tv)) {
+                                log_add("Signature-index has the wrong "
+                                        "insertion-time of data-product at "
+                                        "offset %ld", (long)elems[i].offset);
+                                return false;
+                        }
+                }
+                n++;
+        }
+        if(n != sxp->nelems) {
+                log_add("Signature-index has %lu signatures for %lu "
+                        "data-products", (unsigned long)sxp->nelems,
+                        (unsigned long)n);
+                return false;
+        }
+        return true;
 }
 
 /*
- * Returns the number of slots in a product-queue.
- *
- * Arguments:
- *      pq              Pointer to the product-queue object.
- * Returns:
- *      The number of slots in the product-queue.
+ * Checks the index of evicted signatures. Returns true if it's consistent;
+ * otherwise, log_add() is called.
  */
-size_t
-pq_getSlotCount(
-    pqueue* const       pq)
+static bool
+rc_checkEvsigs(const pqueue *const pq)
 {
-    pq_lockIf(pq);
-    size_t nalloc = pq->nalloc;
-    pq_unlockIf(pq);
-    return nalloc;
+        es *const             esp = pq->esp;
+        const uint32_t *const buckets = es_buckets(esp);
+        size_t                n = 0;
+
+        if(esp->magic != ES_MAGIC || esp->nalloc != pq->nalloc ||
+                        esp->nbuckets != es_nbuckets(pq->nalloc) ||
+                        esp->head >= esp->nalloc ||
+                        esp->nelems > esp->nalloc ||
+                        (esp->nelems < esp->nalloc &&
+                         esp->head != esp->nelems)) {
+                log_add("Index of evicted signatures has invalid parameters");
+                return false;
+        }
+        for(size_t i = 0; i < esp->nbuckets; i++) {
+                if(buckets[i] > esp->nelems) {
+                        log_add("Index of evicted signatures has invalid "
+                                "bucket %lu", (unsigned long)i);
+                        return false;
+                }
+                if(buckets[i])
+                        n++;
+        }
+        if(n != esp->nelems) {
+                log_add("Index of evicted signatures has %lu entries instead "
+                        "of %lu", (unsigned long)n,
+                        (unsigned long)esp->nelems);
+                return false;
+        }
+        return true;
 }
 
-
 /*
- * Returns the insertion-timestamp of the oldest data-product in the
- * product-queue.
- *
- * Arguments:
- *      oldestCursor    Pointer to structure to received the insertion-time
- *                      of the oldest data-product.
- * Returns:
- *      ENOERR          Success.
- *      else            Failure.
+ * Rebuilds the region-list from the retained candidates. The fblks must have
+ * been initialized. Returns 0 or PQ_CORRUPT, in which case log_add() is
+ * called.
  */
-int
-pq_getOldestCursor(
-    pqueue*             pq,
-    timestampt* const   oldestCursor)
+static int
+rc_rebuildRegions(pqueue *const pq, const rcelem *const elems,
+        const size_t nelems)
 {
-    pq_lockIf(pq);
-
-    int status = ctl_get(pq, 0);
-    if (status == ENOERR) {
-        tqelem*         tqep = tqe_first(pq->tqp);
+        regionl *const rl = pq->rlp;
+        off_t          pos = pq->datao;
+
+        rl_init(rl, pq->nalloc, pq->fbp);
+        if(pq->clp)
+                cl_init(pq->clp);
+        for(size_t i = 0; i <= nelems; i++) {
+                const off_t end = i < nelems ? elems[i].offset : pq->ixo;
+                size_t      rlix;
+                region     *rep;
+
+                if(i < nelems && !elems[i].keep)
+                        continue;
+                if(end > pos && rl_add(rl, pos, (size_t)(end - pos)) == NULL) {
+                        log_add("Couldn't add free region at offset %ld",
+                                (long)pos);
+                        return PQ_CORRUPT;
+                }
+                if(i == nelems)
+                        break;
+                rlix = rp_get(rl);
+                if(rlix == RL_NONE) {
+                        log_add("No region slot for data-product at offset %ld",
+                                (long)elems[i].offset);
+                        return PQ_CORRUPT;
+                }
+                rep = rl->rp + rlix;
+                rep->offset = elems[i].offset;
+                rep->extent = elems[i].extent;
+                set_IsAlloc(rep);
+                if(elems[i].kind == RC_MAP)
+                        set_IsChunked(rep);
+                if(elems[i].zipped)
+                        set_IsZipped(rep);
+                rlhash_add(rl, rlix);
+                rl->nelems++;
+                rl->nbytes += elems[i].extent;
+                pos = elems[i].offset + (off_t)elems[i].extent;
+        }
+        rl->maxelems = rl->nelems;
+        rl->maxbytes = rl->nbytes;
+        rl->maxfextent = rl_maxfextent(rl);
+        log_assert(rl->nelems + rl->nfree + rl->nempty == rl->nalloc);
+        return 0;
+}
 
-        if (tqep == NULL) {
-            *oldestCursor = TS_NONE;
+/*
+ * Rebuilds the time-index from the retained data-products. A data-product
+ * that the old time-index didn't reference is given its arrival-time as its
+ * insertion-time. Returns 0, ENOMEM, or PQ_CORRUPT, in which case log_add()
+ * is called.
+ */
+static int
+rc_rebuildTimes(pqueue *const pq, rcelem *const elems, const size_t nelems)
+{
+        tqueue *const tq = pq->tqp;
+        rcelem      **prods = malloc((nelems + 1) * sizeof(rcelem *));
+        size_t        nprods = 0;
+        int           status = 0;
+
+        if(prods == NULL) {
+                log_add_syserr("Couldn't allocate %lu data-products",
+                        (unsigned long)nelems);
+                return ENOMEM;
         }
-        else {
-            *oldestCursor = tqep->tv;
+        for(size_t i = 0; i < nelems; i++) {
+                if(!elems[i].keep || elems[i].kind == RC_CHUNK)
+                        continue;
+                if(!elems[i].intq)
+                        elems[i].tv = elems[i].arrival;
+                prods[nprods++] = elems + i;
         }
+        qsort(prods, nprods, sizeof(rcelem *), rc_cmpTime);
 
-        (void)ctl_rel(pq, 0);
-    }                                   /* control region locked */
+        tq_init(tq, pq->nalloc, pq->fbp,
+                ctl_ixFormats(pq->ctlp) & IX_TQRING, pq->tqfp != NULL);
+        /*
+         * The elements are added in order and then given their insertion-times,
+         * which are made unique, so the order of the time-index is kept.
+         */
+        for(size_t i = 0; i < nprods; i++) {
+                rcelem *const rcp = prods[i];
+                timestampt    tv;
 
-    pq_unlockIf(pq);
-    return status;
+                if(i > 0 && !TV_CMP_LT(prods[i-1]->tv, rcp->tv)) {
+                        rcp->tv = prods[i-1]->tv;
+                        timestamp_incr(&rcp->tv);
+                }
+                if(tq_add(tq, pq->tqfp, rcp->offset, rcp->feedtype, &tv)) {
+                        log_add("Couldn't add data-product at offset %ld to "
+                                "time-index", (long)rcp->offset);
+                        status = PQ_CORRUPT;
+                        break;
+                }
+                tqe_find(tq, &tv, TV_EQ)->tv = rcp->tv;
+        }
+        if(status == 0 && nprods > 0)
+                pq->ctlp->mostRecent = prods[nprods-1]->tv;
+        free(prods);
+        return status;
 }
 
-
 /*
- * Returns the number of pq_open()s for writing outstanding on an existing
- * product queue.  If a writing process terminates without calling pq_close(),
- * then the actual number will be less than this number.  This function opens
- * the product-queue read-only, so if there are no outstanding product-queue
- * writers, then the returned count will be zero.
+ * Rebuilds the signature-index from the retained data-products and their
+ * insertion-times, so the time-index must be consistent. Returns 0 or
+ * PQ_CORRUPT, in which case log_add() is called.
+ */
+static int
+rc_rebuildSigs(pqueue *const pq, const rcelem *const elems,
+        const size_t nelems)
+{
+        sx_init(pq->sxp, pq->nalloc, ctl_ixFormats(pq->ctlp) & IX_SXOPEN);
+        for(size_t i = 0; i < nelems; i++) {
+                if(!elems[i].keep || elems[i].kind == RC_CHUNK)
+                        continue;
+                sxelem *const sxep = sx_add(pq->sxp, elems[i].sig,
+                                elems[i].offset);
+
+                if(sxep == NULL) {
+                        log_add("Couldn't add signature of data-product at "
+                                "offset %ld", (long)elems[i].offset);
+                        return PQ_CORRUPT;
+                }
+                sxe_setTime(pq->sxp, sxep, &elems[i].tv);
+        }
+        return 0;
+}
+
+/* End rc */
+
+
+/**
+ * Recovers a product-queue after a writer terminated without closing it --
+ * instead of re-creating it. The data-products are found from the in-use
+ * regions of the region table, which are read and decoded by several threads.
+ * The region-list, time-index, signature-index, skip-list blocks, and the
+ * index of evicted signatures are then checked against them, and only those
+ * that are inconsistent are rebuilt. The data-products are kept, except for
+ * ones that were being inserted and, if the region-list is rebuilt, ones that
+ * can't be decoded. A data-product that a rebuilt time-index didn't reference
+ * is given its arrival-time as its insertion-time. Finally, the writer-counter
+ * is set to zero, so no other process may have the product-queue open for
+ * writing.
  *
- * Arguments:
- *      path    The pathname of the product-queue.
- *      count   The memory to receive the number of writers.
- * Returns:
- *      0           Success.  *count will be the number of writers.
- *      EINVAL      path is NULL or count is NULL.  *count untouched.
- *      ENOSYS      Function not supported because product-queue doesn't support
- *                  writer-counting.
- *      PQ_CORRUPT  The  product-queue is internally inconsistent.
- *      else        <errno.h> error-code.  *count untouched.
+ * @param[in]  path        Pathname of the product-queue.
+ * @param[in]  nthreads    Number of threads to decode the data-products with.
+ *                         0 means one per online processor. Small
+ *                         product-queues use fewer.
+ * @param[out] rebuilt     The indexes that were rebuilt: bitwise OR of
+ *                         PQ_RECOVER_* flags. May be NULL.
+ * @param[out] nprods      Number of data-products in the product-queue. May be
+ *                         NULL.
+ * @param[out] nfreed      Number of in-use regions that were freed because
+ *                         they didn't hold a data-product that could be kept.
+ *                         May be NULL.
+ * @retval     0           Success.
+ * @retval     EINVAL      `path` is NULL.
+ * @retval     PQ_CORRUPT  The product-queue couldn't be recovered and should
+ *                         be re-created. `log_add()` called.
+ * @return                 Other <errno.h> error-code. `log_add()` called.
  */
 int
-pq_get_write_count(
-    const char* const   path,
-    unsigned* const     count)
+pq_recover(
+        const char* const path,
+        const unsigned    nthreads,
+        unsigned* const   rebuilt,
+        size_t* const     nprods,
+        size_t* const     nfreed)
 {
-    int status;
+    pqueue* pq;
+    int     status;
 
-    if (NULL == path || NULL == count) {
-        status = EINVAL;
-    }
-    else {
-        pqueue* pq;
+    if (NULL == path)
+        return EINVAL;
 
-        status = pq_open(path, PQ_READONLY, &pq);
+    status = pq_open(path, PQ_DEFAULT, &pq);        /* open for writing */
+
+    if (!status) {
+        status = ctl_get(pq, RGN_WRITE);
 
         if (!status) {
-            /*
-             * Get the control-block.
-             */
-            status = ctl_get(pq, 0);            /* readonly */
+            const bool ring = ctl_ixFormats(pq->ctlp) & IX_TQRING;
+            bool       regionsOk = true;
+            bool       timesOk = true;
+            bool       sigsOk = true;
+            bool       evsigsOk = true;
+            unsigned   ixs = 0;
+            size_t     nelems;
+            size_t     nkept = 0;
+            size_t     nlost = 0;
+            unsigned   nused = 0;
+            rcelem*    elems = rc_candidates(pq, &nelems, &regionsOk);
+
+            if (elems == NULL && nelems) {
+                status = ENOMEM;
+            }
+            else {
+                nused = rc_scan(pq, elems, nelems, nthreads);
+                rc_claimChunks(pq, elems, nelems);
+                timesOk = rc_checkTimes(pq, elems, nelems);
+                status = rc_select(elems, nelems, &timesOk, &nkept, &nlost);
+            }
 
             if (!status) {
-                pqctl*  ctlp = pq->ctlp;
-
-                if (WRITE_COUNT_MAGIC != ctlp->write_count_magic) {
-                    status = ENOSYS;
+                regionsOk = regionsOk && rc_checkRegions(pq, elems, nelems);
+                if (regionsOk && (ring || timesOk))
+                    regionsOk = rc_checkFblks(pq, !ring);
+                if (!ring)
+                    regionsOk = timesOk = regionsOk && timesOk; // share fblks
+                sigsOk = rc_checkSigs(pq, elems, nelems, timesOk);
+                evsigsOk = pq->esp == NULL || rc_checkEvsigs(pq);
+                log_flush_notice();
+
+                if (!regionsOk) {
+                    fb_init(pq->fbp, pq->nalloc);
+                    status = rc_rebuildRegions(pq, elems, nelems);
+                    ixs |= PQ_RECOVER_REGIONS;
                 }
-                else {
-                    *count = pq->ctlp->write_count;
+                if (!status && !timesOk) {
+                    status = rc_rebuildTimes(pq, elems, nelems);
+                    ixs |= PQ_RECOVER_TIMES;
+                }
+                if (!status && !sigsOk) {
+                    status = rc_rebuildSigs(pq, elems, nelems);
+                    ixs |= PQ_RECOVER_SIGS;
+                }
+                if (!status && !evsigsOk) {
+                    es_init(pq->esp, pq->nalloc);
+                    ixs |= PQ_RECOVER_EVSIGS;
                 }
-                
-                (void)ctl_rel(pq, 0);
             }
 
-            (void)pq_close(pq);
+            if (!status) {
+                pq->ctlp->write_count = 1;      /* pq_close() will decrement */
+                log_info_q("Recovered product-queue \"%s\" with %u "
+                        "thread(s): %lu data-products kept, %lu regions "
+                        "freed, rebuilt:%s%s%s%s%s", path, nused,
+                        (unsigned long)nkept, (unsigned long)nlost,
+                        ixs ? "" : " nothing",
+                        (ixs & PQ_RECOVER_REGIONS) ? " region-list" : "",
+                        (ixs & PQ_RECOVER_TIMES) ? " time-index" : "",
+                        (ixs & PQ_RECOVER_SIGS) ? " signature-index" : "",
+                        (ixs & PQ_RECOVER_EVSIGS) ? " evicted-signatures" :
+                                "");
+                if (rebuilt)
+                    *rebuilt = ixs;
+                if (nprods)
+                    *nprods = nkept;
+                if (nfreed)
+                    *nfreed = nlost;
+            }
+
+            for (size_t i = 0; i < nelems && elems; i++)
+                free(elems[i].map);
+            free(elems);
+            (void)ctl_rel(pq, RGN_MODIFIED);
         }
+
+        (void)pq_close(pq);
     }
 
     return status;
 }
 
+/* Begin gr */
 
 /*
- * Sets to zero the number of pq_open()s for writing outstanding on the
- * product-queue.  This is a dangerous function and should only be used when
- * it is known that there are no outstanding pq_open()s for writing on the
- * product-queue.
+ * Growing a product-queue in place (see `pq_grow()`). The data-products stay
+ * where they are. New indexes for the new capacity are built after the end of
+ * the grown data section from the current ones -- by the functions that rebuild
+ * them during recovery -- and the control-region is then changed to refer to
+ * them. The old index region becomes free space for data-products. Other
+ * processes notice the change the next time they lock the control-region and
+ * adopt the new geometry (see `ctl_regeometry()`).
+ */
+
+/*
+ * Returns the in-use regions of a product-queue whose indexes are consistent
+ * as retained candidates for the rebuild functions, sorted by offset. Those of
+ * the time-index are data-products with their insertion-times and feedtypes.
+ * The others -- the chunks of chunked data-products and the regions of
+ * insertions in progress -- are retained only as in-use regions. Returns 0,
+ * ENOMEM, or PQ_CORRUPT, in which case log_add() is called.
+ */
+static int
+gr_elems(const pqueue *const pq, rcelem **const elemsp, size_t *const nelemsp)
+{
+        bool    consistent = true;
+        size_t  nelems;
+        rcelem *elems = rc_candidates(pq, &nelems, &consistent);
+
+        if(elems == NULL && nelems)
+                return ENOMEM;
+        if(!consistent) {
+                free(elems);
+                return PQ_CORRUPT;
+        }
+        for(size_t i = 0; i < nelems; i++) {
+                elems[i].kind = RC_CHUNK;
+                elems[i].keep = true;
+        }
+        for(const tqelem *tqep = tqe_first(pq->tqp);
+                        tqep != NULL && tqep->offset != OFF_NONE;
+                        tqep = tq_next(pq->tqp, tqep)) {
+                rcelem *const rcp = rc_find(elems, nelems, tqep->offset);
+
+                if(rcp == NULL || rcp->intq) {
+                        log_add("Time-index element refers to offset %ld, "
+                                "which isn't an in-use region",
+                                (long)tqep->offset);
+                        free(elems);
+                        return PQ_CORRUPT;
+                }
+                rcp->kind = RC_PRODUCT;
+                rcp->intq = true;
+                rcp->tv = tqep->tv;
+                rcp->feedtype = TQ_FEED(pq->tqp, pq->tqfp, tqep);
+        }
+        *elemsp = elems;
+        *nelemsp = nelems;
+        return 0;
+}
+
+/*
+ * Builds the indexes of a grown product-queue in a new index region from its
+ * current indexes. The current indexes and the control-region aren't modified
+ * (except for the time of the most recent insertion, which is rewritten). The
+ * control-region must be held for writing.
  *
- * Arguments:
- *      path    The pathname of the product-queue.
- * Returns:
- *      0           Success.
- *      EINVAL      path is NULL.
- *      PQ_CORRUPT  The  product-queue is internally inconsistent.
- *      else        <errno.h> error-code.
+ * Returns 0, ENOMEM, or PQ_CORRUPT, in which case log_add() is called.
+ */
+static int
+gr_build(pqueue *const pq, void *const ixp, const off_t ixo,
+        const size_t ixsz, const size_t nalloc)
+{
+        const unsigned    formats = ctl_ixFormats(pq->ctlp);
+        regionl *const    orlp = pq->rlp;
+        tqueue *const     otqp = pq->tqp;
+        feedtypet *const  otqfp = pq->tqfp;
+        fb *const         ofbp = pq->fbp;
+        sx *const         osxp = pq->sxp;
+        es *const         oesp = pq->esp;
+        cl *const         oclp = pq->clp;
+        const off_t       oixo = pq->ixo;
+        const size_t      onalloc = pq->nalloc;
+        rcelem           *elems = NULL;
+        size_t            nelems = 0;
+        int               status = gr_elems(pq, &elems, &nelems);
+
+        if(status)
+                return status;
+
+        if(!ix_ptrs(ixp, ixsz, nalloc, pq->ctlp->align, formats, &pq->rlp,
+                        &pq->tqp, &pq->fbp, &pq->sxp, &pq->esp, &pq->clp)) {
+                log_add("New index region is too small");
+                status = PQ_CORRUPT;
+        }
+        else {
+                pq->tqfp = ix_tqFeeds(pq->tqp, formats);
+                pq->ixo = ixo;
+                pq->nalloc = nalloc;
+
+                fb_init(pq->fbp, nalloc);
+                status = rc_rebuildRegions(pq, elems, nelems);
+                if(!status) {
+                        if(pq->rlp->maxelems < orlp->maxelems)
+                                pq->rlp->maxelems = orlp->maxelems;
+                        if(pq->rlp->maxbytes < orlp->maxbytes)
+                                pq->rlp->maxbytes = orlp->maxbytes;
+                        status = rc_rebuildTimes(pq, elems, nelems);
+                }
+                if(!status) {
+                        sx_init(pq->sxp, nalloc, formats & IX_SXOPEN);
+                        if(sx_copy(pq->sxp, osxp)) {
+                                log_add("Couldn't copy signature-index");
+                                status = PQ_CORRUPT;
+                        }
+                }
+                if(!status && pq->esp) {
+                        es_init(pq->esp, nalloc);
+                        es_copy(pq->esp, oesp);
+                }
+        }
+
+        pq->rlp = orlp;
+        pq->tqp = otqp;
+        pq->tqfp = otqfp;
+        pq->fbp = ofbp;
+        pq->sxp = osxp;
+        pq->esp = oesp;
+        pq->clp = oclp;
+        pq->ixo = oixo;
+        pq->nalloc = onalloc;
+        free(elems);
+        return status;
+}
+
+/* End gr */
+
+
+/**
+ * Grows a product-queue in place while it's in use: its file is extended, new
+ * indexes for the new capacity are built after the new end of its data
+ * section, and its control-region is changed to refer to them. The data-products
+ * aren't moved or copied, and the old index region becomes free space.
+ * Processes that have the product-queue open notice the change the next time
+ * they access it and extend their memory-mapping of it; a process that
+ * memory-maps the product-queue as a whole can do that only within the
+ * address-space that it reserved when it opened the product-queue (four times
+ * its size but at least 64 GiB on 64-bit systems) and must otherwise reopen it.
+ * The control-region is locked for writing only while the new indexes are
+ * built, not while the file is extended.
+ *
+ * @param[in] path       Pathname of the product-queue.
+ * @param[in] pflags     Bitwise OR of
+ *                         - PQ_SPARSE  Extend the file sparsely rather than
+ *                                      by writing zeros
+ * @param[in] size       New size of the data section of the product-queue in
+ *                       bytes. Must be greater than the current size and is
+ *                       made at least as great as the current size plus that
+ *                       of the current index region.
+ * @param[in] nproducts  New capacity of the product-queue in data-products.
+ *                       Must not be less than the current capacity. 0 means
+ *                       to grow the capacity in proportion to `size`.
+ * @retval    0          Success.
+ * @retval    EINVAL     `path` is NULL, or `size` or `nproducts` is too small.
+ *                       `log_add()` called for the latter.
+ * @retval    EAGAIN     Another process grew the product-queue concurrently.
+ *                       `log_add()` called.
+ * @retval    ENOTSUP    The product-queue can't be memory-mapped on this
+ *                       system. `log_add()` called.
+ * @retval    PQ_CORRUPT The product-queue is inconsistent. Recover it (see
+ *                       `pq_recover()`). `log_add()` called.
+ * @return               Other <errno.h> error-code.
  */
 int
-pq_clear_write_count(const char* const path)
+pq_grow(
+        const char* const path,
+        const int         pflags,
+        const off_t       size,
+        const size_t      nproducts)
 {
-    int status;
+    if (NULL == path)
+        return EINVAL;
 
-    if (NULL == path) {
+#ifndef HAVE_MMAP
+    log_add("Growing product-queue \"%s\" requires memory-mapping", path);
+    return ENOTSUP;
+#else
+    pqueue* pq;
+    int     status = pq_open(path, PQ_DEFAULT, &pq); /* open for writing */
+
+    if (status)
+        return status;
+
+    const off_t  oixo = pq->ixo;
+    const size_t oixsz = pq->ixsz;
+    const size_t onalloc = pq->nalloc;
+    const off_t  odatasz = oixo - pq->datao;
+    const off_t  datasz = _RNDUP(size, (off_t)pq->pagesz);
+    off_t        ixo = pq->datao + datasz;
+    size_t       ixsz = 0;
+    size_t       nalloc = nproducts ? nproducts
+            : (size_t)((double)onalloc * datasz / odatasz);
+
+    if (size <= odatasz) {
+        log_add("New size of the data section of product-queue \"%s\" (%ld "
+                "bytes) isn't greater than the current one (%ld bytes)", path,
+                (long)size, (long)odatasz);
+        status = EINVAL;
+    }
+    else if (nalloc < onalloc) {
+        log_add("New capacity of product-queue \"%s\" (%lu data-products) is "
+                "less than the current one (%lu)", path,
+                (unsigned long)nalloc, (unsigned long)onalloc);
         status = EINVAL;
     }
     else {
-        pqueue* pq;
+        /* The old indexes must survive until the new ones are built */
+        if (ixo < oixo + (off_t)oixsz)
+            ixo = oixo + (off_t)oixsz;
 
-        status = pq_open(path, 0, &pq);         /* open for writing */
+        status = ctl_get(pq, 0);
+        if (!status) {
+            ixsz = _RNDUP(ix_sz(nalloc, pq->ctlp->align,
+                    ctl_ixFormats(pq->ctlp)), pq->pagesz);
+            (void)ctl_rel(pq, 0);
+            /* Done without locking because it can take a while */
+            status = fgrow(pq->fd, ixo + (off_t)ixsz,
+                    fIsSet(pflags, PQ_SPARSE));
+            if (status)
+                log_add_errno(status, "Couldn't extend product-queue \"%s\" "
+                        "to %ld bytes", path, (long)(ixo + ixsz));
+        }
+    }
+
+    if (!status) {
+        status = ctl_get(pq, RGN_WRITE);
 
         if (!status) {
-            status = ctl_get(pq, RGN_WRITE);
+            void* ixp = NULL;
 
-            if (!status) {
-                int    rflags = 0;              /* control-block unmodified */
-                pqctl* ctlp = pq->ctlp;
+            if (pq->ixo != oixo || pq->nalloc != onalloc) {
+                log_add("Product-queue \"%s\" was grown by another process",
+                        path);
+                status = EAGAIN;
+            }
+            else {
+                status = mapwrap(pq->fd, ixo, ixsz, PROT_READ|PROT_WRITE,
+                        MAP_SHARED, &ixp);
+            }
 
-                if (ctlp->write_count != 1) {
-                    ctlp->write_count = 1;      /* pq_close() will decrement */
-                    rflags = RGN_MODIFIED;      /* control-block modified */
+            if (!status) {
+                status = gr_build(pq, ixp, ixo, ixsz, nalloc);
+                /* The new indexes must be durable before they're referenced */
+                if (!status && msync(ixp, ixsz, MS_SYNC)) {
+                    status = errno;
+                    log_add_syserr("Couldn't write new indexes of "
+                            "product-queue \"%s\"", path);
                 }
-
-                ctl_rel(pq, rflags);
+                if (!status) {
+                    pq->ctlp->ixo = ixo;
+                    pq->ctlp->ixsz = ixsz;
+                    pq->ctlp->nalloc = nalloc;
+                    pq->ctlp->isFull = 0;
+                    log_notice_q("Grew product-queue \"%s\" from %ld to %ld "
+                            "data bytes and from %lu to %lu slots", path,
+                            (long)odatasz, (long)(ixo - pq->datao),
+                            (unsigned long)onalloc, (unsigned long)nalloc);
+                }
+                (void)unmapwrap(ixp, ixo, ixsz, 0);
             }
 
-            (void)pq_close(pq);
+            (void)ctl_rel(pq, status ? 0 : RGN_MODIFIED);
         }
     }
 
+    (void)pq_close(pq);
+
     return status;
+#endif
 }
 
 
@@ -6958,6 +13779,7 @@ pq_cset(pqueue *pq, const timestampt *tvp)
         } else if (tvEqual(*tvp, TS_ZERO)) {
             pq->cursor_offset = 0;
         }
+        cons_publish(pq);
     pq_unlockIf(pq);
 }
 
@@ -7144,12 +13966,12 @@ pq_getMetadataFromOffset(
     else {
         void*                   vp;
         const region* const     rp = rlp->rp + rlix;
-        const size_t            extent = Extent(rp);
+        size_t                  extent = Extent(rp);
 
         /*
          * Lock the data-product's data-region.
          */
-        status = rgn_get(pq, offset, extent, 0, &vp);
+        status = rgn_get(pq, offset, &extent, 0, &vp);
 
         if (0 != status) {
             log_syserr_q("Couldn't lock data-product's "
@@ -7198,8 +14020,10 @@ pq_findTimeEntryBySignature(
         const signaturet        sig,
         tqelem** const restrict tqepp)
 {
-    int     status;
-    sxelem* signatureEntry;
+    int        status;
+    sxelem*    signatureEntry;
+    timestampt insertTime;
+    tqelem*    linkedEntry;
 
     /*
      * Get the relevant entry in the signature-map.
@@ -7207,6 +14031,15 @@ pq_findTimeEntryBySignature(
     if (!sx_find(pq->sxp, sig, &signatureEntry)) {
         status = PQ_NOTFOUND;
     }
+    else if (sxe_getTime(pq->sxp, signatureEntry, &insertTime) &&
+            (linkedEntry = tqe_find(pq->tqp, &insertTime, TV_EQ)) != NULL &&
+            linkedEntry->offset == signatureEntry->offset) {
+        /*
+         * The signature-entry knows the insertion-time of the data-product.
+         */
+        *tqepp = linkedEntry;
+        status = 0;
+    }
     else {
         InfoBuf     infoBuf;
         // Necessary for `getMetadataFromOffset()`
@@ -7257,8 +14090,6 @@ pq_findTimeEntryBySignature(
                  * find the matching entry.
                  */
                 const tqelem*       initialTimeEntry = timeEntry;
-                const fb* const     fbp =
-                    (fb*)((char*)pq->tqp + pq->tqp->fbp_off);
 
                 for (;;) {
                     if (OFF_NONE == timeEntry->offset) {
@@ -7282,7 +14113,7 @@ pq_findTimeEntryBySignature(
                    /*
                     * Advance to the very next entry in the time-map.
                     */
-                    timeEntry = &pq->tqp->tqep[fbp->fblks[timeEntry->fblk]];
+                    timeEntry = tq_next(pq->tqp, timeEntry);
                 }                   /* time-map entry loop */
 
                 if (status == PQ_NOTFOUND) {
@@ -7317,7 +14148,7 @@ pq_findTimeEntryBySignature(
                        /*
                         * Advance to the very next entry in the time-map.
                         */
-                        timeEntry = &pq->tqp->tqep[fbp->fblks[timeEntry->fblk]];
+                        timeEntry = tq_next(pq->tqp, timeEntry);
                     }               /* time-map entry loop */
                 }                   /* product not where it should be */
             }                       /* non-empty product-queue */
@@ -7495,9 +14326,9 @@ pq_processProduct(
                  */
                 void*               vp;
                 const region* const rp = rlp->rp + rlix;
-                const size_t        extent = Extent(rp);
+                size_t              extent = Extent(rp);
 
-                if (rgn_get(pq, offset, extent, 0, &vp)) {
+                if (rgn_get(pq, offset, &extent, 0, &vp)) {
                     log_add("Couldn't lock data-product's data-region");
                     status = PQ_SYSTEM;
                 }
@@ -7563,12 +14394,308 @@ pq_processProduct(
             (void)ctl_rel(pq, 0);
     }                                   // control region locked
 
-    if (instanceLocked)
-        pq_unlockIf(pq);
+    if (instanceLocked)
+        pq_unlockIf(pq);
+
+    return status;
+}
+
+
+/*
+ * Number of times that pq_sequenceHelper() tries to find a data-product
+ * without locking the control-region before it locks it.
+ */
+#define SEQ_OPTIMISTIC_TRIES 3
+
+/*
+ * Maximum number of data-products that a reader steps over by their feedtype
+ * in the time-index (see PQ_TQFEED) in one call.
+ */
+#define SEQ_SKIP_MAX    1024
+
+/*
+ * Returns the union of the feedtypes of a class of data-products, against
+ * which the feedtypes recorded in the time-index are tested, or ANY if the
+ * class doesn't restrict them.
+ */
+static feedtypet
+seq_feedMask(const prod_class_t* const clss)
+{
+    return (clss == NULL || clss == PQ_CLASS_ALL)
+            ? ANY
+            : clss_feedtypeU(clss);
+}
+
+/*
+ * Indicates whether a data-product can be stepped over without being read
+ * because its feedtype, `feed`, isn't in the feedtype-union, `mask`, of the
+ * reader's class.
+ */
+#define SEQ_SKIP(mask, feed)    ((mask) != ANY && !((feed) & (mask)))
+
+/**
+ * Finds the data-product that pq_sequenceHelper() would find but without
+ * locking the control-region: the indexes are read while the generation-
+ * counter of the control-region is even and unchanged (i.e., no writer
+ * intervened). Only the data-region of the data-product is locked. Requires
+ * that the entire product-queue be memory-mapped and shared.
+ *
+ * If the time-index records feedtypes, then products whose feedtype isn't in
+ * `mask` are stepped over (up to SEQ_SKIP_MAX of them); if no product is
+ * found after that, then the last one stepped over is returned unpinned.
+ *
+ * @param[in,out] pq          Product-queue.
+ * @param[in]     mt          Direction from the cursor.
+ * @param[in]     mask        Feedtype-union of the reader's class or ANY.
+ * @param[in]     pin         Whether to lock the data-region of the product.
+ * @param[out]    tvp         Insertion-time of the product.
+ * @param[out]    offp        Offset of the product's data-region.
+ * @param[out]    extp        Extent of the product's data-region. Set only if
+ *                            `pin` is true and `*skipp` is false.
+ * @param[out]    vpp         The product's data-region. Set only if `pin` is
+ *                            true and `*skipp` is false.
+ * @param[out]    skipp       Whether the product was stepped over.
+ * @retval        0           Success. The output arguments are set.
+ * @retval        PQUEUE_END  No such product.
+ * @retval        EAGAIN      A writer intervened. Try again.
+ * @retval        ENOTSUP     Not possible. Lock the control-region instead.
+ */
+static int
+seq_findOptimistic(
+        pqueue* const     pq,
+        const pq_match    mt,
+        const feedtypet   mask,
+        const bool        pin,
+        timestampt* const tvp,
+        off_t* const      offp,
+        size_t* const     extp,
+        void** const      vpp,
+        bool* const       skipp)
+{
+#ifndef HAVE_MMAP
+    return ENOTSUP;
+#else
+    pqctl* const ctlp = (pqctl*)pq->base;
+    regionl*     rlp;
+    tqueue*      tqp;
+    fb*          fbp;
+    sx*          sxp;
+    es*          esp;
+    cl*          clp;
+    feedtypet*   feeds;
+    feedtypet    feed;
+    timestampt   key;
+    uint32_t     gen;
+    uint32_t     seq;
+    int          status;
+
+    if (pq->ftom != mm0_ftom || ctlp == NULL ||
+            fIsSet(pq->pflags, PQ_PRIVATE) ||
+            ctlp->write_gen_magic != WRITE_GEN_MAGIC)
+        return ENOTSUP;
+
+    gen = __atomic_load_n(&ctlp->write_gen, __ATOMIC_ACQUIRE);
+    if (gen & 1)
+        return EAGAIN;
+    if (ctlp->ixo != pq->ixo || ctlp->ixsz != pq->ixsz ||
+            ctlp->nalloc != pq->nalloc)
+        return ENOTSUP; // The product-queue grew. Locking will remap it.
+    seq = __atomic_load_n(&ctlp->insert_seq, __ATOMIC_RELAXED);
+
+    if (!ix_ptrs((char*)pq->base + pq->ixo, pq->ixsz, pq->nalloc, ctlp->align,
+            ctl_ixFormats(ctlp), &rlp, &tqp, &fbp, &sxp, &esp, &clp))
+        return ENOTSUP;
+
+    feeds = ix_tqFeeds(tqp, ctl_ixFormats(ctlp));
+    status = tqe_findOptimistic(tqp, feeds, &pq->cursor, mt, tvp, offp,
+            &feed);
+    for (size_t nskipped = 0; status == 0 && SEQ_SKIP(mask, feed) &&
+            mt != TV_EQ && ++nskipped < SEQ_SKIP_MAX; ) {
+        const off_t offset = *offp;
+
+        key = *tvp;
+        status = tqe_findOptimistic(tqp, feeds, &key, mt, tvp, offp, &feed);
+        if (status == PQUEUE_END) {
+            /* Return the last product stepped over */
+            *tvp = key;
+            *offp = offset;
+            status = 0;
+            break;
+        }
+    }
+    *skipp = status == 0 && SEQ_SKIP(mask, feed);
+    if (status == 0 && pin && !*skipp) {
+        status = rl_findOptimistic(rlp, *offp, extp);
+        if (status == 0 && (*offp < pq->datao ||
+                *offp + (off_t)*extp > pq->ixo))
+            status = EAGAIN;
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&ctlp->write_gen, __ATOMIC_RELAXED) != gen)
+        return EAGAIN;
+    if (status == EAGAIN || status == EINVAL)
+        return ENOTSUP; // Inconsistent without a writer. Let locking decide.
+
+    if (status == 0 && pin && !*skipp) {
+        if (rgn_get(pq, *offp, extp, RGN_UNLOCKED, vpp)) {
+            log_clear();
+            return ENOTSUP;
+        }
+        /* The product might have been deleted before its region was locked */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&ctlp->write_gen, __ATOMIC_RELAXED) != gen) {
+            (void)rgn_rel(pq, *offp, 0);
+            return EAGAIN;
+        }
+    }
+
+    /* for pq_wait(): no insertion after this can be missed */
+    pq->seen_seq = seq;
+
+    return status;
+#endif
+}
+
+/* Begin pf */
+
+/**
+ * Advises the O/S about the pages of a region of the product-queue file. The
+ * pages that the region touches are read ahead if the region will be needed;
+ * otherwise, only the pages that the region covers are marked as reclaimable
+ * because adjacent regions might share a page.
+ *
+ * @param[in] pq      The product-queue.
+ * @param[in] offset  Offset of the region in the file.
+ * @param[in] extent  Extent of the region in bytes.
+ * @param[in] need    Whether the region will be needed soon.
+ * @retval    0       No advice was given.
+ * @return            Number of bytes about which advice was given.
+ */
+static size_t
+pf_advise(
+        const pqueue* const pq,
+        const off_t         offset,
+        const size_t        extent,
+        const bool          need)
+{
+    const off_t pagesz = (off_t)pq->pagesz;
+    const off_t end = offset + (off_t)extent;
+    const off_t first = need ? offset - offset % pagesz : _RNDUP(offset, pagesz);
+    const off_t last = need ? _RNDUP(end, pagesz) : end - end % pagesz;
+
+    if (first >= last)
+        return 0;
+
+#ifdef HAVE_MMAP
+    if (pq->base != NULL) {
+        /*
+         * Discarding the pages of a private mapping would discard its
+         * modifications.
+         */
+        if (!need && fIsSet(pq->pflags, PQ_PRIVATE))
+            return 0;
+#   ifdef MADV_COLD
+        const int advice = need ? MADV_WILLNEED : MADV_COLD;
+#   else
+        const int advice = need ? MADV_WILLNEED : MADV_DONTNEED;
+#   endif
+        return madvise((char*)pq->base + first, last - first, advice)
+                ? 0
+                : last - first;
+    }
+#endif
+#ifdef POSIX_FADV_WILLNEED
+    /*
+     * The file isn't mapped as a whole: read the region into the page-cache.
+     * Its pages aren't dropped from the cache when it's no longer needed
+     * because other processes might be sequencing the product-queue.
+     */
+    if (need)
+        return posix_fadvise(pq->fd, first, last - first, POSIX_FADV_WILLNEED)
+                ? 0
+                : last - first;
+#endif
+    return 0;
+}
+
+/**
+ * Prefetches the regions of the data-products that follow the cursor of a
+ * product-queue and that haven't already been prefetched. Does nothing if the
+ * cursor hasn't reached the middle of the data-products prefetched last time
+ * or if that prefetch reached the end of the product-queue and fewer than half
+ * as many data-products have been inserted since then: recently inserted
+ * data-products are likely to still be in memory. Locks and releases the
+ * control-region otherwise.
+ *
+ * @param[in,out] pq    The product-queue. `pq->pf_count` must be positive.
+ * @param[in]     mask  Union of the feedtypes of interest. Data-products of
+ *                      other feedtypes aren't prefetched.
+ */
+static void
+pf_fill(
+        pqueue* const   pq,
+        const feedtypet mask)
+{
+    if (tvCmp(pq->cursor, pq->pf_mid, <) || (pq->pf_tail &&
+                pq->seen_seq - pq->pf_seq < (pq->pf_count+1)/2) ||
+            ctl_get(pq, 0))
+        return;
+
+    unsigned n = 0;
+    tqelem*  tqep = tqe_find(pq->tqp, &pq->cursor, TV_GT);
+
+    pq->pf_seq = pq->ctlp->insert_seq;
+    pq->pf_mid = pq->cursor;
+
+    for (; n < pq->pf_count && tqep && tqep->offset != OFF_NONE;
+            tqep = tq_next(pq->tqp, tqep)) {
+        if (n++ <= pq->pf_count/2)
+            pq->pf_mid = tqep->tv;
+
+        if (!tvCmp(tqep->tv, pq->pf_last, >) ||
+                SEQ_SKIP(mask, TQ_FEED(pq->tqp, pq->tqfp, tqep)))
+            continue;
+
+        const size_t rlix = rl_find(pq->rlp, tqep->offset);
+
+        if (rlix != RL_NONE) {
+            const size_t nbytes = pf_advise(pq, tqep->offset,
+                    Extent(pq->rlp->rp + rlix), true);
+
+            if (nbytes) {
+                pq->pf_prods++;
+                pq->pf_bytes += nbytes;
+            }
+        }
+        pq->pf_last = tqep->tv;
+    }
+
+    pq->pf_tail = n < pq->pf_count;
+    (void)ctl_rel(pq, 0);
+}
+
+/**
+ * Marks the pages of the region of a sequenced data-product as reclaimable.
+ *
+ * @param[in,out] pq      The product-queue.
+ * @param[in]     offset  Offset of the region, which must be in use.
+ */
+static void
+pf_cool(
+        pqueue* const pq,
+        const off_t   offset)
+{
+    riu* rp;
 
-    return status;
+    /* The region of a chunked data-product isn't contiguous */
+    if (riul_r_find(pq->riulp, offset, &rp) && rp->ckhead == NULL &&
+            pf_advise(pq, offset, rp->zphead ? rp->zpextent : rp->extent,
+                false))
+        pq->pf_colds++;
 }
 
+/* End pf */
 
 /**
  * Step thru the time sorted inventory according to 'mt',
@@ -7668,6 +14795,7 @@ pq_sequenceHelper(pqueue *pq, pq_match mt,
     void *datap;
     XDR xdrs;
     timestampt pq_time;
+    const feedtypet mask = ifMatch == NULL ? ANY : seq_feedMask(clss);
 
     if(pq == NULL)
             return EINVAL;
@@ -7691,11 +14819,44 @@ pq_sequenceHelper(pqueue *pq, pq_match mt,
                 }
         }
 
+        if(pq->pf_count && mt == TV_GT)
+                pf_fill(pq, mask);
+
+        /* Try without locking the control-region */
+        {
+                const bool pin = clss != NULL && ifMatch != NULL;
+                int        try = 0;
+                bool       skipped;
+
+                do {
+                        status = seq_findOptimistic(pq, mt, mask, pin,
+                                        &pq_time, &offset, &extent, &vp,
+                                        &skipped);
+                } while(status == EAGAIN && ++try < SEQ_OPTIMISTIC_TRIES);
+
+                if(status == PQUEUE_END)
+                        goto unwind_lock;
+                if(status == ENOERR)
+                {
+                        pq_cset(pq, &pq_time);
+                        pq_coffset(pq, offset);
+                        if(!pin || skipped)
+                        {
+                                log_debug(skipped ? "Skipped" : "NOOP");
+                                goto unwind_lock;
+                        }
+                        goto have_region;
+                }
+                /* else a writer intervened or it's not possible */
+        }
+
         /* Read lock pq->xctl.  */
         status = ctl_get(pq, 0);
         if(status != ENOERR) {
             goto unwind_lock;
         }
+        /* for pq_wait(): no insertion after this can be missed */
+        pq->seen_seq = pq->ctlp->insert_seq;
 
         /* find the specified queue element */
         tqep = tqe_find(pq->tqp, &pq->cursor, mt);
@@ -7709,6 +14870,19 @@ pq_sequenceHelper(pqueue *pq, pq_match mt,
         pq_cset(pq, &tqep->tv);
         pq_coffset(pq, tqep->offset);
 
+        /* step over products that can't be in the class */
+        for(size_t nskipped = 0;
+                SEQ_SKIP(mask, TQ_FEED(pq->tqp, pq->tqfp, tqep)); )
+        {
+                if(mt == TV_EQ || ++nskipped >= SEQ_SKIP_MAX)
+                        goto unwind_ctl;
+                tqep = tqe_find(pq->tqp, &pq->cursor, mt);
+                if(tqep == NULL)
+                        goto unwind_ctl; /* status is ENOERR */
+                pq_cset(pq, &tqep->tv);
+                pq_coffset(pq, tqep->offset);
+        }
+
         /*
          * Spec'ing clss NULL or ifMatch NULL
          * _just_ sequences cursor.
@@ -7741,14 +14915,14 @@ pq_sequenceHelper(pqueue *pq, pq_match mt,
                 status = ENOERR;
                 goto unwind_ctl;
         }
-        status = rgn_get(pq, rp->offset, Extent(rp), 0, &vp);
+        extent = Extent(rp);
+        status = rgn_get(pq, rp->offset, &extent, 0, &vp);
         if(status != ENOERR)
         {
                 goto unwind_ctl;
         }
         log_assert(vp != NULL);
         offset = rp->offset;
-        extent = Extent(rp);
 
         // Delay to process product, useful to see if it's falling behind
         if(log_is_enabled_debug) {
@@ -7764,6 +14938,8 @@ pq_sequenceHelper(pqueue *pq, pq_match mt,
         status = ctl_rel(pq, 0);
         log_assert(status == 0);
 
+have_region:
+    cons_publish(pq);
     pq_unlockIf(pq);
 
     /*
@@ -7834,6 +15010,8 @@ pq_sequenceHelper(pqueue *pq, pq_match mt,
     /*FALLTHROUGH*/
     unwind_rgn:
             xdr_destroy(&xdrs);
+            if (pq->pf_count && mt == TV_GT && off == NULL && status == 0)
+                pf_cool(pq, offset);
             if (off == NULL)
                 (void) rgn_rel(pq, offset, 0); // release the data segment
 
@@ -7844,6 +15022,7 @@ pq_sequenceHelper(pqueue *pq, pq_match mt,
         /*FALLTHROUGH*/
 
 unwind_lock:
+    cons_publish(pq);
     pq_unlockIf(pq);
 
     return status;
@@ -8014,6 +15193,100 @@ pq_sequenceLock(
     return pq_sequenceHelper(pq, mt, clss, ifMatch, otherargs, offset);
 }
 
+/**
+ * Decodes the metadata of a locked data-product and, if the data-product
+ * matches, passes it to a function.
+ *
+ * @param[in]     clss       Product matching criteria
+ * @param[in]     func       Function to call for a matching product
+ * @param[in,out] app_par    Application-supplied parameters or `NULL`
+ * @param[in]     queue_par  Product-queue parameters of the data-product
+ * @param[in]     encoded    The locked, XDR-encoded data-product
+ * @param[in]     size       Size of `encoded` in bytes
+ * @retval        0          Success
+ * @retval        PQ_SYSTEM  The metadata couldn't be decoded.
+ *                           `log_error_q()` called.
+ */
+static int
+next_apply(
+        const prod_class_t* const restrict clss,
+        pq_next_func* const                func,
+        void* const restrict               app_par,
+        queue_par_t* const restrict        queue_par,
+        void* const restrict               encoded,
+        const size_t                       size)
+{
+    int status = 0;
+    // Following avoids calls to malloc() in XDR module
+    char ident[KEYSIZE + 1];
+    char origin[HOSTNAMESIZE + 1];
+    prod_par_t prod_par = {
+            .info.ident = ident,
+            .info.origin = origin,
+            .encoded = encoded,
+            .size = size
+    };
+
+    /*
+     * If appropriate, log delay since product insertion to indicate if
+     * processing is falling behind.
+     */
+    if (log_is_enabled_debug) {
+        timestampt now;
+        if (gettimeofday(&now, 0) == 0) {
+            double delay = d_diff_timestamp(&now, &queue_par->inserted);
+            log_debug("Delay: %.4f sec", delay);
+        }
+    }
+
+    // Decode data-product metadata
+    XDR xdrs;
+    xdrmem_create(&xdrs, prod_par.encoded, (u_int)prod_par.size, XDR_DECODE) ;
+    if (!xdr_prod_info(&xdrs, &prod_par.info)) {
+        log_error_q("xdr_prod_info() failed") ;
+        status = PQ_SYSTEM;
+    }
+    else {
+        log_assert(prod_par.info.sz <= xdrs.x_handy);
+
+        #if PQ_SEQ_TRACE
+            log_debug("%s %u", s_prod_info(NULL, 0, &prod_par.info, 1),
+                    xdrs.x_handy) ;
+        #endif
+
+        /*
+         * If appropriate, log time-interval from product-creation to
+         * queue-insertion.
+         */
+        if (log_is_enabled_debug) {
+            double latency = d_diff_timestamp(&queue_par->inserted,
+                    &prod_par.info.arrival);
+            log_debug("time(insert)-time(create): %.4f s", latency);
+        }
+
+        // If appropriate, apply caller-supplied function.
+        if (clss == PQ_CLASS_ALL || prodInClass(clss, &prod_par.info)) {
+            log_assert(func != NULL);
+            {
+                // Change extent into xlen_product */
+                const size_t xsz = _RNDUP(prod_par.info.sz, 4);
+                if (xdrs.x_handy > xsz)
+                    prod_par.size -= (xdrs.x_handy - xsz);
+            }
+            // Copying data is avoided by using existing buffer.
+            prod_par.data = xdrs.x_private;
+            /*
+             * Product-queue is unlocked because calling a foreign function
+             * with an acquired lock can result in deadlock:
+             */
+            func(&prod_par, queue_par, app_par);
+        } // Product matches
+    } // xdr_prod_info() succeeded
+    xdr_destroy(&xdrs);
+
+    return status;
+}
+
 /**
  * Step thru the time-sorted inventory from the current time-cursor.
  *
@@ -8065,6 +15338,9 @@ pq_next(
         else {
             bool ctl_locked = true;
 
+            // For `pq_wait()`: no insertion after this can be missed
+            pq->seen_seq = pq->ctlp->insert_seq;
+
             queue_par_t queue_par;
             queue_par.is_full = pq->ctlp->isFull;
 
@@ -8074,6 +15350,13 @@ pq_next(
             if (tqep == NULL) {
                 status = PQUEUE_END;
             }
+            else if (SEQ_SKIP(seq_feedMask(clss),
+                    TQ_FEED(pq->tqp, pq->tqfp, tqep))) {
+                // Can't be in the class. Step over it without reading it.
+                pq_cset(pq, &tqep->tv);
+                pq_coffset(pq, tqep->offset);
+                status = 0;
+            }
             else {
                 // Update product-queue time-cursor
                 pq_cset(pq, &tqep->tv);
@@ -8100,103 +15383,32 @@ pq_next(
                     status = 0;
                 }
                 else {
-                    // Following avoids calls to malloc() in XDR module
-                    char ident[KEYSIZE + 1];
-                    char origin[HOSTNAMESIZE + 1];
-                    prod_par_t prod_par = {
-                            .info.ident = ident,
-                            .info.origin = origin,
-                            .size = Extent(rp)
-                    };
+                    void*  encoded;
+                    size_t size = Extent(rp);
                     // Lock region in product-queue that contains product
-                    status = rgn_get(pq, rp->offset, prod_par.size, 0,
-                            &prod_par.encoded);
+                    status = rgn_get(pq, rp->offset, &size, 0, &encoded);
                     if (status) {
                         log_add_errno(status, "Couldn't get product region");
                         status = PQ_SYSTEM;
                     }
                     else {
-                        log_assert(prod_par.encoded != NULL);
+                        log_assert(encoded != NULL);
+                        queue_par.offset = rp->offset;
 
                         /*
                          * Because data-product is locked, control-header can
                          * be released so that another process can access
-                         * product-queue. NB: This makes `tqep` invalid.
+                         * product-queue. NB: This makes `tqep` and `rp`
+                         * invalid.
                          */
                         status = ctl_rel(pq, 0);
                         log_assert(status == 0);
                         ctl_locked = false;
 
-                        /*
-                         * If appropriate, log delay since product insertion to
-                         * indicate if processing is falling behind.
-                         */
-                        if (log_is_enabled_debug) {
-                            timestampt now;
-                            if (gettimeofday(&now, 0) == 0) {
-                                double delay = d_diff_timestamp(&now,
-                                        &queue_par.inserted);
-                                log_debug("Delay: %.4f sec", delay);
-                            }
-                        }
-
-                        // Decode data-product metadata
-                        XDR xdrs;
-                        xdrmem_create(&xdrs, prod_par.encoded,
-                                (u_int)prod_par.size, XDR_DECODE) ;
-                        if (!xdr_prod_info(&xdrs, &prod_par.info)) {
-                            log_error_q("xdr_prod_info() failed") ;
-                            status = PQ_SYSTEM;
-                        }
-                        else {
-                            log_assert(prod_par.info.sz <= xdrs.x_handy);
-
-                            #if PQ_SEQ_TRACE
-                                log_debug("%s %u",
-                                        s_prod_info(NULL, 0, &prod_par.info, 1),
-                                        xdrs.x_handy) ;
-                            #endif
-
-                            /*
-                             * If appropriate, log time-interval from
-                             * product-creation to queue-insertion.
-                             */
-                            if (log_is_enabled_debug) {
-                                double latency =
-                                        d_diff_timestamp(&queue_par.inserted,
-                                                &prod_par.info.arrival);
-                                log_debug("time(insert)-time(create): %.4f s",
-                                        latency);
-                            }
-
-                            // If appropriate, apply caller-supplied function.
-                            if (clss == PQ_CLASS_ALL ||
-                                    prodInClass(clss, &prod_par.info)) {
-                                log_assert(func != NULL);
-                                {
-                                    // Change extent into xlen_product */
-                                    const size_t xsz =
-                                            _RNDUP(prod_par.info.sz, 4);
-                                    if (xdrs.x_handy > xsz)
-                                        prod_par.size -= (xdrs.x_handy - xsz);
-                                }
-                                /*
-                                 * Copying data is avoided by using existing
-                                 * buffer.
-                                 */
-                                prod_par.data = xdrs.x_private;
-                                queue_par.offset = rp->offset;
-                                /*
-                                 * Product-queue is unlocked because calling a
-                                 * foreign function with an acquired lock can
-                                 * result in deadlock:
-                                 */
-                                func(&prod_par, &queue_par, app_par);
-                            } // Product matches
-                        } // xdr_prod_info() succeeded
-                        xdr_destroy(&xdrs);
+                        status = next_apply(clss, func, app_par, &queue_par,
+                                encoded, size);
                         if (!keep_locked)
-                            (void)rgn_rel(pq, rp->offset, 0);
+                            (void)rgn_rel(pq, queue_par.offset, 0);
                     } // rgn_get() succeeded
                 } // rl_r_find() succeeded
             } // tqe_find() succeeded
@@ -8204,9 +15416,177 @@ pq_next(
                 (void)ctl_rel(pq, 0);
         } // ctl_get() succeeded
 
+        cons_publish(pq);
+        pq_unlockIf(pq);
+    } // Valid arguments
+
+    return status;
+}
+
+/*
+ * Maximum number of data-products that pq_nextv() locks at once.
+ */
+#define NEXTV_MAX       64
+
+/**
+ * Steps forward through the time-sorted inventory from the current time-cursor
+ * over up to `nmax` data-products at once, which amortizes the locking of the
+ * product-queue and the search of its time-queue over the data-products for a
+ * consumer that's behind. The data-products are found and locked while the
+ * control-header is locked once; then `func` is called for each matching one
+ * in insertion-order, and each is released after its call. The time-cursor is
+ * advanced over every data-product visited. If the time-index records
+ * feedtypes (see PQ_TQFEED), then data-products whose feedtype isn't in the
+ * class are visited without being locked and don't count against `nmax`.
+ *
+ * @param[in,out] pq           Product queue
+ * @param[in]     clss         Product matching criteria
+ * @param[in]     func         Function to call for matching products
+ * @param[in]     nmax         Maximum number of data-products to visit. At
+ *                             most 64 are visited.
+ * @param[in,out] app_par      Application-supplied parameters or `NULL`
+ * @param[out]    nvisited     Number of data-products visited (i.e., over
+ *                             which the cursor was advanced), including those
+ *                             stepped over by feedtype, or `NULL`
+ * @retval        0            Success. At least one data-product was visited.
+ * @retval        PQ_END       End of time-queue hit. No data-product was
+ *                             visited.
+ * @retval        PQ_INVAL     Invalid argument. log_add() called.
+ * @retval        PQ_SYSTEM    System failure. log_add() called.
+ * @see `pq_next()`
+ */
+int
+pq_nextv(
+        pqueue* const restrict             pq,
+        const prod_class_t* const restrict clss,
+        pq_next_func* const                func,
+        size_t                             nmax,
+        void* const restrict               app_par,
+        size_t* const restrict             nvisited)
+{
+    struct {
+        timestampt inserted;
+        off_t      offset;
+        size_t     size;
+        void*      encoded;            // NULL => not locked
+        bool       is_oldest;
+    }      prods[NEXTV_MAX];
+    size_t n = 0;
+    size_t nskipped = 0;
+    int    status;
+
+    if (pq == NULL || clss == NULL || func == NULL || nmax == 0) {
+        log_add("Invalid argument: pq=%p, clss=%p, func=%p, nmax=%lu", pq,
+                clss, func, (unsigned long)nmax);
+        status = PQ_INVAL;
+    }
+    else {
+        if (nmax > NEXTV_MAX)
+            nmax = NEXTV_MAX;
+
+        pq_lockIf(pq);
+
+        // If necessary, initialize product-queue time-cursor
+        if (tvIsNone(pq->cursor))
+            pq->cursor = TS_ZERO;
+
+        // Read-lock control-header
+        status = ctl_get(pq, 0);
+        if (status) {
+            log_add_errno(status, "Couldn't get control-header");
+            status = PQ_SYSTEM;
+        }
+        else {
+            // For `pq_wait()`: no insertion after this can be missed
+            pq->seen_seq = pq->ctlp->insert_seq;
+
+            queue_par_t     queue_par = {.is_full = pq->ctlp->isFull};
+            const feedtypet mask = seq_feedMask(clss);
+            const tqelem*   oldest = tqe_first(pq->tqp);
+            const tqelem*   tqep = tqe_find(pq->tqp, &pq->cursor, TV_GT);
+            timestampt      skipped_tv;     // Last stepped over after prods
+            off_t           skipped_off = OFF_NONE;
+
+            // Find and lock the data-products
+            for (; tqep != NULL && tqep->offset != OFF_NONE && n < nmax;
+                    tqep = tq_next(pq->tqp, tqep)) {
+                region* rp;
+
+                if (SEQ_SKIP(mask, TQ_FEED(pq->tqp, pq->tqfp, tqep))) {
+                    // Can't be in the class. Step over it without locking it.
+                    skipped_tv = tqep->tv;
+                    skipped_off = tqep->offset;
+                    if (++nskipped >= SEQ_SKIP_MAX)
+                        break;
+                    continue;
+                }
+                skipped_off = OFF_NONE;
+
+                prods[n].inserted = tqep->tv;
+                prods[n].offset = tqep->offset;
+                prods[n].is_oldest = tqep == oldest;
+                prods[n].encoded = NULL;
+
+                if (rl_r_find(pq->rlp, tqep->offset, &rp) == 0 ||
+                        rp->offset != tqep->offset ||
+                        Extent(rp) > pq_getDataSize(pq)) {
+                    char ts[20];
+                    (void)sprint_timestampt(ts, sizeof(ts), &tqep->tv);
+                    log_error_q("Queue corrupt: tq: %s invalid region at %ld",
+                            ts, tqep->offset);
+                }
+                else {
+                    prods[n].size = Extent(rp);
+                    status = rgn_get(pq, rp->offset, &prods[n].size, 0,
+                            &prods[n].encoded);
+                    if (status) {
+                        if (n) {
+                            // Visit it next time
+                            log_clear();
+                            status = 0;
+                            break;
+                        }
+                        log_add_errno(status, "Couldn't get product region");
+                        status = PQ_SYSTEM;
+                        break;
+                    }
+                }
+                n++;
+            }
+
+            if (status == 0 && n == 0 && nskipped == 0)
+                status = PQUEUE_END;
+
+            // Release control-header so that other processes can proceed
+            (void)ctl_rel(pq, 0);
+
+            for (size_t i = 0; i < n; i++) {
+                // Update product-queue time-cursor
+                pq_cset(pq, &prods[i].inserted);
+                pq_coffset(pq, prods[i].offset);
+
+                if (prods[i].encoded) {
+                    queue_par.inserted = prods[i].inserted;
+                    queue_par.offset = prods[i].offset;
+                    queue_par.is_oldest = prods[i].is_oldest;
+                    (void)next_apply(clss, func, app_par, &queue_par,
+                            prods[i].encoded, prods[i].size);
+                    (void)rgn_rel(pq, prods[i].offset, 0);
+                }
+            }
+            if (skipped_off != OFF_NONE) {
+                pq_cset(pq, &skipped_tv);
+                pq_coffset(pq, skipped_off);
+            }
+        } // ctl_get() succeeded
+
+        cons_publish(pq);
         pq_unlockIf(pq);
     } // Valid arguments
 
+    if (nvisited)
+        *nvisited = n + nskipped;
+
     return status;
 }
 
@@ -8359,7 +15739,8 @@ pq_seqdel(
         log_assert(rp->offset == tqep->offset);
         log_assert(Extent(rp) <= pq_getDataSize(pq));
 
-        status = rgn_get(pq, rp->offset, Extent(rp), rflags, &vp);
+        extent = Extent(rp);
+        status = rgn_get(pq, rp->offset, &extent, rflags, &vp);
 
         if(status != ENOERR) {
             goto unwind_ctl;
@@ -8372,7 +15753,6 @@ pq_seqdel(
         pq_coffset(pq, OFF_NONE);
 
         offset = rp->offset;
-        extent = Extent(rp);
 
         /*
          * Decode it
@@ -8418,7 +15798,8 @@ pq_seqdel(
                         ts, tqep->offset);
             }
         }
-        rl_free(pq->rlp, rlix);
+        ck_free(pq, offset);
+        pq_freeRegion(pq, rlix);
 
         /*FALLTHROUGH*/
     unwind_rgn:
@@ -8513,6 +15894,73 @@ pq_deleteBySignature(
 }
 
 
+/*
+ * Maximum number of data-products that pq_evict() deletes per locking of the
+ * control-region, which bounds how long an inserter waits for it.
+ */
+#define EVICT_BATCH     16
+
+/**
+ * Deletes the oldest unlocked data-products from a product-queue until the
+ * largest free region has at least a given extent and at least a given number
+ * of product-slots are empty -- so that an insertion of a data-product no
+ * larger than that extent won't have to delete a data-product itself. The
+ * control-region is locked for at most EVICT_BATCH deletions at a time. The
+ * data-products are deleted as an insertion would delete them; in particular,
+ * the minimum virtual residence time and its usage metrics are updated and
+ * the product-queue is marked as full.
+ *
+ * @param[in]  pq         The product-queue. Must be open for writing.
+ * @param[in]  minExtent  Minimum extent of the largest free region in bytes.
+ * @param[in]  minEmpty   Minimum number of empty product-slots.
+ * @param[out] ndeleted   Number of data-products deleted or NULL.
+ * @retval     0          Success. The targets were met or the product-queue
+ *                        is empty.
+ * @retval     EACCES     The remaining data-products are locked. Error-message
+ *                        logged.
+ * @retval     PQ_CORRUPT The product-queue is corrupt. Error message logged.
+ * @retval     PQ_SYSTEM  System error. Error-message logged.
+ */
+int
+pq_evict(
+        pqueue* const restrict pq,
+        const size_t           minExtent,
+        const size_t           minEmpty,
+        size_t* const restrict ndeleted)
+{
+    int    status = 0;
+    size_t n = 0;
+    bool   done = false;
+
+    pq_lockIf(pq);
+        while (!done && status == 0) {
+            if (ctl_get(pq, RGN_WRITE)) {
+                log_error_q("Couldn't lock the control-header of "
+                        "product-queue %s", pq->pathname);
+                status = PQ_SYSTEM;
+                break;
+            }
+            for (int i = 0; i < EVICT_BATCH; i++) {
+                done = pq->rlp->nelems == 0 ||
+                        (pq->rlp->maxfextent >= minExtent &&
+                         pq->rlp->nempty >= minEmpty);
+                if (done)
+                    break;
+                status = pq2_del_oldest(pq);
+                if (status)
+                    break;
+                n++;
+            }
+            (void)ctl_rel(pq, RGN_MODIFIED);
+        }
+    pq_unlockIf(pq);
+
+    if (ndeleted)
+        *ndeleted = n;
+
+    return status;
+}
+
 /*
  * Used only by pq_last() below.
  */
@@ -8711,41 +16159,152 @@ pq_suspendAndUnblock(
     for (int i = 0; i < numSigs; i++)
         (void)sigdelset(&mask, unblockSigs[i]);
 
-    /* Nighty night... */
-    (void)time(&start);
-    sigalrm_received = 0;
-    (void)sigsuspend(&mask);
+    /* Nighty night... */
+    (void)time(&start);
+    sigalrm_received = 0;
+    (void)sigsuspend(&mask);
+
+    /* Now we are back, restore state */
+    if(maxsleep) {
+        (void)alarm(0);
+        (void)sigaction(SIGALRM, &asavact, NULL );
+    }
+    (void)sigaction(SIGCONT, &csavact, NULL );
+    (void)pthread_sigmask(SIG_SETMASK, &savmask, NULL);
+
+    return sigalrm_received
+        ? 0
+        : (unsigned)(time(NULL) - start);
+}
+
+/**
+ * Suspends execution until
+ *   - A signal is delivered whose action is to execute a signal-catching
+ *     function;
+ *   - SIGCONT is received, indicating another data-product is available; or
+ *   - The given amount of time elapses.
+ * Upon return, the signal mask is what it was on entry.
+ *
+ * @param[in] maxsleep  Number of seconds to suspend or 0 for an indefinite
+ *                      suspension.
+ * @return              Requested amount of suspension-time minus the amount of
+ *                      time actually suspended.
+ */
+unsigned
+pq_suspend(unsigned int maxsleep)
+{
+    return pq_suspendAndUnblock(maxsleep, NULL, 0);
+}
+
+
+/**
+ * Suspends execution until
+ *   - A signal is delivered whose action is to execute a signal-catching
+ *     function;
+ *   - A data-product is inserted into the product-queue after the last call
+ *     to `pq_sequence()`, `pq_sequenceLock()`, or `pq_next()` on it; or
+ *   - The given amount of time elapses.
+ * Unlike `pq_suspend()`, only processes waiting on the product-queue are
+ * woken by an insertion. If notification is by SIGCONT (see `PQ_SIGCONT`),
+ * then this function is equivalent to `pq_suspendAndUnblock()`. Upon return,
+ * the signal mask is what it was on entry.
+ *
+ * @param[in] pq           The product-queue.
+ * @param[in] maxsleep     Number of seconds to suspend or 0 for an indefinite
+ *                         suspension.
+ * @param[in] unblockSigs  Additional signals to unblock during suspension.
+ *                         Ignored if `numSigs == 0`.
+ * @param[in] numSigs      Number of additional signals to unblock. May be `0`.
+ * @return                 0 if the timeout occurred; otherwise, the number of
+ *                         seconds suspended.
+ */
+unsigned
+pq_waitAndUnblock(
+        pqueue* const      pq,
+        const unsigned int maxsleep,
+        const int* const   unblockSigs,
+        const int          numSigs)
+{
+    if (pq == NULL || !notify_isSeq(pq))
+        return pq_suspendAndUnblock(maxsleep, unblockSigs, numSigs);
+
+#ifdef PQ_HAVE_NOTIFY
+    pq_lockIf(pq);
+        const uint32_t seq = pq->seen_seq;
+    pq_unlockIf(pq);
+
+    const struct timespec timeout = {maxsleep ? maxsleep : INT_MAX, 0};
+    const time_t          start = time(NULL);
+    int                   status;
+    int                   fd;
+
+    if (numSigs <= 0) {
+        status = notify_wait(pq, seq, &timeout);
+    }
+    else if (pq_getNotifyFd(pq, &fd)) {
+        log_flush_error();
+        status = notify_wait(pq, seq, &timeout);
+    }
+    else if (notify_getSeq(pq) != seq) {
+        status = 0;
+    }
+    else {
+        /*
+         * The signals must be unblocked atomically with the wait so that a
+         * termination signal can't be missed.
+         */
+        sigset_t      mask;
+        struct pollfd pfd;
+
+        (void)pthread_sigmask(SIG_SETMASK, NULL, &mask);
+        for (int i = 0; i < numSigs; i++)
+            (void)sigdelset(&mask, unblockSigs[i]);
 
-    /* Now we are back, restore state */
-    if(maxsleep) {
-        (void)alarm(0);
-        (void)sigaction(SIGALRM, &asavact, NULL );
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+
+        status = ppoll(&pfd, 1, &timeout, &mask);
+        if (status > 0) {
+            eventfd_t count;
+            (void)eventfd_read(fd, &count);
+            status = 0;
+        }
+        else {
+            status = (status == 0) ? ETIMEDOUT : errno;
+        }
     }
-    (void)sigaction(SIGCONT, &csavact, NULL );
-    (void)pthread_sigmask(SIG_SETMASK, &savmask, NULL);
 
-    return sigalrm_received
+    return (status == ETIMEDOUT)
         ? 0
         : (unsigned)(time(NULL) - start);
+#else
+    return pq_suspendAndUnblock(maxsleep, unblockSigs, numSigs);
+#endif
 }
 
 /**
  * Suspends execution until
  *   - A signal is delivered whose action is to execute a signal-catching
  *     function;
- *   - SIGCONT is received, indicating another data-product is available; or
+ *   - A data-product is inserted into the product-queue after the last call
+ *     to `pq_sequence()`, `pq_sequenceLock()`, or `pq_next()` on it; or
  *   - The given amount of time elapses.
- * Upon return, the signal mask is what it was on entry.
+ * This is the replacement for `pq_suspend()`: only processes waiting on the
+ * product-queue are woken by an insertion, and an insertion can't be missed.
  *
+ * @param[in] pq        The product-queue.
  * @param[in] maxsleep  Number of seconds to suspend or 0 for an indefinite
  *                      suspension.
- * @return              Requested amount of suspension-time minus the amount of
- *                      time actually suspended.
+ * @return              0 if the timeout occurred; otherwise, the number of
+ *                      seconds suspended.
+ * @see `pq_waitAndUnblock()`
  */
 unsigned
-pq_suspend(unsigned int maxsleep)
+pq_wait(
+        pqueue* const      pq,
+        const unsigned int maxsleep)
 {
-    return pq_suspendAndUnblock(maxsleep, NULL, 0);
+    return pq_waitAndUnblock(pq, maxsleep, NULL, 0);
 }
 
 
@@ -8805,6 +16364,68 @@ const pqe_index _pqenone = {
 };
 
 
+/**
+ * Returns an allocated region into which to write a data-product based on
+ * data-product metadata.
+ *
+ * @pre                   The control-region is write-locked.
+ * @param[in,out] pq      Pointer to the product-queue object.
+ * @param[in]     infop   Pointer to the data-product metadata object.
+ * @param[out]    ptrp    Pointer to the pointer to the region into which to
+ *                        write the data-product.  Set upon successful return.
+ * @param[out]    indexp  Pointer to the handle for the region.  Set upon
+ *                        successful return.
+ * @retval        0       Success.  "*ptrp" and "*indexp" are set.
+ * @return                <errno.h> error code.
+ */
+static int
+rpqe_newInfo(
+        pqueue *const          pq,
+        const prod_info *const infop,
+        void **const           ptrp,
+        pqe_index *const       indexp)
+{
+        int status;
+        size_t extent;
+        void *vp = NULL;
+        sxelem *sxep;
+
+        if(infop->sz == 0) {
+                log_error_q("zero product size");
+                return EINVAL;
+        }
+
+        if (infop->sz > pq_getDataSize(pq)) {
+                log_error_q("Product too big: product=%u bytes; queue=%lu bytes",
+                    infop->sz, (unsigned long)pq_getDataSize(pq));
+                return PQ_BIG;
+        }
+
+        extent = xlen_prod_i(infop);
+        status = rpqe_new(pq, extent, infop->signature, &vp, &sxep);
+        if(status != ENOERR) {
+                log_debug("rpqe_newInfo(): rpqe_new() failure");
+                return status;
+        }
+
+                                                /* cast away const'ness */
+        *ptrp = xinfo_i(vp, extent, XDR_ENCODE, (prod_info *)infop);
+        if(*ptrp == NULL)
+        {
+                log_debug("rpqe_newInfo(): xinfo_i() failure");
+                return EIO;
+        }
+
+        log_assert(((char *)(*ptrp) + infop->sz) <= ((char *)vp + extent));
+
+        indexp->offset = sxep->offset;
+        memcpy(indexp->signature, sxep->sxi, sizeof(signaturet));
+        pq->pqe_count++;
+
+        return ENOERR;
+}
+
+
 /**
  * Returns an allocated region into which to write a data-product based on
  * data-product metadata.
@@ -8834,23 +16455,6 @@ pqe_new(pqueue *pq,
     log_assert(indexp != NULL);
 
     pq_lockIf(pq);
-        size_t extent;
-        void *vp = NULL;
-        sxelem *sxep;
-
-        if(infop->sz == 0) {
-                log_error_q("zero product size");
-                status = EINVAL;
-                goto unwind_lock;
-        }
-
-        if (infop->sz > pq_getDataSize(pq)) {
-                log_error_q("Product too big: product=%u bytes; queue=%lu bytes",
-                    infop->sz, (unsigned long)pq_getDataSize(pq));
-                status = PQ_BIG;
-                goto unwind_lock;
-        }
-
         if(fIsSet(pq->pflags, PQ_READONLY)) {
             status = EACCES;
             goto unwind_lock;
@@ -8865,30 +16469,8 @@ pqe_new(pqueue *pq,
                 goto unwind_lock;
         }
 
-        extent = xlen_prod_i(infop);
-        status = rpqe_new(pq, extent, infop->signature, &vp, &sxep);
-        if(status != ENOERR) {
-                log_debug("pqe_new(): rpqe_new() failure");
-                goto unwind_ctl;
-        }
-
-                                                /* cast away const'ness */
-        *ptrp = xinfo_i(vp, extent, XDR_ENCODE, (prod_info *)infop);
-        if(*ptrp == NULL)
-        {
-                log_debug("pqe_new(): xinfo_i() failure");
-                status = EIO;
-                goto unwind_ctl;
-        }
-
-        log_assert(((char *)(*ptrp) + infop->sz) <= ((char *)vp + extent));
-
-        indexp->offset = sxep->offset;
-        memcpy(indexp->signature, sxep->sxi, sizeof(signaturet));
-        pq->pqe_count++;
-        /*FALLTHROUGH*/
+        status = rpqe_newInfo(pq, infop, ptrp, indexp);
 
-unwind_ctl:
         (void) ctl_rel(pq, RGN_MODIFIED);
         /*FALLTHROUGH*/
 
@@ -8899,6 +16481,63 @@ unwind_lock:
 }
 
 
+/**
+ * Returns allocated regions into which to write data-products based on their
+ * metadata. The regions are reserved under one lock of the control-region,
+ * which is cheaper than calling `pqe_new()` for each data-product.
+ *
+ * @param[in,out] pq        The product-queue.
+ * @param[in]     infos     The metadata of the data-products.
+ * @param[in]     nprods    The number of data-products.
+ * @param[out]    ptrs      The pointers to the regions into which to write
+ *                          the data-products. `ptrs[i]` is set if
+ *                          `statuses[i]` is zero.
+ * @param[out]    indexes   The handles of the regions. `indexes[i]` is set if
+ *                          `statuses[i]` is zero, in which case the client must
+ *                          eventually call `pqe_insert()`, `pqe_insertv()`, or
+ *                          `pqe_discard()` on it.
+ * @param[out]    statuses  The status of each reservation: 0, PQ_DUP, PQ_BIG,
+ *                          or an <errno.h> error code.
+ * @retval        0         Success. `statuses` is set.
+ * @retval        EACCES    The product-queue is read-only.
+ * @return                  <errno.h> error code. No regions were reserved.
+ * @see `pqe_insertv()`
+ */
+int
+pqe_newv(
+        pqueue* const          pq,
+        const prod_info* const infos,
+        const size_t           nprods,
+        void** const           ptrs,
+        pqe_index* const       indexes,
+        int* const             statuses)
+{
+    int status;
+
+    log_assert(pq != NULL);
+    log_assert(nprods == 0 ||
+            (infos != NULL && ptrs != NULL && indexes != NULL &&
+             statuses != NULL));
+
+    pq_lockIf(pq);
+        if (fIsSet(pq->pflags, PQ_READONLY)) {
+            status = EACCES;
+        }
+        else if ((status = ctl_get(pq, RGN_WRITE)) != ENOERR) {
+            log_debug("pqe_newv(): ctl_get() failure");
+        }
+        else {
+            for (size_t i = 0; i < nprods; i++)
+                statuses[i] = rpqe_newInfo(pq, infos + i, ptrs + i,
+                        indexes + i);
+            (void)ctl_rel(pq, RGN_MODIFIED);
+        }
+    pq_unlockIf(pq);
+
+    return status;
+}
+
+
 /**
  * Returns an allocated region into which to write an XDR-encoded data-product.
  *
@@ -9014,17 +16653,19 @@ pqe_discard(pqueue *pq, pqe_index index)
         int   status;
         off_t offset = pqeOffset(index);
 
-        status = (pq->mtof)(pq, offset, 0);
+        /*
+         * Write lock pq->xctl. The chunks of a chunked data-product are
+         * found via its region, so they're freed before it's released.
+         */
+        status = ctl_get(pq, RGN_WRITE);
         if(status == ENOERR) {
-            /*
-             * Write lock pq->xctl.
-             */
-            status = ctl_get(pq, RGN_WRITE);
+            ck_free(pq, offset);
+            status = rgn_rel(pq, offset, 0);
             if(status == ENOERR) {
                 status = rpqe_free(pq, offset, index.signature);
-                (void)ctl_rel(pq, RGN_MODIFIED);
                 pq->pqe_count--;
             }
+            (void)ctl_rel(pq, RGN_MODIFIED);
         }
     pq_unlockIf(pq);
 
@@ -9032,9 +16673,38 @@ pqe_discard(pqueue *pq, pqe_index index)
 }
 
 
+/*
+ * Returns the feedtype of the XDR-encoded data-product 'xp' of 'extent'
+ * bytes without decoding the rest of its metadata. The feedtype follows the
+ * creation-time, signature, and origin. The header of a compressed
+ * data-product ('zipped') is skipped. Returns ANY if the encoding is
+ * truncated.
+ */
+static feedtypet
+xfeedtype(const void *const xp, const size_t extent, const bool zipped)
+{
+        const char *cp = (const char *)xp + 8 + sizeof(signaturet);
+        const char *const end = (const char *)xp + extent;
+        uint32_t xval;
+
+        if(zipped)
+                cp += ZP_HDRLEN;
+
+        if(cp + 4 > end)
+                return ANY;
+        (void)memcpy(&xval, cp, 4); /* length of origin */
+        if(ntohl(xval) > HOSTNAMESIZE)
+                return ANY;
+        cp += 4 + _RNDUP(ntohl(xval), 4);
+        if(cp + 4 > end)
+                return ANY;
+        (void)memcpy(&xval, cp, 4);
+        return (feedtypet)ntohl(xval);
+}
+
 /*
  * LDM 4 convenience funct.
- * Change signature, Insert at rear of queue, send SIGCONT to process group
+ * Change signature, Insert at rear of queue, notify readers
  */
 int
 pqe_xinsert(pqueue *pq, pqe_index index, const signaturet realsignature)
@@ -9042,6 +16712,9 @@ pqe_xinsert(pqueue *pq, pqe_index index, const signaturet realsignature)
         pq_lockIf(pq);
         int status = ENOERR;
         off_t offset = pqeOffset(index);
+        sxelem *sxep;
+        timestampt insertTime;
+        feedtypet feedtype;
 
         /* correct the signature in the product */
         {
@@ -9055,11 +16728,12 @@ pqe_xinsert(pqueue *pq, pqe_index index, const signaturet realsignature)
                 }
                 xp = rp->vp;
                 log_assert(xp != NULL);
+                feedtype = xfeedtype(xp, rp->extent, false); /* not vetted */
                 xp += 8; /* xlen_timestampt */
                 memcpy(xp, realsignature, sizeof(signaturet));
         }
 
-        status =  (pq->mtof)(pq, offset, RGN_MODIFIED);
+        status =  rgn_rel(pq, offset, RGN_MODIFIED);
         if(status != ENOERR)
                 goto unwind_lock;
 
@@ -9071,11 +16745,16 @@ pqe_xinsert(pqueue *pq, pqe_index index, const signaturet realsignature)
                 goto unwind_lock;
 
         {
-          sxelem *sxep;
           /*
            * Check for duplicate
            */
-          if(sx_find(pq->sxp, realsignature, &sxep) != 0)
+          int dup = sx_find(pq->sxp, realsignature, &sxep) != 0;
+          if(!dup && pq->esp && es_find(pq->esp, realsignature, time(NULL)))
+            {
+              pq->esp->nlate++;
+              dup = 1;
+            }
+          if(dup)
             {
               log_debug("PQ_DUP");
               status = PQ_DUP;
@@ -9091,33 +16770,174 @@ pqe_xinsert(pqueue *pq, pqe_index index, const signaturet realsignature)
                      s_signaturet(NULL, 0, index.signature));
             }
           sxep = sx_add(pq->sxp, realsignature, offset);
+          if(sxep == NULL)
+            {
+              /* The old signature is gone, so free the region directly */
+              const size_t rlix = rl_find(pq->rlp, offset);
+              if(rlix != RL_NONE)
+                      pq_freeRegion(pq, rlix);
+              status = ENOMEM;
+              goto unwind_ctl;
+            }
         }
 
         log_assert(pq->tqp != NULL && tq_HasSpace(pq->tqp));
 
-        status = tq_add(pq->tqp, offset);
+        status = tq_add(pq->tqp, pq->tqfp, offset, feedtype, &insertTime);
         if(status != ENOERR)
                 goto unwind_ctl;
+        if(sxep != NULL)
+                sxe_setTime(pq->sxp, sxep, &insertTime);
 
-        /*
-         * Inform others in our process group
-         * that there is new data available.
-         * (see pq_suspend() below.)
-         *  SIGCONT is ignored by default...
-         */
-        (void)kill(0, SIGCONT);
+        ctl_incSeq(pq);
 
         /*FALLTHROUGH*/
 unwind_ctl:
         (void) ctl_rel(pq, RGN_MODIFIED);
+        if(status == ENOERR)
+                pq_notify(pq, true);
 unwind_lock:
         pq_unlockIf(pq);
         return status;
 }
 
+/**
+ * Vets a data-product reserved by a prior call to `pqe_new()` or
+ * `pqe_newDirect()` before it's inserted. The reservation is discarded if the
+ * data-product is invalid.
+ *
+ * @pre                 The control-region is unlocked.
+ * @param[in] pq        The product-queue.
+ * @param[in] index     The data-product reference.
+ * @retval 0            Success.
+ * @retval PQ_BIG       The data-product is larger than the space allocated.
+ *                      `log_error_q()` called.
+ * @retval PQ_NOTFOUND  The data-product wasn't found. `log_error_q()` called.
+ * @retval PQ_CORRUPT   The metadata couldn't be deserialized. `log_error_q()`
+ *                      called.
+ * @retval PQ_SYSTEM    System failure. `log_error_q()` called.
+ */
+static int
+pqe_vet(pqueue *const pq, const pqe_index index)
+{
+    int  status;
+    riu* rp;
+
+    if (riul_r_find(pq->riulp, index.offset, &rp) == 0) {
+        log_error_q("riul_r_find() failed");
+        status = PQ_NOTFOUND;
+    }
+    else {
+        InfoBuf    infoBuf;
+        prod_info* info = ib_init(&infoBuf);
+        XDR        xdrs;
+        xdrmem_create(&xdrs, rp->vp, rp->extent, XDR_DECODE);
+        if (!xdr_prod_info(&xdrs, info)) {
+            log_error_q("xdr_prod_info() failed; "
+                    "product-queue might now be corrupt");
+            status = pqe_discard(pq, index) ? PQ_SYSTEM : PQ_CORRUPT;
+        }
+        else if (xlen_prod_i(info) > rp->extent) {
+            log_error_q("Product larger than allocated space; "
+                    "product-queue now likely corrupted: "
+                    "info->sz=%lu, rp->extent=%lu",
+                    (unsigned long)info->sz, (unsigned long)rp->extent);
+            status = pqe_discard(pq, index) ? PQ_SYSTEM : PQ_BIG;
+        }
+        else {
+            /*
+             * Compress the data in place if that's worthwhile. A chunked
+             * data-product isn't compressed because its chunks can't be
+             * trimmed.
+             */
+            const size_t infolen = xlen_prod_info(info);
+            size_t       zlen = 0;
+            void* const  zbuf = rp->ckhead
+                    ? NULL
+                    : zp_compress(pq, info->feedtype,
+                            (char*)rp->vp + infolen, info->sz, &zlen);
+
+            if (zbuf)
+                zp_write(rp->vp, rp->vp, infolen, zbuf, zlen);
+
+            if (rgn_rel(pq, index.offset, RGN_MODIFIED)) {
+                log_error_q("rgn_rel() failed");
+                status = PQ_SYSTEM;
+            }
+            else if (zbuf && ctl_get(pq, RGN_WRITE)) {
+                log_error_q("ctl_get() failed");
+                status = PQ_SYSTEM;
+            }
+            else {
+                if (zbuf) {
+                    /* Return the space saved to the free list */
+                    const size_t rlix = rl_find(pq->rlp, index.offset);
+                    size_t       extent = _RNDUP(ZP_HDRLEN + infolen +
+                            _RNDUP(zlen, 4), pq->ctlp->align);
+                    const size_t c = pq->clp
+                            ? cl_ceil(extent, pq->ctlp->align)
+                            : CL_NCLASSES;
+
+                    if (c < CL_NCLASSES)
+                        extent = cl_extent(c, pq->ctlp->align);
+                    if (rlix != RL_NONE) {
+                        set_IsZipped(pq->rlp->rp + rlix);
+                        if (extent < Extent(pq->rlp->rp + rlix))
+                            rl_trim(pq->rlp, rlix, extent);
+                    }
+                    zp_count(pq, info->sz, zlen);
+                    (void)ctl_rel(pq, RGN_MODIFIED);
+                }
+                status = 0;
+            }
+            free(zbuf);
+        }
+        xdr_destroy(&xdrs);
+    } // data-product was found in region-in-use list
+
+    return status;
+}
+
+/**
+ * Adds a vetted data-product to the time-queue.
+ *
+ * @pre               The control-region is write-locked.
+ * @param[in] pq      The product-queue.
+ * @param[in] index   The data-product reference.
+ * @retval 0          Success.
+ * @retval PQ_SYSTEM  System failure. `log_error_q()` called.
+ */
+static int
+rpqe_commit(pqueue *const pq, const pqe_index index)
+{
+    timestampt insertTime;
+    sxelem*    sxep;
+    feedtypet  feedtype = ANY;
+
+    log_assert(pq->tqp != NULL && tq_HasSpace(pq->tqp));
+    if (pq->tqfp != NULL) {
+        riu* rp;
+        if (riul_r_find(pq->riulp, index.offset, &rp))
+            feedtype = xfeedtype(rp->vp, rp->extent,
+                    fIsSet(rl_flags(pq->rlp, index.offset), ISZIPPED));
+    }
+    if (tq_add(pq->tqp, pq->tqfp, index.offset, feedtype, &insertTime)) {
+        log_error_q("tq_add() failed");
+        return PQ_SYSTEM;
+    }
+    if (sx_find(pq->sxp, index.signature, &sxep) &&
+            sxep->offset == index.offset)
+        sxe_setTime(pq->sxp, sxep, &insertTime);
+    (void)set_timestamp(&pq->ctlp->mostRecent);
+    ctl_incSeq(pq);
+    pq->pqe_count--;
+
+    return 0;
+}
+
 /**
  * Inserts the data-product reserved by a prior call to `pqe_new()` or
- * `pqe_newDirect()` and sends a SIGCONT to the process group.
+ * `pqe_newDirect()` and notifies readers.
  *
  * @param[in] pq     The product-queue.
  * @param[in] index  The data-product reference returned by `pqe_new()` or
@@ -9144,57 +16964,20 @@ pqe_insert(pqueue *pq, pqe_index index)
 
 #if 1
     pq_lockIf(pq);
-        riu* rp;
+        status = pqe_vet(pq, index);
 
-        if (riul_r_find(pq->riulp, index.offset, &rp) == 0) {
-            log_error_q("riul_r_find() failed");
-            status = PQ_NOTFOUND;
-        }
-        else {
-            InfoBuf    infoBuf;
-            prod_info* info = ib_init(&infoBuf);
-            XDR        xdrs;
-            xdrmem_create(&xdrs, rp->vp, rp->extent, XDR_DECODE);
-            if (!xdr_prod_info(&xdrs, info)) {
-                log_error_q("xdr_prod_info() failed; "
-                        "product-queue might now be corrupt");
-                status = pqe_discard(pq, index) ? PQ_SYSTEM : PQ_CORRUPT;
-            }
-            else if (xlen_prod_i(info) > rp->extent) {
-                log_error_q("Product larger than allocated space; "
-                        "product-queue now likely corrupted: "
-                        "info->sz=%lu, rp->extent=%lu",
-                        (unsigned long)info->sz, (unsigned long)rp->extent);
-                status = pqe_discard(pq, index) ? PQ_SYSTEM : PQ_BIG;
-            }
-            else if (pq->mtof(pq, index.offset, RGN_MODIFIED)) {
-                log_error_q("pq->mtof() failed");
-                status = PQ_SYSTEM;
-            }
-            else if (ctl_get(pq, RGN_WRITE)) {
+        if (status == 0) {
+            if (ctl_get(pq, RGN_WRITE)) {
                 log_error_q("ctl_get() failed");
                 status = PQ_SYSTEM;
             }
             else {
-                log_assert(pq->tqp != NULL && tq_HasSpace(pq->tqp));
-                if (tq_add(pq->tqp, index.offset)) {
-                    log_error_q("tq_add() failed");
-                    status = PQ_SYSTEM;
-                }
-                else {
-                    (void)set_timestamp(&pq->ctlp->mostRecent);
-                    pq->pqe_count--;
-                    /*
-                     * Inform our process group that there is new data available
-                     * (see pq_suspend() below). SIGCONT is ignored by default.
-                     */
-                    (void)kill(0, SIGCONT);
-                    status = 0;
-                } // entry made in time-queue
+                status = rpqe_commit(pq, index);
                 (void)ctl_rel(pq, RGN_MODIFIED);
+                if (status == 0)
+                    pq_notify(pq, true); // Wakes readers
             } // `ctl_get()` succeeded
-            xdr_destroy(&xdrs);
-        } // data-product was found in region-in-use list
+        } // data-product was vetted
 
     pq_unlockIf(pq);
 
@@ -9203,7 +16986,7 @@ pqe_insert(pqueue *pq, pqe_index index)
         int   status = ENOERR;
         off_t offset = pqeOffset(index);
 
-        status =  (pq->mtof)(pq, offset, RGN_MODIFIED);
+        status =  rgn_rel(pq, offset, RGN_MODIFIED);
         if(status != ENOERR)
                 goto unwind_lock;
 
@@ -9216,7 +16999,7 @@ pqe_insert(pqueue *pq, pqe_index index)
 
         log_assert(pq->tqp != NULL && tq_HasSpace(pq->tqp));
 
-        status = tq_add(pq->tqp, offset);
+        status = tq_add(pq->tqp, pq->tqfp, offset, ANY, NULL);
         if(status != ENOERR)
                 goto unwind_ctl;
 
@@ -9240,6 +17023,70 @@ unwind_lock:
 #endif
 }
 
+/**
+ * Inserts data-products reserved by prior calls to `pqe_new()`,
+ * `pqe_newDirect()`, or `pqe_newv()` under one lock of the control-region and
+ * notifies readers once.
+ *
+ * @param[in]  pq        The product-queue.
+ * @param[in]  indexes   The data-product references.
+ * @param[in]  nprods    The number of data-products.
+ * @param[out] statuses  The status of each insertion -- as returned by
+ *                       `pqe_insert()`.
+ * @retval     0         Success. `statuses` is set.
+ * @retval     PQ_SYSTEM The control-region couldn't be locked. The vetted
+ *                       data-products weren't inserted and have `statuses[i]`
+ *                       set to PQ_SYSTEM. `log_error_q()` called.
+ */
+int
+pqe_insertv(
+        pqueue* const          pq,
+        const pqe_index* const indexes,
+        const size_t           nprods,
+        int* const             statuses)
+{
+    int    status = 0;
+    size_t ninserted = 0;
+
+    log_assert(pq != NULL);
+    log_assert(nprods == 0 || (indexes != NULL && statuses != NULL));
+
+    pq_lockIf(pq);
+        size_t nvetted = 0;
+
+        for (size_t i = 0; i < nprods; i++) {
+            statuses[i] = pqe_vet(pq, indexes[i]);
+            if (statuses[i] == 0)
+                nvetted++;
+        }
+
+        if (nvetted) {
+            if (ctl_get(pq, RGN_WRITE)) {
+                log_error_q("ctl_get() failed");
+                for (size_t i = 0; i < nprods; i++)
+                    if (statuses[i] == 0)
+                        statuses[i] = PQ_SYSTEM;
+                status = PQ_SYSTEM;
+            }
+            else {
+                for (size_t i = 0; i < nprods; i++) {
+                    if (statuses[i] == 0) {
+                        statuses[i] = rpqe_commit(pq, indexes[i]);
+                        if (statuses[i] == 0)
+                            ninserted++;
+                    }
+                }
+                (void)ctl_rel(pq, RGN_MODIFIED);
+                if (ninserted)
+                    pq_notify(pq, true); // Wakes readers
+            } // `ctl_get()` succeeded
+        } // some data-products were vetted
+
+    pq_unlockIf(pq);
+
+    return status;
+}
+
 /**
  * Returns the number of outstanding product reservations (i.e., the number of
  * times `pqe_new()` and `pqe_newDirect()` have been called minus the number of
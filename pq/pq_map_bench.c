@@ -0,0 +1,195 @@
+/**
+ * Copyright 2026 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: pq_map_bench.c
+ *
+ * Benchmark of the memory-mapping modes of the product-queue: compares the
+ * rates of insertion and of sequencing, and the page-faults taken, of a
+ * product-queue that's mapped normally, with transparent huge pages
+ * (PQ_HUGEPAGES), pre-faulted (PQ_POPULATE), and both. Each mode creates a new
+ * product-queue, fills it once, and then sequences through it with a new
+ * reader, like a consumer catching up.
+ *
+ * Usage: pq_map_bench [size [pathname [node]]]
+ *
+ * The default size is 256 MB, the default pathname is "pq_map_bench.pq" (a
+ * pathname on tmpfs(5) shows the effect of huge pages), and by default the
+ * memory isn't bound to a NUMA node.
+ */
+
+#include "config.h"
+
+#include "ldm.h"
+#include "log.h"
+#include "pq.h"
+#include "timestamp.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define PROD_SIZE       16384
+
+static double
+now(void)
+{
+    struct timeval tv;
+    (void)gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+static long
+faults(void)
+{
+    struct rusage usage;
+    (void)getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+static int
+count_prod(
+        const prod_info* const restrict info,
+        const void* const restrict      data,
+        void* const restrict            xprod,
+        const size_t                    size,
+        void* const restrict            arg)
+{
+    ++*(unsigned long*)arg;
+    return 0;
+}
+
+/**
+ * Times creating, filling, and sequencing a product-queue in one
+ * memory-mapping mode.
+ *
+ * @param[in] path    Pathname of the product-queue
+ * @param[in] size    Size of the data portion of the product-queue in bytes
+ * @param[in] mflags  Memory-mapping flags: PQ_HUGEPAGES, PQ_POPULATE, or both
+ * @param[in] node    NUMA node or -1
+ * @retval    0       Success
+ * @retval    -1      Failure. `log_add()` called.
+ */
+static int
+bench(
+        const char* const path,
+        const off_t       size,
+        const int         mflags,
+        const int         node)
+{
+    static char    data[PROD_SIZE];
+    const size_t   nprods = size/PROD_SIZE;
+    pqueue*        pq;
+    product        prod;
+    unsigned long  nread = 0;
+    double         start, createTime, insertRate, seqRate;
+    long           nfaults, insertFaults, seqFaults;
+    int            status = pq_setMapDefaults(mflags, node);
+
+    if (status)
+        return -1;
+
+    (void)unlink(path);
+    start = now();
+    status = pq_create(path, 0600, 0, 0, size, nprods, &pq);
+    if (status) {
+        log_add_errno(status, "Couldn't create product-queue \"%s\"", path);
+        return -1;
+    }
+    createTime = now() - start;
+
+    (void)memset(&prod, 0, sizeof(prod));
+    prod.info.feedtype = EXP;
+    prod.info.ident = "pq_map_bench";
+    prod.info.origin = "localhost";
+    prod.info.sz = sizeof(data);
+    prod.data = data;
+
+    nfaults = faults();
+    start = now();
+    for (uint32_t i = 0; i < nprods; i++) {
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        if (status && status != PQ_DUP) {
+            log_add_errno(status, "Couldn't insert product %lu",
+                    (unsigned long)i);
+            (void)pq_close(pq);
+            return -1;
+        }
+    }
+    insertRate = nprods/(now() - start);
+    insertFaults = faults() - nfaults;
+    (void)pq_close(pq);
+
+    status = pq_open(path, PQ_READONLY, &pq);
+    if (status) {
+        log_add_errno(status, "Couldn't open product-queue \"%s\"", path);
+        return -1;
+    }
+    nfaults = faults();
+    start = now();
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, count_prod, &nread))
+            == 0)
+        ;
+    seqRate = nread/(now() - start);
+    seqFaults = faults() - nfaults;
+    (void)pq_close(pq);
+    (void)unlink(path);
+
+    if (status != PQUEUE_END) {
+        log_add_errno(status, "Couldn't sequence product-queue \"%s\"", path);
+        return -1;
+    }
+
+    (void)printf("%-15s create %7.3f s, %8.0f inserts/s (%7ld faults), "
+            "%8.0f products/s sequenced (%7ld faults)\n",
+            mflags == 0
+                ? "default"
+                : mflags == PQ_HUGEPAGES
+                    ? "huge-pages"
+                    : mflags == PQ_POPULATE
+                        ? "populate"
+                        : "huge+populate",
+            createTime, insertRate, insertFaults, seqRate, seqFaults);
+    return 0;
+}
+
+int
+main(
+        const int          argc,
+        const char* const* argv)
+{
+    static const int modes[] = {0, PQ_HUGEPAGES, PQ_POPULATE,
+            PQ_HUGEPAGES|PQ_POPULATE};
+    const off_t      size = argc > 1 ? strtoll(argv[1], NULL, 0) : 256000000;
+    const char*      path = argc > 2 ? argv[2] : "pq_map_bench.pq";
+    const int        node = argc > 3 ? atoi(argv[3]) : -1;
+    int              status = 0;
+
+    if (log_init(argv[0])) {
+        (void)fprintf(stderr, "Couldn't initialize logging\n");
+        return 1;
+    }
+
+    if (size < 100*PROD_SIZE) {
+        log_add("Invalid size: \"%s\"", argv[1]);
+        status = -1;
+    }
+
+    for (int i = 0; status == 0 && i < sizeof(modes)/sizeof(*modes); i++)
+        status = bench(path, size, modes[i], node);
+
+    if (status)
+        log_flush_error();
+    log_fini();
+
+    return status ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+/**
+ * Copyright 2026 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: pq_sx_bench.c
+ *
+ * Micro-benchmark of the signature-index of the product-queue: compares the
+ * chained and open-addressed (PQ_SXOPEN) formats by the rates of insertion,
+ * of finding a duplicate, of not finding a new signature, and of deleting the
+ * oldest signature while inserting a new one (i.e., eviction), for an index
+ * that's full.
+ *
+ * The index functions are static, so this file includes the implementation.
+ *
+ * Usage: pq_sx_bench [nslots ...]
+ *
+ * The default slot-counts are 1000000 and 10000000.
+ */
+
+#include "pq.c"
+
+#include <sys/time.h>
+
+/*
+ * Sets a signature that's as random as an MD5 checksum from a sequence number.
+ */
+static void
+set_signature(
+        signaturet     sig,
+        const uint64_t i)
+{
+    for (int j = 0; j < 2; j++) {
+        uint64_t z = i * 2 + j + UINT64_C(0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+        z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+        z ^= z >> 31;
+        (void)memcpy(sig + j*sizeof(z), &z, sizeof(z));
+    }
+}
+
+static double
+now(void)
+{
+    struct timeval tv;
+    (void)gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+/**
+ * Times the signature-index operations for one format.
+ *
+ * @param[in] nslots  Number of signatures
+ * @param[in] open    Whether the index is open-addressed
+ * @retval    0       Success
+ * @retval    -1      Failure. `log_add()` called.
+ */
+static int
+bench(
+        const size_t nslots,
+        const bool   open)
+{
+    sx* const  sxp = malloc(sx_sz(nslots, open));
+    signaturet sig;
+    sxelem*    sxep;
+    size_t     nfound = 0;
+    double     start, insertRate, dupRate, newRate, evictRate;
+
+    if (sxp == NULL) {
+        log_add_syserr("Couldn't allocate signature-index");
+        return -1;
+    }
+    sx_init(sxp, nslots, open);
+
+    start = now();
+    for (size_t i = 0; i < nslots; i++) {
+        set_signature(sig, i);
+        if (sx_add(sxp, sig, (off_t)i) == NULL) {
+            log_add("sx_add() failure");
+            free(sxp);
+            return -1;
+        }
+    }
+    insertRate = nslots/(now() - start);
+
+    start = now();
+    for (size_t i = 0; i < nslots; i++) {
+        set_signature(sig, i * 7919 % nslots);
+        nfound += sx_find(sxp, sig, &sxep);
+    }
+    dupRate = nslots/(now() - start);
+
+    start = now();
+    for (size_t i = nslots; i < 2*nslots; i++) {
+        set_signature(sig, i);
+        nfound += sx_find(sxp, sig, &sxep);
+    }
+    newRate = nslots/(now() - start);
+
+    start = now();
+    for (size_t i = 0; i < nslots; i++) {
+        set_signature(sig, i);
+        nfound -= sx_find_delete(sxp, sig);
+        set_signature(sig, nslots + i);
+        (void)sx_add(sxp, sig, (off_t)i);
+    }
+    evictRate = nslots/(now() - start);
+
+    free(sxp);
+    if (nfound != 0) {
+        log_add("Signature-index is inconsistent");
+        return -1;
+    }
+
+    (void)printf("%-8s %9zu signatures: %10.0f inserts/s, %10.0f "
+            "duplicates/s, %10.0f new/s, %10.0f evictions/s\n",
+            open ? "open" : "chained", nslots, insertRate, dupRate, newRate,
+            evictRate);
+    return 0;
+}
+
+int
+main(
+        const int          argc,
+        const char* const* argv)
+{
+    static const size_t defaults[] = {1000000, 10000000};
+    int                 status = 0;
+
+    if (log_init(argv[0])) {
+        (void)fprintf(stderr, "Couldn't initialize logging\n");
+        return 1;
+    }
+
+    for (int i = 0; status == 0 && i < (argc > 1 ? argc - 1 : 2); i++) {
+        const size_t nslots = argc > 1
+                ? strtoul(argv[i+1], NULL, 0)
+                : defaults[i];
+
+        if (nslots < SX_EXP_CHAIN_LEN) {
+            log_add("Invalid number of signatures: \"%s\"", argv[i+1]);
+            status = -1;
+        }
+        else {
+            status = bench(nslots, false);
+            if (status == 0)
+                status = bench(nslots, true);
+        }
+    }
+
+    if (status)
+        log_flush_error();
+    log_fini();
+
+    return status ? 1 : 0;
+}
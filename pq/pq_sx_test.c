@@ -0,0 +1,147 @@
+/**
+ * Copyright 2026 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: pq_sx_test.c
+ *
+ * This file tests the open-addressed signature-index (PQ_SXOPEN) against
+ * signatures that collide. The index functions are static, so this file
+ * includes the implementation.
+ */
+
+#include "pq.c"
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#define NALLOC 3000     /* number of products of the index */
+
+static sxo* sxop;
+
+static int
+setup(void)
+{
+    sxop = malloc(sx_sz(NALLOC, true));
+    if (sxop == NULL)
+        return -1;
+    sx_init((sx*)sxop, NALLOC, true);
+    return 0;
+}
+
+static int
+teardown(void)
+{
+    free(sxop);
+    return 0;
+}
+
+/*
+ * Sets a signature from a sequence number.
+ */
+static void
+set_signature(
+        signaturet     sig,
+        const uint64_t i)
+{
+    (void)memset(sig, 0, sizeof(signaturet));
+    (void)memcpy(sig, &i, sizeof(i));
+}
+
+static void
+test_seed(void)
+{
+    sxo* const other = malloc(sx_sz(NALLOC, true));
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(other);
+    sx_init((sx*)other, NALLOC, true);
+    CU_ASSERT_NOT_EQUAL(sxop->seed, other->seed);
+    free(other);
+}
+
+/*
+ * Adds more signatures with the same home slot than the maximum probe distance
+ * allows, as an upstream LDM that knew the hash could. The excess ones must be
+ * refused and the others must stay findable.
+ */
+static void
+test_collisions(void)
+{
+    const size_t home = sxop->nslots / 2;
+    signaturet   sig;
+    uint64_t     i = 0;
+    unsigned     nadded = 0;
+    unsigned     nrefused = 0;
+
+    while (nrefused < 10) {
+        CU_ASSERT_FATAL(i < UINT64_C(100000000));
+        set_signature(sig, i++);
+        if (sxo_home(sxop, sxo_hash(sxop->seed, sig)) != home)
+            continue;
+
+        sxelem* const sxep = sx_add((sx*)sxop, sig, (off_t)i);
+        if (sxep == NULL) {
+            nrefused++;
+        }
+        else {
+            CU_ASSERT_EQUAL(sxep->offset, (off_t)i);
+            nadded++;
+        }
+    }
+    CU_ASSERT_EQUAL(nadded, SXO_MAX_DIST);
+    CU_ASSERT_EQUAL(sxop->nelems, nadded);
+
+    /* Every added signature is findable and the refused ones aren't */
+    unsigned nfound = 0;
+    for (uint64_t j = 0; j < i; j++) {
+        sxelem* sxep;
+
+        set_signature(sig, j);
+        if (sx_find((sx*)sxop, sig, &sxep)) {
+            CU_ASSERT_EQUAL(sxep->offset, (off_t)(j + 1));
+            nfound++;
+        }
+    }
+    CU_ASSERT_EQUAL(nfound, nadded);
+
+    /* A signature with another home slot can still be added */
+    for (;;) {
+        set_signature(sig, i++);
+        const size_t other = sxo_home(sxop, sxo_hash(sxop->seed, sig));
+        if (other < home - 1 || other > home + SXO_MAX_DIST + 1)
+            break;
+    }
+    CU_ASSERT_PTR_NOT_NULL(sx_add((sx*)sxop, sig, (off_t)i));
+}
+
+int
+main(
+        const int          argc,
+        const char* const* argv)
+{
+    int exitCode = 1;
+
+    if (log_init(argv[0])) {
+        (void)fprintf(stderr, "Couldn't initialize logging\n");
+    }
+    else {
+        if (CUE_SUCCESS == CU_initialize_registry()) {
+            CU_Suite* testSuite = CU_add_suite(__FILE__, setup, teardown);
+
+            if (NULL != testSuite) {
+                if (CU_ADD_TEST(testSuite, test_seed)
+                        && CU_ADD_TEST(testSuite, test_collisions)) {
+                    CU_basic_set_mode(CU_BRM_VERBOSE);
+                    (void) CU_basic_run_tests();
+                }
+            }
+
+            exitCode = CU_get_number_of_tests_failed();
+            CU_cleanup_registry();
+        }
+
+        log_fini();
+    }
+
+    return exitCode;
+}
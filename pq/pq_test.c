@@ -18,9 +18,12 @@
 #include "log.h"
 #include "pq.h"
 #include "stdbool.h"
+#include "timestamp.h"
 #include "xdr.h"
 
 #include <errno.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdint.h>
 #include <sys/time.h>
 #include <sys/wait.h>
@@ -36,6 +39,24 @@
 #define               PQ_DATA_SIZE     100000000
 #define               PQ_SLOT_COUNT         1000
 #define               NUM_CHILDREN             3
+#define               LOCK_PRODS           20000
+#define               TQRING_SLOTS           100
+#define               RECONNECT_PRODS      20000
+#define               NUM_DOWNSTREAMS        500
+#define               BATCH_SIZE              64
+#define               NEXT_PRODS           10000
+#define               FEED_RATIO             100
+#define               EVICT_DATA_SIZE     100000
+#define               EVICT_SLOTS            200
+#define               FRAG_DATA_SIZE     4000000
+#define               FRAG_SLOTS            2000
+#define               FRAG_PRODS           20000
+#define               CHUNK_DATA_SIZE 40000000
+#define               CHUNK_PROD_SIZE  1000000
+#define               RECOVER_SLOTS         5000
+#define               RECOVER_PRODS         4000
+#define               GROW_DATA_SIZE     1000000
+#define               GROW_SLOTS             100
 static unsigned long  num_bytes;
 static struct timeval start;
 static struct timeval stop;
@@ -228,7 +249,7 @@ static int read_products(
     for (bool done = false; !done;) {
         status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, read_prod, &done);
         if (status == PQUEUE_END) {
-            (void)pq_suspend(0); // Indefinite wait. Unblocks SIGCONT
+            (void)pq_wait(pq, 0); // Indefinite wait
         }
         else {
             CU_ASSERT_EQUAL_FATAL(status, 0);
@@ -353,6 +374,2075 @@ static void test_pq_sequence(void)
     unlink_pq();
 }
 
+typedef struct {
+    long last;   // Last sequence number seen
+    bool ok;     // Products seen were consistent and in order
+    bool done;   // Last product seen
+} check_state;
+
+static int check_prod(
+        const prod_info* const restrict info,
+        const void* const restrict      data,
+        void* const restrict            xprod,
+        const size_t                    size,
+        void* const restrict            arg)
+{
+    check_state* const state = arg;
+    if ((long)info->seqno <= state->last || atol(info->ident) != info->seqno)
+        state->ok = false;
+    state->last = info->seqno;
+    state->done = info->seqno == NUM_PRODS - 1;
+    return 0;
+}
+
+/**
+ * Has several readers sequence through the product-queue while a writer
+ * inserts into it. Readers don't lock the control-region unless a writer
+ * intervenes, so this checks that they never see an inconsistent product.
+ */
+static void test_pq_sequence_readers(void)
+{
+    pqueue* pq = create_pq();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pq);
+    close_pq(pq);
+
+    for (int i = 0; i < NUM_CHILDREN; i++) {
+        int pid = fork();
+        CU_ASSERT_NOT_EQUAL_FATAL(pid, -1);
+        if (pid == 0) {
+            check_state state = {-1, true, false};
+            pq = open_pq(false);
+            while (!state.done) {
+                int status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, check_prod,
+                        &state);
+                if (status == PQUEUE_END) {
+                    (void)pq_wait(pq, 0); // Indefinite wait
+                }
+                else if (status) {
+                    exit(1);
+                }
+            }
+            close_pq(pq);
+            exit(state.ok ? 0 : 2);
+        }
+    }
+
+    pq = open_pq(true);
+    int status = insert_products(pq, insert_prod);
+    CU_ASSERT_EQUAL(status, 0);
+    close_pq(pq);
+
+    for (;;) {
+        int child_status;
+        status = wait(&child_status);
+        if (status == -1 && errno == ECHILD)
+            break;
+        CU_ASSERT_NOT_EQUAL_FATAL(status, -1);
+        CU_ASSERT_TRUE(WIFEXITED(child_status));
+        CU_ASSERT_EQUAL(WEXITSTATUS(child_status), 0);
+    }
+
+    unlink_pq();
+}
+
+static void test_pq_notify(void)
+{
+    pqueue* pq = create_pq();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pq);
+    close_pq(pq);
+
+    pq = open_pq(false);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pq);
+    unsigned seq;
+    int      status = pq_getInsertSeq(pq, &seq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    int      fd;
+    status = pq_getNotifyFd(pq, &fd);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    struct timespec timeout = {0, 100000000}; // 100 ms
+    status = pq_waitForInsert(pq, seq, &timeout);
+    CU_ASSERT_EQUAL(status, ETIMEDOUT);
+
+    int pid = fork();
+    CU_ASSERT_NOT_EQUAL(pid, -1);
+    if (pid == 0) {
+        pqueue* wpq = open_pq(true);
+        char    data[1] = {0};
+        product prod;
+        prod.info.feedtype = EXP;
+        prod.info.ident = "notify";
+        prod.info.origin = "localhost";
+        prod.info.seqno = 0;
+        prod.info.sz = sizeof(data);
+        (void)memset(prod.info.signature, 1, sizeof(prod.info.signature));
+        (void)set_timestamp(&prod.info.arrival);
+        prod.data = data;
+        status = pq_insert(wpq, &prod);
+        CU_ASSERT_EQUAL(status, 0);
+        close_pq(wpq);
+        exit(0);
+    }
+
+    timeout.tv_sec = 5;
+    timeout.tv_nsec = 0;
+    status = pq_waitForInsert(pq, seq, &timeout);
+    CU_ASSERT_EQUAL(status, 0);
+
+    struct pollfd pfd = {fd, POLLIN, 0};
+    status = poll(&pfd, 1, 5000);
+    CU_ASSERT_EQUAL(status, 1);
+
+    int child_status;
+    status = wait(&child_status);
+    CU_ASSERT_EQUAL(status, pid);
+    CU_ASSERT_TRUE(WIFEXITED(child_status));
+    CU_ASSERT_EQUAL(WEXITSTATUS(child_status), 0);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+static void init_small_prod(
+        product* const prod,
+        char* const    data,
+        const size_t   size)
+{
+    prod->info.feedtype = EXP;
+    prod->info.ident = "lock";
+    prod->info.origin = "localhost";
+    prod->info.seqno = 0;
+    prod->info.sz = size;
+    (void)memset(prod->info.signature, 0, sizeof(prod->info.signature));
+    (void)memset(data, 0, size);
+    prod->data = data;
+}
+
+static int count_prod(
+        const prod_info* const restrict info,
+        const void* const restrict      data,
+        void* const restrict            xprod,
+        const size_t                    size,
+        void* const restrict            arg)
+{
+    ++*(unsigned long*)arg;
+    return 0;
+}
+
+/**
+ * Measures the rates of insertion and sequencing of small data-products,
+ * which are dominated by locking of the control-region.
+ *
+ * @param[in]  pflags      Flags for `pq_create()`
+ * @param[out] insertRate  Insertions per second
+ * @param[out] seqRate     Calls of `pq_sequence()` per second
+ */
+static void time_lock(
+        const int     pflags,
+        double* const insertRate,
+        double* const seqRate)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, pflags, 0, PQ_DATA_SIZE,
+            LOCK_PRODS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char     data[100];
+    product  prod;
+    init_small_prod(&prod, data, sizeof(data));
+    (void)set_timestamp(&prod.info.arrival);
+    prod.info.arrival.tv_usec = 0;
+    const time_t sec = prod.info.arrival.tv_sec;
+
+    (void)gettimeofday(&start, NULL);
+    for (uint32_t i = 0; i < LOCK_PRODS; i++) {
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        prod.info.arrival.tv_sec = sec + i/1000000; // Distinct times
+        prod.info.arrival.tv_usec = i%1000000;
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    (void)gettimeofday(&stop, NULL);
+    *insertRate = LOCK_PRODS/duration(&stop, &start);
+
+    unsigned long count = 0;
+    pq_cset(pq, &TS_ZERO);
+    (void)gettimeofday(&start, NULL);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, count_prod, &count))
+            == 0)
+        ;
+    (void)gettimeofday(&stop, NULL);
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_TRUE(count > 0);
+    *seqRate = count/duration(&stop, &start);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+static void test_pq_lock_rates(void)
+{
+    double insertRate, seqRate;
+
+    time_lock(0, &insertRate, &seqRate);
+    log_notice_q("fcntl(2) locking: %g insertions/s, %g sequence-steps/s",
+            insertRate, seqRate);
+    time_lock(PQ_ROBUST, &insertRate, &seqRate);
+    log_notice_q("Robust locking:   %g insertions/s, %g sequence-steps/s",
+            insertRate, seqRate);
+}
+
+/**
+ * Measures the rate of insertion of small (1-4 KB), bulletin-like
+ * data-products one at a time and in batches.
+ *
+ * @param[in]  batch  Whether to insert in batches by `pq_insertv()`
+ * @param[out] rate   Insertions per second
+ */
+static void time_insertv(
+        const bool    batch,
+        double* const rate)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, 0, 0, PQ_DATA_SIZE,
+            LOCK_PRODS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    static char data[BATCH_SIZE][4096];
+    product     prods[BATCH_SIZE];
+    int         statuses[BATCH_SIZE];
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        init_small_prod(prods + i, data[i], 1024 + i*3072/BATCH_SIZE);
+        (void)set_timestamp(&prods[i].info.arrival);
+    }
+
+    (void)gettimeofday(&start, NULL);
+    for (uint32_t i = 0; i < LOCK_PRODS; i += BATCH_SIZE) {
+        for (uint32_t j = 0; j < BATCH_SIZE; j++) {
+            const uint32_t k = i + j;
+            (void)memcpy(prods[j].info.signature, &k, sizeof(k));
+        }
+        if (batch) {
+            status = pq_insertv(pq, prods, BATCH_SIZE, statuses);
+            CU_ASSERT_EQUAL_FATAL(status, 0);
+        }
+        else {
+            for (int j = 0; j < BATCH_SIZE; j++)
+                statuses[j] = pq_insert(pq, prods + j);
+        }
+        for (int j = 0; j < BATCH_SIZE; j++)
+            CU_ASSERT_EQUAL_FATAL(statuses[j], 0);
+    }
+    (void)gettimeofday(&stop, NULL);
+    *rate = LOCK_PRODS/BATCH_SIZE*BATCH_SIZE/duration(&stop, &start);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Checks the vectored insertion functions and compares their rate with that
+ * of inserting one data-product at a time.
+ */
+static void test_pq_insertv(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, 0, 0, PQ_DATA_SIZE,
+            TQRING_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char      data[3][100];
+    product   prods[3];
+    prod_info infos[3];
+    void*     ptrs[3];
+    pqe_index indexes[3];
+    int       statuses[3];
+    for (uint32_t i = 0; i < 3; i++) {
+        init_small_prod(prods + i, data[i], sizeof(data[i]));
+        (void)set_timestamp(&prods[i].info.arrival);
+        (void)memcpy(prods[i].info.signature, &i, sizeof(i));
+    }
+    (void)memcpy(prods[2].info.signature, prods[0].info.signature,
+            sizeof(signaturet));
+
+    // A duplicate within the batch is rejected
+    status = pq_insertv(pq, prods, 3, statuses);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(statuses[0], 0);
+    CU_ASSERT_EQUAL(statuses[1], 0);
+    CU_ASSERT_EQUAL(statuses[2], PQ_DUP);
+
+    // Reservations: one is new, one is in the queue, and one is in the batch
+    for (uint32_t i = 0; i < 3; i++) {
+        const uint32_t k = i ? 2 : 1;
+        infos[i] = prods[i].info;
+        (void)memcpy(infos[i].signature, &k, sizeof(k));
+    }
+    status = pqe_newv(pq, infos, 3, ptrs, indexes, statuses);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(statuses[0], PQ_DUP);
+    CU_ASSERT_EQUAL(statuses[1], 0);
+    CU_ASSERT_EQUAL(statuses[2], PQ_DUP);
+    (void)memcpy(ptrs[1], data[1], infos[1].sz);
+    status = pqe_insertv(pq, indexes + 1, 1, statuses);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(statuses[0], 0);
+    CU_ASSERT_EQUAL(pqe_get_count(pq), 0);
+
+    unsigned long count = 0;
+    pq_cset(pq, &TS_ZERO);
+    while (pq_sequence(pq, TV_GT, PQ_CLASS_ALL, count_prod, &count) == 0)
+        ;
+    CU_ASSERT_EQUAL(count, 3);
+
+    close_pq(pq);
+    unlink_pq();
+
+    double rate;
+    time_insertv(false, &rate);
+    log_notice_q("1-4 KB products: %g insertions/s one at a time", rate);
+    time_insertv(true, &rate);
+    log_notice_q("1-4 KB products: %g insertions/s in batches of %d", rate,
+            BATCH_SIZE);
+}
+
+typedef struct {
+    long          last;  // Last sequence number seen
+    bool          ok;    // Products seen were consistent and in order
+    unsigned long count; // Number of products seen
+} next_state;
+
+static void next_prod(
+        const prod_par_t* restrict  prod_par,
+        const queue_par_t* restrict queue_par,
+        void* restrict              app_par)
+{
+    next_state* const state = app_par;
+    const prod_info*  info = &prod_par->info;
+    if ((long)info->seqno <= state->last || atol(info->ident) != info->seqno)
+        state->ok = false;
+    state->last = info->seqno;
+    state->count++;
+}
+
+/**
+ * Measures the rate of sequencing through a product-queue by `pq_next()` or
+ * `pq_nextv()`.
+ *
+ * @param[in]  pq     The product-queue
+ * @param[in]  nmax   Maximum number of products per call or 0 for `pq_next()`
+ * @param[out] rate   Products per second
+ */
+static void time_next(
+        pqueue* const pq,
+        const size_t  nmax,
+        double* const rate)
+{
+    next_state state = {-1, true, 0};
+    int        status;
+
+    pq_cset(pq, &TS_ZERO);
+    (void)gettimeofday(&start, NULL);
+    do {
+        status = nmax
+            ? pq_nextv(pq, PQ_CLASS_ALL, next_prod, nmax, &state, NULL)
+            : pq_next(pq, false, PQ_CLASS_ALL, next_prod, false, &state);
+    } while (status == 0);
+    (void)gettimeofday(&stop, NULL);
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_TRUE(state.ok);
+    CU_ASSERT_EQUAL(state.count, NEXT_PRODS);
+    *rate = state.count/duration(&stop, &start);
+}
+
+/**
+ * Checks that `pq_nextv()` visits data-products in order, only calls the
+ * function for matching ones, and advances the cursor; and compares its rate
+ * with that of `pq_next()`.
+ */
+static void test_pq_nextv(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, 0, 0, PQ_DATA_SIZE,
+            LOCK_PRODS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char    data[100];
+    char    ident[80];
+    product prod;
+    init_small_prod(&prod, data, sizeof(data));
+    prod.info.ident = ident;
+    for (uint32_t i = 0; i < NEXT_PRODS; i++) {
+        (void)snprintf(ident, sizeof(ident), "%u", i);
+        prod.info.seqno = i;
+        prod.info.feedtype = (i % 3) ? EXP : SPARE;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    // Only every third product matches. The pattern needn't be compiled.
+    prod_spec    spec = {SPARE, ".*"};
+    prod_class_t clss = {TS_ZERO, TS_ENDT, {1, &spec}};
+    next_state   state = {-1, true, 0};
+    size_t       nvisited, total = 0;
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_nextv(pq, &clss, next_prod, 10, &state, &nvisited))
+            == 0) {
+        CU_ASSERT_TRUE(nvisited > 0 && nvisited <= 10);
+        total += nvisited;
+    }
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_EQUAL(nvisited, 0);
+    CU_ASSERT_TRUE(state.ok);
+    CU_ASSERT_EQUAL(total, NEXT_PRODS);
+    CU_ASSERT_EQUAL(state.count, (NEXT_PRODS + 2)/3);
+    CU_ASSERT_EQUAL(state.last, (NEXT_PRODS - 1)/3*3);
+
+    double rate;
+    time_next(pq, 0, &rate);
+    log_notice_q("pq_next():      %g products/s", rate);
+    time_next(pq, 64, &rate);
+    log_notice_q("pq_nextv(, 64): %g products/s", rate);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Fills a small product-queue, has `pq_evict()` make room, and checks that the
+ * targets are met, that the oldest products were deleted, and that the
+ * minimum virtual residence time metrics were set.
+ */
+static void test_pq_evict(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, 0, 0, EVICT_DATA_SIZE,
+            EVICT_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char     data[1000];
+    char     ident[80];
+    product  prod;
+    init_small_prod(&prod, data, sizeof(data));
+    prod.info.ident = ident;
+    for (uint32_t i = 0; i < 2*EVICT_DATA_SIZE/sizeof(data); i++) {
+        (void)snprintf(ident, sizeof(ident), "%u", i);
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    size_t nprods0, nprods, nempty, maxextent, ndeleted;
+    status = pq_stats(pq, &nprods0, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+            NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    status = pq_evict(pq, 10*sizeof(data), EVICT_SLOTS/2, &ndeleted);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_TRUE(ndeleted > 0);
+    status = pq_stats(pq, &nprods, NULL, &nempty, NULL, NULL, NULL, NULL, NULL,
+            NULL, &maxextent);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(nprods, nprods0 - ndeleted);
+    CU_ASSERT_TRUE(maxextent >= 10*sizeof(data));
+    CU_ASSERT_TRUE(nempty >= EVICT_SLOTS/2);
+
+    // Targets that are met delete nothing
+    status = pq_evict(pq, sizeof(data), 1, &ndeleted);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(ndeleted, 0);
+
+    // The newest products remain
+    check_state state = {-1, true, false};
+    unsigned long count = 0;
+    state.last = 2*EVICT_DATA_SIZE/sizeof(data) - nprods - 1;
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, check_prod, &state))
+            == 0)
+        count++;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_TRUE(state.ok);
+    CU_ASSERT_EQUAL(count, nprods);
+
+    timestampt mvrt;
+    off_t      mvrtSize;
+    size_t     mvrtSlots;
+    status = pq_getMinVirtResTimeMetrics(pq, &mvrt, &mvrtSize, &mvrtSlots);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_FALSE(tvIsNone(mvrt));
+    CU_ASSERT_TRUE(mvrtSize > 0 && mvrtSize <= pq_getDataSize(pq));
+    CU_ASSERT_TRUE(mvrtSlots > 0 && mvrtSlots <= EVICT_SLOTS);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Inserts a mix of small and large products into a product-queue that
+ * allocates by extent or by size-class and checks the fragmentation metrics
+ * and the consistency of the region-list.
+ *
+ * @param[in]  pflags     Product-queue flags
+ * @param[out] evictions  Number of products deleted per insertion
+ */
+static void
+frag_run(
+        const int     pflags,
+        double* const evictions)
+{
+    pqueue*       pq;
+    int           status = pq_create(PQ_PATHNAME, 0600, pflags, 0,
+            FRAG_DATA_SIZE, FRAG_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    static char   data[300000];
+    product       prod;
+    unsigned long rand = 1;
+    init_small_prod(&prod, data, 0);
+    for (uint32_t i = 0; i < FRAG_PRODS; i++) {
+        rand = rand * 1103515245 + 12345;
+        // Every 25th product is large
+        prod.info.sz = (i % 25)
+                ? 100 + (rand >> 8) % 8000
+                : 100000 + (rand >> 8) % 200000;
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    bool               classes;
+    size_t             nprods, nfree, maxextent, fragMaxextent, classbytes;
+    size_t             hist[PQ_FRAG_BINS];
+    unsigned long long ninserts, nevictions;
+    status = pq_stats(pq, &nprods, &nfree, NULL, NULL, NULL, NULL, NULL, NULL,
+            NULL, &maxextent);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    status = pq_fragStats(pq, &classes, &classbytes, &fragMaxextent, hist,
+            &ninserts, &nevictions);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(classes, (pflags & PQ_RLCLASS) != 0);
+    if (!classes)
+        CU_ASSERT_EQUAL(classbytes, 0);
+    CU_ASSERT_EQUAL(fragMaxextent, maxextent);
+    CU_ASSERT_EQUAL(ninserts, FRAG_PRODS);
+    CU_ASSERT_TRUE(nevictions > 0 && nevictions < FRAG_PRODS);
+    size_t nregions = 0;
+    for (int i = 0; i < PQ_FRAG_BINS; i++)
+        nregions += hist[i];
+    CU_ASSERT_EQUAL(nregions, nfree);
+    *evictions = (double)nevictions / ninserts;
+
+    unsigned long count = 0;
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, count_prod, &count))
+            == 0)
+        ;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_EQUAL(count, nprods);
+    close_pq(pq);
+
+    // The region-list, including any size-classes, is consistent
+    unsigned rebuilt;
+    size_t   nrecovered, nfreed;
+    status = pq_recover(PQ_PATHNAME, 0, &rebuilt, &nrecovered, &nfreed);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(rebuilt, 0);
+    CU_ASSERT_EQUAL(nrecovered, nprods);
+    CU_ASSERT_EQUAL(nfreed, 0);
+
+    // The allocation policy and the metrics are persisted
+    pq = open_pq(false);
+    status = pq_fragStats(pq, &classes, NULL, NULL, NULL, &ninserts, NULL);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(classes, (pflags & PQ_RLCLASS) != 0);
+    CU_ASSERT_EQUAL(ninserts, FRAG_PRODS);
+    close_pq(pq);
+    unlink_pq();
+}
+
+static void test_pq_rlclass(void)
+{
+    double byExtent, byClass;
+
+    frag_run(0, &byExtent);
+    frag_run(PQ_RLCLASS, &byClass);
+    log_notice_q("Evictions per insertion: %g by extent, %g by size-class",
+            byExtent, byClass);
+}
+
+static void fill_chunk_prod(
+        char* const    data,
+        const size_t   size,
+        const uint32_t seqno)
+{
+    for (size_t j = 0; j < size; j++)
+        data[j] = (char)(j*7 + seqno);
+}
+
+static int check_chunk_prod(
+        const prod_info* const restrict info,
+        const void* const restrict      data,
+        void* const restrict            xprod,
+        const size_t                    size,
+        void* const restrict            arg)
+{
+    const char* const cp = data;
+    size_t            j;
+
+    for (j = 0; j < info->sz && cp[j] == (char)(j*7 + info->seqno); j++)
+        ;
+    if (j == info->sz)
+        ++*(unsigned long*)arg;
+    return 0;
+}
+
+/**
+ * Fragments the free space of a product-queue that stores large products as
+ * chains of chunks (PQ_CHUNKED) into holes smaller than a large product, and
+ * checks that large products inserted by `pq_insert()` and by
+ * `pqe_new()`/`pqe_insert()` then delete nothing, read back intact, and free
+ * their chunks when they're evicted.
+ */
+static void test_pq_chunked(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, PQ_CHUNKED, 0,
+            CHUNK_DATA_SIZE, FRAG_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_TRUE(pq_getFlags(pq) & PQ_CHUNKED);
+
+    static char data[10*CHUNK_PROD_SIZE];
+    product     prod;
+    uint32_t    seqno = 0;
+    init_small_prod(&prod, data, CHUNK_PROD_SIZE);
+
+    // Fill the queue with 1 MB products
+    const uint32_t nfill = CHUNK_DATA_SIZE/CHUNK_PROD_SIZE - 2;
+    for (; seqno < nfill; seqno++) {
+        prod.info.seqno = seqno;
+        fill_chunk_prod(data, CHUNK_PROD_SIZE, seqno);
+        (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    // Delete alternate runs of five products, leaving four 5 MB holes
+    size_t     extent;
+    timestampt ts;
+    pq_cset(pq, &TS_ZERO);
+    for (uint32_t i = 0; i < 35; i++) {
+        if ((i / 5) % 2 == 0) {
+            status = pq_seqdel(pq, TV_GT, PQ_CLASS_ALL, 0, &extent, &ts);
+        }
+        else {
+            unsigned long count = 0;
+            status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, count_prod, &count);
+        }
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    size_t             maxextent;
+    unsigned long long nevictions0, nevictions;
+    status = pq_fragStats(pq, NULL, NULL, &maxextent, NULL, NULL,
+            &nevictions0);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_TRUE(maxextent < 7*CHUNK_PROD_SIZE);
+
+    // Insert large products into the holes
+    static const size_t sizes[] = {10*CHUNK_PROD_SIZE, 6*CHUNK_PROD_SIZE};
+    for (int k = 0; k < 2; k++, seqno++) {
+        prod.info.sz = sizes[k];
+        prod.info.seqno = seqno;
+        (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+        (void)set_timestamp(&prod.info.arrival);
+        fill_chunk_prod(data, sizes[k], seqno);
+        if (k == 0) {
+            status = pq_insert(pq, &prod);
+        }
+        else {
+            void*     ptr;
+            pqe_index index;
+            status = pqe_new(pq, &prod.info, &ptr, &index);
+            CU_ASSERT_EQUAL_FATAL(status, 0);
+            (void)memcpy(ptr, data, sizes[k]);
+            status = pqe_insert(pq, index);
+        }
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    status = pq_fragStats(pq, NULL, NULL, NULL, NULL, NULL, &nevictions);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(nevictions, nevictions0);
+
+    // Every product reads back intact
+    size_t        nprods;
+    unsigned long nok = 0;
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, check_chunk_prod,
+            &nok)) == 0)
+        ;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    status = pq_stats(pq, &nprods, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+            NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(nok, nfill - 20 + 2);
+    CU_ASSERT_EQUAL(nprods, nok + 3 + 2); // Each chunk takes a slot
+    close_pq(pq);
+
+    // Evicting the large products frees their chunks
+    pq = open_pq(true);
+    CU_ASSERT_TRUE(pq_getFlags(pq) & PQ_CHUNKED);
+    prod.info.sz = CHUNK_PROD_SIZE;
+    fill_chunk_prod(data, CHUNK_PROD_SIZE, 0);
+    for (uint32_t i = 0; i < 2*nfill; i++, seqno++) {
+        prod.info.seqno = seqno;
+        (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    unsigned long count = 0;
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, count_prod, &count))
+            == 0)
+        ;
+    status = pq_stats(pq, &nprods, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+            NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(nprods, count);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Inserts an XDR-encoded product whose creation-time is replaced by two
+ * arbitrary 32-bit words, as an upstream LDM could send it.
+ *
+ * @param[in] pq     Product-queue
+ * @param[in] prod   Product
+ * @param[in] words  Replacement of the creation-time in the order of the bytes
+ *                   of the encoded product
+ * @retval    0      Success
+ * @return           pqe_newDirect() or pqe_insert() error code
+ */
+static int insert_raw_time(
+        pqueue* const restrict  pq,
+        product* const restrict prod,
+        const uint32_t          words[2])
+{
+    char*     space;
+    pqe_index index;
+    size_t    extent = xlen_product(prod);
+    int       status = pqe_newDirect(pq, extent, prod->info.signature,
+            &space, &index);
+
+    if (status == 0) {
+        XDR xdrs;
+        xdrmem_create(&xdrs, space, extent, XDR_ENCODE);
+        CU_ASSERT_TRUE_FATAL(xdr_product(&xdrs, prod));
+        (void)memcpy(space, words, 2*sizeof(uint32_t));
+        status = pqe_insert(pq, index);
+    }
+    return status;
+}
+
+static int get_seqno(
+        const prod_info* const restrict info,
+        const void* const restrict      data,
+        void* const restrict            xprod,
+        const size_t                    size,
+        void* const restrict            arg)
+{
+    unsigned long nok = 0;
+    (void)check_chunk_prod(info, data, xprod, size, &nok);
+    *(long*)arg = nok ? (long)info->seqno : -1;
+    return 0;
+}
+
+/**
+ * Inserts into a PQ_CHUNKED product-queue a product whose bytes form a valid
+ * chunk map of another product, and checks that it reads back as itself and
+ * that evicting it doesn't free the other product's region.
+ */
+static void test_pq_chunked_mimic(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, PQ_CHUNKED, 0,
+            CHUNK_DATA_SIZE, FRAG_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    static char data[CHUNK_PROD_SIZE];
+    product     prod;
+    init_small_prod(&prod, data, 1000);
+
+    // The product whose region the chunk map references
+    void*     ptr;
+    pqe_index index;
+    fill_chunk_prod(data, prod.info.sz, 0);
+    (void)set_timestamp(&prod.info.arrival);
+    status = pqe_new(pq, &prod.info, &ptr, &index);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    (void)memcpy(ptr, data, prod.info.sz);
+    status = pqe_insert(pq, index);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    /*
+     * The mimic: its creation-time is the magic number and number of chunks
+     * of a chunk map, and its signature is the size of the chunked product
+     * and the offset of the other product's region.
+     */
+    const uint64_t size = prod.info.sz;
+    const off_t    offset = index.offset;
+    const uint32_t words[2] = {htonl(0xC84B4D41), 1};
+    CU_ASSERT_EQUAL_FATAL(sizeof(size) + sizeof(offset), sizeof(signaturet));
+    (void)memcpy(prod.info.signature, &size, sizeof(size));
+    (void)memcpy(prod.info.signature + sizeof(size), &offset, sizeof(offset));
+    prod.info.seqno = 1;
+    fill_chunk_prod(data, prod.info.sz, 1);
+    status = insert_raw_time(pq, &prod, words);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    long seqno = -1;
+    status = pq_processProduct(pq, prod.info.signature, get_seqno, &seqno);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(seqno, 1);
+
+    // Evict both
+    uint32_t       i;
+    const uint32_t nfill = 2*(CHUNK_DATA_SIZE/CHUNK_PROD_SIZE);
+    prod.info.sz = CHUNK_PROD_SIZE;
+    for (i = 2; i < nfill; i++) {
+        prod.info.seqno = i;
+        fill_chunk_prod(data, prod.info.sz, i);
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    size_t        nprods;
+    unsigned long nok = 0;
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, check_chunk_prod,
+            &nok)) == 0)
+        ;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    status = pq_stats(pq, &nprods, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+            NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_TRUE(nok > 0);
+    CU_ASSERT_EQUAL(nprods, nok);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Inserts compressible products into a product-queue that compresses them
+ * (PQ_COMPRESS) by `pq_insert()` and by `pqe_new()`/`pqe_insert()` and checks
+ * that more of them fit than would uncompressed, that they read back intact,
+ * and that they're evicted normally.
+ */
+static void test_pq_compress(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, PQ_COMPRESS, 0,
+            EVICT_DATA_SIZE, EVICT_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_TRUE(pq_getFlags(pq) & PQ_COMPRESS);
+
+    char     data[4000];
+    product  prod;
+    uint32_t seqno;
+    init_small_prod(&prod, data, sizeof(data));
+
+    // Four times the capacity of the queue if uncompressed
+    const uint32_t nfit = 4*EVICT_DATA_SIZE/sizeof(data);
+    for (seqno = 0; seqno < nfit; seqno++) {
+        prod.info.seqno = seqno;
+        fill_chunk_prod(data, sizeof(data), seqno);
+        (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+        (void)set_timestamp(&prod.info.arrival);
+        if (seqno % 2) {
+            status = pq_insert(pq, &prod);
+        }
+        else {
+            void*     ptr;
+            pqe_index index;
+            status = pqe_new(pq, &prod.info, &ptr, &index);
+            CU_ASSERT_EQUAL_FATAL(status, 0);
+            (void)memcpy(ptr, data, sizeof(data));
+            status = pqe_insert(pq, index);
+        }
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    feedtypet          feeds;
+    unsigned long long in, out;
+    status = pq_getCompression(pq, &feeds, &in, &out);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(feeds, ANY);
+    CU_ASSERT_EQUAL(in, nfit*sizeof(data));
+    CU_ASSERT_TRUE(out < in/4);
+
+    size_t        nprods;
+    unsigned long nok = 0;
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, check_chunk_prod,
+            &nok)) == 0)
+        ;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    status = pq_stats(pq, &nprods, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+            NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(nprods, nfit);
+    CU_ASSERT_EQUAL(nok, nfit);
+    close_pq(pq);
+
+    // Compressed products are evicted normally and compression can be disabled
+    pq = open_pq(true);
+    CU_ASSERT_TRUE(pq_getFlags(pq) & PQ_COMPRESS);
+    for (uint32_t i = 0; i < 2*nfit; i++, seqno++) {
+        prod.info.seqno = seqno;
+        fill_chunk_prod(data, sizeof(data), seqno);
+        (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    status = pq_setCompression(pq, NONE);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    prod.info.seqno = seqno;
+    fill_chunk_prod(data, sizeof(data), seqno);
+    (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+    (void)set_timestamp(&prod.info.arrival);
+    status = pq_insert(pq, &prod);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    status = pq_getCompression(pq, &feeds, &in, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(feeds, NONE);
+    CU_ASSERT_EQUAL(in, 3*nfit*sizeof(data));
+
+    nok = 0;
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, check_chunk_prod,
+            &nok)) == 0)
+        ;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    status = pq_stats(pq, &nprods, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+            NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_TRUE(nprods < 3*nfit + 1);
+    CU_ASSERT_EQUAL(nok, nprods);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Inserts into a PQ_COMPRESS product-queue products whose creation-time is the
+ * header of a compressed product -- one stored as is and one that's
+ * compressed -- and checks that they read back as themselves and are evicted
+ * normally.
+ */
+static void test_pq_compress_mimic(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, PQ_COMPRESS, 0,
+            EVICT_DATA_SIZE, EVICT_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char           data[4000];
+    product        prod;
+    uint32_t       seqno;
+    const uint32_t words[2] = {htonl(0xC85A4C42), htonl(100)};
+    init_small_prod(&prod, data, sizeof(data));
+
+    for (seqno = 0; seqno < 2; seqno++) {
+        status = pq_setCompression(pq, seqno ? ANY : NONE);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+        prod.info.seqno = seqno;
+        fill_chunk_prod(data, sizeof(data), seqno);
+        (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+        (void)set_timestamp(&prod.info.arrival);
+        status = insert_raw_time(pq, &prod, words);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    unsigned long long in;
+    status = pq_getCompression(pq, NULL, &in, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(in, sizeof(data));
+
+    for (seqno = 0; seqno < 2; seqno++) {
+        long got = -1;
+        (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+        status = pq_processProduct(pq, prod.info.signature, get_seqno, &got);
+        CU_ASSERT_EQUAL(status, 0);
+        CU_ASSERT_EQUAL(got, seqno);
+    }
+
+    // Evict both
+    const uint32_t nfit = 4*EVICT_DATA_SIZE/sizeof(data);
+    for (; seqno < nfit; seqno++) {
+        prod.info.seqno = seqno;
+        fill_chunk_prod(data, sizeof(data), seqno);
+        (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    size_t        nprods;
+    unsigned long nok = 0;
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, check_chunk_prod,
+            &nok)) == 0)
+        ;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    status = pq_stats(pq, &nprods, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+            NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_TRUE(nok > 0);
+    CU_ASSERT_EQUAL(nprods, nok);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Checks that a product-queue that remembers the signatures of evicted
+ * products (PQ_EVSIGS) rejects their late duplicates until the horizon.
+ */
+static void test_pq_evsigs(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, PQ_EVSIGS, 0, EVICT_DATA_SIZE,
+            EVICT_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_TRUE(pq_getFlags(pq) & PQ_EVSIGS);
+
+    char     data[1000];
+    product  prod;
+    uint32_t i;
+    init_small_prod(&prod, data, sizeof(data));
+    for (i = 0; i < 2*EVICT_DATA_SIZE/sizeof(data); i++) {
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    close_pq(pq);
+
+    // The first product was evicted but is still a duplicate
+    pq = open_pq(true);
+    CU_ASSERT_TRUE(pq_getFlags(pq) & PQ_EVSIGS);
+    i = 0;
+    (void)memcpy(prod.info.signature, &i, sizeof(i));
+    status = pq_insert(pq, &prod);
+    CU_ASSERT_EQUAL(status, PQ_DUP);
+
+    unsigned           horizon;
+    double             history;
+    unsigned long long nlate;
+    status = pq_getEvictedStats(pq, &horizon, &history, &nlate);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(horizon, 3600);
+    CU_ASSERT_TRUE(history >= 0 && history < 60);
+    CU_ASSERT_EQUAL(nlate, 1);
+
+    // It's forgotten after the horizon
+    status = pq_setEvictedHorizon(pq, 1);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    (void)sleep(2);
+    status = pq_insert(pq, &prod);
+    CU_ASSERT_EQUAL(status, 0);
+    status = pq_getEvictedStats(pq, NULL, NULL, &nlate);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(nlate, 1);
+    close_pq(pq);
+    unlink_pq();
+
+    // Without PQ_EVSIGS, there are no statistics
+    pq = create_pq();
+    status = pq_getEvictedStats(pq, NULL, NULL, NULL);
+    CU_ASSERT_EQUAL(status, ENOTSUP);
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Inserts data-products until they've filled a product-queue twice.
+ *
+ * @param[in] pq     The product-queue
+ * @param[in] first  Signature of the first data-product. The others are
+ *                   consecutive.
+ */
+static void fill_evsigs_pq(
+        pqueue* const  pq,
+        const uint32_t first)
+{
+    char     data[1000];
+    product  prod;
+    init_small_prod(&prod, data, sizeof(data));
+    for (uint32_t i = first; i < first + 2*EVICT_DATA_SIZE/sizeof(data); i++) {
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        int status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+}
+
+/**
+ * Checks that a data-product that's evicted a second time is remembered from
+ * its latest eviction rather than its first.
+ */
+static void test_pq_evsigs_latest(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, PQ_EVSIGS, 0, EVICT_DATA_SIZE,
+            5*EVICT_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    status = pq_setEvictedHorizon(pq, 1);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char     data[1000];
+    product  prod;
+    uint32_t i = 0;
+    init_small_prod(&prod, data, sizeof(data));
+    (void)memcpy(prod.info.signature, &i, sizeof(i));
+    fill_evsigs_pq(pq, 0);
+
+    // The first eviction is forgotten after the horizon
+    (void)sleep(2);
+    (void)set_timestamp(&prod.info.arrival);
+    status = pq_insert(pq, &prod);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    // The second eviction is remembered
+    fill_evsigs_pq(pq, 1000);
+    status = pq_insert(pq, &prod);
+    CU_ASSERT_EQUAL(status, PQ_DUP);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Checks that a reader that prefetches (PQ_PREFETCH) reads every product and
+ * that the products ahead of its cursor are prefetched as it advances.
+ */
+static void test_pq_prefetch(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, 0, 0, EVICT_DATA_SIZE,
+            EVICT_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char           data[10000];
+    product        prod;
+    const uint32_t nprods = EVICT_DATA_SIZE/sizeof(data) - 2;
+    init_small_prod(&prod, data, sizeof(data));
+    for (uint32_t i = 0; i < nprods; i++) {
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    // A reader doesn't prefetch by default
+    pqueue*            reader = open_pq(false);
+    unsigned           count;
+    unsigned long long nfetched, nbytes, ncold;
+    status = pq_getPrefetchStats(reader, &count, NULL, NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(count, 0);
+    close_pq(reader);
+
+    status = pq_open(PQ_PATHNAME, PQ_READONLY|PQ_PREFETCH, &reader);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    status = pq_getPrefetchStats(reader, &count, NULL, NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_TRUE(count > 0);
+
+    // Fewer products are prefetched at a time than are in the queue
+    status = pq_setPrefetch(reader, 4);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    unsigned long nread = 0;
+    pq_cset(reader, &TS_ZERO);
+    while ((status = pq_sequence(reader, TV_GT, PQ_CLASS_ALL, count_prod,
+            &nread)) == 0)
+        ;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_EQUAL(nread, nprods);
+    status = pq_getPrefetchStats(reader, &count, &nfetched, &nbytes, &ncold);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(count, 4);
+    CU_ASSERT_EQUAL(nfetched, nprods);
+    CU_ASSERT_TRUE(nbytes >= nprods*sizeof(data));
+    CU_ASSERT_EQUAL(ncold, nprods);
+
+    // Disabling prefetching
+    status = pq_setPrefetch(reader, 0);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    pq_cset(reader, &TS_ZERO);
+    status = pq_sequence(reader, TV_GT, PQ_CLASS_ALL, count_prod, &nread);
+    CU_ASSERT_EQUAL(status, 0);
+    status = pq_getPrefetchStats(reader, &count, &nfetched, NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(count, 0);
+    CU_ASSERT_EQUAL(nfetched, nprods);
+
+    close_pq(reader);
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Checks that a product-queue that's mapped with huge pages and pre-faulted
+ * works normally.
+ */
+static void test_pq_map(void)
+{
+    int status = pq_setMapDefaults(PQ_READONLY, -1);
+    CU_ASSERT_EQUAL(status, EINVAL);
+    log_clear();
+    status = pq_setMapDefaults(PQ_HUGEPAGES, -2);
+    CU_ASSERT_EQUAL(status, EINVAL);
+    log_clear();
+
+    pqueue* pq;
+    status = pq_create(PQ_PATHNAME, 0600, PQ_HUGEPAGES|PQ_POPULATE, 0,
+            EVICT_DATA_SIZE, EVICT_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char     data[1000];
+    product  prod;
+    uint32_t i;
+    init_small_prod(&prod, data, sizeof(data));
+    for (i = 0; i < EVICT_SLOTS/4; i++) {
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    close_pq(pq);
+
+    status = pq_setMapDefaults(PQ_POPULATE, -1);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    pq = open_pq(false);
+    unsigned long nread = 0;
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, count_prod,
+            &nread)) == 0)
+        ;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_EQUAL(nread, i);
+    close_pq(pq);
+
+    status = pq_setMapDefaults(0, -1);
+    CU_ASSERT_EQUAL(status, 0);
+    unlink_pq();
+}
+
+/**
+ * Checks that a reader registers its cursor, that its lag is reported, and
+ * that deleting products it hasn't read is counted.
+ */
+static void test_pq_consumers(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, 0, 0, EVICT_DATA_SIZE,
+            EVICT_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char     data[1000];
+    product  prod;
+    uint32_t i;
+    init_small_prod(&prod, data, sizeof(data));
+    for (i = 0; i < EVICT_SLOTS/4; i++) { // Nothing's deleted
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    pq_consumer        consumers[PQ_MAXCONSUMERS];
+    size_t             count;
+    unsigned long long overruns;
+    status = pq_getConsumers(pq, consumers, &count, &overruns);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(count, 0);
+    CU_ASSERT_EQUAL(overruns, 0);
+
+    // A reader registers when it positions its cursor
+    pqueue*       reader = open_pq(false);
+    unsigned long nread = 0;
+    pq_cset(reader, &TS_ZERO);
+    for (int j = 0; j < 3; j++) {
+        status = pq_sequence(reader, TV_GT, PQ_CLASS_ALL, count_prod, &nread);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    status = pq_getConsumers(pq, consumers, &count, &overruns);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL_FATAL(count, 1);
+    CU_ASSERT_EQUAL(consumers[0].pid, getpid());
+    CU_ASSERT_EQUAL(consumers[0].lagProds, EVICT_SLOTS/4 - 3);
+    CU_ASSERT_TRUE(consumers[0].lagBytes >= (EVICT_SLOTS/4 - 3)*sizeof(data));
+    CU_ASSERT_TRUE(consumers[0].lag >= 0);
+    CU_ASSERT_EQUAL(consumers[0].overruns, 0);
+
+    // Overrunning the reader is counted
+    for (; i < 2*EVICT_DATA_SIZE/sizeof(data); i++) {
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    size_t nprods;
+    status = pq_stats(pq, &nprods, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+            NULL, NULL);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    status = pq_getConsumers(pq, consumers, &count, &overruns);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL_FATAL(count, 1);
+    CU_ASSERT_EQUAL(consumers[0].lagProds, nprods);
+    CU_ASSERT_EQUAL(consumers[0].overruns, i - 3 - nprods);
+    CU_ASSERT_EQUAL(overruns, consumers[0].overruns);
+
+    // Closing unregisters
+    close_pq(reader);
+    status = pq_getConsumers(pq, consumers, &count, NULL);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(count, 0);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+static int hold_prod(
+        const prod_info* const restrict info,
+        const void* const restrict      data,
+        void* const restrict            xprod,
+        const size_t                    size,
+        void* const restrict            arg)
+{
+    (void)write(*(int*)arg, "x", 1); // The product's region is locked
+    (void)usleep(200000);
+    return 0;
+}
+
+static unsigned long long sum_bins(
+        const unsigned long long* const bins)
+{
+    unsigned long long sum = 0;
+    for (int i = 0; i < PQ_LOCK_BINS; i++)
+        sum += bins[i];
+    return sum;
+}
+
+static void test_pq_lockstats(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, 0, 0, EVICT_DATA_SIZE,
+            EVICT_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    pq_lockstats stats[PQ_LOCK_KINDS];
+    status = pq_getLockStats(pq, stats);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    for (int kind = 0; kind < PQ_LOCK_KINDS; kind++)
+        CU_ASSERT_EQUAL(stats[kind].count, 0);
+
+    char     data[1000];
+    product  prod;
+    uint32_t i;
+    init_small_prod(&prod, data, sizeof(data));
+    for (i = 0; i < EVICT_SLOTS/4; i++) {
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    status = pq_getLockStats(pq, stats);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_TRUE(stats[PQ_LOCK_CTL].writes >= i);
+    CU_ASSERT_TRUE(stats[PQ_LOCK_REGION].writes >= i);
+    CU_ASSERT_EQUAL(stats[PQ_LOCK_MUTEX].count, 0);
+    for (int kind = 0; kind < PQ_LOCK_KINDS; kind++) {
+        // Every lock was released
+        CU_ASSERT_EQUAL(sum_bins(stats[kind].wait), stats[kind].count);
+        CU_ASSERT_EQUAL(sum_bins(stats[kind].hold), stats[kind].count);
+        CU_ASSERT_TRUE(stats[kind].holdMax <= stats[kind].holdNs);
+    }
+
+    // Fill the product-queue so that insertion deletes the oldest product
+    for (; i < 2*EVICT_DATA_SIZE/sizeof(data); i++) {
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    // A product that another process is reading is skipped and counted
+    int fds[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(fds), 0);
+    const pid_t pid = fork();
+    CU_ASSERT_NOT_EQUAL_FATAL(pid, -1);
+    if (pid == 0) {
+        pqueue* reader = open_pq(false);
+        pq_cset(reader, &TS_ZERO);
+        status = pq_sequence(reader, TV_GT, PQ_CLASS_ALL, hold_prod, &fds[1]);
+        close_pq(reader);
+        exit(status ? 1 : 0);
+    }
+    char c;
+    CU_ASSERT_EQUAL_FATAL(read(fds[0], &c, 1), 1);
+    for (int j = 0; j < 10; i++, j++) {
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    int child_status;
+    CU_ASSERT_EQUAL_FATAL(waitpid(pid, &child_status, 0), pid);
+    CU_ASSERT_TRUE(WIFEXITED(child_status));
+    CU_ASSERT_EQUAL(WEXITSTATUS(child_status), 0);
+    (void)close(fds[0]);
+    (void)close(fds[1]);
+
+    status = pq_getLockStats(pq, stats);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_TRUE(stats[PQ_LOCK_REGION].retries >= 1);
+    CU_ASSERT_TRUE(stats[PQ_LOCK_REGION].holdMax >= 150000000);
+    CU_ASSERT_TRUE(stats[PQ_LOCK_REGION].hold[PQ_LOCK_BINS-2] +
+            stats[PQ_LOCK_REGION].hold[PQ_LOCK_BINS-1] >= 1); // >= 2^27 ns
+
+    // The mutex of a thread-safe product-queue is counted
+    pqueue* tsq;
+    status = pq_open(PQ_PATHNAME, PQ_READONLY|PQ_THREADSAFE, &tsq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    unsigned long nread = 0;
+    pq_cset(tsq, &TS_ZERO);
+    status = pq_sequence(tsq, TV_GT, PQ_CLASS_ALL, count_prod, &nread);
+    CU_ASSERT_EQUAL(status, 0);
+    close_pq(tsq);
+    status = pq_getLockStats(pq, stats);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_TRUE(stats[PQ_LOCK_MUTEX].count >= 2);
+    CU_ASSERT_EQUAL(sum_bins(stats[PQ_LOCK_MUTEX].hold),
+            stats[PQ_LOCK_MUTEX].count);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+static void test_pq_robust(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, PQ_ROBUST, 0, PQ_DATA_SIZE,
+            PQ_SLOT_COUNT, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char     data[100];
+    product  prod;
+    init_small_prod(&prod, data, sizeof(data));
+    (void)set_timestamp(&prod.info.arrival);
+    status = pq_insert(pq, &prod);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    /*
+     * Terminate readers while they're likely to hold the control-region lock.
+     * Insertion must still succeed.
+     */
+    for (int i = 0; i < 5; i++) {
+        int pid = fork();
+        CU_ASSERT_NOT_EQUAL_FATAL(pid, -1);
+        if (pid == 0) {
+            pqueue*       rpq = open_pq(false);
+            unsigned long count = 0;
+            for (;;) {
+                pq_cset(rpq, &TS_ZERO);
+                (void)pq_sequence(rpq, TV_GT, PQ_CLASS_ALL, count_prod, &count);
+            }
+        }
+
+        struct timespec pause = {0, 50000000}; // 50 ms
+        (void)nanosleep(&pause, NULL);
+        status = kill(pid, SIGKILL);
+        CU_ASSERT_EQUAL(status, 0);
+        int child_status;
+        status = waitpid(pid, &child_status, 0);
+        CU_ASSERT_EQUAL(status, pid);
+
+        (void)alarm(10); // Default action fails the test
+        uint32_t seqno = i + 1;
+        (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL(status, 0);
+        (void)alarm(0);
+    }
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Inserts into a product-queue whose time-index is a ring enough data-products
+ * to wrap the ring several times while deleting some from its middle, and
+ * checks that the time-index stays consistent and in order.
+ */
+static void test_pq_tqring(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, PQ_TQRING, 0, PQ_DATA_SIZE,
+            TQRING_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char       data[100];
+    char       ident[80];
+    product    prod;
+    signaturet sig;
+    init_small_prod(&prod, data, sizeof(data));
+    prod.info.ident = ident;
+
+    for (uint32_t i = 0; i < 10*TQRING_SLOTS; i++) {
+        (void)snprintf(ident, sizeof(ident), "%u", i);
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+
+        if (i % 7 == 3) {
+            // Leave a hole in the ring
+            const uint32_t j = i - 2;
+            (void)memset(sig, 0, sizeof(sig));
+            (void)memcpy(sig, &j, sizeof(j));
+            status = pq_deleteBySignature(pq, sig);
+            CU_ASSERT_EQUAL(status, 0);
+        }
+    }
+    status = pq_check_time_index(PQ_PATHNAME);
+    CU_ASSERT_EQUAL(status, 0);
+
+    check_state   state = {-1, true, false};
+    unsigned long count = 0;
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, check_prod, &state))
+            == 0)
+        count++;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_TRUE(state.ok);
+    CU_ASSERT_EQUAL(state.last, 10*TQRING_SLOTS - 1);
+    CU_ASSERT_TRUE(count > 0 && count <= TQRING_SLOTS);
+
+    // Position the cursor on a product in the middle of the ring
+    const uint32_t last = 10*TQRING_SLOTS - 10;
+    (void)memset(sig, 0, sizeof(sig));
+    (void)memcpy(sig, &last, sizeof(last));
+    status = pq_setCursorFromSignature(pq, sig);
+    CU_ASSERT_EQUAL(status, 0);
+    state.last = last;
+    status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, check_prod, &state);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_TRUE(state.ok);
+    CU_ASSERT_EQUAL(state.last, last + 1);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Inserts into a product-queue whose signature-index is open-addressed enough
+ * data-products to replace its contents several times, deleting some by
+ * signature, and checks that duplicates are rejected and that deleted and
+ * evicted products are forgotten.
+ */
+static void test_pq_sxopen(void)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, PQ_SXOPEN, 0, PQ_DATA_SIZE,
+            TQRING_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char       data[100];
+    product    prod;
+    signaturet sig;
+    init_small_prod(&prod, data, sizeof(data));
+
+    for (uint32_t i = 0; i < 10*TQRING_SLOTS; i++) {
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL(status, PQ_DUP);
+
+        if (i % 5 == 1) {
+            const uint32_t j = i - 1;
+            (void)memset(sig, 0, sizeof(sig));
+            (void)memcpy(sig, &j, sizeof(j));
+            status = pq_deleteBySignature(pq, sig);
+            CU_ASSERT_EQUAL(status, 0);
+            status = pq_deleteBySignature(pq, sig);
+            CU_ASSERT_EQUAL(status, PQ_NOTFOUND);
+        }
+    }
+
+    // The oldest products were evicted and can be inserted again
+    for (uint32_t i = 0; i < TQRING_SLOTS/2; i++) {
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL(status, 0);
+    }
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+/**
+ * Positions the cursor of a product-queue by the signature of a data-product
+ * and checks that the next data-product is read.
+ *
+ * @param[in] pq    The product-queue
+ * @param[in] last  Sequence number and signature of the data-product
+ */
+static void check_cursor_from_sig(
+        pqueue* const  pq,
+        const uint32_t last)
+{
+    signaturet  sig;
+    check_state state = {last, true, false};
+    (void)memset(sig, 0, sizeof(sig));
+    (void)memcpy(sig, &last, sizeof(last));
+    int status = pq_setCursorFromSignature(pq, sig);
+    CU_ASSERT_EQUAL(status, 0);
+    status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, check_prod, &state);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_TRUE(state.ok);
+    CU_ASSERT_EQUAL(state.last, last + 1);
+}
+
+/**
+ * Terminates a writer of a product-queue while it's inserting a data-product
+ * and checks that `pq_recover()` frees the region of that data-product,
+ * rebuilds only the indexes that are inconsistent, keeps the other
+ * data-products in order, zeros the writer-counter, and that a cursor can be
+ * positioned by signature.
+ *
+ * @param[in] pflags  Flags for `pq_create()`
+ * @param[in] expect  Indexes that should be rebuilt
+ */
+static void recover_run(
+        const int      pflags,
+        const unsigned expect)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, pflags, 0, PQ_DATA_SIZE,
+            RECOVER_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char    data[100];
+    char    ident[80];
+    product prod;
+    init_small_prod(&prod, data, sizeof(data));
+    prod.info.ident = ident;
+    for (uint32_t i = 0; i < RECOVER_PRODS; i++) {
+        (void)snprintf(ident, sizeof(ident), "%u", i);
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    close_pq(pq);
+
+    // A writer terminates after reserving a region for a data-product
+    const uint32_t seqno = RECOVER_PRODS;
+    (void)snprintf(ident, sizeof(ident), "%u", seqno);
+    prod.info.seqno = seqno;
+    (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+    pid_t pid = fork();
+    CU_ASSERT_NOT_EQUAL_FATAL(pid, -1);
+    if (pid == 0) {
+        void*     ptr;
+        pqe_index index;
+        pq = open_pq(true);
+        _exit(pqe_new(pq, &prod.info, &ptr, &index) ? 1 : 0);
+    }
+    int child_status;
+    status = waitpid(pid, &child_status, 0);
+    CU_ASSERT_EQUAL_FATAL(status, pid);
+    CU_ASSERT_TRUE_FATAL(WIFEXITED(child_status) &&
+            WEXITSTATUS(child_status) == 0);
+
+    unsigned count;
+    status = pq_get_write_count(PQ_PATHNAME, &count);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(count, 1);
+
+    unsigned rebuilt;
+    size_t   nprods;
+    size_t   nfreed;
+    status = pq_recover(PQ_PATHNAME, 4, &rebuilt, &nprods, &nfreed);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    CU_ASSERT_EQUAL(rebuilt, expect);
+    CU_ASSERT_EQUAL(nprods, RECOVER_PRODS);
+    CU_ASSERT_EQUAL(nfreed, 1);
+    status = pq_get_write_count(PQ_PATHNAME, &count);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(count, 0);
+    status = pq_check_time_index(PQ_PATHNAME);
+    CU_ASSERT_EQUAL(status, 0);
+
+    // The indexes are now consistent
+    status = pq_recover(PQ_PATHNAME, 0, &rebuilt, &nprods, &nfreed);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(rebuilt, 0);
+    CU_ASSERT_EQUAL(nprods, RECOVER_PRODS);
+    CU_ASSERT_EQUAL(nfreed, 0);
+
+    pq = open_pq(true);
+    check_state   state = {-1, true, false};
+    unsigned long n = 0;
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, check_prod, &state))
+            == 0)
+        n++;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_TRUE(state.ok);
+    CU_ASSERT_EQUAL(n, RECOVER_PRODS);
+    check_cursor_from_sig(pq, RECOVER_PRODS/2);
+
+    // The data-product that was being inserted isn't a duplicate
+    (void)set_timestamp(&prod.info.arrival);
+    status = pq_insert(pq, &prod);
+    CU_ASSERT_EQUAL(status, 0);
+
+    close_pq(pq);
+    unlink_pq();
+}
+
+static void test_pq_recover(void)
+{
+    recover_run(0, PQ_RECOVER_REGIONS | PQ_RECOVER_TIMES | PQ_RECOVER_SIGS);
+    // The insertion-times of an open signature-index are rebuilt, too
+    recover_run(PQ_SXOPEN, PQ_RECOVER_REGIONS | PQ_RECOVER_TIMES |
+            PQ_RECOVER_SIGS);
+    // A ring time-index doesn't share the skip-list blocks
+    recover_run(PQ_TQRING | PQ_SXOPEN, PQ_RECOVER_REGIONS | PQ_RECOVER_SIGS);
+    // The size-classes are reset with the region-list
+    recover_run(PQ_RLCLASS, PQ_RECOVER_REGIONS | PQ_RECOVER_TIMES |
+            PQ_RECOVER_SIGS);
+}
+
+/**
+ * Grows a product-queue that's nearly out of slots while a writer and a reader
+ * have it open and a data-product is being inserted, and checks that the
+ * writer can then insert more data-products without deleting any, that the
+ * reader sees them all in order, that a cursor can be positioned by the
+ * signature of a data-product that preceded the growth, and that the grown
+ * indexes are consistent.
+ *
+ * @param[in] pflags  Flags for `pq_create()`
+ */
+static void grow_run(
+        const int pflags)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, pflags, 0, GROW_DATA_SIZE,
+            GROW_SLOTS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char     data[1000];
+    char     ident[80];
+    product  prod;
+    uint32_t seqno = 0;
+    init_small_prod(&prod, data, sizeof(data));
+    prod.info.ident = ident;
+    for (; seqno < GROW_SLOTS - 10; seqno++) {
+        (void)snprintf(ident, sizeof(ident), "%u", seqno);
+        prod.info.seqno = seqno;
+        (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    pqueue*       reader = open_pq(false);
+    check_state   state = {-1, true, false};
+    unsigned long n = 0;
+    pq_cset(reader, &TS_ZERO);
+    while (n < GROW_SLOTS/2 && pq_sequence(reader, TV_GT, PQ_CLASS_ALL,
+            check_prod, &state) == 0)
+        n++;
+
+    // A data-product is being inserted
+    void*     ptr;
+    pqe_index index;
+    (void)snprintf(ident, sizeof(ident), "%u", seqno);
+    prod.info.seqno = seqno;
+    (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+    (void)set_timestamp(&prod.info.arrival);
+    status = pqe_new(pq, &prod.info, &ptr, &index);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    (void)memset(ptr, 0, prod.info.sz);
+
+    status = pq_grow(PQ_PATHNAME, PQ_SPARSE, GROW_DATA_SIZE, 0);
+    CU_ASSERT_EQUAL(status, EINVAL);
+    log_clear();
+    status = pq_grow(PQ_PATHNAME, PQ_SPARSE, 4*GROW_DATA_SIZE, 0);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    status = pqe_insert(pq, index);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+    seqno++;
+    status = pq_insert(pq, &prod);
+    CU_ASSERT_EQUAL(status, PQ_DUP);
+    for (; seqno < 3*GROW_SLOTS; seqno++) {
+        (void)snprintf(ident, sizeof(ident), "%u", seqno);
+        prod.info.seqno = seqno;
+        (void)memcpy(prod.info.signature, &seqno, sizeof(seqno));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+
+    // Nothing was deleted to make room
+    while ((status = pq_sequence(reader, TV_GT, PQ_CLASS_ALL, check_prod,
+            &state)) == 0)
+        n++;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_TRUE(state.ok);
+    CU_ASSERT_EQUAL(n, 3*GROW_SLOTS);
+    check_cursor_from_sig(reader, GROW_SLOTS/4);
+    close_pq(reader);
+    close_pq(pq);
+
+    unsigned rebuilt;
+    size_t   nprods;
+    size_t   nfreed;
+    status = pq_recover(PQ_PATHNAME, 1, &rebuilt, &nprods, &nfreed);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(rebuilt, 0);
+    CU_ASSERT_EQUAL(nprods, 3*GROW_SLOTS);
+    CU_ASSERT_EQUAL(nfreed, 0);
+
+    unlink_pq();
+}
+
+static void test_pq_grow(void)
+{
+    grow_run(0);
+    grow_run(PQ_TQRING | PQ_SXOPEN | PQ_EVSIGS);
+}
+
+static int next_seq_prod(
+        const prod_info* const restrict info,
+        const void* const restrict      data,
+        void* const restrict            xprod,
+        const size_t                    size,
+        void* const restrict            arg)
+{
+    next_state* const state = arg;
+    if ((long)info->seqno <= state->last || atol(info->ident) != info->seqno)
+        state->ok = false;
+    state->last = info->seqno;
+    state->count++;
+    return 0;
+}
+
+/**
+ * Reads the data-products of a narrow class from a product-queue by
+ * `pq_sequence()`, `pq_next()`, and `pq_nextv()` and checks that exactly those
+ * are seen, in order.
+ *
+ * @param[in]  pq    The product-queue
+ * @param[in]  clss  The class: one product in FEED_RATIO
+ * @param[out] rate  Products visited by `pq_sequence()` per second
+ */
+static void read_narrow(
+        pqueue* const             pq,
+        const prod_class_t* const clss,
+        double* const             rate)
+{
+    const unsigned long nmatch = (NEXT_PRODS + FEED_RATIO - 1)/FEED_RATIO;
+    next_state          state = {-1, true, 0};
+    int                 status;
+
+    pq_cset(pq, &TS_ZERO);
+    (void)gettimeofday(&start, NULL);
+    while ((status = pq_sequence(pq, TV_GT, clss, next_seq_prod, &state)) == 0)
+        ;
+    (void)gettimeofday(&stop, NULL);
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_TRUE(state.ok);
+    CU_ASSERT_EQUAL(state.count, nmatch);
+    *rate = NEXT_PRODS/duration(&stop, &start);
+
+    state = (next_state){-1, true, 0};
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_next(pq, false, clss, next_prod, false, &state)) == 0)
+        ;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_TRUE(state.ok);
+    CU_ASSERT_EQUAL(state.count, nmatch);
+
+    state = (next_state){-1, true, 0};
+    pq_cset(pq, &TS_ZERO);
+    while ((status = pq_nextv(pq, clss, next_prod, 64, &state, NULL)) == 0)
+        ;
+    CU_ASSERT_EQUAL(status, PQUEUE_END);
+    CU_ASSERT_TRUE(state.ok);
+    CU_ASSERT_EQUAL(state.count, nmatch);
+    CU_ASSERT_EQUAL(state.last, (NEXT_PRODS - 1)/FEED_RATIO*FEED_RATIO);
+}
+
+/**
+ * Checks that a reader of a narrow class sees the same data-products whether
+ * or not the time-index records feedtypes (PQ_TQFEED) -- for products inserted
+ * by `pq_insert()` and by `pqe_new()`/`pqe_insert()`, and with a time-index
+ * that's a ring -- and compares the rates of reading.
+ */
+static void test_pq_tqfeed(void)
+{
+    static const int pflags[] = {0, PQ_TQFEED, PQ_TQFEED|PQ_TQRING};
+    prod_spec        spec = {SPARE, ".*"};
+    prod_class_t     clss = {TS_ZERO, TS_ENDT, {1, &spec}};
+
+    for (int k = 0; k < sizeof(pflags)/sizeof(pflags[0]); k++) {
+        pqueue* pq;
+        int     status = pq_create(PQ_PATHNAME, 0600, pflags[k], 0,
+                PQ_DATA_SIZE, LOCK_PRODS, &pq);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+
+        char    data[100];
+        char    ident[80];
+        product prod;
+        init_small_prod(&prod, data, sizeof(data));
+        prod.info.ident = ident;
+        for (uint32_t i = 0; i < NEXT_PRODS; i++) {
+            (void)snprintf(ident, sizeof(ident), "%u", i);
+            prod.info.seqno = i;
+            prod.info.feedtype = (i % FEED_RATIO) ? EXP : SPARE;
+            (void)memcpy(prod.info.signature, &i, sizeof(i));
+            (void)set_timestamp(&prod.info.arrival);
+            if (i % 2) {
+                status = pq_insert(pq, &prod);
+            }
+            else {
+                void*     ptr;
+                pqe_index index;
+                status = pqe_new(pq, &prod.info, &ptr, &index);
+                CU_ASSERT_EQUAL_FATAL(status, 0);
+                (void)memcpy(ptr, data, sizeof(data));
+                status = pqe_insert(pq, index);
+            }
+            CU_ASSERT_EQUAL_FATAL(status, 0);
+        }
+        CU_ASSERT_EQUAL(pq_getFlags(pq) & PQ_TQFEED, pflags[k] & PQ_TQFEED);
+
+        double rate;
+        read_narrow(pq, &clss, &rate);
+        log_notice_q("pflags=%#x: 1 product in %d wanted: %g products/s",
+                pflags[k], FEED_RATIO, rate);
+
+        close_pq(pq);
+        unlink_pq();
+    }
+}
+
+/**
+ * Has many downstream LDM-s reconnect to a full product-queue: each opens the
+ * queue, positions its cursor from the signature of the last product it
+ * received, and reads the next product.
+ *
+ * @param[in]  pflags  Flags for `pq_create()`
+ * @param[out] rate    Calls of `pq_setCursorFromSignature()` per second
+ */
+static void time_reconnect(
+        const int     pflags,
+        double* const rate)
+{
+    pqueue* pq;
+    int     status = pq_create(PQ_PATHNAME, 0600, pflags, 0, PQ_DATA_SIZE,
+            RECONNECT_PRODS, &pq);
+    CU_ASSERT_EQUAL_FATAL(status, 0);
+
+    char       data[100];
+    char       ident[80];
+    product    prod;
+    signaturet sig;
+    init_small_prod(&prod, data, sizeof(data));
+    prod.info.ident = ident;
+
+    for (uint32_t i = 0; i < RECONNECT_PRODS; i++) {
+        (void)snprintf(ident, sizeof(ident), "%u", i);
+        prod.info.seqno = i;
+        (void)memcpy(prod.info.signature, &i, sizeof(i));
+        (void)set_timestamp(&prod.info.arrival);
+        status = pq_insert(pq, &prod);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+    }
+    close_pq(pq);
+
+    double elapsed = 0;
+    srand(1);
+    for (int i = 0; i < NUM_DOWNSTREAMS; i++) {
+        const uint32_t last = rand() % (RECONNECT_PRODS - 1);
+        check_state    state = {last, true, false};
+
+        pq = open_pq(false);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(pq);
+        (void)memset(sig, 0, sizeof(sig));
+        (void)memcpy(sig, &last, sizeof(last));
+
+        (void)gettimeofday(&start, NULL);
+        status = pq_setCursorFromSignature(pq, sig);
+        (void)gettimeofday(&stop, NULL);
+        elapsed += duration(&stop, &start);
+        CU_ASSERT_EQUAL_FATAL(status, 0);
+
+        status = pq_sequence(pq, TV_GT, PQ_CLASS_ALL, check_prod, &state);
+        CU_ASSERT_EQUAL(status, 0);
+        CU_ASSERT_TRUE(state.ok);
+        CU_ASSERT_EQUAL(state.last, last + 1);
+        close_pq(pq);
+    }
+    *rate = NUM_DOWNSTREAMS/elapsed;
+
+    unlink_pq();
+}
+
+static void test_pq_reconnect(void)
+{
+    double rate;
+
+    time_reconnect(0, &rate);
+    log_notice_q("Chained signature-index: %g cursor-positionings/s", rate);
+    time_reconnect(PQ_SXOPEN, &rate);
+    log_notice_q("Open signature-index:    %g cursor-positionings/s", rate);
+}
+
 int main(
         const int          argc,
         const char* const* argv)
@@ -371,7 +2461,31 @@ int main(
                 if (//CU_ADD_TEST(testSuite, test_pq_insert_reserve_no_sig)
                         CU_ADD_TEST(testSuite, test_pq_insert)
                         && CU_ADD_TEST(testSuite, test_pq_sequence)
+                        && CU_ADD_TEST(testSuite, test_pq_sequence_readers)
                         && CU_ADD_TEST(testSuite, test_pq_insert_children)
+                        && CU_ADD_TEST(testSuite, test_pq_notify)
+                        && CU_ADD_TEST(testSuite, test_pq_lock_rates)
+                        && CU_ADD_TEST(testSuite, test_pq_insertv)
+                        && CU_ADD_TEST(testSuite, test_pq_nextv)
+                        && CU_ADD_TEST(testSuite, test_pq_tqfeed)
+                        && CU_ADD_TEST(testSuite, test_pq_evict)
+                        && CU_ADD_TEST(testSuite, test_pq_rlclass)
+                        && CU_ADD_TEST(testSuite, test_pq_chunked)
+                        && CU_ADD_TEST(testSuite, test_pq_chunked_mimic)
+                        && CU_ADD_TEST(testSuite, test_pq_consumers)
+                        && CU_ADD_TEST(testSuite, test_pq_lockstats)
+                        && CU_ADD_TEST(testSuite, test_pq_compress)
+                        && CU_ADD_TEST(testSuite, test_pq_compress_mimic)
+                        && CU_ADD_TEST(testSuite, test_pq_evsigs)
+                        && CU_ADD_TEST(testSuite, test_pq_evsigs_latest)
+                        && CU_ADD_TEST(testSuite, test_pq_prefetch)
+                        && CU_ADD_TEST(testSuite, test_pq_map)
+                        && CU_ADD_TEST(testSuite, test_pq_robust)
+                        && CU_ADD_TEST(testSuite, test_pq_tqring)
+                        && CU_ADD_TEST(testSuite, test_pq_sxopen)
+                        && CU_ADD_TEST(testSuite, test_pq_recover)
+                        && CU_ADD_TEST(testSuite, test_pq_grow)
+                        && CU_ADD_TEST(testSuite, test_pq_reconnect)
                         ) {
                     CU_basic_set_mode(CU_BRM_VERBOSE);
                     (void) CU_basic_run_tests();
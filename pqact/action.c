@@ -15,6 +15,7 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <signal.h>
+#include <pthread.h>
 
 #include "child_map.h"
 #include "ldm.h"
@@ -27,8 +28,13 @@
 #include "remote.h"
 #include "pq.h"
 #include "log.h"
+#include "spawner.h"
 
 ChildMap*        execMap = NULL;
+/// Protects `execMap` and `execWaiters` from concurrent actions
+pthread_mutex_t  execMutex = PTHREAD_MUTEX_INITIALIZER;
+/// Number of threads waiting on a particular EXEC child process
+unsigned         execWaiters = 0;
 
 
 /*ARGSUSED*/
@@ -66,6 +72,11 @@ exec_prodput(
 {
     pid_t       pid = 0;
 
+    /*
+     * The lock is held until the child process is in the map so that reap()
+     * can't wait upon the child before then.
+     */
+    (void)pthread_mutex_lock(&execMutex);
     if (NULL == execMap) {
         // Child-process map not allocated
         execMap = cm_new();
@@ -76,17 +87,21 @@ exec_prodput(
         }
     }
 
-    if (0 == pid) {
+    if (-1 == pid) {
+        (void)pthread_mutex_unlock(&execMutex);
+    }
+    else {
         int waitOnChild = 0; // Default is not to wait
 
         if (strcmp(argv[0], "-wait") == 0) {
             waitOnChild = 1;
             argc--; argv++;
+            execWaiters++; // Before the child exists. See reap().
         }
 
-        pid = ldmfork();
+        pid = sp_isActive() ? sp_exec(argv) : fl_fork();
         if (-1 == pid) {
-            log_syserr_q("Couldn't fork EXEC process");
+            log_error_q("Couldn't create EXEC process");
         }
         else if (0 == pid) {
             /*
@@ -95,6 +110,7 @@ exec_prodput(
              * Detach the child process from the parents process group??
              * (void) setpgid(0,0);
              */
+            (void)pthread_mutex_unlock(&execMutex);
             (void)signal(SIGTERM, SIG_DFL);
             (void)pq_close(pq);
 
@@ -114,7 +130,10 @@ exec_prodput(
         else {
             // Parent process.
             (void)cm_add_argv(execMap, pid, argv);
+        }
+        (void)pthread_mutex_unlock(&execMutex);
 
+        if (0 < pid) {
             if (!waitOnChild) {
                 log_debug("exec %s[%d]", argv[0], pid);
             }
@@ -123,6 +142,12 @@ exec_prodput(
                 (void)reap(pid, 0);
             }
         }
+
+        if (waitOnChild) {
+            (void)pthread_mutex_lock(&execMutex);
+            execWaiters--;
+            (void)pthread_mutex_unlock(&execMutex);
+        }
     } // Child-process map allocated
 
     return -1 == pid ? -1 : 0;
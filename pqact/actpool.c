@@ -0,0 +1,703 @@
+/*
+ *   Copyright 2026 University Corporation for Atmospheric Research
+ *
+ *   See file COPYRIGHT in the top-level source-directory for copying and
+ *   redistribution conditions.
+ */
+
+/**
+ * @file actpool.c
+ *
+ * Pool of threads that execute the actions of pqact(1) concurrently.
+ *
+ * An action is executed by the thread that's selected by the hash of the
+ * action's output (see fl_outputHash()), so actions on the same file, database,
+ * or decoder are executed in the order in which they were submitted while
+ * actions on different outputs proceed in parallel. Each thread has its own
+ * list of open outputs (see fl_initThread()).
+ *
+ * A data-product is copied once if any of its actions is executed by the pool.
+ * Data-products are completed in the order in which they were begun: the
+ * insertion-time of a data-product is only saved after all actions on it and
+ * on all previous data-products have completed -- and then only if none of its
+ * actions failed.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "actpool.h"
+#include "filel.h"
+#include "ldmprint.h"
+#include "log.h"
+
+/*
+ * Limits on the data-products that have been begun but not completed. The
+ * thread that begins a data-product waits while either is reached.
+ */
+#ifndef AP_MAX_PRODS
+#define AP_MAX_PRODS 1024
+#endif
+#ifndef AP_MAX_BYTES
+#define AP_MAX_BYTES (256*1024*1024)
+#endif
+
+struct ap_prod {
+    struct ap_prod*   next;     ///< Next data-product in order of beginning
+    const prod_par_t* prod_par; ///< Original. Valid only until `ap_end()`.
+    char*             copy;     ///< Storage of the copy or `NULL`
+    size_t            nbytes;   ///< Size of `copy` in bytes
+    product           prod;     ///< Copy of the data-product
+    void*             xprod;    ///< Copy of the XDR-encoded data-product
+    size_t            xlen;     ///< Size of the XDR-encoded data-product
+    timestampt        inserted; ///< Insertion-time into the product-queue
+    unsigned          refs;     ///< Pending actions + 1 until `ap_end()`
+    bool              error;    ///< Whether an action failed
+    bool              done;     ///< Whether all actions have completed
+};
+
+typedef enum {
+    AP_ACTION,
+    AP_SYNC,
+    AP_CLOSE_LRU,
+    AP_LOG_STATS,
+    AP_STOP
+} ap_type;
+
+typedef struct ap_job {
+    struct ap_job* next;
+    ap_type        type;
+    int            arg;      ///< Argument of `AP_SYNC` and `AP_CLOSE_LRU`
+    ap_prod*       prod;     ///< Data-product of `AP_ACTION`
+    actiont        action;   ///< Action of `AP_ACTION`
+    const char*    pattern;  ///< Pattern of the entry of `AP_ACTION`
+    int            argc;     ///< Number of arguments of `AP_ACTION`
+    char**         argv;     ///< Arguments of `AP_ACTION`
+} ap_job;
+
+typedef struct {
+    pthread_t      thread;
+    pthread_cond_t cond;     ///< Signaled when a job is added
+    ap_job*        head;
+    ap_job*        tail;
+    ap_job         stop;     ///< Job that stops the thread
+    int            status;   ///< Status of initialization of the thread
+    bool           started;  ///< Whether initialization is complete
+} ap_worker;
+
+/// Protects everything below
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+/// Signaled when a data-product completes
+static pthread_cond_t  doneCond = PTHREAD_COND_INITIALIZER;
+/// Signaled when a thread has initialized
+static pthread_cond_t  startCond = PTHREAD_COND_INITIALIZER;
+static ap_worker*      workers;
+/// Number of threads in the pool. 0 => actions are executed by the caller.
+static unsigned        nworkers = 0;
+/// Process that created the pool
+static pid_t           poolPid;
+/// Begun but not completed data-products in order of beginning
+static ap_prod*        fifoHead;
+static ap_prod*        fifoTail;
+static unsigned        nprods;
+static size_t          nbytes;
+/// Insertion-time of the last successfully-processed data-product
+static timestampt*     lastInsertion;
+static ap_stats_t      apStats;
+/// Signal mask of the thread that created the pool
+static sigset_t        origMask;
+static pthread_once_t  atforkOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Restores the signal mask in a child process. The threads of the pool block
+ * all signals, which a child process would otherwise inherit.
+ */
+static void
+ap_atforkChild(void)
+{
+    (void)pthread_sigmask(SIG_SETMASK, &origMask, NULL);
+}
+
+static void
+ap_registerAtfork(void)
+{
+    (void)pthread_atfork(NULL, NULL, ap_atforkChild);
+}
+
+/**
+ * Adds a job to the queue of a thread. The pool must be locked.
+ *
+ * @param[in] worker  Thread
+ * @param[in] job     Job
+ */
+static void
+ap_enqueue(
+        ap_worker* const worker,
+        ap_job* const    job)
+{
+    job->next = NULL;
+    if (worker->tail)
+        worker->tail->next = job;
+    else
+        worker->head = job;
+    worker->tail = job;
+    (void)pthread_cond_signal(&worker->cond);
+}
+
+/**
+ * Releases a reference to a data-product. Completes the data-product when it
+ * has no more references and, in order, all previous data-products. The pool
+ * must be locked.
+ *
+ * @param[in] prod  Data-product
+ */
+static void
+ap_release(
+        ap_prod* const prod)
+{
+    if (--prod->refs)
+        return;
+
+    prod->done = true;
+
+    while (fifoHead != NULL && fifoHead->done) {
+        ap_prod* const done = fifoHead;
+
+        fifoHead = done->next;
+        if (fifoHead == NULL)
+            fifoTail = NULL;
+
+        if (!done->error && lastInsertion != NULL)
+            *lastInsertion = done->inserted;
+
+        nprods--;
+        nbytes -= done->nbytes;
+        free(done->copy);
+        free(done);
+    }
+
+    (void)pthread_cond_broadcast(&doneCond);
+}
+
+/**
+ * Copies a data-product so that its actions can be executed after the
+ * product-queue has released it. The XDR-encoded data-product and the data
+ * share storage if they do so in the original.
+ *
+ * @param[in] prod  Data-product
+ * @retval    0     Success
+ * @retval    -1    Failure. log_add() called.
+ */
+static int
+ap_copy(
+        ap_prod* const prod)
+{
+    const prod_par_t* const par = prod->prod_par;
+    const char* const       ident = par->info.ident;
+    const char* const       origin = par->info.origin;
+    const char* const       encoded = par->encoded;
+    const char* const       data = par->data;
+    const size_t            identLen = strlen(ident) + 1;
+    const size_t            originLen = strlen(origin) + 1;
+    const size_t            encodedLen = encoded ? par->size : 0;
+    const bool              dataInEncoded = encoded && data &&
+            data >= encoded && data + par->info.sz <= encoded + par->size;
+    const size_t            dataLen = (data && !dataInEncoded)
+            ? par->info.sz
+            : 0;
+    const size_t            size = identLen + originLen + encodedLen + dataLen;
+    char*                   cp = malloc(size);
+
+    if (cp == NULL) {
+        log_add_syserr("Couldn't copy %zu-byte data-product \"%s\"", size,
+                ident);
+        return -1;
+    }
+
+    prod->copy = cp;
+    prod->prod.info = par->info;
+    prod->prod.info.ident = memcpy(cp, ident, identLen);
+    cp += identLen;
+    prod->prod.info.origin = memcpy(cp, origin, originLen);
+    cp += originLen;
+    prod->xprod = encoded ? memcpy(cp, encoded, encodedLen) : NULL;
+    prod->xlen = par->size;
+    cp += encodedLen;
+    prod->prod.data = dataInEncoded
+            ? (char*)prod->xprod + (data - encoded)
+            : data
+                ? memcpy(cp, data, dataLen)
+                : NULL;
+
+    (void)pthread_mutex_lock(&poolMutex);
+    prod->nbytes = size;
+    nbytes += size;
+    (void)pthread_mutex_unlock(&poolMutex);
+
+    return 0;
+}
+
+/**
+ * Executes the jobs of one thread of the pool.
+ *
+ * @param[in] arg  Thread
+ * @retval    NULL Always
+ */
+static void*
+ap_run(
+        void* const arg)
+{
+    ap_worker* const worker = arg;
+    const int        status = fl_initThread(nworkers);
+
+    if (status)
+        log_flush_error();
+
+    (void)pthread_mutex_lock(&poolMutex);
+    worker->status = status;
+    worker->started = true;
+    (void)pthread_cond_broadcast(&startCond);
+    (void)pthread_mutex_unlock(&poolMutex);
+
+    if (status)
+        return NULL;
+
+    for (;;) {
+        ap_job* job;
+
+        (void)pthread_mutex_lock(&poolMutex);
+        while ((job = worker->head) == NULL)
+            (void)pthread_cond_wait(&worker->cond, &poolMutex);
+        worker->head = job->next;
+        if (worker->head == NULL)
+            worker->tail = NULL;
+        (void)pthread_mutex_unlock(&poolMutex);
+
+        if (job->type == AP_STOP)
+            break;
+
+        if (job->type == AP_SYNC) {
+            fl_sync(job->arg);
+        }
+        else if (job->type == AP_CLOSE_LRU) {
+            fl_closeLru(job->arg);
+        }
+        else if (job->type == AP_LOG_STATS) {
+            fl_logStats();
+        }
+        else {
+            ap_prod* const prod = job->prod;
+            const int      error = job->action.prod_action(&prod->prod,
+                    job->argc, job->argv, prod->xprod, prod->xlen);
+
+            if (error) {
+                char feedtype[256];
+
+                (void)sprint_feedtypet(feedtype, sizeof(feedtype),
+                        prod->prod.info.feedtype);
+                log_error_q("Couldn't process product: feedtype=%s, "
+                        "pattern=\"%s\", action=%s, ident=\"%s\"", feedtype,
+                        job->pattern, job->action.name, prod->prod.info.ident);
+            }
+
+            (void)pthread_mutex_lock(&poolMutex);
+            apStats.actions++;
+            if (error)
+                prod->error = true;
+            ap_release(prod);
+            (void)pthread_mutex_unlock(&poolMutex);
+        }
+
+        free(job);
+    }
+
+    fl_finiThread();
+
+    return NULL;
+}
+
+/**
+ * Adds a control job to the queue of every thread of the pool.
+ *
+ * @param[in] type  Type of job
+ * @param[in] arg   Argument of the job
+ * @retval    0     Success
+ * @retval    -1    Failure. log_add() called.
+ */
+static int
+ap_broadcast(
+        const ap_type type,
+        const int     arg)
+{
+    int status = 0;
+
+    (void)pthread_mutex_lock(&poolMutex);
+    for (unsigned i = 0; i < nworkers; i++) {
+        ap_job* const job = malloc(sizeof(ap_job));
+
+        if (job == NULL) {
+            log_add_syserr("Couldn't allocate job");
+            status = -1;
+            break;
+        }
+
+        job->type = type;
+        job->arg = arg;
+        ap_enqueue(workers + i, job);
+    }
+    (void)pthread_mutex_unlock(&poolMutex);
+
+    return status;
+}
+
+/**
+ * Stops and joins the first threads of the pool.
+ *
+ * @param[in] n  Number of threads
+ */
+static void
+ap_stop(
+        const unsigned n)
+{
+    (void)pthread_mutex_lock(&poolMutex);
+    for (unsigned i = 0; i < n; i++) {
+        workers[i].stop.type = AP_STOP;
+        ap_enqueue(workers + i, &workers[i].stop);
+    }
+    (void)pthread_mutex_unlock(&poolMutex);
+
+    for (unsigned i = 0; i < n; i++) {
+        ap_worker* const worker = workers + i;
+
+        (void)pthread_join(worker->thread, NULL);
+
+        // A thread that failed to initialize doesn't remove its jobs
+        for (ap_job* job = worker->head; job && job != &worker->stop; ) {
+            ap_job* const next = job->next;
+            free(job);
+            job = next;
+        }
+        (void)pthread_cond_destroy(&worker->cond);
+    }
+}
+
+/**
+ * Creates the pool of threads. Until the pool is destroyed by `ap_fini()`,
+ * actions that are submitted via `ap_submit()` are executed by the pool.
+ *
+ * @param[in] nthreads       Number of threads in the pool. If 0, then nothing
+ *                           happens.
+ * @param[in] last           Insertion-time of the last successfully-processed
+ *                           data-product. Set by the pool when a data-product
+ *                           completes. Shouldn't be accessed until the pool is
+ *                           destroyed.
+ * @retval    0              Success
+ * @retval    -1             Failure. log_add() called.
+ */
+int
+ap_init(
+        const unsigned    nthreads,
+        timestampt* const last)
+{
+    if (nthreads == 0)
+        return 0;
+
+    if (nworkers) {
+        log_add("Pool of threads already exists");
+        return -1;
+    }
+
+    workers = calloc(nthreads, sizeof(ap_worker));
+    if (workers == NULL) {
+        log_add_syserr("Couldn't allocate %u threads", nthreads);
+        return -1;
+    }
+
+    (void)pthread_once(&atforkOnce, ap_registerAtfork);
+
+    lastInsertion = last;
+    poolPid = getpid();
+    nworkers = nthreads;
+
+    /*
+     * The threads block all signals so that they're handled by the main
+     * thread.
+     */
+    sigset_t all;
+    (void)sigfillset(&all);
+    (void)pthread_sigmask(SIG_BLOCK, &all, &origMask);
+
+    unsigned n;
+    for (n = 0; n < nthreads; n++) {
+        ap_worker* const worker = workers + n;
+        int              status;
+
+        (void)pthread_cond_init(&worker->cond, NULL);
+        status = pthread_create(&worker->thread, NULL, ap_run, worker);
+        if (status) {
+            log_add_errno(status, "Couldn't create thread");
+            (void)pthread_cond_destroy(&worker->cond);
+            break;
+        }
+    }
+
+    (void)pthread_sigmask(SIG_SETMASK, &origMask, NULL);
+
+    bool started = n == nthreads;
+
+    (void)pthread_mutex_lock(&poolMutex);
+    for (unsigned i = 0; i < n; i++) {
+        while (!workers[i].started)
+            (void)pthread_cond_wait(&startCond, &poolMutex);
+        if (workers[i].status)
+            started = false;
+    }
+    (void)pthread_mutex_unlock(&poolMutex);
+
+    if (!started) {
+        log_add("Couldn't start pool of %u threads", nthreads);
+        ap_stop(n);
+        free(workers);
+        workers = NULL;
+        nworkers = 0;
+        return -1;
+    }
+
+    log_info_q("Executing actions in %u threads", nthreads);
+
+    return 0;
+}
+
+/**
+ * Indicates if actions are executed by the pool of threads.
+ *
+ * @retval true   Actions are executed by the pool
+ * @retval false  Actions are executed by the caller
+ */
+bool
+ap_isActive(void)
+{
+    return nworkers != 0;
+}
+
+/**
+ * Begins the processing of a data-product by the pool. Waits while the pool
+ * is full.
+ *
+ * @param[in] prod_par  Data-product. Must be valid until `ap_end()`.
+ * @param[in] inserted  Insertion-time of the data-product into the
+ *                      product-queue
+ * @retval    NULL      Failure. log_add() called.
+ * @return              Data-product. Caller should pass to `ap_submit()` for
+ *                      each action and then to `ap_end()`.
+ */
+ap_prod*
+ap_begin(
+        const prod_par_t* const prod_par,
+        const timestampt* const inserted)
+{
+    ap_prod* const prod = calloc(1, sizeof(ap_prod));
+
+    if (prod == NULL) {
+        log_add_syserr("Couldn't allocate data-product");
+    }
+    else {
+        prod->prod_par = prod_par;
+        prod->inserted = *inserted;
+        prod->refs = 1;
+
+        (void)pthread_mutex_lock(&poolMutex);
+        if (fifoHead != NULL &&
+                (nprods >= AP_MAX_PRODS || nbytes >= AP_MAX_BYTES)) {
+            apStats.waits++;
+            do {
+                (void)pthread_cond_wait(&doneCond, &poolMutex);
+            } while (fifoHead != NULL &&
+                    (nprods >= AP_MAX_PRODS || nbytes >= AP_MAX_BYTES));
+        }
+
+        if (fifoTail)
+            fifoTail->next = prod;
+        else
+            fifoHead = prod;
+        fifoTail = prod;
+        nprods++;
+        (void)pthread_mutex_unlock(&poolMutex);
+    }
+
+    return prod;
+}
+
+/**
+ * Submits an action on a data-product to the pool. The arguments are copied.
+ *
+ * @param[in] prod     Data-product from `ap_begin()`
+ * @param[in] action   Action
+ * @param[in] pattern  Pattern of the entry whose action it is
+ * @param[in] argc     Number of arguments of the action
+ * @param[in] argv     Arguments of the action
+ * @retval    0        Success
+ * @retval    -1       Failure. log_add() called.
+ */
+int
+ap_submit(
+        ap_prod* const       prod,
+        const actiont* const action,
+        const char* const    pattern,
+        const int            argc,
+        char** const         argv)
+{
+    if (strcmp(action->name, "noop") == 0)
+        return 0; // Nothing to execute
+
+    if (prod->copy == NULL && ap_copy(prod))
+        return -1;
+
+    size_t size = sizeof(ap_job) + (argc + 1)*sizeof(char*) +
+            strlen(pattern) + 1;
+    for (int i = 0; i < argc; i++)
+        size += strlen(argv[i]) + 1;
+
+    ap_job* const job = malloc(size);
+    if (job == NULL) {
+        log_add_syserr("Couldn't allocate %zu-byte job", size);
+        return -1;
+    }
+
+    char* cp = (char*)(job + 1) + (argc + 1)*sizeof(char*);
+
+    job->type = AP_ACTION;
+    job->prod = prod;
+    job->action = *action;
+    job->argc = argc;
+    job->argv = (char**)(job + 1);
+    for (int i = 0; i < argc; i++) {
+        job->argv[i] = strcpy(cp, argv[i]);
+        cp += strlen(cp) + 1;
+    }
+    job->argv[argc] = NULL;
+    job->pattern = strcpy(cp, pattern);
+
+    ap_worker* const worker = workers +
+            fl_outputHash(action->prod_action, argc, argv) % nworkers;
+
+    (void)pthread_mutex_lock(&poolMutex);
+    prod->refs++;
+    ap_enqueue(worker, job);
+    (void)pthread_mutex_unlock(&poolMutex);
+
+    return 0;
+}
+
+/**
+ * Ends the submission of actions on a data-product to the pool. The
+ * data-product completes when all its actions have been executed.
+ *
+ * @param[in] prod           Data-product from `ap_begin()`. Invalid upon
+ *                           return.
+ * @param[in] errorOccurred  Whether an error occurred that would prevent the
+ *                           insertion-time of the data-product from being
+ *                           saved
+ */
+void
+ap_end(
+        ap_prod* const prod,
+        const bool     errorOccurred)
+{
+    (void)pthread_mutex_lock(&poolMutex);
+    prod->prod_par = NULL;
+    if (errorOccurred)
+        prod->error = true;
+    ap_release(prod);
+    (void)pthread_mutex_unlock(&poolMutex);
+}
+
+/**
+ * Flushes the outstanding I/O of the open outputs of every thread after the
+ * thread's current actions. Equivalent to `fl_sync()` if the pool doesn't
+ * exist.
+ *
+ * @param[in] block  Whether or not the I/O should block
+ */
+void
+ap_sync(
+        const int block)
+{
+    if (nworkers == 0) {
+        fl_sync(block);
+    }
+    else if (ap_broadcast(AP_SYNC, block)) {
+        log_flush_error();
+    }
+}
+
+/**
+ * Closes the least recently used open output of every thread after the
+ * thread's current actions. Equivalent to `fl_closeLru()` if the pool doesn't
+ * exist.
+ *
+ * @param[in] skipflags  Flags of outputs that won't be closed
+ */
+void
+ap_closeLru(
+        const int skipflags)
+{
+    if (nworkers == 0) {
+        fl_closeLru(skipflags);
+    }
+    else if (ap_broadcast(AP_CLOSE_LRU, skipflags)) {
+        log_flush_error();
+    }
+}
+
+/**
+ * Logs statistics on the open outputs of every thread after the thread's
+ * current actions. Equivalent to `fl_logStats()` if the pool doesn't exist.
+ */
+void
+ap_logStats(void)
+{
+    if (nworkers == 0) {
+        fl_logStats();
+    }
+    else if (ap_broadcast(AP_LOG_STATS, 0)) {
+        log_flush_error();
+    }
+}
+
+/**
+ * Returns statistics on the pool.
+ *
+ * @param[out] stats  Statistics
+ */
+void
+ap_getStats(
+        ap_stats_t* const stats)
+{
+    (void)pthread_mutex_lock(&poolMutex);
+    *stats = apStats;
+    (void)pthread_mutex_unlock(&poolMutex);
+}
+
+/**
+ * Destroys the pool of threads after all submitted actions have been
+ * executed. Closes the open outputs of the threads. Does nothing if the pool
+ * doesn't exist or wasn't created by the current process.
+ */
+void
+ap_fini(void)
+{
+    if (nworkers == 0 || getpid() != poolPid)
+        return;
+
+    ap_stop(nworkers);
+    free(workers);
+    workers = NULL;
+    nworkers = 0;
+}
@@ -0,0 +1,46 @@
+/*
+ *   Copyright 2026 University Corporation for Atmospheric Research
+ *
+ *   See file COPYRIGHT in the top-level source-directory for copying and
+ *   redistribution conditions.
+ */
+#ifndef _ACTPOOL_H_
+#define _ACTPOOL_H_
+
+#include <stdbool.h>
+
+#include "action.h"
+#include "ldm.h"
+#include "pq.h"
+
+/**
+ * A data-product whose actions are being executed by the pool
+ */
+typedef struct ap_prod ap_prod;
+
+typedef struct {
+    unsigned long actions;    ///< Number of actions executed by the pool
+    unsigned long waits;      ///< Number of times the pool was full
+} ap_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int      ap_init(unsigned nthreads, timestampt* lastInsertion);
+bool     ap_isActive(void);
+ap_prod* ap_begin(const prod_par_t* prod_par, const timestampt* inserted);
+int      ap_submit(ap_prod* prod, const actiont* action, const char* pattern,
+                int argc, char** argv);
+void     ap_end(ap_prod* prod, bool errorOccurred);
+void     ap_sync(int block);
+void     ap_closeLru(int skipflags);
+void     ap_logStats(void);
+void     ap_getStats(ap_stats_t* stats);
+void     ap_fini(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !_ACTPOOL_H_ */
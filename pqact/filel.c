@@ -26,6 +26,7 @@
 #include <fcntl.h> /* O_RDONLY et al */
 #include <unistd.h> /* access, lseek */
 #include <signal.h>
+#include <pthread.h>
 
 #if !defined(_DARWIN_C_SOURCE) && !defined(__BSD_VISIBLE)
 union semun {
@@ -56,12 +57,16 @@ union semun {
 #include "log.h"
 #include "mkdirs_open.h"
 #include "registry.h"
+#include "shmring.h"
+#include "spawner.h"
 #include "log.h"
 #include "pbuf.h"
 #include "pq.h"
 
-extern pqueue*     pq;
-extern ChildMap*   execMap;
+extern pqueue*          pq;
+extern ChildMap*        execMap;
+extern pthread_mutex_t  execMutex;
+extern unsigned         execWaiters;
 /*
  * Defined in pqcat.c
  */
@@ -74,6 +79,8 @@ static unsigned    shared_size;
 static unsigned    queue_counter = 0;
 static unsigned    largest_queue_element = 0;
 static union semun semarg;
+/// Serializes notifications via the shared-memory segment
+static pthread_mutex_t edexMutex = PTHREAD_MUTEX_INITIALIZER;
 
 #ifndef NO_DB
 
@@ -158,11 +165,15 @@ typedef union f_handle f_handle;
  * An entry in a list of entries, each of which has a open output.
  */
 struct fl_entry {
-    struct fl_entry* next;
-    struct fl_entry* prev;
+    struct fl_entry* next;              // Next less recently used entry
+    struct fl_entry* prev;              // Next more recently used entry
+    struct fl_entry* hnext;             // Next entry in the same hash-bucket
     struct fl_ops*   ops;
     f_handle         handle;
+    shmring*         ring;              // Shared-memory ring of "-shm" PIPE
     unsigned long    private;           // pid, hstat*, R/W flg
+    unsigned long    hits;              // Number of times found in the list
+    uint32_t         hash;              // Hash of type and key
     int              flags;
     ft_t             type;
     char             path[PATH_MAX];    // PATH_MAX includes NUL
@@ -211,13 +222,53 @@ struct fl_ops {
 };
 
 /**
- * The one global list of entries.
+ * A list of entries. There's one for the main thread and, if actions are
+ * executed by a pool of threads, one for each thread of the pool: an entry is
+ * only accessed by the thread whose list contains it.
+ *
+ * The entries are doubly-linked in order of use (most recent at the head) so
+ * that the least recently used one can be closed, and they're also chained in
+ * a hash-table by type and key (pathname or command) so that finding the
+ * entry of an action doesn't depend on the number of open outputs.
+ */
+typedef struct fl {
+    int           size;
+    fl_entry      *head;
+    fl_entry      *tail;
+    unsigned      maxSize;   ///< Maximum number of entries or 0 => `maxEntries`
+    fl_entry**    buckets;   ///< Hash-table of entries or `NULL`
+    unsigned      nbuckets;  ///< Number of buckets. 0 or a power of 2.
+    unsigned long hits;      ///< Number of times an entry was found
+    unsigned long misses;    ///< Number of times an entry wasn't found
+    unsigned long evictions; ///< Number of least-recently-used entries closed
+} fl;
+
+/// Initial number of buckets in the hash-table of a list
+#define FL_MIN_BUCKETS  64
+
+static fl             mainFl = { 0, NULL, NULL, 0, NULL, 0, 0, 0, 0 };
+static pthread_key_t  flKey;
+static pthread_once_t flKeyOnce = PTHREAD_ONCE_INIT;
+static bool           flKeyCreated = false;
+
+/**
+ * Serializes the creation of a pipe and the setting of its file descriptors
+ * to close-on-exec() against the forking of child processes by other threads
+ * so that a child can't inherit the other end of someone else's pipe.
+ */
+static pthread_rwlock_t forkLock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * Returns the list of entries of the calling thread.
  */
-static struct fl {
-    int size;
-    fl_entry *head;
-    fl_entry *tail;
-} thefl[] = { 0, NULL, NULL };
+static inline fl*
+fl_get(void)
+{
+    fl* const list = flKeyCreated ? pthread_getspecific(flKey) : NULL;
+    return list ? list : &mainFl;
+}
+
+#define thefl (fl_get())
 
 #define TO_HEAD(entry) \
         if(thefl->head != entry) fl_makeHead(entry)
@@ -375,11 +426,149 @@ dump_fl(void)
 }
 #endif
 
+/*
+ * Forward reference
+ */
+static int argcat(
+        char *buf,
+        int len,
+        int argc,
+        char **argv);
+
+/**
+ * Returns the key of the entry corresponding to a given type of entry and
+ * command arguments. It's the string that the `cmp` operation of the type
+ * compares against the `path` member of an entry, so entries that compare
+ * equal have the same key.
+ *
+ * @param[in]  type  Type of entry.
+ * @param[in]  argc  Number of command arguments.
+ * @param[in]  argv  Command arguments.
+ * @param[out] buf   Buffer for the key if it must be constructed.
+ * @return           The key.
+ */
+static const char*
+fl_key(
+        const ft_t   type,
+        const int    argc,
+        char** const argv,
+        char         buf[PATH_MAX])
+{
+    switch (type) {
+    case PIPE:
+        (void)argcat(buf, PATH_MAX - 1, argc, argv);
+        return buf;
+#if !defined(NO_DB) && defined(USE_GDBM)
+    case FT_DB:
+        return argv[0];
+#endif
+    default:
+        return argv[argc - 1];
+    }
+}
+
+/**
+ * Returns the hash of a type of entry and a key.
+ *
+ * @param[in] type  Type of entry.
+ * @param[in] key   Key of the entry.
+ * @return          Hash of the type and key (32-bit FNV-1a).
+ */
+static uint32_t
+fl_hash(
+        const ft_t  type,
+        const char* key)
+{
+    uint32_t hash = 2166136261u ^ (uint32_t)type;
+
+    while (*key)
+        hash = (hash ^ (unsigned char)*key++) * 16777619u;
+
+    return hash;
+}
+
+/**
+ * Adds an entry to the hash-table of a list. Grows the table if the list has
+ * as many entries as the table has buckets.
+ *
+ * @param[in] list   The list.
+ * @param[in] entry  The entry to be added.
+ * @pre              {`entry->hash` is set.}
+ * @pre              {The entry isn't in the hash-table.}
+ */
+static void
+fl_hashAdd(
+        fl* const       list,
+        fl_entry* const entry)
+{
+    if (list->size >= list->nbuckets) {
+        const unsigned nbuckets = list->nbuckets
+                ? 2 * list->nbuckets
+                : FL_MIN_BUCKETS;
+        fl_entry**     buckets = calloc(nbuckets, sizeof(fl_entry*));
+
+        if (buckets != NULL) {
+            /*
+             * Every entry that's in the list is also in the old table.
+             */
+            for (fl_entry* ep = list->head; ep != NULL; ep = ep->next) {
+                fl_entry** const bucket = buckets + (ep->hash & (nbuckets - 1));
+                ep->hnext = *bucket;
+                *bucket = ep;
+            }
+            free(list->buckets);
+            list->buckets = buckets;
+            list->nbuckets = nbuckets;
+        }
+        else if (list->buckets == NULL) {
+            /*
+             * The entry is only in the list. It can't be found again, so an
+             * action will open another output, but nothing else breaks.
+             */
+            log_syserr_q("Couldn't allocate hash-table of open outputs");
+            entry->hnext = NULL;
+            return;
+        }
+        // else the old table is kept and its chains get longer
+    }
+
+    fl_entry** const bucket = list->buckets +
+            (entry->hash & (list->nbuckets - 1));
+    entry->hnext = *bucket;
+    *bucket = entry;
+}
+
+/**
+ * Removes an entry from the hash-table of a list. Does nothing if the entry
+ * isn't in the table.
+ *
+ * @param[in] list   The list.
+ * @param[in] entry  The entry to be removed.
+ */
+static void
+fl_hashRemove(
+        fl* const       list,
+        fl_entry* const entry)
+{
+    if (list->buckets != NULL) {
+        for (fl_entry** ep = list->buckets +
+                (entry->hash & (list->nbuckets - 1)); *ep != NULL;
+                ep = &(*ep)->hnext) {
+            if (*ep == entry) {
+                *ep = entry->hnext;
+                break;
+            }
+        }
+    }
+    entry->hnext = NULL;
+}
+
 /**
  * Finds the entry in the list corresponding to a given type of entry and
  * command arguments.
  *
  * @param[in] type  Type of entry.
+ * @param[in] hash  Hash of the type and key of the entry from `fl_hash()`.
  * @param[in] argc  Number of command arguments.
  * @param[in] argv  Command arguments.
  * @retval    NULL  No such entry.
@@ -387,15 +576,21 @@ dump_fl(void)
  */
 static fl_entry*
 fl_find(
-        const ft_t   type,
-        const int    argc,
-        char** const argv)
+        const ft_t     type,
+        const uint32_t hash,
+        const int      argc,
+        char** const   argv)
 {
-    fl_entry *entry = NULL;
-
-    for (entry = thefl->head; entry != NULL ; entry = entry->next) {
-        if (entry->type == type && entry->ops->cmp(entry, argc, argv) == 0)
-            break;
+    const fl* const list = thefl;
+    fl_entry*       entry = NULL;
+
+    if (list->buckets != NULL) {
+        for (entry = list->buckets[hash & (list->nbuckets - 1)];
+                entry != NULL; entry = entry->hnext) {
+            if (entry->hash == hash && entry->type == type &&
+                    entry->ops->cmp(entry, argc, argv) == 0)
+                break;
+        }
     }
 
     return entry;
@@ -429,6 +624,10 @@ fl_removeAndFree(
                     TYPE_NAME[entry->type], entry->path);
         }
 
+        if (DR_LRU == dr)
+            thefl->evictions++;
+
+        fl_hashRemove(thefl, entry);
         fl_remove(entry);
         entry_free(entry);
     }
@@ -492,6 +691,120 @@ fl_closeAll(
         fl_closeLru(0);
 }
 
+/**
+ * Logs statistics on the calling thread's list of entries: the number of
+ * times an entry was found, not found, and closed because it was the least
+ * recently used one at the NOTICE level and, at the INFO level, the number of
+ * times each open entry was found, from the most recently used entry to the
+ * least.
+ */
+void
+fl_logStats(void)
+{
+    const fl* const list = thefl;
+    unsigned        longest = 0;
+
+    for (unsigned i = 0; i < list->nbuckets; i++) {
+        unsigned n = 0;
+        for (const fl_entry* entry = list->buckets[i]; entry != NULL;
+                entry = entry->hnext)
+            n++;
+        if (n > longest)
+            longest = n;
+    }
+
+    log_notice_q("Open outputs: %d (max %u); hits=%lu, misses=%lu, "
+            "evictions=%lu; hash buckets=%u, longest chain=%u", list->size,
+            list->maxSize ? list->maxSize : maxEntries, list->hits,
+            list->misses, list->evictions, list->nbuckets, longest);
+
+    if (log_is_enabled_info) {
+        for (const fl_entry* entry = list->head; entry != NULL;
+                entry = entry->next)
+            log_info_q("%s \"%s\": hits=%lu", TYPE_NAME[entry->type],
+                    entry->path, entry->hits);
+    }
+}
+
+static void
+fl_createKey(void)
+{
+    int status = pthread_key_create(&flKey, NULL);
+
+    if (status) {
+        log_errno_q(status, "Couldn't create thread-specific key");
+    }
+    else {
+        flKeyCreated = true;
+    }
+}
+
+/**
+ * Gives the calling thread its own, empty list of entries. Used by each thread
+ * of a pool of threads that execute actions. The available file descriptors
+ * are divided equally amongst the threads of the pool.
+ *
+ * @param[in] nthreads  Number of threads in the pool
+ * @retval    0         Success
+ * @retval    -1        Failure. log_add() called.
+ */
+int
+fl_initThread(
+        const unsigned nthreads)
+{
+    int status = -1;
+    fl* list;
+
+    (void)pthread_once(&flKeyOnce, fl_createKey);
+
+    if (!flKeyCreated) {
+        log_add("Thread-specific key doesn't exist");
+    }
+    else if ((list = malloc(sizeof(fl))) == NULL) {
+        log_add_syserr("Couldn't allocate list of entries");
+    }
+    else {
+        list->size = 0;
+        list->head = NULL;
+        list->tail = NULL;
+        list->buckets = NULL;
+        list->nbuckets = 0;
+        list->hits = 0;
+        list->misses = 0;
+        list->evictions = 0;
+        list->maxSize = maxEntries / (nthreads ? nthreads : 1);
+        if (list->maxSize == 0)
+            list->maxSize = 1;
+
+        status = pthread_setspecific(flKey, list);
+        if (status) {
+            log_add_errno(status, "Couldn't set list of entries of thread");
+            free(list);
+            status = -1;
+        }
+    }
+
+    return status;
+}
+
+/**
+ * Closes, removes, and frees all entries of the calling thread's own list and
+ * then the list itself. The thread subsequently uses the list of the main
+ * thread. Does nothing if the thread doesn't have its own list.
+ */
+void
+fl_finiThread(void)
+{
+    fl* const list = flKeyCreated ? pthread_getspecific(flKey) : NULL;
+
+    if (list != NULL) {
+        fl_closeAll();
+        (void)pthread_setspecific(flKey, NULL);
+        free(list->buckets);
+        free(list);
+    }
+}
+
 /**
  * Returns the entry in the list corresponding to a given type and command.
  * Creates the entry if it doesn't exist. INVARIANT: An entry in the list has
@@ -511,9 +824,13 @@ fl_getEntry(
         char** const restrict argv,
         bool* const restrict  isNew)
 {
-    fl_entry* entry = fl_find(type, argc, argv);
+    char           buf[PATH_MAX];
+    const uint32_t hash = fl_hash(type, fl_key(type, argc, argv, buf));
+    fl_entry*      entry = fl_find(type, hash, argc, argv);
 
     if (NULL != entry) {
+        thefl->hits++;
+        entry->hits++;
         TO_HEAD(entry);
         #ifdef FL_DEBUG
             dump_fl();
@@ -522,13 +839,20 @@ fl_getEntry(
             *isNew = false;
     }
     else {
-        log_assert(maxEntries > 0);
+        fl* const      list = thefl;
+        const unsigned maxSize = list->maxSize ? list->maxSize : maxEntries;
+
+        log_assert(maxSize > 0);
 
-        if (thefl->size >= maxEntries)
+        list->misses++;
+
+        if (list->size >= maxSize)
             fl_closeLru(0);
 
         entry = entry_new(type, argc, argv);
         if (NULL != entry) {
+            entry->hash = hash;
+            fl_hashAdd(list, entry);
             fl_addToHead(entry);
             #ifdef FL_DEBUG
                 dump_fl();
@@ -591,6 +915,29 @@ ensureCloseOnExec(
     return status;
 }
 
+/**
+ * Forks the current process like ldmfork() but can't do so while another
+ * thread is creating a pipe, which the child process would then inherit.
+ *
+ * @retval -1  Failure. "log_add()" called.
+ * @retval  0  Success. The calling process is the child.
+ * @return              PID of child process. The calling process is the parent.
+ */
+pid_t
+fl_fork(void)
+{
+    const double start = sp_now();
+
+    (void)pthread_rwlock_wrlock(&forkLock);
+    const pid_t pid = ldmfork();
+    (void)pthread_rwlock_unlock(&forkLock);
+
+    if (pid > 0)
+        sp_record(SP_FORK, sp_now() - start);
+
+    return pid;
+}
+
 /**
  * Flushes the I/O buffers of an entry if the FL_FLUSH flag is set.
  *
@@ -661,6 +1008,7 @@ static Option OPT_LOG         = {"log",       entry_setFlag,   FL_LOG};
 static Option OPT_METADATA    = {"metadata",  entry_setFlag,   FL_METADATA};
 static Option OPT_NODATA      = {"nodata",    entry_setFlag,   FL_NODATA};
 static Option OPT_OVERWRITE   = {"overwrite", entry_setFlag,   FL_OVERWRITE};
+static Option OPT_SHM         = {"shm",       entry_setFlag,   FL_SHM};
 static Option OPT_STRIP       = {"strip",     entry_setFlag,   FL_STRIP};
 static Option OPT_TRANSIENT   = {"transient", entry_unsetFlag, FL_NOTRANSIENT};
 
@@ -974,6 +1322,12 @@ static int unio_open(
 {
     char* path;
     int flags = (O_WRONLY | O_CREAT);
+#ifdef O_CLOEXEC
+    /*
+     * Unlike ensureCloseOnExec(), this can't race a fork() by another thread.
+     */
+    flags |= O_CLOEXEC;
+#endif
     int writeFd = -1; /* failure */
 
     log_assert(ac > 0);
@@ -1281,6 +1635,7 @@ int unio_prodput(
     int		status = -1; /* failure */
     fl_entry	*entry = fl_getEntry(UNIXIO, argc, argv, NULL);
     char	must_free_data = 0;
+    bool	edexLocked = false;
 
     log_debug("%d %s", entry == NULL ? -1 : entry->handle.fd,
     prodp->info.ident);
@@ -1296,6 +1651,13 @@ int unio_prodput(
                         "Notification specified but shared memory is not available.");
             }
             else {
+                /*
+                 * The message and the counter are shared by all threads that
+                 * execute actions.
+                 */
+                (void)pthread_mutex_lock(&edexMutex);
+                edexLocked = true;
+
                 edex_message* const queue =
                         (edex_message*)shmat(shared_id, (void*)0, 0);
                 edex_message* const msg = queue + queue_counter;
@@ -1355,10 +1717,12 @@ int unio_prodput(
                     log_add("Couldn't flush I/O to file \"%s\"", entry->path);
                 }
                 else {
-                    if (entry_isFlagSet(entry, FL_LOG))
+                    if (entry_isFlagSet(entry, FL_LOG)) {
+                        char buf[LDM_INFO_MAX];
                         log_notice_q("Filed in \"%s\": %s", argv[argc - 1],
-                                s_prod_info(NULL, 0, &prodp->info,
+                                s_prod_info(buf, sizeof(buf), &prodp->info,
                                         log_is_enabled_debug));
+                    }
                     if (entry_isFlagSet(entry, FL_EDEX) && shared_id != -1) {
                         semarg.val = queue_counter;
                         (void)semctl(sem_id, 1, SETVAL, semarg);
@@ -1373,6 +1737,9 @@ int unio_prodput(
                 free(data);
         } /* data != NULL */
 
+        if (edexLocked)
+            (void)pthread_mutex_unlock(&edexMutex);
+
         if (status || entry_isFlagSet(entry, FL_CLOSE))
             fl_removeAndFree(entry, status ? DR_ERROR : DR_CLOSE);
     } /* entry != NULL */
@@ -1401,6 +1768,12 @@ static int stdio_open(
 {
     char* path;
     int flags = (O_WRONLY | O_CREAT);
+#ifdef O_CLOEXEC
+    /*
+     * Unlike ensureCloseOnExec(), this can't race a fork() by another thread.
+     */
+    flags |= O_CLOEXEC;
+#endif
     int fd;
     char* mode = "a";
 
@@ -1595,10 +1968,12 @@ int stdio_prodput(
 
                 status = flushIfAppropriate(entry);
 
-                if ((status == 0) && entry_isFlagSet(entry, FL_LOG))
+                if ((status == 0) && entry_isFlagSet(entry, FL_LOG)) {
+                    char buf[LDM_INFO_MAX];
                     log_notice_q("StdioFiled in \"%s\": %s", argv[argc - 1],
-                            s_prod_info(NULL, 0, &prodp->info,
+                            s_prod_info(buf, sizeof(buf), &prodp->info,
                                     log_is_enabled_debug));
+                }
             } /* data written */
 
             if (must_free_data)
@@ -1689,6 +2064,81 @@ void endpriv(
     /* else warn??? or set to nobody??? */
 }
 
+/**
+ * Creates the shared-memory ring of a PIPE entry that has the "-shm" option
+ * and announces it to the decoder.
+ *
+ * @param[in] entry    The entry
+ * @param[in] writeFd  Write-end of the pipe to the decoder
+ * @retval    0        Success or the entry doesn't have the option
+ * @retval    -1       Failure. An error-message is logged.
+ */
+static int pipe_createRing(
+        fl_entry* const entry,
+        const int       writeFd)
+{
+    if (!entry_isFlagSet(entry, FL_SHM))
+        return 0;
+
+    if (shmring_create(writeFd, SHMRING_CAPACITY, &entry->ring)) {
+        log_error_q("Couldn't create shared-memory ring for decoder");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Executes the decoder of a PIPE entry via the spawn server, which creates the
+ * pipe.
+ *
+ * @param[in] entry  The entry
+ * @param[in] argc   Number of arguments of the entry
+ * @param[in] argv   Arguments of the entry
+ * @param[in] av     Arguments of the decoder invocation command (i.e., `argv`
+ *                   without the options of the entry)
+ * @retval    -1     Failure. An error-message is logged.
+ * @return           File descriptor of the write-end of the pipe.
+ */
+static int pipe_spawn(
+        fl_entry* const entry,
+        const int       argc,
+        char** const    argv,
+        char** const    av)
+{
+    int         writeFd = -1;
+    const pid_t pid = sp_pipe(av, &writeFd);
+
+    if (-1 == pid) {
+        log_error_q("Couldn't spawn PIPE process");
+        return -1;
+    }
+
+    #ifdef PIPE_BUF
+        entry->handle.pbuf = new_pbuf(writeFd, PIPE_BUF);
+    #else
+        entry->handle.pbuf = new_pbuf(writeFd, _POSIX_PIPE_BUF);
+    #endif
+
+    if (NULL == entry->handle.pbuf) {
+        log_syserr_q("Couldn't create pipe-buffer");
+        (void)close(writeFd); // The decoder will see EOF
+        return -1;
+    }
+    if (pipe_createRing(entry, writeFd)) {
+        free_pbuf(entry->handle.pbuf);
+        entry->handle.pbuf = NULL;
+        (void)close(writeFd);
+        return -1;
+    }
+
+    entry->private = pid;
+    argcat(entry->path, PATH_MAX - 1, argc, argv);
+    log_debug("%d %d", writeFd, pid);
+
+    return writeFd;
+}
+
 /* 
  * Open a pipe to a child decoder process.
  *
@@ -1719,18 +2169,26 @@ static int pipe_open(
     entry_setFlag(entry, FL_NOTRANSIENT);
 
     unsigned nopt = decodeOptions(entry, ac, av, &OPT_TRANSIENT, &OPT_STRIP,
-            &OPT_METADATA, &OPT_NODATA, &OPT_STRIPWMO, &OPT_FLUSH, &OPT_CLOSE, NULL);
+            &OPT_METADATA, &OPT_NODATA, &OPT_STRIPWMO, &OPT_FLUSH, &OPT_CLOSE,
+            &OPT_SHM, NULL);
     // ac -= nopt; // not used
     av += nopt;
 
     if (entry_isFlagSet(entry, FL_NODATA))
         entry_setFlag(entry, FL_METADATA);
 
+    if (sp_isActive())
+        return pipe_spawn(entry, argc, argv, av);
+
     /*
      * Create a pipe into which the parent pqact(1) process will write one or
      * more data-products and from which the child decoder process will read.
      */
+    (void)pthread_rwlock_rdlock(&forkLock);
+
     if (-1 == pipe(pfd)) {
+        (void)pthread_rwlock_unlock(&forkLock);
+
         if (errno == EMFILE || errno == ENFILE) {
             /*
              * Too many open files.
@@ -1745,14 +2203,20 @@ static int pipe_open(
         /*
          * Ensure that the write-end of the pipe will close upon execution
          * of an exec(2) family function because no child processes should
-         * inherit it.
+         * inherit it. Neither should the read-end, which is duplicated onto
+         * the standard input stream of the decoder, or the decoder won't see
+         * EOF when this process closes the write-end.
          */
         int status = ensureCloseOnExec(pfd[1]);
+        if (status == 0)
+            status = ensureCloseOnExec(pfd[0]);
+        (void)pthread_rwlock_unlock(&forkLock);
+
         if (status) {
-            log_error_q("Couldn't set write-end of pipe to close on exec()");
+            log_error_q("Couldn't set ends of pipe to close on exec()");
         }
         else {
-            pid_t pid = ldmfork();
+            pid_t pid = fl_fork();
 
             if (-1 == pid) {
                 log_error_q("Couldn't fork PIPE process");
@@ -1827,6 +2291,10 @@ static int pipe_open(
                     if (NULL == entry->handle.pbuf) {
                         log_syserr_q("Couldn't create pipe-buffer");
                     }
+                    else if (pipe_createRing(entry, pfd[1])) {
+                        free_pbuf(entry->handle.pbuf);
+                        entry->handle.pbuf = NULL;
+                    }
                     else {
                         entry->private = pid;
                         writeFd = pfd[1]; /* success */
@@ -1887,6 +2355,11 @@ static void pipe_close(
         pfd = entry->handle.pbuf->pfd;
         free_pbuf(entry->handle.pbuf);
     }
+    if (entry->ring != NULL) {
+        // Unconsumed products remain available to the decoder
+        shmring_destroy(entry->ring);
+        entry->ring = NULL;
+    }
     if (pfd != -1) {
         if (close(pfd) == -1) {
             log_syserr_q("pipe close: %s", entry->path);
@@ -1925,6 +2398,14 @@ static int pipe_put(
         if (entry_isFlagSet(entry, FL_NODATA)) {
             status = 0;
         }
+        else if (entry->ring != NULL) {
+            struct iovec iov = {(void*)data, sz};
+
+            status = shmring_write(entry->ring, &iov, 1, pipe_timeo);
+            if (status)
+                log_add("Couldn't write %zu-byte product to shared-memory "
+                        "ring", sz);
+        }
         else {
             status = pbuf_write(entry->handle.pbuf, data, sz, pipe_timeo);
 
@@ -1944,58 +2425,15 @@ static int pipe_put(
 
 static struct fl_ops pipe_ops = { argcat_cmp, pipe_open, pipe_close, pipe_sync};
 
-/*
- * Writes the data-product creation-time to the pipe as
- *     integer portion                  uint64_t
- *     microseconds portion             int32_t
- * ARGUMENTS:
- *     entry    Pointer to file-list entry
- *     creation Pointer to data-product creation-time
- * RETURNS:
- *     ENOERR   Success
- *     !ENOERR  Failure
+/**
+ * Maximum size, in bytes, of the metadata of a data-product that's written to
+ * a decoder.
  */
-static int pipe_putcreation(
-        fl_entry* entry,
-        const timestampt* creation)
-{
-    int status;
-#if SIZEOF_UINT64_T*CHAR_BIT == 64
-    uint64_t uint64 = (uint64_t) creation->tv_sec;
-    status = pbuf_write(entry->handle.pbuf, (void*) &uint64,
-            (u_int) sizeof(uint64_t), pipe_timeo);
-#else
-    uint32_t lower32 = (uint32_t) creation->tv_sec;
-#   if SIZEOF_LONG*CHAR_BIT <= 32
-    uint32_t upper32 = 0;
-#   else
-    uint32_t upper32 =
-            (uint32_t)(((unsigned long)creation->tv_sec) >> 32);
-#   endif
-#   if WORDS_BIGENDIAN
-    uint32_t first32 = upper32;
-    uint32_t second32 = lower32;
-#   else
-    uint32_t first32 = lower32;
-    uint32_t second32 = upper32;
-#   endif
-    status = pbuf_write(entry->handle.pbuf, (void*) &first32,
-            (u_int) sizeof(uint32_t), pipe_timeo);
-    if (status == ENOERR) {
-        status = pbuf_write(entry->handle.pbuf, (void*) &second32,
-                (u_int) sizeof(uint32_t), pipe_timeo);
-        if (status == ENOERR) {
-            int32_t int32 = (int32_t) creation->tv_usec;
-            status = pbuf_write(entry->handle.pbuf, (void*) &int32,
-                    (u_int) sizeof(int32_t), pipe_timeo);
-        }
-    }
-#endif
-    return status;
-}
+#define PIPE_META_MAX (4 + 16 + 4 + 8 + 4 + 4 + 4 + (4 + KEYSIZE) + \
+        (4 + HOSTNAMESIZE))
 
 /**
- * Writes the data-product metadata to the pipe as:
+ * Encodes the data-product metadata that's written to a decoder as:
  *    - metadata-length in bytes                                 uint32_t
  *    - data-product signature (MD5 checksum)                    uchar[16]
  *    - data-product size in bytes                               uint32_t
@@ -2011,6 +2449,47 @@ static int pipe_putcreation(
  *            - length in bytes (excluding NUL)                  uint32_t
  *            - non-NUL-terminated string                        char[]
  *
+ * @param[in]  info   Data-product metadata.
+ * @param[in]  sz     Size of the data in bytes.
+ * @param[out] buf    Buffer of at least `PIPE_META_MAX` bytes.
+ * @return            Length of the encoded metadata in bytes.
+ */
+static uint32_t pipe_encodeMeta(
+        const prod_info* const restrict info,
+        const uint32_t                  sz,
+        char* const restrict            buf)
+{
+    const uint32_t identLen = (uint32_t) strnlen(info->ident, KEYSIZE);
+    const uint32_t originLen = (uint32_t) strnlen(info->origin, HOSTNAMESIZE);
+    const uint32_t totalLen = 4 + 16 + 4 + 8 + 4 + 4 + 4 + (4 + identLen)
+                + (4 + originLen);
+    const uint64_t sec = (uint64_t) info->arrival.tv_sec;
+    const int32_t  usec = (int32_t) info->arrival.tv_usec;
+    const uint32_t feedtype = (uint32_t) info->feedtype;
+    const uint32_t seqno = (uint32_t) info->seqno;
+    char*          ptr = buf;
+
+    #define PUT(src, len) (void)memcpy(ptr, src, len), ptr += len
+    PUT(&totalLen, sizeof(totalLen));
+    PUT(info->signature, sizeof(info->signature));
+    PUT(&sz, sizeof(sz));
+    PUT(&sec, sizeof(sec));
+    PUT(&usec, sizeof(usec));
+    PUT(&feedtype, sizeof(feedtype));
+    PUT(&seqno, sizeof(seqno));
+    PUT(&identLen, sizeof(identLen));
+    PUT(info->ident, identLen);
+    PUT(&originLen, sizeof(originLen));
+    PUT(info->origin, originLen);
+    #undef PUT
+
+    return totalLen;
+}
+
+/**
+ * Writes the data-product metadata to the pipe. See `pipe_encodeMeta()` for
+ * the format.
+ *
  * @param[in] entry  Open-file list entry.
  * @param[in] info   Data-product metadata.
  * @param[in] sz     Size of the data in bytes.
@@ -2022,68 +2501,52 @@ static int pipe_putmeta(
         const prod_info* info,
         uint32_t sz)
 {
-    int32_t int32;
-    uint32_t uint32;
-    uint32_t identLen = (uint32_t) strlen(info->ident);
-    uint32_t originLen = (uint32_t) strlen(info->origin);
-    uint32_t totalLen = 4 + 16 + 4 + 8 + 4 + 4 + 4 + (4 + identLen)
-                + (4 + originLen);
-    int status;
+    char           buf[PIPE_META_MAX];
+    const uint32_t len = pipe_encodeMeta(info, sz, buf);
 
-    status = pbuf_write(entry->handle.pbuf, (void*) &totalLen,
-            (u_int) sizeof(totalLen), pipe_timeo);
-    if (status != ENOERR)
-        return status;
-
-    status = pbuf_write(entry->handle.pbuf, (void*) &info->signature,
-            (u_int) sizeof(info->signature), pipe_timeo);
-    if (status != ENOERR)
-        return status;
-
-    status = pbuf_write(entry->handle.pbuf, (void*) &sz, (u_int) sizeof(sz),
-            pipe_timeo);
-    if (status != ENOERR)
-        return status;
-
-    status = pipe_putcreation(entry, &info->arrival);
-    if (status != ENOERR)
-        return status;
-
-    int32 = (int32_t) info->arrival.tv_usec;
-    status = pbuf_write(entry->handle.pbuf, (void*) &int32, (u_int) sizeof(int32),
-            pipe_timeo);
-    if (status != ENOERR)
-        return status;
-
-    uint32 = (uint32_t) info->feedtype;
-    status = pbuf_write(entry->handle.pbuf, (void*) &uint32, (u_int) sizeof(uint32),
-            pipe_timeo);
-    if (status != ENOERR)
-        return status;
+    return pbuf_write(entry->handle.pbuf, buf, len, pipe_timeo);
+}
 
-    uint32 = (uint32_t) info->seqno;
-    status = pbuf_write(entry->handle.pbuf, (void*) &uint32, (u_int) sizeof(uint32),
-            pipe_timeo);
-    if (status != ENOERR)
-        return status;
+/**
+ * Writes a data-product as a single record to the shared-memory ring of an
+ * entry. A product that's too large for the ring is discarded with an error
+ * message rather than terminating the decoder.
+ *
+ * @param[in] entry  Open-file list entry with a shared-memory ring.
+ * @param[in] info   Data-product metadata.
+ * @param[in] data   Data to write.
+ * @param[in] sz     Amount of data in bytes.
+ * @retval    0      Success.
+ * @return           `errno` error-code.
+ */
+static int pipe_ringOut(
+        fl_entry* const restrict        entry,
+        const prod_info* const restrict info,
+        const void* restrict            data,
+        const uint32_t                  sz)
+{
+    char         meta[PIPE_META_MAX];
+    struct iovec iov[2];
+    int          iovcnt = 0;
 
-    status = pbuf_write(entry->handle.pbuf, (void*) &identLen,
-            (u_int) sizeof(identLen), pipe_timeo);
-    if (status != ENOERR)
-        return status;
+    TO_HEAD(entry);
 
-    status = pbuf_write(entry->handle.pbuf, (void*) info->ident, identLen,
-            pipe_timeo);
-    if (status != ENOERR)
-        return status;
+    if (entry_isFlagSet(entry, FL_METADATA)) {
+        iov[iovcnt].iov_base = meta;
+        iov[iovcnt++].iov_len = pipe_encodeMeta(info, sz, meta);
+    }
+    if (!entry_isFlagSet(entry, FL_NODATA)) {
+        iov[iovcnt].iov_base = (void*)data;
+        iov[iovcnt++].iov_len = sz;
+    }
 
-    status = pbuf_write(entry->handle.pbuf, (void*) &originLen,
-            (u_int) sizeof(originLen), pipe_timeo);
-    if (status != ENOERR)
-        return status;
+    int status = shmring_write(entry->ring, iov, iovcnt, pipe_timeo);
 
-    status = pbuf_write(entry->handle.pbuf, (void*) info->origin, originLen,
-            pipe_timeo);
+    if (status == EMSGSIZE) {
+        log_add("Product \"%s\" not sent to decoder", info->ident);
+        log_flush_error();
+        status = 0;
+    }
 
     return status;
 }
@@ -2106,6 +2569,9 @@ static int pipe_out(
 {
     int status = ENOERR;
 
+    if (entry->ring != NULL)
+        return pipe_ringOut(entry, info, data, sz);
+
     if (entry_isFlagSet(entry, FL_METADATA)) {
         status = pipe_putmeta(entry, info, sz);
         if (status)
@@ -2844,8 +3310,12 @@ entry_new(
             entry->type = type;
             entry->next = NULL;
             entry->prev = NULL;
+            entry->hnext = NULL;
+            entry->ring = NULL;
             entry->path[0] = 0;
             entry->private = 0;
+            entry->hits = 0;
+            entry->hash = 0;
 
             if (entry->ops->open(entry, argc, argv) == -1) {
                 free(entry);
@@ -2911,6 +3381,50 @@ int set_shared_space(
     return error;
 }
 
+/**
+ * Returns a hash of the output of an action. Actions whose output is the same
+ * file, database, or decoder have the same hash.
+ *
+ * @param[in] prodput  Function of the action
+ * @param[in] argc     Number of arguments of the action
+ * @param[in] argv     Arguments of the action
+ * @return             Hash of the output of the action
+ */
+unsigned long
+fl_outputHash(
+        int         (*prodput)(const product*, int, char**, const void*,
+                               size_t),
+        const int    argc,
+        char** const argv)
+{
+    unsigned long hash = 5381;
+    int           first = 0;
+    int           last = argc - 1;
+
+    if (prodput == unio_prodput || prodput == stdio_prodput) {
+        first = last; // Pathname of the file. See str_cmp().
+    }
+#ifndef NO_DB
+    else if (prodput == ldmdb_prodput) {
+        // Pathname of the database follows the options. See ldmdb_prodput().
+        for (; first < last && *argv[first] == '-'; first++) {
+            if (strncmp(argv[first], "-dblocksize", 3) == 0)
+                first++;
+        }
+        last = first;
+    }
+#endif
+    // Otherwise, all the arguments. See argcat_cmp().
+
+    for (int i = first; i <= last && i < argc; i++) {
+        for (const unsigned char* cp = (const unsigned char*)argv[i]; *cp; cp++)
+            hash = hash * 33 + *cp;
+        hash = hash * 33 + ' ';
+    }
+
+    return hash;
+}
+
 /*
  * Returns the maximum number of file-descriptors that one process can have 
  * open at any one time.
@@ -2945,7 +3459,7 @@ long openMax()
 }
 
 /*
- * Waits-upon one or more child processes.
+ * Waits-upon one or more child processes, including those of the spawn server.
  *
  * Arguments:
  *      pid             The PID of the process upon which to wait.  If 
@@ -2955,7 +3469,8 @@ long openMax()
  * Returns:
  *      -1              Failure.  "errno" is set.
  *      0               "options" & WNOHANG is true and status isn't available
- *                      for process "pid".
+ *                      for process "pid"; or "pid" is (pid_t)-1 and another
+ *                      thread is waiting on a particular EXEC child process.
  *      else            PID of the waited-upon process.
  */
 pid_t reap(
@@ -2963,7 +3478,34 @@ pid_t reap(
         const int options)
 {
     int status = 0;
-    const pid_t wpid = waitpid(pid, &status, options);
+    pid_t wpid;
+
+    if (pid == (pid_t)-1) {
+        (void)pthread_mutex_lock(&execMutex);
+
+        if (execWaiters) {
+            /*
+             * Waiting on any child could steal the one that's being waited
+             * upon by an "EXEC -wait" action in another thread.
+             */
+            (void)pthread_mutex_unlock(&execMutex);
+            return 0;
+        }
+
+        /*
+         * The children of the spawn server are checked first. Waiting on them
+         * can't block lest other children be ignored.
+         */
+        wpid = sp_wait(pid, &status, options | WNOHANG);
+        if (wpid <= 0)
+            wpid = waitpid(pid, &status, options);
+    }
+    else {
+        wpid = sp_wait(pid, &status, options);
+        if (wpid == -1 && errno == ECHILD) // Not a child of the spawn server
+            wpid = waitpid(pid, &status, options);
+        (void)pthread_mutex_lock(&execMutex);
+    }
 
     if (wpid == -1) {
         if (!(errno == ECHILD && pid == -1)) {
@@ -2988,7 +3530,10 @@ pid_t reap(
          *       because
          *         - The `-close` option was specified; or
          *         - The entry was deleted by `fl_closeLru()`; or
-         *         - An I/O error occurred writing to the pipe.
+         *         - An I/O error occurred writing to the pipe; or
+         *     * The corresponding process is a `PIPE` decoder of an entry in
+         *       the list of another thread, in which case that thread
+         *       removes the entry when it next fails to write to the pipe.
          */
         if (NULL != entry) {
             cmd = entry->path;
@@ -3042,5 +3587,7 @@ pid_t reap(
         }
     } /* wpid != -1 && wpid != 0 */
 
+    (void)pthread_mutex_unlock(&execMutex);
+
     return wpid;
 }
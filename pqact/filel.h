@@ -23,6 +23,7 @@
 #define FL_FLUSH 1024
 #define FL_CLOSE 2048
 #define FL_STRIPWMO 4096
+#define FL_SHM 8192 /* send products via shared-memory ring */
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,6 +47,13 @@ extern pid_t reap(pid_t pid, int options);
 extern void fl_sync(int block);
 extern void fl_closeLru(int skipflags);
 extern void fl_closeAll(void);
+extern void fl_logStats(void);
+extern int fl_initThread(unsigned nthreads);
+extern void fl_finiThread(void);
+extern pid_t fl_fork(void);
+extern unsigned long fl_outputHash(
+	int (*prodput)(const product*, int, char**, const void*, size_t),
+	int argc, char **argv);
 extern void endpriv(void);
 extern int set_avail_fd_count(unsigned fdCount);
 extern int set_shared_space(int shid, int semid, unsigned size);
@@ -14,6 +14,7 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
 #include <sys/timeb.h>
 #include <signal.h>
@@ -24,6 +25,7 @@
 #include "palt.h"
 #include "pq.h"
 #include "action.h"
+#include "actpool.h"
 #include "ldmprint.h"
 #include "atofeedt.h"
 #include "ldmalloc.h"
@@ -55,6 +57,12 @@ struct palt {    /* "Pattern Action Line" */
         regmatch_t *pmatchp;
         actiont action;         /* action proc to execute */
         char *private;                  /* storage for args */
+        char *literals;         /* literals every match contains or NULL */
+        size_t nlits;           /* number of literals */
+        size_t prefixlen;       /* length of first literal if it begins
+                                 * every match; else 0 */
+        int *litids;            /* automaton indexes of other literals */
+        bool isElse;            /* pattern is "^_ELSE_$"? */
 };
 typedef struct palt palt;
 
@@ -70,6 +78,8 @@ free_palt(palt *pal)
         }
         if(pal->private != NULL)
                 free(pal->private);
+        free(pal->literals);
+        free(pal->litids);
         free(pal);
 }
 
@@ -93,6 +103,364 @@ new_palt(void)
 static palt *paList = 0; /* the only one */
 
 
+/* Begin index */
+/*
+ * The pattern/action table is compiled into an index so that a data-product
+ * is only compared against the entries that might match it:
+ *   - The entries are bucketed by the bits of their feedtype, in table order,
+ *     so that a data-product of one feedtype only visits the entries that
+ *     accept it; and
+ *   - The literals that every match of an entry's regular-expression must
+ *     contain (see re_requiredLiterals()) are looked for before the
+ *     regular-expression is executed: an anchored one by comparing the start
+ *     of the product-identifier and the others by one Aho-Corasick scan of
+ *     the product-identifier for the literals of all entries.
+ * Only the entries that pass both are matched by regexec(3), so the entries
+ * whose actions are applied, and their order, are the same as without the
+ * index.
+ */
+
+#define NFEEDBITS       (sizeof(feedtypet)*CHAR_BIT)
+
+typedef struct {
+        int             child;          /* first child or -1 */
+        int             sibling;        /* next sibling or -1 */
+        int             fail;           /* longest proper suffix in automaton */
+        int             out;            /* longest proper suffix that ends a
+                                         * literal or -1 */
+        int             litid;          /* literal ending here or -1 */
+        unsigned char   ch;             /* character of edge to this node */
+} acnode;
+
+typedef struct {
+        palt**          entries;        /* all entries, in table order */
+        size_t          count;          /* number of entries */
+        palt**          bucket[NFEEDBITS];  /* entries by feedtype bit */
+        size_t          bucketLen[NFEEDBITS];
+        acnode*         nodes;          /* automaton of unanchored literals */
+        size_t          nnodes;         /* number of nodes (root is 0) */
+        size_t          maxnodes;       /* capacity of `nodes` */
+        int             root[UCHAR_MAX+1];  /* transitions from root */
+        unsigned*       seen;           /* generation in which literal seen */
+        size_t          nlits;          /* number of distinct literals */
+        unsigned        gen;            /* generation of current scan */
+} paindex;
+
+static paindex*         paIndex = NULL;         /* index of `paList` */
+static bool             paIndexStale = false;   /* `paList` has changed? */
+static bool             paIndexed = true;       /* use `paIndex`? */
+static palt_stats_t     paStats;
+
+
+static void
+pai_free(paindex* idx)
+{
+        if(idx == NULL)
+                return;
+        for(size_t bit = 0; bit < NFEEDBITS; bit++)
+                free(idx->bucket[bit]);
+        free(idx->entries);
+        free(idx->nodes);
+        free(idx->seen);
+        free(idx);
+}
+
+
+/*
+ * Adds a node to the automaton as the first child of another.
+ * Returns the index of the new node or -1 on allocation failure.
+ */
+static int
+pai_addNode(paindex* idx, int parent, unsigned char ch)
+{
+        if(idx->nnodes == idx->maxnodes)
+        {
+                size_t  max = idx->maxnodes ? 2*idx->maxnodes : 256;
+                acnode* nodes = realloc(idx->nodes, max*sizeof(acnode));
+                if(nodes == NULL)
+                        return -1;
+                idx->nodes = nodes;
+                idx->maxnodes = max;
+        }
+
+        int     n = (int)idx->nnodes++;
+        acnode* node = idx->nodes + n;
+
+        node->child = -1;
+        node->litid = -1;
+        node->out = -1;
+        node->fail = 0;
+        node->ch = ch;
+        if(parent >= 0)
+        {
+                node->sibling = idx->nodes[parent].child;
+                idx->nodes[parent].child = n;
+                if(parent == 0)
+                        idx->root[ch] = n;
+        }
+        else
+        {
+                node->sibling = -1;
+        }
+        return n;
+}
+
+
+/*
+ * Returns the child of a node along an edge or -1.
+ */
+static int
+pai_child(const paindex* idx, int n, unsigned char ch)
+{
+        if(n == 0)
+                return idx->root[ch] ? idx->root[ch] : -1;
+        for(n = idx->nodes[n].child; n >= 0; n = idx->nodes[n].sibling)
+                if(idx->nodes[n].ch == ch)
+                        return n;
+        return -1;
+}
+
+
+/*
+ * Returns the state of the automaton after a character.
+ */
+static int
+pai_next(const paindex* idx, int n, unsigned char ch)
+{
+        for(;;)
+        {
+                int child = pai_child(idx, n, ch);
+                if(child >= 0)
+                        return child;
+                if(n == 0)
+                        return 0;
+                n = idx->nodes[n].fail;
+        }
+}
+
+
+/*
+ * Adds a literal to the automaton. Returns its identifier, which is shared
+ * by identical literals, or -1 on allocation failure.
+ */
+static int
+pai_addLiteral(paindex* idx, const char* literal)
+{
+        int n = 0;
+
+        for(const unsigned char* cp = (const unsigned char*)literal; *cp;
+                        cp++)
+        {
+                int child = pai_child(idx, n, *cp);
+                if(child < 0 && (child = pai_addNode(idx, n, *cp)) < 0)
+                        return -1;
+                n = child;
+        }
+        if(idx->nodes[n].litid < 0)
+                idx->nodes[n].litid = (int)idx->nlits++;
+        return idx->nodes[n].litid;
+}
+
+
+/*
+ * Sets the failure and output links of the automaton, breadth first.
+ * Returns 0 or -1 on allocation failure.
+ */
+static int
+pai_link(paindex* idx)
+{
+        int*    queue = Alloc(idx->nnodes, int);
+        size_t  head = 0;
+        size_t  tail = 0;
+
+        if(queue == NULL)
+                return -1;
+        queue[tail++] = 0;
+        while(head < tail)
+        {
+                int u = queue[head++];
+                for(int v = idx->nodes[u].child; v >= 0;
+                                v = idx->nodes[v].sibling)
+                {
+                        acnode* node = idx->nodes + v;
+                        if(u != 0)
+                        {
+                                node->fail = pai_next(idx,
+                                        idx->nodes[u].fail, node->ch);
+                                acnode* fail = idx->nodes + node->fail;
+                                node->out = fail->litid >= 0
+                                        ? node->fail : fail->out;
+                        }
+                        queue[tail++] = v;
+                }
+        }
+        free(queue);
+        return 0;
+}
+
+
+/*
+ * Returns a new index of a pattern/action table or NULL on allocation
+ * failure.
+ */
+static paindex*
+pai_new(palt* list)
+{
+        paindex* idx = calloc(1, sizeof(paindex));
+        palt*    pal;
+
+        if(idx == NULL)
+                return NULL;
+        if(pai_addNode(idx, -1, 0) < 0)
+                goto err;
+
+        for(pal = list; pal != NULL; pal = pal->next)
+        {
+                idx->count++;
+                for(size_t bit = 0; bit < NFEEDBITS; bit++)
+                        if(pal->feedtype & (1u << bit))
+                                idx->bucketLen[bit]++;
+        }
+        if((idx->entries = Alloc(idx->count + 1, palt*)) == NULL)
+                goto err;
+        for(size_t bit = 0; bit < NFEEDBITS; bit++)
+        {
+                if(idx->bucketLen[bit] == 0)
+                        continue;
+                idx->bucket[bit] = Alloc(idx->bucketLen[bit], palt*);
+                if(idx->bucket[bit] == NULL)
+                        goto err;
+                idx->bucketLen[bit] = 0;
+        }
+
+        size_t i = 0;
+        for(pal = list; pal != NULL; pal = pal->next)
+        {
+                idx->entries[i++] = pal;
+                for(size_t bit = 0; bit < NFEEDBITS; bit++)
+                        if(pal->feedtype & (1u << bit))
+                                idx->bucket[bit][idx->bucketLen[bit]++] = pal;
+                if(pal->literals != NULL)
+                {
+                        const char *cp = pal->literals;
+                        int        *litid = pal->litids;
+
+                        if(pal->prefixlen)
+                                cp += pal->prefixlen + 1;
+                        for(; *cp; cp += strlen(cp) + 1)
+                                if((*litid++ = pai_addLiteral(idx, cp)) < 0)
+                                        goto err;
+                }
+        }
+
+        if(pai_link(idx) < 0)
+                goto err;
+        if(idx->nlits && (idx->seen = calloc(idx->nlits, sizeof(unsigned)))
+                        == NULL)
+                goto err;
+
+        return idx;
+err:
+        pai_free(idx);
+        return NULL;
+}
+
+
+/*
+ * Finds the literals in a product-identifier. Afterwards, literal `i` is in
+ * the identifier if and only if `idx->seen[i] == idx->gen`.
+ */
+static void
+pai_scan(paindex* idx, const char* ident)
+{
+        if(++idx->gen == 0)
+        {
+                (void)memset(idx->seen, 0, idx->nlits*sizeof(unsigned));
+                idx->gen = 1;
+        }
+
+        int n = 0;
+        for(const unsigned char* cp = (const unsigned char*)ident; *cp; cp++)
+        {
+                n = pai_next(idx, n, *cp);
+                for(int m = idx->nodes[n].litid >= 0 ? n : idx->nodes[n].out;
+                                m >= 0; m = idx->nodes[m].out)
+                        idx->seen[idx->nodes[m].litid] = idx->gen;
+        }
+}
+
+
+/*
+ * Indicates if a product-identifier contains the literals of an entry, which
+ * it must for the entry's regular-expression to match it.
+ *
+ * Arguments:
+ *      idx             The index
+ *      pal             The entry. Must have literals.
+ *      ident           The product-identifier
+ *      scanned         Whether `pai_scan()` has been called on `ident`. Set
+ *                      if it's called.
+ */
+static bool
+pai_mightMatch(paindex* idx, const palt* pal, const char* ident,
+        bool* scanned)
+{
+        size_t nlits = pal->nlits;
+
+        if(pal->prefixlen)
+        {
+                if(strncmp(ident, pal->literals, pal->prefixlen))
+                        return false;
+                nlits--;
+        }
+        if(nlits && !*scanned)
+        {
+                pai_scan(idx, ident);
+                *scanned = true;
+        }
+        for(size_t i = 0; i < nlits; i++)
+                if(idx->seen[pal->litids[i]] != idx->gen)
+                        return false;
+        return true;
+}
+
+
+/*
+ * (Re)builds the index of the pattern/action table.
+ */
+static void
+pai_build(void)
+{
+        pai_free(paIndex);
+        paIndex = pai_new(paList);
+        paIndexStale = false;
+        if(paIndex == NULL)
+                log_warning_q("Couldn't index pattern/action table: every "
+                        "entry will be matched against every product");
+        else
+                log_debug("Indexed %lu pattern/action entries: %lu literals, "
+                        "%lu automaton nodes", (unsigned long)paIndex->count,
+                        (unsigned long)paIndex->nlits,
+                        (unsigned long)paIndex->nnodes);
+}
+
+
+void
+palt_setIndexed(bool indexed)
+{
+        paIndexed = indexed;
+}
+
+
+void
+palt_getStats(palt_stats_t* stats)
+{
+        *stats = paStats;
+}
+
+/* End index */
+
+
 /*
  * remove an entry from the linked list and Free it
  */
@@ -111,6 +479,7 @@ remove_palt(palt *pal)
                         paList = NULL;
         }
         free_palt(pal);
+        paIndexStale = true;
 }
 
 
@@ -367,6 +736,35 @@ new_palt_fromStr(char *buf)
                 goto err;
         }
 
+        pal->isElse = strcmp(pal->pattern, "^_ELSE_$") == 0;
+        if(!pal->isElse)
+        {
+                char literals[PATSZ+1];
+                int  anchored;
+
+                pal->nlits = re_requiredLiterals(pal->pattern, literals,
+                        &anchored);
+                if(pal->nlits > 0)
+                {
+                        const char *cp = literals;
+                        size_t      size;
+
+                        while(*cp)
+                                cp += strlen(cp) + 1;
+                        size = cp - literals + 1;
+                        pal->literals = malloc(size);
+                        pal->litids = Alloc(pal->nlits, int);
+                        if(pal->literals == NULL || pal->litids == NULL)
+                        {
+                                log_syserr_q("malloc failed");
+                                goto err;
+                        }
+                        (void) memcpy(pal->literals, literals, size);
+                        if(anchored)
+                                pal->prefixlen = strlen(literals);
+                }
+        }
+
         if(atoaction(tabtoks[2], &pal->action) < 0)
         {
                 /* duplicate reporting */
@@ -479,6 +877,7 @@ readPatFile(const char *path)
             }
 
             pal = paList = begin;
+            pai_build();
 
             log_info_q("Successfully read configuration-file \"%s\"", path);
         }
@@ -1168,11 +1567,26 @@ regsub(const palt* const pal, const char *ident, char *dest, size_t size)
 }
 
 
+/*
+ * Executes the action of an entry or, if `apProd` isn't NULL, submits it to
+ * the pool of threads, which logs the failure of the action itself.
+ */
+static int
+pal_execute(palt* const pal, product* const prod, const int argc,
+        char** const argv, const void* const xprod, const size_t xlen,
+        ap_prod* const apProd)
+{
+    return (apProd == NULL)
+            ? (*pal->action.prod_action)(prod, argc, argv, xprod, xlen)
+            : ap_submit(apProd, &pal->action, pal->pattern, argc, argv);
+}
+
 /*
  * Apply the action in pal to prod
  */
 static int
-prodAction(product *prod, palt *pal, const void *xprod, size_t xlen)
+prodAction(product *prod, palt *pal, const void *xprod, size_t xlen,
+        ap_prod* apProd)
 {
     int         argc;
     int         status;
@@ -1182,7 +1596,7 @@ prodAction(product *prod, palt *pal, const void *xprod, size_t xlen)
         char*   argv[1] = {NULL};
 
         argc = 0;
-        status = (*pal->action.prod_action)(prod, argc, argv, xprod, xlen);
+        status = pal_execute(pal, prod, argc, argv, xprod, xlen, apProd);
         if (status)
             log_error_q("Couldn't process product: "
                     "feedtype=%s, pattern=\"%s\", action=%s",
@@ -1226,7 +1640,7 @@ prodAction(product *prod, palt *pal, const void *xprod, size_t xlen)
         if (argc < ARRAYLEN(argv))
         {
             argv[argc] = NULL;
-            status = (*pal->action.prod_action)(prod, argc, argv, xprod, xlen);
+            status = pal_execute(pal, prod, argc, argv, xprod, xlen, apProd);
             if (status)
                 log_error_q("Couldn't process product: "
                         "feedtype=%s, pattern=\"%s\", action=%s, "
@@ -1313,10 +1727,65 @@ processProduct(
 
 #else
 
+/**
+ * Indicates if a data-product matches an entry of the pattern/action table
+ * whose feedtype accepts it. Sets the entry's subexpression matches.
+ *
+ * @param[in] pal       Entry
+ * @param[in] ident     Product-identifier
+ * @param[in] didMatch  Whether the product has matched a previous entry
+ */
+static bool
+pal_matches(palt* const pal, const char* const ident, const bool didMatch)
+{
+    paStats.regexecs++;
+    /*
+     * If the product ID matches the regular expression OR (the pattern is
+     * "_ELSE_" AND nothing has been done to this product yet AND the first
+     * char of the ident isn't '_')
+     */
+    return (regexec(&pal->prog, ident, pal->prog.re_nsub +1, pal->pmatchp, 0)
+                    == 0)
+            || (pal->isElse && !didMatch && ident[0] != '_');
+}
+
+/**
+ * Applies the action of a matching entry of the pattern/action table to a
+ * data-product. The entry is removed from the table if its action is
+ * transient and fails.
+ *
+ * @param[in] pal            Entry
+ * @param[in] prod_par       Data-product parameters
+ * @param[in] apProd         Data-product of the pool of threads or `NULL`
+ * @param[out] errorOccurred Set to `true` if the action fails
+ */
+static void
+pal_apply(
+        palt* const                      pal,
+        const prod_par_t* const restrict prod_par,
+        ap_prod* const restrict          apProd,
+        bool* const restrict             errorOccurred)
+{
+    product prod;
+
+    paStats.matches++;
+    prod.info = prod_par->info;
+    prod.data = prod_par->data;
+    if (prodAction(&prod, pal, prod_par->encoded, prod_par->size, apProd)) {
+        if (pal->action.flags & LDM_ACT_TRANSIENT) {
+            /* connection closed, don't try again */
+            remove_palt(pal);
+        }
+        *errorOccurred = true;
+    }
+}
+
 /**
  * Loop thru the pattern / action table, applying actions to matching product.
  * If no processing error occurs, then the global variable `palt_last_insertion`
- * is set.
+ * is set. If actions are executed by a pool of threads (see actpool.h), then
+ * the pool sets the variable after all actions on this and previous
+ * data-products have completed.
  *
  * @param[in] prod_par   Data-product parameters
  * @param[in] queue_par  Product-queue parameters
@@ -1329,36 +1798,64 @@ processProduct(
         void* const restrict              opt_arg)
 {
     const prod_info* const infop = &prod_par->info;
-    void* const            datap = prod_par->data;
-    palt*                  next;
+    const feedtypet        feedtype = infop->feedtype;
     bool                   didMatch = false;
     bool                   errorOccurred = false;
+    ap_prod*               apProd = NULL;
 
     log_info_q("%s", s_prod_info(NULL, 0, infop, log_is_enabled_debug));
+    paStats.products++;
 
-    for (palt* pal = paList; pal != NULL; pal = next) {
-        next = pal->next;
-        /*
-         * If the feedtype matches AND ((the product ID matches the regular
-         * expression) OR (the pattern is "_ELSE_" AND nothing has been done to
-         * this product yet AND the first char of the ident isn't '_'))
-         */
-        if ((infop->feedtype & pal->feedtype) && (
-                (regexec(&pal->prog, infop->ident, pal->prog.re_nsub +1,
-                        pal->pmatchp, 0) == 0)
-                || (strcmp(pal->pattern, "^_ELSE_$") == 0
-                        && !didMatch && infop->ident[0] != '_'))) {
-            /* A match, do something */
-            didMatch = true;
-            product prod;
-            prod.info = *infop;
-            prod.data = (void*)datap; /* cast away const */
-            if (prodAction(&prod, pal, prod_par->encoded, prod_par->size)) {
-                if (pal->action.flags & LDM_ACT_TRANSIENT) {
-                    /* connection closed, don't try again */
-                    remove_palt(pal);
-                }
-                errorOccurred = true;
+    if (ap_isActive()) {
+        apProd = ap_begin(prod_par, &queue_par->inserted);
+        if (apProd == NULL) {
+            log_error_q("Couldn't process product \"%s\"", infop->ident);
+            return;
+        }
+    }
+
+    if (paIndexStale)
+        pai_build(); // A transient entry was removed
+
+    if (!paIndexed || paIndex == NULL) {
+        palt* next;
+
+        for (palt* pal = paList; pal != NULL; pal = next) {
+            next = pal->next;
+            if ((feedtype & pal->feedtype) &&
+                    pal_matches(pal, infop->ident, didMatch)) {
+                /* A match, do something */
+                didMatch = true;
+                pal_apply(pal, prod_par, apProd, &errorOccurred);
+            }
+        }
+    }
+    else {
+        paindex* const idx = paIndex;
+        palt**         entries = idx->entries;
+        size_t         count = idx->count;
+        bool           scanned = false;
+
+        if (feedtype && (feedtype & (feedtype - 1)) == 0) {
+            /* Only the entries that accept the product's one feedtype */
+            const int bit = ffs((int)feedtype) - 1;
+            entries = idx->bucket[bit];
+            count = idx->bucketLen[bit];
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            palt* const pal = entries[i];
+
+            if ((feedtype & pal->feedtype) == 0)
+                continue;
+            if (pal->literals != NULL && !pai_mightMatch(idx, pal,
+                    infop->ident, &scanned))
+                continue;
+            if (pal_matches(pal, infop->ident, didMatch)) {
+                /* A match, do something */
+                didMatch = true;
+                // Might free `pal`
+                pal_apply(pal, prod_par, apProd, &errorOccurred);
             }
         }
     }
@@ -1371,7 +1868,10 @@ processProduct(
             s_prod_info(buf, sizeof(buf), infop, log_is_enabled_debug));
     }
 
-    if (!errorOccurred) {
+    if (apProd != NULL) {
+        ap_end(apProd, errorOccurred);
+    }
+    else if (!errorOccurred) {
         /*
          * The insertion-time of the last successfully-processed
          * data-product is only set if the product had no processing
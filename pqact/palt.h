@@ -13,6 +13,16 @@
  */
 extern timestampt palt_last_insertion;
 
+/*
+ * Statistics of the matching of data-products against the pattern/action
+ * table:
+ */
+typedef struct {
+    unsigned long products; // Data-products processed
+    unsigned long regexecs; // Regular-expressions executed
+    unsigned long matches;  // Entries whose action was applied
+} palt_stats_t;
+
 #ifdef __cplusplus
 extern "C" int readPatFile(const char *path);
 extern "C" int processProduct(const prod_info *infop, const void *datap,
@@ -20,8 +30,27 @@ extern "C" int processProduct(const prod_info *infop, const void *datap,
 	void *otherargs);
 extern "C" void dummyprod(char *ident);
 #elif defined(__STDC__)
+#include <stdbool.h>
+
 extern int readPatFile(const char *path);
 
+/**
+ * Returns the statistics of the matching of data-products against the
+ * pattern/action table since the program started.
+ *
+ * @param[out] stats  Statistics
+ */
+void palt_getStats(palt_stats_t* stats);
+
+/**
+ * Enables or disables the index of the pattern/action table, which is enabled
+ * by default. Without it, every entry is matched against every data-product.
+ * For testing and benchmarking.
+ *
+ * @param[in] indexed  Whether to use the index
+ */
+void palt_setIndexed(bool indexed);
+
 #if 0
 /**
  * Loop thru the pattern / action table, applying actions
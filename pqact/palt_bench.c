@@ -0,0 +1,277 @@
+/**
+ * Copyright 2026 University Corporation for Atmospheric Research. All rights
+ * reserved. See the the file COPYRIGHT in the top-level source-directory for
+ * licensing conditions.
+ *
+ *   @file: palt_bench.c
+ *
+ * Benchmark of the matching of data-products against the pattern/action table
+ * of pqact(1): writes a synthetic configuration-file of many entries (WMO
+ * headers, NEXRAD Level III, model output, imagery, and an _ELSE_ entry) with
+ * NOOP actions, reads it, and processes the same synthetic data-products
+ * with and without the index of the table. The number of actions applied to
+ * each data-product must be the same both ways.
+ *
+ * Usage: palt_bench [nentries [nprods]]
+ *
+ * The default number of entries is 10000 and the default number of
+ * data-products is 2000.
+ */
+
+#include "config.h"
+
+#include "ldm.h"
+#include "log.h"
+#include "palt.h"
+#include "pq.h"
+#include "timestamp.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* Referenced by the actions */
+pqueue* pq = NULL;
+int     pipe_timeo = 60;
+
+#define CONF_PATH       "palt_bench.conf"
+
+typedef struct {
+    feedtypet feedtype;
+    char      ident[KEYSIZE];
+} synth_prod;
+
+static const char* const stations[] = {"KWBC", "KWNB", "KWNH", "KKCI", "KNES",
+        "KWAL", "PANC", "PHFO", "CWAO", "EGRR"};
+static const char* const radars[] = {"N0R", "N0V", "N0Q", "NCR", "DVL", "EET",
+        "N1P", "NTP", "DPR", "HHC"};
+static const char* const models[] = {"gfs", "nam", "hrrr", "rap", "gefs"};
+
+static double
+now(void)
+{
+    struct timeval tv;
+    (void)gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+static void
+rand_upper(char* const buf, const int n)
+{
+    for (int i = 0; i < n; i++)
+        buf[i] = 'A' + random() % 26;
+    buf[n] = 0;
+}
+
+/*
+ * Returns the `i`th synthetic pattern/action entry.
+ */
+static void
+make_entry(const int i, char* const buf, const size_t size)
+{
+    char tt[5];
+    char site[4];
+
+    switch (i % 5) {
+    case 0:
+        rand_upper(tt, 4);
+        (void)snprintf(buf, size, "IDS|DDPLUS\t^%s%02ld %s ([0-3][0-9])"
+                "([0-2][0-9])\tNOOP\n", tt, random() % 100,
+                stations[random() % 10]);
+        break;
+    case 1:
+        rand_upper(site, 3);
+        (void)snprintf(buf, size, "NEXRAD3\t^SDUS[2-8]. .... ([0-3][0-9])"
+                "([0-2][0-9]).*/p%s%s\tNOOP\n", radars[random() % 10], site);
+        break;
+    case 2:
+        (void)snprintf(buf, size, "NGRID|CONDUIT\tdata/nccf/com/.*/%s\\."
+                "t(..)z.*grb2f%03ld\tNOOP\n", models[random() % 5],
+                random() % 1000);
+        break;
+    case 3:
+        rand_upper(site, 3);
+        (void)snprintf(buf, size, "HDS\t^(SAUS|SPUS|SXUS)[0-9]{2} K%s\tNOOP\n",
+                site);
+        break;
+    default:
+        rand_upper(tt, 4);
+        (void)snprintf(buf, size, "ANY\t%s_[0-9]+_(vis|ir|wv)\\.gif$\tNOOP\n",
+                tt);
+        break;
+    }
+}
+
+/*
+ * Returns a synthetic data-product. Some match entries of the
+ * configuration-file; the rest resemble them and match the _ELSE_ entry.
+ */
+static void
+make_prod(synth_prod* const prod)
+{
+    char tt[5];
+    char site[4];
+
+    rand_upper(tt, 4);
+    rand_upper(site, 3);
+    switch (random() % 4) {
+    case 0:
+        prod->feedtype = (random() % 2) ? IDS : DDPLUS;
+        (void)snprintf(prod->ident, sizeof(prod->ident), "%s%02ld %s 1512%02ld",
+                tt, random() % 100, stations[random() % 10], random() % 60);
+        break;
+    case 1:
+        prod->feedtype = NNEXRAD;
+        (void)snprintf(prod->ident, sizeof(prod->ident),
+                "SDUS5%ld K%s 151200 /p%s%s", random() % 10, site,
+                radars[random() % 10], site);
+        break;
+    case 2:
+        prod->feedtype = (random() % 2) ? NGRID : CONDUIT;
+        (void)snprintf(prod->ident, sizeof(prod->ident),
+                "data/nccf/com/%s/prod/%s.20260101/%s.t12z.pgrb2f%03ld",
+                models[random() % 5], models[random() % 5],
+                models[random() % 5], random() % 1000);
+        break;
+    default:
+        prod->feedtype = HDS;
+        (void)snprintf(prod->ident, sizeof(prod->ident), "SAUS%02ld K%s 151200",
+                random() % 100, site);
+        break;
+    }
+}
+
+static void
+process(const synth_prod* const prod)
+{
+    queue_par_t queue_par = {.inserted = TS_NONE};
+    prod_par_t  prod_par = {
+            .info.feedtype = prod->feedtype,
+            .info.ident = (char*)prod->ident,
+            .info.origin = "localhost",
+            .data = NULL,
+            .encoded = NULL,
+            .size = 0
+    };
+    processProduct(&prod_par, &queue_par, NULL);
+}
+
+/*
+ * Returns the number of products to which a different number of actions is
+ * applied with the index than without it.
+ */
+static int
+verify(const synth_prod* const prods, const int nprods)
+{
+    int ndiff = 0;
+
+    for (int i = 0; i < nprods; i++) {
+        palt_stats_t stats[3];
+
+        palt_getStats(stats);
+        palt_setIndexed(false);
+        process(prods + i);
+        palt_getStats(stats + 1);
+        palt_setIndexed(true);
+        process(prods + i);
+        palt_getStats(stats + 2);
+        if (stats[1].matches - stats[0].matches !=
+                stats[2].matches - stats[1].matches) {
+            (void)fprintf(stderr, "Different actions: %s\n", prods[i].ident);
+            ndiff++;
+        }
+    }
+
+    return ndiff;
+}
+
+/*
+ * Processes the products and returns the rate in products per second.
+ */
+static double
+run(const synth_prod* const prods, const int nprods, const bool indexed,
+        palt_stats_t* const stats)
+{
+    palt_stats_t before;
+    double       start;
+
+    palt_setIndexed(indexed);
+    palt_getStats(&before);
+    start = now();
+    for (int i = 0; i < nprods; i++)
+        process(prods + i);
+    double elapsed = now() - start;
+    palt_getStats(stats);
+    stats->products -= before.products;
+    stats->regexecs -= before.regexecs;
+    stats->matches -= before.matches;
+
+    return nprods / elapsed;
+}
+
+int
+main(const int argc, char* const argv[])
+{
+    const int    nentries = argc > 1 ? atoi(argv[1]) : 10000;
+    const int    nprods = argc > 2 ? atoi(argv[2]) : 2000;
+    FILE*        fp;
+    synth_prod*  prods;
+    palt_stats_t linear, indexed;
+    double       start;
+
+    (void)log_init(argv[0]);
+    log_set_level(LOG_LEVEL_WARNING);
+    srandom(1);
+
+    if ((fp = fopen(CONF_PATH, "w")) == NULL) {
+        perror(CONF_PATH);
+        return 1;
+    }
+    for (int i = 0; i < nentries; i++) {
+        char buf[256];
+        make_entry(i, buf, sizeof(buf));
+        (void)fputs(buf, fp);
+    }
+    (void)fputs("ANY\t^_ELSE_$\tNOOP\n", fp);
+    (void)fclose(fp);
+
+    start = now();
+    if (readPatFile(CONF_PATH) < 0) {
+        (void)unlink(CONF_PATH);
+        return 1;
+    }
+    (void)printf("Read and indexed %d entries in %g s\n", nentries + 1,
+            now() - start);
+    (void)unlink(CONF_PATH);
+
+    if ((prods = malloc(nprods * sizeof(synth_prod))) == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    for (int i = 0; i < nprods; i++)
+        make_prod(prods + i);
+
+    if (verify(prods, nprods)) {
+        (void)fprintf(stderr, "Matching differs with the index\n");
+        return 1;
+    }
+
+    double linearRate = run(prods, nprods, false, &linear);
+    double indexedRate = run(prods, nprods, true, &indexed);
+
+    (void)printf("Without index: %10.1f products/s, %8.1f regexec()s per "
+            "product, %lu actions\n", linearRate,
+            (double)linear.regexecs / nprods, linear.matches);
+    (void)printf("With index:    %10.1f products/s, %8.1f regexec()s per "
+            "product, %lu actions\n", indexedRate,
+            (double)indexed.regexecs / nprods, indexed.matches);
+    (void)printf("Speed-up:      %10.1f\n", indexedRate / linearRate);
+
+    free(prods);
+    log_fini();
+
+    return 0;
+}
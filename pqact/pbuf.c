@@ -6,12 +6,13 @@
 
 #include <config.h>
 #include "pbuf.h"
+#include <errno.h>
+#include <poll.h>
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
 #include "log.h"
 #include "ldmalloc.h"
-#include "alrm.h"
 #include "error.h"
 #include "fdnb.h"
 
@@ -70,7 +71,6 @@ err:
  * @param[in] timeo      Timeout in seconds. 0 means indefinite timeout.
  * @retval    0          Success.
  * @retval    EAGAIN     `block` is false and write would block.
- * @retval    EINTR      Write to pipe was interrupted by signal.
  * @retval    EPIPE      Pipe not open for reading. Reader likely terminated.
  * @retval    ETIMEDOUT  Write to pipe timed-out.
  */
@@ -81,6 +81,7 @@ pbuf_flush(
     unsigned int        timeo)          /* N.B. Not a struct timeval */
 {
     size_t              len = (size_t)(buf->ptr - buf->base);
+    size_t              nwrote = 0;
     int                 status = ENOERR;        /* success */
 
     log_debug("fd %d %6d %s", buf->pfd, len, block ? "block" : "" );
@@ -92,64 +93,83 @@ pbuf_flush(
     time_t start;
     (void)time(&start);
 
-    int changed = block ? clr_fd_nonblock(buf->pfd) : 0;
-
-    if (block && timeo != 0)             /* (timeo == 0) => don't set alarm */
-        SET_ALARM(timeo, flush_timeo);
+    /*
+     * The file descriptor stays non-blocking. A blocking write waits in
+     * poll(2) rather than being interrupted by alarm(2) because actions can
+     * be executed by more than one thread.
+     */
+    while (nwrote < len) {
+        ssize_t n = write(buf->pfd, buf->base + nwrote, len - nwrote);
+
+        if (n > 0) {
+            nwrote += n;
+            continue;
+        }
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && errno != EAGAIN) {
+            status = errno;
+            log_add_errno(status, "Couldn't write to pipe: fd=%d, len=%zd",
+                    buf->pfd, len - nwrote);
+            break;
+        }
+        if (!block) {
+            // Couldn't execute non-blocking write just now
+            if (nwrote == 0)
+                status = EAGAIN;
+            break;
+        }
 
-    int nwrote = (int)write(buf->pfd, buf->base, len);
-    int tmpErrno = errno;                /* CLR_ALRM() can change "errno" */
+        int timeout = -1; // Indefinite
+        if (timeo != 0) {
+            const unsigned long duration = time(NULL) - start;
 
-    if (block && timeo != 0)
-        CLR_ALRM();
+            if (duration >= timeo) {
+                status = ETIMEDOUT;
+                break;
+            }
+            timeout = (int)(timeo - duration) * 1000;
+        }
 
-    if (nwrote == -1) {
-        if ((tmpErrno == EAGAIN) && (!block)) {
-            // Couldn't execute non-blocking write just now
-            nwrote = 0;
+        struct pollfd pfd = {.fd = buf->pfd, .events = POLLOUT};
+        n = poll(&pfd, 1, timeout);
+        if (n == 0) {
+            status = ETIMEDOUT;
+            break;
         }
-        else {
-            log_add_errno(tmpErrno, "Couldn't write to pipe: fd=%d, len=%zd",
-                    buf->pfd, len);
+        if (n == -1 && errno != EINTR) {
+            status = errno;
+            log_add_errno(status, "Couldn't poll pipe: fd=%d", buf->pfd);
+            break;
         }
-        status = tmpErrno;
     }
-    else {
-        if (nwrote == len) {
-            /* wrote the whole buffer */
-            log_debug("Wrote %d bytes", nwrote);
-            buf->ptr = buf->base;
-            len = 0;
-        }
-        else if (nwrote > 0) {
-            /* partial write, just shift the buffer by the amount written */
-            log_debug("Partial write %d of %d bytes",
-                nwrote, len);
-            len -= nwrote;
-            /* could be an overlapping copy */
-            memmove(buf->base, buf->base + nwrote, len);
-            buf->ptr = buf->base +len;
-        }
 
-        unsigned long duration = time(NULL) - start;
-        if (duration > 5)
-            log_warning_q("Write of %d bytes to decoder took %lu seconds", nwrote,
-                    duration);
+    const size_t remaining = len - nwrote;
+
+    if (remaining == 0) {
+        /* wrote the whole buffer */
+        log_debug("Wrote %zu bytes", nwrote);
+        buf->ptr = buf->base;
+    }
+    else if (nwrote > 0) {
+        /* partial write, just shift the buffer by the amount written */
+        log_debug("Partial write %zu of %zu bytes", nwrote, len);
+        /* could be an overlapping copy */
+        memmove(buf->base, buf->base + nwrote, remaining);
+        buf->ptr = buf->base + remaining;
     }
 
-    if (changed)
-        set_fd_nonblock(buf->pfd);
+    unsigned long duration = time(NULL) - start;
+    if (status == ETIMEDOUT) {
+        log_error_q("write(%d,,%lu) to decoder timed-out (%lu s)",
+            buf->pfd, (unsigned long)remaining, duration);
+    }
+    else if (duration > 5) {
+        log_warning_q("Write of %zu bytes to decoder took %lu seconds", nwrote,
+                duration);
+    }
 
     return status;
-
-flush_timeo:
-    if (changed)
-        set_fd_nonblock(buf->pfd);
-
-    log_error_q("write(%d,,%lu) to decoder timed-out (%lu s)",
-        buf->pfd, (unsigned long)len, (unsigned long)(time(NULL) - start));
-
-    return ETIMEDOUT;
 }
 
 /**
@@ -160,7 +180,6 @@ flush_timeo:
  * @param[in] nbytes     Number of bytes to write.
  * @param[in] timeo      Timeout in seconds. 0 means indefinite timeout.
  * @retval    0          Success.
- * @retval    EINTR      Write to pipe was interrupted by signal.
  * @retval    EPIPE      Pipe not open for reading. Reader likely terminated.
  * @retval    ETIMEDOUT  Write to pipe timed-out.
  */
@@ -23,6 +23,7 @@
 #include <rpc/rpc.h>
 #include <signal.h>
 #include <errno.h>
+#include <sys/resource.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <regex.h>
@@ -43,6 +44,7 @@
 #include "atofeedt.h"
 #include "pq.h"
 #include "palt.h"
+#include "actpool.h"
 #include "ldmfork.h"
 #include "ldmprint.h"
 #include "filel.h" /* pipe_timeo */
@@ -50,17 +52,26 @@
 #include "timestamp.h"
 #include "log.h"
 #include "RegularExpressions.h"
+#include "spawner.h"
 
 #ifdef NO_ATEXIT
 #include "atexit.h"
 #endif
 
 static volatile sig_atomic_t hupped = 0;
+/// Whether statistics on the open outputs should be logged
+static volatile sig_atomic_t statsRequested = 0;
 static const char*           conffilename = 0;
 static int                   shmid = -1;
 static int                   semid = -1;
 static key_t                 key;
 static key_t                 semkey;
+/// Number of data-products to prefetch or 0
+static unsigned              prefetch = 0;
+/// Number of threads that execute actions or 0
+static unsigned              nthreads = 0;
+/// Whether the processes of EXEC and PIPE actions are created by a spawn server
+static bool                  useSpawner = false;
 
 #ifndef DEFAULT_INTERVAL
 #define DEFAULT_INTERVAL 15
@@ -71,6 +82,12 @@ static key_t                 semkey;
 #ifndef DEFAULT_PATTERN
 #define DEFAULT_PATTERN ".*"
 #endif
+/*
+ * Maximum number of data-products obtained from the product-queue at once.
+ */
+#ifndef PQACT_BATCH
+#define PQACT_BATCH 64
+#endif
 
 /*
  * Timeout used for PIPE actions,
@@ -115,11 +132,38 @@ cleanup(void)
          * We are not in the interrupt context, so these can be performed
          * safely.
          */
+        if (nthreads) {
+            ap_stats_t apStats;
+
+            ap_fini(); // Waits for submitted actions
+            ap_getStats(&apStats);
+            log_notice_q("Executed %lu actions in %u threads; waited %lu "
+                    "times for the threads", apStats.actions, nthreads,
+                    apStats.waits);
+        }
         fl_closeAll();
 
+        if (pq && prefetch) {
+            unsigned long long nprods, nbytes, ncold;
+
+            if (pq_getPrefetchStats(pq, NULL, &nprods, &nbytes, &ncold) == 0)
+                log_notice_q("Prefetched %llu products (%llu bytes); "
+                        "marked %llu products reclaimable", nprods, nbytes,
+                        ncold);
+        }
+
         if (pq)
             (void)pq_close(pq);
 
+        {
+            palt_stats_t stats;
+
+            palt_getStats(&stats);
+            log_notice_q("Processed %lu products: executed %lu "
+                    "regular-expressions; applied %lu actions",
+                    stats.products, stats.regexecs, stats.matches);
+        }
+
         if (!tvEqual(palt_last_insertion, TS_ZERO)) {
             timestampt  now;
 
@@ -135,6 +179,18 @@ cleanup(void)
 
         while (reap(-1, WNOHANG) > 0)
             /*EMPTY*/;
+
+        sp_logStats();
+        sp_fini();
+    }
+
+    {
+        struct rusage usage;
+
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            log_notice_q("Used %.3f s of user and %.3f s of system CPU time",
+                    usage.ru_utime.tv_sec + usage.ru_utime.tv_usec/1e6,
+                    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec/1e6);
     }
 
     if(shmid != -1) {
@@ -174,6 +230,7 @@ signal_handler(int sig)
                 return;
         case SIGUSR1 :
                 log_refresh();
+                statsRequested = 1;
                 return;
         case SIGUSR2 :
                 log_roll_level();
@@ -275,6 +332,12 @@ usage(
         log_error_q(
 "\t-o offset    Start with products arriving \"offset\" seconds before now (default: 0)");
         log_error_q(
+"\t-r count     Prefetch the next \"count\" products from the queue (default: 0)");
+        log_error_q(
+"\t-n nthreads  Execute actions in \"nthreads\" threads (default: 0)");
+        log_error_q(
+"\t-s           Create EXEC and PIPE processes via a spawn server");
+        log_error_q(
 "\tconfig_file  Pathname of configuration-file (default: " "\"%s\")",
                 getPqactConfigPath());
         exit(EXIT_FAILURE);
@@ -332,7 +395,7 @@ main(int ac, char *av[])
 
             opterr = 1;
 
-            while ((ch = getopt(ac, av, "vxel:d:f:q:o:p:i:t:")) != EOF) {
+            while ((ch = getopt(ac, av, "vxel:d:f:q:o:p:i:t:r:n:s")) != EOF) {
                 switch (ch) {
                 case 'v':
                         if (!log_is_enabled_info)
@@ -394,6 +457,33 @@ main(int ac, char *av[])
                 case 'p':
                         spec.pattern = optarg;
                         break;
+                case 'r': {
+                        char* end;
+                        const unsigned long n = strtoul(optarg, &end, 0);
+                        if (*end || end == optarg || n > UINT_MAX)
+                        {
+                                log_error_q("invalid prefetch count %s",
+                                        optarg);
+                                usage(progname);
+                        }
+                        prefetch = n;
+                        break;
+                }
+                case 'n': {
+                        char* end;
+                        const unsigned long n = strtoul(optarg, &end, 0);
+                        if (*end || end == optarg || n > 1024)
+                        {
+                                log_error_q("invalid number of threads %s",
+                                        optarg);
+                                usage(progname);
+                        }
+                        nthreads = n;
+                        break;
+                }
+                case 's':
+                        useSpawner = true;
+                        break;
                 default:
                         usage(progname);
                         break;
@@ -518,6 +608,15 @@ main(int ac, char *av[])
          */
         set_sigactions();
 
+        /*
+         * Start the spawn server while this process is small and has only one
+         * thread.
+         */
+        if (useSpawner && sp_init()) {
+            log_add("Couldn't start spawn server. Continuing with fork().");
+            log_flush_warning();
+        }
+
         /*
          * Read in (compile) the configuration file.  We do this first so
          * its syntax may be checked without opening a product queue.
@@ -535,6 +634,8 @@ main(int ac, char *av[])
         /*
          * Open the product queue
          */
+        if (pq_setMapDefaults(getQueueMapFlags(), getQueueNumaNode()))
+            log_flush_warning();
         status = pq_open(pqfname, PQ_READONLY, &pq);
         if(status)
         {
@@ -550,6 +651,9 @@ main(int ac, char *av[])
                 /*NOTREACHED*/
         }
 
+        if (prefetch)
+            (void)pq_setPrefetch(pq, prefetch);
+
         if(toffset != TOFFSET_NONE) {
             /*
              * Filter and queue position set by "toffset".
@@ -617,9 +721,24 @@ main(int ac, char *av[])
                         exit(4);
                         /*NOTREACHED*/
                 }
+                if (sp_isActive() && sp_chdir(datadir)) {
+                        log_add("Stopping spawn server. Continuing with "
+                                "fork().");
+                        log_flush_warning();
+                        sp_fini();
+                }
         }
 
 
+        /*
+         * Start the threads that execute actions if appropriate.
+         */
+        if (ap_init(nthreads, &palt_last_insertion)) {
+                log_error_q("Couldn't start threads that execute actions");
+                exit(EXIT_FAILURE);
+                /*NOTREACHED*/
+        }
+
         /*
          *  Do special pre main loop actions in pattern/action file
          *  N.B. Deprecate.
@@ -636,12 +755,23 @@ main(int ac, char *av[])
                 (void) readPatFile(conffilename);
                 hupped = 0;
             }
+            if (statsRequested) {
+                statsRequested = 0;
+                ap_logStats();
+                sp_logStats();
+            }
 
 #if 0
             status = pq_sequence(pq, TV_GT, &clss, processProduct,
                     &palt_processing_error);
 #else
-            status = pq_next(pq, false, &clss, processProduct, false, NULL);
+            /*
+             * Up to `PQACT_BATCH` data-products are locked and found at once,
+             * which reduces the cost per data-product when this program is
+             * behind.
+             */
+            status = pq_nextv(pq, &clss, processProduct, PQACT_BATCH, NULL,
+                    NULL);
 #endif
 
             if (status) {
@@ -657,14 +787,14 @@ main(int ac, char *av[])
                     /*
                      * Perform a non-blocking sync on all open file descriptors.
                      */
-                    fl_sync(FALSE);
+                    ap_sync(FALSE);
                 }
                 else if (status == EAGAIN || status == EACCES) {
                     log_debug("Hit a lock");
                     /*
                      * Close the least recently used file descriptor.
                      */
-                    fl_closeLru(FL_NOTRANSIENT);
+                    ap_closeLru(FL_NOTRANSIENT);
                 }
                 else if (status == EDEADLK
 #if defined(EDEADLOCK) && EDEADLOCK != EDEADLK
@@ -675,16 +805,16 @@ main(int ac, char *av[])
                     /*
                      * Close the least recently used file descriptor.
                      */
-                    fl_closeLru(FL_NOTRANSIENT);
+                    ap_closeLru(FL_NOTRANSIENT);
                 }
                 else {
-                    log_error_q("pq_next() failure: %s (errno = %d)",
+                    log_error_q("pq_nextv() failure: %s (errno = %d)",
                         strerror(status), status);
                     exit(EXIT_FAILURE);
                     /*NOTREACHED*/
                 }
 
-                (void)pq_suspend(interval);
+                (void)pq_wait(pq, interval);
             }                           /* No data-product processed */
 
             (void)exitIfDone(0);
@@ -696,5 +826,7 @@ main(int ac, char *av[])
                 /*EMPTY*/;
         }                               /* main loop */
 
+        ap_fini(); // Waits for submitted actions
+
         return 0;
 }
@@ -0,0 +1,126 @@
+/*
+ *   Copyright 2026 University Corporation for Atmospheric Research
+ *
+ *   See file COPYRIGHT in the top-level source-directory for copying and
+ *   redistribution conditions.
+ */
+/**
+ * Decoder for a PIPE action with the "-shm" option that reads every
+ * data-product in place and discards it. Used to test and benchmark the
+ * shared-memory transport of pqact(1).
+ *
+ * Usage: shm_sink [-m] [outfile]
+ *     -m       Records start with the metadata of the "-metadata" option,
+ *              which is verified
+ *     outfile  File to which "<products> <bytes>" is written when pqact(1)
+ *              closes the pipe. Default is the standard output stream.
+ *
+ * Exits with 0 on success and 1 on failure.
+ */
+#include "config.h"
+
+#include "shmring.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static volatile uint64_t checksum; ///< Keeps the reading of the data
+
+/**
+ * Verifies the metadata at the start of a record.
+ *
+ * @param[in] data  The record
+ * @param[in] size  Size of the record in bytes
+ * @retval    0     The metadata is consistent with the record
+ * @retval    -1    The metadata isn't consistent with the record
+ */
+static int
+verifyMeta(
+        const char* const data,
+        const size_t      size)
+{
+    uint32_t metaLen, dataLen;
+
+    if (size < 2*sizeof(uint32_t) + 16)
+        return -1;
+
+    (void)memcpy(&metaLen, data, sizeof(metaLen));
+    (void)memcpy(&dataLen, data + sizeof(metaLen) + 16, sizeof(dataLen));
+
+    return (metaLen <= size && size - metaLen == dataLen) ? 0 : -1;
+}
+
+int
+main(
+        const int    argc,
+        char* const* argv)
+{
+    int   hasMeta = 0;
+    int   ch;
+
+    while ((ch = getopt(argc, argv, "m")) != -1) {
+        if (ch != 'm') {
+            (void)fprintf(stderr, "Usage: %s [-m] [outfile]\n", argv[0]);
+            return 1;
+        }
+        hasMeta = 1;
+    }
+
+    shmring*           ring;
+    int                status = shmring_attach(STDIN_FILENO, &ring);
+    unsigned long long nprods = 0;
+    unsigned long long nbytes = 0;
+    uint64_t           sum = 0;
+
+    if (status) {
+        (void)fprintf(stderr, "%s: Couldn't attach to shared-memory ring: %s\n",
+                argv[0], strerror(status));
+        return 1;
+    }
+
+    const void* data;
+    size_t      size;
+
+    while ((status = shmring_next(ring, &data, &size)) == 0) {
+        if (hasMeta && verifyMeta(data, size)) {
+            (void)fprintf(stderr, "%s: Invalid metadata in product %llu\n",
+                    argv[0], nprods);
+            status = EPROTO;
+            break;
+        }
+
+        // Touch every byte like a decoder would
+        const unsigned char* ptr = data;
+        for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+            uint64_t word = 0;
+            (void)memcpy(&word, ptr + i,
+                    size - i < sizeof(word) ? size - i : sizeof(word));
+            sum += word;
+        }
+
+        ++nprods;
+        nbytes += size;
+    }
+    shmring_detach(ring);
+    checksum = sum;
+
+    if (status != ENODATA) {
+        (void)fprintf(stderr, "%s: Couldn't read shared-memory ring: %s\n",
+                argv[0], strerror(status));
+        return 1;
+    }
+
+    FILE* const out = optind < argc ? fopen(argv[optind], "w") : stdout;
+
+    if (out == NULL) {
+        (void)fprintf(stderr, "%s: Couldn't open \"%s\": %s\n", argv[0],
+                argv[optind], strerror(errno));
+        return 1;
+    }
+    (void)fprintf(out, "%llu %llu\n", nprods, nbytes);
+
+    return fclose(out) ? 1 : 0;
+}
@@ -0,0 +1,1062 @@
+/*
+ *   Copyright 2026 University Corporation for Atmospheric Research
+ *
+ *   See file COPYRIGHT in the top-level source-directory for copying and
+ *   redistribution conditions.
+ */
+
+/**
+ * @file spawner.c
+ *
+ * Spawn server for the EXEC and PIPE actions of pqact(1).
+ *
+ * Forking pqact(1) to execute a program copies the page-tables of a process
+ * that can be large because of its configuration-file, open outputs, and
+ * product-queue. The spawn server is a small process that's forked from
+ * pqact(1) before the configuration-file is read. It receives requests over a
+ * UNIX-domain socket and creates the child processes with posix_spawnp(). For
+ * a PIPE action, it also creates the pipe and returns the write-end to
+ * pqact(1) via `SCM_RIGHTS`.
+ *
+ * Because the child processes are children of the server, the server waits
+ * upon them and sends their termination status to pqact(1), where sp_wait()
+ * takes the place of waitpid().
+ *
+ * The latency of creating a child process -- from the request until its PID is
+ * known -- is recorded both for the server and for fork() (see sp_record()).
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#ifndef PATH_MAX
+#define PATH_MAX 255                    /* _POSIX_PATH_MAX */
+#endif
+
+#include "filel.h"
+#include "ldmfork.h"
+#include "log.h"
+#include "spawner.h"
+
+extern char** environ;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+/// Maximum size of the arguments of a request in bytes
+#ifndef SP_MAX_REQUEST
+#define SP_MAX_REQUEST (64*1024)
+#endif
+/// Number of most recent latencies from which percentiles are computed
+#ifndef SP_NSAMPLES
+#define SP_NSAMPLES 4096
+#endif
+
+typedef enum {
+    SP_REQ_EXEC,        ///< Execute a program
+    SP_REQ_PIPE,        ///< Execute a decoder that reads from a pipe
+    SP_REQ_CHDIR        ///< Change the current working directory
+} sp_req_type;
+
+/**
+ * Header of a request to the server. Followed by `size` bytes of NUL-terminated
+ * strings: the arguments of the program or the pathname of the directory.
+ */
+typedef struct {
+    uint32_t type;      ///< `sp_req_type`
+    uint32_t size;      ///< Number of bytes that follow
+} sp_req;
+
+typedef enum {
+    SP_MSG_REPLY,       ///< Reply to a request
+    SP_MSG_EXIT         ///< Termination of a child process
+} sp_msg_type;
+
+/**
+ * Message from the server. A reply to a PIPE request that succeeded carries
+ * the write-end of the pipe.
+ */
+typedef struct {
+    int32_t type;       ///< `sp_msg_type`
+    int32_t pid;        ///< PID of the child process or -1
+    int32_t value;      ///< `errno` of the reply or status of the termination
+} sp_msg;
+
+/**
+ * A child process of the server that hasn't been waited upon by pqact(1)
+ */
+typedef struct sp_child {
+    struct sp_child* next;
+    pid_t            pid;
+    int              status;    ///< Termination status if `exited`
+    bool             exited;
+} sp_child;
+
+typedef struct {
+    unsigned long count;                ///< Number of child processes
+    double        sum;                  ///< Sum of latencies in seconds
+    double        max;                  ///< Maximum latency in seconds
+    double        samples[SP_NSAMPLES]; ///< Most recent latencies
+} sp_stats;
+
+static int             sock = -1;       ///< Socket to the server
+static bool            dead = true;     ///< Whether the server can't be used
+static pid_t           serverPid = -1;
+static pid_t           creatorPid = -1; ///< PID of the process of sp_init()
+/// Serializes requests so that at most one reply is outstanding
+static pthread_mutex_t requestMutex = PTHREAD_MUTEX_INITIALIZER;
+/// Protects the following and `dead`
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cond = PTHREAD_COND_INITIALIZER;
+static bool            reading = false; ///< Whether a thread is reading `sock`
+static bool            replied = false; ///< Whether `reply` is set
+static sp_msg          reply;
+static int             replyFd = -1;    ///< File descriptor of `reply`
+static sp_child*       children = NULL;
+
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+static sp_stats        stats[SP_NWAYS];
+
+/// Signals whose handlers in pqact(1) are reset to the default in a child
+static const int       CAUGHT_SIGNALS[] = {SIGHUP, SIGINT, SIGTERM, SIGUSR1,
+        SIGUSR2, SIGALRM, SIGCHLD};
+#define NCAUGHT (sizeof(CAUGHT_SIGNALS)/sizeof(CAUGHT_SIGNALS[0]))
+
+/**
+ * Returns the value of a monotonic clock.
+ *
+ * @return  Value of the clock in seconds
+ */
+double
+sp_now(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+/**
+ * Writes bytes to a file descriptor.
+ *
+ * @param[in] fd     File descriptor
+ * @param[in] iov    Bytes to write. Modified.
+ * @param[in] iovcnt Number of elements in `iov`
+ * @param[in] fdToSend  File descriptor to send with the bytes or -1
+ * @retval    0      Success
+ * @retval    -1     Failure. `errno` is set.
+ */
+static int
+sp_send(
+        const int          fd,
+        struct iovec*      iov,
+        int                iovcnt,
+        const int          fdToSend)
+{
+    union {
+        struct cmsghdr cmsg;
+        char           buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+
+    (void)memset(&msg, 0, sizeof(msg));
+    if (fdToSend >= 0) {
+        struct cmsghdr* cmsg;
+
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        (void)memcpy(CMSG_DATA(cmsg), &fdToSend, sizeof(int));
+    }
+
+    while (iovcnt > 0) {
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        msg.msg_control = NULL; // The file descriptor has been sent
+        msg.msg_controllen = 0;
+
+        for (; iovcnt > 0 && (size_t)n >= iov->iov_len; iov++, iovcnt--)
+            n -= iov->iov_len;
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Reads a given number of bytes from a file descriptor and any file descriptor
+ * sent with them.
+ *
+ * @param[in]  fd         File descriptor
+ * @param[out] buf        Buffer
+ * @param[in]  nbytes     Number of bytes to read
+ * @param[out] fdReceived File descriptor sent with the bytes or -1. May be
+ *                        `NULL`, in which case a received file descriptor is
+ *                        closed.
+ * @retval     0          Success
+ * @retval     -1         End-of-file or failure. `errno` is set on failure.
+ */
+static int
+sp_recv(
+        const int  fd,
+        void*      buf,
+        size_t     nbytes,
+        int* const fdReceived)
+{
+    union {
+        struct cmsghdr cmsg;
+        char           buf[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    if (fdReceived)
+        *fdReceived = -1;
+
+    while (nbytes > 0) {
+        struct iovec  iov = {buf, nbytes};
+        struct msghdr msg;
+
+        (void)memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (n == 0) {
+            errno = 0;
+            return -1;
+        }
+
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+                cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET &&
+                    cmsg->cmsg_type == SCM_RIGHTS) {
+                int received;
+
+                (void)memcpy(&received, CMSG_DATA(cmsg), sizeof(int));
+                if (MSG_CMSG_CLOEXEC == 0)
+                    (void)fcntl(received, F_SETFD, FD_CLOEXEC);
+                if (fdReceived && *fdReceived < 0) {
+                    *fdReceived = received;
+                }
+                else {
+                    (void)close(received);
+                }
+            }
+        }
+
+        buf = (char*)buf + n;
+        nbytes -= n;
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+ * The server:
+ ******************************************************************************/
+
+static void
+sp_onChild(const int sig)
+{
+}
+
+/**
+ * Sends a message to pqact(1). Terminates the server on failure because
+ * pqact(1) is gone.
+ */
+static void
+sp_reply(
+        const int   fd,
+        const int   type,
+        const pid_t pid,
+        const int   value,
+        const int   fdToSend)
+{
+    sp_msg       msg = {type, pid, value};
+    struct iovec iov = {&msg, sizeof(msg)};
+
+    if (sp_send(fd, &iov, 1, fdToSend))
+        _exit(0);
+}
+
+/**
+ * Executes a script that doesn't start with "#!" via the shell like execvp()
+ * does.
+ *
+ * @param[out] pid      PID of the child process
+ * @param[in]  argv     NULL-terminated arguments of the script
+ * @param[in]  actions  File actions for the child process
+ * @param[in]  attr     Attributes of the child process
+ * @retval     0        Success
+ * @return              `errno` error-code
+ */
+static int
+sp_spawnScript(
+        pid_t* const                            pid,
+        char* const* const                      argv,
+        const posix_spawn_file_actions_t* const actions,
+        const posix_spawnattr_t* const          attr)
+{
+    char        path[PATH_MAX];
+    const char* script = argv[0];
+    int         argc = 0;
+    int         status;
+
+    if (strchr(script, '/') == NULL) {
+        const char* dir = getenv("PATH");
+
+        for (script = NULL; dir && script == NULL; ) {
+            const char* const end = strchr(dir, ':');
+            const int         n = end ? end - dir : (int)strlen(dir);
+            const int         len = n
+                    ? snprintf(path, sizeof(path), "%.*s/%s", n, dir, argv[0])
+                    : snprintf(path, sizeof(path), "%s", argv[0]);
+
+            if (len < (int)sizeof(path) && access(path, X_OK) == 0)
+                script = path;
+            dir = end ? end + 1 : NULL;
+        }
+        if (script == NULL)
+            return ENOEXEC;
+    }
+
+    while (argv[argc])
+        argc++;
+
+    char** const args = malloc((argc + 2) * sizeof(char*));
+
+    if (args == NULL)
+        return errno;
+
+    args[0] = "sh";
+    args[1] = (char*)script;
+    (void)memcpy(args + 2, argv + 1, argc * sizeof(char*)); // includes NULL
+    status = posix_spawn(pid, "/bin/sh", actions, attr, args, environ);
+    free(args);
+
+    return status;
+}
+
+/**
+ * Executes a program or decoder.
+ *
+ * @param[in]  argv     NULL-terminated arguments of the program
+ * @param[in]  isPipe   Whether the program is a decoder of a PIPE action
+ * @param[out] writeFd  Write-end of the pipe to the decoder if `isPipe`
+ * @param[out] pid      PID of the child process
+ * @retval     0        Success
+ * @return              `errno` error-code
+ */
+static int
+sp_spawn(
+        char* const* const argv,
+        const bool         isPipe,
+        int* const         writeFd,
+        pid_t* const       pid)
+{
+    posix_spawnattr_t          attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t                   sigset;
+    int                        pfd[2] = {-1, -1};
+    short                      flags = POSIX_SPAWN_SETSIGMASK |
+            POSIX_SPAWN_SETSIGDEF;
+    int                        status;
+
+    if (isPipe) {
+        if (pipe(pfd))
+            return errno;
+        /*
+         * Neither end should be inherited: the read-end is duplicated onto the
+         * standard input stream of the decoder or the decoder won't see EOF
+         * when pqact(1) closes the write-end.
+         */
+        (void)fcntl(pfd[0], F_SETFD, FD_CLOEXEC);
+        (void)fcntl(pfd[1], F_SETFD, FD_CLOEXEC);
+        /*
+         * The decoder is made its own process-group leader to isolate it from
+         * signals sent to the LDM process-group (e.g., SIGCONTs, SIGINTs, and
+         * SIGTERMs).
+         */
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+
+    (void)posix_spawnattr_init(&attr);
+    (void)posix_spawnattr_setflags(&attr, flags);
+    (void)posix_spawnattr_setpgroup(&attr, 0);
+    (void)sigemptyset(&sigset);
+    (void)posix_spawnattr_setsigmask(&attr, &sigset);
+    for (size_t i = 0; i < NCAUGHT; i++)
+        (void)sigaddset(&sigset, CAUGHT_SIGNALS[i]);
+    (void)posix_spawnattr_setsigdefault(&attr, &sigset);
+
+    (void)posix_spawn_file_actions_init(&actions);
+    if (isPipe)
+        (void)posix_spawn_file_actions_adddup2(&actions, pfd[0],
+                STDIN_FILENO);
+
+    log_info_q(isPipe ? "Executing decoder \"%s\"" : "Executing program \"%s\"",
+            argv[0]);
+    status = posix_spawnp(pid, argv[0], &actions, &attr, argv, environ);
+    if (status == ENOEXEC)
+        status = sp_spawnScript(pid, argv, &actions, &attr);
+
+    (void)posix_spawn_file_actions_destroy(&actions);
+    (void)posix_spawnattr_destroy(&attr);
+
+    if (isPipe) {
+        (void)close(pfd[0]);
+        if (status) {
+            (void)close(pfd[1]);
+        }
+        else {
+            *writeFd = pfd[1];
+        }
+    }
+
+    return status;
+}
+
+/**
+ * Executes the request of pqact(1) and replies.
+ *
+ * @param[in] fd    Socket to pqact(1)
+ * @param[in] type  Type of the request
+ * @param[in] buf   Arguments of the request
+ * @param[in] size  Number of bytes in `buf`. `buf[size-1]` is NUL.
+ */
+static void
+sp_handle(
+        const int         fd,
+        const sp_req_type type,
+        char* const       buf,
+        const size_t      size)
+{
+    if (type == SP_REQ_CHDIR) {
+        sp_reply(fd, SP_MSG_REPLY, -1, chdir(buf) ? errno : 0, -1);
+    }
+    else if (type != SP_REQ_EXEC && type != SP_REQ_PIPE) {
+        sp_reply(fd, SP_MSG_REPLY, -1, EINVAL, -1);
+    }
+    else {
+        size_t argc = 0;
+        char** argv;
+
+        for (size_t i = 0; i < size; i++)
+            if (buf[i] == 0)
+                argc++;
+
+        if (argc == 0 || (argv = malloc((argc+1) * sizeof(char*))) == NULL) {
+            sp_reply(fd, SP_MSG_REPLY, -1, argc ? ENOMEM : EINVAL, -1);
+        }
+        else {
+            char* cp = buf;
+            pid_t pid = -1;
+            int   writeFd = -1;
+
+            for (size_t i = 0; i < argc; cp += strlen(cp) + 1)
+                argv[i++] = cp;
+            argv[argc] = NULL;
+
+            int status = sp_spawn(argv, type == SP_REQ_PIPE, &writeFd, &pid);
+
+            if (status) {
+                sp_reply(fd, SP_MSG_REPLY, -1, status, -1);
+            }
+            else {
+                sp_reply(fd, SP_MSG_REPLY, pid, 0, writeFd);
+                if (writeFd >= 0)
+                    (void)close(writeFd);
+            }
+
+            free(argv);
+        }
+    }
+}
+
+/**
+ * Executes the server. Never returns. The server terminates when pqact(1)
+ * closes its end of the socket.
+ *
+ * @param[in] fd  Socket to pqact(1)
+ */
+static void
+sp_serve(
+        const int fd)
+{
+    struct sigaction sigact;
+    sigset_t         sigset, waitSet;
+    char*            buf = NULL;
+    size_t           bufSize = 0;
+
+    /*
+     * The server ignores the signals that pqact(1) catches because it's in the
+     * same process-group. Signals that pqact(1) ignores remain ignored.
+     */
+    (void)sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigact.sa_handler = SIG_IGN;
+    for (size_t i = 0; i < NCAUGHT; i++)
+        if (CAUGHT_SIGNALS[i] != SIGCHLD)
+            (void)sigaction(CAUGHT_SIGNALS[i], &sigact, NULL);
+
+    /*
+     * SIGCHLD is only delivered during pselect() so that the termination of a
+     * child process can't be missed.
+     */
+    sigact.sa_handler = sp_onChild;
+    (void)sigaction(SIGCHLD, &sigact, NULL);
+    (void)sigemptyset(&sigset);
+    (void)sigaddset(&sigset, SIGCHLD);
+    (void)pthread_sigmask(SIG_BLOCK, &sigset, &waitSet);
+    (void)sigdelset(&waitSet, SIGCHLD);
+
+    // Don't let the child processes get any inappropriate privileges
+    endpriv();
+
+    for (;;) {
+        pid_t  pid;
+        int    status;
+        fd_set readFds;
+        sp_req req;
+
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+            sp_reply(fd, SP_MSG_EXIT, pid, status, -1);
+
+        FD_ZERO(&readFds);
+        FD_SET(fd, &readFds);
+        if (pselect(fd+1, &readFds, NULL, NULL, NULL, &waitSet) < 0) {
+            if (errno == EINTR)
+                continue;
+            log_syserr_q("pselect() failure");
+            break;
+        }
+
+        if (sp_recv(fd, &req, sizeof(req), NULL))
+            break; // pqact(1) is gone
+
+        if (req.size == 0 || req.size > SP_MAX_REQUEST) {
+            log_error_q("Invalid request size: %lu", (unsigned long)req.size);
+            break;
+        }
+        if (req.size > bufSize) {
+            free(buf);
+            if ((buf = malloc(req.size)) == NULL) {
+                log_syserr_q("Couldn't allocate %lu-byte buffer",
+                        (unsigned long)req.size);
+                break;
+            }
+            bufSize = req.size;
+        }
+        if (sp_recv(fd, buf, req.size, NULL))
+            break;
+        buf[req.size-1] = 0;
+
+        sp_handle(fd, req.type, buf, req.size);
+    }
+
+    _exit(0); // pqact(1)'s exit-handlers aren't for this process
+}
+
+/******************************************************************************
+ * The client in pqact(1):
+ ******************************************************************************/
+
+/**
+ * Starts the spawn server. Should be called while pqact(1) is small and has
+ * only one thread.
+ *
+ * @retval 0   Success
+ * @retval -1  Failure. log_add() called.
+ */
+int
+sp_init(void)
+{
+    int fds[2];
+    int status = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+        log_add_syserr("Couldn't create socket-pair for spawn server");
+    }
+    else {
+        (void)fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        (void)fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+        const pid_t pid = ldmfork();
+
+        if (pid == -1) {
+            log_add("Couldn't fork spawn server");
+            (void)close(fds[0]);
+            (void)close(fds[1]);
+        }
+        else if (pid == 0) {
+            (void)close(fds[0]);
+            sp_serve(fds[1]);
+        }
+        else {
+            (void)close(fds[1]);
+            sock = fds[0];
+            serverPid = pid;
+            creatorPid = getpid();
+            dead = false;
+            log_info_q("Started spawn server: pid=%ld", (long)pid);
+            status = 0;
+        }
+    }
+
+    return status;
+}
+
+/**
+ * Indicates if child processes are created by the spawn server.
+ *
+ * @retval true   The server is running
+ * @retval false  The server isn't running
+ */
+bool
+sp_isActive(void)
+{
+    (void)pthread_mutex_lock(&mutex);
+    const bool active = !dead;
+    (void)pthread_mutex_unlock(&mutex);
+
+    return active;
+}
+
+/**
+ * Reads one message from the server and acts on it. Must be called with
+ * `mutex` locked and no other thread reading. Returns with `mutex` locked.
+ */
+static void
+sp_read(void)
+{
+    sp_msg msg;
+    int    fd;
+
+    reading = true;
+    (void)pthread_mutex_unlock(&mutex);
+    const int status = sp_recv(sock, &msg, sizeof(msg), &fd);
+    (void)pthread_mutex_lock(&mutex);
+    reading = false;
+
+    if (status) {
+        if (errno) {
+            log_syserr_q("Couldn't read from spawn server");
+        }
+        else {
+            log_error_q("Spawn server terminated");
+        }
+        /*
+         * The termination of the remaining child processes won't be reported.
+         * The socket isn't closed because another thread might be writing to
+         * it.
+         */
+        dead = true;
+        while (children) {
+            sp_child* const child = children;
+            children = child->next;
+            free(child);
+        }
+    }
+    else if (msg.type == SP_MSG_REPLY) {
+        reply = msg;
+        replyFd = fd;
+        replied = true;
+
+        if (msg.pid > 0) {
+            // Before any termination-message about the child
+            sp_child* const child = malloc(sizeof(sp_child));
+
+            if (child == NULL) {
+                log_syserr_q("Couldn't allocate child-process entry");
+            }
+            else {
+                child->pid = msg.pid;
+                child->exited = false;
+                child->next = children;
+                children = child;
+            }
+        }
+    }
+    else {
+        if (fd >= 0)
+            (void)close(fd);
+
+        for (sp_child* child = children; child; child = child->next) {
+            if (child->pid == msg.pid) {
+                child->exited = true;
+                child->status = msg.value;
+                break;
+            }
+        }
+    }
+
+    (void)pthread_cond_broadcast(&cond);
+}
+
+/**
+ * Sends a request to the server and returns the reply.
+ *
+ * @param[in]  type  Type of the request
+ * @param[in]  argv  NULL-terminated arguments of the request
+ * @param[out] msg   The reply
+ * @param[out] fd    File descriptor of the reply or -1. May be `NULL`.
+ * @retval     0     Success. `*msg` and `*fd` are set.
+ * @retval     -1    Failure. log_add() called.
+ */
+static int
+sp_request(
+        const sp_req_type  type,
+        char* const* const argv,
+        sp_msg* const      msg,
+        int* const         fd)
+{
+    const double start = sp_now();
+    sp_req       req = {type, 0};
+    char*        buf;
+    int          status = -1;
+
+    for (int i = 0; argv[i]; i++)
+        req.size += strlen(argv[i]) + 1;
+    if (req.size == 0 || req.size > SP_MAX_REQUEST) {
+        log_add("Invalid size of arguments: %lu bytes",
+                (unsigned long)req.size);
+        return -1;
+    }
+    if ((buf = malloc(req.size)) == NULL) {
+        log_add_syserr("Couldn't allocate %lu-byte request",
+                (unsigned long)req.size);
+        return -1;
+    }
+    for (char *cp = buf, *const* arg = argv; *arg; arg++)
+        cp = stpcpy(cp, *arg) + 1;
+
+    struct iovec iov[2] = {{&req, sizeof(req)}, {buf, req.size}};
+
+    (void)pthread_mutex_lock(&requestMutex);
+
+    /*
+     * `mutex` isn't held while writing to the socket lest the server be
+     * blocked sending termination-messages that aren't being read.
+     */
+    if (!sp_isActive()) {
+        log_add("Spawn server isn't running");
+    }
+    else if (sp_send(sock, iov, 2, -1)) {
+        log_add_syserr("Couldn't send request to spawn server");
+    }
+    else {
+        (void)pthread_mutex_lock(&mutex);
+        while (!replied && !dead) {
+            if (reading) {
+                (void)pthread_cond_wait(&cond, &mutex);
+            }
+            else {
+                sp_read();
+            }
+        }
+        if (!replied) {
+            log_add("Spawn server terminated");
+        }
+        else {
+            replied = false;
+            *msg = reply;
+            if (fd) {
+                *fd = replyFd;
+            }
+            else if (replyFd >= 0) {
+                (void)close(replyFd);
+            }
+            replyFd = -1;
+            status = 0;
+        }
+        (void)pthread_mutex_unlock(&mutex);
+    }
+
+    (void)pthread_mutex_unlock(&requestMutex);
+    free(buf);
+
+    if (status == 0 && msg->pid > 0)
+        sp_record(SP_SERVER, sp_now() - start);
+
+    return status;
+}
+
+/**
+ * Changes the current working directory of the server, and hence of the
+ * child processes that it subsequently creates.
+ *
+ * @param[in] dir  Pathname of the directory
+ * @retval    0    Success
+ * @retval    -1   Failure. log_add() called.
+ */
+int
+sp_chdir(
+        const char* const dir)
+{
+    char* const argv[] = {(char*)dir, NULL};
+    sp_msg      msg;
+    int         status = sp_request(SP_REQ_CHDIR, argv, &msg, NULL);
+
+    if (status == 0 && msg.value) {
+        log_add_errno(msg.value, "Spawn server couldn't change to directory "
+                "\"%s\"", dir);
+        status = -1;
+    }
+
+    return status;
+}
+
+/**
+ * Executes a program in a child process of the server. The standard streams
+ * of the child are those of pqact(1).
+ *
+ * @param[in] argv  NULL-terminated arguments of the program
+ * @retval    -1    Failure. log_add() called.
+ * @return          PID of the child process. Wait upon it via sp_wait().
+ */
+pid_t
+sp_exec(
+        char* const argv[])
+{
+    sp_msg msg;
+
+    if (sp_request(SP_REQ_EXEC, argv, &msg, NULL))
+        return -1;
+
+    if (msg.pid <= 0) {
+        log_add_errno(msg.value, "Couldn't execute utility \"%s\"", argv[0]);
+        return -1;
+    }
+
+    return msg.pid;
+}
+
+/**
+ * Executes a decoder in a child process of the server. The standard input
+ * stream of the decoder is the read-end of a pipe. The decoder is the leader of
+ * its own process-group.
+ *
+ * @param[in]  argv     NULL-terminated arguments of the decoder
+ * @param[out] writeFd  Write-end of the pipe. Close-on-exec().
+ * @retval     -1       Failure. log_add() called.
+ * @return              PID of the decoder. Wait upon it via sp_wait().
+ */
+pid_t
+sp_pipe(
+        char* const argv[],
+        int* const  writeFd)
+{
+    sp_msg msg;
+    int    fd;
+
+    if (sp_request(SP_REQ_PIPE, argv, &msg, &fd))
+        return -1;
+
+    if (msg.pid <= 0) {
+        log_add_errno(msg.value, "Couldn't execute decoder \"%s\"", argv[0]);
+        return -1;
+    }
+    if (fd < 0) {
+        log_add("Spawn server didn't return pipe to decoder \"%s\"", argv[0]);
+        return -1; // The decoder will see EOF
+    }
+
+    *writeFd = fd;
+
+    return msg.pid;
+}
+
+/**
+ * Waits upon a child process of the server like waitpid().
+ *
+ * @param[in]  pid      PID of the child process or -1 for any child process
+ *                      of the server
+ * @param[out] status   Termination status of the child process
+ * @param[in]  options  0 or `WNOHANG`
+ * @retval     -1       The server isn't running or has no such child process.
+ *                      `errno` is `ECHILD`.
+ * @retval     0        `WNOHANG` is set and no such child process has
+ *                      terminated
+ * @return              PID of the terminated child process
+ */
+pid_t
+sp_wait(
+        const pid_t pid,
+        int* const  status,
+        const int   options)
+{
+    pid_t wpid;
+
+    (void)pthread_mutex_lock(&mutex);
+
+    for (;;) {
+        sp_child** prev = &children;
+        sp_child*  child;
+
+        for (child = children; child; prev = &child->next, child = child->next)
+            if (pid == -1 ? child->exited : child->pid == pid)
+                break;
+
+        if (child && child->exited) {
+            *prev = child->next;
+            *status = child->status;
+            wpid = child->pid;
+            free(child);
+            break;
+        }
+        if (dead || (pid == -1 ? children == NULL : child == NULL)) {
+            errno = ECHILD;
+            wpid = -1;
+            break;
+        }
+        if (reading) {
+            if (options & WNOHANG) {
+                wpid = 0;
+                break;
+            }
+            (void)pthread_cond_wait(&cond, &mutex);
+        }
+        else {
+            if (options & WNOHANG) {
+                struct pollfd pfd = {sock, POLLIN, 0};
+
+                if (poll(&pfd, 1, 0) <= 0) {
+                    wpid = 0;
+                    break;
+                }
+            }
+            sp_read();
+        }
+    }
+
+    (void)pthread_mutex_unlock(&mutex);
+
+    return wpid;
+}
+
+/**
+ * Records the latency of creating the child process of an action.
+ *
+ * @param[in] way      How the child process was created
+ * @param[in] seconds  Time from the start of the creation until the PID of the
+ *                     child process was known in seconds
+ */
+void
+sp_record(
+        const sp_way way,
+        const double seconds)
+{
+    sp_stats* const st = stats + way;
+
+    (void)pthread_mutex_lock(&statsMutex);
+    st->samples[st->count % SP_NSAMPLES] = seconds;
+    st->count++;
+    st->sum += seconds;
+    if (seconds > st->max)
+        st->max = seconds;
+    (void)pthread_mutex_unlock(&statsMutex);
+}
+
+static int
+sp_cmpDouble(
+        const void* a,
+        const void* b)
+{
+    const double x = *(const double*)a;
+    const double y = *(const double*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Logs the latencies of creating the child processes of actions: for each way
+ * of creating them, the number, mean, maximum, and the 50th, 90th, and 99th
+ * percentiles of the most recent `SP_NSAMPLES` latencies.
+ */
+void
+sp_logStats(void)
+{
+    static const char* const WAY_NAME[SP_NWAYS] = {"fork()",
+            "spawn server"};
+    static double            samples[SP_NSAMPLES];
+
+    for (int way = 0; way < SP_NWAYS; way++) {
+        (void)pthread_mutex_lock(&statsMutex);
+        const unsigned long count = stats[way].count;
+        const double        sum = stats[way].sum;
+        const double        max = stats[way].max;
+        const size_t        n = count < SP_NSAMPLES ? count : SP_NSAMPLES;
+        (void)memcpy(samples, stats[way].samples, n * sizeof(double));
+        (void)pthread_mutex_unlock(&statsMutex);
+
+        if (n) {
+            qsort(samples, n, sizeof(double), sp_cmpDouble);
+            log_notice_q("Created %lu child processes via %s: latency "
+                    "mean=%.3f ms, 50%%=%.3f ms, 90%%=%.3f ms, 99%%=%.3f ms, "
+                    "max=%.3f ms", count, WAY_NAME[way], 1e3 * sum / count,
+                    1e3 * samples[(n-1) / 2], 1e3 * samples[(9*n - 1) / 10],
+                    1e3 * samples[(99*n - 1) / 100], 1e3 * max);
+        }
+    }
+}
+
+/**
+ * Stops the spawn server. Child processes of the server aren't affected. Does
+ * nothing if the calling process didn't start the server (e.g., it's a child
+ * process of pqact(1)).
+ */
+void
+sp_fini(void)
+{
+    if (sock >= 0 && getpid() == creatorPid) {
+        (void)pthread_mutex_lock(&mutex);
+        dead = true;
+        (void)pthread_mutex_unlock(&mutex);
+        (void)close(sock); // Causes the server to terminate
+        sock = -1;
+        (void)waitpid(serverPid, NULL, 0);
+    }
+}
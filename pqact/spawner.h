@@ -0,0 +1,41 @@
+/*
+ *   Copyright 2026 University Corporation for Atmospheric Research
+ *
+ *   See file COPYRIGHT in the top-level source-directory for copying and
+ *   redistribution conditions.
+ */
+#ifndef _SPAWNER_H_
+#define _SPAWNER_H_
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/**
+ * Ways of creating the child process of an action
+ */
+typedef enum {
+    SP_FORK = 0,        ///< fork() of pqact(1) itself
+    SP_SERVER,          ///< Request to the spawn server
+    SP_NWAYS
+} sp_way;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int    sp_init(void);
+bool   sp_isActive(void);
+int    sp_chdir(const char* dir);
+pid_t  sp_exec(char* const argv[]);
+pid_t  sp_pipe(char* const argv[], int* writeFd);
+pid_t  sp_wait(pid_t pid, int* status, int options);
+double sp_now(void);
+void   sp_record(sp_way way, double seconds);
+void   sp_logStats(void);
+void   sp_fini(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !_SPAWNER_H_ */
@@ -449,7 +449,7 @@ int main(int ac, char *av[])
 
                 if(interval == 0)
                         break;
-                pq_suspend(interval);
+                pq_wait(pq, interval);
                         
         }
 
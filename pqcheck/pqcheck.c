@@ -52,6 +52,12 @@ usage(const char *av0) /*  id string */
 "\t-F           Force. Set the writer-counter to zero "
 "(creating it if necessary).\n");
         (void)fprintf(stderr,
+"\t-r           Recover. Rebuild the indexes of the product-queue from its\n"
+"\t             data-products if they're inconsistent (e.g., after a crash)\n"
+"\t             and set the writer-counter to zero.\n");
+        (void)fprintf(stderr,
+"\t-n nthreads  Number of threads for \"-r\". Default is one per CPU.\n");
+        (void)fprintf(stderr,
 "\t-v           Verbose\n");
         (void)fprintf(stderr,
 "\t-l dest      Log to `dest`. One of: \"\" (system logging daemon), \"-\"\n"
@@ -100,7 +106,9 @@ set_sigactions(void)
  *              if "-F" option used.
  *      3       Write-count of product-queue is greater than zero.  Not possible
  *              if "-F" option used.
- *      4       The product-queue is internally inconsistent.
+ *      4       The product-queue is internally inconsistent (e.g., its
+ *              time-index). If the "-r" option was used, then the product-queue
+ *              couldn't be recovered and must be recreated.
  */
 int main(int ac, char *av[])
 {
@@ -108,6 +116,8 @@ int main(int ac, char *av[])
         int status = 0;
         unsigned write_count;
         int force = 0;
+        int recover = 0;
+        unsigned nthreads = 0;
 
         /*
          * Set up error logging.
@@ -122,11 +132,25 @@ int main(int ac, char *av[])
             pqfname = getQueuePath();
             opterr = 1;
 
-            while ((ch = getopt(ac, av, "Fvxl:q:")) != EOF)
+            while ((ch = getopt(ac, av, "Fn:rvxl:q:")) != EOF)
                     switch (ch) {
                     case 'F':
                             force = 1;
                             break;
+                    case 'n': {
+                            char*         end;
+                            unsigned long n = strtoul(optarg, &end, 0);
+                            if (*end || end == optarg) {
+                                log_error_q("Invalid number of threads: \"%s\"",
+                                        optarg);
+                                usage(progname);
+                            }
+                            nthreads = n;
+                            break;
+                    }
+                    case 'r':
+                            recover = 1;
+                            break;
                     case 'v':
                             if (!log_is_enabled_info)
                                 (void)log_set_level(LOG_LEVEL_INFO);
@@ -163,7 +187,38 @@ int main(int ac, char *av[])
          */
         set_sigactions();
 
-        if (force) {
+        if (recover) {
+            /*
+             * Verify the indexes of the product-queue against its
+             * data-products, rebuild those that are inconsistent, and set the
+             * writer-counter to zero.
+             */
+            unsigned rebuilt;
+            size_t   nprods, nfreed;
+
+            status = pq_recover(pqfname, nthreads, &rebuilt, &nprods, &nfreed);
+            if (status) {
+                if (PQ_CORRUPT == status) {
+                    log_error_q("The product-queue \"%s\" can't be recovered",
+                            pqfname);
+                    return 4;
+                }
+                log_error_q("pq_recover() failure: %s: %s", pqfname,
+                        strerror(status));
+                return 1;
+            }
+            if (rebuilt || nfreed)
+                log_notice_q("Recovered product-queue \"%s\": %lu data-products "
+                        "kept, %lu regions freed, rebuilt:%s%s%s%s%s", pqfname,
+                        (unsigned long)nprods, (unsigned long)nfreed,
+                        (rebuilt & PQ_RECOVER_REGIONS) ? " region-list" : "",
+                        (rebuilt & PQ_RECOVER_TIMES) ? " time-index" : "",
+                        (rebuilt & PQ_RECOVER_SIGS) ? " signature-index" : "",
+                        (rebuilt & PQ_RECOVER_EVSIGS) ? " evicted-signatures" : "",
+                        rebuilt ? "" : " nothing");
+            write_count = 0;
+        }
+        else if (force) {
             /*
              * Add writer-counter capability to the file, if necessary, and set
              * the writer-counter to zero.
@@ -207,5 +262,21 @@ int main(int ac, char *av[])
 
         log_info_q("The writer-counter of the product-queue is %u", write_count);
 
+        /*
+         * Check the time-index of the product-queue.
+         */
+        status = pq_check_time_index(pqfname);
+        if (status) {
+            if (PQ_CORRUPT == status) {
+                log_error_q("The time-index of product-queue \"%s\" is "
+                        "inconsistent", pqfname);
+                return 4;
+            }
+            log_error_q("pq_check_time_index() failure: %s: %s", pqfname,
+                    strerror(status));
+            return 1;
+        }
+        log_info_q("The time-index of the product-queue is consistent");
+
         return write_count == 0 ? 0 : 3;
 }
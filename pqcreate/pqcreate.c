@@ -16,6 +16,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include "ldm.h"
+#include "atofeedt.h"
 #include "globals.h"
 #include "log.h"
 #include "pq.h"
@@ -30,7 +31,33 @@ Usage: %s [options] <initialsz>[k|m|g] <pqfname>\n\
 Options:\n\
         -v\n\
         -c\n\
+        -C           Notify insertions by SIGCONT to the process group\n\
+                     (compatibility with older LDM programs)\n\
+        -L           Lock the queue with a robust, process-shared lock in the\n\
+                     queue rather than fcntl(2)\n\
+        -R           Index products by insertion-time with a circular array\n\
+                     rather than a skip list\n\
+        -O           Index products by signature with an open-addressed hash\n\
+                     table rather than a chained one\n\
+        -F           Record the feedtype of each product in the time-index\n\
+                     so that readers skip unwanted products cheaply\n\
+        -P           Allocate small products from free lists of\n\
+                     size-classes rather than by extent\n\
+        -K           Store a large product for which there's no contiguous\n\
+                     free space as a chain of chunks\n\
+        -z feedtype  Compress the data of products of the given feedtype\n\
+                     with zlib when that saves space\n\
+        -E hours     Reject a product that was evicted less than `hours`\n\
+                     ago as a duplicate\n\
+        -H           Advise transparent huge pages for the mapping of the\n\
+                     queue\n\
+        -M           Pre-fault the mapping of the queue\n\
+        -N node      Bind the memory of the queue to NUMA node `node`\n\
+                     (\"none\" for no binding)\n\
         -f\n\
+        -g           Grow the existing queue in place, while it's in use, to\n\
+                     the given size and number of products (by default, in\n\
+                     proportion to the size)\n\
         -l dest      Log to `dest`. One of: \"\" (system logging daemon),\n\
                      \"-\" (standard error), or file `dest`. Default is\n\
                      \"%s\"\n\
@@ -54,6 +81,7 @@ int main(int ac, char *av[])
         size_t nproducts = 0;
         pqueue *pq = NULL;
         int errnum = 0;
+        int grow = 0;
 
         /*
          * initialize logger
@@ -67,8 +95,15 @@ int main(int ac, char *av[])
         extern char     *optarg;
         extern int       optind;
         const char* pqfname = getQueuePath();
+        feedtypet zipfeeds = NONE;
+        char *Eopt = NULL;
+        double evhours = 0;
+        int fterr;
+        int mapflags = getQueueMapFlags();
+        int node = getQueueNumaNode();
+        char *end;
 
-        while ((ch = getopt(ac, av, "xvcfq:s:S:l:")) != EOF)
+        while ((ch = getopt(ac, av, "xvcCLROFPKHMfgq:s:S:l:z:E:N:")) != EOF)
                 switch (ch) {
                 case 'v':
                         if (!log_is_enabled_info)
@@ -77,9 +112,74 @@ int main(int ac, char *av[])
                 case 'c':
                         pflags &= ~PQ_NOCLOBBER;
                         break;
+                case 'C':
+                        pflags |= PQ_SIGCONT;
+                        break;
+                case 'L':
+                        pflags |= PQ_ROBUST;
+                        break;
+                case 'R':
+                        pflags |= PQ_TQRING;
+                        break;
+                case 'O':
+                        pflags |= PQ_SXOPEN;
+                        break;
+                case 'F':
+                        pflags |= PQ_TQFEED;
+                        break;
+                case 'P':
+                        pflags |= PQ_RLCLASS;
+                        break;
+                case 'K':
+                        pflags |= PQ_CHUNKED;
+                        break;
                 case 'f':
                         pflags |= PQ_SPARSE;
                         break;
+                case 'g':
+                        grow = 1;
+                        break;
+                case 'H':
+                        mapflags |= PQ_HUGEPAGES;
+                        break;
+                case 'M':
+                        mapflags |= PQ_POPULATE;
+                        break;
+                case 'N':
+                        if(strcmp(optarg, "none") == 0)
+                        {
+                                node = -1;
+                                break;
+                        }
+                        node = (int)strtol(optarg, &end, 0);
+                        if(*end || end == optarg || node < 0)
+                        {
+                                fprintf(stderr, "Illegal NUMA node \"%s\"\n",
+                                        optarg);
+                                usage(av[0]);
+                        }
+                        break;
+                case 'z':
+                        fterr = strfeedtypet(optarg, &zipfeeds);
+                        if(fterr != FEEDTYPE_OK)
+                        {
+                                fprintf(stderr, "Bad feedtype \"%s\": %s\n",
+                                        optarg, strfeederr(fterr));
+                                usage(av[0]);
+                        }
+                        pflags |= PQ_COMPRESS;
+                        break;
+                case 'E':
+                        Eopt = optarg;
+                        evhours = atof(optarg);
+                        if(evhours <= 0)
+                        {
+                                fprintf(stderr, "Illegal hours \"%s\"\n",
+                                        Eopt);
+                                usage(av[0]);
+                        }
+                        pflags |= PQ_EVSIGS;
+                        break;
                 case 's':
                         sopt = optarg;
                         break;
@@ -180,7 +280,7 @@ int main(int ac, char *av[])
                         fprintf(stderr, "Illegal nproducts \"%s\"\n", Sopt);
                 }
         }
-        else
+        else if(!grow)
         {
 #define PQ_AVG_PRODUCT_SIZE 51000 // approximate mean size on 2014-08-21
                 /* For default number of product slots, use average product size estimate */
@@ -188,6 +288,30 @@ int main(int ac, char *av[])
         }
 
 
+        if(pq_setMapDefaults(mapflags, node))
+        {
+                log_flush_error();
+                exit(1);
+        }
+
+        if(grow)
+        {
+                log_info_q("Growing %s to %ld bytes, %ld products.\n",
+                        pqfname, (long)initialsz, (long)nproducts);
+
+                errnum = pq_grow(pqfname, pflags, initialsz, nproducts);
+                if(errnum)
+                {
+                        log_flush_error();
+                        fprintf(stderr, "%s: grow \"%s\" failed: %s\n",
+                                av[0], pqfname, errnum == PQ_CORRUPT
+                                        ? "product-queue is inconsistent"
+                                        : strerror(errnum));
+                        exit(1);
+                }
+                return(0);
+        }
+
         log_info_q("Creating %s, %ld bytes, %ld products.\n",
                 pqfname, (long)initialsz, (long)nproducts);
 
@@ -200,6 +324,33 @@ int main(int ac, char *av[])
                 exit(1);
         }
 
+        if((pflags & PQ_COMPRESS) && zipfeeds != ANY)
+        {
+                errnum = pq_setCompression(pq, zipfeeds);
+                if(errnum)
+                {
+                        fprintf(stderr, "%s: couldn't set compression of "
+                                "\"%s\": %s\n", av[0], pqfname,
+                                strerror(errnum));
+                        (void)pq_close(pq);
+                        exit(1);
+                }
+        }
+
+        if(Eopt != NULL)
+        {
+                errnum = pq_setEvictedHorizon(pq,
+                        (unsigned)(evhours*3600 + 0.5));
+                if(errnum)
+                {
+                        fprintf(stderr, "%s: couldn't set eviction horizon "
+                                "of \"%s\": %s\n", av[0], pqfname,
+                                strerror(errnum));
+                        (void)pq_close(pq);
+                        exit(1);
+                }
+        }
+
         (void)pq_close(pq);
 
         return(0);
@@ -48,7 +48,27 @@ static char             myname[HOSTNAMESIZE];
 static feedtypet        feedtype = EXP;
 #if !USE_MMAP
     static struct pqe_index pqeIndex;
+#else
+    /*
+     * Maximum number of files inserted by one call to `pq_insertv()`. Small
+     * files are inserted much faster in batches.
+     */
+    #define MAX_BATCH   64
+    /*
+     * Maximum number of bytes in a batch. Readers are blocked while a batch is
+     * copied into the product-queue, so a file at least this large is
+     * inserted by itself.
+     */
+    #define MAX_BATCH_BYTES (1024*1024)
 #endif
+typedef enum {
+    exit_success = 0,   /* all files inserted successfully */
+    exit_system = 1,    /* operating-system failure */
+    exit_pq_open = 2,   /* couldn't open product-queue */
+    exit_infile = 3,    /* couldn't process input file */
+    exit_dup = 4,       /* input-file already in product-queue */
+    exit_md5 = 6        /* couldn't initialize MD5 processing */
+} ExitCode;
 
 
 static void
@@ -201,6 +221,75 @@ mm_md5(MD5_CTX *md5ctxp, void *vp, size_t sz, signaturet signature)
         MD5Final((unsigned char*)signature, md5ctxp);
         return 0;
 }
+
+
+/*
+ * Logs the outcome of inserting a product.
+ *
+ * Returns the exit code for the outcome or `exit_success` if it shouldn't
+ * affect the exit code.
+ */
+static ExitCode
+report(const product* const prod, const int status)
+{
+        switch (status) {
+        case ENOERR:
+            /* no error */
+            if(log_is_enabled_info)
+                log_info_q("%s", s_prod_info(NULL, 0, &prod->info,
+                    log_is_enabled_debug)) ;
+            break;
+        case PQUEUE_DUP:
+            log_error_q("Product already in queue: %s",
+                s_prod_info(NULL, 0, &prod->info, 1));
+            return exit_dup;
+        case PQUEUE_BIG:
+            log_error_q("Product too big for queue: %s",
+                s_prod_info(NULL, 0, &prod->info, 1));
+            return exit_infile;
+        case ENOMEM:
+            log_error_q("queue full?");
+            return exit_system;
+        case EINTR:
+#if defined(EDEADLOCK) && EDEADLOCK != EDEADLK
+        case EDEADLOCK:
+            /*FALLTHROUGH*/
+#endif
+        case EDEADLK:
+            /* TODO: retry ? */
+            /*FALLTHROUGH*/
+        default:
+            log_error_q("pq_insert: %s", status > 0
+                ? strerror(status) : "Internal error");
+            break;
+        }
+        return exit_success;
+}
+
+
+/*
+ * Inserts a batch of memory-mapped products into the product-queue under one
+ * lock, reports on each, and unmaps them.
+ *
+ * Returns the exit code of the last product that affects it or `exit_success`.
+ */
+static ExitCode
+insert_batch(product* const prods, const size_t nprods)
+{
+        int      statuses[MAX_BATCH];
+        ExitCode exitCode = exit_success;
+        int      status = nprods ? pq_insertv(pq, prods, nprods, statuses) : 0;
+
+        for (size_t i = 0; i < nprods; i++) {
+                ExitCode code = report(prods + i, status ? status : statuses[i]);
+
+                if (code != exit_success)
+                        exitCode = code;
+                (void) munmap(prods[i].data, prods[i].info.sz);
+        }
+
+        return exitCode;
+}
 #endif
 
 
@@ -217,14 +306,7 @@ int main(
         char identifier[KEYSIZE];
         int status;
         int seq_start = 0;
-        enum ExitCode {
-            exit_success = 0,   /* all files inserted successfully */
-            exit_system = 1,    /* operating-system failure */
-            exit_pq_open = 2,   /* couldn't open product-queue */
-            exit_infile = 3,    /* couldn't process input file */
-            exit_dup = 4,       /* input-file already in product-queue */
-            exit_md5 = 6        /* couldn't initialize MD5 processing */
-        } exitCode = exit_success;
+        ExitCode exitCode = exit_success;
 
         (void)log_init(progname);
 
@@ -335,6 +417,12 @@ int main(
         struct stat statb;
         product prod;
         MD5_CTX *md5ctxp = NULL;
+#if USE_MMAP
+        product batch[MAX_BATCH];
+        char idents[MAX_BATCH][KEYSIZE];
+        size_t nbatch = 0;
+        size_t nbatchBytes = 0;
+#endif
 
         /*
          * Allocate an MD5 context
@@ -419,7 +507,12 @@ int main(
                         : mm_md5(md5ctxp, prod.data, prod.info.sz,
                             prod.info.signature);
 
-                (void)exitIfDone(1);
+                if (done) {
+                    /* Insert the files that precede this one */
+                    (void) munmap(prod.data, prod.info.sz);
+                    (void) close(fd);
+                    break;
+                }
 
                 if (status != 0) {
                     log_syserr_q("mm_md5: %s", filename);
@@ -438,46 +531,29 @@ int main(
                 }
 
                 /*
-                 * Do the deed
+                 * Do the deed. The mapping outlives the file descriptor.
                  */
-                status = pq_insert(pq, &prod);
-
-                switch (status) {
-                case ENOERR:
-                    /* no error */
-                    if(log_is_enabled_info)
-                        log_info_q("%s", s_prod_info(NULL, 0, &prod.info,
-                            log_is_enabled_debug)) ;
-                    break;
-                case PQUEUE_DUP:
-                    log_error_q("Product already in queue: %s",
-                        s_prod_info(NULL, 0, &prod.info, 1));
-                    exitCode = exit_dup;
-                    break;
-                case PQUEUE_BIG:
-                    log_error_q("Product too big for queue: %s",
-                        s_prod_info(NULL, 0, &prod.info, 1));
-                    exitCode = exit_infile;
-                    break;
-                case ENOMEM:
-                    log_error_q("queue full?");
-                    exitCode = exit_system;
-                    break;  
-                case EINTR:
-#if defined(EDEADLOCK) && EDEADLOCK != EDEADLK
-                case EDEADLOCK:
-                    /*FALLTHROUGH*/
-#endif
-                case EDEADLK:
-                    /* TODO: retry ? */
-                    /*FALLTHROUGH*/
-                default:
-                    log_error_q("pq_insert: %s", status > 0
-                        ? strerror(status) : "Internal error");
-                    break;
+                if (nbatch &&
+                        nbatchBytes + prod.info.sz > MAX_BATCH_BYTES) {
+                    ExitCode code = insert_batch(batch, nbatch);
+                    if (code != exit_success)
+                        exitCode = code;
+                    nbatch = 0;
+                    nbatchBytes = 0;
+                }
+                batch[nbatch] = prod;
+                if (prod.info.ident == identifier)
+                    batch[nbatch].info.ident = strcpy(idents[nbatch],
+                            identifier);
+                nbatchBytes += prod.info.sz;
+                if (++nbatch == MAX_BATCH ||
+                        nbatchBytes >= MAX_BATCH_BYTES) {
+                    ExitCode code = insert_batch(batch, nbatch);
+                    if (code != exit_success)
+                        exitCode = code;
+                    nbatch = 0;
+                    nbatchBytes = 0;
                 }
-
-                (void) munmap(prod.data, prod.info.sz);
 #else // USE_MMAP above; !USE_MMAP below
                 status = 
                     signatureFromId
@@ -562,6 +638,15 @@ int main(
                 (void) close(fd);
         }                               /* input-file loop */
 
+#if USE_MMAP
+        {
+            ExitCode code = insert_batch(batch, nbatch);
+            if (code != exit_success)
+                exitCode = code;
+        }
+        (void)exitIfDone(1);
+#endif
+
         free_MD5_CTX(md5ctxp);  
         }                               /* code block */
 
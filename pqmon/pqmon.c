@@ -44,6 +44,10 @@
 
 static volatile sig_atomic_t    intr = 0;
 static int                      printSizePar = 0;
+static int                      printFrag = 0;
+static int                      printConsumers = 0;
+static int                      printLate = 0;
+static int                      printLocks = 0;
 
 static void
 usage(const char *av0) /*  id string */
@@ -62,6 +66,14 @@ usage(const char *av0) /*  id string */
         (void)fprintf(stderr,
 "\t             (\"interval\" of 0 means exit at end of queue)\n");
         (void)fprintf(stderr,
+"\t-f           Also report the fragmentation of the data section\n");
+        (void)fprintf(stderr,
+"\t-c           Also report how far behind each registered consumer is\n");
+        (void)fprintf(stderr,
+"\t-d           Also report late duplicates of evicted products\n");
+        (void)fprintf(stderr,
+"\t-k           Also report how long locks are waited for and held\n");
+        (void)fprintf(stderr,
 "Output defaults to standard output\n");
         exit(1);
 }
@@ -230,6 +242,249 @@ xsuspend(unsigned int maxsleep)
 
 
 
+/*
+ * Logs the fragmentation of the data section of the product-queue: the
+ * allocation policy, the free space of the size-classes, the number of
+ * data-products deleted per insertion, the largest free extent, and the
+ * histogram of free extents; and, if the product-queue compresses data, the
+ * compression ratio. Exits on failure.
+ */
+static void
+logFrag(void)
+{
+    bool               classes;
+    size_t             classbytes;
+    size_t             maxextent;
+    size_t             hist[PQ_FRAG_BINS];
+    unsigned long long ninserts;
+    unsigned long long nevictions;
+    char               buf[PQ_FRAG_BINS*24];
+    int                nbytes;
+    int                status = pq_fragStats(pq, &classes, &classbytes,
+            &maxextent, hist, &ninserts, &nevictions);
+
+    if (status) {
+        log_error_q("pq_fragStats() failed: %s (errno = %d)",
+            strerror(status), status);
+        exit(1);
+    }
+
+    log_notice_q("%s allocation: %llu insertions, %llu evictions "
+        "(%.3f/insertion), max free extent %lu",
+        classes ? "size-class" : "extent", ninserts, nevictions,
+        ninserts ? (double)nevictions/ninserts : 0.0,
+        (unsigned long)maxextent);
+    if (classes)
+        log_notice_q("size-classes: %lu free bytes", (unsigned long)classbytes);
+
+    nbytes = snprintf(buf, sizeof(buf), "<1K:%lu", (unsigned long)hist[0]);
+    for (int i = 1; i < PQ_FRAG_BINS; i++) {
+        /* Lower bound of bin `i` in KiB */
+        const unsigned long kib = 1ul << (i - 1);
+
+        nbytes += snprintf(buf + nbytes, sizeof(buf) - nbytes, " %lu%c%s:%lu",
+                kib < 1024 ? kib : kib/1024, kib < 1024 ? 'K' : 'M',
+                i == PQ_FRAG_BINS - 1 ? "+" : "", (unsigned long)hist[i]);
+    }
+    log_notice_q("free extents: %s", buf);
+
+    feedtypet          zipfeeds;
+    unsigned long long zipin, zipout;
+
+    status = pq_getCompression(pq, &zipfeeds, &zipin, &zipout);
+    if (status) {
+        log_error_q("pq_getCompression() failed: %s (errno = %d)",
+            strerror(status), status);
+        exit(1);
+    }
+    if (pq_getFlags(pq) & PQ_COMPRESS)
+        log_notice_q("compression of %s: %llu bytes to %llu (ratio %.2f)",
+            s_feedtypet(zipfeeds), zipin, zipout,
+            zipout ? (double)zipin/zipout : 0.0);
+}
+
+
+/*
+ * Logs the number of data-products rejected because they were evicted
+ * earlier, the horizon for such rejection, and how far back the signatures of
+ * evicted data-products reach. Exits on failure.
+ */
+static void
+logLate(void)
+{
+    unsigned           horizon;
+    double             history;
+    unsigned long long nlate;
+    int                status = pq_getEvictedStats(pq, &horizon, &history,
+            &nlate);
+
+    if (status == ENOTSUP) {
+        log_notice_q("late duplicates: queue doesn't remember evicted "
+            "products");
+    }
+    else if (status) {
+        log_error_q("pq_getEvictedStats() failed: %s (errno = %d)",
+            strerror(status), status);
+        exit(1);
+    }
+    else {
+        log_notice_q("late duplicates: %llu rejected, horizon %u s, history "
+            "%.0f s", nlate, horizon, history);
+    }
+}
+
+
+/*
+ * Logs the registered consumers of the product-queue: the process-ID, the lag
+ * in seconds, bytes, and data-products, and the number of data-products
+ * deleted before being read of each. Exits on failure.
+ */
+static void
+logConsumers(void)
+{
+    pq_consumer        consumers[PQ_MAXCONSUMERS];
+    size_t             count;
+    unsigned long long overruns;
+    int                status = pq_getConsumers(pq, consumers, &count,
+            &overruns);
+
+    if (status) {
+        log_error_q("pq_getConsumers() failed: %s (errno = %d)",
+            strerror(status), status);
+        exit(1);
+    }
+
+    log_notice_q("%lu consumers, %llu products deleted unread",
+        (unsigned long)count, overruns);
+    for (size_t i = 0; i < count; i++)
+        log_notice_q("consumer %ld: lag %.0f s, %lu bytes, %lu products; "
+            "%llu deleted unread", (long)consumers[i].pid, consumers[i].lag,
+            (unsigned long)consumers[i].lagBytes,
+            (unsigned long)consumers[i].lagProds, consumers[i].overruns);
+}
+
+
+/*
+ * Formats a lock time.
+ *
+ * @param[out] buf   The buffer.
+ * @param[in]  size  The size of the buffer in bytes.
+ * @param[in]  ns    The time in nanoseconds.
+ * @return           The buffer.
+ */
+static const char*
+fmtLockTime(
+        char* const        buf,
+        const size_t       size,
+        const double       ns)
+{
+    if (ns < 1e3) {
+        (void)snprintf(buf, size, "%.0f ns", ns);
+    }
+    else if (ns < 1e6) {
+        (void)snprintf(buf, size, "%.1f us", ns/1e3);
+    }
+    else if (ns < 1e9) {
+        (void)snprintf(buf, size, "%.1f ms", ns/1e6);
+    }
+    else {
+        (void)snprintf(buf, size, "%.2f s", ns/1e9);
+    }
+    return buf;
+}
+
+/*
+ * Formats a histogram of lock times. Each bin is labeled by its lower bound.
+ *
+ * @param[out] buf   The buffer.
+ * @param[in]  size  The size of the buffer in bytes.
+ * @param[in]  hist  The histogram (see PQ_LOCK_BINS).
+ * @return           The buffer.
+ */
+static const char*
+fmtLockHist(
+        char* const                     buf,
+        const size_t                    size,
+        const unsigned long long* const hist)
+{
+    int nbytes = snprintf(buf, size, "<1u:%llu", hist[0]);
+
+    for (int i = 1; i < PQ_LOCK_BINS; i++) {
+        /* Lower bound of bin `i` in units of 1024 ns */
+        const unsigned long us = 1ul << (i - 1);
+
+        nbytes += snprintf(buf + nbytes, size - nbytes, " %lu%c%s:%llu",
+                us < 1024 ? us : us/1024, us < 1024 ? 'u' : 'm',
+                i == PQ_LOCK_BINS - 1 ? "+" : "", hist[i]);
+    }
+    return buf;
+}
+
+/*
+ * Logs the statistics of the locks of the product-queue, which are
+ * accumulated by all the processes that have it open: for each kind of lock,
+ * the number of times it was acquired (and for writing), the number of times
+ * it was found to be locked, the mean and longest waits and holds, and
+ * histograms of the waits and holds. Except for the longest times, they're
+ * since the previous report. Exits on failure.
+ */
+static void
+logLocks(void)
+{
+    static const char* const  names[PQ_LOCK_KINDS] = {"control-region",
+            "product-region", "thread-mutex"};
+    static pq_lockstats       prev[PQ_LOCK_KINDS];
+    pq_lockstats              stats[PQ_LOCK_KINDS];
+    int                       status = pq_getLockStats(pq, stats);
+
+    if (status == ENOTSUP) {
+        log_notice_q("locks: queue hasn't been opened for writing by this "
+            "version of the LDM");
+        return;
+    }
+    if (status) {
+        log_error_q("pq_getLockStats() failed: %s (errno = %d)",
+            strerror(status), status);
+        exit(1);
+    }
+
+    for (int kind = 0; kind < PQ_LOCK_KINDS; kind++) {
+        pq_lockstats        d = stats[kind]; // Since the previous report
+        pq_lockstats* const old = prev + kind;
+        char                buf[PQ_LOCK_BINS*24];
+        char                wmean[16], wmax[16], hmean[16], hmax[16];
+
+        d.count -= old->count;
+        d.writes -= old->writes;
+        d.retries -= old->retries;
+        d.waitNs -= old->waitNs;
+        d.holdNs -= old->holdNs;
+        for (int i = 0; i < PQ_LOCK_BINS; i++) {
+            d.wait[i] -= old->wait[i];
+            d.hold[i] -= old->hold[i];
+        }
+        *old = stats[kind];
+
+        if (d.count == 0 && d.retries == 0)
+            continue;
+
+        log_notice_q("%s lock: %llu acquired (%llu for writing), %llu found "
+            "locked; wait mean %s, max %s; hold mean %s, max %s", names[kind],
+            d.count, d.writes, d.retries,
+            fmtLockTime(wmean, sizeof(wmean),
+                d.count ? (double)d.waitNs/d.count : 0),
+            fmtLockTime(wmax, sizeof(wmax), d.waitMax),
+            fmtLockTime(hmean, sizeof(hmean),
+                d.count ? (double)d.holdNs/d.count : 0),
+            fmtLockTime(hmax, sizeof(hmax), d.holdMax));
+        log_notice_q("%s waits: %s", names[kind],
+            fmtLockHist(buf, sizeof(buf), d.wait));
+        log_notice_q("%s holds: %s", names[kind],
+            fmtLockHist(buf, sizeof(buf), d.hold));
+    }
+}
+
+
 int
 main(int ac, char *av[])
 {
@@ -253,7 +508,7 @@ main(int ac, char *av[])
 
         opterr = 1;
 
-        while ((ch = getopt(ac, av, "Sevxl:q:o:i:")) != EOF)
+        while ((ch = getopt(ac, av, "Sefcdkvxl:q:o:i:")) != EOF)
             switch (ch) {
             case 'v':
                 if (!log_is_enabled_info)
@@ -286,6 +541,22 @@ main(int ac, char *av[])
                 printSizePar = 1;
                 break;
             }
+            case 'f': {
+                printFrag = 1;
+                break;
+            }
+            case 'c': {
+                printConsumers = 1;
+                break;
+            }
+            case 'd': {
+                printLate = 1;
+                break;
+            }
+            case 'k': {
+                printLocks = 1;
+                break;
+            }
             case '?':
                 usage(progname);
                 break;
@@ -465,6 +736,14 @@ main(int ac, char *av[])
                     nprods,   nfree,   nempty, nbytes,
                     maxprods, maxfree, minempty, maxextent, age_oldest);
             }
+            if (printFrag)
+                logFrag();
+            if (printConsumers)
+                logConsumers();
+            if (printLate)
+                logLate();
+            if (printLocks)
+                logLocks();
             if(list_extents) {
                 status = pq_fext_dump(pq);
             }
@@ -0,0 +1,363 @@
+/*
+ *   Copyright 2026 University Corporation for Atmospheric Research
+ *   See ../COPYRIGHT file for copying and redistribution conditions.
+ */
+
+/*
+ * Keeps free space in the product-queue by deleting the oldest data-products
+ * before inserters have to, so that an insertion seldom deletes a
+ * data-product in its critical section.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "globals.h"
+#include "ldm.h"
+#include "log.h"
+#include "pq.h"
+
+#ifndef DEFAULT_INTERVAL
+#define DEFAULT_INTERVAL 30
+#endif
+/* Default watermarks as a fraction of the capacity of the product-queue */
+#ifndef DEFAULT_FRACTION
+#define DEFAULT_FRACTION 0.05
+#endif
+
+static volatile sig_atomic_t stats_req;
+static unsigned long         npasses;   /* number of evictions */
+static unsigned long         ndeleted;  /* number of products deleted */
+
+
+static void
+dump_stats(void)
+{
+        log_notice_q("> Evictions: %lu; products deleted: %lu", npasses,
+                ndeleted);
+}
+
+
+static void
+usage(const char *av0)
+{
+        (void)fprintf(stderr,
+"Usage: %s [options]\n"
+"Options:\n"
+"        -v           Verbose, report each eviction\n"
+"        -x           Debug mode\n"
+"        -l dest      Log to `dest`. One of: \"\" (system logging daemon),\n"
+"                     \"-\" (standard error), or file `dest`. Default is\n"
+"                     \"%s\"\n"
+"        -q queue     Product-queue. Default is \"%s\"\n"
+"        -b minfree   Keep a free region of at least `minfree` bytes.\n"
+"                     Suffixes k, m, and g are accepted. Default is %g%%\n"
+"                     of the data portion of the queue.\n"
+"        -s minslots  Keep at least `minslots` product-slots empty. Default\n"
+"                     is %g%% of the product-slots.\n"
+"        -i interval  Check at least every `interval` seconds (default %d)\n",
+                av0, log_get_default_destination(), getDefaultQueuePath(),
+                100*DEFAULT_FRACTION, 100*DEFAULT_FRACTION, DEFAULT_INTERVAL);
+        exit(1);
+}
+
+
+static void
+cleanup(void)
+{
+        log_notice_q("Exiting");
+
+        dump_stats();
+
+        if(pq != NULL)
+        {
+                (void)pq_close(pq);
+                pq = NULL;
+        }
+
+        log_fini();
+}
+
+
+static void
+signal_handler(int sig)
+{
+        switch(sig) {
+        case SIGINT :
+                exit(0);
+        case SIGTERM :
+                done = !0;
+                return;
+        case SIGUSR1 :
+                log_refresh();
+                stats_req = !0;
+                return;
+        case SIGUSR2 :
+                log_roll_level();
+                return;
+        }
+}
+
+
+static void
+set_sigactions(void)
+{
+        struct sigaction sigact;
+
+        (void) sigemptyset(&sigact.sa_mask);
+
+        /* Don't restart: interrupt waiting for an insertion */
+        sigact.sa_flags = 0;
+        sigact.sa_handler = signal_handler;
+        (void) sigaction(SIGUSR1, &sigact, NULL);
+        (void) sigaction(SIGUSR2, &sigact, NULL);
+        (void) sigaction(SIGTERM, &sigact, NULL);
+        (void) sigaction(SIGINT, &sigact, NULL);
+
+        sigset_t sigset;
+        (void)sigemptyset(&sigset);
+        (void)sigaddset(&sigset, SIGUSR1);
+        (void)sigaddset(&sigset, SIGUSR2);
+        (void)sigaddset(&sigset, SIGTERM);
+        (void)sigaddset(&sigset, SIGINT);
+        (void)sigprocmask(SIG_UNBLOCK, &sigset, NULL);
+}
+
+
+/*
+ * Decodes a size in bytes with an optional suffix of k, m, or g. Returns 0 if
+ * the size is invalid.
+ */
+static size_t
+decodeSize(const char* const arg)
+{
+        char*         cp;
+        unsigned long size;
+
+        errno = 0;
+        size = strtoul(arg, &cp, 0);
+        if(errno || cp == arg)
+                return 0;
+        switch(*cp) {
+        case 'g':
+        case 'G':
+                size *= 1000;
+                /* FALLTHROUGH */
+        case 'm':
+        case 'M':
+                size *= 1000;
+                /* FALLTHROUGH */
+        case 'k':
+        case 'K':
+                size *= 1000;
+                cp++;
+                break;
+        }
+        return *cp ? 0 : size;
+}
+
+
+/*
+ * Waits until a data-product is inserted or `interval` seconds elapse.
+ */
+static void
+waitForInsert(
+        const unsigned seq,
+        const int      haveSeq,
+        const int      interval)
+{
+        if(haveSeq)
+        {
+                const struct timespec timeout = {interval, 0};
+                (void)pq_waitForInsert(pq, seq, &timeout);
+        }
+        else
+        {
+                (void)pq_suspend(interval);
+        }
+}
+
+
+int main(
+        int   ac,
+        char* av[])
+{
+        int         status;
+        int         interval = DEFAULT_INTERVAL;
+        size_t      minFree = 0;
+        size_t      minSlots = 0;
+        const char* sopt = NULL;
+        const char* bopt = NULL;
+
+        /*
+         * initialize logger
+         */
+        (void)log_init(av[0]);
+
+        {
+        extern int optind;
+        extern int opterr;
+        extern char *optarg;
+        int ch;
+
+        opterr = 1;
+
+        while ((ch = getopt(ac, av, "vxl:q:b:s:i:")) != EOF)
+                switch (ch) {
+                case 'v':
+                        if (!log_is_enabled_info)
+                            (void)log_set_level(LOG_LEVEL_INFO);
+                        break;
+                case 'x':
+                        (void)log_set_level(LOG_LEVEL_DEBUG);
+                        break;
+                case 'l':
+                        (void)log_set_destination(optarg);
+                        break;
+                case 'q':
+                        setQueuePath(optarg);
+                        break;
+                case 'b':
+                        bopt = optarg;
+                        minFree = decodeSize(optarg);
+                        if(minFree == 0)
+                        {
+                                (void) fprintf(stderr,
+                                        "%s: invalid size \"%s\"\n",
+                                        av[0], optarg);
+                                usage(av[0]);
+                        }
+                        break;
+                case 's':
+                        sopt = optarg;
+                        minSlots = strtoul(optarg, NULL, 0);
+                        if(minSlots == 0)
+                        {
+                                (void) fprintf(stderr,
+                                        "%s: invalid number of slots \"%s\"\n",
+                                        av[0], optarg);
+                                usage(av[0]);
+                        }
+                        break;
+                case 'i':
+                        interval = atoi(optarg);
+                        if(interval <= 0)
+                        {
+                                (void) fprintf(stderr,
+                                        "%s: invalid interval %s\n",
+                                         av[0], optarg);
+                                usage(av[0]);
+                        }
+                        break;
+                case '?':
+                        usage(av[0]);
+                        break;
+                }
+        if(ac - optind != 0)
+                usage(av[0]);
+        }
+
+        log_notice_q("Starting Up");
+
+        /*
+         * Open the product queue
+         */
+        const char* const pqfname = getQueuePath();
+        status = pq_open(pqfname, PQ_DEFAULT, &pq);
+        if(status)
+        {
+                if (PQ_CORRUPT == status) {
+                    log_error_q("The product-queue \"%s\" is inconsistent\n",
+                            pqfname);
+                }
+                else {
+                    log_error_q("pq_open failed: %s: %s",
+                            pqfname, strerror(status));
+                }
+                exit(1);
+        }
+
+        if(atexit(cleanup) != 0)
+        {
+                log_syserr_q("atexit");
+                exit(1);
+        }
+
+        set_sigactions();
+
+        /*
+         * Deleting down to twice the watermarks lets an eviction delete many
+         * products at once rather than one per insertion.
+         */
+        {
+                const size_t dataSize = pq_getDataSize(pq);
+                const size_t nslots = pq_getSlotCount(pq);
+
+                if(bopt == NULL)
+                        minFree = DEFAULT_FRACTION * dataSize;
+                if(sopt == NULL)
+                        minSlots = DEFAULT_FRACTION * nslots;
+                if(minFree > dataSize/2 || minSlots > nslots/2)
+                {
+                        log_error_q("Watermarks (%lu bytes, %lu slots) are "
+                                "more than half the capacity of the "
+                                "product-queue (%lu bytes, %lu slots)",
+                                (unsigned long)minFree,
+                                (unsigned long)minSlots,
+                                (unsigned long)dataSize,
+                                (unsigned long)nslots);
+                        exit(1);
+                }
+                log_notice_q("Keeping %lu bytes and %lu slots free",
+                        (unsigned long)minFree, (unsigned long)minSlots);
+        }
+
+        /*
+         * Main loop
+         */
+        while(exitIfDone(0))
+        {
+                unsigned seq;
+                int      haveSeq = pq_getInsertSeq(pq, &seq) == 0;
+                size_t   nempty, maxextent;
+
+                if(stats_req)
+                {
+                        dump_stats();
+                        stats_req = 0;
+                }
+
+                status = pq_stats(pq, NULL, NULL, &nempty, NULL, NULL, NULL,
+                        NULL, NULL, NULL, &maxextent);
+                if(status)
+                {
+                        log_errno_q(status, "pq_stats() failed");
+                        exit(1);
+                }
+
+                if(maxextent < minFree || nempty < minSlots)
+                {
+                        size_t n;
+
+                        status = pq_evict(pq, 2*minFree, 2*minSlots, &n);
+                        npasses++;
+                        ndeleted += n;
+                        log_info_q("Deleted %lu products", (unsigned long)n);
+                        /* If the rest are locked, then try again later */
+                        if(status && status != EACCES)
+                        {
+                                log_error_q("pq_evict() failed");
+                                exit(1);
+                        }
+                }
+
+                waitForInsert(seq, haveSeq, interval);
+        }
+
+        exit(0);
+}
@@ -574,7 +574,7 @@ static int executeConnection(void) {
 
                         /* Wait for more products to send. */
                         exitIfDone(INTERRUPTED);
-                        pq_suspend(interval);
+                        pq_wait(pq, interval);
                     } else if (EAGAIN == status || EACCES == status) {
                         log_debug("Hit a lock");
                     } else if (EIO == status) {
@@ -843,7 +843,7 @@ int main(int ac, char *av[])
 
                 (void) expire(opq, interval, age);
 
-                pq_suspend(interval);
+                pq_wait(pq, interval);
 
                 (void) reap_act(WNOHANG);
         }
@@ -556,7 +556,7 @@ forn_5_svc(prod_class_t *want, struct svc_req *rqstp, const char *ident,
                         break;
                 }
 
-                pq_suspend(interval);
+                pq_wait(pq, interval);
                         
         }
         
@@ -56,7 +56,7 @@ static UpFilter* _upFilter; /* filters data-products */
 static up6_mode_t _mode; /* FEED, NOTIFY */
 static int _socket = -1; /* socket # */
 static int _isPrimary; /* use HEREIS or CSBD */
-static unsigned _interval; /* pq_suspend() interval */
+static unsigned _interval; /* pq_wait() interval */
 static const char* _downName; /* downstream host name */
 static time_t _lastSendTime; /* time of last activity */
 static int _flushNeeded; /* connection needs a flush? */
@@ -523,7 +523,7 @@ static up6_error_t up6_run(
                             }
                             else {
                                 (void) exitIfDone(0);
-                                (void) pq_suspend(
+                                (void) pq_wait(_pq,
                                         _interval - timeSinceLastSend);
                             }
                         }
@@ -580,7 +580,7 @@ static void up6_destroy(
  *      signature       Pointer to the signature of the last, successfully-
  *                      received data-product.  May be NULL.
  *      pqPath          Pointer to pathname of product-queue.
- *      interval        pq_suspend() interval in seconds.
+ *      interval        pq_wait() interval in seconds.
  *      upFilter        Pointer to product-class for filtering data-products.
  *                      May not be NULL.
  *      mode            Transfer mode: FEED or NOTIFY.
@@ -709,7 +709,7 @@ static up6_error_t up6_init(
  *                      received data-product.  May be NULL.
  *      pqPath          Pointer to pathname of product-queue.  Caller may
  *                      free or modify on return.
- *      interval        pq_suspend() interval in seconds.
+ *      interval        pq_wait() interval in seconds.
  *      upFilter        Pointer to product-class for filtering data-products.
  *                      May not be NULL.
  *      isPrimary       Whether data-product exchange-mode should be
@@ -761,7 +761,7 @@ int up6_new_feeder(
  *                      received data-product.  May be NULL.
  *      pqPath          Pointer to pathname of product-queue.  Caller may
  *                      free or modify on return.
- *      interval        pq_suspend() interval in seconds.
+ *      interval        pq_wait() interval in seconds.
  *      upFilter        Pointer to product-class for filtering data-products.
  *                      May not be NULL.
  * Returns:
@@ -7,6 +7,7 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <limits.h>
 #include <rpc/rpc.h>  /* svc_req */
 #include <stddef.h>
@@ -448,6 +449,98 @@ isAntiDosEnabled(void)
     return isEnabled;
 }
 
+/**
+ * Returns the flags for memory-mapping the product-queue that are set in the
+ * registry.
+ *
+ * @return  Bitwise OR of PQ_HUGEPAGES and PQ_POPULATE (see `pq_open()`).
+ */
+int
+getQueueMapFlags(void)
+{
+    static int flags;
+    static int isSet = 0;
+
+    if (!isSet) {
+        const struct {
+            const char* path;
+            int         flag;
+        }        params[] = {{REG_QUEUE_HUGE_PAGES, PQ_HUGEPAGES},
+                             {REG_QUEUE_POPULATE, PQ_POPULATE}};
+
+        for (int i = 0; i < sizeof(params)/sizeof(*params); i++) {
+            unsigned isEnabled;
+            int      status = reg_getBool(params[i].path, &isEnabled);
+
+            if (status == 0) {
+                if (isEnabled)
+                    flags |= params[i].flag;
+            }
+            else {
+                log_add("Using default value: FALSE");
+                if (status == ENOENT) {
+                    log_flush_info();
+                }
+                else {
+                    log_flush_warning();
+                }
+            }
+        }
+        isSet = 1;
+    }
+
+    return flags;
+}
+
+/**
+ * Returns the NUMA node to which the memory of the product-queue is bound
+ * according to the registry.
+ *
+ * @return     The NUMA node.
+ * @retval -1  The memory isn't bound.
+ */
+int
+getQueueNumaNode(void)
+{
+    static int node = -1;
+    static int isSet = 0;
+
+    if (!isSet) {
+        char* var;
+        int   status = reg_getString(REG_QUEUE_NUMA_NODE, &var);
+
+        if (status == 0) {
+            char* end;
+            long  value = strtol(var, &end, 0);
+
+            if (strcmp(var, "none") == 0) {
+                node = -1;
+            }
+            else if (*end || end == var || value < 0 || value > INT_MAX) {
+                log_add("Invalid NUMA node: \"%s\"", var);
+                log_add("Using default value: none");
+                log_flush_error();
+            }
+            else {
+                node = value;
+            }
+            free(var);
+        }
+        else {
+            log_add("Using default value: none");
+            if (status == ENOENT) {
+                log_flush_info();
+            }
+            else {
+                log_flush_warning();
+            }
+        }
+        isSet = 1;
+    }
+
+    return node;
+}
+
 /**
  * Returns the backlog time-offset for making requests of an upstream LDM.
  *
@@ -446,7 +446,7 @@ int main(int ac, char *av[])
                         break;
                 }
 
-                pq_suspend(interval);
+                pq_wait(pq, interval);
         }
 
         return 0;